@@ -55,6 +55,66 @@ if errorlevel 1 goto error
 cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\adb_wrapper.c /Fo%BUILD_DIR%\adb_wrapper.obj
 if errorlevel 1 goto error
 
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\adb_client.c /Fo%BUILD_DIR%\adb_client.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\process_runner.c /Fo%BUILD_DIR%\process_runner.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\shell_session.c /Fo%BUILD_DIR%\shell_session.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\sync_client.c /Fo%BUILD_DIR%\sync_client.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\resumable_transfer.c /Fo%BUILD_DIR%\resumable_transfer.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\thread_pool.c /Fo%BUILD_DIR%\thread_pool.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\sha256.c /Fo%BUILD_DIR%\sha256.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\decompress.c /Fo%BUILD_DIR%\decompress.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\zip_archive.c /Fo%BUILD_DIR%\zip_archive.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\payload.c /Fo%BUILD_DIR%\payload.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\super_image.c /Fo%BUILD_DIR%\super_image.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\tar_stream.c /Fo%BUILD_DIR%\tar_stream.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\sparse_image.c /Fo%BUILD_DIR%\sparse_image.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\progress.c /Fo%BUILD_DIR%\progress.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\prop_cache.c /Fo%BUILD_DIR%\prop_cache.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\fastboot_client.c /Fo%BUILD_DIR%\fastboot_client.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\fastboot_var_cache.c /Fo%BUILD_DIR%\fastboot_var_cache.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\flash_plan.c /Fo%BUILD_DIR%\flash_plan.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\flash_ledger.c /Fo%BUILD_DIR%\flash_ledger.obj
+if errorlevel 1 goto error
+
+cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\image_check.c /Fo%BUILD_DIR%\image_check.obj
+if errorlevel 1 goto error
+
 cl /nologo /W3 /O2 /DUNICODE /D_UNICODE /I%INC_DIR% /c %SRC_DIR%\device_manager.c /Fo%BUILD_DIR%\device_manager.obj
 if errorlevel 1 goto error
 
@@ -74,12 +134,32 @@ link /nologo /subsystem:console ^
    %BUILD_DIR%\main.obj ^
    %BUILD_DIR%\utils.obj ^
    %BUILD_DIR%\adb_wrapper.obj ^
+   %BUILD_DIR%\adb_client.obj ^
+   %BUILD_DIR%\process_runner.obj ^
+   %BUILD_DIR%\shell_session.obj ^
+   %BUILD_DIR%\sync_client.obj ^
+   %BUILD_DIR%\resumable_transfer.obj ^
+   %BUILD_DIR%\thread_pool.obj ^
+   %BUILD_DIR%\sha256.obj ^
+   %BUILD_DIR%\decompress.obj ^
+   %BUILD_DIR%\zip_archive.obj ^
+   %BUILD_DIR%\payload.obj ^
+   %BUILD_DIR%\super_image.obj ^
+   %BUILD_DIR%\tar_stream.obj ^
+   %BUILD_DIR%\sparse_image.obj ^
+   %BUILD_DIR%\progress.obj ^
+   %BUILD_DIR%\prop_cache.obj ^
+   %BUILD_DIR%\fastboot_client.obj ^
+   %BUILD_DIR%\fastboot_var_cache.obj ^
+   %BUILD_DIR%\flash_plan.obj ^
+   %BUILD_DIR%\flash_ledger.obj ^
+   %BUILD_DIR%\image_check.obj ^
    %BUILD_DIR%\device_manager.obj ^
    %BUILD_DIR%\file_transfer.obj ^
    %BUILD_DIR%\resource_extractor.obj ^
    %BUILD_DIR%\cli.obj ^
    %BUILD_DIR%\resources.res ^
-   user32.lib kernel32.lib shell32.lib ole32.lib
+   user32.lib kernel32.lib shell32.lib ole32.lib ws2_32.lib wininet.lib
 
 if errorlevel 1 goto error
 
@@ -23,9 +23,69 @@ if errorlevel 1 goto error
 gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/adb_wrapper.c -o build/adb_wrapper.o
 if errorlevel 1 goto error
 
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/adb_client.c -o build/adb_client.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/process_runner.c -o build/process_runner.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/shell_session.c -o build/shell_session.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/sync_client.c -o build/sync_client.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/resumable_transfer.c -o build/resumable_transfer.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/thread_pool.c -o build/thread_pool.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/sha256.c -o build/sha256.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/decompress.c -o build/decompress.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/zip_archive.c -o build/zip_archive.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/payload.c -o build/payload.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/super_image.c -o build/super_image.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/tar_stream.c -o build/tar_stream.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/sparse_image.c -o build/sparse_image.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/progress.c -o build/progress.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/prop_cache.c -o build/prop_cache.o
+if errorlevel 1 goto error
+
 gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/fastboot_wrapper.c -o build/fastboot_wrapper.o
 if errorlevel 1 goto error
 
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/fastboot_client.c -o build/fastboot_client.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/fastboot_var_cache.c -o build/fastboot_var_cache.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/flash_plan.c -o build/flash_plan.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/flash_ledger.c -o build/flash_ledger.o
+if errorlevel 1 goto error
+
+gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/image_check.c -o build/image_check.o
+if errorlevel 1 goto error
+
 gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/device_manager.c -o build/device_manager.o
 if errorlevel 1 goto error
 
@@ -45,7 +105,7 @@ gcc -Wall -O2 -DUNICODE -D_UNICODE -Iinclude -c src/module_installer.c -o build/
 if errorlevel 1 goto error
 
 echo Step 3: Linking...
-gcc build/main.o build/utils.o build/adb_wrapper.o build/fastboot_wrapper.o build/device_manager.o build/file_transfer.o build/fastboot_manager.o build/resource_extractor.o build/cli.o build/module_installer.o build/resources.o -o build/FolkAdb.exe -mconsole -luser32 -lkernel32 -lshell32 -lole32
+gcc build/main.o build/utils.o build/adb_wrapper.o build/adb_client.o build/process_runner.o build/shell_session.o build/sync_client.o build/resumable_transfer.o build/thread_pool.o build/sha256.o build/decompress.o build/zip_archive.o build/payload.o build/super_image.o build/tar_stream.o build/sparse_image.o build/progress.o build/prop_cache.o build/fastboot_wrapper.o build/fastboot_client.o build/fastboot_var_cache.o build/flash_plan.o build/flash_ledger.o build/image_check.o build/device_manager.o build/file_transfer.o build/fastboot_manager.o build/resource_extractor.o build/cli.o build/module_installer.o build/resources.o -o build/FolkAdb.exe -mconsole -luser32 -lkernel32 -lshell32 -lole32 -lws2_32 -lwininet
 if errorlevel 1 goto error
 
 echo.
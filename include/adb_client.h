@@ -0,0 +1,72 @@
+#ifndef ADB_CLIENT_H
+#define ADB_CLIENT_H
+
+#include "common.h"
+#include "process_runner.h"
+
+// Native client for the adb server smart-socket protocol.
+// The server address defaults to tcp:127.0.0.1:5037 and can be overridden with
+// ADB_SERVER_SOCKET=tcp:<host>:<port> or ANDROID_ADB_SERVER_PORT, the same
+// variables adb.exe honours, so a local stand-in server can be used instead.
+
+#define ADB_SERVER_DEFAULT_HOST "127.0.0.1"
+#define ADB_SERVER_DEFAULT_PORT 5037
+
+// Shell protocol v2 packet ids
+#define SHELL_ID_STDIN      0
+#define SHELL_ID_STDOUT     1
+#define SHELL_ID_STDERR     2
+#define SHELL_ID_EXIT       3
+#define SHELL_ID_CLOSE_STDIN 4
+
+// adbd's shell protocol stdin buffer is 4 KB including the header
+#define SHELL_STDIN_PAYLOAD 4000
+
+// Server connection
+void AdbClientSetServer(const char* host, int port);
+int AdbClientIsAvailable(void);
+int AdbClientGetServerVersion(void);
+void AdbClientCleanup(void);
+
+// Low-level service access
+SOCKET AdbClientConnect(void);
+SOCKET AdbClientOpenService(const char* device_serial, const char* service);
+char* AdbClientQuery(const char* service);
+int AdbClientSendAll(SOCKET sock, const void* data, size_t len);
+int AdbClientRecvAll(SOCKET sock, void* data, size_t len);
+int AdbClientDeviceHasFeature(const char* device_serial, const char* feature);
+// Forget a device's cached features (it disconnected or changed state)
+void AdbClientForgetDevice(const char* device_serial);
+
+// host:track-devices-l subscription. The socket is non-blocking and signals
+// event (FD_READ/FD_CLOSE) so it can sit in a WaitForMultipleObjects set.
+typedef struct {
+    SOCKET sock;
+    WSAEVENT event;
+    char* buffer;       // Bytes received but not yet parsed
+    size_t size;
+    size_t capacity;
+} AdbDeviceTracker;
+
+int AdbClientTrackerOpen(AdbDeviceTracker* tracker);
+char* AdbClientTrackerRead(AdbDeviceTracker* tracker, int* closed);
+void AdbClientTrackerClose(AdbDeviceTracker* tracker);
+
+// Service wrappers returning the same ProcessResult as the spawn path
+ProcessResult* AdbClientShell(const char* device_serial, const char* command);
+ProcessResult* AdbClientShellStreaming(const char* device_serial, const char* command,
+                                       ProcessOutputCallback on_output, void* user_data);
+ProcessResult* AdbClientExec(const char* device_serial, const char* command);
+ProcessResult* AdbClientRunService(const char* device_serial, const char* service);
+ProcessResult* AdbClientDevices(void);
+
+// Feeding stdin to a "shell,v2,raw:" socket opened with AdbClientOpenService
+int AdbClientShellWriteStdin(SOCKET sock, const void* data, size_t len);
+int AdbClientShellCloseStdin(SOCKET sock);
+int AdbClientShellWaitExit(SOCKET sock, char* out, size_t out_size, int* exit_code);
+
+// Streamed install ("cmd package install -S"); NULL when the device needs adb.exe
+ProcessResult* AdbClientInstallApk(const char* device_serial, const char* apk_path,
+                                   ProgressCallback progress, void* user_data);
+
+#endif // ADB_CLIENT_H
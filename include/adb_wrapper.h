@@ -2,17 +2,25 @@
 #define ADB_WRAPPER_H
 
 #include "common.h"
+#include "process_runner.h"
 
 // Core ADB functions
 ProcessResult* RunAdbCommand(const char* adb_path, const char* args[], int arg_count);
+ProcessResult* RunAdbCommandStreaming(const char* adb_path, const char* args[], int arg_count,
+                                      ProcessOutputCallback on_output, void* user_data);
 void FreeProcessResult(ProcessResult* result);
 
 // ADB command wrappers
 ProcessResult* AdbDevices(const char* adb_path);
 ProcessResult* AdbShellCommand(const char* adb_path, const char* device_serial, const char* command);
+ProcessResult* AdbShellCommandStreaming(const char* adb_path, const char* device_serial, const char* command,
+                                        ProcessOutputCallback on_output, void* user_data);
 ProcessResult* AdbGetProp(const char* adb_path, const char* device_serial, const char* prop);
 ProcessResult* AdbPushFile(const char* adb_path, const char* device_serial,
                            const char* local_path, const char* remote_path);
+ProcessResult* AdbPushFileStreaming(const char* adb_path, const char* device_serial,
+                                    const char* local_path, const char* remote_path,
+                                    ProcessOutputCallback on_output, void* user_data);
 ProcessResult* AdbPullFile(const char* adb_path, const char* device_serial,
                            const char* remote_path, const char* local_path);
 ProcessResult* AdbInstallApk(const char* adb_path, const char* device_serial, const char* apk_path);
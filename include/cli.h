@@ -6,7 +6,7 @@
 // Command structure
 typedef struct {
     char name[64];
-    char args[256];
+    char args[1024];
 } Command;
 
 // CLI functions
@@ -25,6 +25,8 @@ int CmdInfo(AppState* state, const Command* cmd);
 int CmdShell(AppState* state, const Command* cmd);
 int CmdPush(AppState* state, const Command* cmd);
 int CmdPull(AppState* state, const Command* cmd);
+int CmdSync(AppState* state, const Command* cmd);
+int CmdBroadcastPush(AppState* state, const Command* cmd);
 int CmdInstall(AppState* state, const Command* cmd);
 int CmdUninstall(AppState* state, const Command* cmd);
 int CmdShizuku(AppState* state, const Command* cmd);
@@ -39,12 +41,16 @@ int CmdHelp(AppState* state, const Command* cmd);
 int CmdVersion(AppState* state, const Command* cmd);
 int CmdCls(AppState* state, const Command* cmd);
 int CmdCmd(AppState* state, const Command* cmd);
+int CmdPayload(AppState* state, const Command* cmd);
+int CmdSuper(AppState* state, const Command* cmd);
+int CmdLedger(AppState* state, const Command* cmd);
 
 // Fastboot command handlers
 int CmdFbDevices(AppState* state, const Command* cmd);
 int CmdFbSelect(AppState* state, const Command* cmd);
 int CmdFbInfo(AppState* state, const Command* cmd);
 int CmdFbFlash(AppState* state, const Command* cmd);
+int CmdFbFlashAll(AppState* state, const Command* cmd);
 int CmdFbErase(AppState* state, const Command* cmd);
 int CmdFbFormat(AppState* state, const Command* cmd);
 int CmdFbUnlock(AppState* state, const Command* cmd);
@@ -54,5 +60,7 @@ int CmdFbReboot(AppState* state, const Command* cmd);
 int CmdFbGetvar(AppState* state, const Command* cmd);
 int CmdFbActivate(AppState* state, const Command* cmd);
 int CmdFbWipe(AppState* state, const Command* cmd);
+int CmdFbConnect(AppState* state, const Command* cmd);
+int CmdFbDisconnect(AppState* state, const Command* cmd);
 
 #endif // CLI_H
@@ -1,6 +1,7 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <winsock2.h>
 #include <windows.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,7 +13,6 @@
 #include <conio.h>
 
 #define MAX_PATH 260
-#define MAX_DEVICES 16
 #define BUFFER_SIZE 4096
 #define APP_VERSION "1.2.0"
 
@@ -60,6 +60,9 @@ typedef struct {
     size_t stdout_size;
     size_t stderr_size;
     int exit_code;
+    int timed_out;   // Child was killed after the requested timeout
+    int cancelled;   // Child was killed because the cancel event fired
+    int truncated;   // Output exceeded the capture cap and was cut short
 } ProcessResult;
 
 // Theme mode
@@ -111,19 +114,14 @@ typedef struct {
     char adb_path[MAX_PATH];
     char fastboot_path[MAX_PATH];
     char temp_dir[MAX_PATH];
-    AdbDevice devices[MAX_DEVICES];
-    AdbDevice fastboot_devices[MAX_DEVICES];
-    int device_count;
-    int fastboot_device_count;
-    int current_device_index;
-    int current_fastboot_device_index;
-    OperationMode current_mode;
+    struct DeviceStore* device_store;   // Published device snapshots (see device_manager.h)
     int verbose;
     ThemeMode current_theme;
 } AppState;
 
 // Progress callback type
-typedef void (*ProgressCallback)(const char* filename, size_t current, size_t total);
+typedef void (*ProgressCallback)(const char* filename, unsigned long long current,
+                                 unsigned long long total, void* user_data);
 
 // Utility macros
 #define SAFE_FREE(ptr) if(ptr) { free(ptr); ptr = NULL; }
@@ -0,0 +1,37 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include "common.h"
+
+// Built-in streaming decoders for the formats devices and image stores produce:
+// gzip (deflate), raw deflate (zip entries), LZ4 (frame and legacy kernel
+// format), xz (LZMA2) and bzip2. Input is pulled from a read callback and output pushed to a write
+// callback as it is produced, so neither side has to fit in memory.
+
+typedef enum {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_GZIP,
+    COMPRESSION_LZ4,
+    COMPRESSION_DEFLATE,                // No wrapper, so never detected
+    COMPRESSION_XZ,
+    COMPRESSION_BZIP2
+} CompressionFormat;
+
+// Fill buffer with up to size compressed bytes; return the count, 0 at end of input, -1 on error
+typedef int (*DecompressReadFn)(void* buffer, size_t size, void* user_data);
+
+// Consume decompressed bytes; return 0 to abort
+typedef int (*DecompressWriteFn)(const void* data, size_t len, void* user_data);
+
+// Decode a whole stream (concatenated members/frames included). Returns 1 on
+// success, 0 on corrupt or truncated input, a read error or an aborted write.
+int DecompressStream(CompressionFormat format, DecompressReadFn read, void* read_data,
+                     DecompressWriteFn write, void* write_data, char* error, size_t error_size);
+
+// Recognize a format from the first bytes of a stream (COMPRESSION_NONE if unknown)
+CompressionFormat DetectCompression(const unsigned char* data, size_t len);
+
+// Name for messages ("gzip", "lz4", "xz", "bzip2", "none")
+const char* CompressionName(CompressionFormat format);
+
+#endif // DECOMPRESS_H
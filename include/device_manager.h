@@ -3,10 +3,78 @@
 
 #include "common.h"
 
+// Connection state parsed from the status column of adb/fastboot devices
+typedef enum {
+    DEVICE_STATE_OTHER = 0,         // recovery, sideload, no permissions, ...
+    DEVICE_STATE_ONLINE,            // "device" or "fastboot"
+    DEVICE_STATE_OFFLINE,
+    DEVICE_STATE_UNAUTHORIZED
+} DeviceState;
+
+// Hot per-device fields, kept compact so enumeration and serial lookups stay in cache
+typedef struct {
+    unsigned int serial_hash;       // FNV-1a of serial_id, checked before any strcmp
+    unsigned char state;            // DeviceState
+    unsigned char mode;             // OperationMode the device was seen in
+} DeviceSummary;
+
+// Full device metadata, immutable once published and shared between snapshots
+typedef struct DeviceRecord DeviceRecord;
+
+// Growable device registry with a serial hash index
+typedef struct {
+    int count;
+    int capacity;
+    DeviceSummary* summaries;       // Hot: one entry per device
+    DeviceRecord** records;         // Cold: model, name, Android version, ...
+    int* index;                     // Open addressing by serial hash, -1 = empty
+    int index_capacity;             // Power of two, at least twice count
+} DeviceList;
+
+// Immutable view of the device lists, mode and selection. Writers (the monitor
+// thread and CLI commands) publish a modified copy; readers never lock.
+typedef struct DeviceSnapshot {
+    LONG64 version;
+    DeviceList adb;
+    DeviceList fastboot;
+    int current_device_index;
+    int current_fastboot_device_index;
+    OperationMode current_mode;
+    // Reclamation bookkeeping, owned by the writer side
+    struct DeviceSnapshot* next_retired;
+    LONG64 retire_epoch;
+} DeviceSnapshot;
+
+// Registry lookups on a pinned snapshot
+const AdbDevice* DeviceListAt(const DeviceList* list, int index);
+int DeviceListFind(const DeviceList* list, const char* serial);
+
+// Pins the snapshots visible at BeginSnapshotRead until EndSnapshotRead. While
+// a thread holds a pin, every lookup it makes (GetSelectedDevice, nested reads)
+// answers from the pinned snapshot, plus the thread's own writes.
+typedef struct {
+    int slot;
+} SnapshotGuard;
+
+// Snapshot lifetime
+void InitDeviceSnapshots(AppState* state);
+void FreeDeviceSnapshots(AppState* state);
+const DeviceSnapshot* BeginSnapshotRead(const AppState* state, SnapshotGuard* guard);
+void EndSnapshotRead(const AppState* state, SnapshotGuard* guard);
+
+// Operation mode (part of the snapshot)
+OperationMode GetCurrentMode(const AppState* state);
+void SetCurrentMode(AppState* state, OperationMode mode);
+
 // Device management functions
+// GetSelectedDevice and GetSelectedFastbootDevice look at the newest snapshot
+// on every call, so a device that dropped reads as NULL on the next lookup.
+// The device they return stays valid until the thread calls ReleaseDeviceHolds
+// (the interactive loop does after every command), or inside a pin, until
+// EndSnapshotRead.
 int RefreshDeviceList(AppState* state);
 int GetDeviceCount(const AppState* state);
-AdbDevice* GetSelectedDevice(const AppState* state);
+const AdbDevice* GetSelectedDevice(const AppState* state);
 int SelectDevice(AppState* state, int index);
 int SelectDeviceBySerial(AppState* state, const char* serial);
 int GetDeviceInfo(AppState* state, int device_index);
@@ -16,14 +84,16 @@ int WaitForDeviceConnection(AppState* state, int timeout_seconds);
 // Fastboot device management functions
 int RefreshFastbootDeviceList(AppState* state);
 int GetFastbootDeviceCount(const AppState* state);
-AdbDevice* GetSelectedFastbootDevice(const AppState* state);
+const AdbDevice* GetSelectedFastbootDevice(const AppState* state);
+void ReleaseDeviceHolds(const AppState* state);
 int SelectFastbootDevice(AppState* state, int index);
 int SelectFastbootDeviceBySerial(AppState* state, const char* serial);
 void PrintFastbootDeviceList(const AppState* state);
 
 // Auto-monitoring and mode switching
 void StartDeviceMonitoring(AppState* state);
-void StopDeviceMonitoring(void);
+// Returns 0 if the monitor thread was still running when the wait gave up
+int StopDeviceMonitoring(void);
 int CheckDeviceMode(AppState* state);
 void SetPromptRefreshCallback(void (*callback)(void));
 
@@ -0,0 +1,87 @@
+#ifndef FASTBOOT_CLIENT_H
+#define FASTBOOT_CLIENT_H
+
+#include "common.h"
+#include "process_runner.h"
+#include "sha256.h"
+#include "sparse_image.h"
+
+// Native client for the fastboot protocol: text commands answered by
+// INFO/TEXT progress lines and a final OKAY/FAIL, plus the DATA handshake of
+// the download phase. It speaks to the device through a FastbootTransport;
+// TCP ("tcp:<host>[:<port>]", served by fastbootd and network-capable
+// bootloaders) is implemented here, USB devices still go through fastboot.exe.
+
+#define FASTBOOT_TCP_DEFAULT_PORT 5554
+
+// Longest command and reply packet the protocol allows
+#define FASTBOOT_COMMAND_MAX 4096
+#define FASTBOOT_RESPONSE_MAX 256
+
+// Network devices remembered for the device list (fastboot connect)
+#define FASTBOOT_MAX_NETWORK_DEVICES 8
+
+// Message pipe to one device. write sends one whole message; read returns the
+// next message, or its next `size` bytes when it is longer (-1 on error, also
+// when nothing arrived within the timeout). set_timeout may be NULL.
+typedef struct FastbootTransport FastbootTransport;
+struct FastbootTransport {
+    int (*write)(FastbootTransport* transport, const void* data, size_t len);
+    int (*read)(FastbootTransport* transport, void* buffer, size_t size);
+    void (*set_timeout)(FastbootTransport* transport, unsigned int timeout_ms);
+    void (*close)(FastbootTransport* transport);
+};
+
+// Receives INFO/TEXT lines while a command runs
+typedef void (*FastbootInfoCallback)(const char* line, void* user_data);
+
+// Open protocol session with one device
+typedef struct {
+    FastbootTransport* transport;
+    FastbootInfoCallback on_info;       // NULL: print as "(bootloader) ..." like fastboot.exe
+    void* info_data;
+    char error[256];                    // Reason for the last failure
+} FastbootSession;
+
+// Serials this client can reach (everything else needs fastboot.exe)
+int FastbootClientSupports(const char* device_serial);
+
+// Session lifetime
+int FastbootClientOpen(FastbootSession* session, const char* device_serial);
+void FastbootClientClose(FastbootSession* session);
+
+// Run a command; on OKAY copies its payload to response (may be NULL) and returns 1
+int FastbootClientCommand(FastbootSession* session, const char* command, char* response, size_t response_size);
+int FastbootClientGetVar(FastbootSession* session, const char* name, char* value, size_t value_size);
+
+// Download a local image and flash it to a partition, converting raw images to
+// sparse and splitting them to the device's max-download-size (sparse_image.h).
+// The digest, when given, hashes the file while it is scanned.
+int FastbootClientFlashFile(FastbootSession* session, const char* partition, const char* image_path,
+                            Sha256Context* digest, ProgressCallback progress, void* user_data);
+// Same for an image already opened with SparseImageOpen
+int FastbootClientFlashSparse(FastbootSession* session, const char* partition, SparseImage* image,
+                              ProgressCallback progress, void* user_data);
+
+// Writes image bytes into `write` (a decompressor's output, say), keeping
+// *position at how far it is through its input; returns 0 with error set on failure
+typedef int (*FastbootImageProducer)(SparseSinkFn write, void* write_data, unsigned long long* position,
+                                     void* user_data, char* error, size_t error_size);
+
+// Flash an image that only exists as a stream: it is packed into sparse pieces
+// of at most 64 MB (or max-download-size) on a second thread, two pieces in
+// memory at a time, each uploaded and flashed as soon as it is full. Progress
+// is reported in the producer's position units against `total`.
+int FastbootClientFlashStream(FastbootSession* session, const char* partition, unsigned long long total,
+                              FastbootImageProducer produce, void* producer_data,
+                              ProgressCallback progress, void* user_data);
+
+// One-shot command with fastboot.exe-style output, for the wrapper functions
+ProcessResult* FastbootClientRun(const char* device_serial, const char* command);
+
+// Network devices listed next to the ones fastboot.exe reports
+int FastbootClientAddNetworkDevice(const char* device_serial);
+int FastbootClientRemoveNetworkDevice(const char* device_serial);
+void FastbootClientListNetworkDevices(char* buffer, size_t size);
+
+#endif // FASTBOOT_CLIENT_H
@@ -5,11 +5,22 @@
 
 // High-level fastboot operations with safety checks and user interaction
 
-// Flashing operations
-int FlashImage(AppState* state, const char* partition, const char* image_path);
+// Flashing operations. With verify, the image is hashed while it is sent and
+// checked against expected_sha256 when given (fastboot cannot read partitions back).
+// Every flash is recorded in the flash ledger (flash_ledger.h); skip_unchanged
+// leaves out images the ledger says the partition already holds. With
+// check_image, the image's headers are matched against the partition first
+// (image_check.h).
+int FlashImage(AppState* state, const char* partition, const char* image_path,
+               int verify, const char* expected_sha256, int skip_unchanged, int check_image);
 int ErasePartition(AppState* state, const char* partition);
 int FormatPartition(AppState* state, const char* partition, const char* fs_type);
 
+// Flash every image of a manifest, folder or factory zip (flash_plan.h) after a
+// single confirmation; slot/reboot override the manifest's own directives
+int FlashAll(AppState* state, const char* source, const char* slot, int reboot, const char* reboot_mode,
+             int skip_unchanged, int check_images);
+
 // Bootloader operations
 int UnlockBootloader(AppState* state);
 int LockBootloader(AppState* state);
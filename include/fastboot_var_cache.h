@@ -0,0 +1,49 @@
+#ifndef FASTBOOT_VAR_CACHE_H
+#define FASTBOOT_VAR_CACHE_H
+
+#include "common.h"
+
+// Per-device snapshot of `getvar all`, fetched once per fastboot session and
+// indexed by an open-addressing hash table. "(bootloader) " prefixes are
+// stripped, parameterized names keep their argument ("partition-size:boot_a"),
+// and values split across several lines are joined. Invalidated when the
+// device disconnects, reboots or switches slots.
+
+#define FASTBOOT_VAR_MAX_LEN 256
+
+// Room for the partition list offered by tab completion
+#define FASTBOOT_MAX_PARTITIONS 128
+
+// Make sure the snapshot for a device is loaded (returns 0 if getvar all failed)
+int FastbootVarCacheLoad(const char* fastboot_path, const char* device_serial);
+// Whether a snapshot is loaded, without fetching one
+int FastbootVarCacheIsLoaded(const char* device_serial);
+
+// Look up one variable; loads the snapshot on first use. Returns 1 if found.
+int FastbootVarCacheGet(const char* fastboot_path, const char* device_serial, const char* name,
+                        char* value_out, size_t value_size);
+
+// Typed accessors (1 if the device reports the value)
+int FastbootVarCacheGetMaxDownloadSize(const char* fastboot_path, const char* device_serial,
+                                       unsigned long long* size_out);
+int FastbootVarCacheGetCurrentSlot(const char* fastboot_path, const char* device_serial,
+                                   char* slot_out, size_t slot_size);
+int FastbootVarCacheGetIsUserspace(const char* fastboot_path, const char* device_serial, int* is_userspace_out);
+int FastbootVarCacheGetPartitionSize(const char* fastboot_path, const char* device_serial,
+                                     const char* partition, unsigned long long* size_out);
+
+// Receives each variable of a snapshot, in device order
+typedef void (*FastbootVarVisitor)(const char* name, const char* value, void* user_data);
+
+// Walk a loaded snapshot (never fetches); returns the number of variables
+int FastbootVarCacheForEach(const char* device_serial, FastbootVarVisitor visit, void* user_data);
+
+// Partition names from a loaded snapshot: each partition-size entry, plus the
+// bare name of slotted ones (boot for boot_a/boot_b). Never fetches.
+int FastbootVarCacheListPartitions(const char* device_serial, char (*names)[64], int max_count);
+
+// Drop cached data (device gone, rebooted, slot switched, or on exit)
+void FastbootVarCacheInvalidate(const char* device_serial);
+void FastbootVarCacheClear(void);
+
+#endif // FASTBOOT_VAR_CACHE_H
@@ -2,9 +2,12 @@
 #define FASTBOOT_WRAPPER_H
 
 #include "common.h"
+#include "process_runner.h"
 
 // Core fastboot functions
 ProcessResult* RunFastbootCommand(const char* fastboot_path, const char* args[], int arg_count);
+ProcessResult* RunFastbootCommandStreaming(const char* fastboot_path, const char* args[], int arg_count,
+                                           ProcessOutputCallback on_output, void* user_data);
 
 // Device management
 ProcessResult* FastbootDevices(const char* fastboot_path);
@@ -14,6 +17,9 @@ ProcessResult* FastbootGetAllVars(const char* fastboot_path, const char* device_
 // Flashing operations
 ProcessResult* FastbootFlash(const char* fastboot_path, const char* device_serial,
                              const char* partition, const char* image_path);
+ProcessResult* FastbootFlashStreaming(const char* fastboot_path, const char* device_serial,
+                                      const char* partition, const char* image_path,
+                                      ProcessOutputCallback on_output, void* user_data);
 ProcessResult* FastbootErase(const char* fastboot_path, const char* device_serial,
                              const char* partition);
 ProcessResult* FastbootFormat(const char* fastboot_path, const char* device_serial,
@@ -38,6 +44,5 @@ ProcessResult* FastbootWipe(const char* fastboot_path, const char* device_serial
 
 // Utility functions
 int ParseFastbootDeviceList(const char* output, AdbDevice* devices, int max_devices);
-char* ExtractFastbootVar(const char* output, const char* var_name);
 
 #endif // FASTBOOT_WRAPPER_H
@@ -2,12 +2,44 @@
 #define FILE_TRANSFER_H
 
 #include "common.h"
+#include "decompress.h"
 
-// File transfer functions
-int PushFile(AppState* state, const char* local_path, const char* remote_path);
-int PullFile(AppState* state, const char* remote_path, const char* local_path);
+// Concurrent transfers used by directory and batch mode (push/pull -j N)
+#define DEFAULT_TRANSFER_JOBS 4
+#define MAX_TRANSFER_JOBS 16
+
+// File transfer functions. With verify, the file's SHA-256 is computed while it
+// streams through the host and compared with one sha256sum run on the device.
+int PushFile(AppState* state, const char* local_path, const char* remote_path, int verify);
+int PullFile(AppState* state, const char* remote_path, const char* local_path, int verify);
 int ListRemoteFiles(AppState* state, const char* remote_path);
 int DeleteRemoteFile(AppState* state, const char* remote_path);
 int CreateRemoteDirectory(AppState* state, const char* remote_path);
+int IsRemoteDirectory(AppState* state, const char* remote_path);
+
+// Recursive and batch transfers over up to `jobs` parallel sync connections
+int PushDirectory(AppState* state, const char* local_dir, const char* remote_path, int jobs);
+int PullDirectory(AppState* state, const char* remote_dir, const char* local_path, int jobs);
+int PushFiles(AppState* state, const char* local_paths[], int count, const char* remote_dir,
+              int jobs, int* results);
+
+// Push one file to several devices concurrently, reading it from disk once
+// (serials NULL: every online adb device). Each device reports its own progress
+// and failure.
+int BroadcastPushFile(AppState* state, const char* local_path, const char* remote_path,
+                      const char* serials[], int count);
+
+// Bulk mode (push/pull --tar): the whole tree moves as one tar stream, which
+// removes per-file round trips for folders of many small files. Pulls can be
+// compressed on the device (gzip or lz4, when its shell has them).
+int PushDirectoryTar(AppState* state, const char* local_dir, const char* remote_path);
+int PullDirectoryTar(AppState* state, const char* remote_dir, const char* local_path,
+                     CompressionFormat compression);
+
+// Delta sync (sync command): push only files whose size/mtime or content differ
+#define DELTA_SYNC_DELETE   0x01    // Remove remote entries that no longer exist locally
+#define DELTA_SYNC_CHECKSUM 0x02    // Hash same-size files even when mtimes match
+#define DELTA_SYNC_DRY_RUN  0x04    // Only report what would change
+int DeltaSyncDirectory(AppState* state, const char* local_dir, const char* remote_dir, int jobs, int flags);
 
 #endif // FILE_TRANSFER_H
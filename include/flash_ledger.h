@@ -0,0 +1,89 @@
+#ifndef FLASH_LEDGER_H
+#define FLASH_LEDGER_H
+
+#include "common.h"
+#include "flash_plan.h"
+#include "sha256.h"
+
+// Record of what was flashed where: one CSV row per successful flash
+// (timestamp, device, slot, partition, image fingerprint, size, image),
+// appended to FLASH_LEDGER_FILE. The latest row for a device and partition
+// tells whether an image is already on it, so repeated flashes of unchanged
+// images can be skipped. Slotless partition names are recorded with the
+// slot they landed on (boot on slot a is boot_a). Erasing, formatting or
+// wiping a partition appends a row without a fingerprint.
+
+#define FLASH_LEDGER_FILE "flash_ledger.csv"
+
+// Fingerprints hash the image source in pieces of this size, one per task
+#define FLASH_FINGERPRINT_PIECE (16ULL * 1024 * 1024)
+
+// File bytes a fingerprint covers
+typedef struct {
+    unsigned long long offset;
+    unsigned long long length;
+} FingerprintRange;
+
+// Content fingerprint of a plan image: SHA-256 over the SHA-256 of every
+// piece of the bytes the image is made from (the file; a zip entry's stored
+// data; the payload operations or super image extents of a partition) and
+// over how they turn into the image. Not the SHA-256 of the image itself;
+// equal fingerprints mean equal images.
+typedef struct {
+    char path[MAX_PATH];                // File the ranges are in
+    FingerprintRange* ranges;
+    int range_count;
+    int range_capacity;
+    unsigned char* layout;              // Gaps, fills and decode parameters
+    size_t layout_size;
+    size_t layout_capacity;
+    unsigned long long position;        // Image bytes described so far
+    unsigned long long hashed;          // File bytes the ranges cover
+    char hex[SHA256_HEX_SIZE];
+    char error[256];
+} FlashFingerprint;
+
+// One ledger row
+typedef struct {
+    char timestamp[32];
+    char device[64];
+    char slot[16];
+    char partition[64];
+    char fingerprint[SHA256_HEX_SIZE];  // "" for an erased partition
+    unsigned long long size;
+    char image[MAX_PATH];
+} FlashLedgerEntry;
+
+// Describe plan image `index` (cheap, reads only headers). Run it on the
+// thread that owns the plan; FlashFingerprintCompute may then run anywhere.
+int FlashFingerprintInit(FlashFingerprint* fingerprint, FlashPlan* plan, int index);
+
+// Hash the described bytes through memory-mapped views on all cores
+int FlashFingerprintCompute(FlashFingerprint* fingerprint);
+
+void FlashFingerprintFree(FlashFingerprint* fingerprint);
+
+// Partition name as recorded: slotless names of slotted partitions get the
+// device's current slot appended (from the getvar cache)
+void FlashLedgerPartitionKey(const char* fastboot_path, const char* device_serial, const char* partition,
+                             char* key, size_t key_size, char* slot, size_t slot_size);
+
+// Latest row for a device and partition key; 0 if there is none
+int FlashLedgerFind(const char* device_serial, const char* partition_key, FlashLedgerEntry* entry);
+
+// Append a row (fingerprint NULL or "" for an erased partition)
+int FlashLedgerRecord(const char* device_serial, const char* slot, const char* partition_key,
+                      const char* fingerprint, unsigned long long size, const char* image);
+
+// Mark every logical partition the device's ledger holds as erased; a new
+// super image redefines them
+void FlashLedgerForgetLogical(const char* fastboot_path, const char* device_serial);
+
+// Latest row of every device and partition, optionally of one device only;
+// the caller frees *entries
+int FlashLedgerLoad(const char* device_serial, FlashLedgerEntry** entries, int* count);
+
+// Remove the rows of one device, or all of them; returns the rows removed (-1 on error)
+int FlashLedgerClear(const char* device_serial);
+
+#endif // FLASH_LEDGER_H
@@ -0,0 +1,82 @@
+#ifndef FLASH_PLAN_H
+#define FLASH_PLAN_H
+
+#include "common.h"
+#include "decompress.h"
+#include "zip_archive.h"
+#include "payload.h"
+#include "super_image.h"
+#include "sha256.h"
+
+// Image list for flashall, loaded from one of:
+//   - a manifest: "<partition> <image>" per line (paths relative to the
+//     manifest), plus optional "set_active <slot>" and "reboot [mode]" lines;
+//   - a folder holding <partition>.img files;
+//   - a factory zip holding them, directly or in a nested image-*.zip.
+// Folders and zips are flashed in a fixed order: boot chain first, then the
+// system images, vbmeta last.
+
+#define FLASH_PLAN_MAX_IMAGES 64
+
+typedef struct {
+    char partition[64];
+    char image[MAX_PATH];               // File path, or the entry name inside the zip
+    int zip_entry;                      // Index into the plan's zip entries, -1 for a file
+    int payload_partition;              // Index into the plan's payload partitions, -1 otherwise
+    int super_partition;                // Index into the plan's super image partitions, -1 otherwise
+    unsigned long long size;            // Bytes on disk, or uncompressed in the zip
+    CompressionFormat compression;      // gzip/lz4/xz files are decompressed while flashing
+} FlashPlanImage;
+
+typedef struct {
+    char source[MAX_PATH];
+    FlashPlanImage images[FLASH_PLAN_MAX_IMAGES];
+    int count;
+    int has_zip;
+    ZipArchive zip;                     // Archive holding the images
+    int has_payload;
+    Payload payload;                    // OTA payload holding the image
+    int has_super;
+    SuperImage super;                   // super.img holding the (logical partition) image
+    char nested_copy[MAX_PATH];         // Compressed inner zip unpacked to disk (deleted on free)
+    char set_active[16];                // Slot to activate afterwards ("" = leave as is)
+    int reboot;                         // Reboot when done
+    char reboot_mode[32];               // "" for a normal reboot
+    char temp_root[MAX_PATH];           // Parent of temp_dir; "" for the system temp folder
+    char temp_dir[MAX_PATH];            // Created on first use
+    char error[512];
+} FlashPlan;
+
+// Read and validate every input up front; 0 with plan->error set on failure
+int FlashPlanLoad(FlashPlan* plan, const char* source);
+
+// Plan for a single `fb flash`: the image file itself (compressed or not),
+// the <partition>.img entry when path is a zip, the partition of an OTA
+// payload.bin (alone or inside an OTA zip), or a logical partition read out
+// of a super.img (raw or sparse) when the partition is not super itself
+int FlashPlanLoadImage(FlashPlan* plan, const char* partition, const char* path);
+
+// Whether image `index` is a zip entry, a payload or super image partition, or a compressed file
+int FlashPlanNeedsUnpacking(const FlashPlan* plan, int index);
+
+// Stream image `index` as it is flashed (unzipped, decompressed) into write,
+// without touching the disk. *position advances through the image's `size`
+// bytes (read from the file, or unpacked from the zip); the digest, when
+// given, hashes the output.
+int FlashPlanStream(FlashPlan* plan, int index, DecompressWriteFn write, void* write_data, Sha256Context* digest,
+                    unsigned long long* position, char* error, size_t error_size);
+
+// Make image `index` available as a file fastboot.exe can read: its own
+// path, or a temporary sparse file unpacked from the zip or a compressed file
+// (*is_temp set; delete it after use). Blocks of zeros take no disk space.
+int FlashPlanPrepare(FlashPlan* plan, int index, char* path, size_t path_size, int* is_temp, Sha256Context* digest,
+                     char* error, size_t error_size);
+
+// Create the temporary folder and check its drive can hold `needed` bytes of
+// unpacked images; 0 with the reason (folder and sizes) in error otherwise
+int FlashPlanCheckTempSpace(FlashPlan* plan, unsigned long long needed, char* error, size_t error_size);
+
+// Close the zip and remove temporary files
+void FlashPlanFree(FlashPlan* plan);
+
+#endif // FLASH_PLAN_H
@@ -0,0 +1,53 @@
+#ifndef IMAGE_CHECK_H
+#define IMAGE_CHECK_H
+
+#include "common.h"
+#include "flash_plan.h"
+
+// Pre-flight checks run before an image is sent. The image's headers are read
+// through a memory mapping (plain and sparse files, logical partitions of a
+// super image) or from the first bytes it unpacks to (zip entries, compressed
+// files, payload partitions): boot, init_boot and vendor_boot headers v0-v4,
+// vbmeta and the AVB footer, the sparse header, ext4 and EROFS superblocks and
+// liblp geometry. The result is matched against the target partition: what it
+// should hold, its size from the getvar cache, and whether it has slots.
+
+// Expanded image bytes the header parsers look at
+#define IMAGE_CHECK_HEAD_SIZE 8192
+
+// AVB footer at the end of a partition image
+#define AVB_FOOTER_SIZE 64
+#define AVB_VBMETA_HEADER_SIZE 256
+
+typedef enum {
+    IMAGE_KIND_UNKNOWN = 0,
+    IMAGE_KIND_BOOT,                    // boot, init_boot, recovery: "ANDROID!"
+    IMAGE_KIND_VENDOR_BOOT,             // vendor_boot, vendor_kernel_boot: "VNDRBOOT"
+    IMAGE_KIND_VBMETA,                  // "AVB0"
+    IMAGE_KIND_EXT4,
+    IMAGE_KIND_EROFS,
+    IMAGE_KIND_SUPER                    // liblp geometry
+} ImageKind;
+
+typedef struct {
+    ImageKind kind;
+    unsigned int header_version;        // Boot and vendor_boot images
+    int sparse;                         // Sent as an Android sparse file
+    int has_footer;                     // Ends in an AVB footer
+    unsigned long long image_size;      // Bytes the partition receives (0 if unknown)
+    unsigned long long content_size;    // Bytes the headers say the image spans (0 if unknown)
+    char summary[128];                  // "boot v4, kernel 12.0 MB, ramdisk 3.1 MB, AVB footer"
+    char error[512];
+} ImageCheck;
+
+// Check image `index` of a plan before it is flashed. partition_key is the
+// partition as the device knows it (boot_a for boot on slot a, see
+// FlashLedgerPartitionKey); the device checks are skipped without a serial.
+// Returns 0 with check->error set if the image must not be flashed there.
+int ImageCheckPlanImage(FlashPlan* plan, int index, const char* partition_key, const char* fastboot_path,
+                        const char* device_serial, ImageCheck* check);
+
+// "a boot image", "an ext4 filesystem", ...
+const char* ImageKindName(ImageKind kind);
+
+#endif // IMAGE_CHECK_H
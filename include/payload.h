@@ -0,0 +1,96 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include "common.h"
+#include "decompress.h"
+
+// A/B OTA payloads (payload.bin, on its own or stored inside an OTA zip).
+// The manifest is parsed up front; operation data is read through per-operation
+// views of a file mapping. Full payloads (REPLACE, REPLACE_XZ, REPLACE_BZ,
+// ZERO, DISCARD) can be extracted; the operations of incremental ones need the
+// source build and are only listed.
+
+#define PAYLOAD_MAGIC "CrAU"
+
+// InstallOperation types this reader can apply without a source image
+#define PAYLOAD_OP_REPLACE 0
+#define PAYLOAD_OP_REPLACE_BZ 1
+#define PAYLOAD_OP_ZERO 6
+#define PAYLOAD_OP_DISCARD 7
+#define PAYLOAD_OP_REPLACE_XZ 8
+
+// Run of destination blocks
+typedef struct {
+    unsigned long long start_block;
+    unsigned long long num_blocks;
+} PayloadExtent;
+
+// One install operation
+typedef struct {
+    int type;
+    unsigned long long data_offset;     // In the data blob behind the manifest
+    unsigned long long data_length;
+    unsigned char data_sha256[32];
+    int has_data_sha256;
+    int first_extent;                   // Into the partition's extents
+    int extent_count;
+    unsigned long long output_size;     // Bytes the destination extents cover
+} PayloadOperation;
+
+// One partition of the update
+typedef struct {
+    char name[64];
+    unsigned long long size;            // new_partition_info.size (0 if absent)
+    PayloadOperation* operations;
+    int operation_count;
+    int operation_capacity;
+    PayloadExtent* extents;
+    int extent_count;
+    int extent_capacity;
+    int is_delta;                       // Has operations that need the old image
+    unsigned long long data_size;       // Payload bytes its operations read
+} PayloadPartition;
+
+typedef struct {
+    char path[MAX_PATH];
+    HANDLE file;
+    HANDLE mapping;
+    unsigned long long base;            // Where payload.bin starts in the file
+    unsigned long long length;
+    unsigned long long data_offset;     // Data blob, relative to base
+    unsigned int block_size;
+    unsigned long long version;
+    PayloadPartition* partitions;
+    int count;
+    char error[256];
+} Payload;
+
+// Open payload.bin, or an OTA zip holding it stored (0 with payload->error set)
+int PayloadOpen(Payload* payload, const char* path);
+void PayloadClose(Payload* payload);
+
+// Whether a file is a payload.bin, or a zip with one
+int PayloadIsPayloadFile(const char* path);
+
+// Partition by name; "boot" also finds "boot_a" and the other way round
+const PayloadPartition* PayloadFindPartition(const Payload* payload, const char* name);
+
+// Output size of a partition: its declared size, else the end of its last extent
+unsigned long long PayloadPartitionSize(const Payload* payload, const PayloadPartition* partition);
+
+// "REPLACE_XZ", "SOURCE_COPY", ...
+const char* PayloadOperationName(int type);
+
+// Decode partitions into <name>.img files of out_dir, every operation of
+// every partition spread over the CPU cores. progress, when given, is called on
+// the calling thread with the bytes written so far across all partitions.
+int PayloadExtractPartitions(Payload* payload, const PayloadPartition** partitions, int count, const char* out_dir,
+                             ProgressCallback progress, void* user_data);
+
+// Decode one partition in block order into write, decoding operations ahead
+// on the other cores. Gaps between extents and the tail up to the partition
+// size come out as zeros; *position advances by the bytes written.
+int PayloadStreamPartition(Payload* payload, const PayloadPartition* partition, DecompressWriteFn write,
+                           void* write_data, unsigned long long* position);
+
+#endif // PAYLOAD_H
@@ -0,0 +1,26 @@
+#ifndef PROCESS_RUNNER_H
+#define PROCESS_RUNNER_H
+
+#include "common.h"
+
+// Receives output as it arrives; is_stderr tells the two streams apart.
+// Called on the thread that started the process.
+typedef void (*ProcessOutputCallback)(const char* data, size_t len, int is_stderr, void* user_data);
+
+// Options for RunProcessEx (zeroed struct or NULL = defaults)
+typedef struct {
+    DWORD timeout_ms;       // Kill the child after this long (0 = no timeout)
+    HANDLE cancel_event;    // Kill the child when this event is signalled (optional)
+    size_t max_capture;     // Max bytes kept per stream (0 = unlimited, rest is drained)
+    ProcessOutputCallback on_output;  // Stream output here instead of capturing it (optional)
+    void* user_data;                  // Passed through to on_output
+} ProcessOptions;
+
+// Spawn a process and drain stdout/stderr concurrently with overlapped pipes
+ProcessResult* RunProcessEx(const char* executable_path, const char* args[], int arg_count,
+                            const ProcessOptions* options);
+
+// ProcessOutputCallback that writes straight to the console
+void WriteOutputToConsole(const char* data, size_t len, int is_stderr, void* user_data);
+
+#endif // PROCESS_RUNNER_H
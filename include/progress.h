@@ -0,0 +1,60 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include "common.h"
+
+// Single-line console progress for transfers (push, pull, install, download,
+// flash): bar, bytes done, instantaneous and average rate, ETA. Finished
+// transfers are appended to a CSV stats log so slow ports and cables stand out.
+
+// Redraw the progress line at most this often (about 10 Hz)
+#define PROGRESS_REDRAW_MS 100
+// Instantaneous rate is measured over windows of this length
+#define PROGRESS_RATE_WINDOW_MS 1000
+// Width of the bar in characters
+#define PROGRESS_BAR_WIDTH 20
+// Throughput log, next to adbfu.ini in the working directory
+#define TRANSFER_STATS_LOG "transfer_stats.csv"
+
+// One transfer being displayed
+typedef struct {
+    char operation[16];             // "push", "pull", "install", "download", "flash"
+    char device[64];                // Serial (or host for downloads)
+    char label[128];                // File or partition
+    char status[32];                // Shown before the bar, e.g. "[3/40 files]" (optional)
+    unsigned long long total;       // 0 if unknown
+    unsigned long long done;
+    unsigned long long start_done;  // Already done when the transfer (re)started, e.g. a resume
+    int started;                    // First update seen
+    ULONGLONG start_tick;
+    ULONGLONG last_draw_tick;
+    ULONGLONG window_tick;          // Start of the current rate window
+    unsigned long long window_done;
+    double rate;                    // Bytes/s over the last full window
+    double peak_rate;
+    int line_length;                // Characters of the progress line on screen (0: none)
+} ProgressTracker;
+
+void ProgressStart(ProgressTracker* tracker, const char* operation, const char* device,
+                   const char* label, unsigned long long total);
+void ProgressUpdate(ProgressTracker* tracker, unsigned long long done);
+void ProgressRedraw(ProgressTracker* tracker);
+void ProgressClearLine(ProgressTracker* tracker);
+
+// Building blocks for multi-line displays: update rates without drawing, format
+// the line into a buffer (returns its length), log without printing
+void ProgressRecord(ProgressTracker* tracker, unsigned long long done);
+int ProgressFormat(const ProgressTracker* tracker, char* line, size_t size);
+void ProgressLog(const ProgressTracker* tracker, int success);
+
+// End the line, print a summary on success and log the transfer
+void ProgressFinish(ProgressTracker* tracker, int success);
+
+// ProgressCallback adapter; user_data is a ProgressTracker*
+void ProgressTrackerCallback(const char* filename, unsigned long long current,
+                             unsigned long long total, void* user_data);
+
+// Format a byte count as B/KB/MB/GB
+void FormatByteCount(unsigned long long bytes, char* buffer, size_t size);
+
+#endif // PROGRESS_H
@@ -0,0 +1,28 @@
+#ifndef PROP_CACHE_H
+#define PROP_CACHE_H
+
+#include "common.h"
+
+// Room for any property value (Android caps most at 92 bytes, ro.* can be longer)
+#define PROP_VALUE_MAX_LEN 256
+
+// Per-device snapshot of the full `getprop` dump, fetched once per connection
+// and indexed by an open-addressing hash table. Invalidated when the device
+// disconnects or is rebooted.
+
+// Make sure the snapshot for a device is loaded (returns 0 if getprop failed)
+int PropCacheLoad(const char* adb_path, const char* device_serial);
+
+// Look up one property; loads the snapshot on first use. Returns 1 if found.
+int PropCacheGet(const char* adb_path, const char* device_serial, const char* name,
+                 char* value_out, size_t value_size);
+
+// Memoized root solution (a RootSolution value), cleared with the snapshot
+int PropCacheGetRootSolution(const char* device_serial, int* solution_out);
+void PropCacheSetRootSolution(const char* device_serial, int solution);
+
+// Drop cached data (device gone, rebooted, or on exit)
+void PropCacheInvalidate(const char* device_serial);
+void PropCacheClear(void);
+
+#endif // PROP_CACHE_H
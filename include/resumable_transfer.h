@@ -0,0 +1,34 @@
+#ifndef RESUMABLE_TRANSFER_H
+#define RESUMABLE_TRANSFER_H
+
+#include "common.h"
+#include "sha256.h"
+
+// Chunked transfers for large files that survive a dropped connection.
+// The file moves in fixed-size chunks through `dd skip=/seek=` on the device;
+// every verified chunk is appended (offset, length, SHA-256) to a journal next
+// to the destination, so a retry - automatic after the device reappears, or a
+// later run of the same command - continues with the chunks still missing.
+// Pull journals live next to the local file, push journals next to the remote one.
+
+// Files at least this large take the resumable path
+#define RESUMABLE_MIN_SIZE (256ULL * 1024 * 1024)
+
+// Chunk size (a multiple of the 1 MB dd block size)
+#define RESUMABLE_CHUNK_SIZE (32ULL * 1024 * 1024)
+
+// Appended to the destination path to name its journal
+#define RESUMABLE_JOURNAL_SUFFIX ".fadb-journal"
+
+// Both return 1 on success, 0 on failure (the journal is kept for a later
+// resume), or -1 when the device cannot do chunked transfers and the caller
+// should use a plain transfer. Paths are exact targets, not directories.
+// A non-NULL digest receives the SHA-256 of the whole file: chunks moved now
+// are hashed in flight, chunks finished by an earlier run are read back locally.
+int ResumablePushFile(const char* device_serial, const char* local_path, const char* remote_path,
+                      Sha256Context* digest, ProgressCallback progress, void* user_data);
+int ResumablePullFile(const char* device_serial, const char* remote_path, const char* local_path,
+                      unsigned long long size, unsigned int mtime, Sha256Context* digest,
+                      ProgressCallback progress, void* user_data);
+
+#endif // RESUMABLE_TRANSFER_H
@@ -0,0 +1,28 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include "common.h"
+
+// SHA-256 (FIPS 180-4), used to compare file contents without moving them
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE 65      // 64 hex digits plus terminator
+
+// Incremental hashing state
+typedef struct {
+    unsigned int state[8];
+    unsigned long long length;  // Bytes hashed so far
+    unsigned char block[64];
+    size_t block_used;
+} Sha256Context;
+
+void Sha256Init(Sha256Context* ctx);
+void Sha256Update(Sha256Context* ctx, const void* data, size_t size);
+void Sha256Final(Sha256Context* ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+// Lowercase hex, as printed by sha256sum
+void Sha256ToHex(const unsigned char digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE]);
+
+// Hash a whole local file (returns 0 if it cannot be read)
+int Sha256File(const char* path, char hex[SHA256_HEX_SIZE]);
+
+#endif // SHA256_H
@@ -0,0 +1,33 @@
+#ifndef SHELL_SESSION_H
+#define SHELL_SESSION_H
+
+#include "common.h"
+
+// Persistent per-device shell sessions.
+// One long-lived "shell,v2,raw:" connection per device runs commands back to back;
+// each command is framed with sentinel markers on stdout and stderr so its output
+// and exit code can be split out again. Devices without shell_v2 (or with no adb
+// server reachable) fall back to AdbShellCommand, one spawn per command.
+
+// Longest silence from the device before a session command is given up on. A
+// command the session lost after sending it comes back failed (exit code -1)
+// rather than being run a second time; ones never sent run one-shot instead.
+#define SHELL_SESSION_TIMEOUT_MS 60000
+
+// Run one command on the device's session
+ProcessResult* ShellSessionRun(const char* adb_path, const char* device_serial, const char* command);
+
+// Same without the receive deadline, for commands that can legitimately stay
+// quiet for minutes (hashing large files, walking or deleting big trees)
+ProcessResult* ShellSessionRunLong(const char* adb_path, const char* device_serial, const char* command);
+
+// Run several commands in a single round trip; results[i] gets the output of commands[i].
+// Returns 0 if any command could not be run or was lost.
+int ShellSessionRunBatch(const char* adb_path, const char* device_serial,
+                         const char* commands[], int count, ProcessResult* results[]);
+
+// Drop sessions (device gone, or on exit)
+void ShellSessionClose(const char* device_serial);
+void ShellSessionCloseAll(void);
+
+#endif // SHELL_SESSION_H
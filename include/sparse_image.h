@@ -0,0 +1,160 @@
+#ifndef SPARSE_IMAGE_H
+#define SPARSE_IMAGE_H
+
+#include "common.h"
+#include "sha256.h"
+
+// Android sparse images for flashing. A raw image is read through a memory
+// mapping and described as runs of blocks: RAW (data that has to be sent),
+// FILL (every 32-bit word the same, zeros included, sent as one word) and
+// DONT_CARE (left untouched). An image that is already sparse is parsed into
+// the same runs. The runs are then split into pieces that each fit the
+// device's max-download-size; every piece is a complete sparse file covering
+// the whole partition, with the blocks other pieces carry marked DONT_CARE.
+
+#define SPARSE_HEADER_MAGIC 0xed26ff3a
+#define SPARSE_HEADER_SIZE 28
+#define SPARSE_CHUNK_HEADER_SIZE 12
+#define SPARSE_DEFAULT_BLOCK_SIZE 4096
+
+#define SPARSE_CHUNK_RAW 0xcac1
+#define SPARSE_CHUNK_FILL 0xcac2
+#define SPARSE_CHUNK_DONT_CARE 0xcac3
+#define SPARSE_CHUNK_CRC32 0xcac4
+
+// Run of blocks with one treatment
+typedef struct {
+    unsigned short type;                // SPARSE_CHUNK_RAW, _FILL or _DONT_CARE
+    unsigned int first_block;
+    unsigned int blocks;
+    unsigned long long offset;          // RAW: where the data starts in the image file
+    unsigned int fill;                  // FILL: the repeated word
+} SparseChunk;
+
+// Opened image and its block map
+typedef struct {
+    HANDLE file;
+    HANDLE mapping;                     // NULL for an empty file
+    unsigned long long file_size;
+    unsigned int block_size;
+    unsigned int total_blocks;
+    int is_sparse;                      // The file itself is in sparse format
+    SparseChunk* chunks;
+    int chunk_count;
+    int chunk_capacity;
+    const unsigned char* view;          // Currently mapped window
+    unsigned long long view_offset;
+    size_t view_size;
+    char error[256];
+} SparseImage;
+
+// One download: a sparse file carrying blocks [first_block, end_block)
+typedef struct {
+    unsigned int first_block;
+    unsigned int end_block;
+    unsigned int chunks;                // Chunk headers in this piece
+    unsigned long long size;            // Bytes the piece takes on the wire
+} SparsePiece;
+
+// Receives output bytes; return 0 to abort
+typedef int (*SparseSinkFn)(const void* data, size_t len, void* user_data);
+
+// Map and classify an image (raw or sparse). The digest, when given, hashes
+// the file's bytes during the same pass. Returns 0 with image->error set on failure.
+int SparseImageOpen(SparseImage* image, const char* path, Sha256Context* digest);
+void SparseImageClose(SparseImage* image);
+
+// Split the image into pieces of at most max_size bytes (0: one piece); the
+// caller frees *pieces. Returns 0 if a single block cannot fit.
+int SparseImagePlan(SparseImage* image, unsigned long long max_size, SparsePiece** pieces, int* count);
+
+// Emit one planned piece as a sparse file
+int SparseImageWritePiece(SparseImage* image, const SparsePiece* piece, SparseSinkFn sink, void* user_data);
+
+// Emit the image file unchanged
+int SparseImageWriteFile(SparseImage* image, SparseSinkFn sink, void* user_data);
+
+// Random access to the expanded image (what a flashed partition would hold)
+
+// Open like SparseImageOpen, but describe a raw file as one RAW run instead of
+// scanning it, so only the ranges read later are ever touched
+int SparseImageOpenLazy(SparseImage* image, const char* path);
+
+// Emit expanded bytes [offset, offset + len): RAW data straight from the
+// mapping, FILL and DONT_CARE runs expanded (DONT_CARE as zeros)
+int SparseImageReadRange(SparseImage* image, unsigned long long offset, unsigned long long len, SparseSinkFn sink,
+                         void* user_data);
+
+// Copy expanded bytes into a buffer
+int SparseImageRead(SparseImage* image, unsigned long long offset, void* buffer, size_t len);
+
+// ============================================================================
+// Streaming packer
+// ============================================================================
+
+// Builds sparse output from image bytes as they arrive (a decompressor's
+// output, say), raw or already sparse, without the whole image in hand. Output
+// goes into caller-owned buffers that are handed back as they fill:
+//   - split: every buffer is a complete sparse file covering blocks
+//     [0, end_block), the ones before its data marked DONT_CARE, so each can
+//     be downloaded and flashed on its own;
+//   - continuous: the buffers are consecutive parts of one sparse file whose
+//     header, known only at the end, comes from SparseStreamHeader.
+// Chunks never span buffers, so nothing written is ever revisited.
+
+// Receives a filled buffer (blocks up to end_block written so far); returns
+// the buffer to fill next, or NULL to abort
+typedef unsigned char* (*SparseBufferFn)(unsigned char* buffer, size_t size, unsigned int end_block,
+                                         void* user_data);
+
+typedef struct {
+    SparseBufferFn ready;
+    void* user_data;
+    int split;
+    unsigned char* buffer;
+    size_t capacity;
+    size_t used;
+    unsigned int buffers_sent;
+    int buffer_has_data;                // Holds a chunk besides the leading DONT_CARE
+
+    unsigned int block_size;
+    unsigned int block;                 // Blocks written so far
+    unsigned int buffer_chunks;         // Chunks in the current buffer
+    unsigned int total_chunks;          // Chunks in the whole output
+    int chunk_open;                     // Run still growing at chunk_at
+    size_t chunk_at;
+    unsigned short chunk_type;
+    unsigned int chunk_blocks;
+    unsigned int chunk_fill;
+
+    int input_state;                    // Parser state for the incoming bytes
+    unsigned char* pending;             // Partial block or header
+    size_t pending_len;
+    size_t pending_need;
+    unsigned long long skip;            // Input bytes to drop (header extensions, CRC32 chunks)
+    unsigned int chunk_header_size;     // Of sparse input
+    unsigned int input_total_blocks;
+    unsigned int input_chunks_left;
+    unsigned int input_blocks_left;     // Of the RAW or FILL chunk being read
+    unsigned long long input_bytes;
+    int failed;
+    char error[256];
+} SparseStream;
+
+// Start packing into `buffer` (capacity bytes, at least 64 KB)
+void SparseStreamInit(SparseStream* stream, unsigned char* buffer, size_t capacity, int split,
+                      SparseBufferFn ready, void* user_data);
+
+// Feed image bytes (DecompressWriteFn-compatible); returns 0 on bad input or an aborted buffer
+int SparseStreamWrite(const void* data, size_t len, void* stream);
+
+// Flush the last buffer; 0 if the input ended early
+int SparseStreamFinish(SparseStream* stream);
+
+// Header for continuous output, valid after SparseStreamFinish
+void SparseStreamHeader(const SparseStream* stream, unsigned char header[SPARSE_HEADER_SIZE]);
+
+// Free the stream's own scratch memory (the buffers belong to the caller)
+void SparseStreamFree(SparseStream* stream);
+
+#endif // SPARSE_IMAGE_H
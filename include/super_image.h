@@ -0,0 +1,87 @@
+#ifndef SUPER_IMAGE_H
+#define SUPER_IMAGE_H
+
+#include "common.h"
+#include "decompress.h"
+#include "sparse_image.h"
+
+// Dynamic partition super images (super.img), raw or sparse. Only the liblp
+// geometry and metadata are read when the image is opened; a logical
+// partition is a list of extents into the image, read on demand through the
+// image's memory mapping, so one partition can be extracted or flashed
+// without expanding the rest of the super image.
+
+#define LP_GEOMETRY_MAGIC 0x616c4467
+#define LP_METADATA_HEADER_MAGIC 0x414c5030
+#define LP_METADATA_MAJOR_VERSION 10
+#define LP_PARTITION_RESERVED_BYTES 4096
+#define LP_METADATA_GEOMETRY_SIZE 4096
+#define LP_SECTOR_SIZE 512
+
+#define LP_TARGET_TYPE_LINEAR 0
+#define LP_TARGET_TYPE_ZERO 1
+
+#define LP_PARTITION_ATTR_READONLY 0x1
+#define LP_PARTITION_ATTR_SLOT_SUFFIXED 0x2
+#define LP_PARTITION_ATTR_UPDATED 0x4
+#define LP_PARTITION_ATTR_DISABLED 0x8
+
+// Run of partition bytes: a range of the super image, or zeros
+typedef struct {
+    unsigned long long offset;          // LINEAR: byte offset in the (expanded) super image
+    unsigned long long length;
+    int is_zero;
+} SuperExtent;
+
+// One logical partition
+typedef struct {
+    char name[40];
+    char group[40];
+    unsigned int attributes;
+    int first_extent;                   // Into the image's extents
+    int extent_count;
+    int foreign;                        // Has extents on another block device (retrofit)
+    unsigned long long size;
+} SuperPartition;
+
+typedef struct {
+    SparseImage image;
+    unsigned int major;
+    unsigned int minor;
+    unsigned int metadata_max_size;
+    unsigned int metadata_slots;
+    unsigned int logical_block_size;
+    unsigned long long device_size;     // First block device, as the metadata records it
+    SuperPartition* partitions;
+    int count;
+    SuperExtent* extents;
+    int extent_count;
+    char error[256];
+} SuperImage;
+
+// Open super.img and parse the metadata of slot 0 (0 with super->error set)
+int SuperImageOpen(SuperImage* super, const char* path);
+void SuperImageClose(SuperImage* super);
+
+// Whether a file (raw or sparse) carries liblp geometry
+int SuperImageIsSuperFile(const char* path);
+
+// Partition by name; "system" also finds "system_a" (a non-empty one first)
+// and "system_a" finds "system"
+const SuperPartition* SuperImageFindPartition(const SuperImage* super, const char* name);
+
+// Copy partition bytes [offset, offset + len) into buffer
+int SuperImageRead(SuperImage* super, const SuperPartition* partition, unsigned long long offset, void* buffer,
+                   size_t len);
+
+// Write a whole partition, extent by extent, into write; *position advances
+// by the bytes written
+int SuperImageStreamPartition(SuperImage* super, const SuperPartition* partition, DecompressWriteFn write,
+                              void* write_data, unsigned long long* position);
+
+// Write partitions to <name>.img files of out_dir; progress, when given,
+// gets the bytes written so far across all partitions
+int SuperImageExtractPartitions(SuperImage* super, const SuperPartition** partitions, int count, const char* out_dir,
+                                ProgressCallback progress, void* user_data);
+
+#endif // SUPER_IMAGE_H
@@ -0,0 +1,88 @@
+#ifndef SYNC_CLIENT_H
+#define SYNC_CLIENT_H
+
+#include "common.h"
+#include "sha256.h"
+
+// In-process implementation of the adb "sync:" file protocol (SEND/RECV/DATA/DONE,
+// STAT/LIST) over the adb server, replacing adb.exe push/pull for file transfers.
+// Push reads the local file through a memory mapping and sends batches of DATA
+// packets straight out of the mapped view; pull writes through large aligned
+// overlapped writes while the next chunk is being received.
+
+// Largest DATA payload the protocol allows
+#define SYNC_DATA_MAX (64 * 1024)
+
+// Remote path length limit enforced by adbd
+#define SYNC_PATH_MAX 1024
+
+// POSIX file type bits as reported by STAT/LIST
+#define SYNC_S_IFMT  0170000
+#define SYNC_S_IFDIR 0040000
+#define SYNC_S_IFREG 0100000
+#define SYNC_S_IFLNK 0120000
+
+// Open sync session with one device
+typedef struct {
+    SOCKET sock;
+    int has_stat_v2;            // Device supports STA2 (64-bit sizes)
+    Sha256Context* digest;      // Optional: file data of each push/pull is hashed as it streams
+    char error[256];            // Reason for the last failure
+} SyncConnection;
+
+// Remote file metadata from STAT or LIST
+typedef struct {
+    unsigned int mode;          // 0 if the path does not exist
+    unsigned long long size;
+    unsigned int mtime;
+    char name[256];             // Entry name (LIST only)
+} SyncStat;
+
+// Local file opened and mapped once; any number of connections may push it
+// concurrently, each mapping its own views of the shared section
+typedef struct {
+    HANDLE file;
+    HANDLE mapping;             // NULL for empty files
+    unsigned long long size;
+    unsigned int mtime;
+    char name[256];             // Base name, for progress
+} SyncSource;
+
+// Called for each LIST entry; return 0 to stop listing
+typedef int (*SyncListCallback)(const SyncStat* entry, void* user_data);
+
+// Session lifetime
+int SyncOpen(SyncConnection* conn, const char* device_serial);
+void SyncClose(SyncConnection* conn);
+
+// Metadata
+int SyncStatRemote(SyncConnection* conn, const char* remote_path, SyncStat* stat_out);
+int SyncListRemote(SyncConnection* conn, const char* remote_path, SyncListCallback callback, void* user_data);
+
+// File transfer. remote_path/local_path may name an existing directory, in which
+// case the file keeps its name. Progress reports bytes moved so far.
+int SyncPushFile(SyncConnection* conn, const char* local_path, const char* remote_path,
+                 ProgressCallback progress, void* user_data);
+int SyncPullFile(SyncConnection* conn, const char* remote_path, const char* local_path,
+                 ProgressCallback progress, void* user_data);
+
+// Where SyncPushFile/SyncPullFile would write (pull also returns the remote STAT)
+int SyncResolvePushTarget(SyncConnection* conn, const char* local_path, const char* remote_path,
+                          char* target, size_t target_size);
+int SyncResolvePullTarget(SyncConnection* conn, const char* remote_path, const char* local_path,
+                          char* target, size_t target_size, SyncStat* stat_out);
+
+// Same, with the target path taken literally (no STAT, no directory resolution);
+// used when the caller already walked the tree
+int SyncSendFile(SyncConnection* conn, const char* local_path, const char* remote_path,
+                 ProgressCallback progress, void* user_data);
+int SyncRecvFile(SyncConnection* conn, const char* remote_path, const char* local_path,
+                 unsigned long long expected_size, ProgressCallback progress, void* user_data);
+
+// Shared-source push (one local read fanned out to several devices)
+int SyncOpenSource(SyncSource* source, const char* local_path, char* error, size_t error_size);
+void SyncCloseSource(SyncSource* source);
+int SyncSendSource(SyncConnection* conn, const SyncSource* source, const char* remote_path,
+                   ProgressCallback progress, void* user_data);
+
+#endif // SYNC_CLIENT_H
@@ -0,0 +1,71 @@
+#ifndef TAR_STREAM_H
+#define TAR_STREAM_H
+
+#include "common.h"
+
+// Built-in tar reader and writer for bulk folder transfers (push/pull --tar).
+// The extractor is fed the archive as it arrives from the device and writes
+// files under a local root; the writer walks a local folder and hands the
+// archive to a sink in large pieces. Both speak ustar with the GNU long-name
+// and base-256 size extensions; the extractor also honours pax path/size
+// records. Links and special files are skipped on Windows.
+
+#define TAR_BLOCK_SIZE 512
+
+// Receives archive bytes; return 0 to abort
+typedef int (*TarSinkFn)(const void* data, size_t len, void* user_data);
+
+// Streaming extraction
+typedef struct {
+    char root[MAX_PATH];                // Local folder the archive lands in
+    unsigned char header[TAR_BLOCK_SIZE];
+    size_t header_fill;
+    int state;                          // What the next bytes belong to
+    unsigned long long remaining;       // Bytes left in the current entry's data
+    unsigned long long padding;         // Zero bytes after them, up to the block boundary
+    HANDLE file;                        // File being written
+    unsigned int file_mtime;
+    char* meta;                         // GNU long name or pax record being collected
+    size_t meta_fill;
+    char meta_type;
+    char* next_path;                    // Overrides the next header's name
+    unsigned long long next_size;       // Overrides the next header's size (pax)
+    int has_next_size;
+    int zero_blocks;
+    int finished;                       // End-of-archive marker seen
+    int files;
+    int dirs;
+    int skipped;                        // Links, devices, unsafe paths
+    int failures;                       // Entries that could not be written
+    unsigned long long bytes;           // File data written so far
+    char error[256];                    // First failure
+} TarExtractor;
+
+void TarExtractorInit(TarExtractor* tar, const char* root);
+// Returns 0 on a corrupt archive or a local write error (details in tar->error)
+int TarExtractorFeed(TarExtractor* tar, const void* data, size_t len);
+// Release resources; returns 1 if the archive ended cleanly
+int TarExtractorFinish(TarExtractor* tar);
+
+// Archive writer
+typedef struct {
+    TarSinkFn sink;
+    void* user_data;
+    char* buffer;                       // Headers and data coalesced into large sink calls
+    size_t fill;
+    int files;
+    int dirs;
+    unsigned long long bytes;           // File data archived so far
+    ProgressCallback progress;          // Optional, reports `bytes`
+    void* progress_data;
+    unsigned long long progress_total;
+    char error[256];
+} TarWriter;
+
+void TarWriterInit(TarWriter* tar, TarSinkFn sink, void* user_data);
+// Archive local_dir's contents with names relative to it; 0 on failure
+int TarWriteTree(TarWriter* tar, const char* local_dir);
+// Write the end-of-archive marker and flush (write_end 0 just discards); releases resources
+int TarWriterFinish(TarWriter* tar, int write_end);
+
+#endif // TAR_STREAM_H
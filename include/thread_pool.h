@@ -0,0 +1,22 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "common.h"
+
+// Upper bound on workers for one RunParallel call (WaitForMultipleObjects limit)
+#define MAX_PARALLEL_WORKERS 32
+
+// Workers worth starting for CPU-bound items: one per processor, capped at MAX_PARALLEL_WORKERS
+int ParallelWorkerCount(void);
+
+// Process item `index` on worker `worker` (0..workers-1); return 1 on success.
+// A worker handles one item at a time, so per-worker resources indexed by
+// `worker` (connections, buffers) need no locking.
+typedef int (*ParallelTask)(int worker, int index, void* context);
+
+// Run items 0..count-1 over up to max_workers threads (the caller is worker 0).
+// Items are handed out in order as workers free up. Returns the number of items
+// that succeeded.
+int RunParallel(int count, int max_workers, ParallelTask task, void* context);
+
+#endif // THREAD_POOL_H
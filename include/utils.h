@@ -27,8 +27,14 @@ char* TrimString(char* str);
 char* SplitString(char* str, char delimiter);
 void StringToLower(char* str);
 int StringStartsWith(const char* str, const char* prefix);
+unsigned int HashString(const char* str);
+int HasSlotSuffix(const char* name);
 int LevenshteinDistance(const char* s1, const char* s2);
 
+// Byte order (big-endian fields of AVB and OTA payload headers)
+unsigned long long GetBE64(const unsigned char* p);
+unsigned int GetBE32(const unsigned char* p);
+
 // Path utilities
 void JoinPath(char* dest, size_t dest_size, const char* path1, const char* path2);
 int FileExists(const char* path);
@@ -54,4 +60,10 @@ int LoadConfig(void);
 // Time utilities
 void GetCurrentTimestamp(char* buffer, size_t buffer_size);
 
+// 1970-01-01 in FILETIME ticks (100 ns since 1601)
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+// Times before 1970 come out as 0
+unsigned int FileTimeToUnixSeconds(const FILETIME* ft);
+FILETIME UnixSecondsToFileTime(unsigned int seconds);
+
 #endif // UTILS_H
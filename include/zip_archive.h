@@ -0,0 +1,50 @@
+#ifndef ZIP_ARCHIVE_H
+#define ZIP_ARCHIVE_H
+
+#include "common.h"
+#include "decompress.h"
+
+// Read-only zip access for factory image packages: the central directory
+// (ZIP64 included) is loaded up front, entries are streamed out through the
+// built-in decoder (stored or deflate) with their CRC-32 checked. An archive
+// stored uncompressed inside another one is opened in place.
+
+// One file in the archive
+typedef struct {
+    char name[MAX_PATH];
+    unsigned short method;              // 0 stored, 8 deflate
+    unsigned short flags;
+    unsigned int crc32;
+    unsigned long long compressed_size;
+    unsigned long long size;
+    unsigned long long header_offset;   // Local header, relative to the archive start
+} ZipEntry;
+
+typedef struct {
+    char path[MAX_PATH];
+    HANDLE file;
+    unsigned long long base;            // Where the archive starts in the file
+    unsigned long long length;
+    ZipEntry* entries;
+    int count;
+    char error[256];
+} ZipArchive;
+
+// Open the archive at path (0 with zip->error set if it is not a readable zip)
+int ZipOpen(ZipArchive* zip, const char* path);
+// Open a stored (uncompressed) entry of another archive as an archive
+int ZipOpenNested(ZipArchive* zip, ZipArchive* outer, const ZipEntry* entry);
+void ZipClose(ZipArchive* zip);
+
+// File offset of an entry's data as stored in the archive (compressed_size bytes)
+int ZipEntryDataOffset(ZipArchive* zip, const ZipEntry* entry, unsigned long long* offset);
+// File offset of a stored (uncompressed) entry's data, for reading it in place
+int ZipStoredEntryOffset(ZipArchive* zip, const ZipEntry* entry, unsigned long long* offset);
+
+// Entry by full name, or by file name when name has no folder part
+const ZipEntry* ZipFindEntry(const ZipArchive* zip, const char* name);
+
+// Stream an entry's contents to write; fails on corrupt data or a CRC mismatch
+int ZipExtractEntry(ZipArchive* zip, const ZipEntry* entry, DecompressWriteFn write, void* user_data);
+
+#endif // ZIP_ARCHIVE_H
@@ -0,0 +1,875 @@
+#include "adb_client.h"
+#include "utils.h"
+#include <ws2tcpip.h>
+
+// Sanity limit for length-prefixed replies and shell packets
+#define MAX_MESSAGE_SIZE (64 * 1024 * 1024)
+
+// How long a failed probe is trusted before the server is tried again
+#define SERVER_RETRY_MS 3000
+#define CONNECT_TIMEOUT_MS 500
+
+// APK bytes read and sent per step of a streamed install
+#define INSTALL_STREAM_CHUNK (256 * 1024)
+
+// Shell stdin packets handed to the socket per WSASend
+#define SHELL_STDIN_BATCH 64
+
+// Callers arrive from worker threads, so one-time setup goes through InitOnce
+static INIT_ONCE g_wsa_once = INIT_ONCE_STATIC_INIT;
+static volatile LONG g_wsa_initialized = 0;
+static INIT_ONCE g_server_config_once = INIT_ONCE_STATIC_INIT;
+static char g_server_host[256] = ADB_SERVER_DEFAULT_HOST;
+static int g_server_port = ADB_SERVER_DEFAULT_PORT;
+
+// Server availability: 0 = unknown, 1 = up, -1 = down
+static volatile LONG g_server_state = 0;
+static volatile ULONGLONG g_server_down_tick = 0;
+
+// Per-device feature cache (shell_v2 etc.), one entry per connected device.
+// Entries are kept packed; removing one moves the last into its place.
+#define FEATURE_CACHE_MIN_CAPACITY 16
+typedef struct {
+    char serial[256];
+    unsigned int serial_hash;   // FNV-1a of serial, checked before any strcmp
+    char* features;             // Comma-separated, as the server reports them
+} FeatureCacheEntry;
+
+static FeatureCacheEntry* g_feature_cache = NULL;
+static int g_feature_count = 0;
+static int g_feature_capacity = 0;
+static int* g_feature_index = NULL;         // Open addressing by serial hash, -1 = empty
+static int g_feature_index_capacity = 0;    // Power of two, at least twice g_feature_count
+static SRWLOCK g_feature_lock = SRWLOCK_INIT;
+
+// InitOnce callback: start Winsock
+static BOOL CALLBACK StartWinsock(PINIT_ONCE once, PVOID parameter, PVOID* context) {
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) == 0) {
+        InterlockedExchange(&g_wsa_initialized, 1);
+    }
+    return TRUE;
+}
+
+// Initialize Winsock once
+static int EnsureWinsock(void) {
+    InitOnceExecuteOnce(&g_wsa_once, StartWinsock, NULL, NULL);
+    return g_wsa_initialized != 0;
+}
+
+// InitOnce callback: load the server address from the environment (same variables as adb.exe)
+static BOOL CALLBACK ReadServerConfig(PINIT_ONCE once, PVOID parameter, PVOID* context) {
+    char value[256];
+    DWORD len = GetEnvironmentVariableA("ADB_SERVER_SOCKET", value, sizeof(value));
+    if (len > 0 && len < sizeof(value) && StringStartsWith(value, "tcp:")) {
+        // tcp:<host>:<port> or tcp:<port>
+        char* spec = value + 4;
+        char* colon = strrchr(spec, ':');
+        if (colon) {
+            *colon = '\0';
+            strncpy(g_server_host, spec, sizeof(g_server_host) - 1);
+            g_server_port = atoi(colon + 1);
+        } else {
+            g_server_port = atoi(spec);
+        }
+        return TRUE;
+    }
+
+    len = GetEnvironmentVariableA("ANDROID_ADB_SERVER_PORT", value, sizeof(value));
+    if (len > 0 && len < sizeof(value)) {
+        int port = atoi(value);
+        if (port > 0 && port < 65536) {
+            g_server_port = port;
+        }
+    }
+    return TRUE;
+}
+
+// Load the server address once
+static void LoadServerConfig(void) {
+    InitOnceExecuteOnce(&g_server_config_once, ReadServerConfig, NULL, NULL);
+}
+
+// Override server address (e.g. to point at a stand-in server)
+void AdbClientSetServer(const char* host, int port) {
+    // The environment is read first so it cannot overwrite the override later
+    LoadServerConfig();
+    if (host) {
+        strncpy(g_server_host, host, sizeof(g_server_host) - 1);
+        g_server_host[sizeof(g_server_host) - 1] = '\0';
+    }
+    if (port > 0) {
+        g_server_port = port;
+    }
+    InterlockedExchange(&g_server_state, 0);
+}
+
+// Connect with a short timeout so a missing server doesn't stall the caller
+static int ConnectWithTimeout(SOCKET sock, const struct sockaddr* addr, int addr_len) {
+    unsigned long nonblocking = 1;
+    ioctlsocket(sock, FIONBIO, &nonblocking);
+
+    int rc = connect(sock, addr, addr_len);
+    if (rc == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK) {
+        fd_set write_set, error_set;
+        FD_ZERO(&write_set);
+        FD_ZERO(&error_set);
+        FD_SET(sock, &write_set);
+        FD_SET(sock, &error_set);
+
+        struct timeval tv = { CONNECT_TIMEOUT_MS / 1000, (CONNECT_TIMEOUT_MS % 1000) * 1000 };
+        rc = select(0, NULL, &write_set, &error_set, &tv);
+        if (rc <= 0 || FD_ISSET(sock, &error_set) || !FD_ISSET(sock, &write_set)) {
+            return 0;
+        }
+    } else if (rc == SOCKET_ERROR) {
+        return 0;
+    }
+
+    nonblocking = 0;
+    ioctlsocket(sock, FIONBIO, &nonblocking);
+    return 1;
+}
+
+// Open a TCP connection to the adb server
+SOCKET AdbClientConnect(void) {
+    if (!EnsureWinsock()) return INVALID_SOCKET;
+    LoadServerConfig();
+
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", g_server_port);
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    struct addrinfo* info = NULL;
+    if (getaddrinfo(g_server_host, port_str, &hints, &info) != 0 || !info) {
+        return INVALID_SOCKET;
+    }
+
+    SOCKET sock = INVALID_SOCKET;
+    for (struct addrinfo* ai = info; ai != NULL; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock == INVALID_SOCKET) continue;
+
+        if (ConnectWithTimeout(sock, ai->ai_addr, (int)ai->ai_addrlen)) {
+            break;
+        }
+        closesocket(sock);
+        sock = INVALID_SOCKET;
+    }
+    freeaddrinfo(info);
+
+    if (sock != INVALID_SOCKET) {
+        int nodelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+    }
+
+    return sock;
+}
+
+// Send the whole buffer
+int AdbClientSendAll(SOCKET sock, const void* data, size_t len) {
+    const char* ptr = (const char*)data;
+    while (len > 0) {
+        int chunk = (len > 0x40000000) ? 0x40000000 : (int)len;
+        int sent = send(sock, ptr, chunk, 0);
+        if (sent <= 0) return 0;
+        ptr += sent;
+        len -= sent;
+    }
+    return 1;
+}
+
+// Receive exactly len bytes
+int AdbClientRecvAll(SOCKET sock, void* data, size_t len) {
+    char* ptr = (char*)data;
+    while (len > 0) {
+        int chunk = (len > 0x40000000) ? 0x40000000 : (int)len;
+        int received = recv(sock, ptr, chunk, 0);
+        if (received <= 0) return 0;
+        ptr += received;
+        len -= received;
+    }
+    return 1;
+}
+
+// Parse a 4-digit hex length
+static int ParseHexLength(const char* hex, size_t* out) {
+    size_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = hex[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= (size_t)(c - '0');
+        else if (c >= 'a' && c <= 'f') value |= (size_t)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') value |= (size_t)(c - 'A' + 10);
+        else return 0;
+    }
+    *out = value;
+    return 1;
+}
+
+// Send a smart-socket request: 4 hex digits of length followed by the payload
+static int SendRequest(SOCKET sock, const char* service) {
+    size_t len = strlen(service);
+    if (len > 0xFFFF) return 0;
+
+    char header[5];
+    snprintf(header, sizeof(header), "%04x", (unsigned int)len);
+    return AdbClientSendAll(sock, header, 4) && AdbClientSendAll(sock, service, len);
+}
+
+// Read a length-prefixed string (used by FAIL replies and host queries)
+static char* ReadLengthPrefixed(SOCKET sock) {
+    char hex[4];
+    size_t len = 0;
+    if (!AdbClientRecvAll(sock, hex, 4) || !ParseHexLength(hex, &len)) {
+        return NULL;
+    }
+
+    char* data = (char*)SafeMalloc(len + 1);
+    if (len > 0 && !AdbClientRecvAll(sock, data, len)) {
+        free(data);
+        return NULL;
+    }
+    data[len] = '\0';
+    return data;
+}
+
+// Read OKAY/FAIL status
+static int ReadStatus(SOCKET sock) {
+    char status[4];
+    if (!AdbClientRecvAll(sock, status, 4)) return 0;
+
+    if (memcmp(status, "OKAY", 4) == 0) return 1;
+
+    if (memcmp(status, "FAIL", 4) == 0) {
+        char* message = ReadLengthPrefixed(sock);
+        SAFE_FREE(message);
+    }
+    return 0;
+}
+
+// Check that the server answers host:version, caching the outcome
+int AdbClientIsAvailable(void) {
+    LONG server_state = g_server_state;
+    if (server_state == 1) return 1;
+    if (server_state == -1 && GetTickCount64() - g_server_down_tick < SERVER_RETRY_MS) {
+        return 0;
+    }
+
+    int version = AdbClientGetServerVersion();
+    return version > 0;
+}
+
+// Query the server protocol version (host:version)
+int AdbClientGetServerVersion(void) {
+    SOCKET sock = AdbClientConnect();
+    if (sock == INVALID_SOCKET) {
+        g_server_down_tick = GetTickCount64();
+        InterlockedExchange(&g_server_state, -1);
+        return 0;
+    }
+
+    int version = 0;
+    if (SendRequest(sock, "host:version") && ReadStatus(sock)) {
+        char* reply = ReadLengthPrefixed(sock);
+        if (reply) {
+            version = (int)strtol(reply, NULL, 16);
+            free(reply);
+        }
+    }
+    closesocket(sock);
+
+    if (version > 0) {
+        InterlockedExchange(&g_server_state, 1);
+    } else {
+        g_server_down_tick = GetTickCount64();
+        InterlockedExchange(&g_server_state, -1);
+    }
+    return version;
+}
+
+// Mark the server as gone after a connection failure
+static void MarkServerDown(void) {
+    g_server_down_tick = GetTickCount64();
+    InterlockedExchange(&g_server_state, -1);
+}
+
+// Open a service on a device (or a host service when the name starts with "host")
+SOCKET AdbClientOpenService(const char* device_serial, const char* service) {
+    if (!service) return INVALID_SOCKET;
+
+    SOCKET sock = AdbClientConnect();
+    if (sock == INVALID_SOCKET) {
+        MarkServerDown();
+        return INVALID_SOCKET;
+    }
+
+    if (!StringStartsWith(service, "host")) {
+        // Switch the connection to the device transport first
+        char transport[300];
+        if (device_serial && strlen(device_serial) > 0) {
+            snprintf(transport, sizeof(transport), "host:transport:%s", device_serial);
+        } else {
+            snprintf(transport, sizeof(transport), "host:transport-any");
+        }
+
+        if (!SendRequest(sock, transport) || !ReadStatus(sock)) {
+            closesocket(sock);
+            return INVALID_SOCKET;
+        }
+    }
+
+    if (!SendRequest(sock, service) || !ReadStatus(sock)) {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+
+    return sock;
+}
+
+// Run a host query and return its length-prefixed reply
+char* AdbClientQuery(const char* service) {
+    if (!AdbClientIsAvailable()) return NULL;
+
+    SOCKET sock = AdbClientOpenService(NULL, service);
+    if (sock == INVALID_SOCKET) return NULL;
+
+    char* reply = ReadLengthPrefixed(sock);
+    closesocket(sock);
+    return reply;
+}
+
+// Rebuild the serial index after an entry was added or removed (caller holds
+// g_feature_lock exclusively)
+static void RebuildFeatureIndex(void) {
+    int index_capacity = FEATURE_CACHE_MIN_CAPACITY * 2;
+    while (index_capacity < g_feature_count * 2) index_capacity *= 2;
+
+    if (index_capacity != g_feature_index_capacity) {
+        free(g_feature_index);
+        g_feature_index = (int*)SafeMalloc(index_capacity * sizeof(int));
+        g_feature_index_capacity = index_capacity;
+    }
+    memset(g_feature_index, 0xFF, index_capacity * sizeof(int));
+
+    int mask = index_capacity - 1;
+    for (int i = 0; i < g_feature_count; i++) {
+        int slot = (int)(g_feature_cache[i].serial_hash & (unsigned int)mask);
+        while (g_feature_index[slot] >= 0) slot = (slot + 1) & mask;
+        g_feature_index[slot] = i;
+    }
+}
+
+// Find the cached features of a device (caller holds g_feature_lock)
+static FeatureCacheEntry* FindFeatures(const char* serial) {
+    if (g_feature_index_capacity == 0) return NULL;
+
+    unsigned int hash = HashString(serial);
+    int mask = g_feature_index_capacity - 1;
+    int slot = (int)(hash & (unsigned int)mask);
+
+    while (g_feature_index[slot] >= 0) {
+        FeatureCacheEntry* entry = &g_feature_cache[g_feature_index[slot]];
+        if (entry->serial_hash == hash && strcmp(entry->serial, serial) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+// Check whether the device advertises a feature (e.g. shell_v2)
+int AdbClientDeviceHasFeature(const char* device_serial, const char* feature) {
+    if (!feature) return 0;
+
+    const char* key = device_serial ? device_serial : "";
+    char* features = NULL;
+
+    AcquireSRWLockShared(&g_feature_lock);
+    FeatureCacheEntry* entry = key[0] ? FindFeatures(key) : NULL;
+    if (entry) features = _strdup(entry->features);
+    ReleaseSRWLockShared(&g_feature_lock);
+
+    if (!features) {
+        char service[300];
+        if (device_serial && strlen(device_serial) > 0) {
+            snprintf(service, sizeof(service), "host-serial:%s:features", device_serial);
+        } else {
+            snprintf(service, sizeof(service), "host:features");
+        }
+
+        features = AdbClientQuery(service);
+        if (!features) return 0;
+
+        // Cached until the device leaves or changes state (AdbClientForgetDevice)
+        if (key[0]) {
+            AcquireSRWLockExclusive(&g_feature_lock);
+            if (!FindFeatures(key)) {
+                if (g_feature_count == g_feature_capacity) {
+                    int capacity = g_feature_capacity > 0 ? g_feature_capacity * 2 : FEATURE_CACHE_MIN_CAPACITY;
+                    g_feature_cache = (FeatureCacheEntry*)SafeRealloc(g_feature_cache,
+                                                                      capacity * sizeof(FeatureCacheEntry));
+                    g_feature_capacity = capacity;
+                }
+                entry = &g_feature_cache[g_feature_count++];
+                memset(entry, 0, sizeof(FeatureCacheEntry));
+                strncpy(entry->serial, key, sizeof(entry->serial) - 1);
+                entry->serial_hash = HashString(entry->serial);
+                entry->features = _strdup(features);
+                RebuildFeatureIndex();
+            }
+            ReleaseSRWLockExclusive(&g_feature_lock);
+        }
+    }
+
+    // Features are a comma-separated list
+    int found = 0;
+    size_t feature_len = strlen(feature);
+    const char* cursor = features;
+    while (*cursor && !found) {
+        const char* comma = strchr(cursor, ',');
+        size_t len = comma ? (size_t)(comma - cursor) : strlen(cursor);
+        found = len == feature_len && strncmp(cursor, feature, len) == 0;
+        if (!comma) break;
+        cursor = comma + 1;
+    }
+
+    free(features);
+    return found;
+}
+
+// Drop what is cached about a device (it left, or came back in another state)
+void AdbClientForgetDevice(const char* device_serial) {
+    if (!device_serial) return;
+
+    AcquireSRWLockExclusive(&g_feature_lock);
+    FeatureCacheEntry* entry = FindFeatures(device_serial);
+    if (entry) {
+        free(entry->features);
+        FeatureCacheEntry* last = &g_feature_cache[g_feature_count - 1];
+        if (entry != last) memcpy(entry, last, sizeof(FeatureCacheEntry));
+        g_feature_count--;
+        RebuildFeatureIndex();
+    }
+    ReleaseSRWLockExclusive(&g_feature_lock);
+}
+
+// Append bytes to a growable, null-terminated buffer
+static void AppendToBuffer(char** data, size_t* size, size_t* capacity, const char* src, size_t len) {
+    if (*size + len + 1 > *capacity) {
+        size_t new_capacity = *capacity ? *capacity : 4096;
+        while (*size + len + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        *data = (char*)SafeRealloc(*data, new_capacity);
+        *capacity = new_capacity;
+    }
+    if (len > 0) {
+        memcpy(*data + *size, src, len);
+        *size += len;
+    }
+    (*data)[*size] = '\0';
+}
+
+// Allocate an empty result with null-terminated buffers
+static ProcessResult* CreateEmptyResult(void) {
+    ProcessResult* result = (ProcessResult*)SafeCalloc(1, sizeof(ProcessResult));
+    result->stdout_data = (char*)SafeCalloc(1, 1);
+    result->stderr_data = (char*)SafeCalloc(1, 1);
+    return result;
+}
+
+// Read a raw stream until the device closes it
+static ProcessResult* ReadStreamToResult(SOCKET sock) {
+    ProcessResult* result = CreateEmptyResult();
+    size_t capacity = 1;
+
+    char buffer[BUFFER_SIZE * 4];
+    int received;
+    while ((received = recv(sock, buffer, sizeof(buffer), 0)) > 0) {
+        AppendToBuffer(&result->stdout_data, &result->stdout_size, &capacity, buffer, (size_t)received);
+    }
+
+    result->exit_code = 0;
+    return result;
+}
+
+// Run a shell command using shell protocol v2, capturing or streaming stdout/stderr
+static ProcessResult* RunShellV2(const char* device_serial, const char* command,
+                                 ProcessOutputCallback on_output, void* user_data) {
+    if (!command) return NULL;
+    if (!AdbClientIsAvailable()) return NULL;
+
+    // Legacy devices without shell_v2 lose the exit code, leave those to adb.exe
+    if (!AdbClientDeviceHasFeature(device_serial, "shell_v2")) return NULL;
+
+    size_t service_len = strlen(command) + 32;
+    char* service = (char*)SafeMalloc(service_len);
+    snprintf(service, service_len, "shell,v2,raw:%s", command);
+
+    SOCKET sock = AdbClientOpenService(device_serial, service);
+    free(service);
+    if (sock == INVALID_SOCKET) return NULL;
+
+    ProcessResult* result = CreateEmptyResult();
+    size_t stdout_capacity = 1;
+    size_t stderr_capacity = 1;
+    int got_exit = 0;
+
+    char* payload = (char*)SafeMalloc(BUFFER_SIZE * 16);
+    size_t payload_capacity = BUFFER_SIZE * 16;
+
+    while (1) {
+        unsigned char header[5];
+        if (!AdbClientRecvAll(sock, header, sizeof(header))) break;
+
+        size_t len = (size_t)header[1] | ((size_t)header[2] << 8) |
+                     ((size_t)header[3] << 16) | ((size_t)header[4] << 24);
+        if (len > MAX_MESSAGE_SIZE) break;
+
+        if (len > payload_capacity) {
+            payload = (char*)SafeRealloc(payload, len);
+            payload_capacity = len;
+        }
+        if (len > 0 && !AdbClientRecvAll(sock, payload, len)) break;
+
+        if (header[0] == SHELL_ID_STDOUT || header[0] == SHELL_ID_STDERR) {
+            int is_stderr = (header[0] == SHELL_ID_STDERR);
+            if (on_output) {
+                if (len > 0) on_output(payload, len, is_stderr, user_data);
+            } else if (is_stderr) {
+                AppendToBuffer(&result->stderr_data, &result->stderr_size, &stderr_capacity, payload, len);
+            } else {
+                AppendToBuffer(&result->stdout_data, &result->stdout_size, &stdout_capacity, payload, len);
+            }
+        } else if (header[0] == SHELL_ID_EXIT) {
+            result->exit_code = (len > 0) ? (unsigned char)payload[0] : 0;
+            got_exit = 1;
+            break;
+        }
+    }
+
+    free(payload);
+    closesocket(sock);
+
+    if (!got_exit) {
+        // Connection dropped before the command finished
+        result->exit_code = 1;
+    }
+
+    return result;
+}
+
+// Send local bytes to the shell's stdin as batches of shell protocol packets
+int AdbClientShellWriteStdin(SOCKET sock, const void* data, size_t len) {
+    const char* bytes = (const char*)data;
+    unsigned char headers[SHELL_STDIN_BATCH][5];
+    WSABUF buffers[SHELL_STDIN_BATCH * 2];
+
+    while (len > 0) {
+        DWORD count = 0;
+        for (int i = 0; i < SHELL_STDIN_BATCH && len > 0; i++) {
+            size_t chunk = len > SHELL_STDIN_PAYLOAD ? SHELL_STDIN_PAYLOAD : len;
+            headers[i][0] = SHELL_ID_STDIN;
+            headers[i][1] = (unsigned char)(chunk & 0xFF);
+            headers[i][2] = (unsigned char)((chunk >> 8) & 0xFF);
+            headers[i][3] = (unsigned char)((chunk >> 16) & 0xFF);
+            headers[i][4] = (unsigned char)((chunk >> 24) & 0xFF);
+            buffers[count].buf = (CHAR*)headers[i];
+            buffers[count].len = 5;
+            count++;
+            buffers[count].buf = (CHAR*)bytes;
+            buffers[count].len = (ULONG)chunk;
+            count++;
+            bytes += chunk;
+            len -= chunk;
+        }
+
+        // WSASend may stop part way on a busy socket
+        WSABUF* pending = buffers;
+        while (count > 0) {
+            DWORD sent = 0;
+            if (WSASend(sock, pending, count, &sent, 0, NULL, NULL) != 0) return 0;
+            while (count > 0 && sent >= pending->len) {
+                sent -= pending->len;
+                pending++;
+                count--;
+            }
+            if (count > 0) {
+                pending->buf += sent;
+                pending->len -= sent;
+            }
+        }
+    }
+    return 1;
+}
+
+// Signal end of input to a shell v2 command
+int AdbClientShellCloseStdin(SOCKET sock) {
+    unsigned char close_stdin[5] = { SHELL_ID_CLOSE_STDIN, 0, 0, 0, 0 };
+    return AdbClientSendAll(sock, close_stdin, sizeof(close_stdin));
+}
+
+// Collect a shell v2 command's stdout (truncated to out_size) and exit code
+int AdbClientShellWaitExit(SOCKET sock, char* out, size_t out_size, int* exit_code) {
+    size_t used = 0;
+    char payload[4096];
+    out[0] = '\0';
+
+    while (1) {
+        unsigned char header[5];
+        if (!AdbClientRecvAll(sock, header, sizeof(header))) return 0;
+
+        size_t len = (size_t)header[1] | ((size_t)header[2] << 8) |
+                     ((size_t)header[3] << 16) | ((size_t)header[4] << 24);
+        if (header[0] == SHELL_ID_EXIT && len == 0) {
+            *exit_code = 0;
+            return 1;
+        }
+        while (len > 0) {
+            size_t take = len > sizeof(payload) ? sizeof(payload) : len;
+            if (!AdbClientRecvAll(sock, payload, take)) return 0;
+            if (header[0] == SHELL_ID_STDOUT && used + 1 < out_size) {
+                size_t copy = take < out_size - 1 - used ? take : out_size - 1 - used;
+                memcpy(out + used, payload, copy);
+                used += copy;
+                out[used] = '\0';
+            }
+            if (header[0] == SHELL_ID_EXIT) {
+                *exit_code = (unsigned char)payload[0];
+                return 1;
+            }
+            len -= take;
+        }
+    }
+}
+
+// Run a shell command using shell protocol v2 (separate stdout/stderr and exit code)
+ProcessResult* AdbClientShell(const char* device_serial, const char* command) {
+    return RunShellV2(device_serial, command, NULL, NULL);
+}
+
+// Same as AdbClientShell but output goes to on_output as packets arrive
+ProcessResult* AdbClientShellStreaming(const char* device_serial, const char* command,
+                                       ProcessOutputCallback on_output, void* user_data) {
+    return RunShellV2(device_serial, command, on_output, user_data);
+}
+
+// Run a command with exec: (raw stdout, no pty, no exit code)
+ProcessResult* AdbClientExec(const char* device_serial, const char* command) {
+    if (!command) return NULL;
+
+    size_t service_len = strlen(command) + 8;
+    char* service = (char*)SafeMalloc(service_len);
+    snprintf(service, service_len, "exec:%s", command);
+
+    ProcessResult* result = AdbClientRunService(device_serial, service);
+    free(service);
+    return result;
+}
+
+// Open any device service and collect its output until the stream closes
+ProcessResult* AdbClientRunService(const char* device_serial, const char* service) {
+    if (!service) return NULL;
+    if (!AdbClientIsAvailable()) return NULL;
+
+    SOCKET sock = AdbClientOpenService(device_serial, service);
+    if (sock == INVALID_SOCKET) return NULL;
+
+    ProcessResult* result = ReadStreamToResult(sock);
+    closesocket(sock);
+    return result;
+}
+
+// Stream an APK into "cmd package install -S" like adb's streamed install
+ProcessResult* AdbClientInstallApk(const char* device_serial, const char* apk_path,
+                                   ProgressCallback progress, void* user_data) {
+    if (!apk_path) return NULL;
+    if (!AdbClientIsAvailable()) return NULL;
+
+    // Streamed installs need the cmd service (Android 7+); older devices use adb.exe
+    if (!AdbClientDeviceHasFeature(device_serial, "cmd")) return NULL;
+
+    HANDLE file = CreateFileA(apk_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return NULL;
+    }
+    unsigned long long size = (unsigned long long)file_size.QuadPart;
+
+    char service[128];
+    snprintf(service, sizeof(service), "exec:cmd package 'install' -S %llu", size);
+    SOCKET sock = AdbClientOpenService(device_serial, service);
+    if (sock == INVALID_SOCKET) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    const char* name = strrchr(apk_path, '\\');
+    name = name ? name + 1 : apk_path;
+
+    // pm reads exactly `size` bytes from stdin, then prints Success or Failure [...]
+    char* buffer = (char*)SafeMalloc(INSTALL_STREAM_CHUNK);
+    unsigned long long sent = 0;
+    int ok = 1;
+    while (ok && sent < size) {
+        DWORD read = 0;
+        if (!ReadFile(file, buffer, INSTALL_STREAM_CHUNK, &read, NULL) || read == 0) {
+            ok = 0;
+            break;
+        }
+        ok = AdbClientSendAll(sock, buffer, read);
+        sent += read;
+        if (progress) progress(name, sent, size, user_data);
+    }
+    free(buffer);
+    CloseHandle(file);
+
+    ProcessResult* result = ReadStreamToResult(sock);
+    closesocket(sock);
+
+    TrimString(result->stdout_data);
+    result->stdout_size = strlen(result->stdout_data);
+    result->exit_code = (ok && strstr(result->stdout_data, "Success") != NULL) ? 0 : 1;
+    return result;
+}
+
+// List devices through host:devices-l, formatted like `adb devices -l`
+ProcessResult* AdbClientDevices(void) {
+    char* reply = AdbClientQuery("host:devices-l");
+    if (!reply) return NULL;
+
+    ProcessResult* result = CreateEmptyResult();
+    size_t capacity = 1;
+    const char* header = "List of devices attached\n";
+    AppendToBuffer(&result->stdout_data, &result->stdout_size, &capacity, header, strlen(header));
+    AppendToBuffer(&result->stdout_data, &result->stdout_size, &capacity, reply, strlen(reply));
+    free(reply);
+
+    result->exit_code = 0;
+    return result;
+}
+
+// Release Winsock
+void AdbClientCleanup(void) {
+    AcquireSRWLockExclusive(&g_feature_lock);
+    for (int i = 0; i < g_feature_count; i++) {
+        free(g_feature_cache[i].features);
+    }
+    SAFE_FREE(g_feature_cache);
+    SAFE_FREE(g_feature_index);
+    g_feature_count = 0;
+    g_feature_capacity = 0;
+    g_feature_index_capacity = 0;
+    ReleaseSRWLockExclusive(&g_feature_lock);
+
+    // Called once on exit; Winsock is not started again afterwards
+    if (InterlockedExchange(&g_wsa_initialized, 0)) {
+        WSACleanup();
+    }
+}
+
+// Subscribe to device list updates; the first message is the current list
+int AdbClientTrackerOpen(AdbDeviceTracker* tracker) {
+    if (!tracker) return 0;
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->sock = INVALID_SOCKET;
+
+    if (!AdbClientIsAvailable()) return 0;
+
+    SOCKET sock = AdbClientOpenService(NULL, "host:track-devices-l");
+    if (sock == INVALID_SOCKET) return 0;
+
+    WSAEVENT event = WSACreateEvent();
+    if (event == NULL) {
+        closesocket(sock);
+        return 0;
+    }
+
+    // Also switches the socket to non-blocking mode
+    if (WSAEventSelect(sock, event, FD_READ | FD_CLOSE) != 0) {
+        WSACloseEvent(event);
+        closesocket(sock);
+        return 0;
+    }
+
+    tracker->sock = sock;
+    tracker->event = event;
+    return 1;
+}
+
+// Drain whatever has arrived and return the newest complete device list (NULL if none).
+// *closed is set when the server dropped the subscription.
+char* AdbClientTrackerRead(AdbDeviceTracker* tracker, int* closed) {
+    if (closed) *closed = 0;
+    if (!tracker || tracker->sock == INVALID_SOCKET) {
+        if (closed) *closed = 1;
+        return NULL;
+    }
+
+    WSANETWORKEVENTS events;
+    WSAEnumNetworkEvents(tracker->sock, tracker->event, &events);
+
+    char chunk[BUFFER_SIZE];
+    while (1) {
+        int received = recv(tracker->sock, chunk, sizeof(chunk), 0);
+        if (received > 0) {
+            AppendToBuffer(&tracker->buffer, &tracker->size, &tracker->capacity, chunk, (size_t)received);
+            continue;
+        }
+        if (received == 0 || WSAGetLastError() != WSAEWOULDBLOCK) {
+            if (closed) *closed = 1;
+        }
+        break;
+    }
+
+    // Several updates may be queued; only the last one matters
+    char* latest = NULL;
+    size_t offset = 0;
+    while (tracker->size - offset >= 4) {
+        size_t len = 0;
+        if (!ParseHexLength(tracker->buffer + offset, &len)) {
+            if (closed) *closed = 1;
+            break;
+        }
+        if (tracker->size - offset - 4 < len) break;
+
+        SAFE_FREE(latest);
+        latest = (char*)SafeMalloc(len + 1);
+        memcpy(latest, tracker->buffer + offset + 4, len);
+        latest[len] = '\0';
+        offset += 4 + len;
+    }
+
+    if (offset > 0) {
+        memmove(tracker->buffer, tracker->buffer + offset, tracker->size - offset);
+        tracker->size -= offset;
+    }
+
+    return latest;
+}
+
+// End the subscription
+void AdbClientTrackerClose(AdbDeviceTracker* tracker) {
+    if (!tracker) return;
+
+    if (tracker->sock != INVALID_SOCKET) {
+        closesocket(tracker->sock);
+        tracker->sock = INVALID_SOCKET;
+    }
+    if (tracker->event != NULL) {
+        WSACloseEvent(tracker->event);
+        tracker->event = NULL;
+    }
+    SAFE_FREE(tracker->buffer);
+    tracker->size = 0;
+    tracker->capacity = 0;
+}
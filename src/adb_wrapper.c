@@ -1,126 +1,30 @@
 #include "adb_wrapper.h"
+#include "adb_client.h"
+#include "prop_cache.h"
 #include "utils.h"
+#include "process_runner.h"
 #include <stdarg.h>
 
-// Read output from pipe into buffer
-static void ReadOutputToBuffer(HANDLE hRead, char** data, size_t* size) {
-    DWORD buffer_size = 4096;
-    *data = (char*)SafeMalloc(buffer_size);
-    *size = 0;
-
-    DWORD bytes_read;
-    char temp[4096];
-    while (ReadFile(hRead, temp, sizeof(temp), &bytes_read, NULL) && bytes_read > 0) {
-        if (*size + bytes_read >= buffer_size) {
-            buffer_size *= 2;
-            *data = (char*)SafeRealloc(*data, buffer_size);
-        }
-        memcpy(*data + *size, temp, bytes_read);
-        *size += bytes_read;
-    }
-
-    // Null-terminate
-    if (*size + 1 >= buffer_size) {
-        *data = (char*)SafeRealloc(*data, buffer_size + 1);
-    }
-    (*data)[*size] = '\0';
-}
-
 // Spawn adb.exe and capture output
 ProcessResult* RunAdbCommand(const char* adb_path, const char* args[], int arg_count) {
     if (!adb_path || !args || arg_count <= 0) {
         return NULL;
     }
 
-    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
-    HANDLE stdout_read, stdout_write;
-    HANDLE stderr_read, stderr_write;
-
-    // Create pipes for stdout and stderr
-    if (!CreatePipe(&stdout_read, &stdout_write, &sa, 0) ||
-        !CreatePipe(&stderr_read, &stderr_write, &sa, 0)) {
-        return NULL;
-    }
-
-    // Set read handles to not be inherited
-    SetHandleInformation(stdout_read, HANDLE_FLAG_INHERIT, 0);
-    SetHandleInformation(stderr_read, HANDLE_FLAG_INHERIT, 0);
-
-    // Build command line
-    size_t cmdline_size = strlen(adb_path) + 4; // +4 for quotes and space
-    for (int i = 0; i < arg_count; i++) {
-        cmdline_size += strlen(args[i]) + 3; // +3 for space and potential quotes
-    }
-
-    char* cmdline = (char*)SafeMalloc(cmdline_size);
-    snprintf(cmdline, cmdline_size, "\"%s\"", adb_path);
-    for (int i = 0; i < arg_count; i++) {
-        strcat(cmdline, " ");
-        // Quote arguments that contain spaces
-        if (strchr(args[i], ' ')) {
-            strcat(cmdline, "\"");
-            strcat(cmdline, args[i]);
-            strcat(cmdline, "\"");
-        } else {
-            strcat(cmdline, args[i]);
-        }
-    }
+    return RunProcessEx(adb_path, args, arg_count, NULL);
+}
 
-    // Setup startup info
-    STARTUPINFOA si = { sizeof(STARTUPINFOA) };
-    si.dwFlags = STARTF_USESTDHANDLES;
-    si.hStdOutput = stdout_write;
-    si.hStdError = stderr_write;
-    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
-
-    PROCESS_INFORMATION pi = {0};
-
-    // Create process
-    BOOL success = CreateProcessA(
-        NULL,
-        cmdline,
-        NULL,
-        NULL,
-        TRUE,
-        CREATE_NO_WINDOW,
-        NULL,
-        NULL,
-        &si,
-        &pi
-    );
-
-    // Close write ends (we only read)
-    CloseHandle(stdout_write);
-    CloseHandle(stderr_write);
-
-    if (!success) {
-        CloseHandle(stdout_read);
-        CloseHandle(stderr_read);
-        free(cmdline);
+// Spawn adb.exe and hand output to on_output while it runs (NULL callback = capture)
+ProcessResult* RunAdbCommandStreaming(const char* adb_path, const char* args[], int arg_count,
+                                      ProcessOutputCallback on_output, void* user_data) {
+    if (!adb_path || !args || arg_count <= 0) {
         return NULL;
     }
 
-    // Allocate result structure
-    ProcessResult* result = (ProcessResult*)SafeCalloc(1, sizeof(ProcessResult));
-
-    // Read output
-    ReadOutputToBuffer(stdout_read, &result->stdout_data, &result->stdout_size);
-    ReadOutputToBuffer(stderr_read, &result->stderr_data, &result->stderr_size);
-
-    // Wait for process to finish
-    WaitForSingleObject(pi.hProcess, INFINITE);
-    DWORD exit_code;
-    GetExitCodeProcess(pi.hProcess, &exit_code);
-    result->exit_code = (int)exit_code;
-
-    // Cleanup
-    CloseHandle(stdout_read);
-    CloseHandle(stderr_read);
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-    free(cmdline);
-
-    return result;
+    ProcessOptions options = {0};
+    options.on_output = on_output;
+    options.user_data = user_data;
+    return RunProcessEx(adb_path, args, arg_count, &options);
 }
 
 // Free process result
@@ -134,16 +38,29 @@ void FreeProcessResult(ProcessResult* result) {
 
 // List connected devices
 ProcessResult* AdbDevices(const char* adb_path) {
+    // Ask the running server directly, spawn adb.exe (which starts the server) otherwise
+    ProcessResult* result = AdbClientDevices();
+    if (result) return result;
+
     const char* args[] = { "devices", "-l" };
     return RunAdbCommand(adb_path, args, 2);
 }
 
 // Execute shell command
 ProcessResult* AdbShellCommand(const char* adb_path, const char* device_serial, const char* command) {
+    return AdbShellCommandStreaming(adb_path, device_serial, command, NULL, NULL);
+}
+
+// Execute shell command, streaming its output (NULL callback = capture)
+ProcessResult* AdbShellCommandStreaming(const char* adb_path, const char* device_serial, const char* command,
+                                        ProcessOutputCallback on_output, void* user_data) {
     if (!command) return NULL;
 
-    int arg_count = 2; // "shell" + command
-    int serial_index = 0;
+    // Talk to the adb server directly when possible
+    ProcessResult* result = on_output
+        ? AdbClientShellStreaming(device_serial, command, on_output, user_data)
+        : AdbClientShell(device_serial, command);
+    if (result) return result;
 
     const char* args[4];
     int idx = 0;
@@ -151,13 +68,12 @@ ProcessResult* AdbShellCommand(const char* adb_path, const char* device_serial,
     if (device_serial) {
         args[idx++] = "-s";
         args[idx++] = device_serial;
-        serial_index = 1;
     }
 
     args[idx++] = "shell";
     args[idx++] = command;
 
-    return RunAdbCommand(adb_path, args, idx);
+    return RunAdbCommandStreaming(adb_path, args, idx, on_output, user_data);
 }
 
 // Get device property
@@ -173,6 +89,13 @@ ProcessResult* AdbGetProp(const char* adb_path, const char* device_serial, const
 // Push file to device
 ProcessResult* AdbPushFile(const char* adb_path, const char* device_serial,
                            const char* local_path, const char* remote_path) {
+    return AdbPushFileStreaming(adb_path, device_serial, local_path, remote_path, NULL, NULL);
+}
+
+// Push file to device, streaming adb's output (NULL callback = capture)
+ProcessResult* AdbPushFileStreaming(const char* adb_path, const char* device_serial,
+                                    const char* local_path, const char* remote_path,
+                                    ProcessOutputCallback on_output, void* user_data) {
     if (!local_path || !remote_path) return NULL;
 
     int idx = 0;
@@ -187,7 +110,7 @@ ProcessResult* AdbPushFile(const char* adb_path, const char* device_serial,
     args[idx++] = local_path;
     args[idx++] = remote_path;
 
-    return RunAdbCommand(adb_path, args, idx);
+    return RunAdbCommandStreaming(adb_path, args, idx, on_output, user_data);
 }
 
 // Pull file from device
@@ -251,6 +174,16 @@ ProcessResult* AdbUninstallPackage(const char* adb_path, const char* device_seri
 
 // Reboot device
 ProcessResult* AdbReboot(const char* adb_path, const char* device_serial, const char* mode) {
+    // Properties (and root state) may differ after the reboot
+    if (device_serial) PropCacheInvalidate(device_serial);
+
+    char service[128];
+    snprintf(service, sizeof(service), "reboot:%s",
+             (mode && strcmp(mode, "system") != 0) ? mode : "");
+
+    ProcessResult* result = AdbClientRunService(device_serial, service);
+    if (result) return result;
+
     int idx = 0;
     const char* args[5];
 
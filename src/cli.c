@@ -2,9 +2,18 @@
 #include "device_manager.h"
 #include "file_transfer.h"
 #include "fastboot_manager.h"
+#include "fastboot_client.h"
+#include "fastboot_var_cache.h"
 #include "adb_wrapper.h"
+#include "adb_client.h"
+#include "shell_session.h"
+#include "prop_cache.h"
+#include "progress.h"
 #include "utils.h"
 #include "module_installer.h"
+#include "payload.h"
+#include "super_image.h"
+#include "flash_ledger.h"
 #include <string.h>
 #include <ctype.h>
 #include <conio.h>
@@ -66,16 +75,22 @@ void ShowBanner(void) {
 // Get prompt string without newline
 void GetPromptString(const AppState* state, char* buffer, size_t size) {
     char device_str[64] = "no device";
-    const char* mode_str = (state->current_mode == MODE_FASTBOOT) ? "fastboot" : "adb";
-    
+
+    // Called from the monitor thread too, so read mode and device from one pinned snapshot
+    SnapshotGuard guard;
+    const DeviceSnapshot* snapshot = BeginSnapshotRead(state, &guard);
+    int fastboot = snapshot && snapshot->current_mode == MODE_FASTBOOT;
+    const char* mode_str = fastboot ? "fastboot" : "adb";
+
     // Get device ID
-    if (state->current_mode == MODE_FASTBOOT) {
-        AdbDevice* device = GetSelectedFastbootDevice(state);
+    if (fastboot) {
+        const AdbDevice* device = GetSelectedFastbootDevice(state);
         if (device) strncpy(device_str, device->serial_id, sizeof(device_str)-1);
     } else {
-        AdbDevice* device = GetSelectedDevice(state);
+        const AdbDevice* device = GetSelectedDevice(state);
         if (device) strncpy(device_str, device->serial_id, sizeof(device_str)-1);
     }
+    EndSnapshotRead(state, &guard);
 
     switch (state->current_theme) {
         case THEME_ROBBYRUSSELL:
@@ -314,15 +329,25 @@ void ShowHelp(AppState* state) {
     printf("========================================\n");
     printf("\n");
     
-    if (state->current_mode == MODE_ADB) {
+    if (GetCurrentMode(state) == MODE_ADB) {
         printf("ADB Device Management:\n");
         printf("  devices, dev             List connected devices\n");
         printf("  select <index|serial>    Select device\n");
         printf("  info                     Show device information\n");
         printf("\n");
         printf("ADB File Operations:\n");
-        printf("  push <local> [remote]    Push file to device (default: /storage/emulated/0/)\n");
-        printf("  pull <remote> [local]    Pull file from device\n");
+        printf("  push <local> [remote]    Push file or folder to device (default: /storage/emulated/0/)\n");
+        printf("  pull <remote> [local]    Pull file or folder from device\n");
+        printf("                           - Folders transfer recursively, -j N files at a time (default %d)\n",
+               DEFAULT_TRANSFER_JOBS);
+        printf("                           - --tar moves a folder as one tar stream (many small files)\n");
+        printf("                           - pull --tar -z / --lz4 compresses on the device\n");
+        printf("                           - --verify hashes a file in flight and checks it on the device\n");
+        printf("  sync <local> <remote>    Push only new/changed files of a folder\n");
+        printf("                           - --delete removes remote files missing locally\n");
+        printf("                           - --checksum compares content, --dry-run only reports\n");
+        printf("  bpush <local> [remote]   Push one file to every online device at once\n");
+        printf("                           - --devices s1,s2 limits the targets\n");
         printf("  ls <remote_path>         List files on device\n");
         printf("  rm <remote_path>         Delete file on device\n");
         printf("  mkdir <remote_path>      Create directory on device\n");
@@ -345,6 +370,16 @@ void ShowHelp(AppState* state) {
         printf("  select <id>       Select fastboot device\n");
         printf("  info              Show fastboot device info\n");
         printf("  flash <part> <img> Flash partition with image\n");
+        printf("                    - --verify[=<sha256>] hashes the image while it is sent\n");
+        printf("                    - .gz/.lz4/.xz images and zips holding <part>.img are unpacked on the fly\n");
+        printf("                    - payload.bin or an OTA zip: the partition is decoded from the payload\n");
+        printf("                    - super.img: a logical partition is read out of it (fastbootd)\n");
+        printf("                    - --skip-unchanged skips it if the ledger says the partition holds it\n");
+        printf("                    - headers are checked against the partition first; --no-check skips that\n");
+        printf("  flashall <manifest|dir|zip> Flash a whole image set after one confirmation\n");
+        printf("                    - --set-active=<slot>, --reboot[=<mode>] run afterwards\n");
+        printf("                    - --skip-unchanged leaves out images the partitions already hold\n");
+        printf("                    - every image is checked before any is sent; --no-check skips that\n");
         printf("  erase <part>      Erase partition\n");
         printf("  format <part> <fs> Format partition\n");
         printf("  reboot [mode]     Reboot device\n");
@@ -354,6 +389,8 @@ void ShowHelp(AppState* state) {
         printf("  lock              Lock bootloader\n");
         printf("  wipe <part>       Wipe data\n");
         printf("  activate <slot>   Activate slot\n");
+        printf("  connect <host[:port]> Attach a network device (fastboot over TCP)\n");
+        printf("  disconnect [serial] Forget a network device\n");
         printf("\n");
         printf("To use ADB commands, switch back to ADB mode or use 'adb' prefix (future).\n");
     }
@@ -364,9 +401,16 @@ void ShowHelp(AppState* state) {
     printf("  version                  Show version information\n");
     printf("  cls                      Clear screen\n");
     printf("  cmd                      Enter Windows Command Prompt (type 'exit' to return)\n");
+    printf("  payload list <file>      Partitions of an OTA payload.bin or OTA zip\n");
+    printf("  payload extract <file> [parts...] [-o dir]  Decode partitions to <part>.img on all cores\n");
+    printf("  super list <file>        Logical partitions of a super.img (raw or sparse)\n");
+    printf("  super extract <file> [parts...] [-o dir]  Copy logical partitions out to <part>.img\n");
+    printf("  ledger [serial]          What was last flashed to each partition (%s)\n", FLASH_LEDGER_FILE);
+    printf("  ledger clear [serial]    Forget the flash history of one device or all\n");
     printf("  exit, quit               Exit program\n");
     printf("\n");
     printf("Note: Auto device monitoring is enabled by default (3s interval)\n");
+    printf("Note: Push, pull, install, download and flash throughput is logged to %s\n", TRANSFER_STATS_LOG);
 }
 
 // Parse command input
@@ -418,6 +462,8 @@ static int DispatchFastbootSubcommand(AppState* state, const char* subcommand, c
         return CmdFbInfo(state, &subcmd);
     } else if (strcmp(subcommand, "flash") == 0) {
         return CmdFbFlash(state, &subcmd);
+    } else if (strcmp(subcommand, "flashall") == 0) {
+        return CmdFbFlashAll(state, &subcmd);
     } else if (strcmp(subcommand, "erase") == 0) {
         return CmdFbErase(state, &subcmd);
     } else if (strcmp(subcommand, "format") == 0) {
@@ -436,6 +482,10 @@ static int DispatchFastbootSubcommand(AppState* state, const char* subcommand, c
         return CmdFbActivate(state, &subcmd);
     } else if (strcmp(subcommand, "wipe") == 0) {
         return CmdFbWipe(state, &subcmd);
+    } else if (strcmp(subcommand, "connect") == 0) {
+        return CmdFbConnect(state, &subcmd);
+    } else if (strcmp(subcommand, "disconnect") == 0) {
+        return CmdFbDisconnect(state, &subcmd);
     }
     
     return 0; // Not a fastboot command
@@ -459,6 +509,10 @@ static int DispatchAdbSubcommand(AppState* state, const char* subcommand, const
         return CmdPush(state, &subcmd);
     } else if (strcmp(subcommand, "pull") == 0) {
         return CmdPull(state, &subcmd);
+    } else if (strcmp(subcommand, "sync") == 0) {
+        return CmdSync(state, &subcmd);
+    } else if (strcmp(subcommand, "bpush") == 0) {
+        return CmdBroadcastPush(state, &subcmd);
     } else if (strcmp(subcommand, "ls") == 0) {
         return CmdLs(state, &subcmd);
     } else if (strcmp(subcommand, "rm") == 0) {
@@ -490,7 +544,7 @@ static int DispatchAdbSubcommand(AppState* state, const char* subcommand, const
 int CmdAdb(AppState* state, const Command* cmd) {
     if (strlen(cmd->args) == 0) {
         printf("Usage: adb <command> [args...]\n");
-        printf("Commands: devices, select, info, push, pull, ls, rm, mkdir, shell, install, uninstall, reboot, dli, shizuku\n");
+        printf("Commands: devices, select, info, push, pull, sync, bpush, ls, rm, mkdir, shell, install, uninstall, reboot, dli, shizuku\n");
         return 1;
     }
 
@@ -528,7 +582,7 @@ int CmdAdb(AppState* state, const Command* cmd) {
 int CmdFastboot(AppState* state, const Command* cmd) {
     if (strlen(cmd->args) == 0) {
         printf("Usage: fastboot <command> [args...]\n");
-        printf("Commands: devices, select, info, flash, erase, format, unlock, lock, oem, reboot, getvar, activate, wipe\n");
+        printf("Commands: devices, select, info, flash, flashall, erase, format, unlock, lock, oem, reboot, getvar, activate, wipe, connect, disconnect\n");
         return 1;
     }
 
@@ -603,7 +657,7 @@ static const Shortcut g_fastboot_shortcuts[] = {
 static int g_last_shortcuts_line_count = 0;
 
 static void ShowShortcuts(AppState* state) {
-    const Shortcut* shortcuts = (state->current_mode == MODE_FASTBOOT) ? g_fastboot_shortcuts : g_adb_shortcuts;
+    const Shortcut* shortcuts = (GetCurrentMode(state) == MODE_FASTBOOT) ? g_fastboot_shortcuts : g_adb_shortcuts;
     int lines = 0;
     
     printf("\n"); lines++;
@@ -622,7 +676,7 @@ static void ShowShortcuts(AppState* state) {
 }
 
 static const char* GetShortcutCommand(AppState* state, const char* name) {
-    const Shortcut* shortcuts = (state->current_mode == MODE_FASTBOOT) ? g_fastboot_shortcuts : g_adb_shortcuts;
+    const Shortcut* shortcuts = (GetCurrentMode(state) == MODE_FASTBOOT) ? g_fastboot_shortcuts : g_adb_shortcuts;
     
     for (int i = 0; shortcuts[i].name != NULL; i++) {
         if (strcmp(name, shortcuts[i].name) == 0) {
@@ -645,7 +699,7 @@ int ExecuteCommand(AppState* state, const Command* cmd) {
     }
 
     // 1. If in fastboot mode, try fastboot subcommands first (no prefix)
-    if (state->current_mode == MODE_FASTBOOT) {
+    if (GetCurrentMode(state) == MODE_FASTBOOT) {
         // Exclude utility commands from auto-routing
         if (strcmp(cmd->name, "reboot") != 0 && 
             strcmp(cmd->name, "help") != 0 && 
@@ -661,7 +715,7 @@ int ExecuteCommand(AppState* state, const Command* cmd) {
     }
 
     // 2. If in ADB mode, try ADB subcommands first (no prefix)
-    if (state->current_mode == MODE_ADB) {
+    if (GetCurrentMode(state) == MODE_ADB) {
         // Exclude utility commands from auto-routing
         if (strcmp(cmd->name, "reboot") != 0 && 
             strcmp(cmd->name, "help") != 0 && 
@@ -694,6 +748,12 @@ int ExecuteCommand(AppState* state, const Command* cmd) {
         return CmdCls(state, cmd);
     } else if (strcmp(cmd->name, "cmd") == 0) {
         return CmdCmd(state, cmd);
+    } else if (strcmp(cmd->name, "payload") == 0) {
+        return CmdPayload(state, cmd);
+    } else if (strcmp(cmd->name, "super") == 0) {
+        return CmdSuper(state, cmd);
+    } else if (strcmp(cmd->name, "ledger") == 0) {
+        return CmdLedger(state, cmd);
     } else if (strcmp(cmd->name, "exit") == 0 || strcmp(cmd->name, "quit") == 0) {
         return -1; // Signal to exit
     }
@@ -737,7 +797,7 @@ int CmdSelect(AppState* state, const Command* cmd) {
     if (isdigit(cmd->args[0])) {
         int index = atoi(cmd->args);
         if (SelectDevice(state, index)) {
-            AdbDevice* dev = GetSelectedDevice(state);
+            const AdbDevice* dev = GetSelectedDevice(state);
             printf("Selected device: %s\n", dev->serial_id);
         } else {
             printf("Invalid device index.\n");
@@ -745,7 +805,7 @@ int CmdSelect(AppState* state, const Command* cmd) {
     } else {
         // Try as serial number
         if (SelectDeviceBySerial(state, cmd->args)) {
-            AdbDevice* dev = GetSelectedDevice(state);
+            const AdbDevice* dev = GetSelectedDevice(state);
             printf("Selected device: %s\n", dev->serial_id);
         } else {
             printf("Device not found: %s\n", cmd->args);
@@ -757,7 +817,7 @@ int CmdSelect(AppState* state, const Command* cmd) {
 
 // Command: info
 int CmdInfo(AppState* state, const Command* cmd) {
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 1;
@@ -774,6 +834,23 @@ int CmdInfo(AppState* state, const Command* cmd) {
     if (strlen(device->android_version) > 0) {
         printf("Android:      %s (API %s)\n", device->android_version, device->api_level);
     }
+
+    // Everything else comes from the cached getprop snapshot
+    static const struct { const char* label; const char* prop; } extra_props[] = {
+        { "Brand:        ", "ro.product.brand" },
+        { "Product:      ", "ro.product.model" },
+        { "ABI:          ", "ro.product.cpu.abi" },
+        { "Patch level:  ", "ro.build.version.security_patch" },
+        { "Build:        ", "ro.build.display.id" },
+        { "Slot:         ", "ro.boot.slot_suffix" }
+    };
+    char value[PROP_VALUE_MAX_LEN];
+    for (size_t i = 0; i < ARRAY_SIZE(extra_props); i++) {
+        if (PropCacheGet(state->adb_path, device->serial_id, extra_props[i].prop, value, sizeof(value)) &&
+            strlen(value) > 0) {
+            printf("%s%s\n", extra_props[i].label, value);
+        }
+    }
     printf("========================================\n");
 
     return 1;
@@ -781,7 +858,7 @@ int CmdInfo(AppState* state, const Command* cmd) {
 
 // Command: shell
 int CmdShell(AppState* state, const Command* cmd) {
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 1;
@@ -848,58 +925,249 @@ int CmdShell(AppState* state, const Command* cmd) {
         return 1;
     }
 
-    ProcessResult* result = AdbShellCommand(state->adb_path, device->serial_id, cmd->args);
+    // Stream output as it arrives so long-running commands (logcat -d, dumpsys) show progress
+    ProcessResult* result = AdbShellCommandStreaming(state->adb_path, device->serial_id, cmd->args,
+                                                     WriteOutputToConsole, NULL);
     if (!result) {
         PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to execute shell command");
         return 1;
     }
 
-    if (result->stdout_data && strlen(result->stdout_data) > 0) {
-        printf("%s\n", result->stdout_data);
+    FreeProcessResult(result);
+    return 1;
+}
+
+// Split arguments on whitespace, honoring "double quotes" (paths with spaces)
+static int SplitArguments(const char* args, char argv[][MAX_PATH], int max_args) {
+    int argc = 0;
+    const char* p = args;
+
+    while (*p && argc < max_args) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+
+        size_t len = 0;
+        int quoted = 0;
+        while (*p && (quoted || !isspace((unsigned char)*p))) {
+            if (*p == '"') {
+                quoted = !quoted;
+            } else if (len < MAX_PATH - 1) {
+                argv[argc][len++] = *p;
+            }
+            p++;
+        }
+        argv[argc][len] = '\0';
+        argc++;
     }
 
-    if (result->stderr_data && strlen(result->stderr_data) > 0) {
-        fprintf(stderr, "%s\n", result->stderr_data);
+    return argc;
+}
+
+// Pull "-j N" / "--jobs N" out of an argument list; returns the remaining count
+static int ExtractJobsOption(char argv[][MAX_PATH], int argc, int* jobs) {
+    int out = 0;
+    for (int i = 0; i < argc; i++) {
+        if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) && i + 1 < argc) {
+            *jobs = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && isdigit((unsigned char)argv[i][2])) {
+            *jobs = atoi(argv[i] + 2);
+        } else {
+            if (out != i) strcpy(argv[out], argv[i]);
+            out++;
+        }
     }
 
-    FreeProcessResult(result);
-    return 1;
+    if (*jobs < 1) *jobs = 1;
+    if (*jobs > MAX_TRANSFER_JOBS) *jobs = MAX_TRANSFER_JOBS;
+    return out;
+}
+
+// Pull a boolean flag out of an argument list; returns the remaining count
+static int ExtractFlagOption(char argv[][MAX_PATH], int argc, const char* flag, int* present) {
+    int out = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], flag) == 0) {
+            *present = 1;
+        } else {
+            if (out != i) strcpy(argv[out], argv[i]);
+            out++;
+        }
+    }
+    return out;
+}
+
+// Pull "--tar", "-z"/"--gzip" and "--lz4" out of an argument list; returns the remaining count
+static int ExtractTarOptions(char argv[][MAX_PATH], int argc, int* use_tar, CompressionFormat* compression) {
+    int out = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--tar") == 0) {
+            *use_tar = 1;
+        } else if (strcmp(argv[i], "-z") == 0 || strcmp(argv[i], "--gzip") == 0) {
+            *compression = COMPRESSION_GZIP;
+        } else if (strcmp(argv[i], "--lz4") == 0) {
+            *compression = COMPRESSION_LZ4;
+        } else {
+            if (out != i) strcpy(argv[out], argv[i]);
+            out++;
+        }
+    }
+
+    // Compression only makes sense on the tar stream
+    if (*compression != COMPRESSION_NONE) *use_tar = 1;
+    return out;
 }
 
 // Command: push
 int CmdPush(AppState* state, const Command* cmd) {
-    char local_path[MAX_PATH] = {0};
-    char remote_path[MAX_PATH] = {0};
-
-    int count = sscanf(cmd->args, "%s %s", local_path, remote_path);
+    char argv[8][MAX_PATH];
+    int jobs = DEFAULT_TRANSFER_JOBS;
+    int use_tar = 0;
+    CompressionFormat compression = COMPRESSION_NONE;
+    int verify = 0;
+    int count = ExtractJobsOption(argv, SplitArguments(cmd->args, argv, 8), &jobs);
+    count = ExtractTarOptions(argv, count, &use_tar, &compression);
+    count = ExtractFlagOption(argv, count, "--verify", &verify);
 
     if (count < 1) {
-        PrintError(ADB_ERROR_INVALID_COMMAND, "Usage: push <local> [remote]");
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Usage: push [-j N | --tar | --verify] <local> [remote]");
         return 1;
     }
 
+    const char* local_path = argv[0];
+    const char* remote_path = argv[1];
     if (count == 1) {
         // Default to /storage/emulated/0/ if no remote path specified
-        strcpy(remote_path, "/storage/emulated/0/");
+        remote_path = "/storage/emulated/0/";
         printf("No remote path specified, defaulting to: %s\n", remote_path);
     }
 
-    return PushFile(state, local_path, remote_path);
+    if (DirectoryExists(local_path)) {
+        if (verify) {
+            printf("Note: --verify applies to single files; use 'sync --checksum' to compare a folder.\n");
+        }
+        if (use_tar) {
+            if (compression != COMPRESSION_NONE) {
+                printf("Note: compression applies to pulls; pushing an uncompressed tar stream.\n");
+            }
+            return PushDirectoryTar(state, local_path, remote_path);
+        }
+        return PushDirectory(state, local_path, remote_path, jobs);
+    }
+
+    return PushFile(state, local_path, remote_path, verify);
 }
 
 // Command: pull
 int CmdPull(AppState* state, const Command* cmd) {
-    char remote_path[MAX_PATH] = {0};
-    char local_path[MAX_PATH] = {0};
-
-    int count = sscanf(cmd->args, "%s %s", remote_path, local_path);
+    char argv[8][MAX_PATH];
+    int jobs = DEFAULT_TRANSFER_JOBS;
+    int use_tar = 0;
+    CompressionFormat compression = COMPRESSION_NONE;
+    int verify = 0;
+    int count = ExtractJobsOption(argv, SplitArguments(cmd->args, argv, 8), &jobs);
+    count = ExtractTarOptions(argv, count, &use_tar, &compression);
+    count = ExtractFlagOption(argv, count, "--verify", &verify);
 
     if (count < 1) {
-        PrintError(ADB_ERROR_INVALID_COMMAND, "Usage: pull <remote> [local]");
+        PrintError(ADB_ERROR_INVALID_COMMAND,
+                   "Usage: pull [-j N | --tar [-z|--lz4] | --verify] <remote> [local]");
+        return 1;
+    }
+
+    const char* remote_path = argv[0];
+    const char* local_path = count >= 2 ? argv[1] : NULL;
+
+    if (IsRemoteDirectory(state, remote_path)) {
+        if (verify) {
+            printf("Note: --verify applies to single files; pull is not verified.\n");
+        }
+        if (use_tar) {
+            return PullDirectoryTar(state, remote_path, local_path, compression);
+        }
+        return PullDirectory(state, remote_path, local_path, jobs);
+    }
+
+    return PullFile(state, remote_path, local_path, verify);
+}
+
+// Command: sync
+int CmdSync(AppState* state, const Command* cmd) {
+    char argv[8][MAX_PATH];
+    int jobs = DEFAULT_TRANSFER_JOBS;
+    int count = ExtractJobsOption(argv, SplitArguments(cmd->args, argv, 8), &jobs);
+
+    int flags = 0;
+    const char* paths[2] = { NULL, NULL };
+    int path_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (strcmp(argv[i], "--delete") == 0) {
+            flags |= DELTA_SYNC_DELETE;
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--checksum") == 0) {
+            flags |= DELTA_SYNC_CHECKSUM;
+        } else if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--dry-run") == 0) {
+            flags |= DELTA_SYNC_DRY_RUN;
+        } else if (path_count < 2) {
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    if (path_count < 2) {
+        PrintError(ADB_ERROR_INVALID_COMMAND,
+                   "Usage: sync [-j N] [--delete] [--checksum] [--dry-run] <local_dir> <remote_dir>");
+        return 1;
+    }
+
+    return DeltaSyncDirectory(state, paths[0], paths[1], jobs, flags);
+}
+
+// Command: bpush (one file to many devices)
+int CmdBroadcastPush(AppState* state, const Command* cmd) {
+    char argv[8][MAX_PATH];
+    int count = SplitArguments(cmd->args, argv, 8);
+
+    const char* paths[2] = { NULL, NULL };
+    int path_count = 0;
+    char* device_list = NULL;
+    for (int i = 0; i < count; i++) {
+        if ((strcmp(argv[i], "--devices") == 0 || strcmp(argv[i], "-s") == 0) && i + 1 < count) {
+            device_list = argv[++i];
+        } else if (path_count < 2) {
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    if (path_count < 1) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Usage: bpush [--devices s1,s2,...] <local_file> [remote]");
+        return 1;
+    }
+    if (DirectoryExists(paths[0])) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "bpush sends a single file, not a folder");
         return 1;
     }
 
-    return PullFile(state, remote_path, count >= 2 ? local_path : NULL);
+    const char* remote_path = paths[1];
+    if (path_count == 1) {
+        remote_path = "/storage/emulated/0/";
+        printf("No remote path specified, defaulting to: %s\n", remote_path);
+    }
+
+    if (!device_list) {
+        return BroadcastPushFile(state, paths[0], remote_path, NULL, 0);
+    }
+
+    // Comma separated serials, split in place; one slot per comma bounds the list
+    int max_serials = 1;
+    for (const char* c = device_list; *c; c++) {
+        if (*c == ',') max_serials++;
+    }
+    const char** serials = (const char**)SafeMalloc(max_serials * sizeof(const char*));
+    int serial_count = 0;
+    for (char* token = strtok(device_list, ","); token; token = strtok(NULL, ",")) {
+        if (*token) serials[serial_count++] = token;
+    }
+    int result = BroadcastPushFile(state, paths[0], remote_path, serials, serial_count);
+    free((void*)serials);
+    return result;
 }
 
 // Command: install
@@ -909,7 +1177,7 @@ int CmdInstall(AppState* state, const Command* cmd) {
         return 1;
     }
 
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 1;
@@ -920,8 +1188,15 @@ int CmdInstall(AppState* state, const Command* cmd) {
         return 1;
     }
 
-
-    ProcessResult* result = AdbInstallApk(state->adb_path, device->serial_id, cmd->args);
+    // Stream the APK natively for live progress; adb.exe handles devices without cmd
+    ProgressTracker tracker;
+    ProgressStart(&tracker, "install", device->serial_id, cmd->args, 0);
+    ProcessResult* result = AdbClientInstallApk(device->serial_id, cmd->args, ProgressTrackerCallback, &tracker);
+    if (result) {
+        ProgressFinish(&tracker, result->exit_code == 0);
+    } else {
+        result = AdbInstallApk(state->adb_path, device->serial_id, cmd->args);
+    }
     if (!result) {
         PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to install APK");
         return 1;
@@ -954,7 +1229,7 @@ int CmdUninstall(AppState* state, const Command* cmd) {
         return 1;
     }
 
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 1;
@@ -1014,7 +1289,7 @@ int CmdMkdir(AppState* state, const Command* cmd) {
 
 // Command: sudo
 int CmdSudo(AppState* state, const Command* cmd) {
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 1;
@@ -1035,27 +1310,19 @@ int CmdSudo(AppState* state, const Command* cmd) {
     args[idx++] = "-c";
     args[idx++] = cmd->args;
 
-    ProcessResult* result = RunAdbCommand(state->adb_path, args, idx);
+    ProcessResult* result = RunAdbCommandStreaming(state->adb_path, args, idx, WriteOutputToConsole, NULL);
     if (!result) {
         PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to execute sudo command");
         return 1;
     }
 
-    if (result->stdout_data && strlen(result->stdout_data) > 0) {
-        printf("%s\n", result->stdout_data);
-    }
-
-    if (result->stderr_data && strlen(result->stderr_data) > 0) {
-        fprintf(stderr, "%s\n", result->stderr_data);
-    }
-
     FreeProcessResult(result);
     return 1;
 }
 
 // Command: shizuku
 int CmdShizuku(AppState* state, const Command* cmd) {
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 1;
@@ -1065,7 +1332,7 @@ int CmdShizuku(AppState* state, const Command* cmd) {
 
     // 1. Get package path
     // adb shell pm path moe.shizuku.privileged.api
-    ProcessResult* res = AdbShellCommand(state->adb_path, device->serial_id, "pm path moe.shizuku.privileged.api");
+    ProcessResult* res = ShellSessionRun(state->adb_path, device->serial_id, "pm path moe.shizuku.privileged.api");
     if (!res || res->exit_code != 0 || !res->stdout_data || strlen(res->stdout_data) == 0) {
         PrintError(ADB_ERROR_UNKNOWN, "Shizuku app not found (package: moe.shizuku.privileged.api)");
         if (res) FreeProcessResult(res);
@@ -1100,18 +1367,23 @@ int CmdShizuku(AppState* state, const Command* cmd) {
         }
     }
 
-    // Construct library path
-    // Note: We try arm64 first as most modern devices are 64-bit.
-    // Ideally we should check device ABI but this is a good heuristic for now.
+    // Construct library path from the device's primary ABI (APK lib dirs use short names)
+    char abi[PROP_VALUE_MAX_LEN];
+    const char* lib_dir = "arm64";
+    if (PropCacheGet(state->adb_path, device->serial_id, "ro.product.cpu.abi", abi, sizeof(abi))) {
+        if (strcmp(abi, "armeabi-v7a") == 0 || strcmp(abi, "armeabi") == 0) lib_dir = "arm";
+        else if (strcmp(abi, "x86_64") == 0) lib_dir = "x86_64";
+        else if (strcmp(abi, "x86") == 0) lib_dir = "x86";
+    }
     char lib_path[512];
-    snprintf(lib_path, sizeof(lib_path), "%s/lib/arm64/libshizuku.so", path_start);
+    snprintf(lib_path, sizeof(lib_path), "%s/lib/%s/libshizuku.so", path_start, lib_dir);
 
     printf("Found Shizuku path: %s\n", path_start);
     FreeProcessResult(res);
 
     // 2. Execute library
     printf("Executing: %s\n", lib_path);
-    res = AdbShellCommand(state->adb_path, device->serial_id, lib_path);
+    res = ShellSessionRun(state->adb_path, device->serial_id, lib_path);
     if (!res) {
         PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to execute activation command");
         return 1;
@@ -1356,13 +1628,13 @@ int CmdTheme(AppState* state, const Command* cmd) {
 // Command: reboot
 int CmdReboot(AppState* state, const Command* cmd) {
     // Check current mode and route to appropriate reboot function
-    if (state->current_mode == MODE_FASTBOOT) {
+    if (GetCurrentMode(state) == MODE_FASTBOOT) {
         // In fastboot mode, use fastboot reboot
         TrimString((char*)cmd->args);
         return RebootFastbootDevice(state, strlen(cmd->args) > 0 ? cmd->args : NULL);
     } else {
         // In ADB mode, use ADB reboot
-        AdbDevice* device = GetSelectedDevice(state);
+        const AdbDevice* device = GetSelectedDevice(state);
         if (!device) {
             PrintError(ADB_ERROR_NO_DEVICE, NULL);
             return 1;
@@ -1413,6 +1685,11 @@ int CmdVersion(AppState* state, const Command* cmd) {
     }
 
     if (result) FreeProcessResult(result);
+
+    int server_version = AdbClientGetServerVersion();
+    if (server_version > 0) {
+        printf("ADB server protocol version: %d (native client active)\n", server_version);
+    }
     return 1;
 }
 
@@ -1448,6 +1725,341 @@ int CmdCmd(AppState* state, const Command* cmd) {
     return 1;
 }
 
+// Operation types of a partition, as "REPLACE_XZ x120, ZERO x3"
+static void DescribePayloadOperations(const PayloadPartition* partition, char* buffer, size_t size) {
+    int counts[16] = {0};
+    int other = 0;
+    for (int i = 0; i < partition->operation_count; i++) {
+        int type = partition->operations[i].type;
+        if (type >= 0 && type < (int)ARRAY_SIZE(counts)) counts[type]++;
+        else other++;
+    }
+
+    buffer[0] = '\0';
+    size_t used = 0;
+    for (int type = 0; type < (int)ARRAY_SIZE(counts); type++) {
+        if (counts[type] == 0 || used >= size) continue;
+        used += snprintf(buffer + used, size - used, "%s%s x%d", used ? ", " : "", PayloadOperationName(type), counts[type]);
+    }
+    if (other > 0 && used < size) snprintf(buffer + used, size - used, "%sother x%d", used ? ", " : "", other);
+}
+
+// payload list: partitions, sizes and operation types
+static int ListPayload(Payload* payload) {
+    printf("\n%s: payload v%llu, %d partitions, %u-byte blocks\n\n", payload->path, payload->version,
+           payload->count, payload->block_size);
+    printf("%-20s %10s %10s  %s\n", "Partition", "Size", "Data", "Operations");
+
+    for (int i = 0; i < payload->count; i++) {
+        const PayloadPartition* partition = &payload->partitions[i];
+        char size[32], data[32], operations[256];
+        FormatByteCount(PayloadPartitionSize(payload, partition), size, sizeof(size));
+        FormatByteCount(partition->data_size, data, sizeof(data));
+        DescribePayloadOperations(partition, operations, sizeof(operations));
+        printf("%-20s %10s %10s  %s%s\n", partition->name, size, data, operations,
+               partition->is_delta ? " (delta)" : "");
+    }
+    printf("\n");
+    return 1;
+}
+
+// payload extract: the named partitions (all full ones by default) into out_dir
+static int ExtractPayload(Payload* payload, char names[][MAX_PATH], int name_count, const char* out_dir) {
+    const PayloadPartition** selected =
+        (const PayloadPartition**)SafeMalloc((payload->count + 1) * sizeof(PayloadPartition*));
+    int count = 0;
+    unsigned long long total = 0;
+    int ok = 1;
+
+    if (name_count == 0) {
+        for (int i = 0; i < payload->count; i++) {
+            if (payload->partitions[i].is_delta) {
+                printf("Skipping %s (delta update)\n", payload->partitions[i].name);
+            } else {
+                selected[count++] = &payload->partitions[i];
+            }
+        }
+    }
+    for (int i = 0; i < name_count && ok; i++) {
+        const PayloadPartition* partition = PayloadFindPartition(payload, names[i]);
+        if (!partition) {
+            char message[MAX_PATH + 64];
+            snprintf(message, sizeof(message), "No partition '%s' in the payload", names[i]);
+            PrintError(ADB_ERROR_INVALID_PARTITION, message);
+            ok = 0;
+        } else {
+            int repeated = 0;
+            for (int j = 0; j < count; j++) repeated |= selected[j] == partition;
+            if (!repeated && count < payload->count) selected[count++] = partition;
+        }
+    }
+    for (int i = 0; i < count; i++) total += PayloadPartitionSize(payload, selected[i]);
+
+    if (ok && count == 0) {
+        PrintError(ADB_ERROR_INVALID_PARTITION, "Nothing to extract");
+        ok = 0;
+    }
+    if (ok && !CreateDirectoryA(out_dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        char message[MAX_PATH + 64];
+        snprintf(message, sizeof(message), "Cannot create %s", out_dir);
+        PrintError(ADB_ERROR_PERMISSION_DENIED, message);
+        ok = 0;
+    }
+
+    if (ok) {
+        char label[64];
+        if (count == 1) {
+            snprintf(label, sizeof(label), "%s", selected[0]->name);
+        } else {
+            snprintf(label, sizeof(label), "%d partitions", count);
+        }
+        ProgressTracker tracker;
+        ProgressStart(&tracker, "extract", "local", label, total);
+        ULONGLONG start = GetTickCount64();
+        ok = PayloadExtractPartitions(payload, selected, count, out_dir, ProgressTrackerCallback, &tracker);
+        ProgressClearLine(&tracker);
+
+        if (ok) {
+            char size[32];
+            FormatByteCount(total, size, sizeof(size));
+            printf("Extracted %d partition%s (%s) to %s in %.1fs\n", count, count == 1 ? "" : "s", size, out_dir,
+                   (GetTickCount64() - start) / 1000.0);
+        } else {
+            PrintError(ADB_ERROR_UNKNOWN, payload->error);
+        }
+    }
+    free(selected);
+    return ok;
+}
+
+// Arguments of `payload` and `super`: list|extract <file> [partitions...] [-o <dir>]
+typedef struct {
+    char argv[34][MAX_PATH];
+    int list;
+    const char* source;
+    const char* out_dir;
+    char names[32][MAX_PATH];
+    int name_count;
+} ImageToolArgs;
+
+// Split the arguments; 0 if they do not form a list or extract command
+static int ParseImageToolArgs(const Command* cmd, ImageToolArgs* args) {
+    int argc = SplitArguments(cmd->args, args->argv, 34);
+
+    // -o <dir> may appear anywhere after the action
+    args->out_dir = ".";
+    args->source = NULL;
+    args->name_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(args->argv[i], "-o") == 0 && i + 1 < argc) {
+            args->out_dir = args->argv[++i];
+        } else if (!args->source) {
+            args->source = args->argv[i];
+        } else if (args->name_count < 32) {
+            snprintf(args->names[args->name_count++], MAX_PATH, "%s", args->argv[i]);
+        }
+    }
+
+    args->list = argc > 0 && strcmp(args->argv[0], "list") == 0;
+    int extract = argc > 0 && strcmp(args->argv[0], "extract") == 0;
+    return (args->list || extract) && args->source && !(args->list && args->name_count > 0);
+}
+
+// Command: payload list|extract <payload.bin|ota.zip> [partitions...] [-o <dir>]
+int CmdPayload(AppState* state, const Command* cmd) {
+    ImageToolArgs args;
+    if (!ParseImageToolArgs(cmd, &args)) {
+        PrintError(ADB_ERROR_INVALID_COMMAND,
+                   "Usage: payload list <payload.bin|ota.zip> | payload extract <payload.bin|ota.zip> [partitions...] [-o <dir>]");
+        return 1;
+    }
+
+    Payload payload;
+    if (!PayloadOpen(&payload, args.source)) {
+        PrintError(ADB_ERROR_FILE_NOT_FOUND, payload.error);
+        return 1;
+    }
+    if (args.list) {
+        ListPayload(&payload);
+    } else {
+        ExtractPayload(&payload, args.names, args.name_count, args.out_dir);
+    }
+    PayloadClose(&payload);
+    return 1;
+}
+
+// Partition attributes, as "readonly, updated"
+static void DescribeSuperAttributes(unsigned int attributes, char* buffer, size_t size) {
+    static const char* names[] = { "readonly", "slot-suffixed", "updated", "disabled" };
+    buffer[0] = '\0';
+    size_t used = 0;
+    for (int bit = 0; bit < (int)ARRAY_SIZE(names); bit++) {
+        if (!(attributes & (1u << bit)) || used >= size) continue;
+        used += snprintf(buffer + used, size - used, "%s%s", used ? ", " : "", names[bit]);
+    }
+}
+
+// super list: logical partitions, their groups, sizes and extents
+static int ListSuper(SuperImage* super, const char* path) {
+    char device[32];
+    FormatByteCount(super->device_size, device, sizeof(device));
+    printf("\n%s: liblp %u.%u, %d partitions, %s device%s\n\n", path, super->major, super->minor, super->count,
+           device, super->image.is_sparse ? ", sparse" : "");
+    printf("%-24s %-20s %10s %7s  %s\n", "Partition", "Group", "Size", "Extents", "Attributes");
+
+    for (int i = 0; i < super->count; i++) {
+        const SuperPartition* partition = &super->partitions[i];
+        char size[32], attributes[96];
+        FormatByteCount(partition->size, size, sizeof(size));
+        DescribeSuperAttributes(partition->attributes, attributes, sizeof(attributes));
+        printf("%-24s %-20s %10s %7d  %s%s\n", partition->name, partition->group, size, partition->extent_count,
+               attributes, partition->foreign ? " (other block device)" : "");
+    }
+    printf("\n");
+    return 1;
+}
+
+// super extract: the named partitions (all non-empty ones by default) into out_dir
+static int ExtractSuper(SuperImage* super, char names[][MAX_PATH], int name_count, const char* out_dir) {
+    const SuperPartition** selected =
+        (const SuperPartition**)SafeMalloc((super->count + 1) * sizeof(SuperPartition*));
+    int count = 0;
+    unsigned long long total = 0;
+    int ok = 1;
+
+    if (name_count == 0) {
+        for (int i = 0; i < super->count; i++) {
+            if (super->partitions[i].foreign) {
+                printf("Skipping %s (on another block device)\n", super->partitions[i].name);
+            } else if (super->partitions[i].size > 0) {
+                selected[count++] = &super->partitions[i];
+            }
+        }
+    }
+    for (int i = 0; i < name_count && ok; i++) {
+        const SuperPartition* partition = SuperImageFindPartition(super, names[i]);
+        if (!partition) {
+            char message[MAX_PATH + 64];
+            snprintf(message, sizeof(message), "No partition '%s' in the super image", names[i]);
+            PrintError(ADB_ERROR_INVALID_PARTITION, message);
+            ok = 0;
+        } else {
+            int repeated = 0;
+            for (int j = 0; j < count; j++) repeated |= selected[j] == partition;
+            if (!repeated && count < super->count) selected[count++] = partition;
+        }
+    }
+    for (int i = 0; i < count; i++) total += selected[i]->size;
+
+    if (ok && count == 0) {
+        PrintError(ADB_ERROR_INVALID_PARTITION, "Nothing to extract");
+        ok = 0;
+    }
+    if (ok && !CreateDirectoryA(out_dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        char message[MAX_PATH + 64];
+        snprintf(message, sizeof(message), "Cannot create %s", out_dir);
+        PrintError(ADB_ERROR_PERMISSION_DENIED, message);
+        ok = 0;
+    }
+
+    if (ok) {
+        char label[64];
+        if (count == 1) {
+            snprintf(label, sizeof(label), "%s", selected[0]->name);
+        } else {
+            snprintf(label, sizeof(label), "%d partitions", count);
+        }
+        ProgressTracker tracker;
+        ProgressStart(&tracker, "extract", "local", label, total);
+        ULONGLONG start = GetTickCount64();
+        ok = SuperImageExtractPartitions(super, selected, count, out_dir, ProgressTrackerCallback, &tracker);
+        ProgressClearLine(&tracker);
+
+        if (ok) {
+            char size[32];
+            FormatByteCount(total, size, sizeof(size));
+            printf("Extracted %d partition%s (%s) to %s in %.1fs\n", count, count == 1 ? "" : "s", size, out_dir,
+                   (GetTickCount64() - start) / 1000.0);
+        } else {
+            PrintError(ADB_ERROR_UNKNOWN, super->error);
+        }
+    }
+    free(selected);
+    return ok;
+}
+
+// Command: super list|extract <super.img> [partitions...] [-o <dir>]
+int CmdSuper(AppState* state, const Command* cmd) {
+    ImageToolArgs args;
+    if (!ParseImageToolArgs(cmd, &args)) {
+        PrintError(ADB_ERROR_INVALID_COMMAND,
+                   "Usage: super list <super.img> | super extract <super.img> [partitions...] [-o <dir>]");
+        return 1;
+    }
+
+    SuperImage super;
+    if (!SuperImageOpen(&super, args.source)) {
+        PrintError(ADB_ERROR_FILE_NOT_FOUND, super.error);
+        return 1;
+    }
+    if (args.list) {
+        ListSuper(&super, args.source);
+    } else {
+        ExtractSuper(&super, args.names, args.name_count, args.out_dir);
+    }
+    SuperImageClose(&super);
+    return 1;
+}
+
+// Command: ledger [serial] | ledger clear [serial]
+int CmdLedger(AppState* state, const Command* cmd) {
+    char argv[2][MAX_PATH];
+    int argc = SplitArguments(cmd->args, argv, 2);
+
+    if (argc >= 1 && strcmp(argv[0], "clear") == 0) {
+        const char* serial = argc == 2 ? argv[1] : NULL;
+        int removed = FlashLedgerClear(serial);
+        if (removed < 0) {
+            PrintError(ADB_ERROR_UNKNOWN, "Could not rewrite " FLASH_LEDGER_FILE);
+            return 1;
+        }
+        printf("Removed %d ledger row(s)%s%s.\n", removed, serial ? " of " : "", serial ? serial : "");
+        return 1;
+    }
+    if (argc > 1) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Usage: ledger [serial] | ledger clear [serial]");
+        return 1;
+    }
+
+    FlashLedgerEntry* entries = NULL;
+    int count = 0;
+    if (!FlashLedgerLoad(argc == 1 ? argv[0] : NULL, &entries, &count) || count == 0) {
+        printf("No flashes recorded in %s.\n", FLASH_LEDGER_FILE);
+        free(entries);
+        return 1;
+    }
+
+    printf("\n%-20s %-20s %-18s %-12s %10s  %s\n", "Flashed", "Device", "Partition", "Fingerprint", "Size",
+           "Image");
+    for (int i = 0; i < count; i++) {
+        const FlashLedgerEntry* entry = &entries[i];
+        char size[32];
+        char fingerprint[16];
+        if (entry->fingerprint[0]) {
+            FormatByteCount(entry->size, size, sizeof(size));
+            snprintf(fingerprint, sizeof(fingerprint), "%.12s", entry->fingerprint);
+        } else {
+            strcpy(size, "-");
+            strcpy(fingerprint, "(erased)");
+        }
+        printf("%-20s %-20s %-18s %-12s %10s  %s\n", entry->timestamp, entry->device, entry->partition, fingerprint,
+               size, entry->fingerprint[0] ? entry->image : "");
+    }
+    printf("\n%d partition(s)\n", count);
+    free(entries);
+    return 1;
+}
+
 // Count APK files in input
 int CountApks(const char* input) {
     if (!input || !*input) return 0;
@@ -1534,7 +2146,7 @@ int HandleDragDropInput(AppState* state, char* input) {
     if (!has_apk) return 0;
 
     // Check mode
-    if (state->current_mode == MODE_FASTBOOT) {
+    if (GetCurrentMode(state) == MODE_FASTBOOT) {
         printf("\nError: Cannot install APK in fastboot mode.\n");
         printf("Please switch to ADB mode first.\n");
         return 1; // Handled (as error)
@@ -1649,15 +2261,15 @@ void ClearMultilinePrompt(const char* prompt) {
 }
 
 static const char* ADB_COMMANDS[] = {
-    "devices", "dev", "select", "info", "push", "pull", "ls", "rm", "mkdir",
+    "devices", "dev", "select", "info", "push", "pull", "sync", "bpush", "ls", "rm", "mkdir",
     "shell", "sudo", "install", "uninstall", "reboot", "dli", "shizuku", "theme",
-    "help", "version", "cls", "cmd", "exit", "quit", NULL
+    "payload", "super", "ledger", "help", "version", "cls", "cmd", "exit", "quit", NULL
 };
 
 static const char* FASTBOOT_COMMANDS[] = {
-    "devices", "select", "info", "flash", "erase", "format", "unlock",
-    "lock", "oem", "reboot", "getvar", "activate", "wipe",
-    "help", "version", "cls", "cmd", "exit", "quit", NULL
+    "devices", "select", "info", "flash", "flashall", "erase", "format", "unlock",
+    "lock", "oem", "reboot", "getvar", "activate", "wipe", "connect", "disconnect",
+    "payload", "super", "ledger", "help", "version", "cls", "cmd", "exit", "quit", NULL
 };
 
 static const char* REBOOT_MODES[] = {
@@ -1669,6 +2281,23 @@ static const char* FLASH_PARTITIONS[] = {
     "init_boot", "vendor_boot", "dtbo", "super", "radio", "modem", NULL
 };
 
+// Partition names to complete: the selected fastboot device's own, else the common ones
+static int GetPartitionCandidates(AppState* state, const char** out, int max_count) {
+    static char device_partitions[FASTBOOT_MAX_PARTITIONS][64];
+    int count = 0;
+
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
+    if (device && FastbootVarCacheLoad(state->fastboot_path, device->serial_id)) {
+        int listed = FastbootVarCacheListPartitions(device->serial_id, device_partitions, FASTBOOT_MAX_PARTITIONS);
+        for (int i = 0; i < listed && count < max_count; i++) out[count++] = device_partitions[i];
+    }
+
+    if (count == 0) {
+        for (int i = 0; FLASH_PARTITIONS[i] != NULL && count < max_count; i++) out[count++] = FLASH_PARTITIONS[i];
+    }
+    return count;
+}
+
 static void HandleTabCompletion(AppState* state, char* input, int* input_pos) {
     // 1. Find the word being typed (last word segment)
     // We assume the cursor is at the end of input
@@ -1712,7 +2341,7 @@ static void HandleTabCompletion(AppState* state, char* input, int* input_pos) {
     
     if (strlen(prev_word) == 0) {
         // Root command: Use current mode commands + extras
-        const char** mode_cmds = (state->current_mode == MODE_FASTBOOT) ? FASTBOOT_COMMANDS : ADB_COMMANDS;
+        const char** mode_cmds = (GetCurrentMode(state) == MODE_FASTBOOT) ? FASTBOOT_COMMANDS : ADB_COMMANDS;
         static const char* ROOT_EXTRAS[] = { "adb", "fastboot", NULL };
         
         // Add mode commands
@@ -1753,9 +2382,11 @@ static void HandleTabCompletion(AppState* state, char* input, int* input_pos) {
         }
     } else if (strcmp(prev_word, "flash") == 0 || strcmp(prev_word, "erase") == 0 || strcmp(prev_word, "format") == 0 || strcmp(prev_word, "wipe") == 0) {
         // Partitions
-        for (int i = 0; FLASH_PARTITIONS[i] != NULL; i++) {
-            if (strncmp(word_to_complete, FLASH_PARTITIONS[i], word_len) == 0) {
-                if (match_count < 64) matches[match_count++] = FLASH_PARTITIONS[i];
+        const char* partitions[FASTBOOT_MAX_PARTITIONS];
+        int partition_count = GetPartitionCandidates(state, partitions, FASTBOOT_MAX_PARTITIONS);
+        for (int i = 0; i < partition_count; i++) {
+            if (strncmp(word_to_complete, partitions[i], word_len) == 0) {
+                if (match_count < 64) matches[match_count++] = partitions[i];
             }
         }
     }
@@ -1770,7 +2401,7 @@ static void HandleTabCompletion(AppState* state, char* input, int* input_pos) {
         int candidate_count = 0;
 
         if (strlen(prev_word) == 0) {
-            const char** mode_cmds = (state->current_mode == MODE_FASTBOOT) ? FASTBOOT_COMMANDS : ADB_COMMANDS;
+            const char** mode_cmds = (GetCurrentMode(state) == MODE_FASTBOOT) ? FASTBOOT_COMMANDS : ADB_COMMANDS;
             static const char* ROOT_EXTRAS[] = { "adb", "fastboot", NULL };
             for (int i = 0; mode_cmds[i] != NULL; i++) candidates[candidate_count++] = mode_cmds[i];
             for (int i = 0; ROOT_EXTRAS[i] != NULL; i++) candidates[candidate_count++] = ROOT_EXTRAS[i];
@@ -1781,7 +2412,7 @@ static void HandleTabCompletion(AppState* state, char* input, int* input_pos) {
         } else if (strcmp(prev_word, "reboot") == 0) {
             for (int i = 0; REBOOT_MODES[i] != NULL; i++) candidates[candidate_count++] = REBOOT_MODES[i];
         } else if (strcmp(prev_word, "flash") == 0 || strcmp(prev_word, "erase") == 0 || strcmp(prev_word, "format") == 0 || strcmp(prev_word, "wipe") == 0) {
-             for (int i = 0; FLASH_PARTITIONS[i] != NULL; i++) candidates[candidate_count++] = FLASH_PARTITIONS[i];
+             candidate_count = GetPartitionCandidates(state, candidates, 128);
         }
 
         for (int i = 0; i < candidate_count; i++) {
@@ -2031,10 +2662,13 @@ input_check:;
                                 Command cmd = ParseCommand(input);
                                 int result = ExecuteCommand(state, &cmd);
                                 if (result == -1) {
+                                    ReleaseDeviceHolds(state);
                                     printf("Goodbye!\n");
                                     return;
                                 }
                             }
+                            // Devices the command looked up were kept alive for it
+                            ReleaseDeviceHolds(state);
                             
                             input_pos = 0;
                             input[0] = '\0';
@@ -2171,20 +2805,20 @@ int CmdFbSelect(AppState* state, const Command* cmd) {
     if (isdigit(cmd->args[0])) {
         int index = atoi(cmd->args);
         if (SelectFastbootDevice(state, index)) {
-            AdbDevice* dev = GetSelectedFastbootDevice(state);
+            const AdbDevice* dev = GetSelectedFastbootDevice(state);
             printf("Selected fastboot device: %s\n", dev->serial_id);
             // Switch to fastboot mode
-            state->current_mode = MODE_FASTBOOT;
+            SetCurrentMode(state, MODE_FASTBOOT);
         } else {
             printf("Invalid fastboot device index.\n");
         }
     } else {
         // Try as serial number
         if (SelectFastbootDeviceBySerial(state, cmd->args)) {
-            AdbDevice* dev = GetSelectedFastbootDevice(state);
+            const AdbDevice* dev = GetSelectedFastbootDevice(state);
             printf("Selected fastboot device: %s\n", dev->serial_id);
             // Switch to fastboot mode
-            state->current_mode = MODE_FASTBOOT;
+            SetCurrentMode(state, MODE_FASTBOOT);
         } else {
             printf("Fastboot device not found: %s\n", cmd->args);
         }
@@ -2201,17 +2835,80 @@ int CmdFbInfo(AppState* state, const Command* cmd) {
 
 // Command: fb_flash
 int CmdFbFlash(AppState* state, const Command* cmd) {
-    char partition[64] = {0};
-    char image_path[MAX_PATH] = {0};
+    char argv[6][MAX_PATH];
+    int argc = SplitArguments(cmd->args, argv, 6);
+
+    // --verify[=<sha256>], --skip-unchanged and --no-check may appear anywhere
+    int verify = 0;
+    int skip_unchanged = 0;
+    int check_image = 1;
+    const char* expected = NULL;
+    const char* positional[2] = { NULL, NULL };
+    int count = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--verify") == 0) {
+            verify = 1;
+        } else if (StringStartsWith(argv[i], "--verify=")) {
+            verify = 1;
+            expected = argv[i] + strlen("--verify=");
+        } else if (strcmp(argv[i], "--skip-unchanged") == 0) {
+            skip_unchanged = 1;
+        } else if (strcmp(argv[i], "--no-check") == 0) {
+            check_image = 0;
+        } else if (count < 2) {
+            positional[count++] = argv[i];
+        }
+    }
 
-    if (sscanf(cmd->args, "%s %s", partition, image_path) != 2) {
-        PrintError(ADB_ERROR_INVALID_COMMAND, "Usage: flash <partition> <image_file>");
+    if (count != 2) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Usage: flash [--verify[=<sha256>]] [--skip-unchanged] [--no-check] <partition> <image_file>");
         return 1;
     }
 
     // Switch to fastboot mode
-    state->current_mode = MODE_FASTBOOT;
-    return FlashImage(state, partition, image_path);
+    SetCurrentMode(state, MODE_FASTBOOT);
+    return FlashImage(state, positional[0], positional[1], verify, expected, skip_unchanged, check_image);
+}
+
+// Command: fb_flashall
+int CmdFbFlashAll(AppState* state, const Command* cmd) {
+    char argv[6][MAX_PATH];
+    int argc = SplitArguments(cmd->args, argv, 6);
+
+    // --set-active=<slot>, --reboot[=<mode>], --skip-unchanged and --no-check may appear anywhere
+    const char* slot = NULL;
+    const char* reboot_mode = NULL;
+    int reboot = 0;
+    int skip_unchanged = 0;
+    int check_images = 1;
+    const char* source = NULL;
+    int count = 0;
+    for (int i = 0; i < argc; i++) {
+        if (StringStartsWith(argv[i], "--set-active=")) {
+            slot = argv[i] + strlen("--set-active=");
+        } else if (strcmp(argv[i], "--reboot") == 0) {
+            reboot = 1;
+        } else if (StringStartsWith(argv[i], "--reboot=")) {
+            reboot = 1;
+            reboot_mode = argv[i] + strlen("--reboot=");
+        } else if (strcmp(argv[i], "--skip-unchanged") == 0) {
+            skip_unchanged = 1;
+        } else if (strcmp(argv[i], "--no-check") == 0) {
+            check_images = 0;
+        } else {
+            source = argv[i];
+            count++;
+        }
+    }
+
+    if (count != 1) {
+        PrintError(ADB_ERROR_INVALID_COMMAND,
+                   "Usage: flashall <manifest|dir|factory.zip> [--set-active=<slot>] [--reboot[=<mode>]] [--skip-unchanged] [--no-check]");
+        return 1;
+    }
+
+    SetCurrentMode(state, MODE_FASTBOOT);
+    return FlashAll(state, source, slot, reboot, reboot_mode, skip_unchanged, check_images);
 }
 
 // Command: fb_erase
@@ -2221,7 +2918,7 @@ int CmdFbErase(AppState* state, const Command* cmd) {
         return 1;
     }
 
-    state->current_mode = MODE_FASTBOOT;
+    SetCurrentMode(state, MODE_FASTBOOT);
     return ErasePartition(state, cmd->args);
 }
 
@@ -2235,19 +2932,19 @@ int CmdFbFormat(AppState* state, const Command* cmd) {
         return 1;
     }
 
-    state->current_mode = MODE_FASTBOOT;
+    SetCurrentMode(state, MODE_FASTBOOT);
     return FormatPartition(state, partition, fs_type);
 }
 
 // Command: fb_unlock
 int CmdFbUnlock(AppState* state, const Command* cmd) {
-    state->current_mode = MODE_FASTBOOT;
+    SetCurrentMode(state, MODE_FASTBOOT);
     return UnlockBootloader(state);
 }
 
 // Command: fb_lock
 int CmdFbLock(AppState* state, const Command* cmd) {
-    state->current_mode = MODE_FASTBOOT;
+    SetCurrentMode(state, MODE_FASTBOOT);
     return LockBootloader(state);
 }
 
@@ -2258,21 +2955,21 @@ int CmdFbOem(AppState* state, const Command* cmd) {
         return 1;
     }
 
-    state->current_mode = MODE_FASTBOOT;
+    SetCurrentMode(state, MODE_FASTBOOT);
     return ExecuteOemCommand(state, cmd->args);
 }
 
 // Command: fb_reboot
 int CmdFbReboot(AppState* state, const Command* cmd) {
     TrimString((char*)cmd->args);
-    state->current_mode = MODE_FASTBOOT;
+    SetCurrentMode(state, MODE_FASTBOOT);
     return RebootFastbootDevice(state, strlen(cmd->args) > 0 ? cmd->args : NULL);
 }
 
 // Command: fb_getvar
 int CmdFbGetvar(AppState* state, const Command* cmd) {
     TrimString((char*)cmd->args);
-    state->current_mode = MODE_FASTBOOT;
+    SetCurrentMode(state, MODE_FASTBOOT);
     return GetFastbootVar(state, strlen(cmd->args) > 0 ? cmd->args : NULL);
 }
 
@@ -2283,7 +2980,7 @@ int CmdFbActivate(AppState* state, const Command* cmd) {
         return 1;
     }
 
-    state->current_mode = MODE_FASTBOOT;
+    SetCurrentMode(state, MODE_FASTBOOT);
     return ActivateFastbootSlot(state, cmd->args);
 }
 
@@ -2294,10 +2991,84 @@ int CmdFbWipe(AppState* state, const Command* cmd) {
         return 1;
     }
 
-    state->current_mode = MODE_FASTBOOT;
+    SetCurrentMode(state, MODE_FASTBOOT);
     return WipeFastbootPartition(state, cmd->args);
 }
 
+// Normalize "host", "host:port" or "tcp:..." to tcp:<host>:<port> so a device is never listed twice
+static void NormalizeNetworkSerial(const char* target, char* serial, size_t size) {
+    const char* host = StringStartsWith(target, "tcp:") ? target + 4 : target;
+    const char* bracket = strchr(host, ']');
+    int has_port = host[0] == '[' ? (bracket && bracket[1] == ':') : strchr(host, ':') != NULL;
+    if (has_port) {
+        snprintf(serial, size, "tcp:%s", host);
+    } else {
+        snprintf(serial, size, "tcp:%s:%d", host, FASTBOOT_TCP_DEFAULT_PORT);
+    }
+}
+
+// Command: fb_connect
+int CmdFbConnect(AppState* state, const Command* cmd) {
+    char target[256];
+    strncpy(target, cmd->args, sizeof(target) - 1);
+    target[sizeof(target) - 1] = '\0';
+    TrimString(target);
+    if (strlen(target) == 0) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Usage: connect <host[:port]>");
+        return 1;
+    }
+
+    char serial[256];
+    NormalizeNetworkSerial(target, serial, sizeof(serial));
+
+    FastbootSession session;
+    char product[FASTBOOT_RESPONSE_MAX + 1] = "";
+    if (!FastbootClientOpen(&session, serial)) {
+        PrintError(ADB_ERROR_FASTBOOT_FAILED, session.error);
+        return 1;
+    }
+    FastbootClientGetVar(&session, "product", product, sizeof(product));
+    FastbootClientClose(&session);
+
+    if (!FastbootClientAddNetworkDevice(serial)) {
+        PrintError(ADB_ERROR_FASTBOOT_FAILED, "Too many network devices; disconnect one first");
+        return 1;
+    }
+    RefreshFastbootDeviceList(state);
+    if (SelectFastbootDeviceBySerial(state, serial)) {
+        SetCurrentMode(state, MODE_FASTBOOT);
+    }
+    if (product[0]) {
+        printf("Connected to %s (%s)\n", serial, product);
+    } else {
+        printf("Connected to %s\n", serial);
+    }
+    return 1;
+}
+
+// Command: fb_disconnect
+int CmdFbDisconnect(AppState* state, const Command* cmd) {
+    char target[256] = "";
+    strncpy(target, cmd->args, sizeof(target) - 1);
+    TrimString(target);
+
+    char serial[256] = "";
+    if (strlen(target) > 0) {
+        NormalizeNetworkSerial(target, serial, sizeof(serial));
+    } else {
+        const AdbDevice* dev = GetSelectedFastbootDevice(state);
+        if (dev) strncpy(serial, dev->serial_id, sizeof(serial) - 1);
+    }
+
+    if (!FastbootClientRemoveNetworkDevice(serial)) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Usage: disconnect [tcp:<host>:<port>] (network devices only)");
+        return 1;
+    }
+    RefreshFastbootDeviceList(state);
+    printf("Disconnected %s\n", serial);
+    return 1;
+}
+
 // Helper to extract filename from URL
 static void GetFilenameFromUrl(const char* url, char* buffer, size_t size) {
     const char* last_slash = strrchr(url, '/');
@@ -2352,7 +3123,7 @@ int CmdDli(AppState* state, const Command* cmd) {
     }
 
     // 2. Push to device
-    AdbDevice* dev = GetSelectedDevice(state);
+    const AdbDevice* dev = GetSelectedDevice(state);
     if (!dev) {
         printf("Error: No device selected. Cannot install module.\n");
         return 1;
@@ -2362,7 +3133,7 @@ int CmdDli(AppState* state, const Command* cmd) {
     snprintf(remote_path, sizeof(remote_path), "/storage/emulated/0/%s", filename);
 
     printf("Pushing to device: %s -> %s\n", local_path, remote_path);
-    if (!PushFile(state, local_path, remote_path)) {
+    if (!PushFile(state, local_path, remote_path, 0)) {
         printf("Error: Failed to push file to device.\n");
         return 1;
     }
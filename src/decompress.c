@@ -0,0 +1,1787 @@
+#include "decompress.h"
+#include "utils.h"
+#include "sha256.h"
+#include <stdarg.h>
+
+// Compressed bytes pulled from the read callback at a time
+#define INPUT_BUFFER_SIZE (256 * 1024)
+// History kept behind the output position: deflate reaches back 32 KB, LZ4 64 KB
+#define OUTPUT_HISTORY (64 * 1024)
+// Decoded bytes collected before they are handed to the write callback
+#define OUTPUT_FLUSH (1024 * 1024)
+// Largest single copy into the output window
+#define OUTPUT_STEP (64 * 1024)
+
+// Huffman codes up to this length resolve with one table lookup
+#define FAST_BITS 9
+#define MAX_CODE_BITS 15
+
+#define LZ4_FRAME_MAGIC      0x184D2204u
+#define LZ4_LEGACY_MAGIC     0x184C2102u
+#define LZ4_SKIPPABLE_MAGIC  0x184D2A50u
+#define LZ4_SKIPPABLE_MASK   0xFFFFFFF0u
+// Legacy blocks hold 8 MB of output; this is LZ4_compressBound of that
+#define LZ4_LEGACY_BOUND     (8 * 1024 * 1024 + 8 * 1024 * 1024 / 255 + 16)
+
+#define XZ_FILTER_LZMA2      0x21
+// Largest dictionary allocated for one xz block (xz -9 uses 64 MB)
+#define XZ_DICT_MAX          (768ULL * 1024 * 1024)
+// LZMA2 chunks hold at most 64 KB of compressed data
+#define LZMA2_CHUNK_MAX      (64 * 1024)
+#define LZMA_STATES          12
+#define LZMA_LIT_STATES      7
+#define LZMA_POS_STATES_MAX  16
+#define LZMA_DIST_STATES     4
+#define LZMA_DIST_MODEL_END  14
+#define LZMA_FULL_DISTANCES  128
+#define LZMA_ALIGN_BITS      4
+#define BZ_MAX_TABLES        6
+#define BZ_MAX_SYMBOLS       258
+#define BZ_MAX_CODE_BITS     20
+#define BZ_MAX_SELECTORS     18002
+// Symbols coded with one table before the next selector applies
+#define BZ_GROUP_SIZE        50
+
+// Canonical Huffman code (puff layout) plus a direct lookup table for short codes
+typedef struct {
+    unsigned short count[MAX_CODE_BITS + 1];    // Codes of each length
+    unsigned short symbol[288];                 // Symbols ordered by code
+    unsigned short fast[1 << FAST_BITS];        // symbol | length << 12, 0 = longer code
+} Huffman;
+
+// One decoding run
+typedef struct {
+    DecompressReadFn read;
+    void* read_data;
+    unsigned char* in;
+    size_t in_pos;
+    size_t in_len;
+    int in_eof;
+
+    unsigned long long bits;                    // Deflate bit reader, LSB first
+    int bit_count;
+
+    DecompressWriteFn write;
+    void* write_data;
+    unsigned char* out;
+    size_t out_pos;                             // End of decoded data
+    size_t out_flushed;                         // Decoded data before this was written
+    unsigned long long out_total;               // Bytes decoded by the current member
+
+    int track_crc;                              // gzip: CRC-32 of everything written
+    unsigned int crc;
+    unsigned int crc_table[256];
+
+    int fixed_ready;
+    Huffman fixed_lengths;
+    Huffman fixed_distances;
+    Huffman lengths;
+    Huffman distances;
+
+    char* error;
+    size_t error_size;
+    int failed;
+} Decoder;
+
+static const unsigned short g_length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char g_length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short g_distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char g_distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const unsigned char g_code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Record the first failure
+static int DecodeFail(Decoder* d, const char* format, ...) {
+    if (!d->failed && d->error && d->error_size > 0) {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(d->error, d->error_size, format, args);
+        va_end(args);
+    }
+    d->failed = 1;
+    return 0;
+}
+
+// Make sure unread input is buffered; 0 at end of input
+static int FillInput(Decoder* d) {
+    if (d->in_pos < d->in_len) return 1;
+    if (d->in_eof) return 0;
+
+    int got = d->read(d->in, INPUT_BUFFER_SIZE, d->read_data);
+    if (got <= 0) {
+        d->in_eof = 1;
+        if (got < 0) DecodeFail(d, "Reading compressed data failed");
+        return 0;
+    }
+    d->in_pos = 0;
+    d->in_len = (size_t)got;
+    return 1;
+}
+
+// Next input byte, -1 at end of input
+static int ReadByte(Decoder* d) {
+    if (!FillInput(d)) return -1;
+    return d->in[d->in_pos++];
+}
+
+// Exactly len input bytes (out may be NULL to skip them)
+static int ReadInput(Decoder* d, unsigned char* out, size_t len) {
+    while (len > 0) {
+        if (!FillInput(d)) return DecodeFail(d, "Compressed data is truncated");
+        size_t chunk = d->in_len - d->in_pos;
+        if (chunk > len) chunk = len;
+        if (out) {
+            memcpy(out, d->in + d->in_pos, chunk);
+            out += chunk;
+        }
+        d->in_pos += chunk;
+        len -= chunk;
+    }
+    return 1;
+}
+
+// Little-endian 32-bit input field
+static int ReadLE32(Decoder* d, unsigned int* value) {
+    unsigned char bytes[4];
+    if (!ReadInput(d, bytes, sizeof(bytes))) return 0;
+    *value = (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) |
+             ((unsigned int)bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+    return 1;
+}
+
+// Build the CRC-32 (IEEE) table
+static void InitCrcTable(Decoder* d) {
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned int c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        d->crc_table[i] = c;
+    }
+}
+
+// Hand decoded bytes to the write callback
+static int FlushOutput(Decoder* d) {
+    if (d->out_pos == d->out_flushed) return 1;
+
+    const unsigned char* data = d->out + d->out_flushed;
+    size_t len = d->out_pos - d->out_flushed;
+    if (d->track_crc) {
+        unsigned int crc = d->crc;
+        for (size_t i = 0; i < len; i++) crc = d->crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        d->crc = crc;
+    }
+    d->out_flushed = d->out_pos;
+
+    if (!d->write(data, len, d->write_data)) return DecodeFail(d, "Writing decompressed data failed");
+    return 1;
+}
+
+// Room for `need` (<= OUTPUT_STEP) more bytes, keeping the match history
+static int ReserveOutput(Decoder* d, size_t need) {
+    if (d->out_pos + need <= OUTPUT_HISTORY + OUTPUT_FLUSH) return 1;
+    if (!FlushOutput(d)) return 0;
+
+    size_t keep = d->out_pos < OUTPUT_HISTORY ? d->out_pos : OUTPUT_HISTORY;
+    memmove(d->out, d->out + d->out_pos - keep, keep);
+    d->out_pos = keep;
+    d->out_flushed = keep;
+    return 1;
+}
+
+// Append literal bytes
+static int PutBytes(Decoder* d, const unsigned char* data, size_t len) {
+    while (len > 0) {
+        size_t chunk = len < OUTPUT_STEP ? len : OUTPUT_STEP;
+        if (!ReserveOutput(d, chunk)) return 0;
+        memcpy(d->out + d->out_pos, data, chunk);
+        d->out_pos += chunk;
+        d->out_total += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return 1;
+}
+
+// Append a back-reference (LZ77 match)
+static int CopyMatch(Decoder* d, size_t distance, size_t length) {
+    if (distance == 0 || distance > OUTPUT_HISTORY || distance > d->out_total) {
+        return DecodeFail(d, "Corrupt compressed data (bad match distance)");
+    }
+
+    while (length > 0) {
+        size_t chunk = length < OUTPUT_STEP ? length : OUTPUT_STEP;
+        if (!ReserveOutput(d, chunk)) return 0;
+
+        unsigned char* dest = d->out + d->out_pos;
+        const unsigned char* src = dest - distance;
+        if (distance >= chunk) {
+            memcpy(dest, src, chunk);
+        } else {
+            // Overlapping run: later bytes repeat ones written by this copy
+            for (size_t i = 0; i < chunk; i++) dest[i] = src[i];
+        }
+        d->out_pos += chunk;
+        d->out_total += chunk;
+        length -= chunk;
+    }
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Deflate (RFC 1951)
+// ---------------------------------------------------------------------------
+
+// Have at least n bits buffered; 0 at end of input
+static int NeedBits(Decoder* d, int n) {
+    while (d->bit_count < n) {
+        int byte = ReadByte(d);
+        if (byte < 0) return 0;
+        d->bits |= (unsigned long long)byte << d->bit_count;
+        d->bit_count += 8;
+    }
+    return 1;
+}
+
+// Read n (<= 16) bits
+static int GetBits(Decoder* d, int n, unsigned int* value) {
+    if (!NeedBits(d, n)) return DecodeFail(d, "Compressed data is truncated");
+    *value = (unsigned int)(d->bits & ((1ull << n) - 1));
+    d->bits >>= n;
+    d->bit_count -= n;
+    return 1;
+}
+
+// Buffer as many whole bytes as fit, without blocking on the end of input
+static void TopUpBits(Decoder* d) {
+    while (d->bit_count <= 56) {
+        if (d->in_pos >= d->in_len && !FillInput(d)) return;
+        d->bits |= (unsigned long long)d->in[d->in_pos++] << d->bit_count;
+        d->bit_count += 8;
+    }
+}
+
+// Build a decoding table from code lengths; 0 if the lengths are over-subscribed
+static int BuildHuffman(Huffman* h, const unsigned char* lengths, int n) {
+    memset(h, 0, sizeof(Huffman));
+    for (int i = 0; i < n; i++) h->count[lengths[i]]++;
+    if (h->count[0] == n) return 1;     // No codes; any use of it is an error
+    h->count[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len <= MAX_CODE_BITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return 0;
+    }
+
+    unsigned short offsets[MAX_CODE_BITS + 2];
+    offsets[1] = 0;
+    for (int len = 1; len <= MAX_CODE_BITS; len++) offsets[len + 1] = offsets[len] + h->count[len];
+    for (int i = 0; i < n; i++) {
+        if (lengths[i]) h->symbol[offsets[lengths[i]]++] = (unsigned short)i;
+    }
+
+    // Short codes get every table slot whose low bits match the (bit-reversed) code
+    unsigned int next_code[MAX_CODE_BITS + 1];
+    unsigned int code = 0;
+    for (int len = 1; len <= MAX_CODE_BITS; len++) {
+        code = (code + h->count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+    for (int i = 0; i < n; i++) {
+        int len = lengths[i];
+        if (len == 0) continue;
+        unsigned int assigned = next_code[len]++;
+        if (len > FAST_BITS) continue;
+
+        unsigned int reversed = 0;
+        for (int b = 0; b < len; b++) reversed |= ((assigned >> b) & 1) << (len - 1 - b);
+        for (unsigned int slot = reversed; slot < (1u << FAST_BITS); slot += 1u << len) {
+            h->fast[slot] = (unsigned short)(i | (len << 12));
+        }
+    }
+    return 1;
+}
+
+// Decode one symbol; -1 on invalid or truncated input
+static int DecodeSymbol(Decoder* d, const Huffman* h) {
+    TopUpBits(d);
+    if (d->bit_count >= FAST_BITS) {
+        unsigned short entry = h->fast[d->bits & ((1u << FAST_BITS) - 1)];
+        if (entry) {
+            int len = entry >> 12;
+            d->bits >>= len;
+            d->bit_count -= len;
+            return entry & 0x1FF;
+        }
+    }
+
+    // Long code, or too few bits left for a lookup: walk the canonical code
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MAX_CODE_BITS; len++) {
+        if (!NeedBits(d, 1)) return -1;
+        code |= (int)(d->bits & 1);
+        d->bits >>= 1;
+        d->bit_count--;
+
+        int count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+// Stored block: copied straight from the input
+static int InflateStored(Decoder* d) {
+    unsigned int skip;
+    GetBits(d, d->bit_count & 7, &skip);
+
+    unsigned int len, inverse;
+    if (!GetBits(d, 16, &len) || !GetBits(d, 16, &inverse)) return 0;
+    if ((len ^ 0xFFFF) != inverse) return DecodeFail(d, "Corrupt deflate stored block");
+
+    // Whole bytes already sitting in the bit buffer come first
+    while (len > 0 && d->bit_count >= 8) {
+        unsigned char byte = (unsigned char)(d->bits & 0xFF);
+        d->bits >>= 8;
+        d->bit_count -= 8;
+        if (!PutBytes(d, &byte, 1)) return 0;
+        len--;
+    }
+    while (len > 0) {
+        if (!FillInput(d)) return DecodeFail(d, "Compressed data is truncated");
+        size_t chunk = d->in_len - d->in_pos;
+        if (chunk > len) chunk = len;
+        if (!PutBytes(d, d->in + d->in_pos, chunk)) return 0;
+        d->in_pos += chunk;
+        len -= (unsigned int)chunk;
+    }
+    return 1;
+}
+
+// Literal/length and distance codes until end of block
+static int InflateCodes(Decoder* d, const Huffman* lengths, const Huffman* distances) {
+    while (1) {
+        int symbol = DecodeSymbol(d, lengths);
+        if (symbol < 0) return DecodeFail(d, d->in_eof ? "Compressed data is truncated" : "Corrupt deflate data");
+
+        if (symbol < 256) {
+            if (d->out_pos >= OUTPUT_HISTORY + OUTPUT_FLUSH && !ReserveOutput(d, 1)) return 0;
+            d->out[d->out_pos++] = (unsigned char)symbol;
+            d->out_total++;
+        } else if (symbol == 256) {
+            return 1;
+        } else {
+            symbol -= 257;
+            if (symbol >= 29) return DecodeFail(d, "Corrupt deflate data");
+            unsigned int extra = 0;
+            if (!GetBits(d, g_length_extra[symbol], &extra)) return 0;
+            size_t length = g_length_base[symbol] + extra;
+
+            int dist_symbol = DecodeSymbol(d, distances);
+            if (dist_symbol < 0 || dist_symbol >= 30) return DecodeFail(d, "Corrupt deflate data");
+            if (!GetBits(d, g_distance_extra[dist_symbol], &extra)) return 0;
+            if (!CopyMatch(d, g_distance_base[dist_symbol] + extra, length)) return 0;
+        }
+    }
+}
+
+// Block with the predefined codes
+static int InflateFixed(Decoder* d) {
+    if (!d->fixed_ready) {
+        unsigned char lengths[288];
+        int i = 0;
+        for (; i < 144; i++) lengths[i] = 8;
+        for (; i < 256; i++) lengths[i] = 9;
+        for (; i < 280; i++) lengths[i] = 7;
+        for (; i < 288; i++) lengths[i] = 8;
+        BuildHuffman(&d->fixed_lengths, lengths, 288);
+        for (i = 0; i < 30; i++) lengths[i] = 5;
+        BuildHuffman(&d->fixed_distances, lengths, 30);
+        d->fixed_ready = 1;
+    }
+    return InflateCodes(d, &d->fixed_lengths, &d->fixed_distances);
+}
+
+// Block with codes described in its header
+static int InflateDynamic(Decoder* d) {
+    unsigned int nlen, ndist, ncode;
+    if (!GetBits(d, 5, &nlen) || !GetBits(d, 5, &ndist) || !GetBits(d, 4, &ncode)) return 0;
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > 286 || ndist > 30) return DecodeFail(d, "Corrupt deflate block header");
+
+    unsigned char lengths[320];
+    memset(lengths, 0, sizeof(lengths));
+    for (unsigned int i = 0; i < ncode; i++) {
+        unsigned int len;
+        if (!GetBits(d, 3, &len)) return 0;
+        lengths[g_code_length_order[i]] = (unsigned char)len;
+    }
+    if (!BuildHuffman(&d->lengths, lengths, 19)) return DecodeFail(d, "Corrupt deflate block header");
+
+    unsigned int index = 0;
+    memset(lengths, 0, sizeof(lengths));
+    while (index < nlen + ndist) {
+        int symbol = DecodeSymbol(d, &d->lengths);
+        if (symbol < 0) return DecodeFail(d, "Corrupt deflate block header");
+        if (symbol < 16) {
+            lengths[index++] = (unsigned char)symbol;
+            continue;
+        }
+
+        unsigned char repeat_len = 0;
+        unsigned int repeat;
+        if (symbol == 16) {
+            if (index == 0) return DecodeFail(d, "Corrupt deflate block header");
+            repeat_len = lengths[index - 1];
+            if (!GetBits(d, 2, &repeat)) return 0;
+            repeat += 3;
+        } else if (symbol == 17) {
+            if (!GetBits(d, 3, &repeat)) return 0;
+            repeat += 3;
+        } else {
+            if (!GetBits(d, 7, &repeat)) return 0;
+            repeat += 11;
+        }
+        if (index + repeat > nlen + ndist) return DecodeFail(d, "Corrupt deflate block header");
+        while (repeat--) lengths[index++] = repeat_len;
+    }
+
+    if (lengths[256] == 0) return DecodeFail(d, "Corrupt deflate block header");
+    if (!BuildHuffman(&d->lengths, lengths, (int)nlen) ||
+        !BuildHuffman(&d->distances, lengths + nlen, (int)ndist)) {
+        return DecodeFail(d, "Corrupt deflate block header");
+    }
+    return InflateCodes(d, &d->lengths, &d->distances);
+}
+
+// One deflate stream, up to and including its last block
+static int Inflate(Decoder* d) {
+    unsigned int last = 0;
+    while (!last) {
+        unsigned int type;
+        if (!GetBits(d, 1, &last) || !GetBits(d, 2, &type)) return 0;
+
+        int ok;
+        switch (type) {
+            case 0: ok = InflateStored(d); break;
+            case 1: ok = InflateFixed(d); break;
+            case 2: ok = InflateDynamic(d); break;
+            default: ok = DecodeFail(d, "Corrupt deflate data (block type 3)"); break;
+        }
+        if (!ok) return 0;
+    }
+    return 1;
+}
+
+// Byte-aligned read through the bit buffer
+static int GetByte(Decoder* d, unsigned int* value) {
+    return GetBits(d, 8, value);
+}
+
+// One gzip member (RFC 1952): header, deflate data, CRC-32 and size trailer
+static int DecodeGzipMember(Decoder* d) {
+    unsigned int header[10];
+    for (int i = 0; i < 10; i++) {
+        if (!GetByte(d, &header[i])) return 0;
+    }
+    if (header[0] != 0x1F || header[1] != 0x8B) return DecodeFail(d, "Not a gzip stream");
+    if (header[2] != 8) return DecodeFail(d, "Unsupported gzip compression method %u", header[2]);
+
+    unsigned int flags = header[3];
+    unsigned int byte;
+    if (flags & 0x04) {
+        // FEXTRA
+        unsigned int lo, hi;
+        if (!GetByte(d, &lo) || !GetByte(d, &hi)) return 0;
+        for (unsigned int i = 0; i < (lo | (hi << 8)); i++) {
+            if (!GetByte(d, &byte)) return 0;
+        }
+    }
+    for (unsigned int mask = 0x08; mask <= 0x10; mask <<= 1) {
+        // FNAME, FCOMMENT: zero-terminated
+        if (!(flags & mask)) continue;
+        do {
+            if (!GetByte(d, &byte)) return 0;
+        } while (byte != 0);
+    }
+    if (flags & 0x02) {
+        // FHCRC
+        if (!GetByte(d, &byte) || !GetByte(d, &byte)) return 0;
+    }
+
+    d->crc = 0xFFFFFFFFu;
+    d->out_total = 0;
+    if (!Inflate(d) || !FlushOutput(d)) return 0;
+
+    unsigned int trailer[8];
+    GetBits(d, d->bit_count & 7, &byte);
+    for (int i = 0; i < 8; i++) {
+        if (!GetByte(d, &trailer[i])) return 0;
+    }
+    unsigned int expected_crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | (trailer[3] << 24);
+    unsigned int expected_size = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | (trailer[7] << 24);
+    if ((d->crc ^ 0xFFFFFFFFu) != expected_crc) return DecodeFail(d, "gzip CRC mismatch (data is corrupt)");
+    if ((unsigned int)d->out_total != expected_size) return DecodeFail(d, "gzip size mismatch (data is corrupt)");
+    return 1;
+}
+
+// gzip stream, possibly several concatenated members
+static int DecodeGzip(Decoder* d) {
+    d->track_crc = 1;
+    InitCrcTable(d);
+
+    do {
+        if (!DecodeGzipMember(d)) return 0;
+        // Anything other than another member (zero padding, trailing junk) ends the stream
+    } while (NeedBits(d, 8) && (d->bits & 0xFF) == 0x1F);
+
+    return !d->failed;
+}
+
+// Raw deflate stream, as stored in zip entries (the archive carries the checksum)
+static int DecodeDeflate(Decoder* d) {
+    return Inflate(d);
+}
+
+// ---------------------------------------------------------------------------
+// LZ4 (frame format and the legacy format used for kernels)
+// ---------------------------------------------------------------------------
+
+// Decode one compressed block against the output history
+static int DecodeLz4Block(Decoder* d, const unsigned char* src, size_t size) {
+    const unsigned char* ip = src;
+    const unsigned char* end = src + size;
+
+    while (ip < end) {
+        unsigned int token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            unsigned char extra;
+            do {
+                if (ip >= end) return DecodeFail(d, "Corrupt LZ4 block");
+                extra = *ip++;
+                literals += extra;
+            } while (extra == 255);
+        }
+        if ((size_t)(end - ip) < literals) return DecodeFail(d, "Corrupt LZ4 block");
+        if (!PutBytes(d, ip, literals)) return 0;
+        ip += literals;
+
+        // The last sequence carries literals only
+        if (ip >= end) break;
+
+        if (end - ip < 2) return DecodeFail(d, "Corrupt LZ4 block");
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+
+        size_t length = token & 15;
+        if (length == 15) {
+            unsigned char extra;
+            do {
+                if (ip >= end) return DecodeFail(d, "Corrupt LZ4 block");
+                extra = *ip++;
+                length += extra;
+            } while (extra == 255);
+        }
+        if (!CopyMatch(d, offset, length + 4)) return 0;
+    }
+    return 1;
+}
+
+// Read a block of `size` bytes into a reusable buffer and decode it
+static int ReadLz4Block(Decoder* d, unsigned int size, unsigned char** block, size_t* capacity) {
+    if (size > *capacity) {
+        *block = (unsigned char*)SafeRealloc(*block, size);
+        *capacity = size;
+    }
+    return ReadInput(d, *block, size) && DecodeLz4Block(d, *block, size);
+}
+
+// One frame after its magic number
+static int DecodeLz4Frame(Decoder* d, unsigned char** block, size_t* capacity) {
+    int flags = ReadByte(d);
+    int descriptor = ReadByte(d);
+    if (flags < 0 || descriptor < 0) return DecodeFail(d, "Compressed data is truncated");
+    if ((flags >> 6) != 1) return DecodeFail(d, "Unsupported LZ4 frame version");
+    if (flags & 0x01) return DecodeFail(d, "LZ4 frames with a dictionary are not supported");
+
+    int block_id = (descriptor >> 4) & 7;
+    if (block_id < 4) return DecodeFail(d, "Corrupt LZ4 frame header");
+    unsigned int max_block = 1u << (8 + 2 * block_id);
+
+    // Content size, then the header checksum
+    if ((flags & 0x08) && !ReadInput(d, NULL, 8)) return 0;
+    if (!ReadInput(d, NULL, 1)) return 0;
+
+    while (1) {
+        unsigned int size;
+        if (!ReadLE32(d, &size)) return 0;
+        if (size == 0) break;
+
+        int stored = (size & 0x80000000u) != 0;
+        size &= 0x7FFFFFFFu;
+        if (size > max_block) return DecodeFail(d, "Corrupt LZ4 frame (block too large)");
+
+        if (stored) {
+            while (size > 0) {
+                if (!FillInput(d)) return DecodeFail(d, "Compressed data is truncated");
+                size_t chunk = d->in_len - d->in_pos;
+                if (chunk > size) chunk = size;
+                if (!PutBytes(d, d->in + d->in_pos, chunk)) return 0;
+                d->in_pos += chunk;
+                size -= (unsigned int)chunk;
+            }
+        } else if (!ReadLz4Block(d, size, block, capacity)) {
+            return 0;
+        }
+
+        // Block checksum
+        if ((flags & 0x10) && !ReadInput(d, NULL, 4)) return 0;
+    }
+
+    // Content checksum
+    if ((flags & 0x04) && !ReadInput(d, NULL, 4)) return 0;
+    return 1;
+}
+
+// Legacy blocks until the input ends or another magic number starts (returned in next_magic)
+static int DecodeLz4Legacy(Decoder* d, unsigned char** block, size_t* capacity, unsigned int* next_magic) {
+    *next_magic = 0;
+    while (FillInput(d)) {
+        unsigned int size;
+        if (!ReadLE32(d, &size)) return 0;
+        if (size == LZ4_LEGACY_MAGIC) continue;
+        if (size == LZ4_FRAME_MAGIC || (size & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC) {
+            *next_magic = size;
+            return 1;
+        }
+        // Kernel builds append the uncompressed size after the last block
+        if (!FillInput(d)) break;
+        if (size > LZ4_LEGACY_BOUND) return DecodeFail(d, "Corrupt LZ4 legacy block");
+        if (!ReadLz4Block(d, size, block, capacity)) return 0;
+    }
+    return !d->failed;
+}
+
+// LZ4 stream: any sequence of frames, legacy frames and skippable frames
+static int DecodeLz4(Decoder* d) {
+    unsigned char* block = NULL;
+    size_t capacity = 0;
+    int ok = 1;
+
+    unsigned int magic = 0;
+    if (!ReadLE32(d, &magic)) return 0;
+    while (ok && magic != 0) {
+        if (magic == LZ4_FRAME_MAGIC) {
+            ok = DecodeLz4Frame(d, &block, &capacity);
+            magic = 0;
+        } else if (magic == LZ4_LEGACY_MAGIC) {
+            ok = DecodeLz4Legacy(d, &block, &capacity, &magic);
+            continue;
+        } else if ((magic & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC) {
+            unsigned int size;
+            ok = ReadLE32(d, &size) && ReadInput(d, NULL, size);
+            magic = 0;
+        } else {
+            ok = DecodeFail(d, "Not an LZ4 stream");
+            break;
+        }
+
+        if (ok && FillInput(d)) ok = ReadLE32(d, &magic);
+    }
+
+    free(block);
+    return ok && !d->failed;
+}
+
+// ---------------------------------------------------------------------------
+// xz (LZMA2 filter only, as xz writes by default)
+// ---------------------------------------------------------------------------
+
+// Dictionary of one block: circular window over the decoded output
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t pos;                                 // Next write position
+    size_t full;                                // Valid bytes behind pos (<= size)
+    size_t flushed;                             // Bytes before this were handed on
+    unsigned long long total;                   // Decoded since the last dictionary reset
+} LzmaDict;
+
+// Length decoder (match and rep lengths each have one)
+typedef struct {
+    unsigned short choice;
+    unsigned short choice2;
+    unsigned short low[LZMA_POS_STATES_MAX][1 << 3];
+    unsigned short mid[LZMA_POS_STATES_MAX][1 << 3];
+    unsigned short high[1 << 8];
+} LzmaLengthCoder;
+
+// LZMA2 decoding state plus the block's integrity check
+typedef struct {
+    // Range decoder over one chunk held in memory
+    const unsigned char* rc_in;
+    size_t rc_pos;
+    size_t rc_size;
+    unsigned int range;
+    unsigned int code;
+
+    LzmaDict dict;
+    unsigned int lc, lp_mask, pb_mask;
+    unsigned int state;
+    unsigned int rep0, rep1, rep2, rep3;
+
+    unsigned short is_match[LZMA_STATES][LZMA_POS_STATES_MAX];
+    unsigned short is_rep[LZMA_STATES];
+    unsigned short is_rep0[LZMA_STATES];
+    unsigned short is_rep1[LZMA_STATES];
+    unsigned short is_rep2[LZMA_STATES];
+    unsigned short is_rep0_long[LZMA_STATES][LZMA_POS_STATES_MAX];
+    unsigned short dist_slot[LZMA_DIST_STATES][1 << 6];
+    unsigned short dist_special[LZMA_FULL_DISTANCES - LZMA_DIST_MODEL_END];
+    unsigned short dist_align[1 << LZMA_ALIGN_BITS];
+    LzmaLengthCoder match_len;
+    LzmaLengthCoder rep_len;
+    unsigned short literal[1 << 4][0x300];      // lc + lp <= 4 in LZMA2
+
+    int check_type;                             // Stream flags: 0 none, 1 CRC-32, 4 CRC-64, 10 SHA-256
+    unsigned int check_crc32;
+    unsigned long long check_crc64;
+    Sha256Context check_sha256;
+    unsigned long long crc64_table[256];
+    unsigned long long block_output;            // Bytes the current block decoded to
+} XzDecoder;
+
+// Check field size by check type
+static const unsigned char g_xz_check_sizes[16] = { 0, 4, 4, 4, 8, 8, 8, 16, 16, 16, 32, 32, 32, 64, 64, 64 };
+
+// CRC-32 (IEEE) of a buffer, continuing from crc
+static unsigned int UpdateCrc32(const Decoder* d, unsigned int crc, const unsigned char* data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = d->crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Build the CRC-64 (ECMA-182) table
+static void InitCrc64Table(XzDecoder* x) {
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned long long c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xC96C5795D7870F42ULL ^ (c >> 1) : c >> 1;
+        x->crc64_table[i] = c;
+    }
+}
+
+// Feed decoded bytes to the block's check and hand them to the write callback
+static int XzEmit(Decoder* d, XzDecoder* x, const unsigned char* data, size_t len) {
+    if (len == 0) return 1;
+    if (x->check_type == 1) {
+        x->check_crc32 = UpdateCrc32(d, x->check_crc32, data, len);
+    } else if (x->check_type == 4) {
+        unsigned long long crc = ~x->check_crc64;
+        for (size_t i = 0; i < len; i++) crc = x->crc64_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        x->check_crc64 = ~crc;
+    } else if (x->check_type == 10) {
+        Sha256Update(&x->check_sha256, data, len);
+    }
+    x->block_output += len;
+
+    if (!d->write(data, len, d->write_data)) return DecodeFail(d, "Writing decompressed data failed");
+    return 1;
+}
+
+// Hand on what the dictionary decoded since the last flush
+static int LzmaFlushDict(Decoder* d, XzDecoder* x) {
+    LzmaDict* dict = &x->dict;
+    if (!XzEmit(d, x, dict->data + dict->flushed, dict->pos - dict->flushed)) return 0;
+    dict->flushed = dict->pos;
+    if (dict->pos == dict->size) {
+        dict->pos = 0;
+        dict->flushed = 0;
+    }
+    return 1;
+}
+
+// Append one decoded byte
+static int LzmaPutByte(Decoder* d, XzDecoder* x, unsigned char byte) {
+    LzmaDict* dict = &x->dict;
+    dict->data[dict->pos++] = byte;
+    dict->total++;
+    if (dict->full < dict->size) dict->full++;
+    return dict->pos < dict->size || LzmaFlushDict(d, x);
+}
+
+// Byte `distance` (>= 1) positions back
+static unsigned char LzmaDictByte(const LzmaDict* dict, size_t distance) {
+    return dict->data[dict->pos >= distance ? dict->pos - distance : dict->pos + dict->size - distance];
+}
+
+// Repeat `length` bytes from `distance` back
+static int LzmaCopyMatch(Decoder* d, XzDecoder* x, size_t distance, size_t length) {
+    LzmaDict* dict = &x->dict;
+    if (distance == 0 || distance > dict->full) return DecodeFail(d, "Corrupt xz data (bad match distance)");
+
+    size_t src = dict->pos >= distance ? dict->pos - distance : dict->pos + dict->size - distance;
+    while (length > 0) {
+        // Copy in runs that wrap neither source nor destination
+        size_t run = length;
+        if (run > dict->size - dict->pos) run = dict->size - dict->pos;
+        if (run > dict->size - src) run = dict->size - src;
+        if (distance >= run) {
+            memcpy(dict->data + dict->pos, dict->data + src, run);
+        } else {
+            for (size_t i = 0; i < run; i++) dict->data[dict->pos + i] = dict->data[src + i];
+        }
+        dict->pos += run;
+        dict->total += run;
+        dict->full = (dict->full + run < dict->size) ? dict->full + run : dict->size;
+        src += run;
+        if (src == dict->size) src = 0;
+        length -= run;
+        if (dict->pos == dict->size && !LzmaFlushDict(d, x)) return 0;
+    }
+    return 1;
+}
+
+// Keep at least 2^24 in the range, pulling in the next byte
+static void LzmaNormalize(XzDecoder* x) {
+    if (x->range < (1u << 24)) {
+        x->range <<= 8;
+        // Reading past the chunk is caught by the check after it
+        x->code = (x->code << 8) | (x->rc_pos < x->rc_size ? x->rc_in[x->rc_pos] : 0);
+        x->rc_pos++;
+    }
+}
+
+// Decode one bit with an adaptive probability
+static unsigned int LzmaBit(XzDecoder* x, unsigned short* prob) {
+    LzmaNormalize(x);
+    unsigned int bound = (x->range >> 11) * *prob;
+    if (x->code < bound) {
+        x->range = bound;
+        *prob += (2048 - *prob) >> 5;
+        return 0;
+    }
+    x->range -= bound;
+    x->code -= bound;
+    *prob -= *prob >> 5;
+    return 1;
+}
+
+// Most significant bit first through a tree of 2^bits probabilities
+static unsigned int LzmaBitTree(XzDecoder* x, unsigned short* probs, int bits) {
+    unsigned int symbol = 1;
+    for (int i = 0; i < bits; i++) symbol = (symbol << 1) | LzmaBit(x, &probs[symbol]);
+    return symbol - (1u << bits);
+}
+
+// Least significant bit first, added to *value
+static void LzmaBitTreeReverse(XzDecoder* x, unsigned short* probs, int bits, unsigned int* value) {
+    unsigned int symbol = 1;
+    for (int i = 0; i < bits; i++) {
+        unsigned int bit = LzmaBit(x, &probs[symbol]);
+        symbol = (symbol << 1) | bit;
+        *value += bit << i;
+    }
+}
+
+// Bits with fixed probability one half, shifted into *value
+static void LzmaDirectBits(XzDecoder* x, int bits, unsigned int* value) {
+    while (bits-- > 0) {
+        LzmaNormalize(x);
+        x->range >>= 1;
+        unsigned int bit = x->code >= x->range;
+        if (bit) x->code -= x->range;
+        *value = (*value << 1) | bit;
+    }
+}
+
+// Match length (2..273)
+static unsigned int LzmaLength(XzDecoder* x, LzmaLengthCoder* coder, unsigned int pos_state) {
+    if (!LzmaBit(x, &coder->choice)) return 2 + LzmaBitTree(x, coder->low[pos_state], 3);
+    if (!LzmaBit(x, &coder->choice2)) return 2 + 8 + LzmaBitTree(x, coder->mid[pos_state], 3);
+    return 2 + 16 + LzmaBitTree(x, coder->high, 8);
+}
+
+// Forget the previous chunks' statistics and distances
+static void LzmaResetState(XzDecoder* x) {
+    x->state = 0;
+    x->rep0 = x->rep1 = x->rep2 = x->rep3 = 0;
+
+    // Every probability array runs from is_match to the end of literal
+    unsigned short* first = &x->is_match[0][0];
+    unsigned short* end = &x->literal[0][0] + sizeof(x->literal) / sizeof(unsigned short);
+    for (unsigned short* p = first; p < end; p++) *p = 1024;
+}
+
+// Decode one literal byte
+static int LzmaLiteral(Decoder* d, XzDecoder* x) {
+    unsigned int prev = x->dict.full ? LzmaDictByte(&x->dict, 1) : 0;
+    unsigned int index = (((unsigned int)x->dict.total & x->lp_mask) << x->lc) + (prev >> (8 - x->lc));
+    unsigned short* probs = x->literal[index];
+
+    unsigned int symbol = 1;
+    if (x->state < LZMA_LIT_STATES) {
+        while (symbol < 0x100) symbol = (symbol << 1) | LzmaBit(x, &probs[symbol]);
+    } else {
+        // After a match the byte at rep0 predicts the literal until a bit differs
+        if (x->rep0 >= x->dict.full) return DecodeFail(d, "Corrupt xz data (bad match distance)");
+        unsigned int match_byte = LzmaDictByte(&x->dict, x->rep0 + 1);
+        unsigned int offset = 0x100;
+        while (symbol < 0x100) {
+            match_byte <<= 1;
+            unsigned int match_bit = match_byte & offset;
+            if (LzmaBit(x, &probs[offset + match_bit + symbol])) {
+                symbol = (symbol << 1) | 1;
+                offset = match_bit;
+            } else {
+                symbol <<= 1;
+                offset &= ~match_bit;
+            }
+        }
+    }
+
+    x->state = x->state < 4 ? 0 : (x->state < 10 ? x->state - 3 : x->state - 6);
+    return LzmaPutByte(d, x, (unsigned char)symbol);
+}
+
+// Decode an LZMA chunk of `size` output bytes
+static int LzmaDecodeChunk(Decoder* d, XzDecoder* x, size_t size) {
+    unsigned long long end_total = x->dict.total + size;
+
+    while (x->dict.total < end_total && !d->failed) {
+        unsigned int pos_state = (unsigned int)x->dict.total & x->pb_mask;
+        unsigned long long left = end_total - x->dict.total;
+
+        if (!LzmaBit(x, &x->is_match[x->state][pos_state])) {
+            if (!LzmaLiteral(d, x)) return 0;
+            continue;
+        }
+
+        unsigned int length;
+        if (!LzmaBit(x, &x->is_rep[x->state])) {
+            // New distance
+            x->state = x->state < LZMA_LIT_STATES ? 7 : 10;
+            x->rep3 = x->rep2;
+            x->rep2 = x->rep1;
+            x->rep1 = x->rep0;
+            length = LzmaLength(x, &x->match_len, pos_state);
+
+            unsigned int dist_state = length < 2 + LZMA_DIST_STATES ? length - 2 : LZMA_DIST_STATES - 1;
+            unsigned int slot = LzmaBitTree(x, x->dist_slot[dist_state], 6);
+            if (slot < 4) {
+                x->rep0 = slot;
+            } else {
+                int bits = (int)(slot >> 1) - 1;
+                x->rep0 = (2 | (slot & 1)) << bits;
+                if (slot < LZMA_DIST_MODEL_END) {
+                    LzmaBitTreeReverse(x, x->dist_special + x->rep0 - slot - 1, bits, &x->rep0);
+                } else {
+                    unsigned int high = 2 | (slot & 1);
+                    LzmaDirectBits(x, bits - LZMA_ALIGN_BITS, &high);
+                    x->rep0 = high << LZMA_ALIGN_BITS;
+                    LzmaBitTreeReverse(x, x->dist_align, LZMA_ALIGN_BITS, &x->rep0);
+                }
+            }
+        } else if (!LzmaBit(x, &x->is_rep0[x->state])) {
+            if (!LzmaBit(x, &x->is_rep0_long[x->state][pos_state])) {
+                // One byte from rep0
+                x->state = x->state < LZMA_LIT_STATES ? 9 : 11;
+                if (!LzmaCopyMatch(d, x, (size_t)x->rep0 + 1, 1)) return 0;
+                continue;
+            }
+            x->state = x->state < LZMA_LIT_STATES ? 8 : 11;
+            length = LzmaLength(x, &x->rep_len, pos_state);
+        } else {
+            unsigned int distance;
+            if (!LzmaBit(x, &x->is_rep1[x->state])) {
+                distance = x->rep1;
+            } else {
+                if (!LzmaBit(x, &x->is_rep2[x->state])) {
+                    distance = x->rep2;
+                } else {
+                    distance = x->rep3;
+                    x->rep3 = x->rep2;
+                }
+                x->rep2 = x->rep1;
+            }
+            x->rep1 = x->rep0;
+            x->rep0 = distance;
+            x->state = x->state < LZMA_LIT_STATES ? 8 : 11;
+            length = LzmaLength(x, &x->rep_len, pos_state);
+        }
+
+        // LZMA2 chunks never end inside a match, nor carry an end marker
+        if (length > left) return DecodeFail(d, "Corrupt xz data (match past the chunk)");
+        if (!LzmaCopyMatch(d, x, (size_t)x->rep0 + 1, length)) return 0;
+    }
+    if (d->failed) return 0;
+
+    LzmaNormalize(x);
+    if (x->rc_pos != x->rc_size || x->code != 0) return DecodeFail(d, "Corrupt xz data (chunk size mismatch)");
+    return 1;
+}
+
+// Start a dictionary over (new block, or a chunk asking for it)
+static void LzmaResetDict(XzDecoder* x) {
+    x->dict.pos = 0;
+    x->dict.full = 0;
+    x->dict.flushed = 0;
+    x->dict.total = 0;
+}
+
+// LZMA2 chunks up to the end marker; *consumed counts the bytes read
+static int DecodeLzma2(Decoder* d, XzDecoder* x, unsigned long long* consumed) {
+    unsigned char* chunk = (unsigned char*)SafeMalloc(LZMA2_CHUNK_MAX);
+    int need_dict_reset = 1;
+    int need_props = 1;
+    int ok = 1;
+
+    while (ok) {
+        int control = ReadByte(d);
+        if (control < 0) {
+            ok = DecodeFail(d, "Compressed data is truncated");
+            break;
+        }
+        (*consumed)++;
+        if (control == 0x00) break;
+
+        unsigned char head[5];
+        if (control < 0x80) {
+            // Stored chunk: 0x01 resets the dictionary first, 0x02 keeps it
+            if (control > 0x02 || (control == 0x02 && need_dict_reset)) {
+                ok = DecodeFail(d, "Corrupt xz data (bad LZMA2 chunk)");
+                break;
+            }
+            if (control == 0x01) {
+                LzmaResetDict(x);
+                need_dict_reset = 0;
+            }
+            if (!ReadInput(d, head, 2)) {
+                ok = 0;
+                break;
+            }
+            size_t size = (((size_t)head[0] << 8) | head[1]) + 1;
+            *consumed += 2 + size;
+            ok = ReadInput(d, chunk, size);
+            for (size_t i = 0; ok && i < size; i++) ok = LzmaPutByte(d, x, chunk[i]);
+            continue;
+        }
+
+        // LZMA chunk: sizes, then new properties when the reset level asks for them
+        int reset = (control >> 5) & 3;
+        size_t head_size = reset >= 2 ? 5 : 4;
+        if (!ReadInput(d, head, head_size)) {
+            ok = 0;
+            break;
+        }
+        size_t unpacked = ((((size_t)control & 0x1F) << 16) | ((size_t)head[0] << 8) | head[1]) + 1;
+        size_t packed = (((size_t)head[2] << 8) | head[3]) + 1;
+        *consumed += head_size + packed;
+
+        if (reset == 3) {
+            LzmaResetDict(x);
+            need_dict_reset = 0;
+        } else if (need_dict_reset) {
+            ok = DecodeFail(d, "Corrupt xz data (no dictionary reset)");
+            break;
+        }
+        if (reset >= 2) {
+            unsigned int props = head[4];
+            if (props >= 9 * 5 * 5) {
+                ok = DecodeFail(d, "Corrupt xz data (bad LZMA properties)");
+                break;
+            }
+            unsigned int lc = props % 9;
+            unsigned int lp = (props / 9) % 5;
+            unsigned int pb = props / 45;
+            if (lc + lp > 4) {
+                ok = DecodeFail(d, "Corrupt xz data (bad LZMA properties)");
+                break;
+            }
+            x->lc = lc;
+            x->lp_mask = (1u << lp) - 1;
+            x->pb_mask = (1u << pb) - 1;
+            need_props = 0;
+        } else if (need_props) {
+            ok = DecodeFail(d, "Corrupt xz data (no LZMA properties)");
+            break;
+        }
+        if (reset >= 1) LzmaResetState(x);
+
+        if (packed < 5 || !ReadInput(d, chunk, packed)) {
+            ok = packed < 5 ? DecodeFail(d, "Corrupt xz data (bad LZMA2 chunk)") : 0;
+            break;
+        }
+        if (chunk[0] != 0) {
+            ok = DecodeFail(d, "Corrupt xz data (bad range coder start)");
+            break;
+        }
+        x->rc_in = chunk;
+        x->rc_size = packed;
+        x->rc_pos = 5;
+        x->range = 0xFFFFFFFFu;
+        x->code = ((unsigned int)chunk[1] << 24) | ((unsigned int)chunk[2] << 16) |
+                  ((unsigned int)chunk[3] << 8) | chunk[4];
+        ok = LzmaDecodeChunk(d, x, unpacked);
+    }
+
+    free(chunk);
+    return ok && LzmaFlushDict(d, x);
+}
+
+// Variable-length integer from a buffer (up to 9 bytes of 7 bits)
+static int ParseXzVli(const unsigned char* data, size_t size, size_t* pos, unsigned long long* value) {
+    *value = 0;
+    for (int i = 0; i < 9; i++) {
+        if (*pos >= size) return 0;
+        unsigned int byte = data[(*pos)++];
+        *value |= (unsigned long long)(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) return byte != 0 || i == 0;
+    }
+    return 0;
+}
+
+// Variable-length integer from the index, added to its CRC-32 and size
+static int ReadXzVli(Decoder* d, unsigned long long* value, unsigned int* crc, unsigned long long* size) {
+    unsigned char bytes[9];
+    size_t count = 0;
+    int byte;
+    do {
+        byte = ReadByte(d);
+        if (byte < 0) return DecodeFail(d, "Compressed data is truncated");
+        bytes[count++] = (unsigned char)byte;
+    } while ((byte & 0x80) && count < sizeof(bytes));
+
+    size_t pos = 0;
+    *crc = UpdateCrc32(d, *crc, bytes, count);
+    *size += count;
+    if (!ParseXzVli(bytes, count, &pos, value)) return DecodeFail(d, "Corrupt xz index");
+    return 1;
+}
+
+// One block after its header-size byte; adds its sizes for the index check
+static int DecodeXzBlock(Decoder* d, XzDecoder* x, unsigned int size_byte,
+                         unsigned long long* unpadded_sum, unsigned long long* uncompressed_sum) {
+    unsigned char header[1024];
+    size_t header_size = ((size_t)size_byte + 1) * 4;
+    header[0] = (unsigned char)size_byte;
+    if (!ReadInput(d, header + 1, header_size - 1)) return 0;
+
+    unsigned int stored_crc = (unsigned int)header[header_size - 4] | ((unsigned int)header[header_size - 3] << 8) |
+                              ((unsigned int)header[header_size - 2] << 16) | ((unsigned int)header[header_size - 1] << 24);
+    if (UpdateCrc32(d, 0, header, header_size - 4) != stored_crc) return DecodeFail(d, "Corrupt xz block header");
+
+    unsigned int flags = header[1];
+    if (flags & 0x3C) return DecodeFail(d, "Unsupported xz block flags");
+
+    size_t pos = 2, end = header_size - 4;
+    unsigned long long compressed_size = 0, uncompressed_size = 0;
+    if ((flags & 0x40) && !ParseXzVli(header, end, &pos, &compressed_size)) return DecodeFail(d, "Corrupt xz block header");
+    if ((flags & 0x80) && !ParseXzVli(header, end, &pos, &uncompressed_size)) return DecodeFail(d, "Corrupt xz block header");
+
+    // A single LZMA2 filter; BCJ and delta filters are for executables and audio, not disk images
+    unsigned long long filter_id = 0, props_size = 0;
+    if (!ParseXzVli(header, end, &pos, &filter_id) || !ParseXzVli(header, end, &pos, &props_size)) {
+        return DecodeFail(d, "Corrupt xz block header");
+    }
+    if ((flags & 0x03) != 0 || filter_id != XZ_FILTER_LZMA2) {
+        return DecodeFail(d, "Unsupported xz filter (only plain LZMA2 is supported)");
+    }
+    if (props_size != 1 || pos >= end) return DecodeFail(d, "Corrupt xz block header");
+    unsigned int dict_bits = header[pos++] & 0x3F;
+    while (pos < end) {
+        if (header[pos++] != 0) return DecodeFail(d, "Corrupt xz block header");
+    }
+    if (dict_bits > 40) return DecodeFail(d, "Corrupt xz block header");
+
+    // Dictionary as large as the block needs, within reason
+    unsigned long long dict_size = dict_bits == 40 ? 0xFFFFFFFFULL : (2ULL | (dict_bits & 1)) << (dict_bits / 2 + 11);
+    if ((flags & 0x80) && uncompressed_size < dict_size) dict_size = uncompressed_size;
+    if (dict_size < 4096) dict_size = 4096;
+    if (dict_size > XZ_DICT_MAX) {
+        return DecodeFail(d, "xz dictionary of %llu MB is too large", dict_size >> 20);
+    }
+    if (x->dict.size < dict_size) {
+        free(x->dict.data);
+        x->dict.data = (unsigned char*)SafeMalloc((size_t)dict_size);
+        x->dict.size = (size_t)dict_size;
+    }
+
+    x->check_crc32 = 0;
+    x->check_crc64 = 0;
+    Sha256Init(&x->check_sha256);
+    x->block_output = 0;
+
+    unsigned long long consumed = 0;
+    if (!DecodeLzma2(d, x, &consumed)) return 0;
+    if ((flags & 0x40) && consumed != compressed_size) return DecodeFail(d, "Corrupt xz block (size mismatch)");
+    if ((flags & 0x80) && x->block_output != uncompressed_size) return DecodeFail(d, "Corrupt xz block (size mismatch)");
+
+    // Padding to a multiple of four, then the check
+    for (unsigned long long padded = consumed; padded & 3; padded++) {
+        if (ReadByte(d) != 0) return DecodeFail(d, "Corrupt xz block padding");
+    }
+    unsigned char check[64];
+    size_t check_size = g_xz_check_sizes[x->check_type];
+    if (!ReadInput(d, check, check_size)) return 0;
+
+    if (x->check_type == 1 || x->check_type == 4) {
+        unsigned long long value = x->check_type == 1 ? x->check_crc32 : x->check_crc64;
+        for (size_t i = 0; i < check_size; i++) {
+            if (check[i] != (unsigned char)(value >> (8 * i))) return DecodeFail(d, "xz check mismatch (data is corrupt)");
+        }
+    } else if (x->check_type == 10) {
+        unsigned char digest[SHA256_DIGEST_SIZE];
+        Sha256Final(&x->check_sha256, digest);
+        if (memcmp(check, digest, sizeof(digest)) != 0) return DecodeFail(d, "xz check mismatch (data is corrupt)");
+    }
+
+    *unpadded_sum += header_size + consumed + check_size;
+    *uncompressed_sum += x->block_output;
+    return 1;
+}
+
+// Index after the last block (its indicator byte already read): must
+// describe the blocks just decoded. *index_size receives its full length.
+static int DecodeXzIndex(Decoder* d, unsigned long long blocks, unsigned long long unpadded_sum,
+                         unsigned long long uncompressed_sum, unsigned long long* index_size) {
+    unsigned char indicator = 0;
+    unsigned int crc = UpdateCrc32(d, 0, &indicator, 1);
+    unsigned long long size = 1;
+    unsigned long long records = 0;
+    if (!ReadXzVli(d, &records, &crc, &size)) return 0;
+    if (records != blocks) return DecodeFail(d, "Corrupt xz index");
+
+    unsigned long long listed_unpadded = 0, listed_uncompressed = 0;
+    for (unsigned long long i = 0; i < records; i++) {
+        unsigned long long unpadded, uncompressed;
+        if (!ReadXzVli(d, &unpadded, &crc, &size) || !ReadXzVli(d, &uncompressed, &crc, &size)) return 0;
+        listed_unpadded += unpadded;
+        listed_uncompressed += uncompressed;
+    }
+    if (listed_unpadded != unpadded_sum || listed_uncompressed != uncompressed_sum) {
+        return DecodeFail(d, "Corrupt xz index");
+    }
+
+    for (; size & 3; size++) {
+        unsigned char pad = 0;
+        if (ReadByte(d) != 0) return DecodeFail(d, "Corrupt xz index");
+        crc = UpdateCrc32(d, crc, &pad, 1);
+    }
+    unsigned int stored_crc;
+    if (!ReadLE32(d, &stored_crc)) return 0;
+    if (stored_crc != crc) return DecodeFail(d, "Corrupt xz index");
+
+    *index_size = size + 4;
+    return 1;
+}
+
+// One stream: header, blocks, index and footer
+static int DecodeXzStream(Decoder* d, XzDecoder* x) {
+    static const unsigned char magic[6] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+    unsigned char header[12];
+    if (!ReadInput(d, header, sizeof(header))) return 0;
+    if (memcmp(header, magic, sizeof(magic)) != 0) return DecodeFail(d, "Not an xz stream");
+
+    unsigned int stored_crc = (unsigned int)header[8] | ((unsigned int)header[9] << 8) |
+                              ((unsigned int)header[10] << 16) | ((unsigned int)header[11] << 24);
+    if (UpdateCrc32(d, 0, header + 6, 2) != stored_crc) return DecodeFail(d, "Corrupt xz stream header");
+    if (header[6] != 0 || header[7] > 0x0F) return DecodeFail(d, "Unsupported xz stream flags");
+    x->check_type = header[7];
+
+    unsigned long long blocks = 0, unpadded_sum = 0, uncompressed_sum = 0;
+    for (;;) {
+        int size_byte = ReadByte(d);
+        if (size_byte < 0) return DecodeFail(d, "Compressed data is truncated");
+        if (size_byte == 0) break;
+        if (!DecodeXzBlock(d, x, (unsigned int)size_byte, &unpadded_sum, &uncompressed_sum)) return 0;
+        blocks++;
+    }
+
+    unsigned long long index_size = 0;
+    if (!DecodeXzIndex(d, blocks, unpadded_sum, uncompressed_sum, &index_size)) return 0;
+
+    // Footer: CRC-32, backward size, the same flags, "YZ"
+    unsigned char footer[12];
+    if (!ReadInput(d, footer, sizeof(footer))) return 0;
+    stored_crc = (unsigned int)footer[0] | ((unsigned int)footer[1] << 8) |
+                 ((unsigned int)footer[2] << 16) | ((unsigned int)footer[3] << 24);
+    unsigned long long backward = (unsigned long long)footer[4] | ((unsigned long long)footer[5] << 8) |
+                                  ((unsigned long long)footer[6] << 16) | ((unsigned long long)footer[7] << 24);
+    if (UpdateCrc32(d, 0, footer + 4, 6) != stored_crc || footer[10] != 'Y' || footer[11] != 'Z' ||
+        memcmp(footer + 8, header + 6, 2) != 0 || (backward + 1) * 4 != index_size) {
+        return DecodeFail(d, "Corrupt xz stream footer");
+    }
+    return 1;
+}
+
+// xz file: streams separated by zero padding in multiples of four bytes
+static int DecodeXz(Decoder* d) {
+    XzDecoder* x = (XzDecoder*)SafeCalloc(1, sizeof(XzDecoder));
+    InitCrcTable(d);
+    InitCrc64Table(x);
+
+    int ok = DecodeXzStream(d, x);
+    while (ok) {
+        size_t padding = 0;
+        while (FillInput(d) && d->in[d->in_pos] == 0) {
+            d->in_pos++;
+            padding++;
+        }
+        if (d->failed) {
+            ok = 0;
+        } else if (padding & 3) {
+            ok = DecodeFail(d, "Corrupt xz stream padding");
+        } else if (!FillInput(d)) {
+            break;
+        } else {
+            ok = DecodeXzStream(d, x);
+        }
+    }
+
+    free(x->dict.data);
+    free(x);
+    return ok && !d->failed;
+}
+
+// ---------------------------------------------------------------------------
+// bzip2 (Burrows-Wheeler blocks, as used by REPLACE_BZ payload operations)
+// ---------------------------------------------------------------------------
+
+// Tree for one of up to six Huffman tables of a block
+typedef struct {
+    int limit[BZ_MAX_CODE_BITS + 1];            // Largest code of each length, -1 if none
+    int first_code[BZ_MAX_CODE_BITS + 1];
+    int first_index[BZ_MAX_CODE_BITS + 1];
+    unsigned short perm[BZ_MAX_SYMBOLS];        // Symbols ordered by code
+    int min_len;
+    int max_len;
+} BzHuffman;
+
+// Block decoding state
+typedef struct {
+    unsigned long long bits;                    // Bit reader, MSB first
+    int bit_count;
+
+    unsigned int* tt;                           // Block bytes, then the inverse BWT links
+    unsigned int block_max;                     // Block size limit from the stream header
+
+    unsigned int crc_table[256];                // MSB-first CRC-32 (poly 0x04C11DB7)
+    unsigned int block_crc;
+
+    unsigned char selectors[BZ_MAX_SELECTORS];
+    BzHuffman tables[BZ_MAX_TABLES];
+
+    unsigned char out[OUTPUT_STEP];
+    size_t out_len;
+} BzDecoder;
+
+// Have at least n (<= 32) bits buffered; 0 at end of input
+static int BzNeedBits(Decoder* d, BzDecoder* b, int n) {
+    while (b->bit_count < n) {
+        if (!FillInput(d)) return 0;
+        b->bits = (b->bits << 8) | d->in[d->in_pos++];
+        b->bit_count += 8;
+    }
+    return 1;
+}
+
+// Read n (<= 32) bits
+static int BzGetBits(Decoder* d, BzDecoder* b, int n, unsigned int* value) {
+    if (!BzNeedBits(d, b, n)) return DecodeFail(d, "Compressed data is truncated");
+    b->bit_count -= n;
+    *value = (unsigned int)(b->bits >> b->bit_count) & (unsigned int)((1ULL << n) - 1);
+    return 1;
+}
+
+// Build the decoding table from code lengths
+static int BzBuildHuffman(BzHuffman* h, const unsigned char* lengths, int n) {
+    int count[BZ_MAX_CODE_BITS + 1] = {0};
+    h->min_len = BZ_MAX_CODE_BITS;
+    h->max_len = 0;
+    for (int i = 0; i < n; i++) {
+        count[lengths[i]]++;
+        if (lengths[i] < h->min_len) h->min_len = lengths[i];
+        if (lengths[i] > h->max_len) h->max_len = lengths[i];
+    }
+
+    int code = 0, index = 0;
+    for (int len = 1; len <= BZ_MAX_CODE_BITS; len++) {
+        h->first_code[len] = code;
+        h->first_index[len] = index;
+        for (int i = 0; i < n; i++) {
+            if (lengths[i] == len) h->perm[index++] = (unsigned short)i;
+        }
+        code += count[len];
+        h->limit[len] = code - 1;
+        if (code > (1 << len)) return 0;
+        code <<= 1;
+    }
+    return 1;
+}
+
+// Decode one symbol; -1 on invalid or truncated input
+static int BzDecodeSymbol(Decoder* d, BzDecoder* b, const BzHuffman* h) {
+    // Peek max_len bits, padding with zeros at the very end of the input
+    BzNeedBits(d, b, h->max_len);
+    unsigned int peek;
+    if (b->bit_count >= h->max_len) {
+        peek = (unsigned int)(b->bits >> (b->bit_count - h->max_len)) & ((1u << h->max_len) - 1);
+    } else {
+        peek = (unsigned int)(b->bits << (h->max_len - b->bit_count)) & ((1u << h->max_len) - 1);
+    }
+
+    for (int len = h->min_len; len <= h->max_len; len++) {
+        int code = (int)(peek >> (h->max_len - len));
+        if (code <= h->limit[len]) {
+            if (len > b->bit_count) {
+                DecodeFail(d, "Compressed data is truncated");
+                return -1;
+            }
+            b->bit_count -= len;
+            return h->perm[h->first_index[len] + code - h->first_code[len]];
+        }
+    }
+    DecodeFail(d, "Corrupt compressed data (bad bzip2 code)");
+    return -1;
+}
+
+// Hand buffered output on, folding it into the block CRC
+static int BzFlush(Decoder* d, BzDecoder* b) {
+    unsigned int crc = b->block_crc;
+    for (size_t i = 0; i < b->out_len; i++) crc = (crc << 8) ^ b->crc_table[(crc >> 24) ^ b->out[i]];
+    b->block_crc = crc;
+
+    size_t len = b->out_len;
+    b->out_len = 0;
+    if (len > 0 && !d->write(b->out, len, d->write_data)) return DecodeFail(d, "Writing decompressed data failed");
+    return 1;
+}
+
+// Append `count` copies of a byte
+static int BzPut(Decoder* d, BzDecoder* b, unsigned char byte, unsigned int count) {
+    while (count > 0) {
+        if (b->out_len == sizeof(b->out) && !BzFlush(d, b)) return 0;
+        size_t chunk = sizeof(b->out) - b->out_len;
+        if (chunk > count) chunk = count;
+        memset(b->out + b->out_len, byte, chunk);
+        b->out_len += chunk;
+        count -= (unsigned int)chunk;
+    }
+    return 1;
+}
+
+// Symbol tables of a block: used bytes, selectors and the Huffman code lengths
+static int BzReadTables(Decoder* d, BzDecoder* b, unsigned char* seq_to_byte, int* in_use,
+                        int* table_count, unsigned int* selector_count) {
+    unsigned int used_map, bits;
+    if (!BzGetBits(d, b, 16, &used_map)) return 0;
+    *in_use = 0;
+    for (int i = 0; i < 16; i++) {
+        if (!(used_map & (0x8000u >> i))) continue;
+        if (!BzGetBits(d, b, 16, &bits)) return 0;
+        for (int j = 0; j < 16; j++) {
+            if (bits & (0x8000u >> j)) seq_to_byte[(*in_use)++] = (unsigned char)(i * 16 + j);
+        }
+    }
+    if (*in_use == 0) return DecodeFail(d, "Corrupt bzip2 block (no symbols)");
+
+    unsigned int groups, selectors;
+    if (!BzGetBits(d, b, 3, &groups) || !BzGetBits(d, b, 15, &selectors)) return 0;
+    if (groups < 2 || groups > BZ_MAX_TABLES || selectors == 0) return DecodeFail(d, "Corrupt bzip2 block header");
+
+    // Selectors: unary table numbers, move-to-front coded. Ones past the
+    // limit cannot be used by a valid block and are read and dropped.
+    unsigned char mtf[BZ_MAX_TABLES];
+    for (unsigned int i = 0; i < groups; i++) mtf[i] = (unsigned char)i;
+    for (unsigned int i = 0; i < selectors; i++) {
+        unsigned int j = 0;
+        for (;;) {
+            if (!BzGetBits(d, b, 1, &bits)) return 0;
+            if (!bits) break;
+            if (++j >= groups) return DecodeFail(d, "Corrupt bzip2 selector");
+        }
+        unsigned char table = mtf[j];
+        for (; j > 0; j--) mtf[j] = mtf[j - 1];
+        mtf[0] = table;
+        if (i < BZ_MAX_SELECTORS) b->selectors[i] = table;
+    }
+    if (selectors > BZ_MAX_SELECTORS) selectors = BZ_MAX_SELECTORS;
+
+    // Code lengths, delta coded per symbol
+    int symbols = *in_use + 2;
+    for (unsigned int t = 0; t < groups; t++) {
+        unsigned char lengths[BZ_MAX_SYMBOLS];
+        unsigned int len;
+        if (!BzGetBits(d, b, 5, &len)) return 0;
+        for (int s = 0; s < symbols; s++) {
+            for (;;) {
+                if (len < 1 || len > BZ_MAX_CODE_BITS) return DecodeFail(d, "Corrupt bzip2 code lengths");
+                if (!BzGetBits(d, b, 1, &bits)) return 0;
+                if (!bits) break;
+                if (!BzGetBits(d, b, 1, &bits)) return 0;
+                len = bits ? len - 1 : len + 1;
+            }
+            lengths[s] = (unsigned char)len;
+        }
+        if (!BzBuildHuffman(&b->tables[t], lengths, symbols)) return DecodeFail(d, "Corrupt bzip2 code lengths");
+    }
+
+    *table_count = (int)groups;
+    *selector_count = selectors;
+    return 1;
+}
+
+// One block after its magic: symbols, inverse BWT, then the initial run-length pass
+static int DecodeBzBlock(Decoder* d, BzDecoder* b, unsigned int* combined_crc) {
+    unsigned int stored_crc, randomised, orig_ptr;
+    if (!BzGetBits(d, b, 32, &stored_crc) || !BzGetBits(d, b, 1, &randomised) ||
+        !BzGetBits(d, b, 24, &orig_ptr)) {
+        return 0;
+    }
+    if (randomised) return DecodeFail(d, "Unsupported bzip2 block (randomised)");
+
+    unsigned char seq_to_byte[256];
+    int in_use, groups;
+    unsigned int selectors;
+    if (!BzReadTables(d, b, seq_to_byte, &in_use, &groups, &selectors)) return 0;
+
+    // Symbols: RUNA/RUNB zero runs, move-to-front indexes and end of block
+    unsigned char mtf[256];
+    for (int i = 0; i < 256; i++) mtf[i] = (unsigned char)i;
+    unsigned int byte_count[256] = {0};
+    unsigned int length = 0;
+    unsigned int run = 0, run_weight = 1;
+    unsigned int group = 0, group_left = 0;
+    const BzHuffman* table = NULL;
+    int end_symbol = in_use + 1;
+
+    for (;;) {
+        if (group_left == 0) {
+            if (group >= selectors) return DecodeFail(d, "Corrupt bzip2 block (selectors exhausted)");
+            table = &b->tables[b->selectors[group++]];
+            group_left = BZ_GROUP_SIZE;
+        }
+        group_left--;
+
+        int symbol = BzDecodeSymbol(d, b, table);
+        if (symbol < 0) return 0;
+        if (symbol <= 1) {
+            // RUNA adds one times the weight, RUNB two; weights double
+            if (run_weight > b->block_max) return DecodeFail(d, "Corrupt bzip2 block (run too long)");
+            run += run_weight << symbol;
+            run_weight <<= 1;
+            continue;
+        }
+
+        if (run > 0) {
+            if (run > b->block_max - length) return DecodeFail(d, "Corrupt bzip2 block (too long)");
+            unsigned char byte = seq_to_byte[mtf[0]];
+            byte_count[byte] += run;
+            while (run > 0) {
+                b->tt[length++] = byte;
+                run--;
+            }
+            run_weight = 1;
+        }
+        if (symbol == end_symbol) break;
+
+        if (length >= b->block_max) return DecodeFail(d, "Corrupt bzip2 block (too long)");
+        int index = symbol - 1;
+        unsigned char seq = mtf[index];
+        memmove(mtf + 1, mtf, (size_t)index);
+        mtf[0] = seq;
+        unsigned char byte = seq_to_byte[seq];
+        byte_count[byte]++;
+        b->tt[length++] = byte;
+    }
+    if (orig_ptr >= length) return DecodeFail(d, "Corrupt bzip2 block (bad origin)");
+
+    // Inverse BWT: link each position to the next one in the original order
+    unsigned int start[256];
+    unsigned int sum = 0;
+    for (int i = 0; i < 256; i++) {
+        start[i] = sum;
+        sum += byte_count[i];
+    }
+    for (unsigned int i = 0; i < length; i++) {
+        unsigned char byte = (unsigned char)(b->tt[i] & 0xFF);
+        b->tt[start[byte]++] |= i << 8;
+    }
+
+    // Walk the links, undoing the run-length pass: four equal bytes are
+    // followed by a count of further repeats
+    b->block_crc = 0xFFFFFFFFu;
+    unsigned int pos = b->tt[orig_ptr] >> 8;
+    int last = -1, repeats = 0;
+    for (unsigned int i = 0; i < length; i++) {
+        unsigned int entry = b->tt[pos];
+        unsigned char byte = (unsigned char)(entry & 0xFF);
+        pos = entry >> 8;
+
+        if (repeats == 4) {
+            if (!BzPut(d, b, (unsigned char)last, byte)) return 0;
+            repeats = 0;
+            continue;
+        }
+        if (b->out_len == sizeof(b->out) && !BzFlush(d, b)) return 0;
+        b->out[b->out_len++] = byte;
+        if (repeats > 0 && byte == last) {
+            repeats++;
+        } else {
+            repeats = 1;
+            last = byte;
+        }
+    }
+    if (!BzFlush(d, b)) return 0;
+
+    b->block_crc = ~b->block_crc;
+    if (b->block_crc != stored_crc) return DecodeFail(d, "bzip2 block CRC mismatch");
+    *combined_crc = ((*combined_crc << 1) | (*combined_crc >> 31)) ^ b->block_crc;
+    return 1;
+}
+
+// One stream: "BZh<level>", blocks, end marker with the combined CRC
+static int DecodeBzStream(Decoder* d, BzDecoder* b) {
+    unsigned int magic, level;
+    if (!BzGetBits(d, b, 24, &magic) || !BzGetBits(d, b, 8, &level)) return 0;
+    if (magic != 0x425A68 || level < '1' || level > '9') return DecodeFail(d, "Not a bzip2 stream");
+
+    unsigned int block_max = (level - '0') * 100000;
+    if (block_max > b->block_max) {
+        free(b->tt);
+        b->tt = (unsigned int*)SafeMalloc(block_max * sizeof(unsigned int));
+        b->block_max = block_max;
+    }
+
+    unsigned int combined = 0;
+    for (;;) {
+        unsigned int high, low;
+        if (!BzGetBits(d, b, 24, &high) || !BzGetBits(d, b, 24, &low)) return 0;
+        if (high == 0x314159 && low == 0x265359) {
+            if (!DecodeBzBlock(d, b, &combined)) return 0;
+        } else if (high == 0x177245 && low == 0x385090) {
+            unsigned int stored;
+            if (!BzGetBits(d, b, 32, &stored)) return 0;
+            if (stored != combined) return DecodeFail(d, "bzip2 stream CRC mismatch");
+            break;
+        } else {
+            return DecodeFail(d, "Corrupt bzip2 block magic");
+        }
+    }
+
+    // Streams end on a byte boundary
+    b->bit_count -= b->bit_count & 7;
+    return 1;
+}
+
+// bzip2 file, possibly several concatenated streams
+static int DecodeBzip2(Decoder* d) {
+    BzDecoder* b = (BzDecoder*)SafeCalloc(1, sizeof(BzDecoder));
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned int c = i << 24;
+        for (int k = 0; k < 8; k++) c = (c & 0x80000000u) ? (c << 1) ^ 0x04C11DB7u : c << 1;
+        b->crc_table[i] = c;
+    }
+
+    int ok = DecodeBzStream(d, b);
+    while (ok && (b->bit_count > 0 || FillInput(d))) {
+        ok = DecodeBzStream(d, b);
+    }
+
+    free(b->tt);
+    free(b);
+    return ok && !d->failed;
+}
+
+// ---------------------------------------------------------------------------
+
+// Pass input through unchanged
+static int CopyStream(Decoder* d) {
+    while (FillInput(d)) {
+        if (!d->write(d->in + d->in_pos, d->in_len - d->in_pos, d->write_data)) {
+            return DecodeFail(d, "Writing decompressed data failed");
+        }
+        d->in_pos = d->in_len;
+    }
+    return !d->failed;
+}
+
+// Decode a whole stream through the callbacks
+int DecompressStream(CompressionFormat format, DecompressReadFn read, void* read_data,
+                     DecompressWriteFn write, void* write_data, char* error, size_t error_size) {
+    if (!read || !write) return 0;
+    if (error && error_size > 0) error[0] = '\0';
+
+    Decoder* d = (Decoder*)SafeCalloc(1, sizeof(Decoder));
+    d->read = read;
+    d->read_data = read_data;
+    d->write = write;
+    d->write_data = write_data;
+    d->error = error;
+    d->error_size = error_size;
+    d->in = (unsigned char*)SafeMalloc(INPUT_BUFFER_SIZE);
+
+    int ok;
+    if (format == COMPRESSION_NONE) {
+        ok = CopyStream(d);
+    } else {
+        d->out = (unsigned char*)SafeMalloc(OUTPUT_HISTORY + OUTPUT_FLUSH);
+        if (format == COMPRESSION_GZIP) {
+            ok = DecodeGzip(d);
+        } else if (format == COMPRESSION_DEFLATE) {
+            ok = DecodeDeflate(d);
+        } else if (format == COMPRESSION_XZ) {
+            ok = DecodeXz(d);
+        } else if (format == COMPRESSION_BZIP2) {
+            ok = DecodeBzip2(d);
+        } else {
+            ok = DecodeLz4(d);
+        }
+        if (ok) ok = FlushOutput(d);
+    }
+
+    free(d->in);
+    free(d->out);
+    free(d);
+    return ok;
+}
+
+// Recognize a format by its magic bytes
+CompressionFormat DetectCompression(const unsigned char* data, size_t len) {
+    if (len >= 2 && data[0] == 0x1F && data[1] == 0x8B) return COMPRESSION_GZIP;
+    if (len >= 4 && data[1] == 0x22 && data[2] == 0x4D && data[3] == 0x18 && data[0] == 0x04) return COMPRESSION_LZ4;
+    if (len >= 4 && data[1] == 0x21 && data[2] == 0x4C && data[3] == 0x18 && data[0] == 0x02) return COMPRESSION_LZ4;
+    if (len >= 6 && memcmp(data, "\xFD" "7zXZ" "\x00", 6) == 0) return COMPRESSION_XZ;
+    if (len >= 4 && memcmp(data, "BZh", 3) == 0 && data[3] >= '1' && data[3] <= '9') return COMPRESSION_BZIP2;
+    return COMPRESSION_NONE;
+}
+
+// Name for messages
+const char* CompressionName(CompressionFormat format) {
+    switch (format) {
+        case COMPRESSION_GZIP: return "gzip";
+        case COMPRESSION_LZ4:  return "lz4";
+        case COMPRESSION_DEFLATE: return "deflate";
+        case COMPRESSION_XZ:   return "xz";
+        case COMPRESSION_BZIP2: return "bzip2";
+        default:               return "none";
+    }
+}
@@ -1,71 +1,596 @@
 #include "device_manager.h"
 #include "adb_wrapper.h"
 #include "fastboot_wrapper.h"
+#include "fastboot_client.h"
+#include "adb_client.h"
+#include "shell_session.h"
+#include "prop_cache.h"
+#include "fastboot_var_cache.h"
 #include "utils.h"
 #include <stdio.h>
 #include <time.h>
 
-// Refresh device list from ADB
-int RefreshDeviceList(AppState* state) {
-    if (!state) return 0;
+// ============================================================================
+// Device Registry
+// ============================================================================
+
+#define DEVICE_LIST_MIN_CAPACITY 16
+
+// Refcounted so unchanged devices are shared by consecutive snapshots, and a
+// device a command looked up outlives the snapshot it came from. Writers count
+// under the snapshot write lock, holders from their own threads.
+struct DeviceRecord {
+    volatile LONG refs;
+    AdbDevice device;
+};
+
+// Records one thread's lookups keep alive until ReleaseDeviceHolds
+typedef struct {
+    DeviceRecord** records;
+    int count;
+    int capacity;
+} DeviceHolds;
+
+// Map an adb/fastboot status string to the compact state
+static DeviceState ParseDeviceState(const char* status) {
+    if (strcmp(status, "device") == 0 || strcmp(status, "fastboot") == 0) return DEVICE_STATE_ONLINE;
+    if (strcmp(status, "offline") == 0) return DEVICE_STATE_OFFLINE;
+    if (strcmp(status, "unauthorized") == 0) return DEVICE_STATE_UNAUTHORIZED;
+    return DEVICE_STATE_OTHER;
+}
+
+// Drop one reference to a record
+static void ReleaseDeviceRecord(DeviceRecord* record) {
+    if (record && InterlockedDecrement(&record->refs) == 0) {
+        free(record);
+    }
+}
+
+// Rebuild the serial index after the list changed size or order
+static void RebuildDeviceIndex(DeviceList* list) {
+    int index_capacity = DEVICE_LIST_MIN_CAPACITY * 2;
+    while (index_capacity < list->count * 2) index_capacity *= 2;
+
+    if (index_capacity != list->index_capacity) {
+        free(list->index);
+        list->index = (int*)SafeMalloc(index_capacity * sizeof(int));
+        list->index_capacity = index_capacity;
+    }
+    memset(list->index, 0xFF, index_capacity * sizeof(int));
+
+    int mask = index_capacity - 1;
+    for (int i = 0; i < list->count; i++) {
+        int slot = (int)(list->summaries[i].serial_hash & (unsigned int)mask);
+        while (list->index[slot] >= 0) slot = (slot + 1) & mask;
+        list->index[slot] = i;
+    }
+}
+
+// Make room for at least `needed` devices
+static void ReserveDeviceList(DeviceList* list, int needed) {
+    if (needed <= list->capacity) return;
+
+    int capacity = list->capacity > 0 ? list->capacity : DEVICE_LIST_MIN_CAPACITY;
+    while (capacity < needed) capacity *= 2;
+
+    list->summaries = (DeviceSummary*)SafeRealloc(list->summaries, capacity * sizeof(DeviceSummary));
+    list->records = (DeviceRecord**)SafeRealloc(list->records, capacity * sizeof(DeviceRecord*));
+    list->capacity = capacity;
+}
+
+// Release a list's records and arrays
+static void FreeDeviceList(DeviceList* list) {
+    for (int i = 0; i < list->count; i++) {
+        ReleaseDeviceRecord(list->records[i]);
+    }
+    SAFE_FREE(list->summaries);
+    SAFE_FREE(list->records);
+    SAFE_FREE(list->index);
+    list->count = 0;
+    list->capacity = 0;
+    list->index_capacity = 0;
+}
+
+// Copy a list for a write transaction; records are shared, not duplicated
+static void CopyDeviceList(DeviceList* dst, const DeviceList* src) {
+    memset(dst, 0, sizeof(DeviceList));
+    ReserveDeviceList(dst, src->count);
+
+    if (src->count > 0) {
+        memcpy(dst->summaries, src->summaries, src->count * sizeof(DeviceSummary));
+        memcpy(dst->records, src->records, src->count * sizeof(DeviceRecord*));
+    }
+    for (int i = 0; i < src->count; i++) {
+        InterlockedIncrement(&dst->records[i]->refs);
+    }
+    dst->count = src->count;
+
+    if (src->index_capacity > 0) {
+        dst->index = (int*)SafeMalloc(src->index_capacity * sizeof(int));
+        memcpy(dst->index, src->index, src->index_capacity * sizeof(int));
+        dst->index_capacity = src->index_capacity;
+    } else {
+        RebuildDeviceIndex(dst);
+    }
+}
+
+// Replace a list's contents, reusing the records of devices whose data is unchanged
+static void AssignDeviceList(DeviceList* list, const AdbDevice* devices, int count, OperationMode mode) {
+    DeviceList updated;
+    memset(&updated, 0, sizeof(updated));
+    ReserveDeviceList(&updated, count);
+
+    for (int i = 0; i < count; i++) {
+        int old = DeviceListFind(list, devices[i].serial_id);
+        DeviceRecord* record;
+        if (old >= 0 && memcmp(&list->records[old]->device, &devices[i], sizeof(AdbDevice)) == 0) {
+            record = list->records[old];
+            InterlockedIncrement(&record->refs);
+        } else {
+            record = (DeviceRecord*)SafeMalloc(sizeof(DeviceRecord));
+            record->refs = 1;
+            memcpy(&record->device, &devices[i], sizeof(AdbDevice));
+        }
+
+        updated.records[i] = record;
+        updated.summaries[i].serial_hash = HashString(devices[i].serial_id);
+        updated.summaries[i].state = (unsigned char)ParseDeviceState(devices[i].status);
+        updated.summaries[i].mode = (unsigned char)mode;
+    }
+    updated.count = count;
+    RebuildDeviceIndex(&updated);
+
+    FreeDeviceList(list);
+    *list = updated;
+}
+
+// Writable copy of one device; clones the record if another snapshot shares it
+static AdbDevice* MutableDeviceAt(DeviceList* list, int index) {
+    DeviceRecord* record = list->records[index];
+    if (record->refs > 1) {
+        DeviceRecord* clone = (DeviceRecord*)SafeMalloc(sizeof(DeviceRecord));
+        clone->refs = 1;
+        memcpy(&clone->device, &record->device, sizeof(AdbDevice));
+        // A holder may drop its reference meanwhile, so this can be the last one
+        ReleaseDeviceRecord(record);
+        list->records[index] = clone;
+        record = clone;
+    }
+    return &record->device;
+}
+
+// Compare two lists by content
+static int DeviceListsEqual(const DeviceList* a, const DeviceList* b) {
+    if (a->count != b->count) return 0;
+
+    for (int i = 0; i < a->count; i++) {
+        if (a->records[i] != b->records[i] &&
+            memcmp(&a->records[i]->device, &b->records[i]->device, sizeof(AdbDevice)) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Get a device by position
+const AdbDevice* DeviceListAt(const DeviceList* list, int index) {
+    if (!list || index < 0 || index >= list->count) return NULL;
+    return &list->records[index]->device;
+}
+
+// Find a device's position by serial (-1 if absent)
+int DeviceListFind(const DeviceList* list, const char* serial) {
+    if (!list || !serial || list->count == 0 || list->index_capacity == 0) return -1;
+
+    unsigned int hash = HashString(serial);
+    int mask = list->index_capacity - 1;
+    int slot = (int)(hash & (unsigned int)mask);
+
+    while (list->index[slot] >= 0) {
+        int position = list->index[slot];
+        if (list->summaries[position].serial_hash == hash &&
+            strcmp(list->records[position]->device.serial_id, serial) == 0) {
+            return position;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+// Parse a devices listing into a heap array sized from its line count
+static AdbDevice* ParseDeviceOutput(const char* output, OperationMode mode, int* count_out) {
+    int lines = 1;
+    for (const char* p = output ? output : ""; *p; p++) {
+        if (*p == '\n') lines++;
+    }
+
+    AdbDevice* devices = (AdbDevice*)SafeCalloc(lines, sizeof(AdbDevice));
+    *count_out = (mode == MODE_FASTBOOT)
+        ? ParseFastbootDeviceList(output, devices, lines)
+        : ParseDeviceList(output, devices, lines);
+    return devices;
+}
+
+// ============================================================================
+// Device Snapshots
+// ============================================================================
+
+// Concurrent readers that can pin snapshots at once (CLI, monitor, workers)
+#define MAX_SNAPSHOT_READERS 32
+
+// Published snapshot plus epoch-based reclamation state. Readers announce the
+// epoch they started in; a superseded snapshot is freed once every announced
+// epoch is at least the epoch in which it was retired.
+struct DeviceStore {
+    DeviceSnapshot* volatile current;
+    SRWLOCK write_lock;                                      // Serializes writers only
+    volatile LONG64 epoch;                                   // Bumped on every publish
+    volatile LONG64 reader_epochs[MAX_SNAPSHOT_READERS];     // 0 = slot free
+    DeviceSnapshot* retired;                                 // Guarded by write_lock
+    DWORD pin_tls;                                           // Per thread: the snapshot it has pinned
+    DWORD hold_tls;                                          // Per thread: DeviceHolds
+};
+
+// Release a snapshot and its references (caller holds the write lock)
+static void FreeSnapshot(DeviceSnapshot* snapshot) {
+    FreeDeviceList(&snapshot->adb);
+    FreeDeviceList(&snapshot->fastboot);
+    free(snapshot);
+}
+
+// Free retired snapshots that no active reader can still see (caller holds the write lock)
+static void ReclaimRetiredSnapshots(struct DeviceStore* store) {
+    LONG64 oldest_reader = 0;
+    for (int i = 0; i < MAX_SNAPSHOT_READERS; i++) {
+        LONG64 reader = store->reader_epochs[i];
+        if (reader != 0 && (oldest_reader == 0 || reader < oldest_reader)) {
+            oldest_reader = reader;
+        }
+    }
+
+    DeviceSnapshot** link = &store->retired;
+    while (*link) {
+        DeviceSnapshot* snapshot = *link;
+        if (oldest_reader == 0 || snapshot->retire_epoch <= oldest_reader) {
+            *link = snapshot->next_retired;
+            FreeSnapshot(snapshot);
+        } else {
+            link = &snapshot->next_retired;
+        }
+    }
+}
+
+// Create the store with an empty snapshot (nothing selected, ADB mode)
+void InitDeviceSnapshots(AppState* state) {
+    if (!state || state->device_store) return;
+
+    struct DeviceStore* store = (struct DeviceStore*)SafeCalloc(1, sizeof(struct DeviceStore));
+    InitializeSRWLock(&store->write_lock);
+    store->epoch = 1;
+    store->pin_tls = TlsAlloc();
+    store->hold_tls = TlsAlloc();
+
+    DeviceSnapshot* snapshot = (DeviceSnapshot*)SafeCalloc(1, sizeof(DeviceSnapshot));
+    snapshot->version = 1;
+    snapshot->current_device_index = -1;
+    snapshot->current_fastboot_device_index = -1;
+    snapshot->current_mode = MODE_ADB;
+    store->current = snapshot;
+
+    state->device_store = store;
+}
+
+// Release every snapshot (on exit, after the monitor thread has stopped)
+void FreeDeviceSnapshots(AppState* state) {
+    if (!state || !state->device_store) return;
+
+    struct DeviceStore* store = state->device_store;
+    AcquireSRWLockExclusive(&store->write_lock);
+    while (store->retired) {
+        DeviceSnapshot* next = store->retired->next_retired;
+        FreeSnapshot(store->retired);
+        store->retired = next;
+    }
+    FreeSnapshot((DeviceSnapshot*)store->current);
+    store->current = NULL;
+    ReleaseSRWLockExclusive(&store->write_lock);
+
+    if (store->pin_tls != TLS_OUT_OF_INDEXES) TlsFree(store->pin_tls);
+    if (store->hold_tls != TLS_OUT_OF_INDEXES) TlsFree(store->hold_tls);
+    free(store);
+    state->device_store = NULL;
+}
+
+// Pin the current snapshot; never blocks on writers. Reads nested inside a pin
+// on the same thread get the snapshot already pinned, so one command sees one view.
+const DeviceSnapshot* BeginSnapshotRead(const AppState* state, SnapshotGuard* guard) {
+    guard->slot = -1;
+    if (!state || !state->device_store) return NULL;
+
+    struct DeviceStore* store = state->device_store;
+    const DeviceSnapshot* pinned = (const DeviceSnapshot*)TlsGetValue(store->pin_tls);
+    if (pinned) return pinned;
+
+    while (guard->slot < 0) {
+        LONG64 epoch = store->epoch;
+        for (int i = 0; i < MAX_SNAPSHOT_READERS; i++) {
+            if (store->reader_epochs[i] == 0 &&
+                InterlockedCompareExchange64(&store->reader_epochs[i], epoch, 0) == 0) {
+                guard->slot = i;
+                break;
+            }
+        }
+        if (guard->slot < 0) {
+            // Every slot is pinned; readers are short-lived, so just retry
+            Sleep(0);
+        }
+    }
+
+    // The announcement above is a full barrier, so this load cannot be reclaimed under us
+    pinned = (const DeviceSnapshot*)store->current;
+    TlsSetValue(store->pin_tls, (LPVOID)pinned);
+    return pinned;
+}
+
+// Unpin a snapshot taken with BeginSnapshotRead (nested reads have nothing to unpin)
+void EndSnapshotRead(const AppState* state, SnapshotGuard* guard) {
+    if (!state || !state->device_store || guard->slot < 0) return;
+
+    TlsSetValue(state->device_store->pin_tls, NULL);
+    InterlockedExchange64(&state->device_store->reader_epochs[guard->slot], 0);
+    guard->slot = -1;
+}
+
+// Start a write transaction: lock out other writers and return a private copy
+static DeviceSnapshot* BeginSnapshotWrite(AppState* state) {
+    if (!state || !state->device_store) return NULL;
+
+    struct DeviceStore* store = state->device_store;
+    AcquireSRWLockExclusive(&store->write_lock);
+
+    const DeviceSnapshot* current = (const DeviceSnapshot*)store->current;
+    DeviceSnapshot* draft = (DeviceSnapshot*)SafeCalloc(1, sizeof(DeviceSnapshot));
+    draft->version = current->version;
+    CopyDeviceList(&draft->adb, &current->adb);
+    CopyDeviceList(&draft->fastboot, &current->fastboot);
+    draft->current_device_index = current->current_device_index;
+    draft->current_fastboot_device_index = current->current_fastboot_device_index;
+    draft->current_mode = current->current_mode;
+    return draft;
+}
+
+// Finish a write transaction: publish the draft if anything changed
+static void CommitSnapshotWrite(AppState* state, DeviceSnapshot* draft) {
+    if (!draft) return;
+
+    struct DeviceStore* store = state->device_store;
+    DeviceSnapshot* current = (DeviceSnapshot*)store->current;
+
+    // Compare only the published content, not the version or bookkeeping
+    if (draft->current_device_index == current->current_device_index &&
+        draft->current_fastboot_device_index == current->current_fastboot_device_index &&
+        draft->current_mode == current->current_mode &&
+        DeviceListsEqual(&draft->adb, &current->adb) &&
+        DeviceListsEqual(&draft->fastboot, &current->fastboot)) {
+        FreeSnapshot(draft);
+        ReleaseSRWLockExclusive(&store->write_lock);
+        return;
+    }
+
+    draft->version = current->version + 1;
+    InterlockedExchangePointer((PVOID volatile*)&store->current, draft);
+
+    // A thread that writes inside its own pin reads its write back; the draft
+    // is published after the pin's epoch, so it is not reclaimed before the unpin
+    if (TlsGetValue(store->pin_tls)) TlsSetValue(store->pin_tls, draft);
+
+    // Readers announcing this epoch or later can only have seen the new snapshot
+    current->retire_epoch = InterlockedIncrement64(&store->epoch);
+    current->next_retired = store->retired;
+    store->retired = current;
+    ReclaimRetiredSnapshots(store);
+
+    ReleaseSRWLockExclusive(&store->write_lock);
+}
+
+// Abandon a write transaction without publishing
+static void AbortSnapshotWrite(AppState* state, DeviceSnapshot* draft) {
+    if (!draft) return;
+
+    FreeSnapshot(draft);
+    ReleaseSRWLockExclusive(&state->device_store->write_lock);
+}
+
+// Look up the selected device in the newest snapshot (or the one this thread has
+// pinned). Outside a pin the record is held for the thread until
+// ReleaseDeviceHolds, so the pointer survives the snapshot being reclaimed.
+static const AdbDevice* HoldSelectedDevice(const AppState* state, int fastboot) {
+    SnapshotGuard guard;
+    const DeviceSnapshot* snapshot = BeginSnapshotRead(state, &guard);
+    if (!snapshot) return NULL;
+
+    const DeviceList* list = fastboot ? &snapshot->fastboot : &snapshot->adb;
+    int index = fastboot ? snapshot->current_fastboot_device_index : snapshot->current_device_index;
+    const AdbDevice* device = DeviceListAt(list, index);
+    if (device && guard.slot >= 0) {
+        DeviceRecord* record = list->records[index];
+        DeviceHolds* holds = (DeviceHolds*)TlsGetValue(state->device_store->hold_tls);
+        if (!holds) {
+            holds = (DeviceHolds*)SafeCalloc(1, sizeof(DeviceHolds));
+            TlsSetValue(state->device_store->hold_tls, holds);
+        }
+
+        int held = 0;
+        for (int i = 0; i < holds->count && !held; i++) {
+            held = holds->records[i] == record;
+        }
+        if (!held) {
+            if (holds->count == holds->capacity) {
+                holds->capacity = holds->capacity ? holds->capacity * 2 : 4;
+                holds->records = (DeviceRecord**)SafeRealloc(holds->records,
+                                                             holds->capacity * sizeof(DeviceRecord*));
+            }
+            // The pin keeps the snapshot's reference alive while this one is taken
+            InterlockedIncrement(&record->refs);
+            holds->records[holds->count++] = record;
+        }
+    }
+    EndSnapshotRead(state, &guard);
+    return device;
+}
+
+// Drop the devices this thread's lookups held (end of a command)
+void ReleaseDeviceHolds(const AppState* state) {
+    if (!state || !state->device_store) return;
+
+    DeviceHolds* holds = (DeviceHolds*)TlsGetValue(state->device_store->hold_tls);
+    if (!holds) return;
+    for (int i = 0; i < holds->count; i++) {
+        ReleaseDeviceRecord(holds->records[i]);
+    }
+    holds->count = 0;
+}
+
+// Get the current operation mode
+OperationMode GetCurrentMode(const AppState* state) {
+    SnapshotGuard guard;
+    const DeviceSnapshot* snapshot = BeginSnapshotRead(state, &guard);
+    OperationMode mode = snapshot ? snapshot->current_mode : MODE_ADB;
+    EndSnapshotRead(state, &guard);
+    return mode;
+}
+
+// Switch the operation mode
+void SetCurrentMode(AppState* state, OperationMode mode) {
+    DeviceSnapshot* draft = BeginSnapshotWrite(state);
+    if (!draft) return;
+
+    draft->current_mode = mode;
+    CommitSnapshotWrite(state, draft);
+}
+
+// ============================================================================
+// ADB Device Management Functions
+// ============================================================================
+
+// Replace the ADB device list with "devices -l" style output, keeping the selection
+static int ApplyAdbDeviceList(AppState* state, const char* list_output) {
+    // Parse outside the write lock; only the swap happens inside it
+    int count = 0;
+    AdbDevice* parsed = ParseDeviceOutput(list_output, MODE_ADB, &count);
+
+    DeviceSnapshot* draft = BeginSnapshotWrite(state);
+    if (!draft) {
+        free(parsed);
+        return 0;
+    }
 
     // Save current device serial to try to maintain selection
     char saved_serial[256] = "";
-    if (state->current_device_index >= 0 &&
-        state->current_device_index < state->device_count) {
-        strncpy(saved_serial, state->devices[state->current_device_index].serial_id,
-                sizeof(saved_serial) - 1);
+    const AdbDevice* selected = DeviceListAt(&draft->adb, draft->current_device_index);
+    if (selected) {
+        strncpy(saved_serial, selected->serial_id, sizeof(saved_serial) - 1);
     }
 
-    ProcessResult* result = AdbDevices(state->adb_path);
-    if (!result) {
-        PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to get device list");
-        return 0;
+    // Keep the Android version of devices that stay connected
+    for (int i = 0; i < count; i++) {
+        const AdbDevice* old = DeviceListAt(&draft->adb, DeviceListFind(&draft->adb, parsed[i].serial_id));
+        if (old) {
+            memcpy(parsed[i].android_version, old->android_version, sizeof(parsed[i].android_version));
+            memcpy(parsed[i].api_level, old->api_level, sizeof(parsed[i].api_level));
+        }
     }
 
-    int count = ParseDeviceList(result->stdout_data, state->devices, MAX_DEVICES);
-    state->device_count = count;
+    // Remember who was connected, and in which state, so sessions of vanished devices can be dropped
+    int old_count = draft->adb.count;
+    char (*vanished)[256] = old_count > 0 ? (char (*)[256])SafeMalloc(old_count * sizeof(*vanished)) : NULL;
+    char (*old_status)[64] = old_count > 0 ? (char (*)[64])SafeMalloc(old_count * sizeof(*old_status)) : NULL;
+    for (int i = 0; i < old_count; i++) {
+        const AdbDevice* old = DeviceListAt(&draft->adb, i);
+        strncpy(vanished[i], old->serial_id, sizeof(vanished[i]) - 1);
+        vanished[i][sizeof(vanished[i]) - 1] = '\0';
+        memcpy(old_status[i], old->status, sizeof(old_status[i]));
+    }
 
-    FreeProcessResult(result);
+    AssignDeviceList(&draft->adb, parsed, count, MODE_ADB);
+    free(parsed);
+
+    // A device still listed in another state (device -> recovery, sideload) counts as
+    // gone too: what its adbd offers may have changed
+    int vanished_count = 0;
+    for (int i = 0; i < old_count; i++) {
+        const AdbDevice* now = DeviceListAt(&draft->adb, DeviceListFind(&draft->adb, vanished[i]));
+        if (!now || strcmp(now->status, old_status[i]) != 0) {
+            if (vanished_count != i) memcpy(vanished[vanished_count], vanished[i], sizeof(vanished[i]));
+            vanished_count++;
+        }
+    }
+    free(old_status);
 
     // Try to restore selection by serial number
-    if (strlen(saved_serial) > 0) {
-        for (int i = 0; i < count; i++) {
-            if (strcmp(state->devices[i].serial_id, saved_serial) == 0) {
-                state->current_device_index = i;
-                return count;
-            }
-        }
+    int restored = strlen(saved_serial) > 0 ? DeviceListFind(&draft->adb, saved_serial) : -1;
+    if (restored >= 0) {
+        draft->current_device_index = restored;
+    } else if (draft->current_device_index >= count) {
+        // If we couldn't restore selection, reset to first device or -1
+        draft->current_device_index = (count > 0) ? 0 : -1;
     }
 
-    // If we couldn't restore selection, reset to first device or -1
-    if (state->current_device_index >= count) {
-        state->current_device_index = (count > 0) ? 0 : -1;
+    CommitSnapshotWrite(state, draft);
+
+    for (int i = 0; i < vanished_count; i++) {
+        // Reconnects and reboots pass through here; start fresh next time
+        ShellSessionClose(vanished[i]);
+        PropCacheInvalidate(vanished[i]);
+        AdbClientForgetDevice(vanished[i]);
     }
+    free(vanished);
 
     return count;
 }
 
+// Refresh device list from ADB
+int RefreshDeviceList(AppState* state) {
+    if (!state) return 0;
+
+    ProcessResult* result = AdbDevices(state->adb_path);
+    if (!result) {
+        PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to get device list");
+        return 0;
+    }
+
+    int count = ApplyAdbDeviceList(state, result->stdout_data);
+
+    FreeProcessResult(result);
+    return count;
+}
+
 // Get device count
 int GetDeviceCount(const AppState* state) {
-    return state ? state->device_count : 0;
+    SnapshotGuard guard;
+    const DeviceSnapshot* snapshot = BeginSnapshotRead(state, &guard);
+    int count = snapshot ? snapshot->adb.count : 0;
+    EndSnapshotRead(state, &guard);
+    return count;
 }
 
 // Get currently selected device
-AdbDevice* GetSelectedDevice(const AppState* state) {
-    if (!state || state->current_device_index < 0 || state->current_device_index >= state->device_count) {
-        return NULL;
-    }
-    return &state->devices[state->current_device_index];
+const AdbDevice* GetSelectedDevice(const AppState* state) {
+    return HoldSelectedDevice(state, 0);
 }
 
 // Select device by index
 int SelectDevice(AppState* state, int index) {
-    if (!state || index < 0 || index >= state->device_count) {
+    DeviceSnapshot* draft = BeginSnapshotWrite(state);
+    if (!draft) return 0;
+
+    if (index < 0 || index >= draft->adb.count) {
+        AbortSnapshotWrite(state, draft);
         return 0;
     }
 
-    state->current_device_index = index;
+    draft->current_device_index = index;
+    CommitSnapshotWrite(state, draft);
 
     // Get detailed device info
     GetDeviceInfo(state, index);
@@ -75,42 +600,59 @@ int SelectDevice(AppState* state, int index) {
 
 // Select device by serial number
 int SelectDeviceBySerial(AppState* state, const char* serial) {
-    if (!state || !serial) return 0;
+    if (!serial) return 0;
 
-    for (int i = 0; i < state->device_count; i++) {
-        if (strcmp(state->devices[i].serial_id, serial) == 0) {
-            state->current_device_index = i;
-            GetDeviceInfo(state, i);
-            return 1;
-        }
+    DeviceSnapshot* draft = BeginSnapshotWrite(state);
+    if (!draft) return 0;
+
+    int index = DeviceListFind(&draft->adb, serial);
+    if (index < 0) {
+        AbortSnapshotWrite(state, draft);
+        return 0;
     }
 
-    return 0;
+    draft->current_device_index = index;
+    CommitSnapshotWrite(state, draft);
+    GetDeviceInfo(state, index);
+    return 1;
 }
 
 // Get detailed device information
 int GetDeviceInfo(AppState* state, int device_index) {
-    if (!state || device_index < 0 || device_index >= state->device_count) {
+    SnapshotGuard guard;
+    const DeviceSnapshot* snapshot = BeginSnapshotRead(state, &guard);
+    const AdbDevice* device = snapshot ? DeviceListAt(&snapshot->adb, device_index) : NULL;
+    if (!device) {
+        EndSnapshotRead(state, &guard);
         return 0;
     }
 
-    AdbDevice* device = &state->devices[device_index];
-
-    // Get Android version
-    ProcessResult* result = AdbGetProp(state->adb_path, device->serial_id, "ro.build.version.release");
-    if (result && result->stdout_data) {
-        TrimString(result->stdout_data);
-        strncpy(device->android_version, result->stdout_data, sizeof(device->android_version) - 1);
-    }
-    FreeProcessResult(result);
-
-    // Get API level
-    result = AdbGetProp(state->adb_path, device->serial_id, "ro.build.version.sdk");
-    if (result && result->stdout_data) {
-        TrimString(result->stdout_data);
-        strncpy(device->api_level, result->stdout_data, sizeof(device->api_level) - 1);
+    char serial[256];
+    strncpy(serial, device->serial_id, sizeof(serial) - 1);
+    serial[sizeof(serial) - 1] = '\0';
+    EndSnapshotRead(state, &guard);
+
+    // Both come from the device's cached getprop snapshot (one round trip per connection)
+    char android_version[64];
+    char api_level[16];
+    PropCacheGet(state->adb_path, serial, "ro.build.version.release",
+                 android_version, sizeof(android_version));
+    PropCacheGet(state->adb_path, serial, "ro.build.version.sdk",
+                 api_level, sizeof(api_level));
+
+    // The list may have changed meanwhile; update the device by serial, not index
+    DeviceSnapshot* draft = BeginSnapshotWrite(state);
+    int index = DeviceListFind(&draft->adb, serial);
+    if (index >= 0) {
+        const AdbDevice* current = DeviceListAt(&draft->adb, index);
+        if (strcmp(current->android_version, android_version) != 0 ||
+            strcmp(current->api_level, api_level) != 0) {
+            AdbDevice* updated = MutableDeviceAt(&draft->adb, index);
+            strcpy(updated->android_version, android_version);
+            strcpy(updated->api_level, api_level);
+        }
     }
-    FreeProcessResult(result);
+    CommitSnapshotWrite(state, draft);
 
     return 1;
 }
@@ -119,23 +661,27 @@ int GetDeviceInfo(AppState* state, int device_index) {
 void PrintDeviceList(const AppState* state) {
     if (!state) return;
 
+    SnapshotGuard guard;
+    const DeviceSnapshot* snapshot = BeginSnapshotRead(state, &guard);
+    if (!snapshot) return;
+
     printf("\n");
     printf("========================================\n");
-    printf("         Connected Devices (%d)\n", state->device_count);
+    printf("         Connected Devices (%d)\n", snapshot->adb.count);
     printf("========================================\n");
 
-    if (state->device_count == 0) {
+    if (snapshot->adb.count == 0) {
         printf("No devices connected.\n");
         printf("\nPlease make sure:\n");
         printf("- USB debugging is enabled on your device\n");
         printf("- Device is connected via USB\n");
         printf("- You have authorized this computer on the device\n");
     } else {
-        for (int i = 0; i < state->device_count; i++) {
-            AdbDevice* dev = &state->devices[i];
+        for (int i = 0; i < snapshot->adb.count; i++) {
+            const AdbDevice* dev = DeviceListAt(&snapshot->adb, i);
             printf("[%d] %s", i, dev->serial_id);
 
-            if (i == state->current_device_index) {
+            if (i == snapshot->current_device_index) {
                 printf(" [SELECTED]");
             }
 
@@ -153,8 +699,10 @@ void PrintDeviceList(const AppState* state) {
     }
 
     printf("========================================\n");
+    EndSnapshotRead(state, &guard);
 }
 
+
 // Wait for device connection (with timeout)
 int WaitForDeviceConnection(AppState* state, int timeout_seconds) {
     if (!state) return 0;
@@ -196,102 +744,152 @@ int WaitForDeviceConnection(AppState* state, int timeout_seconds) {
 int RefreshFastbootDeviceList(AppState* state) {
     if (!state) return 0;
 
-    // Save current device serial to try to maintain selection
-    char saved_serial[256] = "";
-    if (state->current_fastboot_device_index >= 0 &&
-        state->current_fastboot_device_index < state->fastboot_device_count) {
-        strncpy(saved_serial, state->fastboot_devices[state->current_fastboot_device_index].serial_id,
-                sizeof(saved_serial) - 1);
-    }
+    // Network devices added with fb_connect are listed after the USB ones fastboot.exe reports
+    char network[FASTBOOT_MAX_NETWORK_DEVICES * 300];
+    FastbootClientListNetworkDevices(network, sizeof(network));
 
     ProcessResult* result = FastbootDevices(state->fastboot_path);
-    if (!result) {
+    if (!result && network[0] == '\0') {
         PrintError(ADB_ERROR_FASTBOOT_FAILED, "Failed to get fastboot device list");
         return 0;
     }
 
-    int count = ParseFastbootDeviceList(result->stdout_data, state->fastboot_devices, MAX_DEVICES);
-    state->fastboot_device_count = count;
+    const char* usb = (result && result->stdout_data) ? result->stdout_data : "";
+    size_t usb_len = strlen(usb);
+    char* list_output = (char*)SafeMalloc(usb_len + strlen(network) + 2);
+    snprintf(list_output, usb_len + strlen(network) + 2, "%s\n%s", usb, network);
+    if (result) FreeProcessResult(result);
 
-    FreeProcessResult(result);
+    int count = 0;
+    AdbDevice* parsed = ParseDeviceOutput(list_output, MODE_FASTBOOT, &count);
+    free(list_output);
 
-    // Try to restore selection by serial number
-    if (strlen(saved_serial) > 0) {
-        for (int i = 0; i < count; i++) {
-            if (strcmp(state->fastboot_devices[i].serial_id, saved_serial) == 0) {
-                state->current_fastboot_device_index = i;
-                return count;
-            }
+    DeviceSnapshot* draft = BeginSnapshotWrite(state);
+    if (!draft) {
+        free(parsed);
+        return 0;
+    }
+
+    // Save current device serial to try to maintain selection
+    char saved_serial[256] = "";
+    const AdbDevice* selected = DeviceListAt(&draft->fastboot, draft->current_fastboot_device_index);
+    if (selected) {
+        strncpy(saved_serial, selected->serial_id, sizeof(saved_serial) - 1);
+    }
+
+    // Remember who was connected so variable snapshots of vanished devices can be dropped
+    int old_count = draft->fastboot.count;
+    char (*vanished)[256] = old_count > 0 ? (char (*)[256])SafeMalloc(old_count * sizeof(*vanished)) : NULL;
+    for (int i = 0; i < old_count; i++) {
+        strncpy(vanished[i], DeviceListAt(&draft->fastboot, i)->serial_id, sizeof(vanished[i]) - 1);
+        vanished[i][sizeof(vanished[i]) - 1] = '\0';
+    }
+
+    AssignDeviceList(&draft->fastboot, parsed, count, MODE_FASTBOOT);
+    free(parsed);
+
+    int vanished_count = 0;
+    for (int i = 0; i < old_count; i++) {
+        if (DeviceListFind(&draft->fastboot, vanished[i]) < 0) {
+            if (vanished_count != i) memcpy(vanished[vanished_count], vanished[i], sizeof(vanished[i]));
+            vanished_count++;
         }
     }
 
-    // If we couldn't restore selection, reset to first device or -1
-    if (state->current_fastboot_device_index >= count) {
-        state->current_fastboot_device_index = (count > 0) ? 0 : -1;
+    // Try to restore selection by serial number
+    int restored = strlen(saved_serial) > 0 ? DeviceListFind(&draft->fastboot, saved_serial) : -1;
+    if (restored >= 0) {
+        draft->current_fastboot_device_index = restored;
+    } else if (draft->current_fastboot_device_index >= count) {
+        // If we couldn't restore selection, reset to first device or -1
+        draft->current_fastboot_device_index = (count > 0) ? 0 : -1;
+    }
+
+    CommitSnapshotWrite(state, draft);
+
+    // A device that left fastboot starts a new session when it comes back
+    for (int i = 0; i < vanished_count; i++) {
+        FastbootVarCacheInvalidate(vanished[i]);
+        // It comes back to adb as a freshly booted system, recovery or sideload
+        AdbClientForgetDevice(vanished[i]);
     }
+    free(vanished);
 
     return count;
 }
 
 // Get fastboot device count
 int GetFastbootDeviceCount(const AppState* state) {
-    return state ? state->fastboot_device_count : 0;
+    SnapshotGuard guard;
+    const DeviceSnapshot* snapshot = BeginSnapshotRead(state, &guard);
+    int count = snapshot ? snapshot->fastboot.count : 0;
+    EndSnapshotRead(state, &guard);
+    return count;
 }
 
 // Get selected fastboot device
-AdbDevice* GetSelectedFastbootDevice(const AppState* state) {
-    if (!state || state->current_fastboot_device_index < 0 ||
-        state->current_fastboot_device_index >= state->fastboot_device_count) {
-        return NULL;
-    }
-    return &state->fastboot_devices[state->current_fastboot_device_index];
+const AdbDevice* GetSelectedFastbootDevice(const AppState* state) {
+    return HoldSelectedDevice(state, 1);
 }
 
 // Select fastboot device by index
 int SelectFastbootDevice(AppState* state, int index) {
-    if (!state || index < 0 || index >= state->fastboot_device_count) {
+    DeviceSnapshot* draft = BeginSnapshotWrite(state);
+    if (!draft) return 0;
+
+    if (index < 0 || index >= draft->fastboot.count) {
+        AbortSnapshotWrite(state, draft);
         return 0;
     }
 
-    state->current_fastboot_device_index = index;
+    draft->current_fastboot_device_index = index;
+    CommitSnapshotWrite(state, draft);
     return 1;
 }
 
 // Select fastboot device by serial
 int SelectFastbootDeviceBySerial(AppState* state, const char* serial) {
-    if (!state || !serial) return 0;
+    if (!serial) return 0;
 
-    for (int i = 0; i < state->fastboot_device_count; i++) {
-        if (strcmp(state->fastboot_devices[i].serial_id, serial) == 0) {
-            state->current_fastboot_device_index = i;
-            return 1;
-        }
+    DeviceSnapshot* draft = BeginSnapshotWrite(state);
+    if (!draft) return 0;
+
+    int index = DeviceListFind(&draft->fastboot, serial);
+    if (index < 0) {
+        AbortSnapshotWrite(state, draft);
+        return 0;
     }
 
-    return 0;
+    draft->current_fastboot_device_index = index;
+    CommitSnapshotWrite(state, draft);
+    return 1;
 }
 
 // Print fastboot device list
 void PrintFastbootDeviceList(const AppState* state) {
     if (!state) return;
 
+    SnapshotGuard guard;
+    const DeviceSnapshot* snapshot = BeginSnapshotRead(state, &guard);
+    if (!snapshot) return;
+
     printf("\n");
     printf("========================================\n");
-    printf("       Fastboot Devices (%d)\n", state->fastboot_device_count);
+    printf("       Fastboot Devices (%d)\n", snapshot->fastboot.count);
     printf("========================================\n");
 
-    if (state->fastboot_device_count == 0) {
+    if (snapshot->fastboot.count == 0) {
         printf("No fastboot devices connected.\n");
         printf("\nPlease make sure:\n");
         printf("- Device is in fastboot mode\n");
         printf("- Device is connected via USB\n");
         printf("- Fastboot drivers are installed\n");
     } else {
-        for (int i = 0; i < state->fastboot_device_count; i++) {
-            AdbDevice* dev = &state->fastboot_devices[i];
+        for (int i = 0; i < snapshot->fastboot.count; i++) {
+            const AdbDevice* dev = DeviceListAt(&snapshot->fastboot, i);
             printf("[%d] %s", i, dev->serial_id);
 
-            if (i == state->current_fastboot_device_index) {
+            if (i == snapshot->current_fastboot_device_index) {
                 printf(" [SELECTED]");
             }
 
@@ -302,6 +900,7 @@ void PrintFastbootDeviceList(const AppState* state) {
     }
 
     printf("========================================\n");
+    EndSnapshotRead(state, &guard);
 }
 
 // ============================================================================
@@ -322,19 +921,164 @@ void SetPromptRefreshCallback(PromptRefreshCallback callback) {
 // Thread handle for monitoring
 #ifdef _WIN32
 #include <windows.h>
+#include <dbt.h>
 static HANDLE g_monitor_thread = NULL;
+static HANDLE g_monitor_stop_event = NULL;
+static int g_usb_topology_changed = 0;   // Set by the notification window (monitor thread only)
 #endif
 
-// Monitor thread function
+// Give a re-enumerating device time to settle before running "fastboot devices"
+#define FASTBOOT_RESCAN_DELAY_MS 300
+// Polling interval used only when the adb server or USB notifications are unavailable
+#define MONITOR_POLL_MS 3000
+
+static int ApplyAutoSwitch(AppState* state, int old_adb_count, int old_fastboot_count);
+
 #ifdef _WIN32
+// Window procedure for USB arrival/removal notifications
+static LRESULT CALLBACK MonitorWindowProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam) {
+    if (msg == WM_DEVICECHANGE &&
+        (wparam == DBT_DEVICEARRIVAL || wparam == DBT_DEVICEREMOVECOMPLETE || wparam == DBT_DEVNODES_CHANGED)) {
+        g_usb_topology_changed = 1;
+    }
+    return DefWindowProcA(hwnd, msg, wparam, lparam);
+}
+
+// Create a message-only window registered for all device interface arrivals/removals
+static HWND CreateUsbNotificationWindow(HDEVNOTIFY* notify_out) {
+    *notify_out = NULL;
+
+    WNDCLASSEXA wc = {0};
+    wc.cbSize = sizeof(wc);
+    wc.lpfnWndProc = MonitorWindowProc;
+    wc.hInstance = GetModuleHandleA(NULL);
+    wc.lpszClassName = "FolkAdbDeviceMonitor";
+    RegisterClassExA(&wc);
+
+    HWND window = CreateWindowExA(0, wc.lpszClassName, "", 0, 0, 0, 0, 0,
+                                  HWND_MESSAGE, NULL, wc.hInstance, NULL);
+    if (!window) return NULL;
+
+    // Message-only windows miss broadcasts, so ask for interface notifications explicitly
+    DEV_BROADCAST_DEVICEINTERFACE_A filter = {0};
+    filter.dbcc_size = sizeof(filter);
+    filter.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
+    *notify_out = RegisterDeviceNotificationA(window, &filter,
+                                              DEVICE_NOTIFY_WINDOW_HANDLE | DEVICE_NOTIFY_ALL_INTERFACE_CLASSES);
+    if (!*notify_out) {
+        DestroyWindow(window);
+        return NULL;
+    }
+
+    return window;
+}
+
+// Monitor thread function: adb changes come from host:track-devices-l, fastboot is
+// rescanned only when Windows reports a USB arrival/removal
 DWORD WINAPI MonitorThread(LPVOID lpParam) {
     AppState* state = (AppState*)lpParam;
-    
+
+    HDEVNOTIFY notify = NULL;
+    HWND window = CreateUsbNotificationWindow(&notify);
+
+    AdbDeviceTracker tracker;
+    memset(&tracker, 0, sizeof(tracker));
+    tracker.sock = INVALID_SOCKET;
+    int tracking = 0;
+
+    ULONGLONG fastboot_due = 0;   // 0 = no rescan pending
+    ULONGLONG next_poll = 0;
+
+    // Full scan once so fastboot devices already attached are seen
+    CheckDeviceMode(state);
+    next_poll = GetTickCount64() + MONITOR_POLL_MS;
+
     while (g_monitoring_enabled) {
-        CheckDeviceMode(state);
-        Sleep(3000); // Wait 3 seconds
+        if (!tracking) {
+            // The first message of a new subscription carries the current list
+            tracking = AdbClientTrackerOpen(&tracker);
+        }
+
+        ULONGLONG now = GetTickCount64();
+        int poll_adb = !tracking;
+        int poll_fastboot = (window == NULL);
+
+        if ((poll_adb || poll_fastboot) && now >= next_poll) {
+            int old_adb_count = GetDeviceCount(state);
+            int old_fastboot_count = GetFastbootDeviceCount(state);
+            if (poll_adb) RefreshDeviceList(state);
+            if (poll_fastboot) RefreshFastbootDeviceList(state);
+            ApplyAutoSwitch(state, old_adb_count, old_fastboot_count);
+            next_poll = GetTickCount64() + MONITOR_POLL_MS;
+        }
+
+        if (fastboot_due && now >= fastboot_due) {
+            fastboot_due = 0;
+            int old_adb_count = GetDeviceCount(state);
+            int old_fastboot_count = GetFastbootDeviceCount(state);
+            RefreshFastbootDeviceList(state);
+            ApplyAutoSwitch(state, old_adb_count, old_fastboot_count);
+        }
+
+        // Sleep until a tracker message, a USB notification, a due rescan or stop
+        now = GetTickCount64();
+        DWORD wait_ms = INFINITE;
+        if (poll_adb || poll_fastboot) {
+            wait_ms = now >= next_poll ? 0 : (DWORD)(next_poll - now);
+        }
+        if (fastboot_due) {
+            DWORD due_ms = now >= fastboot_due ? 0 : (DWORD)(fastboot_due - now);
+            if (due_ms < wait_ms) wait_ms = due_ms;
+        }
+
+        HANDLE handles[2];
+        DWORD count = 0;
+        handles[count++] = g_monitor_stop_event;
+        if (tracking) handles[count++] = tracker.event;
+
+        DWORD wait = window
+            ? MsgWaitForMultipleObjects(count, handles, FALSE, wait_ms, QS_ALLINPUT)
+            : WaitForMultipleObjects(count, handles, FALSE, wait_ms);
+
+        if (wait == WAIT_OBJECT_0 || wait == WAIT_FAILED) {
+            break;
+        }
+
+        if (tracking && wait == WAIT_OBJECT_0 + 1) {
+            int closed = 0;
+            char* list = AdbClientTrackerRead(&tracker, &closed);
+            if (list) {
+                int old_adb_count = GetDeviceCount(state);
+                int old_fastboot_count = GetFastbootDeviceCount(state);
+                ApplyAdbDeviceList(state, list);
+                ApplyAutoSwitch(state, old_adb_count, old_fastboot_count);
+                free(list);
+            }
+            if (closed) {
+                // Server went away (e.g. adb kill-server); poll until it is back
+                AdbClientTrackerClose(&tracker);
+                tracking = 0;
+                next_poll = 0;
+            }
+        }
+
+        if (window) {
+            MSG msg;
+            while (PeekMessageA(&msg, NULL, 0, 0, PM_REMOVE)) {
+                DispatchMessageA(&msg);
+            }
+            if (g_usb_topology_changed) {
+                // Debounce: a replug produces a burst of interface notifications
+                g_usb_topology_changed = 0;
+                fastboot_due = GetTickCount64() + FASTBOOT_RESCAN_DELAY_MS;
+            }
+        }
     }
-    
+
+    AdbClientTrackerClose(&tracker);
+    if (notify) UnregisterDeviceNotification(notify);
+    if (window) DestroyWindow(window);
+
     return 0;
 }
 #endif
@@ -349,6 +1093,8 @@ void StartDeviceMonitoring(AppState* state) {
     g_monitoring_enabled = 1;
     
 #ifdef _WIN32
+    g_monitor_stop_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+
     // Create monitoring thread
     g_monitor_thread = CreateThread(
         NULL,                   // Default security attributes
@@ -362,10 +1108,14 @@ void StartDeviceMonitoring(AppState* state) {
     if (g_monitor_thread == NULL) {
         printf("Failed to start device monitoring thread.\n");
         g_monitoring_enabled = 0;
+        if (g_monitor_stop_event) {
+            CloseHandle(g_monitor_stop_event);
+            g_monitor_stop_event = NULL;
+        }
         return;
     }
     
-    printf("Device monitoring started (checking every 3 seconds)...\n");
+    printf("Device monitoring started...\n");
 #else
     printf("Device monitoring not supported on this platform.\n");
     g_monitoring_enabled = 0;
@@ -373,57 +1123,77 @@ void StartDeviceMonitoring(AppState* state) {
 }
 
 // Stop device monitoring
-void StopDeviceMonitoring(void) {
+int StopDeviceMonitoring(void) {
     if (!g_monitoring_enabled) {
-        return;
+        return 1;
     }
     
     g_monitoring_enabled = 0;
     
 #ifdef _WIN32
+    if (g_monitor_stop_event) SetEvent(g_monitor_stop_event);
+
     if (g_monitor_thread != NULL) {
-        // Wait for thread to finish (with timeout)
-        WaitForSingleObject(g_monitor_thread, 5000);
+        // The stop event ends the wait between polls at once; a poll in flight
+        // (an adb.exe or fastboot.exe spawn) gets a few seconds to finish
+        if (WaitForSingleObject(g_monitor_thread, 5000) == WAIT_TIMEOUT) {
+            // Still running: its handles and the state it uses must stay alive
+            printf("Device monitoring did not stop in time.\n");
+            return 0;
+        }
         CloseHandle(g_monitor_thread);
         g_monitor_thread = NULL;
     }
+    if (g_monitor_stop_event) {
+        CloseHandle(g_monitor_stop_event);
+        g_monitor_stop_event = NULL;
+    }
 #endif
     
     g_monitor_state = NULL;
     printf("Device monitoring stopped.\n");
+    return 1;
 }
 
+
 // Check device mode and auto-switch
 int CheckDeviceMode(AppState* state) {
     if (!state) return 0;
 
     // Refresh both ADB and fastboot device lists
-    int old_adb_count = state->device_count;
-    int old_fastboot_count = state->fastboot_device_count;
+    int old_adb_count = GetDeviceCount(state);
+    int old_fastboot_count = GetFastbootDeviceCount(state);
 
     RefreshDeviceList(state);
     RefreshFastbootDeviceList(state);
 
-    int adb_count = state->device_count;
-    int fastboot_count = state->fastboot_device_count;
+    return ApplyAutoSwitch(state, old_adb_count, old_fastboot_count);
+}
+
+// Switch mode/selection after the device lists changed and refresh the prompt
+static int ApplyAutoSwitch(AppState* state, int old_adb_count, int old_fastboot_count) {
+    // Mode and selection change together in one published snapshot
+    DeviceSnapshot* draft = BeginSnapshotWrite(state);
+    if (!draft) return 0;
+
+    int adb_count = draft->adb.count;
+    int fastboot_count = draft->fastboot.count;
 
     // Auto-switch logic
     int mode_changed = 0;
     int needs_refresh = 0;
+    int selected_adb = 0;
 
     // Priority: fastboot > ADB (fastboot is more privileged/lower-level)
     // If fastboot devices detected, switch to fastboot mode
-    if (fastboot_count > 0 && state->current_mode != MODE_FASTBOOT) {
+    if (fastboot_count > 0 && draft->current_mode != MODE_FASTBOOT) {
         printf("\n[Auto-switch] Fastboot device detected, switching to fastboot mode...\n");
-        state->current_mode = MODE_FASTBOOT;
+        draft->current_mode = MODE_FASTBOOT;
 
         // Auto-select first fastboot device
-        if (state->current_fastboot_device_index < 0) {
-            SelectFastbootDevice(state, 0);
-            AdbDevice* dev = GetSelectedFastbootDevice(state);
-            if (dev) {
-                printf("Auto-selected fastboot device: %s\n", dev->serial_id);
-            }
+        if (draft->current_fastboot_device_index < 0) {
+            draft->current_fastboot_device_index = 0;
+            printf("Auto-selected fastboot device: %s\n", DeviceListAt(&draft->fastboot, 0)->serial_id);
         }
         mode_changed = 1;
         needs_refresh = 1;
@@ -431,25 +1201,23 @@ int CheckDeviceMode(AppState* state) {
 
     // If only ADB devices detected (and no fastboot), switch to ADB mode
     // Changed to independent 'if' instead of 'else if'
-    if (adb_count > 0 && fastboot_count == 0 && state->current_mode != MODE_ADB) {
+    if (adb_count > 0 && fastboot_count == 0 && draft->current_mode != MODE_ADB) {
         printf("\n[Auto-switch] ADB device detected, switching to ADB mode...\n");
-        state->current_mode = MODE_ADB;
+        draft->current_mode = MODE_ADB;
 
         // Auto-select first ADB device
-        if (state->current_device_index < 0) {
-            SelectDevice(state, 0);
-            AdbDevice* dev = GetSelectedDevice(state);
-            if (dev) {
-                printf("Auto-selected ADB device: %s\n", dev->serial_id);
-            }
+        if (draft->current_device_index < 0) {
+            draft->current_device_index = 0;
+            selected_adb = 1;
+            printf("Auto-selected ADB device: %s\n", DeviceListAt(&draft->adb, 0)->serial_id);
         }
         mode_changed = 1;
         needs_refresh = 1;
     }
 
     // If no devices at all, reset to ADB mode
-    if (adb_count == 0 && fastboot_count == 0 && state->current_mode != MODE_ADB) {
-        state->current_mode = MODE_ADB;
+    if (adb_count == 0 && fastboot_count == 0 && draft->current_mode != MODE_ADB) {
+        draft->current_mode = MODE_ADB;
         mode_changed = 1;
         needs_refresh = 1;
     }
@@ -457,27 +1225,29 @@ int CheckDeviceMode(AppState* state) {
     // Auto-select device if none selected in current mode
     if (!mode_changed) {
         // In fastboot mode with devices but no selection
-        if (state->current_mode == MODE_FASTBOOT && fastboot_count > 0 &&
-            state->current_fastboot_device_index < 0) {
-            SelectFastbootDevice(state, 0);
-            AdbDevice* dev = GetSelectedFastbootDevice(state);
-            if (dev) {
-                printf("\n[Auto-select] Fastboot device: %s\n", dev->serial_id);
-                needs_refresh = 1;
-            }
+        if (draft->current_mode == MODE_FASTBOOT && fastboot_count > 0 &&
+            draft->current_fastboot_device_index < 0) {
+            draft->current_fastboot_device_index = 0;
+            printf("\n[Auto-select] Fastboot device: %s\n", DeviceListAt(&draft->fastboot, 0)->serial_id);
+            needs_refresh = 1;
         }
         // In ADB mode with devices but no selection
-        else if (state->current_mode == MODE_ADB && adb_count > 0 &&
-                 state->current_device_index < 0) {
-            SelectDevice(state, 0);
-            AdbDevice* dev = GetSelectedDevice(state);
-            if (dev) {
-                printf("\n[Auto-select] ADB device: %s\n", dev->serial_id);
-                needs_refresh = 1;
-            }
+        else if (draft->current_mode == MODE_ADB && adb_count > 0 &&
+                 draft->current_device_index < 0) {
+            draft->current_device_index = 0;
+            selected_adb = 1;
+            printf("\n[Auto-select] ADB device: %s\n", DeviceListAt(&draft->adb, 0)->serial_id);
+            needs_refresh = 1;
         }
     }
 
+    CommitSnapshotWrite(state, draft);
+
+    // Device info needs the shell, so fetch it only after the switch is published
+    if (selected_adb) {
+        GetDeviceInfo(state, 0);
+    }
+
     // Notify of device changes
     if (!mode_changed) {
         if (adb_count != old_adb_count || fastboot_count != old_fastboot_count) {
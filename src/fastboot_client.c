@@ -0,0 +1,779 @@
+#include "fastboot_client.h"
+#include "utils.h"
+#include <ws2tcpip.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+// Network fastboot answers the handshake quickly or not at all
+#define FASTBOOT_CONNECT_TIMEOUT_MS 3000
+// Longest silence from a device before the link counts as lost; flash and erase
+// may keep the device busy (and quiet) for minutes on large partitions
+#define FASTBOOT_REPLY_TIMEOUT_MS 30000
+#define FASTBOOT_LONG_REPLY_TIMEOUT_MS (10 * 60 * 1000)
+
+// Streamed images are packed into pieces of at most this size, two at a time
+#define FASTBOOT_STREAM_PIECE_MAX (64ULL * 1024 * 1024)
+#define FASTBOOT_STREAM_PIECE_MIN (64 * 1024)
+// Bytes per transport write while a piece uploads
+#define FASTBOOT_STREAM_SEND_STEP (1024 * 1024)
+
+// TCP framing: "FB01" handshake, then every message carries a big-endian 64-bit length
+#define FASTBOOT_TCP_HANDSHAKE "FB01"
+#define FASTBOOT_TCP_HEADER 8
+
+// Fastboot over a TCP socket
+typedef struct {
+    FastbootTransport base;
+    SOCKET sock;
+    unsigned long long message_left;    // Unread bytes of the current incoming message
+} TcpTransport;
+
+// Remembered network devices
+static char g_network_devices[FASTBOOT_MAX_NETWORK_DEVICES][64];
+static int g_network_device_count = 0;
+static SRWLOCK g_network_lock = SRWLOCK_INIT;
+
+// Initialize Winsock (reference counted, so repeating it is harmless)
+static int StartWinsock(void) {
+    static volatile LONG started = 0;
+    if (started) return 1;
+
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return 0;
+    InterlockedExchange(&started, 1);
+    return 1;
+}
+
+// Record why the session failed
+static void SetFastbootError(FastbootSession* session, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(session->error, sizeof(session->error), format, args);
+    va_end(args);
+}
+
+// ============================================================================
+// TCP Transport
+// ============================================================================
+
+// Send exactly len bytes
+static int TcpSendAll(SOCKET sock, const char* data, size_t len) {
+    while (len > 0) {
+        int chunk = len > 0x7fffffff ? 0x7fffffff : (int)len;
+        int sent = send(sock, data, chunk, 0);
+        if (sent <= 0) return 0;
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return 1;
+}
+
+// Bound how long a send or receive may block (recv fails with WSAETIMEDOUT after that)
+static void TcpSetTimeout(SOCKET sock, DWORD timeout_ms) {
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout_ms, sizeof(timeout_ms));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout_ms, sizeof(timeout_ms));
+}
+
+// Receive exactly len bytes (fails once the socket timeout passes without data)
+static int TcpRecvAll(SOCKET sock, char* data, size_t len) {
+    while (len > 0) {
+        int chunk = len > 0x7fffffff ? 0x7fffffff : (int)len;
+        int got = recv(sock, data, chunk, 0);
+        if (got <= 0) return 0;
+        data += got;
+        len -= (size_t)got;
+    }
+    return 1;
+}
+
+// FastbootTransport.write: length header and payload in one gathered send
+static int TcpTransportWrite(FastbootTransport* transport, const void* data, size_t len) {
+    TcpTransport* tcp = (TcpTransport*)transport;
+
+    unsigned char header[FASTBOOT_TCP_HEADER];
+    for (int i = 0; i < FASTBOOT_TCP_HEADER; i++) {
+        header[i] = (unsigned char)((unsigned long long)len >> (56 - i * 8));
+    }
+
+    WSABUF buffers[2];
+    buffers[0].buf = (char*)header;
+    buffers[0].len = FASTBOOT_TCP_HEADER;
+    buffers[1].buf = (char*)data;
+    buffers[1].len = (ULONG)len;
+
+    DWORD sent = 0;
+    if (WSASend(tcp->sock, buffers, len > 0 ? 2 : 1, &sent, 0, NULL, NULL) != 0) return 0;
+
+    // WSASend on a blocking socket normally takes everything; finish by hand if not
+    size_t total = FASTBOOT_TCP_HEADER + len;
+    if (sent < FASTBOOT_TCP_HEADER) {
+        if (!TcpSendAll(tcp->sock, (const char*)header + sent, FASTBOOT_TCP_HEADER - sent)) return 0;
+        sent = FASTBOOT_TCP_HEADER;
+    }
+    return sent >= total || TcpSendAll(tcp->sock, (const char*)data + (sent - FASTBOOT_TCP_HEADER),
+                                       total - sent);
+}
+
+// FastbootTransport.read: the rest of the current message, up to size bytes
+static int TcpTransportRead(FastbootTransport* transport, void* buffer, size_t size) {
+    TcpTransport* tcp = (TcpTransport*)transport;
+
+    if (tcp->message_left == 0) {
+        unsigned char header[FASTBOOT_TCP_HEADER];
+        if (!TcpRecvAll(tcp->sock, (char*)header, sizeof(header))) return -1;
+        for (int i = 0; i < FASTBOOT_TCP_HEADER; i++) {
+            tcp->message_left = (tcp->message_left << 8) | header[i];
+        }
+        if (tcp->message_left == 0) return 0;
+    }
+
+    size_t take = tcp->message_left < size ? (size_t)tcp->message_left : size;
+    if (!TcpRecvAll(tcp->sock, (char*)buffer, take)) return -1;
+    tcp->message_left -= take;
+    return (int)take;
+}
+
+// FastbootTransport.set_timeout
+static void TcpTransportSetTimeout(FastbootTransport* transport, unsigned int timeout_ms) {
+    TcpTransport* tcp = (TcpTransport*)transport;
+    TcpSetTimeout(tcp->sock, (DWORD)timeout_ms);
+}
+
+// FastbootTransport.close
+static void TcpTransportClose(FastbootTransport* transport) {
+    TcpTransport* tcp = (TcpTransport*)transport;
+    if (tcp->sock != INVALID_SOCKET) closesocket(tcp->sock);
+    free(tcp);
+}
+
+// Connect to host:port within the timeout (blocking socket on success, with
+// sends and receives bounded by the same timeout until the handshake is done)
+static SOCKET TcpConnect(const char* host, int port) {
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    struct addrinfo* info = NULL;
+    if (getaddrinfo(host, port_str, &hints, &info) != 0 || !info) return INVALID_SOCKET;
+
+    SOCKET sock = INVALID_SOCKET;
+    for (struct addrinfo* ai = info; ai != NULL && sock == INVALID_SOCKET; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock == INVALID_SOCKET) continue;
+
+        unsigned long nonblocking = 1;
+        ioctlsocket(sock, FIONBIO, &nonblocking);
+        int connected = connect(sock, ai->ai_addr, (int)ai->ai_addrlen) == 0;
+        if (!connected && WSAGetLastError() == WSAEWOULDBLOCK) {
+            fd_set write_set, error_set;
+            FD_ZERO(&write_set);
+            FD_ZERO(&error_set);
+            FD_SET(sock, &write_set);
+            FD_SET(sock, &error_set);
+            struct timeval tv = { FASTBOOT_CONNECT_TIMEOUT_MS / 1000, (FASTBOOT_CONNECT_TIMEOUT_MS % 1000) * 1000 };
+            connected = select(0, NULL, &write_set, &error_set, &tv) > 0 &&
+                        FD_ISSET(sock, &write_set) && !FD_ISSET(sock, &error_set);
+        }
+        if (!connected) {
+            closesocket(sock);
+            sock = INVALID_SOCKET;
+            continue;
+        }
+        nonblocking = 0;
+        ioctlsocket(sock, FIONBIO, &nonblocking);
+    }
+
+    freeaddrinfo(info);
+    if (sock != INVALID_SOCKET) {
+        int no_delay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+        TcpSetTimeout(sock, FASTBOOT_CONNECT_TIMEOUT_MS);
+    }
+    return sock;
+}
+
+// Split "tcp:<host>[:<port>]" (IPv6 hosts in brackets)
+static int ParseTcpSerial(const char* serial, char* host, size_t host_size, int* port) {
+    if (!StringStartsWith(serial, "tcp:")) return 0;
+    const char* spec = serial + 4;
+    *port = FASTBOOT_TCP_DEFAULT_PORT;
+
+    const char* host_start = spec;
+    const char* host_end = NULL;
+    const char* port_part = NULL;
+    if (*spec == '[') {
+        host_start = spec + 1;
+        host_end = strchr(host_start, ']');
+        if (!host_end) return 0;
+        if (host_end[1] == ':') port_part = host_end + 2;
+    } else {
+        const char* colon = strrchr(spec, ':');
+        host_end = colon ? colon : spec + strlen(spec);
+        if (colon) port_part = colon + 1;
+    }
+
+    size_t len = (size_t)(host_end - host_start);
+    if (len == 0 || len >= host_size) return 0;
+    memcpy(host, host_start, len);
+    host[len] = '\0';
+
+    if (port_part) {
+        *port = atoi(port_part);
+        if (*port <= 0 || *port > 65535) return 0;
+    }
+    return 1;
+}
+
+// Connect and exchange the protocol version
+static FastbootTransport* OpenTcpTransport(const char* serial, char* error, size_t error_size) {
+    char host[256];
+    int port = 0;
+    if (!ParseTcpSerial(serial, host, sizeof(host), &port)) {
+        snprintf(error, error_size, "Invalid network address %s (expected tcp:<host>[:<port>])", serial);
+        return NULL;
+    }
+    if (!StartWinsock()) {
+        snprintf(error, error_size, "Winsock initialization failed");
+        return NULL;
+    }
+
+    SOCKET sock = TcpConnect(host, port);
+    if (sock == INVALID_SOCKET) {
+        snprintf(error, error_size, "Cannot connect to %s:%d", host, port);
+        return NULL;
+    }
+
+    // The device answers "FBxx" with its own two-digit protocol version
+    char reply[4];
+    int answered = TcpSendAll(sock, FASTBOOT_TCP_HANDSHAKE, 4) && TcpRecvAll(sock, reply, sizeof(reply));
+    if (!answered || memcmp(reply, "FB", 2) != 0 || !isdigit((unsigned char)reply[2]) ||
+        !isdigit((unsigned char)reply[3]) || (reply[2] - '0') * 10 + (reply[3] - '0') < 1) {
+        snprintf(error, error_size, "%s:%d did not answer the fastboot handshake", host, port);
+        closesocket(sock);
+        return NULL;
+    }
+
+    // A device that vanishes mid-command (cable pulled, bootloader hung) fails
+    // the command instead of blocking it forever
+    TcpSetTimeout(sock, FASTBOOT_REPLY_TIMEOUT_MS);
+
+    TcpTransport* tcp = (TcpTransport*)SafeCalloc(1, sizeof(TcpTransport));
+    tcp->base.write = TcpTransportWrite;
+    tcp->base.read = TcpTransportRead;
+    tcp->base.set_timeout = TcpTransportSetTimeout;
+    tcp->base.close = TcpTransportClose;
+    tcp->sock = sock;
+    return &tcp->base;
+}
+
+// ============================================================================
+// Protocol
+// ============================================================================
+
+// Whether the native client can reach this device
+int FastbootClientSupports(const char* device_serial) {
+    return device_serial && StringStartsWith(device_serial, "tcp:");
+}
+
+// Open a session with one device
+int FastbootClientOpen(FastbootSession* session, const char* device_serial) {
+    if (!session) return 0;
+    memset(session, 0, sizeof(FastbootSession));
+
+    if (!FastbootClientSupports(device_serial)) {
+        SetFastbootError(session, "%s is not a network fastboot device", device_serial ? device_serial : "(none)");
+        return 0;
+    }
+
+    session->transport = OpenTcpTransport(device_serial, session->error, sizeof(session->error));
+    return session->transport != NULL;
+}
+
+// End the session
+void FastbootClientClose(FastbootSession* session) {
+    if (!session || !session->transport) return;
+    session->transport->close(session->transport);
+    session->transport = NULL;
+}
+
+// Read replies until OKAY, FAIL or DATA. Returns 1 for OKAY, 2 for DATA
+// (data_size set), 0 for FAIL or a broken link.
+static int ReadFastbootReply(FastbootSession* session, char* response, size_t response_size,
+                             unsigned int* data_size) {
+    char reply[FASTBOOT_RESPONSE_MAX + 1];
+
+    while (1) {
+        int len = session->transport->read(session->transport, reply, FASTBOOT_RESPONSE_MAX);
+        if (len < 0) {
+            if (WSAGetLastError() == WSAETIMEDOUT) {
+                SetFastbootError(session, "Connection to device lost (no reply in time)");
+            } else {
+                SetFastbootError(session, "Connection to device lost");
+            }
+            return 0;
+        }
+        if (len < 4) {
+            SetFastbootError(session, "Malformed reply from device");
+            return 0;
+        }
+        reply[len] = '\0';
+        const char* payload = reply + 4;
+
+        if (memcmp(reply, "INFO", 4) == 0 || memcmp(reply, "TEXT", 4) == 0) {
+            if (session->on_info) {
+                session->on_info(payload, session->info_data);
+            } else {
+                printf("(bootloader) %s\n", payload);
+            }
+        } else if (memcmp(reply, "OKAY", 4) == 0) {
+            if (response && response_size > 0) snprintf(response, response_size, "%s", payload);
+            return 1;
+        } else if (memcmp(reply, "FAIL", 4) == 0) {
+            SetFastbootError(session, "remote: '%s'", payload);
+            return 0;
+        } else if (memcmp(reply, "DATA", 4) == 0 && data_size) {
+            *data_size = (unsigned int)strtoul(payload, NULL, 16);
+            return 2;
+        } else {
+            SetFastbootError(session, "Unexpected reply '%.4s' from device", reply);
+            return 0;
+        }
+    }
+}
+
+// Run one command and wait for its outcome
+int FastbootClientCommand(FastbootSession* session, const char* command, char* response, size_t response_size) {
+    if (!session || !session->transport || !command) return 0;
+
+    size_t len = strlen(command);
+    if (len > FASTBOOT_COMMAND_MAX) {
+        SetFastbootError(session, "Command too long");
+        return 0;
+    }
+
+    // Writing or wiping a partition may take minutes before the OKAY
+    int long_running = StringStartsWith(command, "flash:") || StringStartsWith(command, "erase:");
+    if (long_running && session->transport->set_timeout) {
+        session->transport->set_timeout(session->transport, FASTBOOT_LONG_REPLY_TIMEOUT_MS);
+    }
+
+    int ok = 0;
+    if (!session->transport->write(session->transport, command, len)) {
+        SetFastbootError(session, "Connection to device lost");
+    } else {
+        ok = ReadFastbootReply(session, response, response_size, NULL) == 1;
+    }
+
+    if (long_running && session->transport->set_timeout) {
+        session->transport->set_timeout(session->transport, FASTBOOT_REPLY_TIMEOUT_MS);
+    }
+    return ok;
+}
+
+// Read one variable
+int FastbootClientGetVar(FastbootSession* session, const char* name, char* value, size_t value_size) {
+    char command[FASTBOOT_RESPONSE_MAX];
+    snprintf(command, sizeof(command), "getvar:%s", name);
+    return FastbootClientCommand(session, command, value, value_size);
+}
+
+// Download progress across all pieces of one flash
+typedef struct {
+    FastbootSession* session;
+    const char* name;
+    unsigned long long sent;
+    unsigned long long total;
+    ProgressCallback progress;
+    void* user_data;
+} DownloadSink;
+
+// SparseSinkFn: pass image bytes to the device
+static int SendDownloadBytes(const void* data, size_t len, void* user_data) {
+    DownloadSink* sink = (DownloadSink*)user_data;
+    if (!sink->session->transport->write(sink->session->transport, data, len)) {
+        SetFastbootError(sink->session, "Connection to device lost");
+        return 0;
+    }
+    sink->sent += len;
+    if (sink->progress) sink->progress(sink->name, sink->sent, sink->total, sink->user_data);
+    return 1;
+}
+
+// Announce a download of `size` bytes and wait for the device to accept it
+static int BeginDownload(FastbootSession* session, unsigned long long size) {
+    char command[FASTBOOT_COMMAND_MAX];
+    snprintf(command, sizeof(command), "download:%08x", (unsigned int)size);
+    if (!session->transport->write(session->transport, command, strlen(command))) {
+        SetFastbootError(session, "Connection to device lost");
+        return 0;
+    }
+    unsigned int accepted = 0;
+    if (ReadFastbootReply(session, NULL, 0, &accepted) != 2) return 0;
+    if (accepted != (unsigned int)size) {
+        SetFastbootError(session, "Device accepted %u of %llu bytes", accepted, size);
+        return 0;
+    }
+    return 1;
+}
+
+// One download: the whole file (piece NULL) or one sparse piece, then wait for OKAY
+static int DownloadImage(DownloadSink* sink, SparseImage* image, const SparsePiece* piece) {
+    FastbootSession* session = sink->session;
+    unsigned long long size = piece ? piece->size : image->file_size;
+    if (!BeginDownload(session, size)) return 0;
+
+    session->error[0] = '\0';
+    int ok = piece ? SparseImageWritePiece(image, piece, SendDownloadBytes, sink)
+                   : SparseImageWriteFile(image, SendDownloadBytes, sink);
+    if (!ok) {
+        if (!session->error[0]) SetFastbootError(session, "%s", image->error);
+        return 0;
+    }
+    return ReadFastbootReply(session, NULL, 0, NULL) == 1;
+}
+
+// Largest single download: the device's max-download-size, capped by the 32-bit size field
+static unsigned long long GetDownloadLimit(FastbootSession* session) {
+    char value[FASTBOOT_RESPONSE_MAX];
+    unsigned long long max_download = 0;
+    if (FastbootClientGetVar(session, "max-download-size", value, sizeof(value))) {
+        max_download = strtoull(value, NULL, 0);
+    }
+    return (max_download > 0 && max_download < 0xffffffffULL) ? max_download : 0xffffffffULL;
+}
+
+// Flash an opened image. Raw images go out as sparse pieces when that saves
+// at least a quarter of the bytes or the image exceeds max-download-size;
+// sparse images are re-split only when they do not fit.
+int FastbootClientFlashSparse(FastbootSession* session, const char* partition, SparseImage* image,
+                              ProgressCallback progress, void* user_data) {
+    if (!session || !session->transport || !partition || !image) return 0;
+    if (image->file_size == 0) {
+        SetFastbootError(session, "Image for %s is empty", partition);
+        return 0;
+    }
+
+    unsigned long long limit = GetDownloadLimit(session);
+    SparsePiece* pieces = NULL;
+    int piece_count = 0;
+    if (!SparseImagePlan(image, limit, &pieces, &piece_count)) {
+        SetFastbootError(session, "%s", image->error);
+        return 0;
+    }
+    unsigned long long sparse_size = 0;
+    for (int i = 0; i < piece_count; i++) {
+        sparse_size += pieces[i].size;
+    }
+
+    int as_is = image->file_size <= limit && (image->is_sparse || sparse_size * 4 > image->file_size * 3);
+    DownloadSink sink = { session, partition, 0, as_is ? image->file_size : sparse_size, progress, user_data };
+
+    char command[FASTBOOT_COMMAND_MAX];
+    snprintf(command, sizeof(command), "flash:%s", partition);
+    int ok = 1;
+    for (int i = 0; ok && i < (as_is ? 1 : piece_count); i++) {
+        ok = DownloadImage(&sink, image, as_is ? NULL : &pieces[i]) &&
+             FastbootClientCommand(session, command, NULL, 0);
+    }
+
+    free(pieces);
+    return ok;
+}
+
+// Open, scan and flash an image file
+int FastbootClientFlashFile(FastbootSession* session, const char* partition, const char* image_path,
+                            Sha256Context* digest, ProgressCallback progress, void* user_data) {
+    if (!session || !session->transport || !partition || !image_path) return 0;
+
+    SparseImage image;
+    if (!SparseImageOpen(&image, image_path, digest)) {
+        SetFastbootError(session, "%s", image.error);
+        return 0;
+    }
+    int ok = FastbootClientFlashSparse(session, partition, &image, progress, user_data);
+    SparseImageClose(&image);
+    return ok;
+}
+
+// ============================================================================
+// Streamed images
+// ============================================================================
+
+// Packed pieces handed from the packing thread to the uploading one
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    unsigned long long position;        // Producer's input position once the piece was complete
+    int full;
+} StreamSlot;
+
+// Two-slot pipeline between the producer/packer thread and the upload loop
+typedef struct {
+    SRWLOCK lock;
+    CONDITION_VARIABLE changed;
+    StreamSlot slots[2];
+    int fill;                           // Slot the packer writes next
+    int done;                           // Packer finished; ok says how
+    int ok;
+    int cancelled;                      // Upload failed, packer should stop
+    unsigned long long position;        // Advanced by the producer
+    FastbootImageProducer produce;
+    void* produce_data;
+    SparseStream stream;
+    char error[256];
+} StreamPipeline;
+
+// SparseBufferFn: queue a packed piece and wait for a free slot to pack the next one into
+static unsigned char* QueueStreamPiece(unsigned char* buffer, size_t size, unsigned int end_block, void* user_data) {
+    (void)buffer;
+    (void)end_block;
+    StreamPipeline* pipeline = (StreamPipeline*)user_data;
+
+    AcquireSRWLockExclusive(&pipeline->lock);
+    StreamSlot* slot = &pipeline->slots[pipeline->fill];
+    slot->size = size;
+    slot->position = pipeline->position;
+    slot->full = 1;
+    pipeline->fill ^= 1;
+    WakeAllConditionVariable(&pipeline->changed);
+    while (pipeline->slots[pipeline->fill].full && !pipeline->cancelled) {
+        SleepConditionVariableSRW(&pipeline->changed, &pipeline->lock, INFINITE, 0);
+    }
+    unsigned char* next = pipeline->cancelled ? NULL : pipeline->slots[pipeline->fill].data;
+    ReleaseSRWLockExclusive(&pipeline->lock);
+    return next;
+}
+
+// Thread body: run the producer into the packer
+static DWORD WINAPI PackStreamThread(LPVOID param) {
+    StreamPipeline* pipeline = (StreamPipeline*)param;
+    int ok = pipeline->produce(SparseStreamWrite, &pipeline->stream, &pipeline->position, pipeline->produce_data,
+                               pipeline->error, sizeof(pipeline->error)) &&
+             SparseStreamFinish(&pipeline->stream);
+
+    AcquireSRWLockExclusive(&pipeline->lock);
+    pipeline->ok = ok;
+    pipeline->done = 1;
+    WakeAllConditionVariable(&pipeline->changed);
+    ReleaseSRWLockExclusive(&pipeline->lock);
+    return 0;
+}
+
+// Upload one piece; progress moves from `from` to the input position the piece reaches
+static int DownloadStreamPiece(FastbootSession* session, const char* partition, const StreamSlot* piece,
+                               unsigned long long from, unsigned long long total,
+                               ProgressCallback progress, void* user_data) {
+    if (!BeginDownload(session, piece->size)) return 0;
+
+    for (size_t sent = 0; sent < piece->size;) {
+        size_t step = piece->size - sent < FASTBOOT_STREAM_SEND_STEP ? piece->size - sent : FASTBOOT_STREAM_SEND_STEP;
+        if (!session->transport->write(session->transport, piece->data + sent, step)) {
+            SetFastbootError(session, "Connection to device lost");
+            return 0;
+        }
+        sent += step;
+        if (progress) progress(partition, from + (piece->position - from) * sent / piece->size, total, user_data);
+    }
+    return ReadFastbootReply(session, NULL, 0, NULL) == 1;
+}
+
+// Flash an image produced on the fly: a packing thread turns the producer's
+// bytes into sparse pieces while this thread uploads and flashes the previous one
+int FastbootClientFlashStream(FastbootSession* session, const char* partition, unsigned long long total,
+                              FastbootImageProducer produce, void* producer_data,
+                              ProgressCallback progress, void* user_data) {
+    if (!session || !session->transport || !partition || !produce) return 0;
+
+    unsigned long long limit = GetDownloadLimit(session);
+    size_t piece_size = (size_t)(limit < FASTBOOT_STREAM_PIECE_MAX ? limit : FASTBOOT_STREAM_PIECE_MAX);
+    if (piece_size < FASTBOOT_STREAM_PIECE_MIN) {
+        SetFastbootError(session, "Device max-download-size of %llu bytes is too small", limit);
+        return 0;
+    }
+
+    StreamPipeline* pipeline = (StreamPipeline*)SafeCalloc(1, sizeof(StreamPipeline));
+    InitializeSRWLock(&pipeline->lock);
+    InitializeConditionVariable(&pipeline->changed);
+    pipeline->slots[0].data = (unsigned char*)SafeMalloc(piece_size);
+    pipeline->slots[1].data = (unsigned char*)SafeMalloc(piece_size);
+    pipeline->produce = produce;
+    pipeline->produce_data = producer_data;
+    SparseStreamInit(&pipeline->stream, pipeline->slots[0].data, piece_size, 1, QueueStreamPiece, pipeline);
+
+    int ok = 1;
+    HANDLE thread = CreateThread(NULL, 0, PackStreamThread, pipeline, 0, NULL);
+    if (!thread) {
+        SetFastbootError(session, "Cannot start the image stream (error %lu)", GetLastError());
+        ok = 0;
+    }
+
+    char command[FASTBOOT_COMMAND_MAX];
+    snprintf(command, sizeof(command), "flash:%s", partition);
+    unsigned long long flashed = 0;
+    for (int send = 0; ok; send ^= 1) {
+        AcquireSRWLockExclusive(&pipeline->lock);
+        while (!pipeline->slots[send].full && !pipeline->done) {
+            SleepConditionVariableSRW(&pipeline->changed, &pipeline->lock, INFINITE, 0);
+        }
+        StreamSlot piece = pipeline->slots[send];
+        ReleaseSRWLockExclusive(&pipeline->lock);
+        if (!piece.full) break;
+
+        ok = DownloadStreamPiece(session, partition, &piece, flashed, total, progress, user_data) &&
+             FastbootClientCommand(session, command, NULL, 0);
+        flashed = piece.position;
+
+        AcquireSRWLockExclusive(&pipeline->lock);
+        pipeline->slots[send].full = 0;
+        if (!ok) pipeline->cancelled = 1;
+        WakeAllConditionVariable(&pipeline->changed);
+        ReleaseSRWLockExclusive(&pipeline->lock);
+    }
+
+    if (thread) {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+        // A packer stopped by a failed upload has nothing to add to the session's error
+        if (ok && !pipeline->ok) {
+            ok = 0;
+            if (pipeline->stream.failed) {
+                SetFastbootError(session, "%s", pipeline->stream.error);
+            } else {
+                SetFastbootError(session, "%s", pipeline->error[0] ? pipeline->error : "Reading the image failed");
+            }
+        }
+    }
+
+    SparseStreamFree(&pipeline->stream);
+    free(pipeline->slots[0].data);
+    free(pipeline->slots[1].data);
+    free(pipeline);
+    return ok;
+}
+
+// Output collected for FastbootClientRun
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} RunOutput;
+
+// Append text to a RunOutput
+static void AppendRunOutput(RunOutput* output, const char* text) {
+    size_t len = strlen(text);
+    if (output->size + len + 1 > output->capacity) {
+        while (output->size + len + 1 > output->capacity) {
+            output->capacity = output->capacity ? output->capacity * 2 : 256;
+        }
+        output->data = (char*)SafeRealloc(output->data, output->capacity);
+    }
+    memcpy(output->data + output->size, text, len + 1);
+    output->size += len;
+}
+
+// FastbootInfoCallback collecting "(bootloader) ..." lines
+static void CollectInfoLine(const char* line, void* user_data) {
+    RunOutput* output = (RunOutput*)user_data;
+    AppendRunOutput(output, "(bootloader) ");
+    AppendRunOutput(output, line);
+    AppendRunOutput(output, "\n");
+}
+
+// One command in its own session; output mimics fastboot.exe ("name: value" for getvar)
+ProcessResult* FastbootClientRun(const char* device_serial, const char* command) {
+    ProcessResult* result = (ProcessResult*)SafeCalloc(1, sizeof(ProcessResult));
+    RunOutput out = {0}, err = {0};
+    AppendRunOutput(&out, "");
+    AppendRunOutput(&err, "");
+
+    FastbootSession session;
+    int ok = FastbootClientOpen(&session, device_serial);
+    if (ok) {
+        session.on_info = CollectInfoLine;
+        session.info_data = &out;
+
+        char response[FASTBOOT_RESPONSE_MAX];
+        ok = FastbootClientCommand(&session, command, response, sizeof(response));
+        if (ok && StringStartsWith(command, "getvar:") && strcmp(command + 7, "all") != 0) {
+            AppendRunOutput(&out, command + 7);
+            AppendRunOutput(&out, ": ");
+            AppendRunOutput(&out, response);
+            AppendRunOutput(&out, "\n");
+        } else if (ok && response[0]) {
+            AppendRunOutput(&out, response);
+            AppendRunOutput(&out, "\n");
+        }
+        FastbootClientClose(&session);
+    }
+
+    if (!ok) {
+        AppendRunOutput(&err, "FAILED (");
+        AppendRunOutput(&err, session.error);
+        AppendRunOutput(&err, ")\n");
+    }
+
+    result->stdout_data = out.data;
+    result->stdout_size = out.size;
+    result->stderr_data = err.data;
+    result->stderr_size = err.size;
+    result->exit_code = ok ? 0 : 1;
+    return result;
+}
+
+// ============================================================================
+// Network Device List
+// ============================================================================
+
+// Remember a network device (returns 0 if the list is full)
+int FastbootClientAddNetworkDevice(const char* device_serial) {
+    if (!FastbootClientSupports(device_serial) || strlen(device_serial) >= sizeof(g_network_devices[0])) return 0;
+
+    AcquireSRWLockExclusive(&g_network_lock);
+    int found = 0;
+    for (int i = 0; i < g_network_device_count && !found; i++) {
+        found = strcmp(g_network_devices[i], device_serial) == 0;
+    }
+    int ok = found || g_network_device_count < FASTBOOT_MAX_NETWORK_DEVICES;
+    if (!found && ok) {
+        strcpy(g_network_devices[g_network_device_count++], device_serial);
+    }
+    ReleaseSRWLockExclusive(&g_network_lock);
+    return ok;
+}
+
+// Forget a network device (returns 0 if it was not listed)
+int FastbootClientRemoveNetworkDevice(const char* device_serial) {
+    if (!device_serial) return 0;
+
+    AcquireSRWLockExclusive(&g_network_lock);
+    int removed = 0;
+    for (int i = 0; i < g_network_device_count && !removed; i++) {
+        if (strcmp(g_network_devices[i], device_serial) == 0) {
+            memmove(g_network_devices[i], g_network_devices[i + 1],
+                    (size_t)(g_network_device_count - i - 1) * sizeof(g_network_devices[0]));
+            g_network_device_count--;
+            removed = 1;
+        }
+    }
+    ReleaseSRWLockExclusive(&g_network_lock);
+    return removed;
+}
+
+// Network devices as "serial\tfastboot" lines, the format of "fastboot devices"
+void FastbootClientListNetworkDevices(char* buffer, size_t size) {
+    if (!buffer || size == 0) return;
+    buffer[0] = '\0';
+
+    AcquireSRWLockShared(&g_network_lock);
+    size_t used = 0;
+    for (int i = 0; i < g_network_device_count; i++) {
+        int written = snprintf(buffer + used, size - used, "%s\tfastboot\n", g_network_devices[i]);
+        if (written < 0 || (size_t)written >= size - used) break;
+        used += (size_t)written;
+    }
+    ReleaseSRWLockShared(&g_network_lock);
+}
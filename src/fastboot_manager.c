@@ -1,23 +1,381 @@
 #include "fastboot_manager.h"
 #include "fastboot_wrapper.h"
+#include "fastboot_client.h"
+#include "flash_plan.h"
+#include "fastboot_var_cache.h"
+#include "flash_ledger.h"
+#include "image_check.h"
 #include "adb_wrapper.h"
 #include "device_manager.h"
+#include "progress.h"
+#include "sha256.h"
 #include "utils.h"
 #include <stdio.h>
 #include <conio.h>
+#include <ctype.h>
 
 // Note: GetSelectedFastbootDevice is declared in device_manager.h
 // We use it directly from there
 
+// Console state while fastboot.exe flashes: its step lines plus a progress bar
+typedef struct {
+    ProgressTracker tracker;
+    char line[512];
+    size_t line_len;
+    unsigned long long in_flight;       // Size of the "Sending ..." step awaiting OKAY
+    unsigned long long sent;
+} FlashOutput;
+
+// Track "Sending [sparse] 'x' [i/n] (N KB)" ... "OKAY" steps from fastboot.exe output
+static void FlashOutputCallback(const char* data, size_t len, int is_stderr, void* user_data) {
+    (void)is_stderr;
+    FlashOutput* output = (FlashOutput*)user_data;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (c != '\n' && c != '\r' && output->line_len < sizeof(output->line) - 1) {
+            output->line[output->line_len++] = c;
+            output->line[output->line_len] = '\0';
+
+            // fastboot prints the step, then appends OKAY to the same line once it is done
+            if (output->in_flight == 0 && StringStartsWith(output->line, "Sending")) {
+                const char* size = strrchr(output->line, '(');
+                unsigned long long kb = 0;
+                if (size && sscanf(size, "(%llu KB)", &kb) == 1 && strstr(size, ")")) {
+                    output->in_flight = kb * 1024;
+                }
+            }
+            continue;
+        }
+        if (output->line_len == 0) continue;
+
+        if (output->in_flight > 0 && strstr(output->line, "OKAY")) {
+            output->sent += output->in_flight;
+        }
+        output->in_flight = 0;
+
+        ProgressClearLine(&output->tracker);
+        printf("%s\n", output->line);
+        ProgressUpdate(&output->tracker, output->sent);
+        ProgressRedraw(&output->tracker);
+        output->line_len = 0;
+        output->line[0] = '\0';
+    }
+}
+
+// Size of an image file (0 if it cannot be read)
+static unsigned long long GetImageFileSize(const char* path) {
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) return 0;
+    return ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+}
+
+// Image hashed alongside fastboot.exe, which reads the same file (the reads share the file cache)
+typedef struct {
+    const char* path;
+    char hex[SHA256_HEX_SIZE];
+    int ok;
+} ImageHashJob;
+
+// Thread body for ImageHashJob
+static DWORD WINAPI HashImageThread(LPVOID param) {
+    ImageHashJob* job = (ImageHashJob*)param;
+    job->ok = Sha256File(job->path, job->hex);
+    return 0;
+}
+
+// Report the flashed image's digest and compare it with the expected one
+static int CheckImageDigest(const ImageHashJob* job, const char* expected_sha256) {
+    if (!job->ok) {
+        PrintError(ADB_ERROR_FLASH_FAILED, "Could not hash the image for verification");
+        return 0;
+    }
+
+    printf("Image SHA-256: %s\n", job->hex);
+    if (!expected_sha256 || !*expected_sha256) {
+        printf("Fastboot cannot read partitions back; compare this with the image's published checksum.\n");
+        return 1;
+    }
+
+    char expected[SHA256_HEX_SIZE];
+    snprintf(expected, sizeof(expected), "%s", expected_sha256);
+    for (char* p = expected; *p; p++) {
+        *p = (char)tolower((unsigned char)*p);
+    }
+    if (strlen(expected_sha256) != SHA256_HEX_SIZE - 1 || strcmp(expected, job->hex) != 0) {
+        PrintError(ADB_ERROR_FLASH_FAILED, "Image does not match the expected SHA-256; reflash a good copy");
+        return 0;
+    }
+    printf("Verified: image matches the expected SHA-256.\n");
+    return 1;
+}
+
+// Show bootloader INFO lines above the progress bar
+static void FlashInfoCallback(const char* line, void* user_data) {
+    ProgressTracker* tracker = (ProgressTracker*)user_data;
+    ProgressClearLine(tracker);
+    printf("(bootloader) %s\n", line);
+    ProgressRedraw(tracker);
+}
+
+// Flash an opened image over a native session under a progress bar
+static int FlashSparseNative(FastbootSession* session, const AdbDevice* device, const char* partition,
+                             SparseImage* image, const char* status) {
+    // A new super image redefines the logical partitions and their sizes
+    if (StringStartsWith(partition, "super")) FastbootVarCacheInvalidate(device->serial_id);
+
+    ProgressTracker tracker;
+    ProgressStart(&tracker, "flash", device->serial_id, partition, image->file_size);
+    if (status) snprintf(tracker.status, sizeof(tracker.status), "%s", status);
+    session->on_info = FlashInfoCallback;
+    session->info_data = &tracker;
+
+    int success = FastbootClientFlashSparse(session, partition, image, ProgressTrackerCallback, &tracker);
+    ProgressFinish(&tracker, success);
+    session->on_info = NULL;
+    session->info_data = NULL;
+
+    if (!success) PrintError(ADB_ERROR_FLASH_FAILED, session->error);
+    return success;
+}
+
+// FlashPlanStream for FastbootClientFlashStream
+typedef struct {
+    FlashPlan* plan;
+    int index;
+    Sha256Context* digest;
+} PlanImageProducer;
+
+// FastbootImageProducer: unzip or decompress a plan image
+static int ProducePlanImage(SparseSinkFn write, void* write_data, unsigned long long* position, void* user_data,
+                            char* error, size_t error_size) {
+    PlanImageProducer* producer = (PlanImageProducer*)user_data;
+    return FlashPlanStream(producer->plan, producer->index, write, write_data, producer->digest, position,
+                           error, error_size);
+}
+
+// Stream a compressed image or zip entry over a native session, decompressing
+// it on the way; nothing lands on disk
+static int FlashStreamNative(FastbootSession* session, const AdbDevice* device, FlashPlan* plan, int index,
+                             Sha256Context* digest, const char* status) {
+    const FlashPlanImage* image = &plan->images[index];
+    if (StringStartsWith(image->partition, "super")) FastbootVarCacheInvalidate(device->serial_id);
+
+    ProgressTracker tracker;
+    ProgressStart(&tracker, "flash", device->serial_id, image->partition, image->size);
+    if (status) snprintf(tracker.status, sizeof(tracker.status), "%s", status);
+    session->on_info = FlashInfoCallback;
+    session->info_data = &tracker;
+
+    PlanImageProducer producer = { plan, index, digest };
+    int success = FastbootClientFlashStream(session, image->partition, image->size, ProducePlanImage, &producer,
+                                            ProgressTrackerCallback, &tracker);
+    ProgressFinish(&tracker, success);
+    session->on_info = NULL;
+    session->info_data = NULL;
+
+    if (!success) PrintError(ADB_ERROR_FLASH_FAILED, session->error);
+    return success;
+}
+
+// File name part of an image path or zip entry
+static const char* ImageDisplayName(const char* path) {
+    const char* name = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') name = p + 1;
+    }
+    return name;
+}
+
+// Flash over the native client (network devices); the image is hashed while it is scanned
+static int FlashImageNative(const AdbDevice* device, const char* partition, const char* image_path,
+                            ImageHashJob* hash_job) {
+    FastbootSession session;
+    if (!FastbootClientOpen(&session, device->serial_id)) {
+        PrintError(ADB_ERROR_FLASH_FAILED, session.error);
+        return 0;
+    }
+
+    Sha256Context digest;
+    Sha256Init(&digest);
+    SparseImage image;
+    if (!SparseImageOpen(&image, image_path, hash_job ? &digest : NULL)) {
+        PrintError(ADB_ERROR_FLASH_FAILED, image.error);
+        FastbootClientClose(&session);
+        return 0;
+    }
+
+    int success = FlashSparseNative(&session, device, partition, &image, NULL);
+    SparseImageClose(&image);
+    FastbootClientClose(&session);
+
+    if (success && hash_job) {
+        unsigned char hash[SHA256_DIGEST_SIZE];
+        Sha256Final(&digest, hash);
+        Sha256ToHex(hash, hash_job->hex);
+        hash_job->ok = 1;
+    }
+    return success;
+}
+
+// Flash with fastboot.exe, showing its sending/writing steps under a progress bar
+static int FlashWithFastbootExe(AppState* state, const AdbDevice* device, const char* partition,
+                                const char* image_path, const char* status) {
+    FlashOutput output;
+    memset(&output, 0, sizeof(output));
+    ProgressStart(&output.tracker, "flash", device->serial_id, partition, GetImageFileSize(image_path));
+    if (status) snprintf(output.tracker.status, sizeof(output.tracker.status), "%s", status);
+
+    ProcessResult* result = FastbootFlashStreaming(state->fastboot_path, device->serial_id,
+                                                   partition, image_path, FlashOutputCallback, &output);
+    if (output.line_len > 0) {
+        ProgressClearLine(&output.tracker);
+        printf("%s\n", output.line);
+    }
+
+    // Sparse images send a little more than their file size; the bar is capped at 100%
+    int success = result && result->exit_code == 0;
+    ProgressFinish(&output.tracker, success);
+    if (result) FreeProcessResult(result);
+    return success;
+}
+
+// Flash a compressed image or zip entry: streamed straight to native
+// sessions, through a sparse temporary file for fastboot.exe. --verify hashes
+// the decompressed image.
+static int FlashPackedImage(AppState* state, const AdbDevice* device, FlashPlan* plan,
+                            int verify, const char* expected_sha256) {
+    const char* partition = plan->images[0].partition;
+    Sha256Context digest;
+    Sha256Init(&digest);
+
+    int success;
+    if (FastbootClientSupports(device->serial_id)) {
+        FastbootSession session;
+        if (!FastbootClientOpen(&session, device->serial_id)) {
+            PrintError(ADB_ERROR_FLASH_FAILED, session.error);
+            return 0;
+        }
+        success = FlashStreamNative(&session, device, plan, 0, verify ? &digest : NULL, NULL);
+        FastbootClientClose(&session);
+    } else {
+        char path[MAX_PATH];
+        char error[512] = "";
+        int is_temp = 0;
+        printf("Unpacking %s into %s...\n", ImageDisplayName(plan->images[0].image), plan->temp_dir);
+        success = FlashPlanPrepare(plan, 0, path, sizeof(path), &is_temp, verify ? &digest : NULL,
+                                   error, sizeof(error));
+        if (!success) {
+            PrintError(ADB_ERROR_FLASH_FAILED, error);
+        } else if (!(success = FlashWithFastbootExe(state, device, partition, path, NULL))) {
+            PrintError(ADB_ERROR_FLASH_FAILED, "Failed to flash partition");
+        }
+        if (is_temp) DeleteFileA(path);
+    }
+    if (!success) return 0;
+
+    printf("\nPartition flashed successfully.\n");
+    if (!verify) return 1;
+
+    ImageHashJob hash_job;
+    memset(&hash_job, 0, sizeof(hash_job));
+    unsigned char hash[SHA256_DIGEST_SIZE];
+    Sha256Final(&digest, hash);
+    Sha256ToHex(hash, hash_job.hex);
+    hash_job.ok = 1;
+    return CheckImageDigest(&hash_job, expected_sha256);
+}
+
+// Flash a plain image file: over the native client, or with fastboot.exe
+// while another thread hashes the same file for --verify
+static int FlashPlainImage(AppState* state, const AdbDevice* device, const char* partition, const char* image_path,
+                           int verify, const char* expected_sha256) {
+    ImageHashJob hash_job;
+    memset(&hash_job, 0, sizeof(hash_job));
+    hash_job.path = image_path;
+
+    if (FastbootClientSupports(device->serial_id)) {
+        if (!FlashImageNative(device, partition, image_path, verify ? &hash_job : NULL)) return 0;
+        printf("\nPartition flashed successfully.\n");
+        return verify ? CheckImageDigest(&hash_job, expected_sha256) : 1;
+    }
+
+    HANDLE hash_thread = verify ? CreateThread(NULL, 0, HashImageThread, &hash_job, 0, NULL) : NULL;
+    int success = FlashWithFastbootExe(state, device, partition, image_path, NULL);
+    if (hash_thread) {
+        WaitForSingleObject(hash_thread, INFINITE);
+        CloseHandle(hash_thread);
+    } else if (verify) {
+        HashImageThread(&hash_job);
+    }
+
+    if (success) {
+        printf("\nPartition flashed successfully.\n");
+        if (verify) success = CheckImageDigest(&hash_job, expected_sha256);
+    } else {
+        PrintError(ADB_ERROR_FLASH_FAILED, "Failed to flash partition");
+    }
+    return success;
+}
+
+// ============================================================================
+// Flash Ledger
+// ============================================================================
+
+// Image fingerprint, worked out before the flash or on its own thread during it
+typedef struct {
+    FlashFingerprint fingerprint;
+    int described;
+    int ok;
+} ImageFingerprintJob;
+
+// Thread body for ImageFingerprintJob
+static DWORD WINAPI FingerprintImageThread(LPVOID param) {
+    ImageFingerprintJob* job = (ImageFingerprintJob*)param;
+    job->ok = job->described && FlashFingerprintCompute(&job->fingerprint);
+    return 0;
+}
+
+// Whether the ledger says the partition already holds this image
+static int IsImageUnchanged(const AdbDevice* device, const char* key, const char* fingerprint) {
+    FlashLedgerEntry entry;
+    if (!fingerprint || !FlashLedgerFind(device->serial_id, key, &entry) || strcmp(entry.fingerprint, fingerprint) != 0) {
+        return 0;
+    }
+    printf("%s already holds this image (flashed %s); skipped.\n", key, entry.timestamp);
+    return 1;
+}
+
+// Ledger row for a flash: the fingerprint after a success, an erased row
+// after a failure (the partition may be half written). A new super image also
+// invalidates the logical partitions; callers do that once no session is open,
+// as it may have to query the device.
+static void RecordFlash(const AdbDevice* device, const char* key, const char* slot, const char* fingerprint,
+                        unsigned long long size, const char* image, int success) {
+    if (!FlashLedgerRecord(device->serial_id, slot, key, success ? fingerprint : NULL, size, ImageDisplayName(image))) {
+        printf("Note: could not update %s.\n", FLASH_LEDGER_FILE);
+    }
+}
+
+// Erased row for a partition that fastboot changed without an image
+static void ForgetPartition(AppState* state, const AdbDevice* device, const char* partition) {
+    char key[96];
+    char slot[16];
+    FlashLedgerPartitionKey(state->fastboot_path, device->serial_id, partition, key, sizeof(key), slot, sizeof(slot));
+    FlashLedgerRecord(device->serial_id, slot, key, NULL, 0, "(erased)");
+    if (StringStartsWith(key, "super")) FlashLedgerForgetLogical(state->fastboot_path, device->serial_id);
+}
+
 // Flash image to partition
-int FlashImage(AppState* state, const char* partition, const char* image_path) {
+int FlashImage(AppState* state, const char* partition, const char* image_path,
+               int verify, const char* expected_sha256, int skip_unchanged, int check_image) {
     if (!state || !partition || !image_path) {
         PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
         return 0;
     }
 
     // Check if device is selected
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected. Use 'fb_select' first.");
         return 0;
@@ -29,6 +387,58 @@ int FlashImage(AppState* state, const char* partition, const char* image_path) {
         return 0;
     }
 
+    // Compressed files and zip entries are unpacked on the way to the device
+    FlashPlan* plan = (FlashPlan*)SafeCalloc(1, sizeof(FlashPlan));
+    snprintf(plan->temp_root, sizeof(plan->temp_root), "%s", state->temp_dir);
+    if (!FlashPlanLoadImage(plan, partition, image_path)) {
+        PrintError(ADB_ERROR_IMAGE_NOT_FOUND, plan->error);
+        FlashPlanFree(plan);
+        free(plan);
+        return 0;
+    }
+    const FlashPlanImage* packed = FlashPlanNeedsUnpacking(plan, 0) ? &plan->images[0] : NULL;
+
+    // fastboot.exe reads a file, so a packed image is unpacked to disk first
+    int unpack_to_disk = packed && !FastbootClientSupports(device->serial_id);
+    char temp_error[512];
+    if (unpack_to_disk && !FlashPlanCheckTempSpace(plan, packed->size, temp_error, sizeof(temp_error))) {
+        PrintError(ADB_ERROR_FLASH_FAILED, temp_error);
+        FlashPlanFree(plan);
+        free(plan);
+        return 0;
+    }
+
+    // The ledger needs the image's fingerprint; --skip-unchanged needs it before anything is sent
+    char key[96];
+    char slot[16];
+    FlashLedgerPartitionKey(state->fastboot_path, device->serial_id, partition, key, sizeof(key), slot, sizeof(slot));
+
+    // A wrong or truncated image is turned down before anything is sent
+    ImageCheck check;
+    memset(&check, 0, sizeof(check));
+    if (check_image && !ImageCheckPlanImage(plan, 0, key, state->fastboot_path, device->serial_id, &check)) {
+        PrintError(ADB_ERROR_INVALID_PARTITION, check.error);
+        printf("Use --no-check to flash it anyway.\n");
+        FlashPlanFree(plan);
+        free(plan);
+        return 0;
+    }
+
+    ImageFingerprintJob* fingerprint = (ImageFingerprintJob*)SafeCalloc(1, sizeof(ImageFingerprintJob));
+    fingerprint->described = FlashFingerprintInit(&fingerprint->fingerprint, plan, 0);
+    if (skip_unchanged) {
+        FingerprintImageThread(fingerprint);
+        if (!fingerprint->ok) {
+            printf("Note: cannot fingerprint the image (%s); flashing it anyway.\n", fingerprint->fingerprint.error);
+        } else if (IsImageUnchanged(device, key, fingerprint->fingerprint.hex)) {
+            FlashFingerprintFree(&fingerprint->fingerprint);
+            free(fingerprint);
+            FlashPlanFree(plan);
+            free(plan);
+            return 1;
+        }
+    }
+
     // Warning and confirmation
     printf("\n");
     printf("========================================\n");
@@ -36,6 +446,23 @@ int FlashImage(AppState* state, const char* partition, const char* image_path) {
     printf("========================================\n");
     printf("Partition: %s\n", partition);
     printf("Image: %s\n", image_path);
+    if (check.summary[0]) printf("Contents: %s\n", check.summary);
+    if (packed && packed->payload_partition >= 0) {
+        const PayloadPartition* source = &plan->payload.partitions[packed->payload_partition];
+        printf("Payload: %s, %d operations (decoded while flashing)\n", source->name, source->operation_count);
+    } else if (packed && packed->super_partition >= 0) {
+        const SuperPartition* source = &plan->super.partitions[packed->super_partition];
+        printf("Super image: %s, %d extents (read while flashing)\n", source->name, source->extent_count);
+    } else if (packed && packed->zip_entry >= 0) {
+        printf("Entry: %s (unpacked while flashing)\n", packed->image);
+    } else if (packed) {
+        printf("Compression: %s (decompressed while flashing)\n", CompressionName(packed->compression));
+    }
+    if (unpack_to_disk) {
+        char size[32];
+        FormatByteCount(packed->size, size, sizeof(size));
+        printf("Temporary copy: up to %s in %s (for fastboot.exe)\n", size, plan->temp_dir);
+    }
     printf("Device: %s\n", device->serial_id);
     printf("\n");
     printf("WARNING: This will replace the current data on partition '%s'!\n", partition);
@@ -46,37 +473,420 @@ int FlashImage(AppState* state, const char* partition, const char* image_path) {
     char confirm = _getch();
     printf("%c\n", confirm);
 
+    int success = 0;
     if (confirm != 'y' && confirm != 'Y') {
         printf("Operation cancelled.\n");
+    } else {
+        printf("\nFlashing %s partition...\n", partition);
+        HANDLE fingerprint_thread = NULL;
+        if (!skip_unchanged) {
+            fingerprint_thread = CreateThread(NULL, 0, FingerprintImageThread, fingerprint, 0, NULL);
+        }
+
+        if (packed) {
+            success = FlashPackedImage(state, device, plan, verify, expected_sha256);
+        } else {
+            success = FlashPlainImage(state, device, partition, image_path, verify, expected_sha256);
+        }
+
+        if (fingerprint_thread) {
+            WaitForSingleObject(fingerprint_thread, INFINITE);
+            CloseHandle(fingerprint_thread);
+        } else if (!skip_unchanged) {
+            FingerprintImageThread(fingerprint);
+        }
+        RecordFlash(device, key, slot, fingerprint->ok ? fingerprint->fingerprint.hex : NULL, plan->images[0].size,
+                    plan->images[0].image, success);
+        if (StringStartsWith(key, "super")) FlashLedgerForgetLogical(state->fastboot_path, device->serial_id);
+    }
+
+    FlashFingerprintFree(&fingerprint->fingerprint);
+    free(fingerprint);
+    FlashPlanFree(plan);
+    free(plan);
+    return success;
+}
+
+// ============================================================================
+// Flash All
+// ============================================================================
+
+// Image made ready (unpacked, scanned) while the previous one uploads
+typedef struct {
+    FlashPlan* plan;
+    int index;
+    int native;                         // Also open it as a SparseImage
+    int stream;                         // Native and packed: decompressed while it uploads instead
+    char path[MAX_PATH];
+    int is_temp;
+    SparseImage image;
+    int image_open;
+    char fingerprint[SHA256_HEX_SIZE];  // For the ledger; "" if it could not be worked out
+    int ok;
+    char error[512];
+} PreparedImage;
+
+// Thread body for PreparedImage
+static DWORD WINAPI PrepareImageThread(LPVOID param) {
+    PreparedImage* job = (PreparedImage*)param;
+    if (!job->fingerprint[0]) {
+        FlashFingerprint fingerprint;
+        if (FlashFingerprintInit(&fingerprint, job->plan, job->index) && FlashFingerprintCompute(&fingerprint)) {
+            snprintf(job->fingerprint, sizeof(job->fingerprint), "%s", fingerprint.hex);
+        }
+        FlashFingerprintFree(&fingerprint);
+    }
+    if (job->stream) {
+        job->ok = 1;
         return 0;
     }
+    job->ok = FlashPlanPrepare(job->plan, job->index, job->path, sizeof(job->path), &job->is_temp, NULL,
+                               job->error, sizeof(job->error));
+    if (job->ok && job->native) {
+        job->ok = job->image_open = SparseImageOpen(&job->image, job->path, NULL);
+        if (!job->ok) snprintf(job->error, sizeof(job->error), "%s", job->image.error);
+    }
+    return 0;
+}
 
-    printf("\nFlashing %s partition...\n", partition);
+// Start preparing plan image `index` in the background (inline if no thread can
+// be made); its fingerprint is worked out there unless it is already known
+static HANDLE StartPrepare(PreparedImage* job, FlashPlan* plan, int index, int native, const char* fingerprint) {
+    memset(job, 0, sizeof(*job));
+    job->plan = plan;
+    job->index = index;
+    job->native = native;
+    snprintf(job->fingerprint, sizeof(job->fingerprint), "%s", fingerprint);
+    job->stream = native && FlashPlanNeedsUnpacking(plan, index);
+    HANDLE thread = CreateThread(NULL, 0, PrepareImageThread, job, 0, NULL);
+    if (!thread) PrepareImageThread(job);
+    return thread;
+}
 
-    ProcessResult* result = FastbootFlash(state->fastboot_path, device->serial_id,
-                                          partition, image_path);
-    if (!result) {
-        PrintError(ADB_ERROR_FLASH_FAILED, "Failed to flash partition");
+// Wait for a prepare thread
+static void FinishPrepare(HANDLE thread) {
+    if (!thread) return;
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+// Drop a prepared image and its temporary file
+static void ReleasePreparedImage(PreparedImage* job) {
+    if (job->image_open) SparseImageClose(&job->image);
+    job->image_open = 0;
+    if (job->is_temp) DeleteFileA(job->path);
+    job->is_temp = 0;
+}
+
+// Ledger state of one flashall image
+typedef struct {
+    char key[96];
+    char slot[16];
+    char fingerprint[SHA256_HEX_SIZE];  // Known up front with --skip-unchanged
+    int unchanged;
+} FlashAllLedger;
+
+// Every planned partition must be one the device reports right now: the
+// bootloader lists physical partitions, fastbootd also lists the logical ones
+// inside super and is the only mode that can write them. Some bootloaders
+// (older Qualcomm ABLs among them) report no partition sizes at all; names
+// are then only warned about, not refused. Prints each problem; returns 0 if
+// there is any.
+static int CheckFlashAllPartitions(AppState* state, const AdbDevice* device, const FlashPlan* plan,
+                                   const FlashAllLedger* ledger) {
+    if (!FastbootVarCacheLoad(state->fastboot_path, device->serial_id)) {
+        PrintError(ADB_ERROR_FASTBOOT_FAILED, "Cannot read the device's partition list (getvar all failed)");
         return 0;
     }
 
-    int success = (result->exit_code == 0);
+    int is_userspace = 0;
+    FastbootVarCacheGetIsUserspace(state->fastboot_path, device->serial_id, &is_userspace);
+    char first_partition[1][64];
+    int lists_partitions = is_userspace || FastbootVarCacheListPartitions(device->serial_id, first_partition, 1) > 0;
+
+    int problems = 0;
+    int unverified = 0;
+    for (int i = 0; i < plan->count; i++) {
+        char name[128], value[FASTBOOT_VAR_MAX_LEN];
+        snprintf(name, sizeof(name), "partition-size:%s", ledger[i].key);
+        int known = FastbootVarCacheGet(state->fastboot_path, device->serial_id, name, value, sizeof(value));
+        snprintf(name, sizeof(name), "is-logical:%s", ledger[i].key);
+        int logical = 0;
+        if (FastbootVarCacheGet(state->fastboot_path, device->serial_id, name, value, sizeof(value))) {
+            known = 1;
+            logical = _stricmp(value, "yes") == 0;
+        }
 
-    if (result->stdout_data && strlen(result->stdout_data) > 0) {
-        printf("%s\n", result->stdout_data);
+        if (!known && !lists_partitions) {
+            unverified++;
+        } else if (!known) {
+            printf("%s: the device reports no partition %s%s\n", plan->images[i].partition, ledger[i].key,
+                   is_userspace ? "" : " (logical partitions are only listed in fastbootd)");
+            problems++;
+        } else if (logical && !is_userspace) {
+            printf("%s: %s is a logical partition, which only fastbootd can flash\n", plan->images[i].partition,
+                   ledger[i].key);
+            problems++;
+        }
     }
 
-    if (result->stderr_data && strlen(result->stderr_data) > 0) {
-        fprintf(stderr, "%s\n", result->stderr_data);
+    if (unverified > 0) {
+        printf("Warning: the bootloader lists no partition sizes, so %d partition name%s could not be checked.\n",
+               unverified, unverified == 1 ? "" : "s");
+    }
+    if (problems > 0 && !is_userspace) printf("Use 'fb_reboot fastboot' to enter fastbootd, then retry.\n");
+    return problems == 0;
+}
+
+// Flash every image of a manifest, folder or factory zip after one confirmation.
+// Image N+1 is unpacked and scanned while image N uploads; network devices
+// take compressed images and zip entries as a stream instead.
+int FlashAll(AppState* state, const char* source, const char* slot, int reboot, const char* reboot_mode,
+             int skip_unchanged, int check_images) {
+    if (!state || !source) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
+        return 0;
+    }
+
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
+    if (!device) {
+        PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected. Use 'fb_select' first.");
+        return 0;
+    }
+
+    FlashPlan* plan = (FlashPlan*)SafeCalloc(1, sizeof(FlashPlan));
+    snprintf(plan->temp_root, sizeof(plan->temp_root), "%s", state->temp_dir);
+    if (!FlashPlanLoad(plan, source)) {
+        PrintError(ADB_ERROR_IMAGE_NOT_FOUND, plan->error);
+        FlashPlanFree(plan);
+        free(plan);
+        return 0;
+    }
+    if (slot) snprintf(plan->set_active, sizeof(plan->set_active), "%s", slot);
+    if (reboot) {
+        plan->reboot = 1;
+        snprintf(plan->reboot_mode, sizeof(plan->reboot_mode), "%s", reboot_mode ? reboot_mode : "");
+    }
+
+    FlashAllLedger* ledger = (FlashAllLedger*)SafeCalloc(plan->count, sizeof(FlashAllLedger));
+    for (int i = 0; i < plan->count; i++) {
+        FlashLedgerPartitionKey(state->fastboot_path, device->serial_id, plan->images[i].partition, ledger[i].key,
+                                sizeof(ledger[i].key), ledger[i].slot, sizeof(ledger[i].slot));
+    }
+
+    // Every image is checked before any is sent, so a bad one cannot stop the set halfway
+    ImageCheck* checks = (ImageCheck*)SafeCalloc(plan->count, sizeof(ImageCheck));
+    if (check_images) {
+        int rejected = CheckFlashAllPartitions(state, device, plan, ledger) ? 0 : 1;
+        for (int i = 0; i < plan->count; i++) {
+            if (!ImageCheckPlanImage(plan, i, ledger[i].key, state->fastboot_path, device->serial_id, &checks[i])) {
+                printf("%s (%s): %s\n", plan->images[i].partition, ImageDisplayName(plan->images[i].image),
+                       checks[i].error);
+                rejected++;
+            }
+        }
+        if (rejected > 0) {
+            PrintError(ADB_ERROR_INVALID_PARTITION, "Image check failed; nothing was flashed");
+            printf("Use --no-check to flash anyway.\n");
+            free(checks);
+            free(ledger);
+            FlashPlanFree(plan);
+            free(plan);
+            return 0;
+        }
+    }
+
+    // --skip-unchanged fingerprints every image now; otherwise each one is
+    // fingerprinted while the one before it uploads
+    int* order = (int*)SafeMalloc(plan->count * sizeof(int));
+    int to_flash = 0;
+    if (skip_unchanged) printf("Fingerprinting %d image%s...\n", plan->count, plan->count == 1 ? "" : "s");
+    for (int i = 0; i < plan->count; i++) {
+        if (skip_unchanged) {
+            FlashFingerprint fingerprint;
+            if (FlashFingerprintInit(&fingerprint, plan, i) && FlashFingerprintCompute(&fingerprint)) {
+                snprintf(ledger[i].fingerprint, sizeof(ledger[i].fingerprint), "%s", fingerprint.hex);
+                FlashLedgerEntry entry;
+                ledger[i].unchanged = FlashLedgerFind(device->serial_id, ledger[i].key, &entry) &&
+                                      strcmp(entry.fingerprint, fingerprint.hex) == 0;
+            }
+            FlashFingerprintFree(&fingerprint);
+        }
+        if (!ledger[i].unchanged) order[to_flash++] = i;
+    }
+
+    // fastboot.exe reads files: packed images are unpacked to disk, one
+    // uploading while the next is unpacked, so the two largest must fit
+    int native = to_flash > 0 && FastbootClientSupports(device->serial_id);
+    unsigned long long temp_needed = 0;
+    if (!native) {
+        unsigned long long largest[2] = { 0, 0 };
+        for (int k = 0; k < to_flash; k++) {
+            if (!FlashPlanNeedsUnpacking(plan, order[k])) continue;
+            unsigned long long size = plan->images[order[k]].size;
+            if (size > largest[0]) {
+                largest[1] = largest[0];
+                largest[0] = size;
+            } else if (size > largest[1]) {
+                largest[1] = size;
+            }
+        }
+        temp_needed = largest[0] + largest[1];
+    }
+    char temp_error[512];
+    if (temp_needed > 0 && !FlashPlanCheckTempSpace(plan, temp_needed, temp_error, sizeof(temp_error))) {
+        PrintError(ADB_ERROR_FLASH_FAILED, temp_error);
+        free(order);
+        free(checks);
+        free(ledger);
+        FlashPlanFree(plan);
+        free(plan);
+        return 0;
+    }
+
+    printf("\n");
+    printf("========================================\n");
+    printf("     FLASH ALL WARNING\n");
+    printf("========================================\n");
+    printf("Source: %s\n", source);
+    printf("Device: %s\n", device->serial_id);
+    printf("\n");
+    printf("  #  %-20s %10s  %s\n", "Partition", "Size", "Image");
+    for (int i = 0; i < plan->count; i++) {
+        const FlashPlanImage* image = &plan->images[i];
+        char size[32];
+        FormatByteCount(image->size, size, sizeof(size));
+        printf("%3d  %-20s %10s  %s%s%s%s%s%s%s\n", i + 1, image->partition, size, ImageDisplayName(image->image),
+               image->compression != COMPRESSION_NONE ? ", " : "",
+               image->compression != COMPRESSION_NONE ? CompressionName(image->compression) : "",
+               checks[i].summary[0] ? "  [" : "", checks[i].summary, checks[i].summary[0] ? "]" : "",
+               ledger[i].unchanged ? "  (unchanged, skipped)" : "");
+    }
+    printf("\n");
+    if (temp_needed > 0) {
+        char size[32];
+        FormatByteCount(temp_needed, size, sizeof(size));
+        printf("Temporary copies: up to %s at a time in %s (for fastboot.exe)\n", size, plan->temp_dir);
+    }
+    if (plan->set_active[0]) printf("Then: activate slot %s\n", plan->set_active);
+    if (plan->reboot) printf("Then: reboot%s%s\n", plan->reboot_mode[0] ? " " : "", plan->reboot_mode);
+    printf("WARNING: This will replace the current data on %d partition%s!\n", to_flash,
+           to_flash == 1 ? "" : "s");
+    printf("Press 'y' to confirm, any other key to cancel: ");
+
+    char confirm = _getch();
+    printf("%c\n", confirm);
+    if (confirm != 'y' && confirm != 'Y') {
+        printf("Operation cancelled.\n");
+        free(order);
+        free(checks);
+        free(ledger);
+        FlashPlanFree(plan);
+        free(plan);
+        return 0;
+    }
+
+    FastbootSession session;
+    if (native && !FastbootClientOpen(&session, device->serial_id)) {
+        PrintError(ADB_ERROR_FLASH_FAILED, session.error);
+        free(order);
+        free(checks);
+        free(ledger);
+        FlashPlanFree(plan);
+        free(plan);
+        return 0;
     }
 
+    ULONGLONG start_tick = GetTickCount64();
+    PreparedImage* jobs = (PreparedImage*)SafeCalloc(2, sizeof(PreparedImage));
+    HANDLE threads[2] = { NULL, NULL };
+    if (to_flash > 0) threads[0] = StartPrepare(&jobs[0], plan, order[0], native, ledger[order[0]].fingerprint);
+
+    int flashed = 0;
+    int super_flashed = 0;
+    for (int k = 0; k < to_flash; k++) {
+        int i = order[k];
+        PreparedImage* job = &jobs[k % 2];
+        FinishPrepare(threads[k % 2]);
+        threads[k % 2] = NULL;
+        if (k + 1 < to_flash) {
+            int next = order[k + 1];
+            threads[(k + 1) % 2] = StartPrepare(&jobs[(k + 1) % 2], plan, next, native, ledger[next].fingerprint);
+        }
+
+        const char* partition = plan->images[i].partition;
+        int success = job->ok;
+        if (!success) {
+            PrintError(ADB_ERROR_FLASH_FAILED, job->error);
+        } else {
+            char status[32];
+            snprintf(status, sizeof(status), "[%d/%d]", k + 1, to_flash);
+            if (job->stream) {
+                success = FlashStreamNative(&session, device, plan, i, NULL, status);
+            } else if (native) {
+                success = FlashSparseNative(&session, device, partition, &job->image, status);
+            } else {
+                success = FlashWithFastbootExe(state, device, partition, job->path, status);
+            }
+            if (!success && !native) PrintError(ADB_ERROR_FLASH_FAILED, "Failed to flash partition");
+            RecordFlash(device, ledger[i].key, ledger[i].slot, job->fingerprint[0] ? job->fingerprint : NULL,
+                        plan->images[i].size, plan->images[i].image, success);
+            if (StringStartsWith(ledger[i].key, "super")) super_flashed = 1;
+        }
+        ReleasePreparedImage(job);
+
+        if (!success) {
+            printf("Stopped at %s; the images after it were not flashed.\n", partition);
+            break;
+        }
+        flashed++;
+    }
+
+    // A failure leaves the next image's preparation running
+    for (int i = 0; i < 2; i++) {
+        FinishPrepare(threads[i]);
+        if (threads[i]) ReleasePreparedImage(&jobs[i]);
+    }
+    free(jobs);
+    if (native) FastbootClientClose(&session);
+    if (super_flashed) FlashLedgerForgetLogical(state->fastboot_path, device->serial_id);
+
+    int success = flashed == to_flash;
     if (success) {
-        printf("\nPartition flashed successfully.\n");
-    } else {
-        PrintError(ADB_ERROR_FLASH_FAILED, "Failed to flash partition");
+        int skipped = plan->count - to_flash;
+        printf("\nFlashed %d image%s in %.1f s", flashed, flashed == 1 ? "" : "s",
+               (GetTickCount64() - start_tick) / 1000.0);
+        if (skipped > 0) printf("; %d unchanged image%s skipped", skipped, skipped == 1 ? "" : "s");
+        printf(".\n");
     }
 
-    FreeProcessResult(result);
+    if (success && plan->set_active[0]) {
+        ProcessResult* result = FastbootActivateSlot(state->fastboot_path, device->serial_id, plan->set_active);
+        success = result && result->exit_code == 0;
+        if (success) {
+            printf("Slot %s is now active.\n", plan->set_active);
+        } else {
+            PrintError(ADB_ERROR_FASTBOOT_FAILED, "Failed to activate slot");
+        }
+        if (result) FreeProcessResult(result);
+    }
+
+    if (success && plan->reboot) {
+        ProcessResult* result = FastbootReboot(state->fastboot_path, device->serial_id,
+                                               plan->reboot_mode[0] ? plan->reboot_mode : NULL);
+        if (result && result->exit_code == 0) {
+            printf("Rebooting...\n");
+        } else {
+            PrintError(ADB_ERROR_FASTBOOT_FAILED, "Failed to reboot device");
+        }
+        if (result) FreeProcessResult(result);
+    }
+
+    free(order);
+    free(checks);
+    free(ledger);
+    FlashPlanFree(plan);
+    free(plan);
     return success;
 }
 
@@ -87,7 +897,7 @@ int ErasePartition(AppState* state, const char* partition) {
         return 0;
     }
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected");
         return 0;
@@ -121,6 +931,8 @@ int ErasePartition(AppState* state, const char* partition) {
         return 0;
     }
 
+    // Whatever the outcome, the ledger no longer knows what the partition holds
+    ForgetPartition(state, device, partition);
     int success = (result->exit_code == 0);
 
     if (result->stdout_data && strlen(result->stdout_data) > 0) {
@@ -148,7 +960,7 @@ int FormatPartition(AppState* state, const char* partition, const char* fs_type)
         return 0;
     }
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected");
         return 0;
@@ -163,6 +975,8 @@ int FormatPartition(AppState* state, const char* partition, const char* fs_type)
         return 0;
     }
 
+    // Whatever the outcome, the ledger no longer knows what the partition holds
+    ForgetPartition(state, device, partition);
     int success = (result->exit_code == 0);
 
     if (result->stdout_data && strlen(result->stdout_data) > 0) {
@@ -187,7 +1001,7 @@ int FormatPartition(AppState* state, const char* partition, const char* fs_type)
 int UnlockBootloader(AppState* state) {
     if (!state) return 0;
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected");
         return 0;
@@ -253,7 +1067,7 @@ int UnlockBootloader(AppState* state) {
 int LockBootloader(AppState* state) {
     if (!state) return 0;
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected");
         return 0;
@@ -317,7 +1131,7 @@ int ExecuteOemCommand(AppState* state, const char* oem_cmd) {
         return 0;
     }
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected");
         return 0;
@@ -349,12 +1163,12 @@ int ExecuteOemCommand(AppState* state, const char* oem_cmd) {
 int RebootFastbootDevice(AppState* state, const char* mode) {
     if (!state) return 0;
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         // Try to refresh device list and auto-select
         RefreshFastbootDeviceList(state);
 
-        if (state->fastboot_device_count > 0) {
+        if (GetFastbootDeviceCount(state) > 0) {
             SelectFastbootDevice(state, 0);
             device = GetSelectedFastbootDevice(state);
         }
@@ -397,44 +1211,57 @@ int RebootFastbootDevice(AppState* state, const char* mode) {
     return success;
 }
 
-// Get fastboot variable
+// FastbootVarVisitor printing "name: value"
+static void PrintFastbootVar(const char* name, const char* value, void* user_data) {
+    (void)user_data;
+    printf("%s: %s\n", name, value);
+}
+
+// Get fastboot variable (from the getvar all snapshot when it has it)
 int GetFastbootVar(AppState* state, const char* var_name) {
     if (!state) return 0;
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected");
         return 0;
     }
 
-    if (var_name) {
-        printf("Getting variable: %s\n", var_name);
-        ProcessResult* result = FastbootGetVar(state->fastboot_path, device->serial_id, var_name);
-
-        if (result && result->stdout_data) {
-            printf("%s\n", result->stdout_data);
-        }
-
-        if (result) {
-            FreeProcessResult(result);
-            return (result->exit_code == 0);
-        }
-        return 0;
-    } else {
-        // Get all variables
+    if (!var_name || strcmp(var_name, "all") == 0) {
+        // Asked for everything: take a fresh snapshot
         printf("Getting all variables...\n");
-        ProcessResult* result = FastbootGetAllVars(state->fastboot_path, device->serial_id);
-
-        if (result && result->stdout_data) {
-            printf("%s\n", result->stdout_data);
+        FastbootVarCacheInvalidate(device->serial_id);
+        if (!FastbootVarCacheLoad(state->fastboot_path, device->serial_id)) {
+            PrintError(ADB_ERROR_FASTBOOT_FAILED, "Failed to read device variables");
+            return 0;
         }
+        FastbootVarCacheForEach(device->serial_id, PrintFastbootVar, NULL);
+        return 1;
+    }
 
-        if (result) {
-            FreeProcessResult(result);
-            return (result->exit_code == 0);
-        }
+    char value[FASTBOOT_VAR_MAX_LEN];
+    if (FastbootVarCacheGet(state->fastboot_path, device->serial_id, var_name, value, sizeof(value))) {
+        printf("%s: %s\n", var_name, value);
+        return 1;
+    }
+
+    // Not every variable is listed by getvar all; ask for it directly
+    ProcessResult* result = FastbootGetVar(state->fastboot_path, device->serial_id, var_name);
+    if (!result) {
+        PrintError(ADB_ERROR_FASTBOOT_FAILED, "Failed to read device variable");
         return 0;
     }
+
+    int success = (result->exit_code == 0);
+    if (result->stdout_data && strlen(result->stdout_data) > 0) {
+        printf("%s\n", result->stdout_data);
+    }
+    if (result->stderr_data && strlen(result->stderr_data) > 0) {
+        fprintf(stderr, "%s\n", result->stderr_data);
+    }
+
+    FreeProcessResult(result);
+    return success;
 }
 
 // Activate fastboot slot
@@ -451,7 +1278,7 @@ int ActivateFastbootSlot(AppState* state, const char* slot) {
         return 0;
     }
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected");
         return 0;
@@ -492,7 +1319,7 @@ int WipeFastbootPartition(AppState* state, const char* partition) {
         return 0;
     }
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected");
         return 0;
@@ -526,6 +1353,8 @@ int WipeFastbootPartition(AppState* state, const char* partition) {
         return 0;
     }
 
+    // Whatever the outcome, the ledger no longer knows what the partition holds
+    ForgetPartition(state, device, partition);
     int success = (result->exit_code == 0);
 
     if (result->stdout_data && strlen(result->stdout_data) > 0) {
@@ -550,7 +1379,7 @@ int WipeFastbootPartition(AppState* state, const char* partition) {
 int ShowFastbootDeviceInfo(AppState* state) {
     if (!state) return 0;
 
-    AdbDevice* device = GetSelectedFastbootDevice(state);
+    const AdbDevice* device = GetSelectedFastbootDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, "No fastboot device selected");
         return 0;
@@ -563,15 +1392,64 @@ int ShowFastbootDeviceInfo(AppState* state) {
     printf("Serial: %s\n", device->serial_id);
     printf("Status: %s\n", device->status);
 
-    // Get additional info
-    printf("\nGetting device variables...\n");
+    if (!FastbootVarCacheLoad(state->fastboot_path, device->serial_id)) {
+        printf("\nCould not read device variables.\n");
+        printf("========================================\n");
+        return 1;
+    }
 
-    ProcessResult* result = FastbootGetAllVars(state->fastboot_path, device->serial_id);
-    if (result && result->stdout_data) {
-        printf("%s\n", result->stdout_data);
+    static const struct { const char* name; const char* label; } fields[] = {
+        { "product", "Product" },
+        { "variant", "Variant" },
+        { "version-bootloader", "Bootloader" },
+        { "version-baseband", "Baseband" },
+        { "secure", "Secure" },
+        { "unlocked", "Unlocked" },
+        { "slot-count", "Slots" },
+    };
+
+    printf("\n");
+    char value[FASTBOOT_VAR_MAX_LEN];
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (FastbootVarCacheGet(state->fastboot_path, device->serial_id, fields[i].name, value, sizeof(value))) {
+            printf("%-20s %s\n", fields[i].label, value);
+        }
     }
 
-    if (result) FreeProcessResult(result);
+    char slot[16];
+    if (FastbootVarCacheGetCurrentSlot(state->fastboot_path, device->serial_id, slot, sizeof(slot))) {
+        printf("%-20s %s\n", "Current slot", slot);
+    }
+
+    int is_userspace = 0;
+    if (FastbootVarCacheGetIsUserspace(state->fastboot_path, device->serial_id, &is_userspace)) {
+        printf("%-20s %s\n", "Mode", is_userspace ? "fastbootd (userspace)" : "bootloader");
+    }
+
+    unsigned long long max_download = 0;
+    if (FastbootVarCacheGetMaxDownloadSize(state->fastboot_path, device->serial_id, &max_download)) {
+        char size_text[32];
+        FormatByteCount(max_download, size_text, sizeof(size_text));
+        printf("%-20s %s\n", "Max download size", size_text);
+    }
+
+    // Partition table from the partition-size variables
+    char (*partitions)[64] = (char (*)[64])SafeMalloc(FASTBOOT_MAX_PARTITIONS * sizeof(*partitions));
+    int partition_count = FastbootVarCacheListPartitions(device->serial_id, partitions, FASTBOOT_MAX_PARTITIONS);
+    if (partition_count > 0) {
+        printf("\n%-28s %12s\n", "Partition", "Size");
+        for (int i = 0; i < partition_count; i++) {
+            char name[FASTBOOT_VAR_MAX_LEN];
+            snprintf(name, sizeof(name), "partition-size:%s", partitions[i]);
+            // Bare names of slotted partitions have no size of their own; their _a/_b copies are listed
+            if (!FastbootVarCacheGet(state->fastboot_path, device->serial_id, name, value, sizeof(value))) continue;
+
+            char size_text[32];
+            FormatByteCount(strtoull(value, NULL, 0), size_text, sizeof(size_text));
+            printf("%-28s %12s\n", partitions[i], size_text);
+        }
+    }
+    free(partitions);
 
     printf("========================================\n");
 
@@ -0,0 +1,462 @@
+#include "fastboot_var_cache.h"
+#include "fastboot_wrapper.h"
+#include "adb_wrapper.h"
+#include "fastboot_client.h"
+#include "process_runner.h"
+#include "utils.h"
+#include <ctype.h>
+
+// Fewer devices sit in fastboot at once than in adb; the least recently used is evicted beyond this
+#define MAX_VAR_CACHES 32
+#define MIN_VAR_TABLE 64
+
+// getvar all waits for the device; give up on one that never answers
+#define GETVAR_ALL_TIMEOUT_MS 15000
+
+typedef struct {
+    char name[FASTBOOT_VAR_MAX_LEN];
+    char value[FASTBOOT_VAR_MAX_LEN];
+    unsigned int hash;
+} FastbootVar;
+
+typedef struct {
+    char serial[256];
+    int in_use;
+    int loaded;             // Variable table is valid
+    FastbootVar* vars;      // Device order
+    int count;
+    int* slots;             // Indexes into vars, -1 when empty
+    size_t capacity;        // Power of two
+    ULONGLONG last_used;
+} DeviceVarCache;
+
+static DeviceVarCache g_var_caches[MAX_VAR_CACHES];
+static SRWLOCK g_var_lock = SRWLOCK_INIT;
+
+// Variables that take an argument ("partition-size:<name>: <value>")
+static const char* PARAMETERIZED_VARS[] = {
+    "partition-size", "partition-type", "has-slot", "is-logical",
+    "slot-successful", "slot-unbootable", "slot-retry-count", NULL
+};
+
+// Find a variable in a table; returns its index in vars or -1
+static int LookupVar(const FastbootVar* vars, const int* slots, size_t capacity, const char* name) {
+    if (capacity == 0) return -1;
+
+    unsigned int hash = HashString(name);
+    size_t mask = capacity - 1;
+    size_t index = hash & mask;
+
+    while (slots[index] >= 0) {
+        const FastbootVar* var = &vars[slots[index]];
+        if (var->hash == hash && strcmp(var->name, name) == 0) return slots[index];
+        index = (index + 1) & mask;
+    }
+    return -1;
+}
+
+// Hash slot for a new variable (the table always has spare slots)
+static void IndexVar(const FastbootVar* vars, int* slots, size_t capacity, int var_index) {
+    size_t mask = capacity - 1;
+    size_t index = vars[var_index].hash & mask;
+    while (slots[index] >= 0) index = (index + 1) & mask;
+    slots[index] = var_index;
+}
+
+// Where the name ends in "name: value" / "name:value" / "partition-size:boot_a:0x..."
+static char* FindVarSeparator(char* body) {
+    char* separator = strstr(body, ": ");
+    if (separator) return separator;
+
+    char* colon = strchr(body, ':');
+    if (!colon) return NULL;
+
+    // Without a space the argument of a parameterized variable is still part of the name
+    for (int i = 0; PARAMETERIZED_VARS[i] != NULL; i++) {
+        size_t len = strlen(PARAMETERIZED_VARS[i]);
+        if ((size_t)(colon - body) == len && strncmp(body, PARAMETERIZED_VARS[i], len) == 0) {
+            char* second = strchr(colon + 1, ':');
+            return second ? second : colon;
+        }
+    }
+    return colon;
+}
+
+// Append text to a value, truncating at the buffer size
+static void AppendVarValue(FastbootVar* var, const char* text) {
+    size_t len = strlen(var->value);
+    snprintf(var->value + len, sizeof(var->value) - len, "%s", text);
+}
+
+// Parse "(bootloader) name: value" lines and build the hash table. Values
+// some bootloaders split as name[0], name[1], ... or over plain follow-up
+// lines are joined.
+static void BuildVarTable(char* dump, FastbootVar** vars_out, int* count_out,
+                          int** slots_out, size_t* capacity_out) {
+    size_t lines = 0;
+    for (const char* p = dump; *p; p++) {
+        if (*p == '\n') lines++;
+    }
+    size_t capacity = MIN_VAR_TABLE;
+    while (capacity < (lines + 1) * 2) capacity *= 2;
+
+    FastbootVar* vars = (FastbootVar*)SafeCalloc(lines + 1, sizeof(FastbootVar));
+    int* slots = (int*)SafeMalloc(capacity * sizeof(int));
+    memset(slots, 0xff, capacity * sizeof(int));
+    int count = 0;
+    FastbootVar* last = NULL;
+
+    char* line = dump;
+    while (line && *line) {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+
+        // Only device output carries the prefix; fastboot.exe's own status lines are skipped
+        if (!StringStartsWith(line, "(bootloader)")) {
+            line = next;
+            continue;
+        }
+        char* body = TrimString(line + strlen("(bootloader)"));
+        if (!body[0]) {
+            line = next;
+            continue;
+        }
+
+        char* separator = FindVarSeparator(body);
+        if (!separator) {
+            // Continuation of the previous value
+            if (last) AppendVarValue(last, body);
+            line = next;
+            continue;
+        }
+
+        *separator = '\0';
+        char* name = TrimString(body);
+        char* value = TrimString(separator + 1);
+
+        // name[N] pieces of one long value
+        int is_piece = 0;
+        size_t name_len = strlen(name);
+        if (name_len > 3 && name[name_len - 1] == ']') {
+            char* open = strrchr(name, '[');
+            if (open && open > name && isdigit((unsigned char)open[1])) {
+                *open = '\0';
+                is_piece = 1;
+            }
+        }
+
+        if (!name[0] || strlen(name) >= FASTBOOT_VAR_MAX_LEN) {
+            last = NULL;
+            line = next;
+            continue;
+        }
+
+        int existing = LookupVar(vars, slots, capacity, name);
+        if (existing >= 0) {
+            last = &vars[existing];
+            if (is_piece) {
+                AppendVarValue(last, value);
+            } else {
+                snprintf(last->value, sizeof(last->value), "%s", value);
+            }
+        } else {
+            last = &vars[count];
+            snprintf(last->name, sizeof(last->name), "%s", name);
+            snprintf(last->value, sizeof(last->value), "%s", value);
+            last->hash = HashString(last->name);
+            IndexVar(vars, slots, capacity, count);
+            count++;
+        }
+
+        line = next;
+    }
+
+    *vars_out = vars;
+    *count_out = count;
+    *slots_out = slots;
+    *capacity_out = capacity;
+}
+
+// Release a slot's data (caller holds the lock exclusively)
+static void ResetCache(DeviceVarCache* cache) {
+    SAFE_FREE(cache->vars);
+    SAFE_FREE(cache->slots);
+    cache->count = 0;
+    cache->capacity = 0;
+    cache->loaded = 0;
+    cache->in_use = 0;
+    cache->serial[0] = '\0';
+}
+
+// Find the slot for a serial (caller holds the lock)
+static DeviceVarCache* FindCache(const char* serial) {
+    for (int i = 0; i < MAX_VAR_CACHES; i++) {
+        if (g_var_caches[i].in_use && strcmp(g_var_caches[i].serial, serial) == 0) {
+            return &g_var_caches[i];
+        }
+    }
+    return NULL;
+}
+
+// Find or claim a slot for a serial, evicting the oldest (caller holds the lock exclusively)
+static DeviceVarCache* ClaimCache(const char* serial) {
+    DeviceVarCache* cache = FindCache(serial);
+    if (cache) return cache;
+
+    DeviceVarCache* victim = NULL;
+    for (int i = 0; i < MAX_VAR_CACHES; i++) {
+        DeviceVarCache* candidate = &g_var_caches[i];
+        if (!candidate->in_use) {
+            victim = candidate;
+            break;
+        }
+        if (!victim || candidate->last_used < victim->last_used) {
+            victim = candidate;
+        }
+    }
+
+    ResetCache(victim);
+    strncpy(victim->serial, serial, sizeof(victim->serial) - 1);
+    victim->serial[sizeof(victim->serial) - 1] = '\0';
+    victim->in_use = 1;
+    victim->last_used = GetTickCount64();
+    return victim;
+}
+
+// Run getvar all; fastboot.exe prints the variables on stderr
+static ProcessResult* FetchAllVars(const char* fastboot_path, const char* device_serial) {
+    if (FastbootClientSupports(device_serial)) {
+        return FastbootGetAllVars(fastboot_path, device_serial);
+    }
+
+    const char* args[] = { "-s", device_serial, "getvar", "all" };
+    ProcessOptions options = {0};
+    options.timeout_ms = GETVAR_ALL_TIMEOUT_MS;
+    return RunProcessEx(fastboot_path, args, 4, &options);
+}
+
+// Make sure the snapshot for a device is loaded (returns 0 if getvar all failed)
+int FastbootVarCacheLoad(const char* fastboot_path, const char* device_serial) {
+    if (!device_serial) return 0;
+    if (FastbootVarCacheIsLoaded(device_serial)) return 1;
+
+    ProcessResult* result = FetchAllVars(fastboot_path, device_serial);
+    if (!result || result->exit_code != 0) {
+        FreeProcessResult(result);
+        return 0;
+    }
+
+    size_t out_len = result->stdout_data ? strlen(result->stdout_data) : 0;
+    size_t err_len = result->stderr_data ? strlen(result->stderr_data) : 0;
+    char* dump = (char*)SafeMalloc(out_len + err_len + 2);
+    snprintf(dump, out_len + err_len + 2, "%s\n%s",
+             result->stdout_data ? result->stdout_data : "",
+             result->stderr_data ? result->stderr_data : "");
+    FreeProcessResult(result);
+
+    FastbootVar* vars = NULL;
+    int* slots = NULL;
+    int count = 0;
+    size_t capacity = 0;
+    BuildVarTable(dump, &vars, &count, &slots, &capacity);
+    free(dump);
+
+    if (count == 0) {
+        free(vars);
+        free(slots);
+        return 0;
+    }
+
+    AcquireSRWLockExclusive(&g_var_lock);
+    DeviceVarCache* cache = ClaimCache(device_serial);
+    if (!cache->loaded) {
+        cache->vars = vars;
+        cache->count = count;
+        cache->slots = slots;
+        cache->capacity = capacity;
+        cache->loaded = 1;
+        cache->last_used = GetTickCount64();
+        vars = NULL;
+        slots = NULL;
+    }
+    ReleaseSRWLockExclusive(&g_var_lock);
+
+    // Another thread won the race; keep its copy
+    free(vars);
+    free(slots);
+    return 1;
+}
+
+// Whether a snapshot is loaded, without fetching one
+int FastbootVarCacheIsLoaded(const char* device_serial) {
+    if (!device_serial) return 0;
+
+    AcquireSRWLockShared(&g_var_lock);
+    DeviceVarCache* cache = FindCache(device_serial);
+    int loaded = cache && cache->loaded;
+    ReleaseSRWLockShared(&g_var_lock);
+    return loaded;
+}
+
+// Look up one variable; loads the snapshot on first use. Returns 1 if found.
+int FastbootVarCacheGet(const char* fastboot_path, const char* device_serial, const char* name,
+                        char* value_out, size_t value_size) {
+    if (!name || !value_out || value_size == 0) return 0;
+    value_out[0] = '\0';
+
+    if (!FastbootVarCacheLoad(fastboot_path, device_serial)) return 0;
+
+    int found = 0;
+    AcquireSRWLockShared(&g_var_lock);
+    DeviceVarCache* cache = FindCache(device_serial);
+    int index = (cache && cache->loaded) ? LookupVar(cache->vars, cache->slots, cache->capacity, name) : -1;
+    if (index >= 0) {
+        strncpy(value_out, cache->vars[index].value, value_size - 1);
+        value_out[value_size - 1] = '\0';
+        found = 1;
+    }
+    ReleaseSRWLockShared(&g_var_lock);
+
+    return found;
+}
+
+// Numeric variable, hex ("0x...") or decimal
+static int GetVarNumber(const char* fastboot_path, const char* device_serial, const char* name,
+                        unsigned long long* value_out) {
+    char value[FASTBOOT_VAR_MAX_LEN];
+    if (!FastbootVarCacheGet(fastboot_path, device_serial, name, value, sizeof(value))) return 0;
+
+    char* end = NULL;
+    unsigned long long number = strtoull(value, &end, 0);
+    if (end == value) return 0;
+
+    *value_out = number;
+    return 1;
+}
+
+// Largest single download the device accepts
+int FastbootVarCacheGetMaxDownloadSize(const char* fastboot_path, const char* device_serial,
+                                       unsigned long long* size_out) {
+    if (!size_out) return 0;
+    return GetVarNumber(fastboot_path, device_serial, "max-download-size", size_out) && *size_out > 0;
+}
+
+// Active slot without the underscore ("a", "b"); 0 on devices without slots
+int FastbootVarCacheGetCurrentSlot(const char* fastboot_path, const char* device_serial,
+                                   char* slot_out, size_t slot_size) {
+    if (!slot_out || slot_size == 0) return 0;
+
+    char value[FASTBOOT_VAR_MAX_LEN];
+    if (!FastbootVarCacheGet(fastboot_path, device_serial, "current-slot", value, sizeof(value))) return 0;
+
+    const char* slot = (value[0] == '_') ? value + 1 : value;
+    if (!slot[0]) return 0;
+    snprintf(slot_out, slot_size, "%s", slot);
+    return 1;
+}
+
+// 1 in fastbootd (userspace), 0 in the bootloader
+int FastbootVarCacheGetIsUserspace(const char* fastboot_path, const char* device_serial, int* is_userspace_out) {
+    if (!is_userspace_out) return 0;
+
+    char value[FASTBOOT_VAR_MAX_LEN];
+    if (!FastbootVarCacheGet(fastboot_path, device_serial, "is-userspace", value, sizeof(value))) return 0;
+
+    *is_userspace_out = (_stricmp(value, "yes") == 0);
+    return 1;
+}
+
+// Size of a partition; a slotted name without suffix means the current slot's copy
+int FastbootVarCacheGetPartitionSize(const char* fastboot_path, const char* device_serial,
+                                     const char* partition, unsigned long long* size_out) {
+    if (!partition || !size_out) return 0;
+
+    char name[FASTBOOT_VAR_MAX_LEN];
+    snprintf(name, sizeof(name), "partition-size:%s", partition);
+    if (GetVarNumber(fastboot_path, device_serial, name, size_out)) return 1;
+
+    char slot[16];
+    if (!FastbootVarCacheGetCurrentSlot(fastboot_path, device_serial, slot, sizeof(slot))) return 0;
+
+    snprintf(name, sizeof(name), "partition-size:%s_%s", partition, slot);
+    return GetVarNumber(fastboot_path, device_serial, name, size_out);
+}
+
+// Walk a loaded snapshot (never fetches); returns the number of variables
+int FastbootVarCacheForEach(const char* device_serial, FastbootVarVisitor visit, void* user_data) {
+    if (!device_serial || !visit) return 0;
+
+    int count = 0;
+    AcquireSRWLockShared(&g_var_lock);
+    DeviceVarCache* cache = FindCache(device_serial);
+    if (cache && cache->loaded) {
+        for (count = 0; count < cache->count; count++) {
+            visit(cache->vars[count].name, cache->vars[count].value, user_data);
+        }
+    }
+    ReleaseSRWLockShared(&g_var_lock);
+
+    return count;
+}
+
+// Add a name unless already listed
+static int AddPartitionName(char (*names)[64], int count, int max_count, const char* name, size_t len) {
+    if (count >= max_count || len == 0 || len >= 64) return count;
+    for (int i = 0; i < count; i++) {
+        if (strlen(names[i]) == len && strncmp(names[i], name, len) == 0) return count;
+    }
+    memcpy(names[count], name, len);
+    names[count][len] = '\0';
+    return count + 1;
+}
+
+// Partition names from a loaded snapshot (never fetches)
+int FastbootVarCacheListPartitions(const char* device_serial, char (*names)[64], int max_count) {
+    if (!device_serial || !names) return 0;
+
+    static const char PREFIX[] = "partition-size:";
+    int count = 0;
+
+    AcquireSRWLockShared(&g_var_lock);
+    DeviceVarCache* cache = FindCache(device_serial);
+    if (cache && cache->loaded) {
+        for (int i = 0; i < cache->count; i++) {
+            if (!StringStartsWith(cache->vars[i].name, PREFIX)) continue;
+            const char* partition = cache->vars[i].name + strlen(PREFIX);
+            size_t len = strlen(partition);
+
+            // boot_a/boot_b are also offered as plain boot when the device says it is slotted
+            if (len > 2 && partition[len - 2] == '_') {
+                char has_slot[FASTBOOT_VAR_MAX_LEN];
+                snprintf(has_slot, sizeof(has_slot), "has-slot:%.*s", (int)(len - 2), partition);
+                int index = LookupVar(cache->vars, cache->slots, cache->capacity, has_slot);
+                if (index >= 0 && _stricmp(cache->vars[index].value, "yes") == 0) {
+                    count = AddPartitionName(names, count, max_count, partition, len - 2);
+                }
+            }
+            count = AddPartitionName(names, count, max_count, partition, len);
+        }
+    }
+    ReleaseSRWLockShared(&g_var_lock);
+
+    return count;
+}
+
+// Drop cached data for one device
+void FastbootVarCacheInvalidate(const char* device_serial) {
+    if (!device_serial) return;
+
+    AcquireSRWLockExclusive(&g_var_lock);
+    DeviceVarCache* cache = FindCache(device_serial);
+    if (cache) ResetCache(cache);
+    ReleaseSRWLockExclusive(&g_var_lock);
+}
+
+// Drop everything (called on exit)
+void FastbootVarCacheClear(void) {
+    AcquireSRWLockExclusive(&g_var_lock);
+    for (int i = 0; i < MAX_VAR_CACHES; i++) {
+        ResetCache(&g_var_caches[i]);
+    }
+    ReleaseSRWLockExclusive(&g_var_lock);
+}
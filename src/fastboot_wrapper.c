@@ -1,29 +1,20 @@
 #include "fastboot_wrapper.h"
+#include "fastboot_client.h"
+#include "fastboot_var_cache.h"
 #include "utils.h"
+#include "process_runner.h"
 #include <stdarg.h>
 
-// Read output from pipe into buffer (same as adb_wrapper)
-static void ReadOutputToBuffer(HANDLE hRead, char** data, size_t* size) {
-    DWORD buffer_size = 4096;
-    *data = (char*)SafeMalloc(buffer_size);
-    *size = 0;
-
-    DWORD bytes_read;
-    char temp[4096];
-    while (ReadFile(hRead, temp, sizeof(temp), &bytes_read, NULL) && bytes_read > 0) {
-        if (*size + bytes_read >= buffer_size) {
-            buffer_size *= 2;
-            *data = (char*)SafeRealloc(*data, buffer_size);
-        }
-        memcpy(*data + *size, temp, bytes_read);
-        *size += bytes_read;
-    }
+// Send one protocol command through the native client (network devices)
+static ProcessResult* RunNativeCommand(const char* device_serial, const char* format, ...) {
+    char command[FASTBOOT_COMMAND_MAX + 1];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(command, sizeof(command), format, args);
+    va_end(args);
+    if (len < 0 || len > FASTBOOT_COMMAND_MAX) return NULL;
 
-    // Null-terminate
-    if (*size + 1 >= buffer_size) {
-        *data = (char*)SafeRealloc(*data, buffer_size + 1);
-    }
-    (*data)[*size] = '\0';
+    return FastbootClientRun(device_serial, command);
 }
 
 // Spawn fastboot.exe and capture output
@@ -32,94 +23,20 @@ ProcessResult* RunFastbootCommand(const char* fastboot_path, const char* args[],
         return NULL;
     }
 
-    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
-    HANDLE stdout_read, stdout_write;
-    HANDLE stderr_read, stderr_write;
-
-    // Create pipes for stdout and stderr
-    if (!CreatePipe(&stdout_read, &stdout_write, &sa, 0) ||
-        !CreatePipe(&stderr_read, &stderr_write, &sa, 0)) {
-        return NULL;
-    }
-
-    // Set read handles to not be inherited
-    SetHandleInformation(stdout_read, HANDLE_FLAG_INHERIT, 0);
-    SetHandleInformation(stderr_read, HANDLE_FLAG_INHERIT, 0);
-
-    // Build command line
-    size_t cmdline_size = strlen(fastboot_path) + 4;
-    for (int i = 0; i < arg_count; i++) {
-        cmdline_size += strlen(args[i]) + 3;
-    }
-
-    char* cmdline = (char*)SafeMalloc(cmdline_size);
-    snprintf(cmdline, cmdline_size, "\"%s\"", fastboot_path);
-    for (int i = 0; i < arg_count; i++) {
-        strcat(cmdline, " ");
-        if (strchr(args[i], ' ')) {
-            strcat(cmdline, "\"");
-            strcat(cmdline, args[i]);
-            strcat(cmdline, "\"");
-        } else {
-            strcat(cmdline, args[i]);
-        }
-    }
+    return RunProcessEx(fastboot_path, args, arg_count, NULL);
+}
 
-    // Setup startup info
-    STARTUPINFOA si = { sizeof(STARTUPINFOA) };
-    si.dwFlags = STARTF_USESTDHANDLES;
-    si.hStdOutput = stdout_write;
-    si.hStdError = stderr_write;
-    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
-
-    PROCESS_INFORMATION pi = {0};
-
-    // Create process
-    BOOL success = CreateProcessA(
-        NULL,
-        cmdline,
-        NULL,
-        NULL,
-        TRUE,
-        CREATE_NO_WINDOW,
-        NULL,
-        NULL,
-        &si,
-        &pi
-    );
-
-    // Close write ends
-    CloseHandle(stdout_write);
-    CloseHandle(stderr_write);
-
-    if (!success) {
-        CloseHandle(stdout_read);
-        CloseHandle(stderr_read);
-        free(cmdline);
+// Spawn fastboot.exe and hand output to on_output while it runs
+ProcessResult* RunFastbootCommandStreaming(const char* fastboot_path, const char* args[], int arg_count,
+                                           ProcessOutputCallback on_output, void* user_data) {
+    if (!fastboot_path || !args || arg_count <= 0) {
         return NULL;
     }
 
-    // Allocate result structure
-    ProcessResult* result = (ProcessResult*)SafeCalloc(1, sizeof(ProcessResult));
-
-    // Read output
-    ReadOutputToBuffer(stdout_read, &result->stdout_data, &result->stdout_size);
-    ReadOutputToBuffer(stderr_read, &result->stderr_data, &result->stderr_size);
-
-    // Wait for process to finish
-    WaitForSingleObject(pi.hProcess, INFINITE);
-    DWORD exit_code;
-    GetExitCodeProcess(pi.hProcess, &exit_code);
-    result->exit_code = (int)exit_code;
-
-    // Cleanup
-    CloseHandle(stdout_read);
-    CloseHandle(stderr_read);
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-    free(cmdline);
-
-    return result;
+    ProcessOptions options = {0};
+    options.on_output = on_output;
+    options.user_data = user_data;
+    return RunProcessEx(fastboot_path, args, arg_count, &options);
 }
 
 // List fastboot devices
@@ -131,6 +48,9 @@ ProcessResult* FastbootDevices(const char* fastboot_path) {
 // Get device variable
 ProcessResult* FastbootGetVar(const char* fastboot_path, const char* device_serial, const char* var_name) {
     if (!var_name) return NULL;
+    if (FastbootClientSupports(device_serial)) {
+        return RunNativeCommand(device_serial, "getvar:%s", var_name);
+    }
 
     int idx = 0;
     const char* args[4];
@@ -148,6 +68,10 @@ ProcessResult* FastbootGetVar(const char* fastboot_path, const char* device_seri
 
 // Get all variables
 ProcessResult* FastbootGetAllVars(const char* fastboot_path, const char* device_serial) {
+    if (FastbootClientSupports(device_serial)) {
+        return RunNativeCommand(device_serial, "getvar:all");
+    }
+
     int idx = 0;
     const char* args[3];
 
@@ -165,8 +89,18 @@ ProcessResult* FastbootGetAllVars(const char* fastboot_path, const char* device_
 // Flash partition with image
 ProcessResult* FastbootFlash(const char* fastboot_path, const char* device_serial,
                              const char* partition, const char* image_path) {
+    return FastbootFlashStreaming(fastboot_path, device_serial, partition, image_path, NULL, NULL);
+}
+
+// Flash partition, streaming fastboot's progress output (NULL callback = capture)
+ProcessResult* FastbootFlashStreaming(const char* fastboot_path, const char* device_serial,
+                                      const char* partition, const char* image_path,
+                                      ProcessOutputCallback on_output, void* user_data) {
     if (!partition || !image_path) return NULL;
 
+    // A new super image redefines the logical partitions and their sizes
+    if (device_serial && StringStartsWith(partition, "super")) FastbootVarCacheInvalidate(device_serial);
+
     int idx = 0;
     const char* args[5];
 
@@ -179,13 +113,16 @@ ProcessResult* FastbootFlash(const char* fastboot_path, const char* device_seria
     args[idx++] = partition;
     args[idx++] = image_path;
 
-    return RunFastbootCommand(fastboot_path, args, idx);
+    return RunFastbootCommandStreaming(fastboot_path, args, idx, on_output, user_data);
 }
 
 // Erase partition
 ProcessResult* FastbootErase(const char* fastboot_path, const char* device_serial,
                              const char* partition) {
     if (!partition) return NULL;
+    if (FastbootClientSupports(device_serial)) {
+        return RunNativeCommand(device_serial, "erase:%s", partition);
+    }
 
     int idx = 0;
     const char* args[4];
@@ -257,6 +194,9 @@ ProcessResult* FastbootLock(const char* fastboot_path, const char* device_serial
 ProcessResult* FastbootOemCommand(const char* fastboot_path, const char* device_serial,
                                   const char* oem_cmd) {
     if (!oem_cmd) return NULL;
+    if (FastbootClientSupports(device_serial)) {
+        return RunNativeCommand(device_serial, "oem %s", oem_cmd);
+    }
 
     int idx = 0;
     const char* args[4];
@@ -275,6 +215,16 @@ ProcessResult* FastbootOemCommand(const char* fastboot_path, const char* device_
 // Reboot device
 ProcessResult* FastbootReboot(const char* fastboot_path, const char* device_serial,
                               const char* mode) {
+    // Slot, mode (bootloader or fastbootd) and partitions may differ afterwards
+    if (device_serial) FastbootVarCacheInvalidate(device_serial);
+
+    if (FastbootClientSupports(device_serial)) {
+        if (mode && strcmp(mode, "system") != 0) {
+            return RunNativeCommand(device_serial, "reboot-%s", mode);
+        }
+        return RunNativeCommand(device_serial, "reboot");
+    }
+
     int idx = 0;
     const char* args[3];
 
@@ -305,6 +255,10 @@ ProcessResult* FastbootRebootBootloader(const char* fastboot_path, const char* d
 ProcessResult* FastbootActivateSlot(const char* fastboot_path, const char* device_serial,
                                     const char* slot) {
     if (!slot) return NULL;
+    if (device_serial) FastbootVarCacheInvalidate(device_serial);
+    if (FastbootClientSupports(device_serial)) {
+        return RunNativeCommand(device_serial, "set_active:%s", slot);
+    }
 
     int idx = 0;
     const char* args[4];
@@ -371,30 +325,3 @@ int ParseFastbootDeviceList(const char* output, AdbDevice* devices, int max_devi
     free(copy);
     return count;
 }
-
-// Extract fastboot variable value
-char* ExtractFastbootVar(const char* output, const char* var_name) {
-    if (!output || !var_name) return NULL;
-
-    // Format: "var_name: value" or "(bootloader) var_name: value"
-    char search[512];
-    snprintf(search, sizeof(search), "%s:", var_name);
-
-    char* found = strstr(output, search);
-    if (!found) return NULL;
-
-    found += strlen(search);
-    while (*found == ' ' || *found == '\t') found++;
-
-    char* end = strchr(found, '\n');
-    if (end) {
-        size_t len = end - found;
-        char* value = (char*)SafeMalloc(len + 1);
-        memcpy(value, found, len);
-        value[len] = '\0';
-        TrimString(value);
-        return value;
-    }
-
-    return _strdup(found);
-}
@@ -1,10 +1,100 @@
 #include "file_transfer.h"
 #include "adb_wrapper.h"
+#include "device_manager.h"
+#include "shell_session.h"
+#include "sync_client.h"
+#include "resumable_transfer.h"
+#include "thread_pool.h"
+#include "sha256.h"
+#include "progress.h"
+#include "tar_stream.h"
+#include "adb_client.h"
 #include "utils.h"
 #include <stdio.h>
 
+// Size of a local file (0 if it cannot be read)
+static unsigned long long GetLocalFileSize(const char* path) {
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) return 0;
+    return ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+}
+
+static void AppendShellQuoted(char** buffer, size_t* size, size_t* capacity, const char* word);
+
+// Compare a local SHA-256 with one sha256sum run on the device. When leaf_name
+// is given and remote_path turns out to be a directory, the file hashed is
+// remote_path/leaf_name (where adb push puts a file sent to a directory).
+static int CompareRemoteDigest(const char* adb_path, const char* serial, const char* remote_path,
+                               const char* leaf_name, const char* local_hex) {
+    size_t capacity = 256, size = 0;
+    char* command = (char*)SafeMalloc(capacity);
+    if (leaf_name) {
+        size = (size_t)snprintf(command, capacity, "set --");
+        AppendShellQuoted(&command, &size, &capacity, remote_path);
+        AppendShellQuoted(&command, &size, &capacity, leaf_name);
+        const char* tail = "; if [ -d \"$1\" ]; then set -- \"$1/$2\"; fi; sha256sum \"$1\"";
+        size_t tail_len = strlen(tail);
+        command = (char*)SafeRealloc(command, size + tail_len + 1);
+        memcpy(command + size, tail, tail_len + 1);
+    } else {
+        size = (size_t)snprintf(command, capacity, "sha256sum");
+        AppendShellQuoted(&command, &size, &capacity, remote_path);
+    }
+
+    printf("Verifying on the device...\n");
+    ProcessResult* result = ShellSessionRunLong(adb_path, serial, command);
+    free(command);
+
+    int ok = 0;
+    if (!result || result->exit_code != 0 || !result->stdout_data ||
+        strlen(result->stdout_data) < SHA256_HEX_SIZE - 1) {
+        PrintError(ADB_ERROR_UNKNOWN, "Device could not hash the file (no sha256sum?)");
+    } else if (strncmp(result->stdout_data, local_hex, SHA256_HEX_SIZE - 1) != 0) {
+        char message[256];
+        snprintf(message, sizeof(message), "Verification failed: sent %.16s..., device has %.16s...",
+                 local_hex, result->stdout_data);
+        PrintError(ADB_ERROR_UNKNOWN, message);
+    } else {
+        printf("Verified: SHA-256 %s\n", local_hex);
+        ok = 1;
+    }
+
+    FreeProcessResult(result);
+    return ok;
+}
+
+// Compare a digest taken while the data streamed with the device's copy
+static int VerifyRemoteDigest(const char* adb_path, const char* serial, const char* remote_path,
+                              Sha256Context* digest) {
+    unsigned char bytes[SHA256_DIGEST_SIZE];
+    char local_hex[SHA256_HEX_SIZE];
+    Sha256Final(digest, bytes);
+    Sha256ToHex(bytes, local_hex);
+    return CompareRemoteDigest(adb_path, serial, remote_path, NULL, local_hex);
+}
+
+// Compare a local file, hashed after the fact, with the device's copy
+static int VerifyLocalFile(const char* adb_path, const char* serial, const char* local_path,
+                           const char* remote_path, const char* leaf_name) {
+    char local_hex[SHA256_HEX_SIZE];
+    if (!Sha256File(local_path, local_hex)) {
+        PrintError(ADB_ERROR_FILE_NOT_FOUND, "Cannot read the local file to verify it");
+        return 0;
+    }
+    return CompareRemoteDigest(adb_path, serial, remote_path, leaf_name, local_hex);
+}
+
+// Last component of a local or device path
+static const char* PathLeafName(const char* path) {
+    const char* leaf = path;
+    for (const char* p = path; *p; p++) {
+        if ((*p == '/' || *p == '\\') && p[1]) leaf = p + 1;
+    }
+    return leaf;
+}
+
 // Push file to device
-int PushFile(AppState* state, const char* local_path, const char* remote_path) {
+int PushFile(AppState* state, const char* local_path, const char* remote_path, int verify) {
     if (!state || !local_path || !remote_path) {
         PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
         return 0;
@@ -17,7 +107,7 @@ int PushFile(AppState* state, const char* local_path, const char* remote_path) {
     }
 
     // Check if device is selected
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 0;
@@ -25,7 +115,50 @@ int PushFile(AppState* state, const char* local_path, const char* remote_path) {
 
     printf("Pushing %s to %s:%s...\n", local_path, device->serial_id, remote_path);
 
-    ProcessResult* result = AdbPushFile(state->adb_path, device->serial_id, local_path, remote_path);
+    // Native sync protocol first; adb.exe only when the server cannot be used in-process
+    SyncConnection sync;
+    if (SyncOpen(&sync, device->serial_id)) {
+        unsigned long long size = GetLocalFileSize(local_path);
+        ProgressTracker tracker;
+        ProgressStart(&tracker, "push", device->serial_id, local_path, size);
+
+        // --verify hashes the data on its way out; the device then hashes what it stored
+        Sha256Context digest;
+        Sha256Init(&digest);
+        Sha256Context* hash = verify ? &digest : NULL;
+
+        // Large files go in journaled chunks so a dropped cable does not restart them
+        int success = -1;
+        char target[SYNC_PATH_MAX + 1];
+        int resolved = (size >= RESUMABLE_MIN_SIZE || verify) &&
+                       SyncResolvePushTarget(&sync, local_path, remote_path, target, sizeof(target));
+        if (resolved && size >= RESUMABLE_MIN_SIZE) {
+            success = ResumablePushFile(device->serial_id, local_path, target, hash,
+                                        ProgressTrackerCallback, &tracker);
+        }
+        int chunked = success >= 0;
+        if (!chunked) {
+            sync.digest = hash;
+            success = resolved
+                ? SyncSendFile(&sync, local_path, target, ProgressTrackerCallback, &tracker)
+                : SyncPushFile(&sync, local_path, remote_path, ProgressTrackerCallback, &tracker);
+        }
+        SyncClose(&sync);
+        ProgressFinish(&tracker, success);
+
+        if (success) {
+            printf("File pushed successfully.\n");
+        } else if (!chunked) {
+            PrintError(ADB_ERROR_UNKNOWN, sync.error);
+        }
+        if (success && verify) {
+            success = resolved ? VerifyRemoteDigest(state->adb_path, device->serial_id, target, &digest) : 0;
+        }
+        return success;
+    }
+
+    ProcessResult* result = AdbPushFileStreaming(state->adb_path, device->serial_id, local_path, remote_path,
+                                                 WriteOutputToConsole, NULL);
     if (!result) {
         PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to push file");
         return 0;
@@ -33,33 +166,30 @@ int PushFile(AppState* state, const char* local_path, const char* remote_path) {
 
     int success = (result->exit_code == 0);
 
-    if (result->stdout_data && strlen(result->stdout_data) > 0) {
-        printf("%s\n", result->stdout_data);
-    }
-
-    if (result->stderr_data && strlen(result->stderr_data) > 0) {
-        fprintf(stderr, "%s\n", result->stderr_data);
-    }
-
     if (success) {
         printf("File pushed successfully.\n");
     } else {
         PrintError(ADB_ERROR_UNKNOWN, "Failed to push file");
     }
-
     FreeProcessResult(result);
+
+    // adb.exe did the copy, so hash the source now and the device's copy after it
+    if (success && verify) {
+        success = VerifyLocalFile(state->adb_path, device->serial_id, local_path, remote_path,
+                                  PathLeafName(local_path));
+    }
     return success;
 }
 
 // Pull file from device
-int PullFile(AppState* state, const char* remote_path, const char* local_path) {
+int PullFile(AppState* state, const char* remote_path, const char* local_path, int verify) {
     if (!state || !remote_path) {
         PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
         return 0;
     }
 
     // Check if device is selected
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 0;
@@ -82,6 +212,45 @@ int PullFile(AppState* state, const char* remote_path, const char* local_path) {
 
     printf("Pulling %s:%s to %s...\n", device->serial_id, remote_path, local_file);
 
+    SyncConnection sync;
+    if (SyncOpen(&sync, device->serial_id)) {
+        ProgressTracker tracker;
+        ProgressStart(&tracker, "pull", device->serial_id, remote_path, 0);
+
+        // --verify hashes the data as it arrives; the device then hashes its copy
+        Sha256Context digest;
+        Sha256Init(&digest);
+        Sha256Context* hash = verify ? &digest : NULL;
+
+        char target[MAX_PATH];
+        SyncStat remote;
+        int success = 0, chunked = 0;
+        if (SyncResolvePullTarget(&sync, remote_path, local_file, target, sizeof(target), &remote)) {
+            // Large files go in journaled chunks so a dropped cable does not restart them
+            if (remote.size >= RESUMABLE_MIN_SIZE) {
+                success = ResumablePullFile(device->serial_id, remote_path, target, remote.size, remote.mtime,
+                                            hash, ProgressTrackerCallback, &tracker);
+                chunked = success >= 0;
+            }
+            if (!chunked) {
+                sync.digest = hash;
+                success = SyncRecvFile(&sync, remote_path, target, remote.size, ProgressTrackerCallback, &tracker);
+            }
+        }
+        SyncClose(&sync);
+        ProgressFinish(&tracker, success);
+
+        if (success) {
+            printf("File pulled successfully.\n");
+        } else if (!chunked) {
+            PrintError(ADB_ERROR_UNKNOWN, sync.error);
+        }
+        if (success && verify) {
+            success = VerifyRemoteDigest(state->adb_path, device->serial_id, remote_path, &digest);
+        }
+        return success;
+    }
+
     ProcessResult* result = AdbPullFile(state->adb_path, device->serial_id, remote_path, local_file);
     if (!result) {
         PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to pull file");
@@ -103,8 +272,18 @@ int PullFile(AppState* state, const char* remote_path, const char* local_path) {
     } else {
         PrintError(ADB_ERROR_UNKNOWN, "Failed to pull file");
     }
-
     FreeProcessResult(result);
+
+    // adb.exe did the copy, so hash what landed locally and compare with the device
+    if (success && verify) {
+        char pulled[MAX_PATH];
+        if (DirectoryExists(local_file)) {
+            snprintf(pulled, sizeof(pulled), "%s\\%s", local_file, PathLeafName(remote_path));
+        } else {
+            snprintf(pulled, sizeof(pulled), "%s", local_file);
+        }
+        success = VerifyLocalFile(state->adb_path, device->serial_id, pulled, remote_path, NULL);
+    }
     return success;
 }
 
@@ -113,7 +292,7 @@ int ListRemoteFiles(AppState* state, const char* remote_path) {
     if (!state) return 0;
 
     // Check if device is selected
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 0;
@@ -121,13 +300,16 @@ int ListRemoteFiles(AppState* state, const char* remote_path) {
 
     const char* path = remote_path ? remote_path : "/sdcard";
 
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "ls -la \"%s\"", path);
+    size_t capacity = 256, size = 0;
+    char* cmd = (char*)SafeMalloc(capacity);
+    size = (size_t)snprintf(cmd, capacity, "ls -la");
+    AppendShellQuoted(&cmd, &size, &capacity, path);
 
     printf("Listing %s:%s\n", device->serial_id, path);
     printf("----------------------------------------\n");
 
-    ProcessResult* result = AdbShellCommand(state->adb_path, device->serial_id, cmd);
+    ProcessResult* result = ShellSessionRun(state->adb_path, device->serial_id, cmd);
+    free(cmd);
     if (!result) {
         PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to list files");
         return 0;
@@ -157,18 +339,21 @@ int DeleteRemoteFile(AppState* state, const char* remote_path) {
     }
 
     // Check if device is selected
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 0;
     }
 
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "rm \"%s\"", remote_path);
+    size_t capacity = 256, size = 0;
+    char* cmd = (char*)SafeMalloc(capacity);
+    size = (size_t)snprintf(cmd, capacity, "rm");
+    AppendShellQuoted(&cmd, &size, &capacity, remote_path);
 
     printf("Deleting %s:%s...\n", device->serial_id, remote_path);
 
-    ProcessResult* result = AdbShellCommand(state->adb_path, device->serial_id, cmd);
+    ProcessResult* result = ShellSessionRun(state->adb_path, device->serial_id, cmd);
+    free(cmd);
     if (!result) {
         PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to delete file");
         return 0;
@@ -202,18 +387,21 @@ int CreateRemoteDirectory(AppState* state, const char* remote_path) {
     }
 
     // Check if device is selected
-    AdbDevice* device = GetSelectedDevice(state);
+    const AdbDevice* device = GetSelectedDevice(state);
     if (!device) {
         PrintError(ADB_ERROR_NO_DEVICE, NULL);
         return 0;
     }
 
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "mkdir -p \"%s\"", remote_path);
+    size_t capacity = 256, size = 0;
+    char* cmd = (char*)SafeMalloc(capacity);
+    size = (size_t)snprintf(cmd, capacity, "mkdir -p");
+    AppendShellQuoted(&cmd, &size, &capacity, remote_path);
 
     printf("Creating directory %s:%s...\n", device->serial_id, remote_path);
 
-    ProcessResult* result = AdbShellCommand(state->adb_path, device->serial_id, cmd);
+    ProcessResult* result = ShellSessionRun(state->adb_path, device->serial_id, cmd);
+    free(cmd);
     if (!result) {
         PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to create directory");
         return 0;
@@ -238,3 +426,1496 @@ int CreateRemoteDirectory(AppState* state, const char* remote_path) {
     FreeProcessResult(result);
     return success;
 }
+
+// ============================================================================
+// Batch and Directory Transfers
+// ============================================================================
+
+// Longest batched shell command ("mkdir -p ...", "rm -rf ...") sent in one round trip
+#define SHELL_BATCH_BYTES (32 * 1024)
+
+// One file of a batch transfer
+typedef struct {
+    char* local_path;
+    char* remote_path;
+    unsigned long long size;
+    unsigned int mtime;                 // Source mtime (pulls only; 0 if unknown)
+} TransferItem;
+
+// Files to move and remote/local directories to create first (parents before children)
+typedef struct {
+    TransferItem* items;
+    int count;
+    int capacity;
+    char** dirs;
+    int dir_count;
+    int dir_capacity;
+    unsigned long long total_bytes;
+} TransferPlan;
+
+typedef struct BatchTransfer BatchTransfer;
+
+// Progress callback argument for one worker
+typedef struct {
+    BatchTransfer* batch;
+    int worker;
+} BatchWorker;
+
+// Shared state of a parallel batch; each worker owns its own sync connection
+struct BatchTransfer {
+    const TransferPlan* plan;
+    int is_push;
+    char serial[256];
+    char adb_path[MAX_PATH];
+    SyncConnection conns[MAX_TRANSFER_JOBS];
+    int conn_state[MAX_TRANSFER_JOBS];                      // 0 = closed, 1 = open, -1 = unavailable
+    unsigned long long file_bytes[MAX_TRANSFER_JOBS];       // Progress within the worker's current file
+    BatchWorker workers[MAX_TRANSFER_JOBS];
+    int* results;                                           // Optional per-item outcome
+    volatile LONG64 done_bytes;
+    volatile LONG done_files;
+    CRITICAL_SECTION print_lock;
+    ProgressTracker tracker;                                // Guarded by print_lock
+};
+
+// Add a file to the plan
+static TransferItem* AddTransferItem(TransferPlan* plan, const char* local_path, const char* remote_path,
+                                     unsigned long long size) {
+    if (plan->count == plan->capacity) {
+        plan->capacity = plan->capacity ? plan->capacity * 2 : 64;
+        plan->items = (TransferItem*)SafeRealloc(plan->items, plan->capacity * sizeof(TransferItem));
+    }
+    TransferItem* item = &plan->items[plan->count++];
+    item->local_path = _strdup(local_path);
+    item->remote_path = _strdup(remote_path);
+    item->size = size;
+    item->mtime = 0;
+    plan->total_bytes += size;
+    return item;
+}
+
+// Add a directory to create
+static void AddTransferDir(TransferPlan* plan, const char* path) {
+    if (plan->dir_count == plan->dir_capacity) {
+        plan->dir_capacity = plan->dir_capacity ? plan->dir_capacity * 2 : 16;
+        plan->dirs = (char**)SafeRealloc(plan->dirs, plan->dir_capacity * sizeof(char*));
+    }
+    plan->dirs[plan->dir_count++] = _strdup(path);
+}
+
+// Release a plan
+static void FreeTransferPlan(TransferPlan* plan) {
+    for (int i = 0; i < plan->count; i++) {
+        free(plan->items[i].local_path);
+        free(plan->items[i].remote_path);
+    }
+    for (int i = 0; i < plan->dir_count; i++) {
+        free(plan->dirs[i]);
+    }
+    SAFE_FREE(plan->items);
+    SAFE_FREE(plan->dirs);
+    memset(plan, 0, sizeof(TransferPlan));
+}
+
+// Last component of a local or remote path, ignoring trailing separators
+static void CopyBaseName(const char* path, char* buffer, size_t size) {
+    size_t end = strlen(path);
+    while (end > 1 && (path[end - 1] == '/' || path[end - 1] == '\\')) end--;
+
+    size_t start = end;
+    while (start > 0 && path[start - 1] != '/' && path[start - 1] != '\\') start--;
+
+    size_t len = end - start;
+    if (len >= size) len = size - 1;
+    memcpy(buffer, path + start, len);
+    buffer[len] = '\0';
+}
+
+// Join a remote directory and a name with exactly one '/'
+static void JoinRemotePath(char* buffer, size_t size, const char* dir, const char* name) {
+    size_t len = strlen(dir);
+    int has_slash = len > 0 && dir[len - 1] == '/';
+    snprintf(buffer, size, "%s%s%s", dir, has_slash ? "" : "/", name);
+}
+
+// Append a single-quoted shell word to a growable buffer
+static void AppendShellQuoted(char** buffer, size_t* size, size_t* capacity, const char* word) {
+    size_t needed = *size + strlen(word) * 4 + 4;
+    if (needed > *capacity) {
+        while (needed > *capacity) *capacity = *capacity ? *capacity * 2 : 1024;
+        *buffer = (char*)SafeRealloc(*buffer, *capacity);
+    }
+
+    char* out = *buffer + *size;
+    *out++ = ' ';
+    *out++ = '\'';
+    for (const char* p = word; *p; p++) {
+        if (*p == '\'') {
+            // Close the quote, emit an escaped quote, reopen
+            memcpy(out, "'\\''", 4);
+            out += 4;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out++ = '\'';
+    *out = '\0';
+    *size = (size_t)(out - *buffer);
+}
+
+// Append unquoted shell text to a growable buffer
+static void AppendShellText(char** buffer, size_t* size, size_t* capacity, const char* text) {
+    size_t len = strlen(text);
+    if (*size + len + 1 > *capacity) {
+        while (*size + len + 1 > *capacity) *capacity = *capacity ? *capacity * 2 : 1024;
+        *buffer = (char*)SafeRealloc(*buffer, *capacity);
+    }
+    memcpy(*buffer + *size, text, len + 1);
+    *size += len;
+}
+
+// Run "<command> 'arg1' 'arg2' ..." over the shell session in as few calls as possible
+static int RunBatchedShellCommand(const char* adb_path, const char* serial, const char* command,
+                                  char* const* args, int count) {
+    int ok = 1;
+    int next = 0;
+
+    while (next < count) {
+        size_t capacity = 1024, size = 0;
+        char* line = (char*)SafeMalloc(capacity);
+        size = (size_t)snprintf(line, capacity, "%s", command);
+
+        while (next < count && size < SHELL_BATCH_BYTES) {
+            AppendShellQuoted(&line, &size, &capacity, args[next++]);
+        }
+
+        ProcessResult* result = ShellSessionRunLong(adb_path, serial, line);
+        if (!result || result->exit_code != 0) {
+            if (result && result->stderr_data && strlen(result->stderr_data) > 0) {
+                fprintf(stderr, "%s\n", result->stderr_data);
+            }
+            ok = 0;
+        }
+        FreeProcessResult(result);
+        free(line);
+    }
+
+    return ok;
+}
+
+// Queue every file under local_dir for remote_dir, skipping junctions and symlinked folders
+static void PlanLocalTree(TransferPlan* plan, const char* local_dir, const char* remote_dir) {
+    AddTransferDir(plan, remote_dir);
+
+    char pattern[MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", local_dir);
+
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA(pattern, &find_data);
+    if (find == INVALID_HANDLE_VALUE) return;
+
+    do {
+        const char* name = find_data.cFileName;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        char local_path[MAX_PATH];
+        char remote_path[SYNC_PATH_MAX + 1];
+        if (snprintf(local_path, sizeof(local_path), "%s\\%s", local_dir, name) >= (int)sizeof(local_path)) {
+            printf("\nSkipping (path too long): %s\\%s\n", local_dir, name);
+            continue;
+        }
+        JoinRemotePath(remote_path, sizeof(remote_path), remote_dir, name);
+
+        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                PlanLocalTree(plan, local_path, remote_path);
+            }
+        } else {
+            unsigned long long size = ((unsigned long long)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow;
+            AddTransferItem(plan, local_path, remote_path, size);
+        }
+    } while (FindNextFileA(find, &find_data));
+
+    FindClose(find);
+}
+
+// Collects one directory's LIST reply (nested requests must wait until it ends)
+typedef struct {
+    SyncStat* entries;
+    int count;
+    int capacity;
+} RemoteListing;
+
+// SyncListCallback adding an entry to a RemoteListing
+static int CollectRemoteEntry(const SyncStat* entry, void* user_data) {
+    RemoteListing* listing = (RemoteListing*)user_data;
+    if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) return 1;
+
+    if (listing->count == listing->capacity) {
+        listing->capacity = listing->capacity ? listing->capacity * 2 : 64;
+        listing->entries = (SyncStat*)SafeRealloc(listing->entries, listing->capacity * sizeof(SyncStat));
+    }
+    listing->entries[listing->count++] = *entry;
+    return 1;
+}
+
+// Queue every file under remote_dir for local_dir
+static int PlanRemoteTree(SyncConnection* conn, TransferPlan* plan, const char* remote_dir, const char* local_dir) {
+    AddTransferDir(plan, local_dir);
+
+    RemoteListing listing;
+    memset(&listing, 0, sizeof(listing));
+    if (!SyncListRemote(conn, remote_dir, CollectRemoteEntry, &listing)) {
+        free(listing.entries);
+        return 0;
+    }
+
+    int ok = 1;
+    for (int i = 0; ok && i < listing.count; i++) {
+        const SyncStat* entry = &listing.entries[i];
+
+        char remote_path[SYNC_PATH_MAX + 1];
+        char local_path[MAX_PATH];
+        JoinRemotePath(remote_path, sizeof(remote_path), remote_dir, entry->name);
+        if (snprintf(local_path, sizeof(local_path), "%s\\%s", local_dir, entry->name) >= (int)sizeof(local_path)) {
+            printf("\nSkipping (path too long): %s\n", remote_path);
+            continue;
+        }
+
+        // LIST reports the link itself; follow links to files, never into directories
+        SyncStat target = *entry;
+        if ((entry->mode & SYNC_S_IFMT) == SYNC_S_IFLNK && !SyncStatRemote(conn, remote_path, &target)) {
+            ok = 0;
+            break;
+        }
+
+        unsigned int type = target.mode & SYNC_S_IFMT;
+        if (type == SYNC_S_IFDIR && (entry->mode & SYNC_S_IFMT) == SYNC_S_IFDIR) {
+            ok = PlanRemoteTree(conn, plan, remote_path, local_path);
+        } else if (type == SYNC_S_IFREG) {
+            AddTransferItem(plan, local_path, remote_path, target.size)->mtime = target.mtime;
+        } else {
+            printf("\nSkipping special file or linked folder: %s\n", remote_path);
+        }
+    }
+
+    free(listing.entries);
+    return ok;
+}
+
+// Update the shared progress line (throttled by the tracker; a busy lock skips the update)
+static void DrawBatchProgress(BatchTransfer* batch, int force) {
+    if (!force && !TryEnterCriticalSection(&batch->print_lock)) return;
+    if (force) EnterCriticalSection(&batch->print_lock);
+
+    snprintf(batch->tracker.status, sizeof(batch->tracker.status), "[%ld/%d files]",
+             (long)batch->done_files, batch->plan->count);
+    ProgressUpdate(&batch->tracker, (unsigned long long)batch->done_bytes);
+    if (force) ProgressRedraw(&batch->tracker);
+
+    LeaveCriticalSection(&batch->print_lock);
+}
+
+// ProgressCallback for one worker's current file
+static void BatchFileProgress(const char* filename, unsigned long long current,
+                              unsigned long long total, void* user_data) {
+    BatchWorker* worker = (BatchWorker*)user_data;
+    BatchTransfer* batch = worker->batch;
+
+    unsigned long long previous = batch->file_bytes[worker->worker];
+    if (current > previous) {
+        InterlockedExchangeAdd64(&batch->done_bytes, (LONG64)(current - previous));
+        batch->file_bytes[worker->worker] = current;
+    }
+    DrawBatchProgress(batch, 0);
+}
+
+// Sync connection for a worker, opened on first use (NULL: use adb.exe instead)
+static SyncConnection* GetWorkerConnection(BatchTransfer* batch, int worker) {
+    if (batch->conn_state[worker] == 1 && batch->conns[worker].sock == INVALID_SOCKET) {
+        // A failed transfer dropped the session; open a fresh one
+        batch->conn_state[worker] = 0;
+    }
+    if (batch->conn_state[worker] == 0) {
+        batch->conn_state[worker] = SyncOpen(&batch->conns[worker], batch->serial) ? 1 : -1;
+    }
+    return batch->conn_state[worker] == 1 ? &batch->conns[worker] : NULL;
+}
+
+// ParallelTask moving one planned file
+static int TransferBatchItem(int worker, int index, void* context) {
+    BatchTransfer* batch = (BatchTransfer*)context;
+    const TransferItem* item = &batch->plan->items[index];
+    batch->file_bytes[worker] = 0;
+
+    int ok = -1;
+    const char* error = NULL;
+    if (item->size >= RESUMABLE_MIN_SIZE) {
+        // Chunked and journaled; reports its own errors, -1 means the device cannot do it
+        ok = batch->is_push
+            ? ResumablePushFile(batch->serial, item->local_path, item->remote_path, NULL,
+                                BatchFileProgress, &batch->workers[worker])
+            : ResumablePullFile(batch->serial, item->remote_path, item->local_path, item->size, item->mtime,
+                                NULL, BatchFileProgress, &batch->workers[worker]);
+    }
+
+    if (ok < 0) {
+        SyncConnection* conn = GetWorkerConnection(batch, worker);
+        if (conn) {
+            ok = batch->is_push
+                ? SyncSendFile(conn, item->local_path, item->remote_path, BatchFileProgress, &batch->workers[worker])
+                : SyncRecvFile(conn, item->remote_path, item->local_path, item->size,
+                               BatchFileProgress, &batch->workers[worker]);
+            error = conn->error;
+        } else {
+            ProcessResult* result = batch->is_push
+                ? AdbPushFile(batch->adb_path, batch->serial, item->local_path, item->remote_path)
+                : AdbPullFile(batch->adb_path, batch->serial, item->remote_path, item->local_path);
+            ok = result && result->exit_code == 0;
+            if (!ok && result && result->stderr_data && strlen(result->stderr_data) > 0) {
+                TrimString(result->stderr_data);
+                EnterCriticalSection(&batch->print_lock);
+                fprintf(stderr, "\n[ERROR] %s: %s\n", item->local_path, result->stderr_data);
+                LeaveCriticalSection(&batch->print_lock);
+            }
+            FreeProcessResult(result);
+        }
+    }
+
+    if (!ok && error) {
+        EnterCriticalSection(&batch->print_lock);
+        fprintf(stderr, "\n[ERROR] %s: %s\n", batch->is_push ? item->local_path : item->remote_path, error);
+        LeaveCriticalSection(&batch->print_lock);
+    }
+
+    // Count the file as processed either way so the total still reaches 100%
+    if (item->size > batch->file_bytes[worker]) {
+        InterlockedExchangeAdd64(&batch->done_bytes, (LONG64)(item->size - batch->file_bytes[worker]));
+    }
+    InterlockedIncrement(&batch->done_files);
+    DrawBatchProgress(batch, 0);
+
+    if (batch->results) batch->results[index] = ok;
+    return ok;
+}
+
+// Run a plan over `jobs` concurrent connections and print a summary
+static int RunTransferPlan(AppState* state, const char* serial, const TransferPlan* plan,
+                           int is_push, int jobs, int* results) {
+    if (plan->count == 0) {
+        printf("Nothing to transfer.\n");
+        return 1;
+    }
+
+    if (jobs < 1) jobs = 1;
+    if (jobs > MAX_TRANSFER_JOBS) jobs = MAX_TRANSFER_JOBS;
+
+    BatchTransfer* batch = (BatchTransfer*)SafeCalloc(1, sizeof(BatchTransfer));
+    batch->plan = plan;
+    batch->is_push = is_push;
+    batch->results = results;
+    strncpy(batch->serial, serial, sizeof(batch->serial) - 1);
+    strncpy(batch->adb_path, state->adb_path, sizeof(batch->adb_path) - 1);
+    for (int i = 0; i < MAX_TRANSFER_JOBS; i++) {
+        batch->conns[i].sock = INVALID_SOCKET;
+        batch->workers[i].batch = batch;
+        batch->workers[i].worker = i;
+    }
+    InitializeCriticalSection(&batch->print_lock);
+
+    char total_str[32];
+    FormatByteCount(plan->total_bytes, total_str, sizeof(total_str));
+    printf("%s %d file(s), %s, %d at a time...\n", is_push ? "Pushing" : "Pulling",
+           plan->count, total_str, jobs < plan->count ? jobs : plan->count);
+
+    char label[64];
+    snprintf(label, sizeof(label), "%d files", plan->count);
+    ProgressStart(&batch->tracker, is_push ? "push" : "pull", serial, label, plan->total_bytes);
+
+    int succeeded = RunParallel(plan->count, jobs, TransferBatchItem, batch);
+
+    DrawBatchProgress(batch, 1);
+    ProgressFinish(&batch->tracker, succeeded == plan->count);
+
+    for (int i = 0; i < MAX_TRANSFER_JOBS; i++) {
+        if (batch->conn_state[i] == 1) SyncClose(&batch->conns[i]);
+    }
+
+    printf("%d of %d file(s) %s.\n", succeeded, plan->count, is_push ? "pushed" : "pulled");
+
+    DeleteCriticalSection(&batch->print_lock);
+    free(batch);
+
+    if (succeeded != plan->count) {
+        PrintError(ADB_ERROR_UNKNOWN, "Some files failed to transfer");
+        return 0;
+    }
+    return 1;
+}
+
+// Push several local files into one remote directory in parallel
+int PushFiles(AppState* state, const char* local_paths[], int count, const char* remote_dir,
+              int jobs, int* results) {
+    if (!state || !local_paths || count <= 0 || !remote_dir) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
+        return 0;
+    }
+
+    const AdbDevice* device = GetSelectedDevice(state);
+    if (!device) {
+        PrintError(ADB_ERROR_NO_DEVICE, NULL);
+        return 0;
+    }
+
+    TransferPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    int missing = 0;
+    for (int i = 0; i < count; i++) {
+        WIN32_FILE_ATTRIBUTE_DATA info;
+        if (!GetFileAttributesExA(local_paths[i], GetFileExInfoStandard, &info) ||
+            (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            PrintError(ADB_ERROR_FILE_NOT_FOUND, local_paths[i]);
+            missing++;
+            continue;
+        }
+
+        char name[MAX_PATH];
+        char remote_path[SYNC_PATH_MAX + 1];
+        CopyBaseName(local_paths[i], name, sizeof(name));
+        JoinRemotePath(remote_path, sizeof(remote_path), remote_dir, name);
+        AddTransferItem(&plan, local_paths[i], remote_path,
+                        ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow);
+    }
+
+    // Results are indexed by the caller's list, the plan skips missing files
+    int* plan_results = results ? (int*)SafeCalloc(plan.count > 0 ? plan.count : 1, sizeof(int)) : NULL;
+    int success = RunTransferPlan(state, device->serial_id, &plan, 1, jobs, plan_results) && missing == 0;
+
+    if (results) {
+        int next = 0;
+        for (int i = 0; i < count; i++) {
+            int planned = next < plan.count && strcmp(plan.items[next].local_path, local_paths[i]) == 0;
+            results[i] = planned ? plan_results[next++] : 0;
+        }
+        free(plan_results);
+    }
+
+    FreeTransferPlan(&plan);
+    return success;
+}
+
+// Where a folder push lands. Like adb push, an existing remote directory receives
+// a folder of the same name; trailing separators are dropped from both roots.
+static void ResolvePushRoots(SyncConnection* sync, const char* local_dir, const char* remote_path,
+                             char local_root[MAX_PATH], char remote_root[SYNC_PATH_MAX + 1]) {
+    SyncStat remote;
+    int remote_is_dir = SyncStatRemote(sync, remote_path, &remote) &&
+                        (remote.mode & SYNC_S_IFMT) == SYNC_S_IFDIR;
+
+    if (remote_is_dir) {
+        char name[MAX_PATH];
+        CopyBaseName(local_dir, name, sizeof(name));
+        JoinRemotePath(remote_root, SYNC_PATH_MAX + 1, remote_path, name);
+    } else {
+        snprintf(remote_root, SYNC_PATH_MAX + 1, "%s", remote_path);
+        size_t len = strlen(remote_root);
+        while (len > 1 && remote_root[len - 1] == '/') remote_root[--len] = '\0';
+    }
+
+    snprintf(local_root, MAX_PATH, "%s", local_dir);
+    size_t local_len = strlen(local_root);
+    while (local_len > 3 && (local_root[local_len - 1] == '\\' || local_root[local_len - 1] == '/')) {
+        local_root[--local_len] = '\0';
+    }
+}
+
+// Where a folder pull lands. Like adb pull, an existing local folder receives a
+// folder of the same name.
+static void ResolvePullRoot(const char* remote_dir, const char* local_path, char local_root[MAX_PATH]) {
+    char name[MAX_PATH];
+    CopyBaseName(remote_dir, name, sizeof(name));
+
+    if (!local_path || strlen(local_path) == 0) {
+        snprintf(local_root, MAX_PATH, ".\\%s", name);
+    } else if (DirectoryExists(local_path)) {
+        snprintf(local_root, MAX_PATH, "%s\\%s", local_path, name);
+    } else {
+        snprintf(local_root, MAX_PATH, "%s", local_path);
+    }
+}
+
+// Push a local directory tree
+int PushDirectory(AppState* state, const char* local_dir, const char* remote_path, int jobs) {
+    if (!state || !local_dir || !remote_path) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
+        return 0;
+    }
+
+    if (!DirectoryExists(local_dir)) {
+        PrintError(ADB_ERROR_FILE_NOT_FOUND, local_dir);
+        return 0;
+    }
+
+    const AdbDevice* device = GetSelectedDevice(state);
+    if (!device) {
+        PrintError(ADB_ERROR_NO_DEVICE, NULL);
+        return 0;
+    }
+
+    SyncConnection sync;
+    if (!SyncOpen(&sync, device->serial_id)) {
+        // No in-process server access: adb.exe walks the tree itself
+        printf("Pushing %s to %s:%s...\n", local_dir, device->serial_id, remote_path);
+        ProcessResult* result = AdbPushFileStreaming(state->adb_path, device->serial_id, local_dir, remote_path,
+                                                     WriteOutputToConsole, NULL);
+        int success = result && result->exit_code == 0;
+        if (!success) PrintError(ADB_ERROR_UNKNOWN, "Failed to push directory");
+        FreeProcessResult(result);
+        return success;
+    }
+
+    char remote_root[SYNC_PATH_MAX + 1];
+    char local_root[MAX_PATH];
+    ResolvePushRoots(&sync, local_dir, remote_path, local_root, remote_root);
+    SyncClose(&sync);
+
+    printf("Pushing %s to %s:%s...\n", local_root, device->serial_id, remote_root);
+
+    TransferPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    PlanLocalTree(&plan, local_root, remote_root);
+
+    printf("Creating %d remote folder(s)...\n", plan.dir_count);
+    int success = RunBatchedShellCommand(state->adb_path, device->serial_id, "mkdir -p", plan.dirs, plan.dir_count);
+    if (!success) {
+        PrintError(ADB_ERROR_UNKNOWN, "Failed to create remote folders");
+    } else {
+        success = RunTransferPlan(state, device->serial_id, &plan, 1, jobs, NULL);
+    }
+
+    FreeTransferPlan(&plan);
+    return success;
+}
+
+// Pull a remote directory tree
+int PullDirectory(AppState* state, const char* remote_dir, const char* local_path, int jobs) {
+    if (!state || !remote_dir) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
+        return 0;
+    }
+
+    const AdbDevice* device = GetSelectedDevice(state);
+    if (!device) {
+        PrintError(ADB_ERROR_NO_DEVICE, NULL);
+        return 0;
+    }
+
+    char local_root[MAX_PATH];
+    ResolvePullRoot(remote_dir, local_path, local_root);
+
+    SyncConnection sync;
+    if (!SyncOpen(&sync, device->serial_id)) {
+        printf("Pulling %s:%s to %s...\n", device->serial_id, remote_dir, local_root);
+        ProcessResult* result = AdbPullFile(state->adb_path, device->serial_id, remote_dir, local_root);
+        int success = result && result->exit_code == 0;
+        if (result && result->stdout_data && strlen(result->stdout_data) > 0) printf("%s\n", result->stdout_data);
+        if (!success) PrintError(ADB_ERROR_UNKNOWN, "Failed to pull directory");
+        FreeProcessResult(result);
+        return success;
+    }
+
+    printf("Pulling %s:%s to %s...\n", device->serial_id, remote_dir, local_root);
+    printf("Scanning remote folder...\n");
+
+    TransferPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    int success = PlanRemoteTree(&sync, &plan, remote_dir, local_root);
+    if (!success) {
+        PrintError(ADB_ERROR_UNKNOWN, sync.error);
+    }
+    SyncClose(&sync);
+
+    // Local folders are cheap to create up front, parents first
+    for (int i = 0; success && i < plan.dir_count; i++) {
+        if (!CreateDirectoryA(plan.dirs[i], NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+            PrintError(ADB_ERROR_UNKNOWN, plan.dirs[i]);
+            success = 0;
+        }
+    }
+
+    if (success) {
+        success = RunTransferPlan(state, device->serial_id, &plan, 0, jobs, NULL);
+    }
+
+    FreeTransferPlan(&plan);
+    return success;
+}
+
+// Check whether a remote path is a directory
+int IsRemoteDirectory(AppState* state, const char* remote_path) {
+    if (!state || !remote_path) return 0;
+
+    const AdbDevice* device = GetSelectedDevice(state);
+    if (!device) return 0;
+
+    SyncConnection sync;
+    if (SyncOpen(&sync, device->serial_id)) {
+        SyncStat remote;
+        int is_dir = SyncStatRemote(&sync, remote_path, &remote) && (remote.mode & SYNC_S_IFMT) == SYNC_S_IFDIR;
+        SyncClose(&sync);
+        return is_dir;
+    }
+
+    size_t capacity = 64, size = 0;
+    char* command = (char*)SafeMalloc(capacity);
+    size = (size_t)snprintf(command, capacity, "test -d");
+    AppendShellQuoted(&command, &size, &capacity, remote_path);
+
+    ProcessResult* result = ShellSessionRun(state->adb_path, device->serial_id, command);
+    int is_dir = result && result->exit_code == 0;
+    FreeProcessResult(result);
+    free(command);
+    return is_dir;
+}
+
+// ============================================================================
+// Bulk (tar stream) transfers
+// ============================================================================
+
+// Whether the device shell has a command on its PATH
+static int RemoteHasCommand(const char* adb_path, const char* serial, const char* name) {
+    char command[64];
+    snprintf(command, sizeof(command), "command -v %s >/dev/null", name);
+    ProcessResult* result = ShellSessionRun(adb_path, serial, command);
+    int found = result && result->exit_code == 0;
+    FreeProcessResult(result);
+    return found;
+}
+
+// Apparent size of a remote tree in bytes (0 if unknown)
+static unsigned long long RemoteTreeSize(const char* adb_path, const char* serial, const char* remote_dir) {
+    size_t capacity = 64, size = 0;
+    char* command = (char*)SafeMalloc(capacity);
+    size = (size_t)snprintf(command, capacity, "du -sb");
+    AppendShellQuoted(&command, &size, &capacity, remote_dir);
+
+    unsigned long long bytes = 0;
+    ProcessResult* result = ShellSessionRunLong(adb_path, serial, command);
+    if (result && result->exit_code == 0 && result->stdout_data) {
+        bytes = strtoull(result->stdout_data, NULL, 10);
+    }
+    FreeProcessResult(result);
+    free(command);
+    return bytes;
+}
+
+// Archive stream being unpacked during a bulk pull
+typedef struct {
+    SOCKET sock;
+    TarExtractor tar;
+    ProgressTracker tracker;
+} BulkPull;
+
+// DecompressReadFn over the exec: socket
+static int ReadBulkPullSocket(void* buffer, size_t size, void* user_data) {
+    BulkPull* pull = (BulkPull*)user_data;
+    int got = recv(pull->sock, (char*)buffer, (int)size, 0);
+    return got < 0 ? -1 : got;
+}
+
+// DecompressWriteFn feeding the tar extractor
+static int FeedBulkPull(const void* data, size_t len, void* user_data) {
+    BulkPull* pull = (BulkPull*)user_data;
+    if (!TarExtractorFeed(&pull->tar, data, len)) return 0;
+    ProgressUpdate(&pull->tracker, pull->tar.bytes);
+    return 1;
+}
+
+// Pull a remote tree as one tar stream, optionally compressed on the device
+int PullDirectoryTar(AppState* state, const char* remote_dir, const char* local_path,
+                     CompressionFormat compression) {
+    if (!state || !remote_dir) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
+        return 0;
+    }
+
+    const AdbDevice* device = GetSelectedDevice(state);
+    if (!device) {
+        PrintError(ADB_ERROR_NO_DEVICE, NULL);
+        return 0;
+    }
+    if (!AdbClientIsAvailable()) {
+        PrintError(ADB_ERROR_CONNECTION_FAILED, "Bulk transfers need a running adb server");
+        return 0;
+    }
+
+    const char* compressor = NULL;
+    if (compression == COMPRESSION_GZIP) compressor = "gzip";
+    if (compression == COMPRESSION_LZ4) compressor = "lz4";
+    if (compressor && !RemoteHasCommand(state->adb_path, device->serial_id, compressor)) {
+        printf("Device has no %s, pulling uncompressed.\n", compressor);
+        compression = COMPRESSION_NONE;
+        compressor = NULL;
+    }
+
+    char local_root[MAX_PATH];
+    ResolvePullRoot(remote_dir, local_path, local_root);
+    if (!CreateDirectoryA(local_root, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        PrintError(ADB_ERROR_UNKNOWN, local_root);
+        return 0;
+    }
+
+    unsigned long long total = RemoteTreeSize(state->adb_path, device->serial_id, remote_dir);
+
+    // exec: keeps the stream binary-clean; tar's own complaints would corrupt it
+    size_t capacity = 256, size = 0;
+    char* service = (char*)SafeMalloc(capacity);
+    size = (size_t)snprintf(service, capacity, "exec:cd");
+    AppendShellQuoted(&service, &size, &capacity, remote_dir);
+    AppendShellText(&service, &size, &capacity, " && tar -cf - . 2>/dev/null");
+    if (compression == COMPRESSION_GZIP) AppendShellText(&service, &size, &capacity, " | gzip -1 -c");
+    if (compression == COMPRESSION_LZ4) AppendShellText(&service, &size, &capacity, " | lz4 -1 -c");
+
+    printf("Pulling %s:%s to %s as a tar stream%s%s...\n", device->serial_id, remote_dir, local_root,
+           compressor ? ", compressed with " : "", compressor ? compressor : "");
+
+    BulkPull* pull = (BulkPull*)SafeCalloc(1, sizeof(BulkPull));
+    pull->sock = AdbClientOpenService(device->serial_id, service);
+    free(service);
+    if (pull->sock == INVALID_SOCKET) {
+        PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to start tar on the device");
+        free(pull);
+        return 0;
+    }
+
+    TarExtractorInit(&pull->tar, local_root);
+    ProgressStart(&pull->tracker, "pull", device->serial_id, remote_dir, total);
+
+    char error[256];
+    int success = DecompressStream(compression, ReadBulkPullSocket, pull, FeedBulkPull, pull,
+                                   error, sizeof(error));
+    closesocket(pull->sock);
+
+    int complete = TarExtractorFinish(&pull->tar);
+    if (success && !complete) {
+        snprintf(error, sizeof(error), "Archive stream ended early (folder missing or connection lost)");
+        success = 0;
+    }
+    ProgressFinish(&pull->tracker, success && pull->tar.failures == 0);
+
+    printf("%d file(s), %d folder(s) extracted", pull->tar.files, pull->tar.dirs);
+    if (pull->tar.skipped > 0) printf(", %d link(s) or special file(s) skipped", pull->tar.skipped);
+    printf(".\n");
+
+    if (!success) {
+        PrintError(ADB_ERROR_UNKNOWN, pull->tar.error[0] ? pull->tar.error : error);
+    } else if (pull->tar.failures > 0) {
+        PrintError(ADB_ERROR_UNKNOWN, pull->tar.error);
+        success = 0;
+    }
+
+    free(pull);
+    return success;
+}
+
+// Archive being streamed into the device shell during a bulk push
+typedef struct {
+    SOCKET sock;
+    TarWriter tar;
+    ProgressTracker tracker;
+} BulkPush;
+
+// TarSinkFn sending archive bytes as shell stdin
+static int SendBulkPush(const void* data, size_t len, void* user_data) {
+    BulkPush* push = (BulkPush*)user_data;
+    return AdbClientShellWriteStdin(push->sock, data, len);
+}
+
+// ProgressCallback for archived file data
+static void BulkPushProgress(const char* filename, unsigned long long current,
+                             unsigned long long total, void* user_data) {
+    (void)filename;
+    (void)total;
+    BulkPush* push = (BulkPush*)user_data;
+    ProgressUpdate(&push->tracker, current);
+}
+
+// Push a local tree as one tar stream unpacked by the device's tar
+int PushDirectoryTar(AppState* state, const char* local_dir, const char* remote_path) {
+    if (!state || !local_dir || !remote_path) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
+        return 0;
+    }
+    if (!DirectoryExists(local_dir)) {
+        PrintError(ADB_ERROR_FILE_NOT_FOUND, local_dir);
+        return 0;
+    }
+
+    const AdbDevice* device = GetSelectedDevice(state);
+    if (!device) {
+        PrintError(ADB_ERROR_NO_DEVICE, NULL);
+        return 0;
+    }
+
+    // stdin with a clean end-of-input and tar's exit status need shell protocol v2
+    SyncConnection sync;
+    if (!AdbClientDeviceHasFeature(device->serial_id, "shell_v2") || !SyncOpen(&sync, device->serial_id)) {
+        PrintError(ADB_ERROR_CONNECTION_FAILED, "Bulk push needs an adb server and a device with shell v2");
+        return 0;
+    }
+    char remote_root[SYNC_PATH_MAX + 1];
+    char local_root[MAX_PATH];
+    ResolvePushRoots(&sync, local_dir, remote_path, local_root, remote_root);
+    SyncClose(&sync);
+
+    // Sizes for the progress bar
+    TransferPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    PlanLocalTree(&plan, local_root, remote_root);
+    unsigned long long total = plan.total_bytes;
+    char total_str[32];
+    FormatByteCount(total, total_str, sizeof(total_str));
+    printf("Pushing %s to %s:%s as a tar stream (%d file(s), %s)...\n", local_root, device->serial_id,
+           remote_root, plan.count, total_str);
+    FreeTransferPlan(&plan);
+
+    size_t capacity = 256, size = 0;
+    char* service = (char*)SafeMalloc(capacity);
+    size = (size_t)snprintf(service, capacity, "shell,v2,raw:mkdir -p");
+    AppendShellQuoted(&service, &size, &capacity, remote_root);
+    AppendShellText(&service, &size, &capacity, " && cd");
+    AppendShellQuoted(&service, &size, &capacity, remote_root);
+    AppendShellText(&service, &size, &capacity, " && tar -xf - 2>&1");
+
+    BulkPush* push = (BulkPush*)SafeCalloc(1, sizeof(BulkPush));
+    push->sock = AdbClientOpenService(device->serial_id, service);
+    free(service);
+    if (push->sock == INVALID_SOCKET) {
+        PrintError(ADB_ERROR_CONNECTION_FAILED, "Failed to start tar on the device");
+        free(push);
+        return 0;
+    }
+
+    TarWriterInit(&push->tar, SendBulkPush, push);
+    push->tar.progress = BulkPushProgress;
+    push->tar.progress_data = push;
+    push->tar.progress_total = total;
+    ProgressStart(&push->tracker, "push", device->serial_id, local_root, total);
+
+    int success = TarWriteTree(&push->tar, local_root);
+    success = TarWriterFinish(&push->tar, success) && success;
+
+    // End of stdin lets tar finish; its output explains a failure
+    char reply[1024];
+    int exit_code = -1;
+    int finished = success && AdbClientShellCloseStdin(push->sock) &&
+                   AdbClientShellWaitExit(push->sock, reply, sizeof(reply), &exit_code);
+    closesocket(push->sock);
+
+    if (success && !finished) {
+        snprintf(push->tar.error, sizeof(push->tar.error), "Connection to device lost");
+        success = 0;
+    } else if (success && exit_code != 0) {
+        TrimString(reply);
+        snprintf(push->tar.error, sizeof(push->tar.error), "Device tar failed: %s",
+                 reply[0] ? reply : "unknown error");
+        success = 0;
+    }
+    ProgressFinish(&push->tracker, success);
+
+    if (success) {
+        printf("%d file(s), %d folder(s) pushed.\n", push->tar.files, push->tar.dirs);
+    } else {
+        PrintError(ADB_ERROR_UNKNOWN, push->tar.error);
+    }
+
+    free(push);
+    return success;
+}
+
+// ============================================================================
+// Delta Sync
+// ============================================================================
+
+// One file or folder of a sync manifest, relative to the sync root ('/' separators)
+typedef struct {
+    char* rel_path;
+    unsigned long long size;
+    unsigned int mtime;                 // Unix seconds
+    int is_dir;
+    int needs_hash;                     // Same size, content must be compared
+    char hash[SHA256_HEX_SIZE];         // Empty until computed
+} ManifestEntry;
+
+// Sorted list of manifest entries
+typedef struct {
+    ManifestEntry* entries;
+    int count;
+    int capacity;
+} SyncManifest;
+
+// Hashing job over the local side of a sync
+typedef struct {
+    SyncManifest* manifest;
+    const char* local_root;
+    int* indices;                       // Entries to hash
+} LocalHashJob;
+
+// Add an entry to a manifest
+static ManifestEntry* AddManifestEntry(SyncManifest* manifest, const char* rel_path, int is_dir,
+                                       unsigned long long size, unsigned int mtime) {
+    if (manifest->count == manifest->capacity) {
+        manifest->capacity = manifest->capacity ? manifest->capacity * 2 : 128;
+        manifest->entries = (ManifestEntry*)SafeRealloc(manifest->entries,
+                                                        manifest->capacity * sizeof(ManifestEntry));
+    }
+    ManifestEntry* entry = &manifest->entries[manifest->count++];
+    memset(entry, 0, sizeof(ManifestEntry));
+    entry->rel_path = _strdup(rel_path);
+    entry->is_dir = is_dir;
+    entry->size = size;
+    entry->mtime = mtime;
+    return entry;
+}
+
+// Release a manifest
+static void FreeManifest(SyncManifest* manifest) {
+    for (int i = 0; i < manifest->count; i++) {
+        free(manifest->entries[i].rel_path);
+    }
+    SAFE_FREE(manifest->entries);
+    manifest->count = 0;
+    manifest->capacity = 0;
+}
+
+// qsort comparator on relative path
+static int CompareManifestEntries(const void* a, const void* b) {
+    return strcmp(((const ManifestEntry*)a)->rel_path, ((const ManifestEntry*)b)->rel_path);
+}
+
+// Binary search a sorted manifest
+static ManifestEntry* FindManifestEntry(const SyncManifest* manifest, const char* rel_path) {
+    int low = 0, high = manifest->count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int cmp = strcmp(manifest->entries[mid].rel_path, rel_path);
+        if (cmp == 0) return &manifest->entries[mid];
+        if (cmp < 0) low = mid + 1; else high = mid - 1;
+    }
+    return NULL;
+}
+
+// Add everything under local_dir (rel_prefix is its path relative to the root)
+static void BuildLocalManifest(SyncManifest* manifest, const char* local_dir, const char* rel_prefix) {
+    char pattern[MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", local_dir);
+
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA(pattern, &find_data);
+    if (find == INVALID_HANDLE_VALUE) return;
+
+    do {
+        const char* name = find_data.cFileName;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        char local_path[MAX_PATH];
+        char rel_path[SYNC_PATH_MAX + 1];
+        if (snprintf(local_path, sizeof(local_path), "%s\\%s", local_dir, name) >= (int)sizeof(local_path)) {
+            printf("Skipping (path too long): %s\\%s\n", local_dir, name);
+            continue;
+        }
+        snprintf(rel_path, sizeof(rel_path), "%s%s%s", rel_prefix, rel_prefix[0] ? "/" : "", name);
+
+        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                AddManifestEntry(manifest, rel_path, 1, 0, 0);
+                BuildLocalManifest(manifest, local_path, rel_path);
+            }
+        } else {
+            unsigned long long size = ((unsigned long long)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow;
+            AddManifestEntry(manifest, rel_path, 0, size, FileTimeToUnixSeconds(&find_data.ftLastWriteTime));
+        }
+    } while (FindNextFileA(find, &find_data));
+
+    FindClose(find);
+}
+
+// List the remote tree with one "find | stat" call (returns 0 on failure; a missing folder is empty)
+static int BuildRemoteManifest(const char* adb_path, const char* serial, const char* remote_root,
+                               SyncManifest* manifest) {
+    size_t capacity = 256, size = 0;
+    char* command = (char*)SafeMalloc(capacity);
+    size = (size_t)snprintf(command, capacity, "cd");
+    AppendShellQuoted(&command, &size, &capacity, remote_root);
+    AppendShellText(&command, &size, &capacity,
+                    " 2>/dev/null || exit 0; find . -mindepth 1 -exec stat -c '%f %s %Y %n' {} +");
+
+    ProcessResult* result = ShellSessionRunLong(adb_path, serial, command);
+    free(command);
+    if (!result || result->exit_code != 0) {
+        if (result && result->stderr_data && strlen(result->stderr_data) > 0) {
+            fprintf(stderr, "%s\n", result->stderr_data);
+        }
+        FreeProcessResult(result);
+        return 0;
+    }
+
+    // "<mode hex> <size> <mtime> ./<path>"
+    char* line = result->stdout_data;
+    while (line && *line) {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+
+        unsigned int mode = 0, mtime = 0;
+        unsigned long long file_size = 0;
+        int name_offset = 0;
+        if (sscanf(line, "%x %llu %u %n", &mode, &file_size, &mtime, &name_offset) == 3 && name_offset > 0) {
+            char* name = line + name_offset;
+            size_t len = strlen(name);
+            if (len > 0 && name[len - 1] == '\r') name[--len] = '\0';
+            if (strncmp(name, "./", 2) == 0) name += 2;
+
+            unsigned int type = mode & SYNC_S_IFMT;
+            if (*name && (type == SYNC_S_IFDIR || type == SYNC_S_IFREG)) {
+                AddManifestEntry(manifest, name, type == SYNC_S_IFDIR, file_size, mtime);
+            }
+        }
+
+        line = next;
+    }
+
+    FreeProcessResult(result);
+    return 1;
+}
+
+// ParallelTask hashing one local file
+static int HashLocalEntry(int worker, int index, void* context) {
+    (void)worker;
+    LocalHashJob* job = (LocalHashJob*)context;
+    ManifestEntry* entry = &job->manifest->entries[job->indices[index]];
+
+    char local_path[MAX_PATH];
+    snprintf(local_path, sizeof(local_path), "%s\\%s", job->local_root, entry->rel_path);
+    for (char* p = local_path; *p; p++) {
+        if (*p == '/') *p = '\\';
+    }
+
+    if (!Sha256File(local_path, entry->hash)) {
+        entry->hash[0] = '\0';
+        return 0;
+    }
+    return 1;
+}
+
+// Fill in remote hashes for flagged entries with batched sha256sum calls
+static void HashRemoteEntries(const char* adb_path, const char* serial, const char* remote_root,
+                              SyncManifest* remote) {
+    int next = 0;
+    while (next < remote->count) {
+        size_t capacity = 1024, size = 0;
+        char* command = (char*)SafeMalloc(capacity);
+        size = (size_t)snprintf(command, capacity, "cd");
+        AppendShellQuoted(&command, &size, &capacity, remote_root);
+        AppendShellText(&command, &size, &capacity, " && sha256sum");
+
+        int first = next, batched = 0;
+        while (next < remote->count && size < SHELL_BATCH_BYTES) {
+            if (remote->entries[next].needs_hash) {
+                AppendShellQuoted(&command, &size, &capacity, remote->entries[next].rel_path);
+                batched++;
+            }
+            next++;
+        }
+
+        if (batched > 0) {
+            ProcessResult* result = ShellSessionRunLong(adb_path, serial, command);
+            // sha256sum prints "<hash>  <name>" in argument order; unreadable files stay unhashed
+            int cursor = first;
+            char* line = result ? result->stdout_data : NULL;
+            while (line && *line) {
+                char* eol = strchr(line, '\n');
+                if (eol) *eol++ = '\0';
+
+                size_t len = strlen(line);
+                if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+                if (len > SHA256_HEX_SIZE + 1 && line[SHA256_HEX_SIZE - 1] == ' ') {
+                    ManifestEntry* entry = NULL;
+                    const char* name = line + SHA256_HEX_SIZE + 1;
+                    for (int i = cursor; i < next && !entry; i++) {
+                        if (remote->entries[i].needs_hash && strcmp(remote->entries[i].rel_path, name) == 0) {
+                            entry = &remote->entries[i];
+                            cursor = i + 1;
+                        }
+                    }
+                    if (entry) {
+                        memcpy(entry->hash, line, SHA256_HEX_SIZE - 1);
+                        entry->hash[SHA256_HEX_SIZE - 1] = '\0';
+                    }
+                }
+
+                line = eol;
+            }
+            FreeProcessResult(result);
+        }
+
+        free(command);
+    }
+}
+
+// Push only what changed from local_dir to remote_dir
+int DeltaSyncDirectory(AppState* state, const char* local_dir, const char* remote_dir, int jobs, int flags) {
+    if (!state || !local_dir || !remote_dir) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
+        return 0;
+    }
+
+    if (!DirectoryExists(local_dir)) {
+        PrintError(ADB_ERROR_FILE_NOT_FOUND, local_dir);
+        return 0;
+    }
+
+    const AdbDevice* device = GetSelectedDevice(state);
+    if (!device) {
+        PrintError(ADB_ERROR_NO_DEVICE, NULL);
+        return 0;
+    }
+
+    char local_root[MAX_PATH];
+    snprintf(local_root, sizeof(local_root), "%s", local_dir);
+    size_t local_len = strlen(local_root);
+    while (local_len > 3 && (local_root[local_len - 1] == '\\' || local_root[local_len - 1] == '/')) {
+        local_root[--local_len] = '\0';
+    }
+
+    char remote_root[SYNC_PATH_MAX + 1];
+    snprintf(remote_root, sizeof(remote_root), "%s", remote_dir);
+    size_t remote_len = strlen(remote_root);
+    while (remote_len > 1 && remote_root[remote_len - 1] == '/') remote_root[--remote_len] = '\0';
+
+    if (jobs < 1) jobs = 1;
+    if (jobs > MAX_TRANSFER_JOBS) jobs = MAX_TRANSFER_JOBS;
+
+    printf("Comparing %s with %s:%s...\n", local_root, device->serial_id, remote_root);
+
+    SyncManifest local, remote;
+    memset(&local, 0, sizeof(local));
+    memset(&remote, 0, sizeof(remote));
+
+    BuildLocalManifest(&local, local_root, "");
+    if (!BuildRemoteManifest(state->adb_path, device->serial_id, remote_root, &remote)) {
+        PrintError(ADB_ERROR_UNKNOWN, "Failed to list remote folder");
+        FreeManifest(&local);
+        return 0;
+    }
+    qsort(local.entries, local.count, sizeof(ManifestEntry), CompareManifestEntries);
+    qsort(remote.entries, remote.count, sizeof(ManifestEntry), CompareManifestEntries);
+
+    // Same size is not proof of same content unless the timestamp matches too
+    int* hash_indices = (int*)SafeMalloc((local.count > 0 ? local.count : 1) * sizeof(int));
+    int hash_count = 0;
+    for (int i = 0; i < local.count; i++) {
+        ManifestEntry* entry = &local.entries[i];
+        if (entry->is_dir) continue;
+
+        ManifestEntry* other = FindManifestEntry(&remote, entry->rel_path);
+        if (!other || other->is_dir || other->size != entry->size) continue;
+        if (other->mtime == entry->mtime && !(flags & DELTA_SYNC_CHECKSUM)) continue;
+
+        entry->needs_hash = 1;
+        other->needs_hash = 1;
+        hash_indices[hash_count++] = i;
+    }
+
+    if (hash_count > 0) {
+        printf("Hashing %d candidate file(s) on both sides...\n", hash_count);
+        LocalHashJob job = { &local, local_root, hash_indices };
+        RunParallel(hash_count, MAX_PARALLEL_WORKERS, HashLocalEntry, &job);
+        HashRemoteEntries(state->adb_path, device->serial_id, remote_root, &remote);
+    }
+    free(hash_indices);
+
+    // Classify
+    TransferPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    int unchanged = 0, conflicts = 0;
+    unsigned long long unchanged_bytes = 0;
+
+    // The root is not part of the listing; an empty listing may mean it does not exist yet
+    if (remote.count == 0) {
+        AddTransferDir(&plan, remote_root);
+    }
+
+    for (int i = 0; i < local.count; i++) {
+        const ManifestEntry* entry = &local.entries[i];
+        const ManifestEntry* other = FindManifestEntry(&remote, entry->rel_path);
+
+        char local_path[MAX_PATH];
+        char remote_path[SYNC_PATH_MAX + 1];
+        snprintf(local_path, sizeof(local_path), "%s\\%s", local_root, entry->rel_path);
+        for (char* p = local_path; *p; p++) {
+            if (*p == '/') *p = '\\';
+        }
+        JoinRemotePath(remote_path, sizeof(remote_path), remote_root, entry->rel_path);
+
+        if (other && other->is_dir != entry->is_dir) {
+            printf("Conflict (file/folder mismatch), skipped: %s\n", entry->rel_path);
+            conflicts++;
+        } else if (entry->is_dir) {
+            if (!other) AddTransferDir(&plan, remote_path);
+        } else if (other && other->size == entry->size &&
+                   (entry->needs_hash ? (entry->hash[0] && strcmp(entry->hash, other->hash) == 0)
+                                      : other->mtime == entry->mtime)) {
+            unchanged++;
+            unchanged_bytes += entry->size;
+        } else {
+            AddTransferItem(&plan, local_path, remote_path, entry->size);
+        }
+    }
+
+    // Remote entries with no local counterpart; only the topmost of a stale subtree is listed
+    char** stale = (char**)SafeMalloc((remote.count > 0 ? remote.count : 1) * sizeof(char*));
+    int stale_count = 0;
+    for (int i = 0; i < remote.count; i++) {
+        const ManifestEntry* entry = &remote.entries[i];
+        if (FindManifestEntry(&local, entry->rel_path)) continue;
+
+        const char* slash = strrchr(entry->rel_path, '/');
+        if (slash) {
+            char parent[SYNC_PATH_MAX + 1];
+            size_t len = (size_t)(slash - entry->rel_path);
+            if (len >= sizeof(parent)) len = sizeof(parent) - 1;
+            memcpy(parent, entry->rel_path, len);
+            parent[len] = '\0';
+            if (!FindManifestEntry(&local, parent)) continue;
+        }
+
+        char remote_path[SYNC_PATH_MAX + 1];
+        JoinRemotePath(remote_path, sizeof(remote_path), remote_root, entry->rel_path);
+        stale[stale_count++] = _strdup(remote_path);
+    }
+
+    char push_str[32], same_str[32];
+    FormatByteCount(plan.total_bytes, push_str, sizeof(push_str));
+    FormatByteCount(unchanged_bytes, same_str, sizeof(same_str));
+    printf("%d changed or new (%s), %d unchanged (%s), %d stale on device",
+           plan.count, push_str, unchanged, same_str, stale_count);
+    if (conflicts > 0) printf(", %d conflict(s)", conflicts);
+    printf(".\n");
+
+    int success = conflicts == 0;
+    if (flags & DELTA_SYNC_DRY_RUN) {
+        for (int i = 0; i < plan.count; i++) printf("  push   %s\n", plan.items[i].remote_path);
+        for (int i = 0; i < stale_count; i++) {
+            printf("  %s %s\n", (flags & DELTA_SYNC_DELETE) ? "delete" : "stale ", stale[i]);
+        }
+    } else {
+        if (plan.dir_count > 0 &&
+            !RunBatchedShellCommand(state->adb_path, device->serial_id, "mkdir -p", plan.dirs, plan.dir_count)) {
+            PrintError(ADB_ERROR_UNKNOWN, "Failed to create remote folders");
+            success = 0;
+        } else if (plan.count > 0) {
+            success = RunTransferPlan(state, device->serial_id, &plan, 1, jobs, NULL) && success;
+        }
+
+        if (stale_count > 0 && (flags & DELTA_SYNC_DELETE)) {
+            printf("Deleting %d stale entr%s...\n", stale_count, stale_count == 1 ? "y" : "ies");
+            if (!RunBatchedShellCommand(state->adb_path, device->serial_id, "rm -rf", stale, stale_count)) {
+                PrintError(ADB_ERROR_UNKNOWN, "Failed to delete stale files");
+                success = 0;
+            }
+        } else if (stale_count > 0) {
+            printf("Stale entries kept (use --delete to remove them).\n");
+        }
+    }
+
+    for (int i = 0; i < stale_count; i++) free(stale[i]);
+    free(stale);
+    FreeTransferPlan(&plan);
+    FreeManifest(&local);
+    FreeManifest(&remote);
+    return success;
+}
+
+// ============================================================================
+// Broadcast Push
+// ============================================================================
+
+typedef struct BroadcastPush BroadcastPush;
+
+// One receiving device
+typedef struct {
+    BroadcastPush* push;
+    char serial[256];
+    char target[SYNC_PATH_MAX + 1];     // Resolved remote path
+    char error[256];
+    int finished;
+    int result;
+    ProgressTracker tracker;            // Guarded by print_lock
+} BroadcastTarget;
+
+// Shared state; every device streams from the same file mapping
+struct BroadcastPush {
+    const SyncSource* source;
+    const char* remote_path;
+    BroadcastTarget* targets;
+    int count;
+    int drawn_lines;                    // Rows of the progress block on screen
+    ULONGLONG last_draw_tick;
+    CRITICAL_SECTION print_lock;
+};
+
+// Redraw one row per device in place (caller holds print_lock)
+static void DrawBroadcastProgress(BroadcastPush* push, int force) {
+    ULONGLONG now = GetTickCount64();
+    if (!force && now - push->last_draw_tick < PROGRESS_REDRAW_MS) return;
+    push->last_draw_tick = now;
+
+    if (push->drawn_lines > 0) printf("\033[%dA", push->drawn_lines);
+    for (int i = 0; i < push->count; i++) {
+        BroadcastTarget* target = &push->targets[i];
+        char line[256];
+        if (target->finished && !target->result) {
+            snprintf(line, sizeof(line), ANSI_RED "FAILED: %s" ANSI_RESET, target->error);
+        } else if (!target->tracker.started) {
+            snprintf(line, sizeof(line), "waiting");
+        } else {
+            ProgressFormat(&target->tracker, line, sizeof(line));
+        }
+        printf("\r  %-24.24s %s\033[K\n", target->serial, line);
+    }
+    fflush(stdout);
+    push->drawn_lines = push->count;
+}
+
+// ProgressCallback for one device (a busy lock skips the update)
+static void BroadcastFileProgress(const char* filename, unsigned long long current,
+                                  unsigned long long total, void* user_data) {
+    (void)filename;
+    (void)total;
+    BroadcastTarget* target = (BroadcastTarget*)user_data;
+    BroadcastPush* push = target->push;
+    if (!TryEnterCriticalSection(&push->print_lock)) return;
+
+    ProgressRecord(&target->tracker, current);
+    DrawBroadcastProgress(push, 0);
+
+    LeaveCriticalSection(&push->print_lock);
+}
+
+// ParallelTask pushing the shared source to one device over its own sync session
+static int BroadcastToDevice(int worker, int index, void* context) {
+    (void)worker;
+    BroadcastPush* push = (BroadcastPush*)context;
+    BroadcastTarget* target = &push->targets[index];
+
+    SyncConnection conn;
+    int ok = SyncOpen(&conn, target->serial) &&
+             SyncResolvePushTarget(&conn, push->source->name, push->remote_path,
+                                   target->target, sizeof(target->target)) &&
+             SyncSendSource(&conn, push->source, target->target, BroadcastFileProgress, target);
+    if (!ok) snprintf(target->error, sizeof(target->error), "%s", conn.error[0] ? conn.error : "Push failed");
+    if (conn.sock != INVALID_SOCKET) SyncClose(&conn);
+
+    EnterCriticalSection(&push->print_lock);
+    if (ok) ProgressRecord(&target->tracker, push->source->size);
+    target->finished = 1;
+    target->result = ok;
+    DrawBroadcastProgress(push, 1);
+    LeaveCriticalSection(&push->print_lock);
+    return ok;
+}
+
+// Online adb devices in the current snapshot (caller frees the array and strings)
+static int CollectOnlineSerials(const AppState* state, char*** serials_out) {
+    *serials_out = NULL;
+
+    SnapshotGuard guard;
+    const DeviceSnapshot* snapshot = BeginSnapshotRead(state, &guard);
+    if (!snapshot) return 0;
+
+    int count = 0;
+    char** serials = (char**)SafeCalloc(snapshot->adb.count > 0 ? snapshot->adb.count : 1, sizeof(char*));
+    for (int i = 0; i < snapshot->adb.count; i++) {
+        if (snapshot->adb.summaries[i].state != DEVICE_STATE_ONLINE) continue;
+        serials[count++] = _strdup(DeviceListAt(&snapshot->adb, i)->serial_id);
+    }
+    EndSnapshotRead(state, &guard);
+
+    *serials_out = serials;
+    return count;
+}
+
+// Push one local file to several devices at once (all online devices if serials is NULL)
+int BroadcastPushFile(AppState* state, const char* local_path, const char* remote_path,
+                      const char* serials[], int count) {
+    if (!state || !local_path || !remote_path) {
+        PrintError(ADB_ERROR_INVALID_COMMAND, "Invalid arguments");
+        return 0;
+    }
+
+    char** online = NULL;
+    if (!serials) {
+        count = CollectOnlineSerials(state, &online);
+        serials = (const char**)online;
+    }
+    if (count <= 0) {
+        PrintError(ADB_ERROR_NO_DEVICE, NULL);
+        free(online);
+        return 0;
+    }
+
+    // Mapped once; the page cache then serves every device from a single disk read
+    SyncSource source;
+    char error[512];
+    if (!SyncOpenSource(&source, local_path, error, sizeof(error))) {
+        PrintError(ADB_ERROR_FILE_NOT_FOUND, error);
+        for (int i = 0; online && i < count; i++) free(online[i]);
+        free(online);
+        return 0;
+    }
+
+    BroadcastPush push;
+    memset(&push, 0, sizeof(push));
+    push.source = &source;
+    push.remote_path = remote_path;
+    push.count = count;
+    push.targets = (BroadcastTarget*)SafeCalloc(count, sizeof(BroadcastTarget));
+    InitializeCriticalSection(&push.print_lock);
+    for (int i = 0; i < count; i++) {
+        BroadcastTarget* target = &push.targets[i];
+        target->push = &push;
+        snprintf(target->serial, sizeof(target->serial), "%s", serials[i]);
+        ProgressStart(&target->tracker, "push", target->serial, source.name, source.size);
+    }
+
+    char size_str[32];
+    FormatByteCount(source.size, size_str, sizeof(size_str));
+    printf("Pushing %s (%s) to %d device(s)...\n", local_path, size_str, count);
+
+    EnterCriticalSection(&push.print_lock);
+    DrawBroadcastProgress(&push, 1);
+    LeaveCriticalSection(&push.print_lock);
+
+    int succeeded = RunParallel(count, MAX_PARALLEL_WORKERS, BroadcastToDevice, &push);
+
+    EnterCriticalSection(&push.print_lock);
+    DrawBroadcastProgress(&push, 1);
+    LeaveCriticalSection(&push.print_lock);
+
+    for (int i = 0; i < count; i++) {
+        ProgressLog(&push.targets[i].tracker, push.targets[i].result);
+    }
+    printf("Pushed to %d of %d device(s).\n", succeeded, count);
+
+    DeleteCriticalSection(&push.print_lock);
+    free(push.targets);
+    SyncCloseSource(&source);
+    for (int i = 0; online && i < count; i++) free(online[i]);
+    free(online);
+
+    if (succeeded != count) {
+        PrintError(ADB_ERROR_UNKNOWN, "Push failed on some devices");
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,507 @@
+#include "flash_ledger.h"
+#include "fastboot_var_cache.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+// Views start on the allocation granularity
+#define FINGERPRINT_MAP_ALIGN (64 * 1024)
+
+// Hashed ahead of everything else, so a change of scheme changes every fingerprint
+#define FINGERPRINT_VERSION "FADB-FP1"
+
+// Layout records: gaps of zeros, FILL runs, and decode parameters
+#define LAYOUT_ZEROS 'Z'
+#define LAYOUT_FILL 'F'
+#define LAYOUT_ZIP_ENTRY 'C'
+#define LAYOUT_PAYLOAD 'P'
+#define LAYOUT_OPERATION 'O'
+#define LAYOUT_EXTENT 'E'
+#define LAYOUT_RECORD_SIZE 25
+
+#define LEDGER_HEADER "timestamp,device,slot,partition,fingerprint,bytes,image\n"
+
+// Store a little-endian value
+static void PutLE64(unsigned char* p, unsigned long long value) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+// ============================================================================
+// Describing an image
+// ============================================================================
+
+// Append raw bytes to the layout
+static void AddLayoutBytes(FlashFingerprint* fingerprint, const void* data, size_t len) {
+    if (fingerprint->layout_size + len > fingerprint->layout_capacity) {
+        while (fingerprint->layout_size + len > fingerprint->layout_capacity) {
+            fingerprint->layout_capacity = fingerprint->layout_capacity ? fingerprint->layout_capacity * 2 : 256;
+        }
+        fingerprint->layout = (unsigned char*)SafeRealloc(fingerprint->layout, fingerprint->layout_capacity);
+    }
+    memcpy(fingerprint->layout + fingerprint->layout_size, data, len);
+    fingerprint->layout_size += len;
+}
+
+// Append one layout record; it also pins where in the image it applies
+static void AddLayout(FlashFingerprint* fingerprint, char tag, unsigned long long length, unsigned long long value) {
+    unsigned char record[LAYOUT_RECORD_SIZE];
+    record[0] = (unsigned char)tag;
+    PutLE64(record + 1, fingerprint->position);
+    PutLE64(record + 9, length);
+    PutLE64(record + 17, value);
+    AddLayoutBytes(fingerprint, record, sizeof(record));
+}
+
+// Image bytes that come straight from the file, merged with the previous range when adjacent
+static void AddRange(FlashFingerprint* fingerprint, unsigned long long offset, unsigned long long length) {
+    if (length == 0) return;
+    fingerprint->position += length;
+    fingerprint->hashed += length;
+
+    if (fingerprint->range_count > 0) {
+        FingerprintRange* last = &fingerprint->ranges[fingerprint->range_count - 1];
+        if (last->offset + last->length == offset) {
+            last->length += length;
+            return;
+        }
+    }
+    if (fingerprint->range_count == fingerprint->range_capacity) {
+        fingerprint->range_capacity = fingerprint->range_capacity ? fingerprint->range_capacity * 2 : 64;
+        fingerprint->ranges = (FingerprintRange*)SafeRealloc(fingerprint->ranges,
+                                                             fingerprint->range_capacity * sizeof(FingerprintRange));
+    }
+    fingerprint->ranges[fingerprint->range_count].offset = offset;
+    fingerprint->ranges[fingerprint->range_count].length = length;
+    fingerprint->range_count++;
+}
+
+// Image bytes that are all zeros
+static void AddZeros(FlashFingerprint* fingerprint, unsigned long long length) {
+    if (length == 0) return;
+    AddLayout(fingerprint, LAYOUT_ZEROS, length, 0);
+    fingerprint->position += length;
+}
+
+// Expanded bytes [offset, offset + length) of a (sparse or raw) image file
+static int AddImageRange(FlashFingerprint* fingerprint, const SparseImage* image, unsigned long long offset,
+                         unsigned long long length) {
+    for (int i = 0; i < image->chunk_count && length > 0; i++) {
+        const SparseChunk* chunk = &image->chunks[i];
+        unsigned long long start = (unsigned long long)chunk->first_block * image->block_size;
+        unsigned long long end = start + (unsigned long long)chunk->blocks * image->block_size;
+        if (end <= offset) continue;
+        if (start > offset) break;
+
+        unsigned long long step = (end - offset < length ? end - offset : length);
+        if (chunk->type == SPARSE_CHUNK_RAW) {
+            // The last block of a raw file can end short of the block size
+            unsigned long long at = chunk->offset + (offset - start);
+            unsigned long long in_file = at < image->file_size ? image->file_size - at : 0;
+            if (in_file > step) in_file = step;
+            AddRange(fingerprint, at, in_file);
+            AddZeros(fingerprint, step - in_file);
+        } else if (chunk->type == SPARSE_CHUNK_FILL && chunk->fill != 0) {
+            AddLayout(fingerprint, LAYOUT_FILL, step, chunk->fill);
+            fingerprint->position += step;
+        } else {
+            AddZeros(fingerprint, step);
+        }
+        offset += step;
+        length -= step;
+    }
+    if (length > 0) {
+        snprintf(fingerprint->error, sizeof(fingerprint->error), "Extent past the end of %s", fingerprint->path);
+        return 0;
+    }
+    return 1;
+}
+
+// A payload partition: operation data (or its SHA-256 from the manifest) and where it goes
+static int DescribePayloadPartition(FlashFingerprint* fingerprint, Payload* payload,
+                                    const PayloadPartition* partition) {
+    snprintf(fingerprint->path, sizeof(fingerprint->path), "%s", payload->path);
+    AddLayout(fingerprint, LAYOUT_PAYLOAD, PayloadPartitionSize(payload, partition), payload->block_size);
+
+    for (int i = 0; i < partition->operation_count; i++) {
+        const PayloadOperation* op = &partition->operations[i];
+        AddLayout(fingerprint, LAYOUT_OPERATION, op->data_length, (unsigned long long)op->type);
+        for (int j = 0; j < op->extent_count; j++) {
+            const PayloadExtent* extent = &partition->extents[op->first_extent + j];
+            AddLayout(fingerprint, LAYOUT_EXTENT, extent->num_blocks, extent->start_block);
+        }
+        // Data the manifest vouches for needs no hashing of our own
+        if (op->has_data_sha256) {
+            AddLayoutBytes(fingerprint, op->data_sha256, sizeof(op->data_sha256));
+        } else if (op->data_length > 0) {
+            AddRange(fingerprint, payload->base + payload->data_offset + op->data_offset, op->data_length);
+        }
+    }
+    return 1;
+}
+
+// A super image partition: its extents, expanded through the image's chunks
+static int DescribeSuperPartition(FlashFingerprint* fingerprint, SuperImage* super, const SuperPartition* partition,
+                                  const char* path) {
+    snprintf(fingerprint->path, sizeof(fingerprint->path), "%s", path);
+    for (int i = 0; i < partition->extent_count; i++) {
+        const SuperExtent* extent = &super->extents[partition->first_extent + i];
+        if (extent->is_zero) {
+            AddZeros(fingerprint, extent->length);
+        } else if (!AddImageRange(fingerprint, &super->image, extent->offset, extent->length)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Describe where a plan image's bytes come from
+int FlashFingerprintInit(FlashFingerprint* fingerprint, FlashPlan* plan, int index) {
+    if (!fingerprint || !plan || index < 0 || index >= plan->count) return 0;
+    memset(fingerprint, 0, sizeof(*fingerprint));
+    const FlashPlanImage* image = &plan->images[index];
+
+    if (image->payload_partition >= 0) {
+        return DescribePayloadPartition(fingerprint, &plan->payload, &plan->payload.partitions[image->payload_partition]);
+    }
+    if (image->super_partition >= 0) {
+        return DescribeSuperPartition(fingerprint, &plan->super, &plan->super.partitions[image->super_partition],
+                                      plan->source);
+    }
+
+    if (image->zip_entry >= 0) {
+        const ZipEntry* entry = &plan->zip.entries[image->zip_entry];
+        unsigned long long offset = 0;
+        snprintf(fingerprint->path, sizeof(fingerprint->path), "%s", plan->zip.path);
+        if (!ZipEntryDataOffset(&plan->zip, entry, &offset)) {
+            snprintf(fingerprint->error, sizeof(fingerprint->error), "%s", plan->zip.error);
+            return 0;
+        }
+        AddLayout(fingerprint, LAYOUT_ZIP_ENTRY, entry->size, ((unsigned long long)entry->method << 32) | entry->crc32);
+        AddRange(fingerprint, offset, entry->compressed_size);
+        return 1;
+    }
+
+    // A file as it is, compressed or not
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    snprintf(fingerprint->path, sizeof(fingerprint->path), "%s", image->image);
+    if (!GetFileAttributesExA(image->image, GetFileExInfoStandard, &info)) {
+        snprintf(fingerprint->error, sizeof(fingerprint->error), "Cannot read %s", image->image);
+        return 0;
+    }
+    AddRange(fingerprint, 0, ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow);
+    return 1;
+}
+
+// Release the description
+void FlashFingerprintFree(FlashFingerprint* fingerprint) {
+    if (!fingerprint) return;
+    free(fingerprint->ranges);
+    free(fingerprint->layout);
+    fingerprint->ranges = NULL;
+    fingerprint->layout = NULL;
+    fingerprint->range_count = 0;
+    fingerprint->range_capacity = 0;
+    fingerprint->layout_size = 0;
+    fingerprint->layout_capacity = 0;
+}
+
+// ============================================================================
+// Hashing
+// ============================================================================
+
+// Pieces of the ranges and their digests
+typedef struct {
+    HANDLE mapping;
+    const FingerprintRange* pieces;
+    unsigned char* digests;             // SHA256_DIGEST_SIZE per piece
+    volatile LONG failed;
+} FingerprintJob;
+
+// ParallelTask: hash one piece through a view of its own
+static int HashPiece(int worker, int index, void* context) {
+    (void)worker;
+    FingerprintJob* job = (FingerprintJob*)context;
+    if (job->failed) return 0;
+
+    const FingerprintRange* piece = &job->pieces[index];
+    unsigned long long aligned = piece->offset & ~(unsigned long long)(FINGERPRINT_MAP_ALIGN - 1);
+    SIZE_T span = (SIZE_T)(piece->offset - aligned + piece->length);
+    const unsigned char* view = (const unsigned char*)MapViewOfFile(job->mapping, FILE_MAP_READ, (DWORD)(aligned >> 32),
+                                                                    (DWORD)aligned, span);
+    if (!view) {
+        InterlockedExchange(&job->failed, 1);
+        return 0;
+    }
+
+    Sha256Context ctx;
+    Sha256Init(&ctx);
+    Sha256Update(&ctx, view + (piece->offset - aligned), (size_t)piece->length);
+    Sha256Final(&ctx, job->digests + (size_t)index * SHA256_DIGEST_SIZE);
+    UnmapViewOfFile(view);
+    return 1;
+}
+
+// Split the ranges into pieces, hash them on all cores, then hash the digests with the layout
+int FlashFingerprintCompute(FlashFingerprint* fingerprint) {
+    if (!fingerprint) return 0;
+
+    int piece_count = 0;
+    for (int i = 0; i < fingerprint->range_count; i++) {
+        piece_count += (int)((fingerprint->ranges[i].length + FLASH_FINGERPRINT_PIECE - 1) / FLASH_FINGERPRINT_PIECE);
+    }
+
+    FingerprintJob job;
+    memset(&job, 0, sizeof(job));
+    FingerprintRange* pieces = NULL;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    int ok = 1;
+    if (piece_count > 0) {
+        file = CreateFileA(fingerprint->path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER size;
+        ok = file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &size);
+        if (!ok) snprintf(fingerprint->error, sizeof(fingerprint->error), "Cannot open %s", fingerprint->path);
+        for (int i = 0; ok && i < fingerprint->range_count; i++) {
+            const FingerprintRange* range = &fingerprint->ranges[i];
+            ok = range->offset + range->length <= (unsigned long long)size.QuadPart;
+            if (!ok) snprintf(fingerprint->error, sizeof(fingerprint->error), "%s is truncated", fingerprint->path);
+        }
+        job.mapping = ok ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        if (ok && !job.mapping) {
+            snprintf(fingerprint->error, sizeof(fingerprint->error), "Cannot map %s (error %lu)", fingerprint->path,
+                     GetLastError());
+            ok = 0;
+        }
+    }
+
+    if (ok && piece_count > 0) {
+        pieces = (FingerprintRange*)SafeMalloc((size_t)piece_count * sizeof(FingerprintRange));
+        int n = 0;
+        for (int i = 0; i < fingerprint->range_count; i++) {
+            const FingerprintRange* range = &fingerprint->ranges[i];
+            for (unsigned long long done = 0; done < range->length; done += FLASH_FINGERPRINT_PIECE) {
+                pieces[n].offset = range->offset + done;
+                pieces[n].length = range->length - done < FLASH_FINGERPRINT_PIECE ? range->length - done
+                                                                                  : FLASH_FINGERPRINT_PIECE;
+                n++;
+            }
+        }
+        job.pieces = pieces;
+        job.digests = (unsigned char*)SafeMalloc((size_t)piece_count * SHA256_DIGEST_SIZE);
+        ok = RunParallel(piece_count, ParallelWorkerCount(), HashPiece, &job) == piece_count && !job.failed;
+        if (!ok) snprintf(fingerprint->error, sizeof(fingerprint->error), "Cannot read %s", fingerprint->path);
+    }
+
+    if (ok) {
+        unsigned char total[8];
+        unsigned char digest[SHA256_DIGEST_SIZE];
+        PutLE64(total, fingerprint->hashed);
+        Sha256Context ctx;
+        Sha256Init(&ctx);
+        Sha256Update(&ctx, FINGERPRINT_VERSION, strlen(FINGERPRINT_VERSION));
+        Sha256Update(&ctx, total, sizeof(total));
+        if (fingerprint->layout_size > 0) Sha256Update(&ctx, fingerprint->layout, fingerprint->layout_size);
+        if (piece_count > 0) Sha256Update(&ctx, job.digests, (size_t)piece_count * SHA256_DIGEST_SIZE);
+        Sha256Final(&ctx, digest);
+        Sha256ToHex(digest, fingerprint->hex);
+    }
+
+    if (job.mapping) CloseHandle(job.mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    free(job.digests);
+    free(pieces);
+    return ok;
+}
+
+// ============================================================================
+// Ledger file
+// ============================================================================
+
+// boot_a stays boot_a (slot a); boot becomes boot_<current slot> when the device has slots for it
+void FlashLedgerPartitionKey(const char* fastboot_path, const char* device_serial, const char* partition,
+                             char* key, size_t key_size, char* slot, size_t slot_size) {
+    snprintf(key, key_size, "%s", partition);
+    slot[0] = '\0';
+    if (HasSlotSuffix(partition)) {
+        snprintf(slot, slot_size, "%s", partition + strlen(partition) - 1);
+        return;
+    }
+
+    char current[FASTBOOT_VAR_MAX_LEN];
+    if (!FastbootVarCacheGetCurrentSlot(fastboot_path, device_serial, current, sizeof(current)) || !current[0]) return;
+    if (current[0] == '_') memmove(current, current + 1, strlen(current));
+
+    char name[96];
+    char value[FASTBOOT_VAR_MAX_LEN];
+    unsigned long long size = 0;
+    snprintf(name, sizeof(name), "has-slot:%s", partition);
+    int slotted = FastbootVarCacheGet(fastboot_path, device_serial, name, value, sizeof(value)) &&
+                  _stricmp(value, "yes") == 0;
+    snprintf(name, sizeof(name), "%s_%s", partition, current);
+    if (!slotted) slotted = FastbootVarCacheGetPartitionSize(fastboot_path, device_serial, name, &size);
+    if (slotted) {
+        snprintf(key, key_size, "%s", name);
+        snprintf(slot, slot_size, "%s", current);
+    }
+}
+
+// Split a ledger line into a row; the image column takes the rest of the line
+static int ParseLedgerLine(char* line, FlashLedgerEntry* entry) {
+    line[strcspn(line, "\r\n")] = '\0';
+    char* fields[7];
+    int count = 0;
+    char* p = line;
+    while (count < 6) {
+        fields[count++] = p;
+        char* comma = strchr(p, ',');
+        if (!comma) return 0;
+        *comma = '\0';
+        p = comma + 1;
+    }
+    fields[count] = p;
+
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->timestamp, sizeof(entry->timestamp), "%s", fields[0]);
+    snprintf(entry->device, sizeof(entry->device), "%s", fields[1]);
+    snprintf(entry->slot, sizeof(entry->slot), "%s", fields[2]);
+    snprintf(entry->partition, sizeof(entry->partition), "%s", fields[3]);
+    if (strlen(fields[4]) == SHA256_HEX_SIZE - 1) {
+        snprintf(entry->fingerprint, sizeof(entry->fingerprint), "%s", fields[4]);
+    }
+    entry->size = strtoull(fields[5], NULL, 10);
+    snprintf(entry->image, sizeof(entry->image), "%s", fields[6]);
+    return entry->device[0] && entry->partition[0];
+}
+
+// Latest matching row; the file is append-only, so that is the last one
+int FlashLedgerFind(const char* device_serial, const char* partition_key, FlashLedgerEntry* entry) {
+    if (!device_serial || !partition_key || !entry) return 0;
+    FILE* fp = fopen(FLASH_LEDGER_FILE, "r");
+    if (!fp) return 0;
+
+    int found = 0;
+    char line[MAX_PATH + 256];
+    FlashLedgerEntry row;
+    while (fgets(line, sizeof(line), fp)) {
+        if (ParseLedgerLine(line, &row) && strcmp(row.device, device_serial) == 0 &&
+            _stricmp(row.partition, partition_key) == 0) {
+            *entry = row;
+            found = 1;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+// Append one row, with the header when the file is new
+int FlashLedgerRecord(const char* device_serial, const char* slot, const char* partition_key,
+                      const char* fingerprint, unsigned long long size, const char* image) {
+    if (!device_serial || !partition_key) return 0;
+    int exists = FileExists(FLASH_LEDGER_FILE);
+    FILE* fp = fopen(FLASH_LEDGER_FILE, "a");
+    if (!fp) return 0;
+    if (!exists) fputs(LEDGER_HEADER, fp);
+
+    // Commas would split the column; labels are file or partition names
+    char label[MAX_PATH];
+    snprintf(label, sizeof(label), "%s", image ? image : "");
+    for (char* p = label; *p; p++) {
+        if (*p == ',' || *p == '"') *p = ' ';
+    }
+
+    char timestamp[64];
+    GetCurrentTimestamp(timestamp, sizeof(timestamp));
+    fprintf(fp, "%s,%s,%s,%s,%s,%llu,%s\n", timestamp, device_serial, slot ? slot : "", partition_key,
+            fingerprint ? fingerprint : "", size, label);
+    int ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+// Rows with a fingerprint whose partition the device reports as logical get an erased row
+void FlashLedgerForgetLogical(const char* fastboot_path, const char* device_serial) {
+    FlashLedgerEntry* entries = NULL;
+    int count = 0;
+    if (!device_serial || !FlashLedgerLoad(device_serial, &entries, &count)) return;
+
+    for (int i = 0; i < count; i++) {
+        char name[96];
+        char value[FASTBOOT_VAR_MAX_LEN];
+        snprintf(name, sizeof(name), "is-logical:%s", entries[i].partition);
+        if (entries[i].fingerprint[0] && FastbootVarCacheGet(fastboot_path, device_serial, name, value, sizeof(value)) &&
+            _stricmp(value, "yes") == 0) {
+            FlashLedgerRecord(device_serial, entries[i].slot, entries[i].partition, NULL, 0, "(super flashed)");
+        }
+    }
+    free(entries);
+}
+
+// Keep the last row per device and partition, in order of first appearance
+int FlashLedgerLoad(const char* device_serial, FlashLedgerEntry** entries, int* count) {
+    if (!entries || !count) return 0;
+    *entries = NULL;
+    *count = 0;
+    FILE* fp = fopen(FLASH_LEDGER_FILE, "r");
+    if (!fp) return 1;
+
+    int capacity = 0;
+    char line[MAX_PATH + 256];
+    FlashLedgerEntry row;
+    while (fgets(line, sizeof(line), fp)) {
+        if (!ParseLedgerLine(line, &row) || strcmp(row.device, "device") == 0) continue;
+        if (device_serial && strcmp(row.device, device_serial) != 0) continue;
+
+        int i = 0;
+        while (i < *count && (strcmp((*entries)[i].device, row.device) != 0 ||
+                              _stricmp((*entries)[i].partition, row.partition) != 0)) {
+            i++;
+        }
+        if (i == *count) {
+            if (*count == capacity) {
+                capacity = capacity ? capacity * 2 : 32;
+                *entries = (FlashLedgerEntry*)SafeRealloc(*entries, capacity * sizeof(FlashLedgerEntry));
+            }
+            (*count)++;
+        }
+        (*entries)[i] = row;
+    }
+    fclose(fp);
+    return 1;
+}
+
+// Rewrite the file without the device's rows (or delete it)
+int FlashLedgerClear(const char* device_serial) {
+    FILE* in = fopen(FLASH_LEDGER_FILE, "r");
+    if (!in) return 0;
+
+    char temp_path[MAX_PATH];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", FLASH_LEDGER_FILE);
+    FILE* out = device_serial ? fopen(temp_path, "w") : NULL;
+    if (device_serial && !out) {
+        fclose(in);
+        return -1;
+    }
+
+    int removed = 0;
+    char line[MAX_PATH + 256];
+    char copy[MAX_PATH + 256];
+    FlashLedgerEntry row;
+    while (fgets(line, sizeof(line), in)) {
+        snprintf(copy, sizeof(copy), "%s", line);
+        int is_row = ParseLedgerLine(copy, &row) && strcmp(row.device, "device") != 0;
+        if (is_row && (!device_serial || strcmp(row.device, device_serial) == 0)) {
+            removed++;
+        } else if (out) {
+            fputs(line, out);
+        }
+    }
+    fclose(in);
+
+    if (!out) return DeleteFileA(FLASH_LEDGER_FILE) ? removed : -1;
+    int ok = !ferror(out);
+    fclose(out);
+    if (!ok || !MoveFileExA(temp_path, FLASH_LEDGER_FILE, MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(temp_path);
+        return -1;
+    }
+    return removed;
+}
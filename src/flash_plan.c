@@ -0,0 +1,608 @@
+#include "flash_plan.h"
+#include "resource_extractor.h"
+#include "sparse_image.h"
+#include "progress.h"
+#include "utils.h"
+#include <stdio.h>
+#include <ctype.h>
+
+// Output buffer when unpacking into a sparse temporary file
+#define SPARSE_FILE_BUFFER (4 * 1024 * 1024)
+
+// Partitions flashall picks up from folders and zips, in flashing order.
+// userdata and cache are never written: wiping is a separate decision.
+static const char* g_flashall_partitions[] = {
+    "boot", "init_boot", "vendor_boot", "vendor_kernel_boot", "dtbo", "dt", "pvmfw", "recovery",
+    "super", "system", "system_ext", "system_dlkm", "product", "vendor", "vendor_dlkm", "odm", "odm_dlkm",
+    "vbmeta", "vbmeta_system", "vbmeta_vendor", NULL
+};
+
+// Partition names go straight into fastboot commands
+static int IsValidPartitionName(const char* name) {
+    if (!name[0]) return 0;
+    for (const char* p = name; *p; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_' && *p != '-') return 0;
+    }
+    return 1;
+}
+
+// Size and compression of an image file; 0 if it is missing or empty
+static int InspectImageFile(FlashPlanImage* image, char* error, size_t error_size) {
+    HANDLE file = CreateFileA(image->image, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        snprintf(error, error_size, "Cannot open %s for %s", image->image, image->partition);
+        return 0;
+    }
+
+    LARGE_INTEGER size;
+    unsigned char magic[8] = {0};
+    DWORD got = 0;
+    int ok = GetFileSizeEx(file, &size) && ReadFile(file, magic, sizeof(magic), &got, NULL);
+    CloseHandle(file);
+    if (!ok || size.QuadPart == 0) {
+        snprintf(error, error_size, "%s (for %s) is empty or unreadable", image->image, image->partition);
+        return 0;
+    }
+    image->size = (unsigned long long)size.QuadPart;
+    image->compression = DetectCompression(magic, got);
+    return 1;
+}
+
+// Add a plan entry; 0 when the plan is full or the partition repeats
+static FlashPlanImage* AddPlanImage(FlashPlan* plan, const char* partition) {
+    for (int i = 0; i < plan->count; i++) {
+        if (strcmp(plan->images[i].partition, partition) == 0) {
+            snprintf(plan->error, sizeof(plan->error), "Partition %s is listed twice", partition);
+            return NULL;
+        }
+    }
+    if (plan->count == FLASH_PLAN_MAX_IMAGES) {
+        snprintf(plan->error, sizeof(plan->error), "Too many images (at most %d)", FLASH_PLAN_MAX_IMAGES);
+        return NULL;
+    }
+
+    FlashPlanImage* image = &plan->images[plan->count++];
+    memset(image, 0, sizeof(*image));
+    snprintf(image->partition, sizeof(image->partition), "%s", partition);
+    image->zip_entry = -1;
+    image->payload_partition = -1;
+    image->super_partition = -1;
+    return image;
+}
+
+// ============================================================================
+// Sources
+// ============================================================================
+
+// "<partition> <image>" lines plus set_active/reboot directives
+static int LoadManifest(FlashPlan* plan, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        snprintf(plan->error, sizeof(plan->error), "Cannot open %s", path);
+        return 0;
+    }
+
+    // Image paths are relative to the manifest's folder
+    char folder[MAX_PATH];
+    snprintf(folder, sizeof(folder), "%s", path);
+    char* slash = strrchr(folder, '\\');
+    char* forward = strrchr(folder, '/');
+    if (forward > slash) slash = forward;
+    if (slash) {
+        *slash = '\0';
+    } else {
+        snprintf(folder, sizeof(folder), ".");
+    }
+
+    char line[1024];
+    int line_number = 0;
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), file)) {
+        line_number++;
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        TrimString(line);
+        if (!line[0]) continue;
+
+        char* rest = line;
+        while (*rest && !isspace((unsigned char)*rest)) rest++;
+        if (*rest) *rest++ = '\0';
+        TrimString(rest);
+        size_t rest_len = strlen(rest);
+        if (rest_len >= 2 && rest[0] == '"' && rest[rest_len - 1] == '"') {
+            rest[rest_len - 1] = '\0';
+            rest++;
+        }
+
+        if (strcmp(line, "set_active") == 0) {
+            snprintf(plan->set_active, sizeof(plan->set_active), "%s", rest);
+        } else if (strcmp(line, "reboot") == 0) {
+            plan->reboot = 1;
+            snprintf(plan->reboot_mode, sizeof(plan->reboot_mode), "%s", rest);
+        } else if (!IsValidPartitionName(line) || strlen(line) >= sizeof(plan->images[0].partition) || !rest[0]) {
+            snprintf(plan->error, sizeof(plan->error), "%s:%d: expected \"<partition> <image>\"", path, line_number);
+            ok = 0;
+        } else {
+            FlashPlanImage* image = AddPlanImage(plan, line);
+            if (!image) {
+                ok = 0;
+            } else if (rest[0] == '/' || rest[0] == '\\' || strchr(rest, ':')) {
+                snprintf(image->image, sizeof(image->image), "%s", rest);
+            } else {
+                JoinPath(image->image, sizeof(image->image), folder, rest);
+            }
+            if (ok) ok = InspectImageFile(image, plan->error, sizeof(plan->error));
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+// <partition>.img files of a folder
+static int LoadFolder(FlashPlan* plan, const char* folder) {
+    for (int i = 0; g_flashall_partitions[i]; i++) {
+        char name[96], path[MAX_PATH];
+        snprintf(name, sizeof(name), "%s.img", g_flashall_partitions[i]);
+        JoinPath(path, sizeof(path), folder, name);
+        if (!FileExists(path)) continue;
+
+        FlashPlanImage* image = AddPlanImage(plan, g_flashall_partitions[i]);
+        if (!image) return 0;
+        snprintf(image->image, sizeof(image->image), "%s", path);
+        if (!InspectImageFile(image, plan->error, sizeof(plan->error))) return 0;
+    }
+    return 1;
+}
+
+// <partition>.img entries of the open zip
+static int LoadZipEntries(FlashPlan* plan) {
+    for (int i = 0; g_flashall_partitions[i]; i++) {
+        char name[96];
+        snprintf(name, sizeof(name), "%s.img", g_flashall_partitions[i]);
+        const ZipEntry* entry = ZipFindEntry(&plan->zip, name);
+        if (!entry) continue;
+
+        FlashPlanImage* image = AddPlanImage(plan, g_flashall_partitions[i]);
+        if (!image) return 0;
+        snprintf(image->image, sizeof(image->image), "%s", entry->name);
+        image->zip_entry = (int)(entry - plan->zip.entries);
+        image->size = entry->size;
+    }
+    return 1;
+}
+
+// DecompressWriteFn into a local file
+static int WriteToFile(const void* data, size_t len, void* user_data) {
+    DWORD written = 0;
+    return WriteFile((HANDLE)user_data, data, (DWORD)len, &written, NULL) && written == len;
+}
+
+// Plans unpacking at the same time each get their own folder under temp_root
+static volatile LONG g_temp_dir_count = 0;
+
+// Temporary folder for unpacked images, inside temp_root when one is set
+static int EnsureTempDir(FlashPlan* plan) {
+    if (plan->temp_dir[0]) return 1;
+    if (!plan->temp_root[0]) return CreateTempDirectory(plan->temp_dir, sizeof(plan->temp_dir));
+
+    char name[32];
+    snprintf(name, sizeof(name), "flash_%ld", InterlockedIncrement(&g_temp_dir_count));
+    JoinPath(plan->temp_dir, sizeof(plan->temp_dir), plan->temp_root, name);
+    if (!CreateDirectoryA(plan->temp_dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        plan->temp_dir[0] = '\0';
+        return 0;
+    }
+    return 1;
+}
+
+// Unpack a zip entry to a local file
+static int ExtractEntryToFile(ZipArchive* zip, const ZipEntry* entry, const char* path,
+                              char* error, size_t error_size) {
+    HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        snprintf(error, error_size, "Cannot create %s (error %lu)", path, GetLastError());
+        return 0;
+    }
+    int ok = ZipExtractEntry(zip, entry, WriteToFile, file);
+    CloseHandle(file);
+    if (!ok) {
+        snprintf(error, error_size, "%s", zip->error);
+        DeleteFileA(path);
+    }
+    return ok;
+}
+
+// Factory zip: images at any depth, or inside a nested image-*.zip
+static int LoadZip(FlashPlan* plan, const char* path) {
+    if (!ZipOpen(&plan->zip, path)) {
+        snprintf(plan->error, sizeof(plan->error), "%s", plan->zip.error);
+        return 0;
+    }
+    plan->has_zip = 1;
+    if (!LoadZipEntries(plan)) return 0;
+    if (plan->count > 0) return 1;
+
+    const ZipEntry* nested = NULL;
+    for (int i = 0; i < plan->zip.count && !nested; i++) {
+        const char* name = plan->zip.entries[i].name;
+        const char* slash = strrchr(name, '/');
+        if (slash) name = slash + 1;
+        size_t len = strlen(name);
+        if (StringStartsWith(name, "image-") && len > 4 && _stricmp(name + len - 4, ".zip") == 0) {
+            nested = &plan->zip.entries[i];
+        }
+    }
+    if (!nested) return 1;
+
+    // A stored inner zip is read in place; a compressed one is unpacked once
+    ZipArchive inner;
+    if (nested->method == 0) {
+        if (!ZipOpenNested(&inner, &plan->zip, nested)) {
+            snprintf(plan->error, sizeof(plan->error), "%s", inner.error);
+            return 0;
+        }
+    } else {
+        if (!EnsureTempDir(plan)) {
+            snprintf(plan->error, sizeof(plan->error), "Cannot create a temporary folder");
+            return 0;
+        }
+        JoinPath(plan->nested_copy, sizeof(plan->nested_copy), plan->temp_dir, "images.zip");
+        printf("Unpacking %s to %s...\n", nested->name, plan->nested_copy);
+        if (!ExtractEntryToFile(&plan->zip, nested, plan->nested_copy, plan->error, sizeof(plan->error))) {
+            plan->nested_copy[0] = '\0';
+            return 0;
+        }
+        if (!ZipOpen(&inner, plan->nested_copy)) {
+            snprintf(plan->error, sizeof(plan->error), "%s", inner.error);
+            return 0;
+        }
+    }
+
+    ZipClose(&plan->zip);
+    plan->zip = inner;
+    return LoadZipEntries(plan);
+}
+
+// True if the file starts like a zip archive
+static int IsZipFile(const char* path) {
+    unsigned char magic[4] = {0};
+    FILE* file = fopen(path, "rb");
+    size_t got = file ? fread(magic, 1, sizeof(magic), file) : 0;
+    if (file) fclose(file);
+    return got == 4 && memcmp(magic, "PK\x03\x04", 4) == 0;
+}
+
+// Load a plan from a manifest, folder or zip
+int FlashPlanLoad(FlashPlan* plan, const char* source) {
+    if (!plan || !source) return 0;
+    memset(plan, 0, sizeof(*plan));
+    plan->zip.file = INVALID_HANDLE_VALUE;
+    snprintf(plan->source, sizeof(plan->source), "%s", source);
+
+    int ok;
+    if (DirectoryExists(source)) {
+        ok = LoadFolder(plan, source);
+    } else if (FileExists(source)) {
+        ok = IsZipFile(source) ? LoadZip(plan, source) : LoadManifest(plan, source);
+    } else {
+        snprintf(plan->error, sizeof(plan->error), "%s not found", source);
+        ok = 0;
+    }
+
+    if (ok && plan->count == 0) {
+        snprintf(plan->error, sizeof(plan->error), "No partition images found in %s", source);
+        ok = 0;
+    }
+    if (ok && plan->set_active[0] && !IsValidPartitionName(plan->set_active)) {
+        snprintf(plan->error, sizeof(plan->error), "Invalid slot '%s'", plan->set_active);
+        ok = 0;
+    }
+    return ok;
+}
+
+// The partition's image in an OTA payload (a slot suffix may be left off either side)
+static int LoadPayloadImage(FlashPlan* plan, FlashPlanImage* image, const char* path) {
+    if (!PayloadOpen(&plan->payload, path)) {
+        snprintf(plan->error, sizeof(plan->error), "%s", plan->payload.error);
+        return 0;
+    }
+    plan->has_payload = 1;
+
+    const PayloadPartition* partition = PayloadFindPartition(&plan->payload, image->partition);
+    if (!partition) {
+        snprintf(plan->error, sizeof(plan->error), "The payload in %s has no %s partition", path, image->partition);
+        return 0;
+    }
+    if (partition->is_delta) {
+        snprintf(plan->error, sizeof(plan->error), "%s in %s is a delta update and needs the source build",
+                 partition->name, path);
+        return 0;
+    }
+    snprintf(image->image, sizeof(image->image), "payload.bin:%s", partition->name);
+    image->payload_partition = (int)(partition - plan->payload.partitions);
+    image->size = PayloadPartitionSize(&plan->payload, partition);
+    return 1;
+}
+
+// A logical partition of a super image, read through its mapping while flashing
+static int LoadSuperImage(FlashPlan* plan, FlashPlanImage* image, const char* path) {
+    if (!SuperImageOpen(&plan->super, path)) {
+        snprintf(plan->error, sizeof(plan->error), "%s", plan->super.error);
+        return 0;
+    }
+    plan->has_super = 1;
+
+    const SuperPartition* partition = SuperImageFindPartition(&plan->super, image->partition);
+    if (!partition) {
+        snprintf(plan->error, sizeof(plan->error), "The super image %s has no %s partition", path, image->partition);
+        return 0;
+    }
+    if (partition->foreign) {
+        snprintf(plan->error, sizeof(plan->error), "%s in %s has extents on another block device", partition->name,
+                 path);
+        return 0;
+    }
+    snprintf(image->image, sizeof(image->image), "super:%s", partition->name);
+    image->super_partition = (int)(partition - plan->super.partitions);
+    image->size = partition->size;
+    return 1;
+}
+
+// One image for one partition: a file (compressed or not), the <partition>.img
+// entry of a zip, the partition of an OTA payload, or a logical partition of a
+// super image
+int FlashPlanLoadImage(FlashPlan* plan, const char* partition, const char* path) {
+    if (!plan || !partition || !path) return 0;
+    memset(plan, 0, sizeof(*plan));
+    plan->zip.file = INVALID_HANDLE_VALUE;
+    snprintf(plan->source, sizeof(plan->source), "%s", path);
+
+    if (!IsValidPartitionName(partition) || strlen(partition) >= sizeof(plan->images[0].partition)) {
+        snprintf(plan->error, sizeof(plan->error), "Invalid partition name '%s'", partition);
+        return 0;
+    }
+    FlashPlanImage* image = AddPlanImage(plan, partition);
+
+    if (PayloadIsPayloadFile(path)) return LoadPayloadImage(plan, image, path);
+    if (_stricmp(partition, "super") != 0 && SuperImageIsSuperFile(path)) return LoadSuperImage(plan, image, path);
+    if (!IsZipFile(path)) {
+        snprintf(image->image, sizeof(image->image), "%s", path);
+        return InspectImageFile(image, plan->error, sizeof(plan->error));
+    }
+
+    if (!ZipOpen(&plan->zip, path)) {
+        snprintf(plan->error, sizeof(plan->error), "%s", plan->zip.error);
+        return 0;
+    }
+    plan->has_zip = 1;
+    char name[96];
+    snprintf(name, sizeof(name), "%s.img", partition);
+    const ZipEntry* entry = ZipFindEntry(&plan->zip, name);
+    if (!entry && ZipFindEntry(&plan->zip, "payload.bin")) {
+        // OTA package: the image comes out of its payload
+        ZipClose(&plan->zip);
+        plan->has_zip = 0;
+        return LoadPayloadImage(plan, image, path);
+    }
+    if (!entry) {
+        snprintf(plan->error, sizeof(plan->error), "%s has no %s", path, name);
+        return 0;
+    }
+    snprintf(image->image, sizeof(image->image), "%s", entry->name);
+    image->zip_entry = (int)(entry - plan->zip.entries);
+    image->size = entry->size;
+    return 1;
+}
+
+// ============================================================================
+// Preparation
+// ============================================================================
+
+// Local image file being decompressed; position counts the bytes read
+typedef struct {
+    HANDLE file;
+    unsigned long long* position;
+} FileSource;
+
+// DecompressReadFn over a local file
+static int ReadFromFile(void* buffer, size_t size, void* user_data) {
+    FileSource* source = (FileSource*)user_data;
+    DWORD got = 0;
+    if (!ReadFile(source->file, buffer, (DWORD)size, &got, NULL)) return -1;
+    *source->position += got;
+    return (int)got;
+}
+
+// Image bytes on their way out: hashed and, for zip entries, counted
+typedef struct {
+    DecompressWriteFn write;
+    void* write_data;
+    Sha256Context* digest;
+    unsigned long long* position;       // NULL when the reader counts instead
+} ImageSink;
+
+// DecompressWriteFn in front of the caller's
+static int WriteImageBytes(const void* data, size_t len, void* user_data) {
+    ImageSink* sink = (ImageSink*)user_data;
+    if (sink->digest) Sha256Update(sink->digest, data, len);
+    if (sink->position) *sink->position += len;
+    return sink->write(data, len, sink->write_data);
+}
+
+// Decompress, unzip, or decode from the payload or super image one image into write
+int FlashPlanStream(FlashPlan* plan, int index, DecompressWriteFn write, void* write_data, Sha256Context* digest,
+                    unsigned long long* position, char* error, size_t error_size) {
+    if (!plan || index < 0 || index >= plan->count || !write || !position) return 0;
+    const FlashPlanImage* image = &plan->images[index];
+    ImageSink sink = { write, write_data, digest, NULL };
+
+    if (image->payload_partition >= 0) {
+        const PayloadPartition* partition = &plan->payload.partitions[image->payload_partition];
+        if (!PayloadStreamPartition(&plan->payload, partition, WriteImageBytes, &sink, position)) {
+            snprintf(error, error_size, "%s", plan->payload.error);
+            return 0;
+        }
+        return 1;
+    }
+
+    if (image->super_partition >= 0) {
+        const SuperPartition* partition = &plan->super.partitions[image->super_partition];
+        if (!SuperImageStreamPartition(&plan->super, partition, WriteImageBytes, &sink, position)) {
+            snprintf(error, error_size, "%s", plan->super.error);
+            return 0;
+        }
+        return 1;
+    }
+
+    if (image->zip_entry >= 0) {
+        sink.position = position;
+        if (!ZipExtractEntry(&plan->zip, &plan->zip.entries[image->zip_entry], WriteImageBytes, &sink)) {
+            snprintf(error, error_size, "%s", plan->zip.error);
+            return 0;
+        }
+        return 1;
+    }
+
+    FileSource source = { INVALID_HANDLE_VALUE, position };
+    source.file = CreateFileA(image->image, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (source.file == INVALID_HANDLE_VALUE) {
+        snprintf(error, error_size, "Cannot open %s (error %lu)", image->image, GetLastError());
+        return 0;
+    }
+
+    char reason[256] = "";
+    int ok = DecompressStream(image->compression, ReadFromFile, &source, WriteImageBytes, &sink,
+                              reason, sizeof(reason));
+    CloseHandle(source.file);
+    if (!ok) snprintf(error, error_size, "%s: %s", image->image, reason[0] ? reason : "cannot decompress");
+    return ok;
+}
+
+// Sparse temporary file being written
+typedef struct {
+    HANDLE file;
+    int failed;
+} SparseFileOutput;
+
+// SparseBufferFn: append the buffer to the file and reuse it
+static unsigned char* WriteSparseBuffer(unsigned char* buffer, size_t size, unsigned int end_block, void* user_data) {
+    (void)end_block;
+    SparseFileOutput* out = (SparseFileOutput*)user_data;
+    DWORD written = 0;
+    if (!WriteFile(out->file, buffer, (DWORD)size, &written, NULL) || written != size) {
+        out->failed = 1;
+        return NULL;
+    }
+    return buffer;
+}
+
+// Unpack an image into a sparse file, where runs of zeros or of one repeated
+// word take no room; fastboot.exe flashes it like any sparse image
+static int PackToSparseFile(FlashPlan* plan, int index, const char* path, Sha256Context* digest,
+                            char* error, size_t error_size) {
+    SparseFileOutput out = { INVALID_HANDLE_VALUE, 0 };
+    out.file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (out.file == INVALID_HANDLE_VALUE) {
+        snprintf(error, error_size, "Cannot create %s (error %lu)", path, GetLastError());
+        return 0;
+    }
+
+    unsigned char* buffer = (unsigned char*)SafeMalloc(SPARSE_FILE_BUFFER);
+    SparseStream stream;
+    SparseStreamInit(&stream, buffer, SPARSE_FILE_BUFFER, 0, WriteSparseBuffer, &out);
+    unsigned long long position = 0;
+    int ok = FlashPlanStream(plan, index, SparseStreamWrite, &stream, digest, &position, error, error_size) &&
+             SparseStreamFinish(&stream);
+
+    // The header goes in last, once the block and chunk counts are known
+    if (ok) {
+        unsigned char header[SPARSE_HEADER_SIZE];
+        SparseStreamHeader(&stream, header);
+        LARGE_INTEGER start;
+        start.QuadPart = 0;
+        DWORD written = 0;
+        ok = SetFilePointerEx(out.file, start, NULL, FILE_BEGIN) &&
+             WriteFile(out.file, header, sizeof(header), &written, NULL) && written == sizeof(header);
+        if (!ok) out.failed = 1;
+    }
+    if (out.failed) {
+        snprintf(error, error_size, "Cannot write %s (error %lu)", path, GetLastError());
+    } else if (stream.failed) {
+        snprintf(error, error_size, "%s: %s", plan->images[index].image, stream.error);
+    }
+
+    CloseHandle(out.file);
+    SparseStreamFree(&stream);
+    free(buffer);
+    if (!ok) DeleteFileA(path);
+    return ok;
+}
+
+// Zip entries, payload and super image partitions and compressed files have to be unpacked; plain files are used in place
+int FlashPlanNeedsUnpacking(const FlashPlan* plan, int index) {
+    const FlashPlanImage* image = &plan->images[index];
+    return image->zip_entry >= 0 || image->payload_partition >= 0 || image->super_partition >= 0 ||
+           image->compression != COMPRESSION_NONE;
+}
+
+// Make the temporary folder now and check its drive has room for `needed` bytes
+int FlashPlanCheckTempSpace(FlashPlan* plan, unsigned long long needed, char* error, size_t error_size) {
+    if (!plan) return 0;
+    if (!EnsureTempDir(plan)) {
+        snprintf(error, error_size, "Cannot create a temporary folder");
+        return 0;
+    }
+
+    // Left to the writes themselves when the drive cannot be asked
+    ULARGE_INTEGER available;
+    if (!GetDiskFreeSpaceExA(plan->temp_dir, &available, NULL, NULL)) return 1;
+    if (available.QuadPart >= needed) return 1;
+
+    char needed_str[32];
+    char available_str[32];
+    FormatByteCount(needed, needed_str, sizeof(needed_str));
+    FormatByteCount(available.QuadPart, available_str, sizeof(available_str));
+    snprintf(error, error_size, "Not enough free space in %s to unpack the images (%s needed, %s free)",
+             plan->temp_dir, needed_str, available_str);
+    return 0;
+}
+
+// Make one image available as a file fastboot.exe can read
+int FlashPlanPrepare(FlashPlan* plan, int index, char* path, size_t path_size, int* is_temp, Sha256Context* digest,
+                     char* error, size_t error_size) {
+    if (!plan || index < 0 || index >= plan->count || !path || !is_temp) return 0;
+    const FlashPlanImage* image = &plan->images[index];
+    *is_temp = 0;
+
+    if (!FlashPlanNeedsUnpacking(plan, index)) {
+        snprintf(path, path_size, "%s", image->image);
+        return 1;
+    }
+
+    if (!EnsureTempDir(plan)) {
+        snprintf(error, error_size, "Cannot create a temporary folder");
+        return 0;
+    }
+    char name[96];
+    snprintf(name, sizeof(name), "%s.img", image->partition);
+    JoinPath(path, path_size, plan->temp_dir, name);
+    *is_temp = 1;
+    return PackToSparseFile(plan, index, path, digest, error, error_size);
+}
+
+// Release everything the plan holds
+void FlashPlanFree(FlashPlan* plan) {
+    if (!plan) return;
+    if (plan->has_zip) ZipClose(&plan->zip);
+    plan->has_zip = 0;
+    if (plan->has_payload) PayloadClose(&plan->payload);
+    plan->has_payload = 0;
+    if (plan->has_super) SuperImageClose(&plan->super);
+    plan->has_super = 0;
+    if (plan->nested_copy[0]) DeleteFileA(plan->nested_copy);
+    plan->nested_copy[0] = '\0';
+    if (plan->temp_dir[0]) RemoveDirectoryA(plan->temp_dir);
+    plan->temp_dir[0] = '\0';
+}
@@ -0,0 +1,527 @@
+#include "image_check.h"
+#include "fastboot_var_cache.h"
+#include "sparse_image.h"
+#include "progress.h"
+#include "utils.h"
+
+#define BOOT_MAGIC "ANDROID!"
+#define VENDOR_BOOT_MAGIC "VNDRBOOT"
+#define AVB_MAGIC "AVB0"
+#define AVB_FOOTER_MAGIC "AVBf"
+#define EXT4_SUPERBLOCK_OFFSET 1024
+#define EXT4_MAGIC 0xEF53
+#define EXT4_FEATURE_INCOMPAT_64BIT 0x80
+#define EROFS_SUPERBLOCK_OFFSET 1024
+#define EROFS_MAGIC 0xE0F5E1E2
+
+// Boot image v3 and later have a fixed page size
+#define BOOT_V3_PAGE_SIZE 4096
+
+// Unpacked bytes kept of a streamed image: room for a sparse header and the
+// chunks that expand into the first IMAGE_CHECK_HEAD_SIZE bytes
+#define STREAM_CAPTURE_SIZE (8 * IMAGE_CHECK_HEAD_SIZE)
+
+// What a well-known partition has to hold
+typedef struct {
+    const char* name;
+    ImageKind kind;                     // IMAGE_KIND_UNKNOWN with filesystem set: ext4 or EROFS
+    unsigned int min_version;           // Boot and vendor_boot header versions
+    int filesystem;
+} PartitionRule;
+
+static const PartitionRule g_partition_rules[] = {
+    { "boot", IMAGE_KIND_BOOT, 0, 0 },
+    { "recovery", IMAGE_KIND_BOOT, 0, 0 },
+    { "init_boot", IMAGE_KIND_BOOT, 4, 0 },
+    { "vendor_boot", IMAGE_KIND_VENDOR_BOOT, 3, 0 },
+    { "vendor_kernel_boot", IMAGE_KIND_VENDOR_BOOT, 4, 0 },
+    { "vbmeta", IMAGE_KIND_VBMETA, 0, 0 },
+    { "vbmeta_system", IMAGE_KIND_VBMETA, 0, 0 },
+    { "vbmeta_vendor", IMAGE_KIND_VBMETA, 0, 0 },
+    { "super", IMAGE_KIND_SUPER, 0, 0 },
+    { "system", IMAGE_KIND_UNKNOWN, 0, 1 },
+    { "system_ext", IMAGE_KIND_UNKNOWN, 0, 1 },
+    { "system_dlkm", IMAGE_KIND_UNKNOWN, 0, 1 },
+    { "product", IMAGE_KIND_UNKNOWN, 0, 1 },
+    { "vendor", IMAGE_KIND_UNKNOWN, 0, 1 },
+    { "vendor_dlkm", IMAGE_KIND_UNKNOWN, 0, 1 },
+    { "odm", IMAGE_KIND_UNKNOWN, 0, 1 },
+    { "odm_dlkm", IMAGE_KIND_UNKNOWN, 0, 1 },
+    { NULL, IMAGE_KIND_UNKNOWN, 0, 0 }
+};
+
+// Random access to the expanded image, or only its first bytes
+typedef struct {
+    SparseImage image;                  // Plain files, through their mapping
+    int mapped;
+    SuperImage* super;                  // Logical partitions of a super image
+    const SuperPartition* partition;
+    unsigned char head[IMAGE_CHECK_HEAD_SIZE];
+    size_t head_size;
+    unsigned long long size;            // 0 if unknown
+} ImageReader;
+
+// Unpacked bytes of a streamed image
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} StreamCapture;
+
+// Read a little-endian value
+static unsigned int GetLE16(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+// Read a little-endian value
+static unsigned int GetLE32(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Round up to whole pages
+static unsigned long long PageAlign(unsigned long long size, unsigned int page_size) {
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+// Append ", <text>" to the summary
+static void AddSummary(ImageCheck* check, const char* format, unsigned long long value) {
+    char size[32];
+    char text[64];
+    FormatByteCount(value, size, sizeof(size));
+    snprintf(text, sizeof(text), format, size);
+    size_t used = strlen(check->summary);
+    snprintf(check->summary + used, sizeof(check->summary) - used, ", %s", text);
+}
+
+// ============================================================================
+// Reading
+// ============================================================================
+
+// Copy expanded bytes [offset, offset + len); streamed images only have their head
+static int ReadImage(ImageReader* reader, unsigned long long offset, void* buffer, size_t len) {
+    if (reader->mapped) return SparseImageRead(&reader->image, offset, buffer, len);
+    if (reader->super) return SuperImageRead(reader->super, reader->partition, offset, buffer, len);
+    if (offset > reader->head_size || len > reader->head_size - offset) return 0;
+    memcpy(buffer, reader->head + offset, len);
+    return 1;
+}
+
+// Keep the first bytes of a stream, then stop it
+static int CaptureStream(const void* data, size_t len, void* user_data) {
+    StreamCapture* capture = (StreamCapture*)user_data;
+    size_t take = capture->capacity - capture->size;
+    if (take > len) take = len;
+    memcpy(capture->data + capture->size, data, take);
+    capture->size += take;
+    return capture->size < capture->capacity;
+}
+
+// Expand the chunks of a captured sparse file into the reader's head
+static int ExpandSparseHead(ImageReader* reader, const unsigned char* data, size_t size, ImageCheck* check) {
+    if (size < SPARSE_HEADER_SIZE) {
+        snprintf(check->error, sizeof(check->error), "Sparse header is truncated");
+        return 0;
+    }
+    unsigned int header_size = GetLE16(data + 8);
+    unsigned int chunk_header_size = GetLE16(data + 10);
+    unsigned int block_size = GetLE32(data + 12);
+    unsigned int total_blocks = GetLE32(data + 16);
+    if (header_size < SPARSE_HEADER_SIZE || chunk_header_size < SPARSE_CHUNK_HEADER_SIZE || block_size == 0 ||
+        block_size % 4 != 0) {
+        snprintf(check->error, sizeof(check->error), "Sparse header is invalid");
+        return 0;
+    }
+    reader->size = (unsigned long long)total_blocks * block_size;
+
+    size_t at = header_size;
+    while (reader->head_size < sizeof(reader->head) && at + chunk_header_size <= size) {
+        unsigned int type = GetLE16(data + at);
+        unsigned long long bytes = (unsigned long long)GetLE32(data + at + 4) * block_size;
+        unsigned int total_size = GetLE32(data + at + 8);
+        size_t room = sizeof(reader->head) - reader->head_size;
+        size_t step = (size_t)(bytes < room ? bytes : room);
+        const unsigned char* body = data + at + chunk_header_size;
+
+        if (type == SPARSE_CHUNK_RAW) {
+            size_t have = size - at - chunk_header_size;
+            if (step > have) step = have;
+            memcpy(reader->head + reader->head_size, body, step);
+        } else if (type == SPARSE_CHUNK_FILL) {
+            if (at + chunk_header_size + 4 > size) break;
+            for (size_t i = 0; i < step; i++) reader->head[reader->head_size + i] = body[i % 4];
+        } else if (type == SPARSE_CHUNK_DONT_CARE) {
+            memset(reader->head + reader->head_size, 0, step);
+        } else if (type != SPARSE_CHUNK_CRC32) {
+            snprintf(check->error, sizeof(check->error), "Sparse chunk of unknown type 0x%04x", type);
+            return 0;
+        } else {
+            step = 0;
+        }
+        reader->head_size += step;
+        if (total_size < chunk_header_size) break;
+        at += total_size;
+    }
+    return 1;
+}
+
+// Open an image for header checks: mapped when the bytes are on disk as they
+// will be flashed, else through the first bytes it unpacks to
+static int OpenReader(ImageReader* reader, FlashPlan* plan, int index, ImageCheck* check) {
+    const FlashPlanImage* image = &plan->images[index];
+
+    if (!FlashPlanNeedsUnpacking(plan, index)) {
+        if (!SparseImageOpenLazy(&reader->image, image->image)) {
+            snprintf(check->error, sizeof(check->error), "%s: %s", image->image, reader->image.error);
+            return 0;
+        }
+        reader->mapped = 1;
+        check->sparse = reader->image.is_sparse;
+        reader->size = reader->image.is_sparse
+                           ? (unsigned long long)reader->image.total_blocks * reader->image.block_size
+                           : reader->image.file_size;
+    } else if (image->super_partition >= 0) {
+        reader->super = &plan->super;
+        reader->partition = &plan->super.partitions[image->super_partition];
+        reader->size = reader->partition->size;
+    } else {
+        StreamCapture capture = { (unsigned char*)SafeMalloc(STREAM_CAPTURE_SIZE), 0, STREAM_CAPTURE_SIZE };
+        unsigned long long position = 0;
+        char error[256] = "";
+        int ok = FlashPlanStream(plan, index, CaptureStream, &capture, NULL, &position, error, sizeof(error));
+        if (!ok && capture.size < capture.capacity) {
+            snprintf(check->error, sizeof(check->error), "Cannot unpack the image: %s", error);
+            free(capture.data);
+            return 0;
+        }
+
+        if (capture.size >= 4 && GetLE32(capture.data) == SPARSE_HEADER_MAGIC) {
+            check->sparse = 1;
+            ok = ExpandSparseHead(reader, capture.data, capture.size, check);
+        } else {
+            reader->head_size = capture.size < sizeof(reader->head) ? capture.size : sizeof(reader->head);
+            memcpy(reader->head, capture.data, reader->head_size);
+            // Compressed files only know their compressed size; the rest are known up front
+            if (image->compression == COMPRESSION_NONE || image->zip_entry >= 0) reader->size = image->size;
+            if (ok && capture.size < capture.capacity) reader->size = capture.size;
+            ok = 1;
+        }
+        free(capture.data);
+        if (!ok) return 0;
+        return 1;
+    }
+
+    reader->head_size = reader->size < sizeof(reader->head) ? (size_t)reader->size : sizeof(reader->head);
+    if (!ReadImage(reader, 0, reader->head, reader->head_size)) {
+        snprintf(check->error, sizeof(check->error), "Cannot read the image: %s",
+                 reader->mapped ? reader->image.error : reader->super->error);
+        return 0;
+    }
+    return 1;
+}
+
+// Release the mapping
+static void CloseReader(ImageReader* reader) {
+    if (reader->mapped) SparseImageClose(&reader->image);
+}
+
+// ============================================================================
+// Headers
+// ============================================================================
+
+// boot.img, v0-v2 (kernel, ramdisk, second stage, recovery dtbo, dtb in
+// page_size pages) or v3-v4 (4 KB pages; v4 adds a signature)
+static int ParseBootHeader(const ImageReader* reader, ImageCheck* check) {
+    const unsigned char* head = reader->head;
+    if (reader->head_size < 1660) {
+        snprintf(check->error, sizeof(check->error), "Boot image header is truncated");
+        return 0;
+    }
+    check->kind = IMAGE_KIND_BOOT;
+    check->header_version = GetLE32(head + 40);
+    unsigned int kernel_size = GetLE32(head + 8);
+    unsigned int ramdisk_size;
+    snprintf(check->summary, sizeof(check->summary), "boot v%u", check->header_version);
+
+    if (check->header_version < 3) {
+        unsigned int page_size = GetLE32(head + 36);
+        if (page_size < 2048 || page_size > 65536 || (page_size & (page_size - 1)) != 0) {
+            snprintf(check->error, sizeof(check->error), "Boot image header has an invalid page size (%u)", page_size);
+            return 0;
+        }
+        ramdisk_size = GetLE32(head + 16);
+        check->content_size = page_size + PageAlign(kernel_size, page_size) + PageAlign(ramdisk_size, page_size) +
+                              PageAlign(GetLE32(head + 24), page_size);
+        if (check->header_version >= 1) check->content_size += PageAlign(GetLE32(head + 1632), page_size);
+        if (check->header_version >= 2) check->content_size += PageAlign(GetLE32(head + 1648), page_size);
+    } else if (check->header_version <= 4) {
+        ramdisk_size = GetLE32(head + 12);
+        check->content_size = BOOT_V3_PAGE_SIZE + PageAlign(kernel_size, BOOT_V3_PAGE_SIZE) +
+                              PageAlign(ramdisk_size, BOOT_V3_PAGE_SIZE);
+        if (check->header_version == 4) check->content_size += PageAlign(GetLE32(head + 1580), BOOT_V3_PAGE_SIZE);
+    } else {
+        // Newer than anything known: the layout cannot be checked
+        return 1;
+    }
+
+    if (kernel_size) AddSummary(check, "kernel %s", kernel_size);
+    if (ramdisk_size) AddSummary(check, "ramdisk %s", ramdisk_size);
+    return 1;
+}
+
+// vendor_boot.img, v3-v4 (v4 adds the ramdisk table and bootconfig)
+static int ParseVendorBootHeader(const ImageReader* reader, ImageCheck* check) {
+    const unsigned char* head = reader->head;
+    if (reader->head_size < 2128) {
+        snprintf(check->error, sizeof(check->error), "vendor_boot header is truncated");
+        return 0;
+    }
+    check->kind = IMAGE_KIND_VENDOR_BOOT;
+    check->header_version = GetLE32(head + 8);
+    snprintf(check->summary, sizeof(check->summary), "vendor_boot v%u", check->header_version);
+    if (check->header_version < 3 || check->header_version > 4) return 1;
+
+    unsigned int page_size = GetLE32(head + 12);
+    if (page_size < 2048 || page_size > 65536 || (page_size & (page_size - 1)) != 0) {
+        snprintf(check->error, sizeof(check->error), "vendor_boot header has an invalid page size (%u)", page_size);
+        return 0;
+    }
+    unsigned int ramdisk_size = GetLE32(head + 24);
+    check->content_size = PageAlign(GetLE32(head + 2096), page_size) + PageAlign(ramdisk_size, page_size) +
+                          PageAlign(GetLE32(head + 2100), page_size);
+    if (check->header_version == 4) {
+        check->content_size += PageAlign(GetLE32(head + 2112), page_size) + PageAlign(GetLE32(head + 2124), page_size);
+    }
+    if (ramdisk_size) AddSummary(check, "ramdisks %s", ramdisk_size);
+    return 1;
+}
+
+// vbmeta.img: a 256-byte header, then the authentication and auxiliary blocks
+static int ParseVbmetaHeader(const ImageReader* reader, ImageCheck* check) {
+    if (reader->head_size < AVB_VBMETA_HEADER_SIZE) {
+        snprintf(check->error, sizeof(check->error), "vbmeta header is truncated");
+        return 0;
+    }
+    check->kind = IMAGE_KIND_VBMETA;
+    check->header_version = GetBE32(reader->head + 4);
+    check->content_size = AVB_VBMETA_HEADER_SIZE + GetBE64(reader->head + 12) + GetBE64(reader->head + 20);
+    snprintf(check->summary, sizeof(check->summary), "vbmeta (libavb %u.%u)", check->header_version,
+             GetBE32(reader->head + 8));
+    return 1;
+}
+
+// ext4 superblock: block count and size give the filesystem size
+static void ParseExt4Superblock(const ImageReader* reader, ImageCheck* check) {
+    const unsigned char* sb = reader->head + EXT4_SUPERBLOCK_OFFSET;
+    unsigned long long blocks = GetLE32(sb + 4);
+    if (GetLE32(sb + 0x60) & EXT4_FEATURE_INCOMPAT_64BIT) blocks |= (unsigned long long)GetLE32(sb + 0x150) << 32;
+    unsigned int log_block_size = GetLE32(sb + 24);
+    check->kind = IMAGE_KIND_EXT4;
+    snprintf(check->summary, sizeof(check->summary), "ext4");
+    if (log_block_size <= 6) {
+        check->content_size = blocks << (10 + log_block_size);
+        AddSummary(check, "%s filesystem", check->content_size);
+    }
+}
+
+// EROFS superblock: block count and block size bits
+static void ParseErofsSuperblock(const ImageReader* reader, ImageCheck* check) {
+    const unsigned char* sb = reader->head + EROFS_SUPERBLOCK_OFFSET;
+    unsigned int block_bits = sb[12];
+    check->kind = IMAGE_KIND_EROFS;
+    snprintf(check->summary, sizeof(check->summary), "EROFS");
+    if (block_bits >= 9 && block_bits <= 16) {
+        check->content_size = (unsigned long long)GetLE32(sb + 36) << block_bits;
+        AddSummary(check, "%s filesystem", check->content_size);
+    }
+}
+
+// Identify the image from its first bytes
+static int ParseHeaders(const ImageReader* reader, ImageCheck* check) {
+    const unsigned char* head = reader->head;
+    size_t size = reader->head_size;
+
+    if (size >= 8 && memcmp(head, BOOT_MAGIC, 8) == 0) return ParseBootHeader(reader, check);
+    if (size >= 8 && memcmp(head, VENDOR_BOOT_MAGIC, 8) == 0) return ParseVendorBootHeader(reader, check);
+    if (size >= 4 && memcmp(head, AVB_MAGIC, 4) == 0) return ParseVbmetaHeader(reader, check);
+
+    if (size >= LP_PARTITION_RESERVED_BYTES + 4 && GetLE32(head + LP_PARTITION_RESERVED_BYTES) == LP_GEOMETRY_MAGIC) {
+        check->kind = IMAGE_KIND_SUPER;
+        snprintf(check->summary, sizeof(check->summary), "super (liblp)");
+    } else if (size >= EXT4_SUPERBLOCK_OFFSET + 0x154 && GetLE16(head + EXT4_SUPERBLOCK_OFFSET + 56) == EXT4_MAGIC) {
+        ParseExt4Superblock(reader, check);
+    } else if (size >= EROFS_SUPERBLOCK_OFFSET + 40 && GetLE32(head + EROFS_SUPERBLOCK_OFFSET) == EROFS_MAGIC) {
+        ParseErofsSuperblock(reader, check);
+    } else {
+        snprintf(check->summary, sizeof(check->summary), "raw data");
+    }
+    return 1;
+}
+
+// AVB footer in the last 64 bytes: the original image, then vbmeta, must fit
+// before it. Only images that can be read at their end are looked at.
+static int CheckAvbFooter(ImageReader* reader, ImageCheck* check, unsigned long long* limit) {
+    if ((!reader->mapped && !reader->super) || reader->size < AVB_FOOTER_SIZE + AVB_VBMETA_HEADER_SIZE) return 1;
+
+    unsigned char footer[AVB_FOOTER_SIZE];
+    if (!ReadImage(reader, reader->size - AVB_FOOTER_SIZE, footer, sizeof(footer)) ||
+        memcmp(footer, AVB_FOOTER_MAGIC, 4) != 0) {
+        return 1;
+    }
+    check->has_footer = 1;
+    unsigned long long original_size = GetBE64(footer + 12);
+    unsigned long long vbmeta_offset = GetBE64(footer + 20);
+    unsigned long long vbmeta_size = GetBE64(footer + 28);
+    unsigned long long room = reader->size - AVB_FOOTER_SIZE;
+
+    unsigned char magic[4];
+    if (original_size > vbmeta_offset || vbmeta_offset > room || vbmeta_size > room - vbmeta_offset ||
+        vbmeta_size < AVB_VBMETA_HEADER_SIZE || !ReadImage(reader, vbmeta_offset, magic, sizeof(magic)) ||
+        memcmp(magic, AVB_MAGIC, 4) != 0) {
+        snprintf(check->error, sizeof(check->error), "AVB footer does not point at a vbmeta block");
+        return 0;
+    }
+    *limit = original_size;
+    size_t used = strlen(check->summary);
+    snprintf(check->summary + used, sizeof(check->summary) - used, ", AVB footer");
+    return 1;
+}
+
+// ============================================================================
+// Partition
+// ============================================================================
+
+// Rule for a partition, by its name without a slot suffix
+static const PartitionRule* FindPartitionRule(const char* partition) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s", partition);
+    if (HasSlotSuffix(name)) name[strlen(name) - 2] = '\0';
+    for (int i = 0; g_partition_rules[i].name; i++) {
+        if (_stricmp(g_partition_rules[i].name, name) == 0) return &g_partition_rules[i];
+    }
+    return NULL;
+}
+
+// Whether the image is what the partition holds
+static int CheckPartitionKind(const char* partition, ImageCheck* check) {
+    const PartitionRule* rule = FindPartitionRule(partition);
+    if (!rule) return 1;
+
+    if (rule->filesystem) {
+        if (check->kind == IMAGE_KIND_EXT4 || check->kind == IMAGE_KIND_EROFS) return 1;
+        snprintf(check->error, sizeof(check->error), "%s takes an ext4 or EROFS filesystem; the image is %s",
+                 partition, ImageKindName(check->kind));
+        return 0;
+    }
+    if (check->kind != rule->kind) {
+        snprintf(check->error, sizeof(check->error), "%s takes %s; the image is %s", partition,
+                 ImageKindName(rule->kind), ImageKindName(check->kind));
+        return 0;
+    }
+    if (check->header_version < rule->min_version) {
+        snprintf(check->error, sizeof(check->error), "%s takes header v%u or later; the image has v%u", partition,
+                 rule->min_version, check->header_version);
+        return 0;
+    }
+    return 1;
+}
+
+// Sizes and slots the device reports for the partition
+static int CheckDevicePartition(const char* partition, const char* partition_key, const char* fastboot_path,
+                                const char* device_serial, ImageCheck* check) {
+    char name[96];
+    char value[FASTBOOT_VAR_MAX_LEN];
+
+    // boot_a on a device without slots for boot
+    if (HasSlotSuffix(partition)) {
+        char base[64];
+        snprintf(base, sizeof(base), "%s", partition);
+        base[strlen(base) - 2] = '\0';
+        snprintf(name, sizeof(name), "has-slot:%s", base);
+        if (FastbootVarCacheGet(fastboot_path, device_serial, name, value, sizeof(value)) &&
+            _stricmp(value, "no") == 0) {
+            snprintf(check->error, sizeof(check->error), "%s has no slots on this device; flash it as %s", base,
+                     base);
+            return 0;
+        }
+    }
+
+    // fastbootd resizes logical partitions to the image
+    snprintf(name, sizeof(name), "is-logical:%s", partition_key);
+    if (FastbootVarCacheGet(fastboot_path, device_serial, name, value, sizeof(value)) &&
+        _stricmp(value, "yes") == 0) {
+        return 1;
+    }
+
+    unsigned long long partition_size = 0;
+    if (!FastbootVarCacheGetPartitionSize(fastboot_path, device_serial, partition_key, &partition_size) ||
+        partition_size == 0) {
+        return 1;
+    }
+    unsigned long long needed = check->image_size > check->content_size ? check->image_size : check->content_size;
+    if (needed > partition_size) {
+        char image_size[32];
+        char available[32];
+        FormatByteCount(needed, image_size, sizeof(image_size));
+        FormatByteCount(partition_size, available, sizeof(available));
+        snprintf(check->error, sizeof(check->error), "Image needs %s but %s is only %s", image_size, partition_key,
+                 available);
+        return 0;
+    }
+    return 1;
+}
+
+// ============================================================================
+// Public
+// ============================================================================
+
+// Name of an image kind, with its article
+const char* ImageKindName(ImageKind kind) {
+    switch (kind) {
+        case IMAGE_KIND_BOOT: return "a boot image";
+        case IMAGE_KIND_VENDOR_BOOT: return "a vendor_boot image";
+        case IMAGE_KIND_VBMETA: return "a vbmeta image";
+        case IMAGE_KIND_EXT4: return "an ext4 filesystem";
+        case IMAGE_KIND_EROFS: return "an EROFS filesystem";
+        case IMAGE_KIND_SUPER: return "a super image";
+        default: return "unrecognized data";
+    }
+}
+
+// Parse an image's headers and match them against the partition and device
+int ImageCheckPlanImage(FlashPlan* plan, int index, const char* partition_key, const char* fastboot_path,
+                        const char* device_serial, ImageCheck* check) {
+    memset(check, 0, sizeof(*check));
+    if (!plan || index < 0 || index >= plan->count) return 0;
+    const char* partition = plan->images[index].partition;
+    if (!partition_key) partition_key = partition;
+
+    ImageReader* reader = (ImageReader*)SafeCalloc(1, sizeof(ImageReader));
+    int ok = OpenReader(reader, plan, index, check);
+    if (ok) {
+        check->image_size = reader->size;
+        ok = ParseHeaders(reader, check);
+    }
+
+    // Truncated: the headers describe more than the image (or its footer) holds
+    unsigned long long limit = reader->size;
+    if (ok) ok = CheckAvbFooter(reader, check, &limit);
+    if (ok && check->sparse) {
+        size_t used = strlen(check->summary);
+        snprintf(check->summary + used, sizeof(check->summary) - used, ", sparse");
+    }
+    if (ok && limit > 0 && check->content_size > limit) {
+        char needed[32];
+        char have[32];
+        FormatByteCount(check->content_size, needed, sizeof(needed));
+        FormatByteCount(limit, have, sizeof(have));
+        snprintf(check->error, sizeof(check->error), "Image is truncated: its headers describe %s but it holds %s",
+                 needed, have);
+        ok = 0;
+    }
+    CloseReader(reader);
+    free(reader);
+
+    if (ok) ok = CheckPartitionKind(partition, check);
+    if (ok && device_serial) ok = CheckDevicePartition(partition, partition_key, fastboot_path, device_serial, check);
+    return ok;
+}
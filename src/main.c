@@ -5,6 +5,10 @@
 #include "utils.h"
 #include "file_transfer.h"
 #include "adb_wrapper.h"
+#include "adb_client.h"
+#include "shell_session.h"
+#include "prop_cache.h"
+#include "fastboot_var_cache.h"
 #include "module_installer.h"
 
 // Global state for cleanup
@@ -14,8 +18,18 @@ static AppState g_state = {0};
 static void Cleanup(void) {
     printf("\nCleaning up...\n");
 
-    // Stop device monitoring
-    StopDeviceMonitoring();
+    // Stop device monitoring. A monitor still stuck in a poll may be using the
+    // sessions, caches and snapshots; they are left to the process exit then.
+    if (StopDeviceMonitoring()) {
+        // Close persistent shell sessions, then release Winsock used by the adb server client
+        ShellSessionCloseAll();
+        PropCacheClear();
+        FastbootVarCacheClear();
+        AdbClientCleanup();
+
+        // Monitor is stopped, so no reader or writer can still hold a snapshot
+        FreeDeviceSnapshots(&g_state);
+    }
 
     // Cleanup extracted resources
     if (strlen(g_state.temp_dir) > 0) {
@@ -34,9 +48,7 @@ static int Initialize(AppState* state) {
     SetConsoleTitleA(title_buffer);
 
     memset(state, 0, sizeof(AppState));
-    state->current_device_index = -1;
-    state->current_fastboot_device_index = -1;
-    state->current_mode = MODE_ADB;
+    InitDeviceSnapshots(state);
     state->current_theme = (ThemeMode)LoadConfig();
 
     // Show banner
@@ -72,8 +84,8 @@ static int AutoConnect(AppState* state) {
     RefreshDeviceList(state);
     RefreshFastbootDeviceList(state);
 
-    int adb_count = state->device_count;
-    int fastboot_count = state->fastboot_device_count;
+    int adb_count = GetDeviceCount(state);
+    int fastboot_count = GetFastbootDeviceCount(state);
     int total_count = adb_count + fastboot_count;
 
     if (total_count == 0) {
@@ -89,9 +101,9 @@ static int AutoConnect(AppState* state) {
     // Priority: fastboot > ADB
     if (fastboot_count > 0) {
         // Auto-switch to fastboot mode
-        state->current_mode = MODE_FASTBOOT;
+        SetCurrentMode(state, MODE_FASTBOOT);
         SelectFastbootDevice(state, 0);
-        AdbDevice* dev = GetSelectedFastbootDevice(state);
+        const AdbDevice* dev = GetSelectedFastbootDevice(state);
         printf("\nFastboot device detected: %s\n", dev->serial_id);
         printf("Auto-switched to fastboot mode.\n");
         return 1;
@@ -99,7 +111,7 @@ static int AutoConnect(AppState* state) {
     else if (adb_count == 1) {
         // Auto-select single ADB device
         SelectDevice(state, 0);
-        AdbDevice* dev = GetSelectedDevice(state);
+        const AdbDevice* dev = GetSelectedDevice(state);
         printf("\nAutomatically connected to: %s\n", dev->serial_id);
 
         if (strlen(dev->android_version) > 0) {
@@ -138,13 +150,13 @@ int main(int argc, char* argv[]) {
         printf("\nDetected %d file(s) via command line arguments.\n", argc - 1);
         
         // Try to connect to device
-        if (!AutoConnect(&state) && state.device_count == 0) {
+        if (!AutoConnect(&state) && GetDeviceCount(&state) == 0) {
              printf("\nWaiting for device connection (10s timeout)...\n");
              int retries = 0;
              while (retries < 10) {
                  Sleep(1000);
                  RefreshDeviceList(&state);
-                 if (state.device_count > 0) {
+                 if (GetDeviceCount(&state) > 0) {
                      AutoConnect(&state);
                      break;
                  }
@@ -152,7 +164,7 @@ int main(int argc, char* argv[]) {
              }
         }
         
-        if (state.device_count == 0) {
+        if (GetDeviceCount(&state) == 0) {
              printf("\nError: No ADB device found. Cannot process files.\n");
              printf("Please connect a device and enable USB debugging.\n");
              system("pause");
@@ -161,7 +173,7 @@ int main(int argc, char* argv[]) {
 
         // We can process pushes in fastboot mode? No, usually ADB push requires ADB.
         // Fastboot flash is different.
-        if (state.current_mode == MODE_FASTBOOT) {
+        if (GetCurrentMode(&state) == MODE_FASTBOOT) {
             printf("\nError: Device is in fastboot mode. ADB Push/Install requires ADB mode.\n");
             printf("Please switch to ADB mode.\n");
             system("pause");
@@ -171,6 +183,11 @@ int main(int argc, char* argv[]) {
         printf("\nStarting batch processing...\n");
         int module_install_choice = -1; // -1: Ask, 0: No (Push only), 1: Yes (Install)
 
+        // Files to push are collected and sent together over parallel connections
+        const char** push_paths = (const char**)SafeCalloc(argc, sizeof(char*));
+        int* push_results = (int*)SafeCalloc(argc, sizeof(int));
+        int push_count = 0;
+
         for (int i = 1; i < argc; i++) {
             const char* file_path = argv[i];
             const char* ext = strrchr(file_path, '.');
@@ -183,6 +200,11 @@ int main(int argc, char* argv[]) {
             printf("\n----------------------------------------\n");
             printf("Processing: %s\n", file_name);
 
+            if (DirectoryExists(file_path)) {
+                PushDirectory(&state, file_path, "/storage/emulated/0/", DEFAULT_TRANSFER_JOBS);
+                continue;
+            }
+
             int is_apk = (ext && (_stricmp(ext, ".apk") == 0));
             int do_install = 0;
 
@@ -202,47 +224,64 @@ int main(int argc, char* argv[]) {
                 strncpy(cmd.args, file_path, sizeof(cmd.args) - 1);
                 CmdInstall(&state, &cmd);
             } else {
-                char remote_path[MAX_PATH];
-                snprintf(remote_path, sizeof(remote_path), "/storage/emulated/0/%s", file_name);
-                printf("Pushing to: %s\n", remote_path);
-                PushFile(&state, file_path, remote_path);
-
-                // Check if zip and module
-                int is_zip = (ext && (_stricmp(ext, ".zip") == 0));
-                if (is_zip) {
-                    char seven_zip_path[MAX_PATH];
-                    snprintf(seven_zip_path, sizeof(seven_zip_path), "%s\\7za.exe", state.temp_dir);
-                    if (IsModuleZip(file_path, seven_zip_path)) {
-                        printf("\nDetected Magisk/KSU/APatch Module.\n");
-                        
-                        // Detect root solution
-                        RootSolution sol = DetectRootSolution(&state);
-                        
-                        if (sol != ROOT_NONE) {
-                            // Ask user if we haven't yet
-                            if (module_install_choice == -1) {
-                                printf("Install this module? (y=install, n=push only): ");
-                                int ch = _getch();
-                                printf("%c\n", ch);
-                                if (ch == 'y' || ch == 'Y') {
-                                    module_install_choice = 1;
-                                } else {
-                                    module_install_choice = 0;
-                                }
-                            }
-
-                            if (module_install_choice == 1) {
-                                InstallRootModule(&state, remote_path, sol);
-                            } else {
-                                printf("Skipping module installation (Push only).\n");
-                            }
+                printf("Queued for push to: /storage/emulated/0/%s\n", file_name);
+                push_paths[push_count++] = file_path;
+            }
+        }
+
+        if (push_count > 0) {
+            printf("\n----------------------------------------\n");
+            PushFiles(&state, push_paths, push_count, "/storage/emulated/0/", DEFAULT_TRANSFER_JOBS, push_results);
+        }
+
+        // Offer module installation for pushed zips
+        for (int i = 0; i < push_count; i++) {
+            const char* file_path = push_paths[i];
+            const char* ext = strrchr(file_path, '.');
+            int is_zip = (ext && (_stricmp(ext, ".zip") == 0));
+            if (!is_zip || !push_results[i]) continue;
+
+            const char* file_name = strrchr(file_path, '\\');
+            if (!file_name) file_name = strrchr(file_path, '/');
+            if (file_name) file_name++; else file_name = file_path;
+
+            char remote_path[MAX_PATH];
+            snprintf(remote_path, sizeof(remote_path), "/storage/emulated/0/%s", file_name);
+
+            char seven_zip_path[MAX_PATH];
+            snprintf(seven_zip_path, sizeof(seven_zip_path), "%s\\7za.exe", state.temp_dir);
+            if (IsModuleZip(file_path, seven_zip_path)) {
+                printf("\nDetected Magisk/KSU/APatch Module: %s\n", file_name);
+                
+                // Detect root solution
+                RootSolution sol = DetectRootSolution(&state);
+                
+                if (sol != ROOT_NONE) {
+                    // Ask user if we haven't yet
+                    if (module_install_choice == -1) {
+                        printf("Install this module? (y=install, n=push only): ");
+                        int ch = _getch();
+                        printf("%c\n", ch);
+                        if (ch == 'y' || ch == 'Y') {
+                            module_install_choice = 1;
                         } else {
-                            printf("No supported root solution (Magisk/KSU/APatch) detected. Module pushed but not installed.\n");
+                            module_install_choice = 0;
                         }
                     }
+
+                    if (module_install_choice == 1) {
+                        InstallRootModule(&state, remote_path, sol);
+                    } else {
+                        printf("Skipping module installation (Push only).\n");
+                    }
+                } else {
+                    printf("No supported root solution (Magisk/KSU/APatch) detected. Module pushed but not installed.\n");
                 }
             }
         }
+
+        free(push_paths);
+        free(push_results);
         
         printf("\n----------------------------------------\n");
         printf("Batch processing completed.\n");
@@ -1,7 +1,11 @@
 #include "module_installer.h"
 #include "adb_wrapper.h"
 #include "device_manager.h"
+#include "shell_session.h"
+#include "prop_cache.h"
+#include "progress.h"
 #include "utils.h"
+#include <wininet.h>
 
 // Check if zip file is a module (contains module.prop)
 int IsModuleZip(const char* zip_path, const char* seven_zip_path) {
@@ -31,44 +35,43 @@ int IsModuleZip(const char* zip_path, const char* seven_zip_path) {
 RootSolution DetectRootSolution(AppState* state) {
     if (!state) return ROOT_NONE;
 
-    AdbDevice* dev = GetSelectedDevice(state);
+    const AdbDevice* dev = GetSelectedDevice(state);
     if (!dev) return ROOT_NONE;
 
-    // Check APatch
-    // Use su -c to ensure we are checking as root/root context if needed, 
-    // though typically version checks might work as shell. 
-    // User requested su usage.
-    ProcessResult* res = AdbShellCommand(state->adb_path, dev->serial_id, "su -c \"apd -V\"");
-    if (res && res->exit_code == 0) {
-        FreeProcessResult(res);
-        return ROOT_APATCH;
+    // Answer stays valid until the device reconnects or reboots
+    int cached_solution;
+    if (PropCacheGetRootSolution(dev->serial_id, &cached_solution)) {
+        return (RootSolution)cached_solution;
     }
-    FreeProcessResult(res);
 
-    // Check KernelSU
-    res = AdbShellCommand(state->adb_path, dev->serial_id, "su -c \"ksud -V\"");
-    if (res && res->exit_code == 0) {
-        FreeProcessResult(res);
-        return ROOT_KSU;
-    }
-    FreeProcessResult(res);
-
-    // Check Magisk
-    res = AdbShellCommand(state->adb_path, dev->serial_id, "su -c \"magisk -V\"");
-    if (res && res->exit_code == 0) {
-        FreeProcessResult(res);
-        return ROOT_MAGISK;
+    // Ask all three root managers at once over the shell session; first hit wins
+    const char* commands[] = {
+        "su -c \"apd -V\"",     // APatch
+        "su -c \"ksud -V\"",    // KernelSU
+        "su -c \"magisk -V\""   // Magisk
+    };
+    const RootSolution solutions[] = { ROOT_APATCH, ROOT_KSU, ROOT_MAGISK };
+    ProcessResult* results[3];
+    ShellSessionRunBatch(state->adb_path, dev->serial_id, commands, 3, results);
+
+    RootSolution detected = ROOT_NONE;
+    for (int i = 0; i < 3; i++) {
+        if (detected == ROOT_NONE && results[i] && results[i]->exit_code == 0) {
+            detected = solutions[i];
+        }
+        FreeProcessResult(results[i]);
     }
-    FreeProcessResult(res);
 
-    return ROOT_NONE;
+    // No answer may just be a su prompt still pending or denied; ask again next time
+    if (detected != ROOT_NONE) PropCacheSetRootSolution(dev->serial_id, (int)detected);
+    return detected;
 }
 
 // Install module
 void InstallRootModule(AppState* state, const char* remote_zip_path, RootSolution solution) {
     if (!state || !remote_zip_path) return;
     
-    AdbDevice* dev = GetSelectedDevice(state);
+    const AdbDevice* dev = GetSelectedDevice(state);
     if (!dev) return;
 
     char cmd[MAX_PATH + 64];
@@ -107,15 +110,109 @@ void InstallRootModule(AppState* state, const char* remote_zip_path, RootSolutio
     }
 }
 
-// Download file from URL to destination using system curl or PowerShell
+// Read buffer for WinINet downloads
+#define DOWNLOAD_CHUNK (256 * 1024)
+
+// Download over WinINet with live progress (returns 0 to let curl/PowerShell try)
+static int DownloadWithWinInet(const char* url, const char* dest_path) {
+    HINTERNET internet = InternetOpenA("FolkADB", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+    if (!internet) return 0;
+
+    HINTERNET request = InternetOpenUrlA(internet, url, NULL, 0,
+                                         INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_NO_UI, 0);
+    if (!request) {
+        InternetCloseHandle(internet);
+        return 0;
+    }
+
+    // Redirects are already followed; anything but 200 is an error page, not the file
+    DWORD status = 0, status_size = sizeof(status);
+    if (HttpQueryInfoA(request, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status, &status_size, NULL) &&
+        status != 200) {
+        printf("Server returned HTTP %lu.\n", (unsigned long)status);
+        InternetCloseHandle(request);
+        InternetCloseHandle(internet);
+        return 0;
+    }
+
+    // Content-Length may be missing (chunked responses); progress then shows bytes only
+    char length_text[32];
+    DWORD length_size = sizeof(length_text);
+    unsigned long long total = 0;
+    if (HttpQueryInfoA(request, HTTP_QUERY_CONTENT_LENGTH, length_text, &length_size, NULL)) {
+        total = strtoull(length_text, NULL, 10);
+    }
+
+    // Write to a side file so an interrupted download never looks complete
+    char part_path[MAX_PATH];
+    snprintf(part_path, sizeof(part_path), "%s.part", dest_path);
+    HANDLE file = CreateFileA(part_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        InternetCloseHandle(request);
+        InternetCloseHandle(internet);
+        return 0;
+    }
+
+    char host[64] = "";
+    const char* host_start = strstr(url, "://");
+    host_start = host_start ? host_start + 3 : url;
+    size_t host_len = strcspn(host_start, "/:?");
+    if (host_len >= sizeof(host)) host_len = sizeof(host) - 1;
+    memcpy(host, host_start, host_len);
+    host[host_len] = '\0';
+
+    const char* name = strrchr(dest_path, '\\');
+    ProgressTracker tracker;
+    ProgressStart(&tracker, "download", host, name ? name + 1 : dest_path, total);
+
+    char* buffer = (char*)SafeMalloc(DOWNLOAD_CHUNK);
+    unsigned long long received = 0;
+    int ok = 1;
+    while (1) {
+        DWORD read = 0;
+        if (!InternetReadFile(request, buffer, DOWNLOAD_CHUNK, &read)) {
+            ok = 0;
+            break;
+        }
+        if (read == 0) break;
+
+        DWORD written = 0;
+        if (!WriteFile(file, buffer, read, &written, NULL) || written != read) {
+            ok = 0;
+            break;
+        }
+        received += read;
+        ProgressUpdate(&tracker, received);
+    }
+    free(buffer);
+    CloseHandle(file);
+    InternetCloseHandle(request);
+    InternetCloseHandle(internet);
+
+    if (ok && total > 0 && received != total) ok = 0;
+    ProgressFinish(&tracker, ok);
+
+    if (!ok || !MoveFileExA(part_path, dest_path, MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(part_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Download file from URL to destination (WinINet, then system curl or PowerShell)
 int DownloadFile(const char* url, const char* dest_path) {
     if (!url || !dest_path) return 0;
 
     printf("Downloading: %s\n", url);
     printf("To: %s\n", dest_path);
 
+    if (DownloadWithWinInet(url, dest_path)) {
+        return 1;
+    }
+    printf("WinINet download failed. Falling back to curl...\n");
+
     char cmd[2048];
-    // Try using curl first (usually available on Windows 10+)
+    // Then curl (usually available on Windows 10+)
     // -L: Follow redirects
     // -o: Write to file
     // We use system() to let curl show its progress bar directly in the console
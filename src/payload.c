@@ -0,0 +1,866 @@
+#include "payload.h"
+#include "zip_archive.h"
+#include "sha256.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+// payload.bin header: magic, version and manifest size (big-endian u64), then
+// in version 2 the size of the metadata signature (big-endian u32)
+#define PAYLOAD_HEADER_V1_SIZE 20
+#define PAYLOAD_HEADER_V2_SIZE 24
+
+// Views of the payload start on the allocation granularity
+#define PAYLOAD_MAP_ALIGN (64 * 1024)
+
+// Streaming keeps decoded operations in memory until their turn: at most
+// this much per batch, and operations larger than the single limit are
+// decoded in place when they come up
+#define PAYLOAD_BATCH_BYTES (256ULL * 1024 * 1024)
+#define PAYLOAD_BUFFERED_OP_MAX (64ULL * 1024 * 1024)
+// Batches hold this many operations per worker at most
+#define PAYLOAD_OPS_PER_WORKER 4
+
+// Zeros handed to sinks for gaps and ZERO operations
+#define PAYLOAD_ZERO_CHUNK (256 * 1024)
+
+// Manifest field numbers (update_metadata.proto)
+#define MANIFEST_BLOCK_SIZE 3
+#define MANIFEST_PARTITIONS 13
+#define PARTITION_NAME 1
+#define PARTITION_NEW_INFO 7
+#define PARTITION_OPERATIONS 8
+#define PARTITION_INFO_SIZE 1
+#define OPERATION_TYPE 1
+#define OPERATION_DATA_OFFSET 2
+#define OPERATION_DATA_LENGTH 3
+#define OPERATION_DST_EXTENTS 6
+#define OPERATION_DATA_SHA256 8
+#define EXTENT_START_BLOCK 1
+#define EXTENT_NUM_BLOCKS 2
+
+static const unsigned char g_zero_chunk[PAYLOAD_ZERO_CHUNK];
+
+// Whether an operation can be applied without the source image
+static int IsFullOperation(int type) {
+    return type == PAYLOAD_OP_REPLACE || type == PAYLOAD_OP_REPLACE_BZ || type == PAYLOAD_OP_REPLACE_XZ ||
+           type == PAYLOAD_OP_ZERO || type == PAYLOAD_OP_DISCARD;
+}
+
+// ============================================================================
+// Manifest
+// ============================================================================
+
+// Protobuf message being walked
+typedef struct {
+    const unsigned char* pos;
+    const unsigned char* end;
+} ProtoReader;
+
+// Base-128 varint
+static int ReadVarint(ProtoReader* reader, unsigned long long* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->pos >= reader->end) return 0;
+        unsigned char byte = *reader->pos++;
+        *value |= (unsigned long long)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return 1;
+    }
+    return 0;
+}
+
+// Next field: varints and fixed values land in *value, length-delimited
+// fields in *message. Returns 0 at the end of the message, -1 if malformed.
+static int NextField(ProtoReader* reader, unsigned int* field, unsigned long long* value, ProtoReader* message) {
+    if (reader->pos >= reader->end) return 0;
+
+    unsigned long long key;
+    if (!ReadVarint(reader, &key)) return -1;
+    *field = (unsigned int)(key >> 3);
+    *value = 0;
+    message->pos = message->end = NULL;
+
+    switch (key & 7) {
+        case 0:
+            return ReadVarint(reader, value) ? 1 : -1;
+        case 1:
+        case 5: {
+            size_t size = (key & 7) == 1 ? 8 : 4;
+            if ((size_t)(reader->end - reader->pos) < size) return -1;
+            for (size_t i = size; i > 0; i--) *value = (*value << 8) | reader->pos[i - 1];
+            reader->pos += size;
+            return 1;
+        }
+        case 2: {
+            unsigned long long length;
+            if (!ReadVarint(reader, &length) || length > (unsigned long long)(reader->end - reader->pos)) return -1;
+            message->pos = reader->pos;
+            message->end = reader->pos + length;
+            reader->pos += length;
+            return 1;
+        }
+        default:
+            return -1;
+    }
+}
+
+// One Extent message onto the partition's list
+static int ParseExtent(PayloadPartition* partition, ProtoReader* reader) {
+    if (partition->extent_count == partition->extent_capacity) {
+        partition->extent_capacity = partition->extent_capacity ? partition->extent_capacity * 2 : 64;
+        partition->extents = (PayloadExtent*)SafeRealloc(partition->extents,
+                                                         partition->extent_capacity * sizeof(PayloadExtent));
+    }
+    PayloadExtent* extent = &partition->extents[partition->extent_count++];
+    memset(extent, 0, sizeof(*extent));
+
+    unsigned int field;
+    unsigned long long value;
+    ProtoReader message;
+    int result;
+    while ((result = NextField(reader, &field, &value, &message)) > 0) {
+        if (field == EXTENT_START_BLOCK) extent->start_block = value;
+        else if (field == EXTENT_NUM_BLOCKS) extent->num_blocks = value;
+    }
+    return result == 0;
+}
+
+// One InstallOperation message
+static int ParseOperation(PayloadPartition* partition, ProtoReader* reader, unsigned int block_size) {
+    if (partition->operation_count == partition->operation_capacity) {
+        partition->operation_capacity = partition->operation_capacity ? partition->operation_capacity * 2 : 64;
+        partition->operations = (PayloadOperation*)SafeRealloc(
+            partition->operations, partition->operation_capacity * sizeof(PayloadOperation));
+    }
+    PayloadOperation* op = &partition->operations[partition->operation_count++];
+    memset(op, 0, sizeof(*op));
+    op->first_extent = partition->extent_count;
+
+    unsigned int field;
+    unsigned long long value;
+    ProtoReader message;
+    int result;
+    while ((result = NextField(reader, &field, &value, &message)) > 0) {
+        if (field == OPERATION_TYPE) {
+            op->type = (int)value;
+        } else if (field == OPERATION_DATA_OFFSET) {
+            op->data_offset = value;
+        } else if (field == OPERATION_DATA_LENGTH) {
+            op->data_length = value;
+        } else if (field == OPERATION_DST_EXTENTS && message.pos) {
+            if (!ParseExtent(partition, &message)) return 0;
+            const PayloadExtent* extent = &partition->extents[partition->extent_count - 1];
+            op->output_size += extent->num_blocks * block_size;
+            op->extent_count++;
+        } else if (field == OPERATION_DATA_SHA256 && message.pos && message.end - message.pos == 32) {
+            memcpy(op->data_sha256, message.pos, 32);
+            op->has_data_sha256 = 1;
+        }
+    }
+
+    if (!IsFullOperation(op->type)) partition->is_delta = 1;
+    partition->data_size += op->data_length;
+    return result == 0;
+}
+
+// One PartitionUpdate message
+static int ParsePartition(Payload* payload, ProtoReader* reader) {
+    payload->partitions = (PayloadPartition*)SafeRealloc(payload->partitions,
+                                                         (payload->count + 1) * sizeof(PayloadPartition));
+    PayloadPartition* partition = &payload->partitions[payload->count++];
+    memset(partition, 0, sizeof(*partition));
+
+    unsigned int field;
+    unsigned long long value;
+    ProtoReader message;
+    int result;
+    while ((result = NextField(reader, &field, &value, &message)) > 0) {
+        if (field == PARTITION_NAME && message.pos) {
+            size_t len = (size_t)(message.end - message.pos);
+            if (len >= sizeof(partition->name)) len = sizeof(partition->name) - 1;
+            memcpy(partition->name, message.pos, len);
+            partition->name[len] = '\0';
+        } else if (field == PARTITION_NEW_INFO && message.pos) {
+            unsigned int info_field;
+            unsigned long long info_value;
+            ProtoReader unused;
+            int info_result;
+            while ((info_result = NextField(&message, &info_field, &info_value, &unused)) > 0) {
+                if (info_field == PARTITION_INFO_SIZE) partition->size = info_value;
+            }
+            if (info_result < 0) return 0;
+        } else if (field == PARTITION_OPERATIONS && message.pos) {
+            if (!ParseOperation(partition, &message, payload->block_size)) return 0;
+        }
+    }
+    return result == 0 && partition->name[0];
+}
+
+// DeltaArchiveManifest: block size first (it may follow the partitions), then the partitions
+static int ParseManifest(Payload* payload, const unsigned char* data, size_t size) {
+    ProtoReader reader = { data, data + size };
+    unsigned int field;
+    unsigned long long value;
+    ProtoReader message;
+    int result;
+
+    payload->block_size = 4096;
+    while ((result = NextField(&reader, &field, &value, &message)) > 0) {
+        if (field == MANIFEST_BLOCK_SIZE) payload->block_size = (unsigned int)value;
+    }
+    if (result < 0 || payload->block_size == 0 || payload->block_size > 1024 * 1024) return 0;
+
+    reader.pos = data;
+    while ((result = NextField(&reader, &field, &value, &message)) > 0) {
+        if (field == MANIFEST_PARTITIONS && message.pos && !ParsePartition(payload, &message)) return 0;
+    }
+    return result == 0;
+}
+
+// ============================================================================
+// Opening
+// ============================================================================
+
+// Map [offset, offset + size) of the payload; *view is what to unmap
+static const unsigned char* MapPayloadRange(Payload* payload, unsigned long long offset, unsigned long long size,
+                                            void** view, char* error, size_t error_size) {
+    *view = NULL;
+    if (offset > payload->length || size > payload->length - offset) {
+        snprintf(error, error_size, "%s is truncated", payload->path);
+        return NULL;
+    }
+
+    unsigned long long start = payload->base + offset;
+    unsigned long long aligned = start & ~(unsigned long long)(PAYLOAD_MAP_ALIGN - 1);
+    unsigned long long span = start - aligned + size;
+    if (span != (SIZE_T)span) {
+        snprintf(error, error_size, "Range of %llu bytes is too large to map", size);
+        return NULL;
+    }
+
+    *view = MapViewOfFile(payload->mapping, FILE_MAP_READ, (DWORD)(aligned >> 32), (DWORD)aligned, (SIZE_T)span);
+    if (!*view) {
+        snprintf(error, error_size, "Cannot map %s (error %lu)", payload->path, GetLastError());
+        return NULL;
+    }
+    return (const unsigned char*)*view + (start - aligned);
+}
+
+// Find payload.bin inside an OTA zip; it has to be stored to be read in place
+static int LocateInZip(Payload* payload, const char* path) {
+    ZipArchive zip;
+    if (!ZipOpen(&zip, path)) {
+        snprintf(payload->error, sizeof(payload->error), "%s", zip.error);
+        return 0;
+    }
+
+    const ZipEntry* entry = ZipFindEntry(&zip, "payload.bin");
+    int ok = entry != NULL;
+    if (!ok) {
+        snprintf(payload->error, sizeof(payload->error), "%s has no payload.bin", path);
+    } else if (!ZipStoredEntryOffset(&zip, entry, &payload->base)) {
+        snprintf(payload->error, sizeof(payload->error), "payload.bin in %s: %s", path, zip.error);
+        ok = 0;
+    } else {
+        payload->length = entry->size;
+    }
+    ZipClose(&zip);
+    return ok;
+}
+
+// Open payload.bin or an OTA zip and parse the manifest
+int PayloadOpen(Payload* payload, const char* path) {
+    if (!payload || !path) return 0;
+    memset(payload, 0, sizeof(*payload));
+    snprintf(payload->path, sizeof(payload->path), "%s", path);
+
+    payload->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (payload->file == INVALID_HANDLE_VALUE) {
+        snprintf(payload->error, sizeof(payload->error), "Cannot open %s (error %lu)", path, GetLastError());
+        return 0;
+    }
+
+    LARGE_INTEGER file_size;
+    unsigned char magic[4] = {0};
+    DWORD got = 0;
+    if (!GetFileSizeEx(payload->file, &file_size) || !ReadFile(payload->file, magic, sizeof(magic), &got, NULL)) {
+        snprintf(payload->error, sizeof(payload->error), "Cannot read %s", path);
+        PayloadClose(payload);
+        return 0;
+    }
+    payload->length = (unsigned long long)file_size.QuadPart;
+    if (got == 4 && memcmp(magic, "PK\x03\x04", 4) == 0 && !LocateInZip(payload, path)) {
+        char error[sizeof(payload->error)];
+        snprintf(error, sizeof(error), "%s", payload->error);
+        PayloadClose(payload);
+        snprintf(payload->error, sizeof(payload->error), "%s", error);
+        return 0;
+    }
+
+    payload->mapping = payload->length > 0 ? CreateFileMappingA(payload->file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    if (!payload->mapping) {
+        snprintf(payload->error, sizeof(payload->error), "Cannot map %s (error %lu)", path, GetLastError());
+        PayloadClose(payload);
+        return 0;
+    }
+
+    char error[sizeof(payload->error)] = "";
+    void* view = NULL;
+    const unsigned char* header = MapPayloadRange(payload, 0, PAYLOAD_HEADER_V2_SIZE, &view, error, sizeof(error));
+    unsigned long long manifest_size = 0, header_size = 0, signature_size = 0;
+    int ok = header != NULL;
+    if (ok && memcmp(header, PAYLOAD_MAGIC, 4) != 0) {
+        snprintf(error, sizeof(error), "%s is not an OTA payload", path);
+        ok = 0;
+    } else if (ok) {
+        payload->version = GetBE64(header + 4);
+        manifest_size = GetBE64(header + 12);
+        if (payload->version == 2) {
+            header_size = PAYLOAD_HEADER_V2_SIZE;
+            signature_size = GetBE32(header + 20);
+        } else if (payload->version == 1) {
+            header_size = PAYLOAD_HEADER_V1_SIZE;
+        } else {
+            snprintf(error, sizeof(error), "Unsupported payload version %llu", payload->version);
+            ok = 0;
+        }
+    }
+    if (view) UnmapViewOfFile(view);
+
+    if (ok) {
+        const unsigned char* manifest = MapPayloadRange(payload, header_size, manifest_size, &view, error, sizeof(error));
+        ok = manifest != NULL;
+        if (ok && !ParseManifest(payload, manifest, (size_t)manifest_size)) {
+            snprintf(error, sizeof(error), "Damaged payload manifest in %s", path);
+            ok = 0;
+        }
+        if (view) UnmapViewOfFile(view);
+    }
+    if (ok) {
+        payload->data_offset = header_size + manifest_size + signature_size;
+        if (payload->data_offset > payload->length) {
+            snprintf(error, sizeof(error), "%s is truncated", path);
+            ok = 0;
+        }
+    }
+
+    if (!ok) {
+        PayloadClose(payload);
+        snprintf(payload->error, sizeof(payload->error), "%s", error);
+    }
+    return ok;
+}
+
+// Release the mapping and parsed manifest
+void PayloadClose(Payload* payload) {
+    if (!payload) return;
+    for (int i = 0; i < payload->count; i++) {
+        free(payload->partitions[i].operations);
+        free(payload->partitions[i].extents);
+    }
+    free(payload->partitions);
+    if (payload->mapping) CloseHandle(payload->mapping);
+    if (payload->file && payload->file != INVALID_HANDLE_VALUE) CloseHandle(payload->file);
+    payload->partitions = NULL;
+    payload->count = 0;
+    payload->mapping = NULL;
+    payload->file = INVALID_HANDLE_VALUE;
+}
+
+// Whether the file starts with the payload magic
+int PayloadIsPayloadFile(const char* path) {
+    unsigned char magic[4] = {0};
+    FILE* file = fopen(path, "rb");
+    size_t got = file ? fread(magic, 1, sizeof(magic), file) : 0;
+    if (file) fclose(file);
+    return got == 4 && memcmp(magic, PAYLOAD_MAGIC, 4) == 0;
+}
+
+// Exact name first, then with or without a slot suffix
+const PayloadPartition* PayloadFindPartition(const Payload* payload, const char* name) {
+    if (!payload || !name) return NULL;
+    for (int i = 0; i < payload->count; i++) {
+        if (_stricmp(payload->partitions[i].name, name) == 0) return &payload->partitions[i];
+    }
+
+    size_t len = strlen(name);
+    for (int i = 0; i < payload->count; i++) {
+        const char* candidate = payload->partitions[i].name;
+        size_t candidate_len = strlen(candidate);
+        if (len > 2 && candidate_len == len - 2 && (strcmp(name + len - 2, "_a") == 0 || strcmp(name + len - 2, "_b") == 0) &&
+            _strnicmp(candidate, name, candidate_len) == 0) {
+            return &payload->partitions[i];
+        }
+    }
+    return NULL;
+}
+
+// Declared size, else where the last extent ends
+unsigned long long PayloadPartitionSize(const Payload* payload, const PayloadPartition* partition) {
+    if (partition->size > 0) return partition->size;
+    unsigned long long end = 0;
+    for (int i = 0; i < partition->extent_count; i++) {
+        unsigned long long extent_end = (partition->extents[i].start_block + partition->extents[i].num_blocks) *
+                                        payload->block_size;
+        if (extent_end > end) end = extent_end;
+    }
+    return end;
+}
+
+// Operation type for messages
+const char* PayloadOperationName(int type) {
+    static const char* names[] = {
+        "REPLACE", "REPLACE_BZ", "MOVE", "BSDIFF", "SOURCE_COPY", "SOURCE_BSDIFF", "ZERO", "DISCARD",
+        "REPLACE_XZ", "PUFFDIFF", "BROTLI_BSDIFF", "ZUCCHINI", "LZ4DIFF_BSDIFF", "LZ4DIFF_PUFFDIFF"
+    };
+    if (type >= 0 && type < (int)ARRAY_SIZE(names)) return names[type];
+    return "UNKNOWN";
+}
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+// Places decoded bytes at a partition offset; data is NULL for zeros
+typedef int (*PayloadPutFn)(unsigned long long offset, const void* data, size_t len, void* user_data);
+
+// Walks an operation's destination extents as its output is produced
+typedef struct {
+    const PayloadExtent* extents;
+    int extent_count;
+    unsigned int block_size;
+    int extent;                         // Current extent
+    unsigned long long extent_done;     // Bytes already placed in it
+    unsigned long long placed;          // Bytes placed in all extents
+    PayloadPutFn put;
+    void* put_data;
+    int overflow;                       // Output ran past the last extent
+} ExtentWriter;
+
+// Start at the first extent of an operation
+static void InitExtentWriter(ExtentWriter* writer, const PayloadPartition* partition, const PayloadOperation* op,
+                             unsigned int block_size, PayloadPutFn put, void* put_data) {
+    memset(writer, 0, sizeof(*writer));
+    writer->extents = partition->extents + op->first_extent;
+    writer->extent_count = op->extent_count;
+    writer->block_size = block_size;
+    writer->put = put;
+    writer->put_data = put_data;
+}
+
+// Spread bytes (or zeros, data NULL) over the extents
+static int PlaceBytes(ExtentWriter* writer, const unsigned char* data, unsigned long long len) {
+    while (len > 0) {
+        if (writer->extent >= writer->extent_count) {
+            writer->overflow = 1;
+            return 0;
+        }
+        const PayloadExtent* extent = &writer->extents[writer->extent];
+        unsigned long long extent_size = extent->num_blocks * writer->block_size;
+        unsigned long long room = extent_size - writer->extent_done;
+        size_t chunk = (size_t)(len < room ? len : room);
+        if (chunk > 0x40000000) chunk = 0x40000000;
+
+        unsigned long long offset = extent->start_block * writer->block_size + writer->extent_done;
+        if (!writer->put(offset, data, chunk, writer->put_data)) return 0;
+        if (data) data += chunk;
+        len -= chunk;
+        writer->extent_done += chunk;
+        writer->placed += chunk;
+        if (writer->extent_done == extent_size) {
+            writer->extent++;
+            writer->extent_done = 0;
+        }
+    }
+    return 1;
+}
+
+// DecompressWriteFn into the extents
+static int WriteToExtents(const void* data, size_t len, void* user_data) {
+    return PlaceBytes((ExtentWriter*)user_data, (const unsigned char*)data, len);
+}
+
+// Operation data being decompressed from the mapping
+typedef struct {
+    const unsigned char* data;
+    size_t left;
+} MemorySource;
+
+// DecompressReadFn over mapped bytes
+static int ReadFromMemory(void* buffer, size_t size, void* user_data) {
+    MemorySource* source = (MemorySource*)user_data;
+    if (size > source->left) size = source->left;
+    memcpy(buffer, source->data, size);
+    source->data += size;
+    source->left -= size;
+    return (int)size;
+}
+
+// Check and apply one operation: its data hash, then REPLACE/REPLACE_BZ/
+// REPLACE_XZ output or ZERO/DISCARD zeros through the writer. Output short
+// of the extents is padded with zeros.
+static int DecodeOperation(Payload* payload, const PayloadPartition* partition, int index, ExtentWriter* writer,
+                           char* error, size_t error_size) {
+    const PayloadOperation* op = &partition->operations[index];
+    if (!IsFullOperation(op->type)) {
+        snprintf(error, error_size, "%s: %s operations need the source build (incremental OTA)", partition->name,
+                 PayloadOperationName(op->type));
+        return 0;
+    }
+
+    if (op->type != PAYLOAD_OP_ZERO && op->type != PAYLOAD_OP_DISCARD) {
+        void* view = NULL;
+        const unsigned char* data = MapPayloadRange(payload, payload->data_offset + op->data_offset, op->data_length,
+                                                    &view, error, error_size);
+        if (!data) return 0;
+
+        int ok = 1;
+        if (op->has_data_sha256) {
+            Sha256Context sha;
+            unsigned char digest[SHA256_DIGEST_SIZE];
+            Sha256Init(&sha);
+            Sha256Update(&sha, data, (size_t)op->data_length);
+            Sha256Final(&sha, digest);
+            if (memcmp(digest, op->data_sha256, sizeof(digest)) != 0) {
+                snprintf(error, error_size, "%s: operation %d data is corrupt (SHA-256 mismatch)", partition->name, index);
+                ok = 0;
+            }
+        }
+
+        if (ok && op->type == PAYLOAD_OP_REPLACE) {
+            ok = PlaceBytes(writer, data, op->data_length);
+        } else if (ok) {
+            MemorySource source = { data, (size_t)op->data_length };
+            CompressionFormat format = op->type == PAYLOAD_OP_REPLACE_XZ ? COMPRESSION_XZ : COMPRESSION_BZIP2;
+            char reason[256] = "";
+            ok = DecompressStream(format, ReadFromMemory, &source, WriteToExtents, writer, reason, sizeof(reason));
+            if (!ok && !writer->overflow && reason[0]) {
+                snprintf(error, error_size, "%s: operation %d: %s", partition->name, index, reason);
+            }
+        }
+        UnmapViewOfFile(view);
+        if (!ok && writer->overflow) {
+            snprintf(error, error_size, "%s: operation %d decodes past its extents", partition->name, index);
+        }
+        if (!ok) return 0;
+    }
+
+    // What the data did not cover (all of it for ZERO and DISCARD) is zeros
+    return writer->placed >= op->output_size || PlaceBytes(writer, NULL, op->output_size - writer->placed);
+}
+
+// ============================================================================
+// Extraction to files
+// ============================================================================
+
+// One partition being written
+typedef struct {
+    const PayloadPartition* partition;
+    HANDLE file;
+    char path[MAX_PATH];
+} ExtractTarget;
+
+// An operation to run: target and operation index
+typedef struct {
+    int target;
+    int op;
+} ExtractTask;
+
+// Shared state of one PayloadExtractPartitions call
+typedef struct {
+    Payload* payload;
+    ExtractTarget* targets;
+    ExtractTask* tasks;
+    volatile LONGLONG done;             // Output bytes decoded so far
+    unsigned long long total;
+    volatile LONG failed;
+    char error[256];
+    ProgressCallback progress;
+    void* user_data;
+} ExtractJob;
+
+// PayloadPutFn: positional write into the output file. The file was sized up
+// front and reads as zeros where nothing was written, so zeros are skipped.
+static int PutToFile(unsigned long long offset, const void* data, size_t len, void* user_data) {
+    if (!data) return 1;
+    HANDLE file = (HANDLE)user_data;
+    const unsigned char* bytes = (const unsigned char*)data;
+    while (len > 0) {
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD written = 0;
+        if (!WriteFile(file, bytes, (DWORD)len, &written, &overlapped) || written == 0) return 0;
+        bytes += written;
+        offset += written;
+        len -= written;
+    }
+    return 1;
+}
+
+// ParallelTask: decode one operation into its partition's file
+static int ExtractOperation(int worker, int index, void* context) {
+    ExtractJob* job = (ExtractJob*)context;
+    if (job->failed) return 0;
+
+    const ExtractTask* task = &job->tasks[index];
+    ExtractTarget* target = &job->targets[task->target];
+    const PayloadOperation* op = &target->partition->operations[task->op];
+
+    ExtentWriter writer;
+    InitExtentWriter(&writer, target->partition, op, job->payload->block_size, PutToFile, target->file);
+    char error[256] = "";
+    if (!DecodeOperation(job->payload, target->partition, task->op, &writer, error, sizeof(error))) {
+        if (!error[0]) snprintf(error, sizeof(error), "Cannot write %s (error %lu)", target->path, GetLastError());
+        if (InterlockedCompareExchange(&job->failed, 1, 0) == 0) {
+            snprintf(job->error, sizeof(job->error), "%s", error);
+        }
+        return 0;
+    }
+
+    LONGLONG done = InterlockedExchangeAdd64(&job->done, (LONGLONG)op->output_size) + (LONGLONG)op->output_size;
+    // Only the calling thread reports, so progress output needs no locking
+    if (worker == 0 && job->progress) {
+        job->progress(target->partition->name, (unsigned long long)done, job->total, job->user_data);
+    }
+    return 1;
+}
+
+// Create an output file at its final size
+static int CreateTargetFile(ExtractTarget* target, unsigned long long size, char* error, size_t error_size) {
+    target->file = CreateFileA(target->path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (target->file == INVALID_HANDLE_VALUE) {
+        snprintf(error, error_size, "Cannot create %s (error %lu)", target->path, GetLastError());
+        return 0;
+    }
+
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(target->file, end, NULL, FILE_BEGIN) || !SetEndOfFile(target->file)) {
+        snprintf(error, error_size, "Cannot size %s (error %lu)", target->path, GetLastError());
+        return 0;
+    }
+    return 1;
+}
+
+// Decode the partitions into <name>.img files, operations spread over all cores
+int PayloadExtractPartitions(Payload* payload, const PayloadPartition** partitions, int count, const char* out_dir,
+                             ProgressCallback progress, void* user_data) {
+    if (!payload || !partitions || count <= 0 || !out_dir) return 0;
+
+    ExtractJob job;
+    memset(&job, 0, sizeof(job));
+    job.payload = payload;
+    job.progress = progress;
+    job.user_data = user_data;
+    job.targets = (ExtractTarget*)SafeCalloc((size_t)count, sizeof(ExtractTarget));
+
+    int task_count = 0;
+    int ok = 1;
+    for (int i = 0; i < count && ok; i++) {
+        ExtractTarget* target = &job.targets[i];
+        target->partition = partitions[i];
+        target->file = INVALID_HANDLE_VALUE;
+        if (partitions[i]->is_delta) {
+            snprintf(job.error, sizeof(job.error), "%s is a delta update and needs the source build",
+                     partitions[i]->name);
+            ok = 0;
+            break;
+        }
+
+        char name[96];
+        snprintf(name, sizeof(name), "%s.img", partitions[i]->name);
+        JoinPath(target->path, sizeof(target->path), out_dir, name);
+        ok = CreateTargetFile(target, PayloadPartitionSize(payload, partitions[i]), job.error, sizeof(job.error));
+        task_count += partitions[i]->operation_count;
+        for (int j = 0; j < partitions[i]->operation_count; j++) job.total += partitions[i]->operations[j].output_size;
+    }
+
+    if (ok && task_count > 0) {
+        job.tasks = (ExtractTask*)SafeMalloc((size_t)task_count * sizeof(ExtractTask));
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            for (int j = 0; j < partitions[i]->operation_count; j++) {
+                job.tasks[n].target = i;
+                job.tasks[n].op = j;
+                n++;
+            }
+        }
+        ok = RunParallel(task_count, ParallelWorkerCount(), ExtractOperation, &job) == task_count && !job.failed;
+        if (ok && progress) progress(partitions[count - 1]->name, job.total, job.total, user_data);
+    }
+
+    for (int i = 0; i < count; i++) {
+        ExtractTarget* target = &job.targets[i];
+        if (target->file && target->file != INVALID_HANDLE_VALUE) {
+            CloseHandle(target->file);
+            if (!ok) DeleteFileA(target->path);
+        }
+    }
+    if (!ok) snprintf(payload->error, sizeof(payload->error), "%s", job.error);
+    free(job.tasks);
+    free(job.targets);
+    return ok;
+}
+
+// ============================================================================
+// Streaming in block order
+// ============================================================================
+
+// Partition bytes on their way to the caller, strictly in order
+typedef struct {
+    DecompressWriteFn write;
+    void* write_data;
+    unsigned long long emitted;         // Partition bytes written so far
+    unsigned long long* position;
+    int out_of_order;
+} OrderedSink;
+
+// Hand zeros to the sink
+static int WriteZeros(OrderedSink* sink, unsigned long long len) {
+    while (len > 0) {
+        size_t chunk = len < PAYLOAD_ZERO_CHUNK ? (size_t)len : PAYLOAD_ZERO_CHUNK;
+        if (!sink->write(g_zero_chunk, chunk, sink->write_data)) return 0;
+        sink->emitted += chunk;
+        *sink->position += chunk;
+        len -= chunk;
+    }
+    return 1;
+}
+
+// PayloadPutFn: zero-fill up to offset, then pass the bytes on
+static int PutToSink(unsigned long long offset, const void* data, size_t len, void* user_data) {
+    OrderedSink* sink = (OrderedSink*)user_data;
+    if (offset < sink->emitted) {
+        sink->out_of_order = 1;
+        return 0;
+    }
+    if (offset > sink->emitted && !WriteZeros(sink, offset - sink->emitted)) return 0;
+    if (!data) return WriteZeros(sink, len);
+
+    if (len > 0 && !sink->write(data, len, sink->write_data)) return 0;
+    sink->emitted += len;
+    *sink->position += len;
+    return 1;
+}
+
+// Operation decoded into memory ahead of its turn
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    int ok;
+    char error[256];
+} BufferedOperation;
+
+// A run of consecutive operations decoded in parallel
+typedef struct {
+    Payload* payload;
+    const PayloadPartition* partition;
+    int first;                          // Operation index of buffers[0]
+    BufferedOperation* buffers;
+} StreamBatch;
+
+// PayloadPutFn: the operation's output back to back in its buffer
+static int PutToBuffer(unsigned long long offset, const void* data, size_t len, void* user_data) {
+    (void)offset;
+    BufferedOperation* buffer = (BufferedOperation*)user_data;
+    if (data) {
+        memcpy(buffer->data + buffer->size, data, len);
+    } else {
+        memset(buffer->data + buffer->size, 0, len);
+    }
+    buffer->size += len;
+    return 1;
+}
+
+// Worth decoding ahead: data operations that fit in memory
+static int IsBufferedOperation(const PayloadOperation* op) {
+    return op->type != PAYLOAD_OP_ZERO && op->type != PAYLOAD_OP_DISCARD && op->output_size <= PAYLOAD_BUFFERED_OP_MAX;
+}
+
+// ParallelTask: decode one operation of the batch into memory
+static int DecodeBufferedOperation(int worker, int index, void* context) {
+    (void)worker;
+    StreamBatch* batch = (StreamBatch*)context;
+    const PayloadOperation* op = &batch->partition->operations[batch->first + index];
+    BufferedOperation* buffer = &batch->buffers[index];
+    if (!IsBufferedOperation(op)) return 1;
+
+    buffer->data = (unsigned char*)SafeMalloc(op->output_size > 0 ? (size_t)op->output_size : 1);
+    ExtentWriter writer;
+    InitExtentWriter(&writer, batch->partition, op, batch->payload->block_size, PutToBuffer, buffer);
+    buffer->ok = DecodeOperation(batch->payload, batch->partition, batch->first + index, &writer,
+                                 buffer->error, sizeof(buffer->error));
+    return buffer->ok;
+}
+
+// Stream one partition: batches of operations are decoded on all cores, then
+// written out in order while zeros, gaps and oversized operations go inline
+int PayloadStreamPartition(Payload* payload, const PayloadPartition* partition, DecompressWriteFn write,
+                           void* write_data, unsigned long long* position) {
+    if (!payload || !partition || !write || !position) return 0;
+    if (partition->is_delta) {
+        snprintf(payload->error, sizeof(payload->error), "%s is a delta update and needs the source build",
+                 partition->name);
+        return 0;
+    }
+
+    int workers = ParallelWorkerCount();
+    int batch_max = workers * PAYLOAD_OPS_PER_WORKER;
+    OrderedSink sink = { write, write_data, 0, position, 0 };
+    StreamBatch batch = { payload, partition, 0, NULL };
+    batch.buffers = (BufferedOperation*)SafeMalloc((size_t)batch_max * sizeof(BufferedOperation));
+    char error[256] = "";
+    int ok = 1;
+
+    int next = 0;
+    while (ok && next < partition->operation_count) {
+        // Gather the next batch by count and buffered bytes
+        int count = 0;
+        unsigned long long bytes = 0;
+        while (next + count < partition->operation_count && count < batch_max) {
+            const PayloadOperation* op = &partition->operations[next + count];
+            if (IsBufferedOperation(op)) {
+                if (count > 0 && bytes + op->output_size > PAYLOAD_BATCH_BYTES) break;
+                bytes += op->output_size;
+            }
+            count++;
+        }
+
+        batch.first = next;
+        memset(batch.buffers, 0, (size_t)count * sizeof(BufferedOperation));
+        RunParallel(count, workers, DecodeBufferedOperation, &batch);
+
+        for (int i = 0; i < count && ok; i++) {
+            const PayloadOperation* op = &partition->operations[next + i];
+            BufferedOperation* buffer = &batch.buffers[i];
+            ExtentWriter writer;
+            InitExtentWriter(&writer, partition, op, payload->block_size, PutToSink, &sink);
+            if (!IsBufferedOperation(op)) {
+                ok = DecodeOperation(payload, partition, next + i, &writer, error, sizeof(error));
+            } else if (!buffer->ok) {
+                snprintf(error, sizeof(error), "%s", buffer->error);
+                ok = 0;
+            } else {
+                ok = PlaceBytes(&writer, buffer->data, buffer->size);
+            }
+            if (!ok && sink.out_of_order) {
+                snprintf(error, sizeof(error), "%s: operations are not in block order", partition->name);
+            } else if (!ok && !error[0]) {
+                snprintf(error, sizeof(error), "Writing %s failed", partition->name);
+            }
+        }
+        for (int i = 0; i < count; i++) free(batch.buffers[i].data);
+        next += count;
+    }
+
+    unsigned long long size = PayloadPartitionSize(payload, partition);
+    if (ok && size > sink.emitted && !WriteZeros(&sink, size - sink.emitted)) {
+        snprintf(error, sizeof(error), "Writing %s failed", partition->name);
+        ok = 0;
+    }
+
+    free(batch.buffers);
+    if (!ok) snprintf(payload->error, sizeof(payload->error), "%s", error);
+    return ok;
+}
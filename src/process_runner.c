@@ -0,0 +1,332 @@
+#include "process_runner.h"
+#include "utils.h"
+
+#define PIPE_READ_CHUNK 16384
+#define EXIT_DRAIN_IDLE_MS 250   // Stop draining once the child is gone and pipes stay quiet
+#define KILL_WAIT_MS 5000
+
+// One captured output stream (stdout or stderr)
+typedef struct {
+    HANDLE pipe;
+    OVERLAPPED ov;
+    char chunk[PIPE_READ_CHUNK];
+    char* data;
+    size_t size;
+    size_t capacity;
+    int pending;
+    int closed;
+} PipeStream;
+
+static volatile LONG g_pipe_serial = 0;
+
+// Create a pipe whose read end supports overlapped I/O (anonymous pipes do not)
+static int CreateOverlappedPipe(HANDLE* read_out, HANDLE* write_out) {
+    char name[128];
+    snprintf(name, sizeof(name), "\\\\.\\pipe\\folkadb.%lu.%ld",
+             (unsigned long)GetCurrentProcessId(), (long)InterlockedIncrement(&g_pipe_serial));
+
+    HANDLE read_end = CreateNamedPipeA(name,
+                                       PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                       PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                       1, PIPE_READ_CHUNK, PIPE_READ_CHUNK, 0, NULL);
+    if (read_end == INVALID_HANDLE_VALUE) return 0;
+
+    // The child gets an ordinary synchronous, inheritable write end
+    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+    HANDLE write_end = CreateFileA(name, GENERIC_WRITE, 0, &sa, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (write_end == INVALID_HANDLE_VALUE) {
+        CloseHandle(read_end);
+        return 0;
+    }
+
+    *read_out = read_end;
+    *write_out = write_end;
+    return 1;
+}
+
+// Build a quoted command line for CreateProcessA
+static char* BuildCommandLine(const char* executable_path, const char* args[], int arg_count) {
+    size_t cmdline_size = strlen(executable_path) + 4; // +4 for quotes and space
+    for (int i = 0; i < arg_count; i++) {
+        cmdline_size += strlen(args[i]) + 3; // +3 for space and potential quotes
+    }
+
+    char* cmdline = (char*)SafeMalloc(cmdline_size);
+    snprintf(cmdline, cmdline_size, "\"%s\"", executable_path);
+    for (int i = 0; i < arg_count; i++) {
+        strcat(cmdline, " ");
+        // Quote arguments that contain whitespace (and empty ones, so they survive)
+        if (args[i][0] == '\0' || strpbrk(args[i], " \t")) {
+            strcat(cmdline, "\"");
+            strcat(cmdline, args[i]);
+            strcat(cmdline, "\"");
+        } else {
+            strcat(cmdline, args[i]);
+        }
+    }
+
+    return cmdline;
+}
+
+// Set up a stream with an empty, null-terminated capture buffer
+static int InitPipeStream(PipeStream* stream, HANDLE pipe) {
+    stream->pipe = pipe;
+    stream->capacity = 4096;
+    stream->data = (char*)SafeMalloc(stream->capacity);
+    stream->data[0] = '\0';
+    stream->size = 0;
+    stream->pending = 0;
+    stream->closed = 0;
+
+    memset(&stream->ov, 0, sizeof(stream->ov));
+    stream->ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    return stream->ov.hEvent != NULL;
+}
+
+// Keep up to max_capture bytes of a chunk, draining (and dropping) the rest
+static void AppendCaptured(PipeStream* stream, DWORD bytes, size_t max_capture, ProcessResult* result) {
+    size_t keep = bytes;
+    if (max_capture > 0) {
+        size_t room = stream->size < max_capture ? max_capture - stream->size : 0;
+        if (keep > room) {
+            keep = room;
+            result->truncated = 1;
+        }
+    }
+    if (keep == 0) return;
+
+    if (stream->size + keep + 1 > stream->capacity) {
+        while (stream->size + keep + 1 > stream->capacity) stream->capacity *= 2;
+        stream->data = (char*)SafeRealloc(stream->data, stream->capacity);
+    }
+    memcpy(stream->data + stream->size, stream->chunk, keep);
+    stream->size += keep;
+    stream->data[stream->size] = '\0';
+}
+
+// Queue the next overlapped read; marks the stream closed when the writer is gone
+static void IssueRead(PipeStream* stream) {
+    ResetEvent(stream->ov.hEvent);
+    if (ReadFile(stream->pipe, stream->chunk, sizeof(stream->chunk), NULL, &stream->ov) ||
+        GetLastError() == ERROR_IO_PENDING) {
+        // Synchronous completions also signal the event, so both cases are handled alike
+        stream->pending = 1;
+    } else {
+        stream->pending = 0;
+        stream->closed = 1;
+    }
+}
+
+// Collect a finished read, hand it to the callback or capture buffer, and queue the next one
+static void CompleteRead(PipeStream* stream, int is_stderr, const ProcessOptions* options, ProcessResult* result) {
+    DWORD bytes = 0;
+    stream->pending = 0;
+
+    if (!GetOverlappedResult(stream->pipe, &stream->ov, &bytes, FALSE)) {
+        // ERROR_BROKEN_PIPE is the normal end of stream
+        stream->closed = 1;
+        return;
+    }
+
+    if (options->on_output) {
+        if (bytes > 0) options->on_output(stream->chunk, bytes, is_stderr, options->user_data);
+    } else {
+        AppendCaptured(stream, bytes, options->max_capture, result);
+    }
+    IssueRead(stream);
+}
+
+// Abort an in-flight read and wait for the kernel to release the buffer
+static void CancelPendingRead(PipeStream* stream) {
+    if (!stream->pending) return;
+
+    DWORD bytes = 0;
+    CancelIo(stream->pipe);
+    GetOverlappedResult(stream->pipe, &stream->ov, &bytes, TRUE);
+    stream->pending = 0;
+}
+
+// Spawn a process and drain stdout/stderr concurrently with overlapped pipes
+ProcessResult* RunProcessEx(const char* executable_path, const char* args[], int arg_count,
+                            const ProcessOptions* options) {
+    if (!executable_path || (arg_count > 0 && !args) || arg_count < 0) {
+        return NULL;
+    }
+
+    ProcessOptions defaults = {0};
+    if (!options) options = &defaults;
+    DWORD timeout_ms = options->timeout_ms;
+    HANDLE cancel_event = options->cancel_event;
+
+    HANDLE stdout_read, stdout_write;
+    HANDLE stderr_read, stderr_write;
+
+    // Create pipes for stdout and stderr
+    if (!CreateOverlappedPipe(&stdout_read, &stdout_write)) {
+        return NULL;
+    }
+    if (!CreateOverlappedPipe(&stderr_read, &stderr_write)) {
+        CloseHandle(stdout_read);
+        CloseHandle(stdout_write);
+        return NULL;
+    }
+
+    char* cmdline = BuildCommandLine(executable_path, args, arg_count);
+
+    // Setup startup info
+    STARTUPINFOA si = { sizeof(STARTUPINFOA) };
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdOutput = stdout_write;
+    si.hStdError = stderr_write;
+    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+
+    PROCESS_INFORMATION pi = {0};
+
+    // Create process
+    BOOL success = CreateProcessA(
+        NULL,
+        cmdline,
+        NULL,
+        NULL,
+        TRUE,
+        CREATE_NO_WINDOW,
+        NULL,
+        NULL,
+        &si,
+        &pi
+    );
+
+    // Close write ends so EOF is seen once the child exits
+    CloseHandle(stdout_write);
+    CloseHandle(stderr_write);
+    free(cmdline);
+
+    if (!success) {
+        CloseHandle(stdout_read);
+        CloseHandle(stderr_read);
+        return NULL;
+    }
+
+    ProcessResult* result = (ProcessResult*)SafeCalloc(1, sizeof(ProcessResult));
+
+    PipeStream* streams = (PipeStream*)SafeCalloc(2, sizeof(PipeStream));
+    PipeStream* out = &streams[0];
+    PipeStream* err = &streams[1];
+    int kill_child = 0;
+    int out_ready = InitPipeStream(out, stdout_read);
+    int err_ready = InitPipeStream(err, stderr_read);
+    if (!out_ready || !err_ready) {
+        // Without events there is no way to wait on the pipes; give up on the child
+        out->closed = err->closed = 1;
+        kill_child = 1;
+    } else {
+        IssueRead(out);
+        IssueRead(err);
+    }
+
+    ULONGLONG deadline = timeout_ms ? GetTickCount64() + timeout_ms : 0;
+    ULONGLONG idle_deadline = 0;
+    int process_exited = 0;
+
+    while (!out->closed || !err->closed) {
+        HANDLE handles[4];
+        PipeStream* owners[4] = { NULL, NULL, NULL, NULL };
+        DWORD count = 0;
+        int process_slot = -1, cancel_slot = -1;
+
+        if (!out->closed) { owners[count] = out; handles[count++] = out->ov.hEvent; }
+        if (!err->closed) { owners[count] = err; handles[count++] = err->ov.hEvent; }
+        if (!process_exited) { process_slot = (int)count; handles[count++] = pi.hProcess; }
+        if (cancel_event) { cancel_slot = (int)count; handles[count++] = cancel_event; }
+
+        // Wait for whichever comes first: output, exit, cancel, timeout or idle drain
+        ULONGLONG now = GetTickCount64();
+        DWORD wait_ms = INFINITE;
+        if (deadline) wait_ms = now >= deadline ? 0 : (DWORD)(deadline - now);
+        if (process_exited) {
+            DWORD idle_left = now >= idle_deadline ? 0 : (DWORD)(idle_deadline - now);
+            if (idle_left < wait_ms) wait_ms = idle_left;
+        }
+
+        DWORD wait = WaitForMultipleObjects(count, handles, FALSE, wait_ms);
+
+        if (wait == WAIT_TIMEOUT) {
+            if (process_exited && (!deadline || GetTickCount64() < deadline)) {
+                // A grandchild (e.g. a forked adb server) still holds the pipe open
+                break;
+            }
+            result->timed_out = 1;
+            break;
+        }
+        if (wait == WAIT_FAILED) {
+            break;
+        }
+
+        int slot = (int)(wait - WAIT_OBJECT_0);
+        if (slot == cancel_slot) {
+            result->cancelled = 1;
+            break;
+        }
+        if (slot == process_slot) {
+            process_exited = 1;
+            idle_deadline = GetTickCount64() + EXIT_DRAIN_IDLE_MS;
+            continue;
+        }
+
+        CompleteRead(owners[slot], owners[slot] == err, options, result);
+        if (process_exited) {
+            idle_deadline = GetTickCount64() + EXIT_DRAIN_IDLE_MS;
+        }
+    }
+
+    // Both pipes closed early (e.g. the child redirected them); still honour timeout/cancel
+    if (!kill_child && !result->timed_out && !result->cancelled && !process_exited) {
+        HANDLE handles[2] = { pi.hProcess, cancel_event };
+        DWORD wait_ms = INFINITE;
+        if (deadline) {
+            ULONGLONG now = GetTickCount64();
+            wait_ms = now >= deadline ? 0 : (DWORD)(deadline - now);
+        }
+        DWORD wait = WaitForMultipleObjects(cancel_event ? 2 : 1, handles, FALSE, wait_ms);
+        if (wait == WAIT_TIMEOUT) result->timed_out = 1;
+        else if (wait == WAIT_OBJECT_0 + 1) result->cancelled = 1;
+    }
+
+    if (kill_child || result->timed_out || result->cancelled) {
+        TerminateProcess(pi.hProcess, 1);
+        WaitForSingleObject(pi.hProcess, KILL_WAIT_MS);
+        result->exit_code = -1;
+    } else {
+        WaitForSingleObject(pi.hProcess, INFINITE);
+        DWORD exit_code;
+        GetExitCodeProcess(pi.hProcess, &exit_code);
+        result->exit_code = (int)exit_code;
+    }
+
+    CancelPendingRead(out);
+    CancelPendingRead(err);
+
+    result->stdout_data = out->data;
+    result->stdout_size = out->size;
+    result->stderr_data = err->data;
+    result->stderr_size = err->size;
+
+    // Cleanup
+    if (out->ov.hEvent) CloseHandle(out->ov.hEvent);
+    if (err->ov.hEvent) CloseHandle(err->ov.hEvent);
+    CloseHandle(stdout_read);
+    CloseHandle(stderr_read);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    free(streams);
+
+    return result;
+}
+
+// ProcessOutputCallback that writes straight to the console
+void WriteOutputToConsole(const char* data, size_t len, int is_stderr, void* user_data) {
+    (void)user_data;
+    FILE* target = is_stderr ? stderr : stdout;
+    fwrite(data, 1, len, target);
+    fflush(target);
+}
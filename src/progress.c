@@ -0,0 +1,215 @@
+#include "progress.h"
+#include "utils.h"
+
+static SRWLOCK g_stats_log_lock = SRWLOCK_INIT;
+
+// Format a byte count as B/KB/MB/GB
+void FormatByteCount(unsigned long long bytes, char* buffer, size_t size) {
+    const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1024.0 && unit < 4) {
+        value /= 1024.0;
+        unit++;
+    }
+    if (unit == 0) {
+        snprintf(buffer, size, "%llu B", bytes);
+    } else {
+        snprintf(buffer, size, "%.1f %s", value, units[unit]);
+    }
+}
+
+// Format seconds as m:ss or h:mm:ss
+static void FormatDuration(unsigned long long seconds, char* buffer, size_t size) {
+    if (seconds >= 3600) {
+        snprintf(buffer, size, "%llu:%02llu:%02llu", seconds / 3600, (seconds / 60) % 60, seconds % 60);
+    } else {
+        snprintf(buffer, size, "%llu:%02llu", seconds / 60, seconds % 60);
+    }
+}
+
+// Average bytes/s since the first update
+static double AverageRate(const ProgressTracker* tracker, ULONGLONG now) {
+    ULONGLONG elapsed = now - tracker->start_tick;
+    unsigned long long moved = tracker->done > tracker->start_done ? tracker->done - tracker->start_done : 0;
+    return elapsed > 0 ? (double)moved * 1000.0 / (double)elapsed : 0.0;
+}
+
+// Start tracking a transfer
+void ProgressStart(ProgressTracker* tracker, const char* operation, const char* device,
+                   const char* label, unsigned long long total) {
+    memset(tracker, 0, sizeof(ProgressTracker));
+    snprintf(tracker->operation, sizeof(tracker->operation), "%s", operation ? operation : "");
+    snprintf(tracker->device, sizeof(tracker->device), "%s", device ? device : "");
+    snprintf(tracker->label, sizeof(tracker->label), "%s", label ? label : "");
+    tracker->total = total;
+    tracker->start_tick = GetTickCount64();
+    tracker->window_tick = tracker->start_tick;
+}
+
+// Format "[#####.....]  42%  1.2 GB / 2.9 GB  38.0 MB/s (avg 35.1 MB/s)  ETA 0:45"
+int ProgressFormat(const ProgressTracker* tracker, char* line, size_t size) {
+    ULONGLONG now = GetTickCount64();
+    double average = AverageRate(tracker, now);
+    // Until the first window closes the average is the best estimate
+    double current = tracker->rate > 0.0 ? tracker->rate : average;
+
+    char done_str[32], rate_str[32], average_str[32];
+    FormatByteCount(tracker->done, done_str, sizeof(done_str));
+    FormatByteCount((unsigned long long)current, rate_str, sizeof(rate_str));
+    FormatByteCount((unsigned long long)average, average_str, sizeof(average_str));
+
+    int len;
+    if (tracker->total > 0) {
+        unsigned long long done = tracker->done < tracker->total ? tracker->done : tracker->total;
+        int percent = (int)(done * 100 / tracker->total);
+        int filled = (int)(done * PROGRESS_BAR_WIDTH / tracker->total);
+
+        char bar[PROGRESS_BAR_WIDTH + 1];
+        for (int i = 0; i < PROGRESS_BAR_WIDTH; i++) bar[i] = i < filled ? '#' : '.';
+        bar[PROGRESS_BAR_WIDTH] = '\0';
+
+        char total_str[32], eta_str[32];
+        FormatByteCount(tracker->total, total_str, sizeof(total_str));
+        if (current > 0.0) {
+            FormatDuration((unsigned long long)((double)(tracker->total - done) / current), eta_str, sizeof(eta_str));
+        } else {
+            snprintf(eta_str, sizeof(eta_str), "--:--");
+        }
+
+        len = snprintf(line, size, "%s%s[%s] %3d%%  %s / %s  %s/s (avg %s/s)  ETA %s",
+                       tracker->status, tracker->status[0] ? " " : "", bar, percent, done_str, total_str,
+                       rate_str, average_str, eta_str);
+    } else {
+        len = snprintf(line, size, "%s%s%s  %s/s (avg %s/s)", tracker->status,
+                       tracker->status[0] ? " " : "", done_str, rate_str, average_str);
+    }
+    if (len < 0) len = 0;
+    if (len >= (int)size) len = (int)size - 1;
+    return len;
+}
+
+// Draw the progress line over the previous one
+void ProgressRedraw(ProgressTracker* tracker) {
+    tracker->last_draw_tick = GetTickCount64();
+
+    char line[256];
+    int len = ProgressFormat(tracker, line, sizeof(line));
+
+    // Pad over the previous, possibly longer, line
+    int pad = tracker->line_length > len ? tracker->line_length - len : 0;
+    printf("\r%s%*s", line, pad, "");
+    fflush(stdout);
+    tracker->line_length = len;
+}
+
+// Record progress without drawing (callers that render several trackers themselves)
+void ProgressRecord(ProgressTracker* tracker, unsigned long long done) {
+    ULONGLONG now = GetTickCount64();
+
+    if (!tracker->started) {
+        // Bytes already present (resumed transfers) do not count towards the rate
+        tracker->started = 1;
+        tracker->start_done = done;
+        tracker->window_done = done;
+        tracker->start_tick = now;
+        tracker->window_tick = now;
+    }
+    tracker->done = done;
+
+    if (now - tracker->window_tick >= PROGRESS_RATE_WINDOW_MS) {
+        unsigned long long moved = done > tracker->window_done ? done - tracker->window_done : 0;
+        tracker->rate = (double)moved * 1000.0 / (double)(now - tracker->window_tick);
+        if (tracker->rate > tracker->peak_rate) tracker->peak_rate = tracker->rate;
+        tracker->window_tick = now;
+        tracker->window_done = done;
+    }
+}
+
+// Record progress; redraws at most every PROGRESS_REDRAW_MS
+void ProgressUpdate(ProgressTracker* tracker, unsigned long long done) {
+    ProgressRecord(tracker, done);
+
+    ULONGLONG now = GetTickCount64();
+    int complete = tracker->total > 0 && done >= tracker->total;
+    if (complete || now - tracker->last_draw_tick >= PROGRESS_REDRAW_MS) {
+        ProgressRedraw(tracker);
+    }
+}
+
+// Erase the progress line so other output can be printed cleanly
+void ProgressClearLine(ProgressTracker* tracker) {
+    if (tracker->line_length > 0) {
+        printf("\r%*s\r", tracker->line_length, "");
+        tracker->line_length = 0;
+    }
+}
+
+// Append one row to the stats log
+static void LogTransferStats(const ProgressTracker* tracker, double seconds, double average, int success) {
+    AcquireSRWLockExclusive(&g_stats_log_lock);
+
+    int exists = FileExists(TRANSFER_STATS_LOG);
+    FILE* fp = fopen(TRANSFER_STATS_LOG, "a");
+    if (fp) {
+        if (!exists) {
+            fprintf(fp, "timestamp,operation,device,item,bytes,seconds,avg_mb_s,peak_mb_s,result\n");
+        }
+
+        // Commas would split the column; labels are file or partition names
+        char label[sizeof(tracker->label)];
+        snprintf(label, sizeof(label), "%s", tracker->label);
+        for (char* p = label; *p; p++) {
+            if (*p == ',' || *p == '"') *p = ' ';
+        }
+
+        char timestamp[64];
+        GetCurrentTimestamp(timestamp, sizeof(timestamp));
+        double peak = tracker->peak_rate > average ? tracker->peak_rate : average;
+        fprintf(fp, "%s,%s,%s,%s,%llu,%.2f,%.2f,%.2f,%s\n", timestamp, tracker->operation, tracker->device, label,
+                tracker->done - tracker->start_done, seconds, average / (1024.0 * 1024.0),
+                peak / (1024.0 * 1024.0), success ? "ok" : "failed");
+        fclose(fp);
+    }
+
+    ReleaseSRWLockExclusive(&g_stats_log_lock);
+}
+
+// End the line, print a summary on success and log the transfer
+void ProgressFinish(ProgressTracker* tracker, int success) {
+    ULONGLONG now = GetTickCount64();
+    double seconds = (now - tracker->start_tick) / 1000.0;
+    double average = AverageRate(tracker, now);
+
+    if (tracker->line_length > 0) {
+        ProgressRedraw(tracker);
+        printf("\n");
+        tracker->line_length = 0;
+    }
+
+    if (success) {
+        char size_str[32], average_str[32], peak_str[32];
+        FormatByteCount(tracker->done - tracker->start_done, size_str, sizeof(size_str));
+        FormatByteCount((unsigned long long)average, average_str, sizeof(average_str));
+        FormatByteCount((unsigned long long)(tracker->peak_rate > average ? tracker->peak_rate : average),
+                        peak_str, sizeof(peak_str));
+        printf("%s in %.1f s (avg %s/s, peak %s/s).\n", size_str, seconds, average_str, peak_str);
+    }
+
+    LogTransferStats(tracker, seconds, average, success);
+}
+
+// Log the transfer without printing anything (the caller reports the result)
+void ProgressLog(const ProgressTracker* tracker, int success) {
+    ULONGLONG now = GetTickCount64();
+    LogTransferStats(tracker, (now - tracker->start_tick) / 1000.0, AverageRate(tracker, now), success);
+}
+
+// ProgressCallback adapter; user_data is a ProgressTracker*
+void ProgressTrackerCallback(const char* filename, unsigned long long current,
+                             unsigned long long total, void* user_data) {
+    (void)filename;
+    ProgressTracker* tracker = (ProgressTracker*)user_data;
+    if (total > 0) tracker->total = total;
+    ProgressUpdate(tracker, current);
+}
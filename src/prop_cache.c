@@ -0,0 +1,297 @@
+#include "prop_cache.h"
+#include "shell_session.h"
+#include "adb_wrapper.h"
+#include "utils.h"
+
+// One dump per connected device; the table grows with the device count
+#define PROP_CACHE_MIN_CAPACITY 16
+#define MIN_PROP_TABLE 64
+
+typedef struct {
+    const char* key;        // Points into the owning dump
+    const char* value;
+    unsigned int hash;
+} PropSlot;
+
+typedef struct {
+    char serial[256];
+    unsigned int serial_hash;   // FNV-1a of serial, checked before any strcmp
+    int loaded;             // Property table is valid
+    char* dump;             // getprop output, split in place into keys and values
+    PropSlot* slots;
+    size_t capacity;        // Power of two
+    size_t count;
+    int has_root_solution;
+    int root_solution;
+} DevicePropCache;
+
+// Entries are kept packed; removing one moves the last into its place
+static DevicePropCache* g_prop_caches = NULL;
+static int g_prop_cache_count = 0;
+static int g_prop_cache_capacity = 0;
+static int* g_prop_cache_index = NULL;      // Open addressing by serial hash, -1 = empty
+static int g_prop_cache_index_capacity = 0; // Power of two, at least twice g_prop_cache_count
+static SRWLOCK g_prop_lock = SRWLOCK_INIT;
+
+// Insert (or overwrite) a property; the table always has spare slots
+static void InsertProp(PropSlot* slots, size_t capacity, const char* key, const char* value) {
+    unsigned int hash = HashString(key);
+    size_t mask = capacity - 1;
+    size_t index = hash & mask;
+
+    while (slots[index].key) {
+        if (slots[index].hash == hash && strcmp(slots[index].key, key) == 0) {
+            slots[index].value = value;
+            return;
+        }
+        index = (index + 1) & mask;
+    }
+
+    slots[index].key = key;
+    slots[index].value = value;
+    slots[index].hash = hash;
+}
+
+// Find a property in a loaded table
+static const char* LookupProp(const DevicePropCache* cache, const char* name) {
+    if (!cache->loaded || cache->capacity == 0) return NULL;
+
+    unsigned int hash = HashString(name);
+    size_t mask = cache->capacity - 1;
+    size_t index = hash & mask;
+
+    while (cache->slots[index].key) {
+        if (cache->slots[index].hash == hash && strcmp(cache->slots[index].key, name) == 0) {
+            return cache->slots[index].value;
+        }
+        index = (index + 1) & mask;
+    }
+    return NULL;
+}
+
+// Parse "[name]: [value]" lines in place and build the hash table
+static void BuildPropTable(char* dump, PropSlot** slots_out, size_t* capacity_out, size_t* count_out) {
+    // Size the table for a load factor of at most 1/2
+    size_t lines = 0;
+    for (const char* p = dump; *p; p++) {
+        if (*p == '\n') lines++;
+    }
+    size_t capacity = MIN_PROP_TABLE;
+    while (capacity < (lines + 1) * 2) capacity *= 2;
+
+    PropSlot* slots = (PropSlot*)SafeCalloc(capacity, sizeof(PropSlot));
+    size_t count = 0;
+
+    char* line = dump;
+    while (line && *line) {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+
+        // Lines that do not start a property are continuations of a multi-line value; skip them
+        char* separator = (line[0] == '[') ? strstr(line, "]: [") : NULL;
+        char* value_end = separator ? strrchr(separator + 4, ']') : NULL;
+        if (separator && value_end) {
+            *separator = '\0';
+            *value_end = '\0';
+            InsertProp(slots, capacity, line + 1, separator + 4);
+            count++;
+        }
+
+        line = next;
+    }
+
+    *slots_out = slots;
+    *capacity_out = capacity;
+    *count_out = count;
+}
+
+// Rebuild the serial index after an entry was added or removed (caller holds the lock exclusively)
+static void RebuildCacheIndex(void) {
+    int index_capacity = PROP_CACHE_MIN_CAPACITY * 2;
+    while (index_capacity < g_prop_cache_count * 2) index_capacity *= 2;
+
+    if (index_capacity != g_prop_cache_index_capacity) {
+        free(g_prop_cache_index);
+        g_prop_cache_index = (int*)SafeMalloc(index_capacity * sizeof(int));
+        g_prop_cache_index_capacity = index_capacity;
+    }
+    memset(g_prop_cache_index, 0xFF, index_capacity * sizeof(int));
+
+    int mask = index_capacity - 1;
+    for (int i = 0; i < g_prop_cache_count; i++) {
+        int slot = (int)(g_prop_caches[i].serial_hash & (unsigned int)mask);
+        while (g_prop_cache_index[slot] >= 0) slot = (slot + 1) & mask;
+        g_prop_cache_index[slot] = i;
+    }
+}
+
+// Release an entry's data
+static void FreeCache(DevicePropCache* cache) {
+    SAFE_FREE(cache->dump);
+    SAFE_FREE(cache->slots);
+}
+
+// Find the entry for a serial (caller holds the lock)
+static DevicePropCache* FindCache(const char* serial) {
+    if (g_prop_cache_index_capacity == 0) return NULL;
+
+    unsigned int hash = HashString(serial);
+    int mask = g_prop_cache_index_capacity - 1;
+    int slot = (int)(hash & (unsigned int)mask);
+
+    while (g_prop_cache_index[slot] >= 0) {
+        DevicePropCache* cache = &g_prop_caches[g_prop_cache_index[slot]];
+        if (cache->serial_hash == hash && strcmp(cache->serial, serial) == 0) {
+            return cache;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+// Find or add the entry for a serial (caller holds the lock exclusively). Adding
+// may move the table, so earlier entry pointers are stale afterwards.
+static DevicePropCache* ClaimCache(const char* serial) {
+    DevicePropCache* cache = FindCache(serial);
+    if (cache) return cache;
+
+    if (g_prop_cache_count == g_prop_cache_capacity) {
+        int capacity = g_prop_cache_capacity > 0 ? g_prop_cache_capacity * 2 : PROP_CACHE_MIN_CAPACITY;
+        g_prop_caches = (DevicePropCache*)SafeRealloc(g_prop_caches, capacity * sizeof(DevicePropCache));
+        g_prop_cache_capacity = capacity;
+    }
+
+    cache = &g_prop_caches[g_prop_cache_count++];
+    memset(cache, 0, sizeof(DevicePropCache));
+    strncpy(cache->serial, serial, sizeof(cache->serial) - 1);
+    cache->serial_hash = HashString(cache->serial);
+    RebuildCacheIndex();
+    return cache;
+}
+
+// Make sure the snapshot for a device is loaded (returns 0 if getprop failed)
+int PropCacheLoad(const char* adb_path, const char* device_serial) {
+    if (!device_serial) return 0;
+
+    AcquireSRWLockShared(&g_prop_lock);
+    DevicePropCache* cache = FindCache(device_serial);
+    int loaded = cache && cache->loaded;
+    ReleaseSRWLockShared(&g_prop_lock);
+    if (loaded) return 1;
+
+    // One getprop for everything, over the device's shell session
+    ProcessResult* result = ShellSessionRun(adb_path, device_serial, "getprop");
+    if (!result || result->exit_code != 0 || !result->stdout_data || result->stdout_size == 0) {
+        FreeProcessResult(result);
+        return 0;
+    }
+
+    // Take ownership of the output; keys and values will point into it
+    char* dump = result->stdout_data;
+    result->stdout_data = NULL;
+    FreeProcessResult(result);
+
+    PropSlot* slots = NULL;
+    size_t capacity = 0, count = 0;
+    BuildPropTable(dump, &slots, &capacity, &count);
+
+    AcquireSRWLockExclusive(&g_prop_lock);
+    cache = ClaimCache(device_serial);
+    if (!cache->loaded) {
+        cache->dump = dump;
+        cache->slots = slots;
+        cache->capacity = capacity;
+        cache->count = count;
+        cache->loaded = 1;
+        dump = NULL;
+        slots = NULL;
+    }
+    ReleaseSRWLockExclusive(&g_prop_lock);
+
+    // Another thread won the race; keep its copy
+    free(dump);
+    free(slots);
+    return 1;
+}
+
+// Look up one property; loads the snapshot on first use. Returns 1 if found.
+int PropCacheGet(const char* adb_path, const char* device_serial, const char* name,
+                 char* value_out, size_t value_size) {
+    if (!name || !value_out || value_size == 0) return 0;
+    value_out[0] = '\0';
+
+    if (!PropCacheLoad(adb_path, device_serial)) return 0;
+
+    int found = 0;
+    AcquireSRWLockShared(&g_prop_lock);
+    DevicePropCache* cache = FindCache(device_serial);
+    const char* value = cache ? LookupProp(cache, name) : NULL;
+    if (value) {
+        strncpy(value_out, value, value_size - 1);
+        value_out[value_size - 1] = '\0';
+        found = 1;
+    }
+    ReleaseSRWLockShared(&g_prop_lock);
+
+    return found;
+}
+
+// Memoized root solution (a RootSolution value), cleared with the snapshot
+int PropCacheGetRootSolution(const char* device_serial, int* solution_out) {
+    if (!device_serial || !solution_out) return 0;
+
+    int found = 0;
+    AcquireSRWLockShared(&g_prop_lock);
+    DevicePropCache* cache = FindCache(device_serial);
+    if (cache && cache->has_root_solution) {
+        *solution_out = cache->root_solution;
+        found = 1;
+    }
+    ReleaseSRWLockShared(&g_prop_lock);
+
+    return found;
+}
+
+// Remember the detected root solution until the device reconnects or reboots
+void PropCacheSetRootSolution(const char* device_serial, int solution) {
+    if (!device_serial) return;
+
+    AcquireSRWLockExclusive(&g_prop_lock);
+    DevicePropCache* cache = ClaimCache(device_serial);
+    cache->root_solution = solution;
+    cache->has_root_solution = 1;
+    ReleaseSRWLockExclusive(&g_prop_lock);
+}
+
+// Drop cached data for one device
+void PropCacheInvalidate(const char* device_serial) {
+    if (!device_serial) return;
+
+    AcquireSRWLockExclusive(&g_prop_lock);
+    DevicePropCache* cache = FindCache(device_serial);
+    if (cache) {
+        FreeCache(cache);
+        DevicePropCache* last = &g_prop_caches[g_prop_cache_count - 1];
+        if (cache != last) memcpy(cache, last, sizeof(DevicePropCache));
+        g_prop_cache_count--;
+        RebuildCacheIndex();
+    }
+    ReleaseSRWLockExclusive(&g_prop_lock);
+}
+
+// Drop everything (called on exit)
+void PropCacheClear(void) {
+    AcquireSRWLockExclusive(&g_prop_lock);
+    for (int i = 0; i < g_prop_cache_count; i++) {
+        FreeCache(&g_prop_caches[i]);
+    }
+    SAFE_FREE(g_prop_caches);
+    SAFE_FREE(g_prop_cache_index);
+    g_prop_cache_count = 0;
+    g_prop_cache_capacity = 0;
+    g_prop_cache_index_capacity = 0;
+    ReleaseSRWLockExclusive(&g_prop_lock);
+}
@@ -0,0 +1,634 @@
+#include "resumable_transfer.h"
+#include "adb_client.h"
+#include "adb_wrapper.h"
+#include "sync_client.h"
+#include "sha256.h"
+#include "utils.h"
+
+// dd block size; chunk offsets are expressed in these units
+#define DD_BLOCK_SIZE (1024 * 1024)
+// Attempts per chunk before giving up (the journal keeps what is done)
+#define CHUNK_ATTEMPTS 5
+// How long to wait for the device to come back after a failed chunk
+#define DEVICE_RETURN_TIMEOUT_MS 60000
+// Local read buffer (a multiple of the shell stdin packet payload)
+#define CHUNK_IO_BUFFER (SHELL_STDIN_PAYLOAD * 256)
+
+// Room for a remote path after shell quoting (each ' becomes '\'')
+#define QUOTED_PATH_MAX (SYNC_PATH_MAX * 4 + 3)
+
+#define JOURNAL_MAGIC "FOLKADB-JOURNAL"
+#define JOURNAL_VERSION 1
+
+// Which chunks of one transfer are already done
+typedef struct {
+    int chunk_count;
+    int done_count;
+    unsigned char* done;                // One flag per chunk
+    char (*hashes)[SHA256_HEX_SIZE];    // Recorded SHA-256 of each done chunk
+} ChunkJournal;
+
+// Progress across the whole file while a chunk is moving
+typedef struct {
+    const char* name;
+    unsigned long long total;
+    unsigned long long base;            // Bytes of completed chunks
+    ProgressCallback callback;
+    void* user_data;
+} ChunkProgress;
+
+// Report bytes moved within the current chunk
+static void ReportChunkProgress(const ChunkProgress* progress, unsigned long long chunk_bytes) {
+    if (progress->callback) {
+        progress->callback(progress->name, progress->base + chunk_bytes, progress->total, progress->user_data);
+    }
+}
+
+// Name shown in progress output
+static const char* ResumableBaseName(const char* path) {
+    const char* name = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') name = p + 1;
+    }
+    return name;
+}
+
+// Single-quote a path for the device shell (returns 0 if it does not fit)
+static int QuoteRemotePath(const char* path, char* out, size_t size) {
+    size_t used = 0;
+    if (size < 3) return 0;
+    out[used++] = '\'';
+    for (const char* p = path; *p; p++) {
+        const char* piece = (*p == '\'') ? "'\\''" : NULL;
+        size_t len = piece ? 4 : 1;
+        if (used + len + 2 > size) return 0;
+        if (piece) {
+            memcpy(out + used, piece, len);
+        } else {
+            out[used] = *p;
+        }
+        used += len;
+    }
+    out[used++] = '\'';
+    out[used] = '\0';
+    return 1;
+}
+
+// Journal header identifying the source version and chunk layout
+static void FormatJournalHeader(char* buffer, size_t size, unsigned long long file_size, unsigned int mtime) {
+    snprintf(buffer, size, "%s %d %llu %u %llu", JOURNAL_MAGIC, JOURNAL_VERSION,
+             file_size, mtime, (unsigned long long)RESUMABLE_CHUNK_SIZE);
+}
+
+// Set up an empty journal for a file
+static void InitChunkJournal(ChunkJournal* journal, unsigned long long file_size) {
+    journal->chunk_count = (int)((file_size + RESUMABLE_CHUNK_SIZE - 1) / RESUMABLE_CHUNK_SIZE);
+    journal->done_count = 0;
+    journal->done = (unsigned char*)SafeCalloc(journal->chunk_count > 0 ? journal->chunk_count : 1, 1);
+    journal->hashes = (char (*)[SHA256_HEX_SIZE])SafeCalloc(journal->chunk_count > 0 ? journal->chunk_count : 1,
+                                                             SHA256_HEX_SIZE);
+}
+
+// Release a journal's flags and hashes
+static void FreeChunkJournal(ChunkJournal* journal) {
+    free(journal->done);
+    free(journal->hashes);
+    journal->done = NULL;
+    journal->hashes = NULL;
+}
+
+// Mark the chunks recorded in journal text; returns 0 if it belongs to another file version
+static int ParseChunkJournal(char* text, const char* expected_header, ChunkJournal* journal) {
+    char* line = text;
+    int header_ok = 0;
+
+    while (line && *line) {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+
+        if (!header_ok) {
+            if (strcmp(line, expected_header) != 0) return 0;
+            header_ok = 1;
+        } else {
+            // "<offset> <length> <sha256>"; a torn last line simply does not count, and a
+            // chunk pulled again after failing its check is recorded again (the last line wins)
+            unsigned long long offset = 0, length = 0;
+            char hash[SHA256_HEX_SIZE];
+            if (sscanf(line, "%llu %llu %64s", &offset, &length, hash) == 3 &&
+                strlen(hash) == SHA256_HEX_SIZE - 1 && offset % RESUMABLE_CHUNK_SIZE == 0) {
+                int index = (int)(offset / RESUMABLE_CHUNK_SIZE);
+                if (index < journal->chunk_count) {
+                    if (!journal->done[index]) journal->done_count++;
+                    journal->done[index] = 1;
+                    memcpy(journal->hashes[index], hash, SHA256_HEX_SIZE);
+                }
+            }
+        }
+
+        line = next;
+    }
+
+    return header_ok;
+}
+
+// Length of chunk `index`
+static unsigned long long ChunkLength(unsigned long long file_size, int index) {
+    unsigned long long offset = (unsigned long long)index * RESUMABLE_CHUNK_SIZE;
+    unsigned long long remaining = file_size - offset;
+    return remaining < RESUMABLE_CHUNK_SIZE ? remaining : RESUMABLE_CHUNK_SIZE;
+}
+
+// Bytes covered by completed chunks
+static unsigned long long JournalDoneBytes(const ChunkJournal* journal, unsigned long long file_size) {
+    unsigned long long bytes = 0;
+    for (int i = 0; i < journal->chunk_count; i++) {
+        if (journal->done[i]) bytes += ChunkLength(file_size, i);
+    }
+    return bytes;
+}
+
+// Bring a whole-file digest up to `end` by reading the local copy (chunks not moved this run)
+static int CatchUpDigest(HANDLE file, Sha256Context* digest, unsigned long long end, char* buffer) {
+    if (!digest || digest->length >= end) return 1;
+
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)digest->length;
+    if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN)) return 0;
+
+    while (digest->length < end) {
+        unsigned long long want = end - digest->length;
+        DWORD read = 0;
+        if (!ReadFile(file, buffer, want < CHUNK_IO_BUFFER ? (DWORD)want : CHUNK_IO_BUFFER, &read, NULL) ||
+            read == 0) {
+            return 0;
+        }
+        Sha256Update(digest, buffer, read);
+    }
+    return 1;
+}
+
+// Re-hash the chunks a pull journal lists against the partial local file and
+// unmark any that no longer match (edited, truncated, or never reached the disk);
+// returns how many will be pulled again
+static int RecheckJournaledChunks(HANDLE file, unsigned long long file_size, ChunkJournal* journal, char* buffer) {
+    int dropped = 0;
+    for (int i = 0; i < journal->chunk_count; i++) {
+        if (!journal->done[i]) continue;
+
+        LARGE_INTEGER position;
+        position.QuadPart = (LONGLONG)((unsigned long long)i * RESUMABLE_CHUNK_SIZE);
+        unsigned long long remaining = ChunkLength(file_size, i);
+        int ok = SetFilePointerEx(file, position, NULL, FILE_BEGIN) ? 1 : 0;
+
+        Sha256Context ctx;
+        Sha256Init(&ctx);
+        while (ok && remaining > 0) {
+            DWORD read = 0;
+            if (!ReadFile(file, buffer, remaining < CHUNK_IO_BUFFER ? (DWORD)remaining : CHUNK_IO_BUFFER, &read,
+                          NULL) || read == 0) {
+                ok = 0;
+                break;
+            }
+            Sha256Update(&ctx, buffer, read);
+            remaining -= read;
+        }
+
+        char hash[SHA256_HEX_SIZE] = "";
+        if (ok) {
+            unsigned char chunk_digest[SHA256_DIGEST_SIZE];
+            Sha256Final(&ctx, chunk_digest);
+            Sha256ToHex(chunk_digest, hash);
+        }
+        if (!ok || strcmp(hash, journal->hashes[i]) != 0) {
+            journal->done[i] = 0;
+            journal->done_count--;
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+// Wait until the adb server sees the device online again
+static int WaitForDeviceReturn(const char* device_serial) {
+    char service[300];
+    snprintf(service, sizeof(service), "host-serial:%s:get-state", device_serial);
+
+    ULONGLONG deadline = GetTickCount64() + DEVICE_RETURN_TIMEOUT_MS;
+    while (GetTickCount64() < deadline) {
+        char* state = AdbClientQuery(service);
+        int online = state && strcmp(state, "device") == 0;
+        free(state);
+        if (online) return 1;
+        Sleep(1000);
+    }
+    return 0;
+}
+
+// Run a short shell v2 command; stdout goes to out (may be NULL). Returns the exit code, -1 if the link broke.
+static int RunShortShell(const char* device_serial, const char* command, char* out, size_t out_size) {
+    ProcessResult* result = AdbClientShell(device_serial, command);
+    if (!result) return -1;
+
+    if (out && out_size > 0) {
+        snprintf(out, out_size, "%s", result->stdout_data ? result->stdout_data : "");
+    }
+    int exit_code = result->exit_code;
+    FreeProcessResult(result);
+    return exit_code;
+}
+
+// Write one chunk with dd seek= and have the device hash what landed on disk
+static int PushChunk(const char* device_serial, HANDLE file, const char* quoted_remote,
+                     unsigned long long offset, unsigned long long length, char* buffer,
+                     const ChunkProgress* progress, Sha256Context* digest, char hash_out[SHA256_HEX_SIZE]) {
+    unsigned long long block = offset / DD_BLOCK_SIZE;
+    unsigned long long blocks = (length + DD_BLOCK_SIZE - 1) / DD_BLOCK_SIZE;
+
+    size_t service_len = strlen(quoted_remote) * 2 + 256;
+    char* service = (char*)SafeMalloc(service_len);
+    snprintf(service, service_len,
+             "shell,v2,raw:dd of=%s bs=%d seek=%llu conv=notrunc 2>/dev/null && "
+             "dd if=%s bs=%d skip=%llu count=%llu 2>/dev/null | sha256sum",
+             quoted_remote, DD_BLOCK_SIZE, block, quoted_remote, DD_BLOCK_SIZE, block, blocks);
+
+    SOCKET sock = AdbClientOpenService(device_serial, service);
+    free(service);
+    if (sock == INVALID_SOCKET) return 0;
+
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)offset;
+    int ok = SetFilePointerEx(file, position, NULL, FILE_BEGIN) ? 1 : 0;
+
+    Sha256Context ctx;
+    Sha256Init(&ctx);
+    unsigned long long sent = 0;
+    while (ok && sent < length) {
+        unsigned long long want = length - sent;
+        DWORD read = 0;
+        if (!ReadFile(file, buffer, want < CHUNK_IO_BUFFER ? (DWORD)want : CHUNK_IO_BUFFER, &read, NULL) || read == 0) {
+            ok = 0;
+            break;
+        }
+        Sha256Update(&ctx, buffer, read);
+        if (digest) Sha256Update(digest, buffer, read);
+        if (!AdbClientShellWriteStdin(sock, buffer, read)) {
+            ok = 0;
+            break;
+        }
+        sent += read;
+        ReportChunkProgress(progress, sent);
+    }
+
+    // End of stdin lets dd finish; the reply is the hash of the bytes now on the device
+    char reply[256];
+    int exit_code = -1;
+    if (ok) {
+        ok = AdbClientShellCloseStdin(sock) &&
+             AdbClientShellWaitExit(sock, reply, sizeof(reply), &exit_code) && exit_code == 0;
+    }
+    closesocket(sock);
+    if (!ok) return 0;
+
+    unsigned char chunk_digest[SHA256_DIGEST_SIZE];
+    Sha256Final(&ctx, chunk_digest);
+    Sha256ToHex(chunk_digest, hash_out);
+    return strncmp(reply, hash_out, SHA256_HEX_SIZE - 1) == 0;
+}
+
+// Push a large file in verified chunks, resuming from the device-side journal
+int ResumablePushFile(const char* device_serial, const char* local_path, const char* remote_path,
+                      Sha256Context* digest, ProgressCallback progress, void* user_data) {
+    if (!device_serial || !local_path || !remote_path) return 0;
+
+    // Chunk writes need stdin plus a reliable exit code
+    if (!AdbClientIsAvailable() || !AdbClientDeviceHasFeature(device_serial, "shell_v2")) return -1;
+
+    char quoted_remote[QUOTED_PATH_MAX];
+    char journal_path[QUOTED_PATH_MAX];
+    char quoted_journal[QUOTED_PATH_MAX];
+    snprintf(journal_path, sizeof(journal_path), "%s%s", remote_path, RESUMABLE_JOURNAL_SUFFIX);
+    if (!QuoteRemotePath(remote_path, quoted_remote, sizeof(quoted_remote)) ||
+        !QuoteRemotePath(journal_path, quoted_journal, sizeof(quoted_journal))) {
+        return -1;
+    }
+
+    HANDLE file = CreateFileA(local_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        PrintError(ADB_ERROR_FILE_NOT_FOUND, local_path);
+        return 0;
+    }
+
+    LARGE_INTEGER file_size;
+    FILETIME write_time;
+    if (!GetFileSizeEx(file, &file_size) || !GetFileTime(file, NULL, NULL, &write_time)) {
+        PrintError(ADB_ERROR_UNKNOWN, "Cannot read local file");
+        CloseHandle(file);
+        return 0;
+    }
+    unsigned long long size = (unsigned long long)file_size.QuadPart;
+    unsigned int mtime = FileTimeToUnixSeconds(&write_time);
+
+    char header[128];
+    FormatJournalHeader(header, sizeof(header), size, mtime);
+
+    ChunkJournal journal;
+    InitChunkJournal(&journal, size);
+
+    // An existing journal only counts while the partial file it describes is still there
+    size_t command_size = strlen(quoted_remote) + strlen(quoted_journal) + 256;
+    char* command = (char*)SafeMalloc(command_size);
+    size_t text_size = 64 + (size_t)journal.chunk_count * 128;
+    char* text = (char*)SafeMalloc(text_size);
+    snprintf(command, command_size, "[ -f %s ] && cat %s 2>/dev/null", quoted_remote, quoted_journal);
+    int resumed = RunShortShell(device_serial, command, text, text_size) == 0 &&
+                  ParseChunkJournal(text, header, &journal);
+    free(text);
+
+    int ok = 1;
+    if (resumed && journal.done_count > 0) {
+        printf("Resuming: %d of %d chunk(s) already on the device.\n", journal.done_count, journal.chunk_count);
+    } else {
+        memset(journal.done, 0, journal.chunk_count);
+        journal.done_count = 0;
+        snprintf(command, command_size, ": > %s && echo '%s' > %s", quoted_remote, header, quoted_journal);
+        if (RunShortShell(device_serial, command, NULL, 0) != 0) {
+            PrintError(ADB_ERROR_UNKNOWN, "Cannot create remote file");
+            ok = 0;
+        }
+    }
+
+    ChunkProgress chunk_progress = { ResumableBaseName(local_path), size, JournalDoneBytes(&journal, size),
+                                     progress, user_data };
+    char* buffer = (char*)SafeMalloc(CHUNK_IO_BUFFER);
+
+    for (int i = 0; ok && i < journal.chunk_count; i++) {
+        if (journal.done[i]) continue;
+
+        unsigned long long offset = (unsigned long long)i * RESUMABLE_CHUNK_SIZE;
+        unsigned long long length = ChunkLength(size, i);
+
+        // The digest only advances in file order; a failed attempt rolls it back
+        if (!CatchUpDigest(file, digest, offset, buffer)) {
+            PrintError(ADB_ERROR_UNKNOWN, "Cannot read local file for verification");
+            ok = 0;
+            break;
+        }
+        Sha256Context digest_before;
+        if (digest) digest_before = *digest;
+
+        char hash[SHA256_HEX_SIZE];
+        int attempt = 0;
+        while (1) {
+            if (PushChunk(device_serial, file, quoted_remote, offset, length, buffer, &chunk_progress,
+                          digest, hash)) {
+                break;
+            }
+            if (digest) *digest = digest_before;
+
+            if (++attempt >= CHUNK_ATTEMPTS) {
+                ok = 0;
+                break;
+            }
+            printf("\nChunk at %llu MB failed, waiting for the device (attempt %d of %d)...\n",
+                   offset / DD_BLOCK_SIZE, attempt + 1, CHUNK_ATTEMPTS);
+            if (!WaitForDeviceReturn(device_serial)) {
+                ok = 0;
+                break;
+            }
+        }
+        if (!ok) break;
+
+        // Record the verified chunk; if this is lost the chunk is simply sent again
+        snprintf(command, command_size, "echo '%llu %llu %s' >> %s", offset, length, hash, quoted_journal);
+        RunShortShell(device_serial, command, NULL, 0);
+
+        journal.done[i] = 1;
+        journal.done_count++;
+        chunk_progress.base += length;
+    }
+
+    if (ok && !CatchUpDigest(file, digest, size, buffer)) {
+        PrintError(ADB_ERROR_UNKNOWN, "Cannot read local file for verification");
+        ok = 0;
+    }
+    free(buffer);
+    CloseHandle(file);
+
+    if (ok) {
+        // Keep the source timestamp like a sync push, then drop the journal
+        snprintf(command, command_size, "touch -m -d @%u %s 2>/dev/null; rm -f %s", mtime, quoted_remote, quoted_journal);
+        RunShortShell(device_serial, command, NULL, 0);
+        ReportChunkProgress(&chunk_progress, 0);
+    } else {
+        printf("\nPush interrupted with %d of %d chunk(s) done; run the same command again to resume.\n",
+               journal.done_count, journal.chunk_count);
+    }
+
+    free(command);
+    FreeChunkJournal(&journal);
+    return ok;
+}
+
+// Read one chunk with dd skip= over exec: and write it at its offset
+static int PullChunk(const char* device_serial, HANDLE file, const char* quoted_remote,
+                     unsigned long long offset, unsigned long long length, char* buffer,
+                     const ChunkProgress* progress, Sha256Context* digest, char hash_out[SHA256_HEX_SIZE]) {
+    unsigned long long block = offset / DD_BLOCK_SIZE;
+    unsigned long long blocks = (length + DD_BLOCK_SIZE - 1) / DD_BLOCK_SIZE;
+
+    size_t service_len = strlen(quoted_remote) + 128;
+    char* service = (char*)SafeMalloc(service_len);
+    snprintf(service, service_len, "exec:dd if=%s bs=%d skip=%llu count=%llu 2>/dev/null",
+             quoted_remote, DD_BLOCK_SIZE, block, blocks);
+
+    SOCKET sock = AdbClientOpenService(device_serial, service);
+    free(service);
+    if (sock == INVALID_SOCKET) return 0;
+
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)offset;
+    int ok = SetFilePointerEx(file, position, NULL, FILE_BEGIN) ? 1 : 0;
+
+    Sha256Context ctx;
+    Sha256Init(&ctx);
+    unsigned long long received = 0;
+    while (ok && received < length) {
+        unsigned long long want = length - received;
+        int got = recv(sock, buffer, want < CHUNK_IO_BUFFER ? (int)want : CHUNK_IO_BUFFER, 0);
+        if (got <= 0) {
+            // Stream ended early: the device went away or the file shrank
+            ok = 0;
+            break;
+        }
+
+        DWORD written = 0;
+        if (!WriteFile(file, buffer, (DWORD)got, &written, NULL) || written != (DWORD)got) {
+            ok = 0;
+            break;
+        }
+        Sha256Update(&ctx, buffer, (size_t)got);
+        if (digest) Sha256Update(digest, buffer, (size_t)got);
+        received += (unsigned long long)got;
+        ReportChunkProgress(progress, received);
+    }
+    closesocket(sock);
+
+    // The chunk must be on disk before the journal says so
+    if (!ok || !FlushFileBuffers(file)) return 0;
+
+    unsigned char chunk_digest[SHA256_DIGEST_SIZE];
+    Sha256Final(&ctx, chunk_digest);
+    Sha256ToHex(chunk_digest, hash_out);
+    return 1;
+}
+
+// Pull a large file in chunks, resuming from the journal next to local_path
+int ResumablePullFile(const char* device_serial, const char* remote_path, const char* local_path,
+                      unsigned long long size, unsigned int mtime, Sha256Context* digest,
+                      ProgressCallback progress, void* user_data) {
+    if (!device_serial || !remote_path || !local_path) return 0;
+    if (!AdbClientIsAvailable()) return -1;
+
+    char quoted_remote[QUOTED_PATH_MAX];
+    if (!QuoteRemotePath(remote_path, quoted_remote, sizeof(quoted_remote))) return -1;
+
+    char journal_path[MAX_PATH];
+    if (snprintf(journal_path, sizeof(journal_path), "%s%s", local_path, RESUMABLE_JOURNAL_SUFFIX) >=
+        (int)sizeof(journal_path)) {
+        return -1;
+    }
+
+    char header[128];
+    FormatJournalHeader(header, sizeof(header), size, mtime);
+
+    ChunkJournal journal;
+    InitChunkJournal(&journal, size);
+
+    // An existing journal only counts while the partial file it describes is still there
+    int resumed = 0;
+    FILE* journal_file = FileExists(local_path) ? fopen(journal_path, "rb") : NULL;
+    if (journal_file) {
+        size_t text_size = 64 + (size_t)journal.chunk_count * 128;
+        char* text = (char*)SafeMalloc(text_size);
+        size_t text_len = fread(text, 1, text_size - 1, journal_file);
+        text[text_len] = '\0';
+        fclose(journal_file);
+        resumed = ParseChunkJournal(text, header, &journal);
+        free(text);
+    }
+
+    if (!resumed) {
+        memset(journal.done, 0, journal.chunk_count);
+        journal.done_count = 0;
+    }
+
+    // Read access lets a verifying pull hash chunks that an earlier run already wrote
+    HANDLE file = CreateFileA(local_path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                              resumed ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        PrintError(ADB_ERROR_UNKNOWN, "Cannot create local file");
+        FreeChunkJournal(&journal);
+        return 0;
+    }
+
+    // Reserve the full size up front so a full disk fails now, not hours in
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)size;
+    int ok = SetFilePointerEx(file, end, NULL, FILE_BEGIN) && SetEndOfFile(file);
+    if (!ok) PrintError(ADB_ERROR_UNKNOWN, "Not enough disk space for the file");
+
+    journal_file = ok ? fopen(journal_path, resumed ? "ab" : "wb") : NULL;
+    if (ok && !journal_file) {
+        PrintError(ADB_ERROR_UNKNOWN, "Cannot create transfer journal");
+        ok = 0;
+    }
+    if (ok && !resumed) {
+        fprintf(journal_file, "%s\n", header);
+        fflush(journal_file);
+    }
+
+    // The journal's hashes are only trusted once the bytes on disk still match them
+    char* buffer = (char*)SafeMalloc(CHUNK_IO_BUFFER);
+    if (ok && journal.done_count > 0) {
+        printf("Checking %d chunk(s) already on disk...\n", journal.done_count);
+        int dropped = RecheckJournaledChunks(file, size, &journal, buffer);
+        if (dropped > 0) printf("%d chunk(s) no longer match the journal and will be pulled again.\n", dropped);
+    }
+    if (ok && journal.done_count > 0) {
+        printf("Resuming: %d of %d chunk(s) already on disk.\n", journal.done_count, journal.chunk_count);
+    }
+
+    ChunkProgress chunk_progress = { ResumableBaseName(remote_path), size, JournalDoneBytes(&journal, size),
+                                     progress, user_data };
+
+    for (int i = 0; ok && i < journal.chunk_count; i++) {
+        if (journal.done[i]) continue;
+
+        unsigned long long offset = (unsigned long long)i * RESUMABLE_CHUNK_SIZE;
+        unsigned long long length = ChunkLength(size, i);
+
+        // The digest only advances in file order; a failed attempt rolls it back
+        if (!CatchUpDigest(file, digest, offset, buffer)) {
+            PrintError(ADB_ERROR_UNKNOWN, "Cannot read local file for verification");
+            ok = 0;
+            break;
+        }
+        Sha256Context digest_before;
+        if (digest) digest_before = *digest;
+
+        char hash[SHA256_HEX_SIZE];
+        int attempt = 0;
+        while (1) {
+            if (PullChunk(device_serial, file, quoted_remote, offset, length, buffer, &chunk_progress,
+                          digest, hash)) {
+                break;
+            }
+            if (digest) *digest = digest_before;
+
+            if (++attempt >= CHUNK_ATTEMPTS) {
+                ok = 0;
+                break;
+            }
+            printf("\nChunk at %llu MB failed, waiting for the device (attempt %d of %d)...\n",
+                   offset / DD_BLOCK_SIZE, attempt + 1, CHUNK_ATTEMPTS);
+            if (!WaitForDeviceReturn(device_serial)) {
+                ok = 0;
+                break;
+            }
+        }
+        if (!ok) break;
+
+        fprintf(journal_file, "%llu %llu %s\n", offset, length, hash);
+        fflush(journal_file);
+
+        journal.done[i] = 1;
+        journal.done_count++;
+        chunk_progress.base += length;
+    }
+
+    if (ok && !CatchUpDigest(file, digest, size, buffer)) {
+        PrintError(ADB_ERROR_UNKNOWN, "Cannot read local file for verification");
+        ok = 0;
+    }
+    free(buffer);
+    if (journal_file) fclose(journal_file);
+
+    if (ok) {
+        // Keep the device timestamp like a sync pull, then drop the journal
+        FILETIME write_time = UnixSecondsToFileTime(mtime);
+        SetFileTime(file, NULL, NULL, &write_time);
+        CloseHandle(file);
+        DeleteFileA(journal_path);
+        ReportChunkProgress(&chunk_progress, 0);
+    } else {
+        CloseHandle(file);
+        printf("\nPull interrupted with %d of %d chunk(s) done; run the same command again to resume.\n",
+               journal.done_count, journal.chunk_count);
+    }
+
+    FreeChunkJournal(&journal);
+    return ok;
+}
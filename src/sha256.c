@@ -0,0 +1,252 @@
+#include "sha256.h"
+#include "utils.h"
+
+// x86 SHA extensions (SHA-NI): several times faster than the portable rounds,
+// which matters when a transfer is hashed as it streams
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SHA256_HAVE_SHANI 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHANI_TARGET
+#else
+#include <cpuid.h>
+#define SHANI_TARGET __attribute__((target("sha,sse4.1")))
+#endif
+#endif
+
+// Read size for Sha256File
+#define SHA256_FILE_CHUNK (1024 * 1024)
+
+// Compresses whole 64-byte blocks into the state
+typedef void (*Sha256BlocksFn)(unsigned int state[8], const unsigned char* data, size_t blocks);
+
+static const unsigned int g_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Compress one 64-byte block into the state
+static void Sha256Block(unsigned int state[8], const unsigned char* block) {
+    unsigned int w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((unsigned int)block[i * 4] << 24) | ((unsigned int)block[i * 4 + 1] << 16) |
+               ((unsigned int)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        unsigned int s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned int s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    unsigned int a = state[0], b = state[1], c = state[2], d = state[3];
+    unsigned int e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+        unsigned int s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        unsigned int ch = (e & f) ^ (~e & g);
+        unsigned int t1 = h + s1 + ch + g_sha256_k[i] + w[i];
+        unsigned int s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        unsigned int maj = (a & b) ^ (a & c) ^ (b & c);
+        unsigned int t2 = s0 + maj;
+
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// Portable path for several blocks
+static void Sha256BlocksGeneric(unsigned int state[8], const unsigned char* data, size_t blocks) {
+    while (blocks-- > 0) {
+        Sha256Block(state, data);
+        data += 64;
+    }
+}
+
+#ifdef SHA256_HAVE_SHANI
+// Whether the CPU has the SHA extensions (and the SSE4.1/SSSE3 shuffles they are used with)
+static int CpuHasShaExtensions(void) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return 0;
+    __cpuid(info, 1);
+    int sse = (info[2] & (1 << 9)) && (info[2] & (1 << 19));
+    __cpuidex(info, 7, 0);
+    return sse && (info[1] & (1 << 29));
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) < 7) return 0;
+    __cpuid(1, eax, ebx, ecx, edx);
+    int sse = (ecx & (1 << 9)) && (ecx & (1 << 19));
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return sse && (ebx & (1 << 29));
+#endif
+}
+
+// SHA-NI path: four rounds per pair of sha256rnds2, schedule with sha256msg1/2
+SHANI_TARGET static void Sha256BlocksShaNi(unsigned int state[8], const unsigned char* data, size_t blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The instructions keep the state as ABEF/CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (blocks-- > 0) {
+        __m128i abef = state0, cdgh = state1;
+        __m128i msg[4];
+        for (int i = 0; i < 4; i++) {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), byte_swap);
+        }
+
+        // msg[i & 3] holds W[4i..4i+3]; each group is replaced by the one four groups later
+        for (int i = 0; i < 16; i++) {
+            __m128i words = _mm_add_epi32(msg[i & 3], _mm_loadu_si128((const __m128i*)&g_sha256_k[i * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(words, 0x0E));
+
+            if (i < 12) {
+                __m128i next = _mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+                msg[i & 3] = _mm_sha256msg2_epu32(next, msg[(i + 3) & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+#endif
+
+// Block function for this CPU, chosen on first use
+static Sha256BlocksFn g_sha256_blocks = NULL;
+
+// Start a new hash
+void Sha256Init(Sha256Context* ctx) {
+    if (!g_sha256_blocks) {
+#ifdef SHA256_HAVE_SHANI
+        g_sha256_blocks = CpuHasShaExtensions() ? Sha256BlocksShaNi : Sha256BlocksGeneric;
+#else
+        g_sha256_blocks = Sha256BlocksGeneric;
+#endif
+    }
+
+    static const unsigned int initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->block_used = 0;
+}
+
+// Feed data
+void Sha256Update(Sha256Context* ctx, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    ctx->length += size;
+
+    if (ctx->block_used > 0) {
+        size_t take = 64 - ctx->block_used;
+        if (take > size) take = size;
+        memcpy(ctx->block + ctx->block_used, p, take);
+        ctx->block_used += take;
+        p += take;
+        size -= take;
+        if (ctx->block_used < 64) return;
+        g_sha256_blocks(ctx->state, ctx->block, 1);
+        ctx->block_used = 0;
+    }
+
+    // Whole blocks straight from the caller's buffer
+    if (size >= 64) {
+        g_sha256_blocks(ctx->state, p, size / 64);
+        p += size & ~(size_t)63;
+        size &= 63;
+    }
+
+    memcpy(ctx->block, p, size);
+    ctx->block_used = size;
+}
+
+// Pad, finish and write the digest
+void Sha256Final(Sha256Context* ctx, unsigned char digest[SHA256_DIGEST_SIZE]) {
+    unsigned long long bits = ctx->length * 8;
+
+    ctx->block[ctx->block_used++] = 0x80;
+    if (ctx->block_used > 56) {
+        memset(ctx->block + ctx->block_used, 0, 64 - ctx->block_used);
+        g_sha256_blocks(ctx->state, ctx->block, 1);
+        ctx->block_used = 0;
+    }
+    memset(ctx->block + ctx->block_used, 0, 56 - ctx->block_used);
+    for (int i = 0; i < 8; i++) {
+        ctx->block[56 + i] = (unsigned char)(bits >> (56 - i * 8));
+    }
+    g_sha256_blocks(ctx->state, ctx->block, 1);
+
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)ctx->state[i];
+    }
+}
+
+// Lowercase hex, as printed by sha256sum
+void Sha256ToHex(const unsigned char digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0x0f];
+    }
+    hex[SHA256_HEX_SIZE - 1] = '\0';
+}
+
+// Hash a whole local file (returns 0 if it cannot be read)
+int Sha256File(const char* path, char hex[SHA256_HEX_SIZE]) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    unsigned char* buffer = (unsigned char*)SafeMalloc(SHA256_FILE_CHUNK);
+    Sha256Context ctx;
+    Sha256Init(&ctx);
+
+    int ok = 1;
+    DWORD read = 0;
+    while (1) {
+        if (!ReadFile(file, buffer, SHA256_FILE_CHUNK, &read, NULL)) {
+            ok = 0;
+            break;
+        }
+        if (read == 0) break;
+        Sha256Update(&ctx, buffer, read);
+    }
+
+    free(buffer);
+    CloseHandle(file);
+    if (!ok) return 0;
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    Sha256Final(&ctx, digest);
+    Sha256ToHex(digest, hex);
+    return 1;
+}
@@ -0,0 +1,484 @@
+#include "shell_session.h"
+#include "adb_client.h"
+#include "adb_wrapper.h"
+#include "utils.h"
+
+// The table grows with the number of devices; slots of closed sessions are reused
+#define SESSION_TABLE_MIN_CAPACITY 16
+
+// adbd's shell protocol buffer is small on older releases; keep stdin packets under it
+#define STDIN_PACKET_PAYLOAD 4000
+#define MAX_PACKET_PAYLOAD (16 * 1024 * 1024)
+
+#define LOST_COMMAND_MESSAGE "Shell session to the device was lost while the command ran; it was not retried"
+
+
+typedef struct {
+    char serial[256];
+    unsigned int serial_hash;   // FNV-1a of serial, checked before any strcmp
+    int in_use;
+    SOCKET sock;                // INVALID_SOCKET until connected
+    CRITICAL_SECTION lock;      // Serializes commands on this session
+    char* out;                  // Unconsumed stdout
+    size_t out_size;
+    size_t out_capacity;
+    char* err;                  // Unconsumed stderr
+    size_t err_size;
+    size_t err_capacity;
+} ShellSession;
+
+// Sessions are allocated one by one and never move, so a session stays valid
+// (and its lock usable) while the table grows around it
+static ShellSession** g_sessions = NULL;
+static int g_session_count = 0;
+static int g_session_capacity = 0;
+static int* g_session_index = NULL;         // Open addressing by serial hash, -1 = empty
+static int g_session_index_capacity = 0;    // Power of two, at least twice g_session_count
+static SRWLOCK g_sessions_lock = SRWLOCK_INIT;
+static volatile LONG g_marker_seq = 0;
+
+// Rebuild the serial index after a session was claimed or closed (caller holds
+// g_sessions_lock exclusively)
+static void RebuildSessionIndex(void) {
+    int index_capacity = SESSION_TABLE_MIN_CAPACITY * 2;
+    while (index_capacity < g_session_count * 2) index_capacity *= 2;
+
+    if (index_capacity != g_session_index_capacity) {
+        free(g_session_index);
+        g_session_index = (int*)SafeMalloc(index_capacity * sizeof(int));
+        g_session_index_capacity = index_capacity;
+    }
+    memset(g_session_index, 0xFF, index_capacity * sizeof(int));
+
+    int mask = index_capacity - 1;
+    for (int i = 0; i < g_session_count; i++) {
+        if (!g_sessions[i]->in_use) continue;
+        int slot = (int)(g_sessions[i]->serial_hash & (unsigned int)mask);
+        while (g_session_index[slot] >= 0) slot = (slot + 1) & mask;
+        g_session_index[slot] = i;
+    }
+}
+
+// Find the open session for a serial (caller holds g_sessions_lock)
+static ShellSession* FindSession(const char* serial) {
+    if (g_session_index_capacity == 0) return NULL;
+
+    unsigned int hash = HashString(serial);
+    int mask = g_session_index_capacity - 1;
+    int slot = (int)(hash & (unsigned int)mask);
+
+    while (g_session_index[slot] >= 0) {
+        ShellSession* session = g_sessions[g_session_index[slot]];
+        if (session->in_use && session->serial_hash == hash && strcmp(session->serial, serial) == 0) {
+            return session;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+// Close the connection and drop buffered output (caller holds session->lock)
+static void DisconnectSession(ShellSession* session) {
+    if (session->sock != INVALID_SOCKET) {
+        // Tell sh its stdin is done so it exits instead of lingering on the device
+        unsigned char packet[5] = { SHELL_ID_CLOSE_STDIN, 0, 0, 0, 0 };
+        AdbClientSendAll(session->sock, packet, sizeof(packet));
+        closesocket(session->sock);
+        session->sock = INVALID_SOCKET;
+    }
+    session->out_size = 0;
+    session->err_size = 0;
+}
+
+// Reuse the slot of a closed session, or add one, and return it locked. A closed
+// slot whose lock is still held (its last command is winding down) is skipped
+// rather than waited for (caller holds g_sessions_lock exclusively).
+static ShellSession* ClaimSession(const char* serial) {
+    ShellSession* claimed = NULL;
+    for (int i = 0; i < g_session_count && !claimed; i++) {
+        ShellSession* candidate = g_sessions[i];
+        if (!candidate->in_use && TryEnterCriticalSection(&candidate->lock)) claimed = candidate;
+    }
+    if (!claimed) {
+        if (g_session_count == g_session_capacity) {
+            int capacity = g_session_capacity > 0 ? g_session_capacity * 2 : SESSION_TABLE_MIN_CAPACITY;
+            g_sessions = (ShellSession**)SafeRealloc(g_sessions, capacity * sizeof(ShellSession*));
+            g_session_capacity = capacity;
+        }
+        claimed = (ShellSession*)SafeCalloc(1, sizeof(ShellSession));
+        InitializeCriticalSection(&claimed->lock);
+        claimed->sock = INVALID_SOCKET;
+        EnterCriticalSection(&claimed->lock);
+        g_sessions[g_session_count++] = claimed;
+    }
+
+    DisconnectSession(claimed);
+    strncpy(claimed->serial, serial, sizeof(claimed->serial) - 1);
+    claimed->serial[sizeof(claimed->serial) - 1] = '\0';
+    claimed->serial_hash = HashString(claimed->serial);
+    claimed->in_use = 1;
+    RebuildSessionIndex();
+    return claimed;
+}
+
+// Find (or claim) the session for a serial and return it locked
+static ShellSession* AcquireSession(const char* serial) {
+    while (1) {
+        AcquireSRWLockShared(&g_sessions_lock);
+        ShellSession* session = FindSession(serial);
+        ReleaseSRWLockShared(&g_sessions_lock);
+
+        if (!session) {
+            AcquireSRWLockExclusive(&g_sessions_lock);
+            // Another thread may have claimed it between the two locks
+            session = FindSession(serial);
+            if (!session) {
+                session = ClaimSession(serial);
+                ReleaseSRWLockExclusive(&g_sessions_lock);
+                return session;
+            }
+            ReleaseSRWLockExclusive(&g_sessions_lock);
+        }
+
+        // Waiting for the device's own session happens outside the table lock
+        EnterCriticalSection(&session->lock);
+        AcquireSRWLockShared(&g_sessions_lock);
+        // The slot may have been closed or handed to another device while we waited for it
+        int still_ours = session->in_use && strcmp(session->serial, serial) == 0;
+        ReleaseSRWLockShared(&g_sessions_lock);
+        if (still_ours) return session;
+        LeaveCriticalSection(&session->lock);
+    }
+}
+
+// Open the long-lived sh (no command = shell reading stdin, raw = no pty)
+static int ConnectSession(ShellSession* session) {
+    if (session->sock != INVALID_SOCKET) return 1;
+
+    session->sock = AdbClientOpenService(session->serial[0] ? session->serial : NULL, "shell,v2,raw:");
+    session->out_size = 0;
+    session->err_size = 0;
+    return session->sock != INVALID_SOCKET;
+}
+
+// An idle session whose server or device went away reads as closed; catch that
+// before anything is written to it, so nothing has to be retried afterwards
+static int SessionLooksAlive(ShellSession* session) {
+    fd_set read_set;
+    FD_ZERO(&read_set);
+    FD_SET(session->sock, &read_set);
+    struct timeval tv = { 0, 0 };
+    if (select(0, &read_set, NULL, NULL, &tv) <= 0) return 1;
+
+    char byte;
+    return recv(session->sock, &byte, 1, MSG_PEEK) > 0;
+}
+
+// Append a command as one single-quoted sh word
+static size_t AppendQuoted(char* buffer, size_t size, const char* word) {
+    char* out = buffer + size;
+    *out++ = '\'';
+    for (const char* p = word; *p; p++) {
+        if (*p == '\'') {
+            // Close the quote, emit an escaped quote, reopen
+            memcpy(out, "'\\''", 4);
+            out += 4;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out++ = '\'';
+    *out = '\0';
+    return (size_t)(out - buffer);
+}
+
+// Append bytes to one of the session's stream buffers
+static void AppendStream(char** data, size_t* size, size_t* capacity, const char* src, size_t len) {
+    if (*size + len + 1 > *capacity) {
+        size_t new_capacity = *capacity ? *capacity : 4096;
+        while (*size + len + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        *data = (char*)SafeRealloc(*data, new_capacity);
+        *capacity = new_capacity;
+    }
+    memcpy(*data + *size, src, len);
+    *size += len;
+    (*data)[*size] = '\0';
+}
+
+// Locate a byte pattern (output may contain NULs, so strstr is not enough)
+static const char* FindBytes(const char* data, size_t size, const char* pattern, size_t pattern_len) {
+    if (pattern_len == 0 || size < pattern_len) return NULL;
+
+    const char* end = data + size - pattern_len;
+    for (const char* p = data; p <= end; p++) {
+        p = (const char*)memchr(p, pattern[0], (size_t)(end - p) + 1);
+        if (!p) return NULL;
+        if (memcmp(p, pattern, pattern_len) == 0) return p;
+    }
+    return NULL;
+}
+
+// Copy the first len bytes of a buffer into a new null-terminated string
+static char* CopyBytes(const char* data, size_t len) {
+    char* copy = (char*)SafeMalloc(len + 1);
+    memcpy(copy, data, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// If both sentinels for a command have arrived, cut its result out of the buffers
+static ProcessResult* TakeCompletedResult(ShellSession* session, const char* marker) {
+    char out_pattern[64], err_pattern[64];
+    int out_len = snprintf(out_pattern, sizeof(out_pattern), "\n%s ", marker);
+    int err_len = snprintf(err_pattern, sizeof(err_pattern), "\n%s\n", marker);
+
+    const char* out_mark = FindBytes(session->out, session->out_size, out_pattern, (size_t)out_len);
+    if (!out_mark) return NULL;
+    const char* code_start = out_mark + out_len;
+    const char* out_eol = (const char*)memchr(code_start, '\n',
+                                              session->out_size - (size_t)(code_start - session->out));
+    if (!out_eol) return NULL;
+
+    const char* err_mark = FindBytes(session->err, session->err_size, err_pattern, (size_t)err_len);
+    if (!err_mark) return NULL;
+
+    ProcessResult* result = (ProcessResult*)SafeCalloc(1, sizeof(ProcessResult));
+    result->stdout_size = (size_t)(out_mark - session->out);
+    result->stdout_data = CopyBytes(session->out, result->stdout_size);
+    result->stderr_size = (size_t)(err_mark - session->err);
+    result->stderr_data = CopyBytes(session->err, result->stderr_size);
+    result->exit_code = atoi(code_start);
+
+    // Consume through the end of each sentinel line
+    size_t out_used = (size_t)(out_eol + 1 - session->out);
+    memmove(session->out, session->out + out_used, session->out_size - out_used);
+    session->out_size -= out_used;
+    size_t err_used = (size_t)(err_mark + err_len - session->err);
+    memmove(session->err, session->err + err_used, session->err_size - err_used);
+    session->err_size -= err_used;
+
+    return result;
+}
+
+// Write a script to sh's stdin as shell protocol packets. Returns how far into
+// the script the device may have read: everything, or up to the end of the
+// packet whose send failed (part of it may have gone out).
+static size_t SendScript(SOCKET sock, const char* script, size_t len) {
+    unsigned char header[5];
+    size_t written = 0;
+    while (len > 0) {
+        size_t chunk = len > STDIN_PACKET_PAYLOAD ? STDIN_PACKET_PAYLOAD : len;
+        header[0] = SHELL_ID_STDIN;
+        header[1] = (unsigned char)(chunk & 0xFF);
+        header[2] = (unsigned char)((chunk >> 8) & 0xFF);
+        header[3] = (unsigned char)((chunk >> 16) & 0xFF);
+        header[4] = (unsigned char)((chunk >> 24) & 0xFF);
+        written += chunk;
+        if (!AdbClientSendAll(sock, header, sizeof(header)) ||
+            !AdbClientSendAll(sock, script, chunk)) {
+            return written;
+        }
+        script += chunk;
+        len -= chunk;
+    }
+    return written;
+}
+
+// Frame each command with sentinels, send them all, then collect results in order.
+// Returns the number of commands that completed; *sent is how many the device may
+// have received (and so may be running, or have run, even if they never completed).
+static int RunOnSession(ShellSession* session, const char* commands[], int count,
+                        ProcessResult* results[], int* sent) {
+    *sent = 0;
+
+    // Each command runs in its own sh -c with stdin detached, so it cannot eat later
+    // commands or change the session's cwd/environment, and a syntax error (an
+    // unbalanced quote in a path, say) ends only that command. Then both streams
+    // get a marker.
+    LONG first_seq = InterlockedExchangeAdd(&g_marker_seq, count) + 1;
+    size_t script_size = 1;
+    for (int i = 0; i < count; i++) {
+        script_size += strlen(commands[i]) * 4 + 200;
+    }
+    char* script = (char*)SafeMalloc(script_size);
+    size_t* starts = (size_t*)SafeMalloc(count * sizeof(size_t));
+    size_t script_len = 0;
+    for (int i = 0; i < count; i++) {
+        starts[i] = script_len;
+        script_len += (size_t)snprintf(script + script_len, script_size - script_len, "sh -c ");
+        script_len = AppendQuoted(script, script_len, commands[i]);
+        script_len += (size_t)snprintf(script + script_len, script_size - script_len,
+            " </dev/null; printf '\\n%%s %%d\\n' __FOLKADB_END_%ld__ \"$?\"; "
+            "printf '\\n%%s\\n' __FOLKADB_END_%ld__ >&2\n",
+            (long)(first_seq + i), (long)(first_seq + i));
+    }
+
+    size_t written = SendScript(session->sock, script, script_len);
+    free(script);
+    while (*sent < count && starts[*sent] < written) (*sent)++;
+    free(starts);
+    if (written < script_len) return 0;
+
+    int completed = 0;
+    char marker[48];
+    snprintf(marker, sizeof(marker), "__FOLKADB_END_%ld__", (long)first_seq);
+
+    char* payload = NULL;
+    size_t payload_capacity = 0;
+
+    while (completed < count) {
+        unsigned char header[5];
+        if (!AdbClientRecvAll(session->sock, header, sizeof(header))) break;
+
+        size_t len = (size_t)header[1] | ((size_t)header[2] << 8) |
+                     ((size_t)header[3] << 16) | ((size_t)header[4] << 24);
+        if (len > MAX_PACKET_PAYLOAD) break;
+        if (len > payload_capacity) {
+            payload = (char*)SafeRealloc(payload, len);
+            payload_capacity = len;
+        }
+        if (len > 0 && !AdbClientRecvAll(session->sock, payload, len)) break;
+
+        if (header[0] == SHELL_ID_STDOUT) {
+            AppendStream(&session->out, &session->out_size, &session->out_capacity, payload, len);
+        } else if (header[0] == SHELL_ID_STDERR) {
+            AppendStream(&session->err, &session->err_size, &session->err_capacity, payload, len);
+        } else if (header[0] == SHELL_ID_EXIT) {
+            // sh itself went away
+            break;
+        } else {
+            continue;
+        }
+
+        // One packet can finish several queued commands
+        ProcessResult* result;
+        while (completed < count && (result = TakeCompletedResult(session, marker)) != NULL) {
+            results[completed++] = result;
+            snprintf(marker, sizeof(marker), "__FOLKADB_END_%ld__", (long)(first_seq + completed));
+        }
+    }
+
+    free(payload);
+    return completed;
+}
+
+// Result for a command the session lost after sending it. It is not run again
+// one-shot: it may still be running on the device, or have run already.
+static ProcessResult* LostCommandResult(void) {
+    ProcessResult* result = (ProcessResult*)SafeCalloc(1, sizeof(ProcessResult));
+    result->stdout_data = (char*)SafeCalloc(1, 1);
+    result->stderr_data = CopyBytes(LOST_COMMAND_MESSAGE, strlen(LOST_COMMAND_MESSAGE));
+    result->stderr_size = strlen(LOST_COMMAND_MESSAGE);
+    result->exit_code = -1;
+    return result;
+}
+
+// Run a batch with a receive deadline (0 = wait as long as the device keeps the link up)
+static int RunBatchWithTimeout(const char* adb_path, const char* device_serial, const char* commands[],
+                               int count, ProcessResult* results[], DWORD timeout_ms) {
+    if (!commands || !results || count <= 0) return 0;
+
+    for (int i = 0; i < count; i++) results[i] = NULL;
+
+    int completed = 0;
+    int sent = 0;
+    ShellSession* session = NULL;
+    if (AdbClientIsAvailable() && AdbClientDeviceHasFeature(device_serial, "shell_v2")) {
+        session = AcquireSession(device_serial ? device_serial : "");
+    }
+    if (session) {
+        // A session left idle across a server restart is found dead here, before use
+        if (session->sock != INVALID_SOCKET && !SessionLooksAlive(session)) DisconnectSession(session);
+
+        if (ConnectSession(session)) {
+            setsockopt(session->sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout_ms, sizeof(timeout_ms));
+            completed = RunOnSession(session, commands, count, results, &sent);
+            if (completed < count) DisconnectSession(session);
+        }
+
+        LeaveCriticalSection(&session->lock);
+    }
+
+    // Commands the device may have seen are reported lost; the rest (all of them
+    // without a session) go one-shot: AdbClientShell, or one adb.exe spawn each
+    int all_ok = 1;
+    for (int i = completed; i < count; i++) {
+        results[i] = i < sent ? LostCommandResult() : AdbShellCommand(adb_path, device_serial, commands[i]);
+        if (!results[i] || i < sent) all_ok = 0;
+    }
+
+    return all_ok;
+}
+
+// Run several commands in a single round trip; results[i] gets the output of commands[i]
+int ShellSessionRunBatch(const char* adb_path, const char* device_serial,
+                         const char* commands[], int count, ProcessResult* results[]) {
+    return RunBatchWithTimeout(adb_path, device_serial, commands, count, results, SHELL_SESSION_TIMEOUT_MS);
+}
+
+// Run one command on the device's session
+ProcessResult* ShellSessionRun(const char* adb_path, const char* device_serial, const char* command) {
+    if (!command) return NULL;
+
+    const char* commands[1] = { command };
+    ProcessResult* results[1] = { NULL };
+    RunBatchWithTimeout(adb_path, device_serial, commands, 1, results, SHELL_SESSION_TIMEOUT_MS);
+    return results[0];
+}
+
+// Run one command that may stay silent for a long time, with no receive deadline
+ProcessResult* ShellSessionRunLong(const char* adb_path, const char* device_serial, const char* command) {
+    if (!command) return NULL;
+
+    const char* commands[1] = { command };
+    ProcessResult* results[1] = { NULL };
+    RunBatchWithTimeout(adb_path, device_serial, commands, 1, results, 0);
+    return results[0];
+}
+
+// Drop the session for one device. The slot is freed under the table lock; its
+// socket is closed once a command still running on it lets go.
+void ShellSessionClose(const char* device_serial) {
+    AcquireSRWLockExclusive(&g_sessions_lock);
+    ShellSession* closing = FindSession(device_serial ? device_serial : "");
+    if (closing) {
+        closing->in_use = 0;
+        closing->serial[0] = '\0';
+        RebuildSessionIndex();
+    }
+    ReleaseSRWLockExclusive(&g_sessions_lock);
+    if (!closing) return;
+
+    EnterCriticalSection(&closing->lock);
+    AcquireSRWLockShared(&g_sessions_lock);
+    // A slot claimed again meanwhile was disconnected by its new owner
+    int reclaimed = closing->in_use;
+    ReleaseSRWLockShared(&g_sessions_lock);
+    if (!reclaimed) DisconnectSession(closing);
+    LeaveCriticalSection(&closing->lock);
+}
+
+// Drop every session (called on exit)
+void ShellSessionCloseAll(void) {
+    for (int i = 0; ; i++) {
+        AcquireSRWLockShared(&g_sessions_lock);
+        ShellSession* session = i < g_session_count ? g_sessions[i] : NULL;
+        ReleaseSRWLockShared(&g_sessions_lock);
+        if (!session) break;
+
+        EnterCriticalSection(&session->lock);
+        AcquireSRWLockExclusive(&g_sessions_lock);
+        session->in_use = 0;
+        session->serial[0] = '\0';
+        RebuildSessionIndex();
+        ReleaseSRWLockExclusive(&g_sessions_lock);
+        DisconnectSession(session);
+        SAFE_FREE(session->out);
+        SAFE_FREE(session->err);
+        session->out_capacity = 0;
+        session->err_capacity = 0;
+        LeaveCriticalSection(&session->lock);
+    }
+}
@@ -0,0 +1,969 @@
+#include "sparse_image.h"
+#include "utils.h"
+
+// Fill detection compares 64 bytes per step with SSE2 (always present on x64)
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPARSE_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Bytes of the image mapped at a time; views start on the allocation granularity
+#define SPARSE_MAP_WINDOW (64ULL * 1024 * 1024)
+#define SPARSE_MAP_ALIGN (64 * 1024)
+
+// Output is handed to the sink in pieces of about this size; smaller RAW runs
+// are copied next to their headers, larger ones go straight from the mapping
+#define SPARSE_OUTPUT_BUFFER (1024 * 1024)
+#define SPARSE_DIRECT_MIN (256 * 1024)
+
+// Read a little-endian value
+static unsigned int GetLE16(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+// Read a little-endian value
+static unsigned int GetLE32(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Store a little-endian value
+static void PutLE16(unsigned char* p, unsigned int value) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+}
+
+// Store a little-endian value
+static void PutLE32(unsigned char* p, unsigned int value) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+}
+
+// Pointer to `offset` in the image with at least min_len bytes behind it when
+// the file has them; *avail is what the current view holds from there
+static const unsigned char* MapRange(SparseImage* image, unsigned long long offset, size_t min_len, size_t* avail) {
+    if (offset >= image->file_size) {
+        snprintf(image->error, sizeof(image->error), "Image is truncated");
+        return NULL;
+    }
+
+    if (!image->view || offset < image->view_offset ||
+        offset + min_len > image->view_offset + image->view_size) {
+        if (image->view) UnmapViewOfFile(image->view);
+        image->view = NULL;
+
+        unsigned long long base = offset & ~(unsigned long long)(SPARSE_MAP_ALIGN - 1);
+        unsigned long long size = image->file_size - base;
+        if (size > SPARSE_MAP_WINDOW) size = SPARSE_MAP_WINDOW;
+        image->view = (const unsigned char*)MapViewOfFile(image->mapping, FILE_MAP_READ, (DWORD)(base >> 32),
+                                                          (DWORD)base, (SIZE_T)size);
+        if (!image->view) {
+            snprintf(image->error, sizeof(image->error), "Cannot map image (error %lu)", GetLastError());
+            return NULL;
+        }
+        image->view_offset = base;
+        image->view_size = (size_t)size;
+    }
+
+    *avail = (size_t)(image->view_offset + image->view_size - offset);
+    return image->view + (offset - image->view_offset);
+}
+
+// ============================================================================
+// Block Map
+// ============================================================================
+
+// Append a run to the block map
+static void AppendChunk(SparseImage* image, unsigned short type, unsigned int first_block, unsigned int blocks,
+                        unsigned long long offset, unsigned int fill) {
+    if (image->chunk_count == image->chunk_capacity) {
+        image->chunk_capacity = image->chunk_capacity ? image->chunk_capacity * 2 : 256;
+        image->chunks = (SparseChunk*)SafeRealloc(image->chunks, image->chunk_capacity * sizeof(SparseChunk));
+    }
+    SparseChunk* chunk = &image->chunks[image->chunk_count++];
+    chunk->type = type;
+    chunk->first_block = first_block;
+    chunk->blocks = blocks;
+    chunk->offset = offset;
+    chunk->fill = fill;
+}
+
+// Extend the last run with the next block or start a new one
+static void AddBlock(SparseImage* image, unsigned short type, unsigned int block, unsigned long long offset,
+                     unsigned int fill) {
+    if (image->chunk_count > 0) {
+        SparseChunk* last = &image->chunks[image->chunk_count - 1];
+        if (last->type == type && (type != SPARSE_CHUNK_FILL || last->fill == fill)) {
+            last->blocks++;
+            return;
+        }
+    }
+    AppendChunk(image, type, block, 1, offset, fill);
+}
+
+// True if the block repeats its first 32-bit word throughout (size is a multiple of 64)
+static int IsFillBlock(const unsigned char* block, size_t size, unsigned int* fill) {
+    unsigned int word;
+    memcpy(&word, block, sizeof(word));
+
+#ifdef SPARSE_HAVE_SSE2
+    const __m128i pattern = _mm_set1_epi32((int)word);
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < size; i += 64) {
+        __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(block + i)), pattern);
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(block + i + 16)), pattern);
+        __m128i c = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(block + i + 32)), pattern);
+        __m128i d = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(block + i + 48)), pattern);
+        __m128i diff = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xffff) return 0;
+    }
+#else
+    for (size_t i = 4; i < size; i += 4) {
+        if (memcmp(block + i, &word, sizeof(word)) != 0) return 0;
+    }
+#endif
+
+    *fill = word;
+    return 1;
+}
+
+// Classify every block of a raw image, hashing the file on the way
+static int MapRawImage(SparseImage* image, Sha256Context* digest) {
+    image->block_size = SPARSE_DEFAULT_BLOCK_SIZE;
+    unsigned long long blocks = (image->file_size + image->block_size - 1) / image->block_size;
+    if (blocks > 0xffffffffULL) {
+        snprintf(image->error, sizeof(image->error), "Image is too large");
+        return 0;
+    }
+    image->total_blocks = (unsigned int)blocks;
+
+    unsigned char tail[SPARSE_DEFAULT_BLOCK_SIZE];
+    unsigned long long offset = 0;
+    for (unsigned int block = 0; block < image->total_blocks; block++, offset += image->block_size) {
+        size_t avail = 0;
+        const unsigned char* data = MapRange(image, offset, image->block_size, &avail);
+        if (!data) return 0;
+
+        // Views are block aligned, so only the file's last block can come up short
+        size_t len = avail < image->block_size ? avail : image->block_size;
+        if (digest) Sha256Update(digest, data, len);
+        if (len < image->block_size) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, data, len);
+            data = tail;
+        }
+
+        unsigned int fill = 0;
+        if (IsFillBlock(data, image->block_size, &fill)) {
+            AddBlock(image, SPARSE_CHUNK_FILL, block, 0, fill);
+        } else {
+            AddBlock(image, SPARSE_CHUNK_RAW, block, offset, 0);
+        }
+    }
+    return 1;
+}
+
+// Read the chunk list of an image that is already sparse
+static int MapSparseImage(SparseImage* image, Sha256Context* digest) {
+    size_t avail = 0;
+    const unsigned char* header = MapRange(image, 0, SPARSE_HEADER_SIZE, &avail);
+    if (!header) return 0;
+
+    unsigned int major = GetLE16(header + 4);
+    unsigned int header_size = GetLE16(header + 8);
+    unsigned int chunk_header_size = GetLE16(header + 10);
+    image->block_size = GetLE32(header + 12);
+    image->total_blocks = GetLE32(header + 16);
+    unsigned int total_chunks = GetLE32(header + 20);
+    if (major != 1 || header_size < SPARSE_HEADER_SIZE || chunk_header_size < SPARSE_CHUNK_HEADER_SIZE ||
+        image->block_size == 0 || image->block_size % 4 != 0) {
+        snprintf(image->error, sizeof(image->error), "Unsupported sparse image header");
+        return 0;
+    }
+
+    unsigned long long offset = header_size;
+    unsigned int block = 0;
+    for (unsigned int i = 0; i < total_chunks; i++) {
+        const unsigned char* chunk = MapRange(image, offset, chunk_header_size, &avail);
+        if (!chunk || avail < chunk_header_size) {
+            snprintf(image->error, sizeof(image->error), "Sparse image is truncated");
+            return 0;
+        }
+        unsigned short type = (unsigned short)GetLE16(chunk);
+        unsigned int blocks = GetLE32(chunk + 4);
+        unsigned long long total_size = GetLE32(chunk + 8);
+        unsigned long long data_offset = offset + chunk_header_size;
+        unsigned long long data_size = total_size - chunk_header_size;
+
+        int valid = total_size >= chunk_header_size && blocks <= image->total_blocks - block;
+        if (type == SPARSE_CHUNK_RAW) {
+            valid = valid && data_size == (unsigned long long)blocks * image->block_size;
+        } else if (type == SPARSE_CHUNK_FILL) {
+            valid = valid && data_size == 4;
+        } else if (type == SPARSE_CHUNK_DONT_CARE) {
+            valid = valid && data_size == 0;
+        } else if (type != SPARSE_CHUNK_CRC32) {
+            valid = 0;
+        }
+        if (!valid || data_offset + data_size > image->file_size) {
+            snprintf(image->error, sizeof(image->error), "Corrupt sparse image (chunk %u)", i);
+            return 0;
+        }
+
+        if (type == SPARSE_CHUNK_FILL) {
+            const unsigned char* value = MapRange(image, data_offset, 4, &avail);
+            if (!value) return 0;
+            AppendChunk(image, type, block, blocks, 0, GetLE32(value));
+        } else if (type != SPARSE_CHUNK_CRC32 && blocks > 0) {
+            AppendChunk(image, type, block, blocks, data_offset, 0);
+        }
+        if (type != SPARSE_CHUNK_CRC32) block += blocks;
+        offset = data_offset + data_size;
+    }
+    if (block < image->total_blocks) {
+        AppendChunk(image, SPARSE_CHUNK_DONT_CARE, block, image->total_blocks - block, 0, 0);
+    }
+
+    // The chunk walk skips RAW data, so hash the file in a pass of its own
+    for (offset = 0; digest && offset < image->file_size; offset += avail) {
+        const unsigned char* data = MapRange(image, offset, 1, &avail);
+        if (!data) return 0;
+        Sha256Update(digest, data, avail);
+    }
+    return 1;
+}
+
+// Describe a raw image as one RAW run without reading it
+static int MapRawRun(SparseImage* image) {
+    image->block_size = SPARSE_DEFAULT_BLOCK_SIZE;
+    unsigned long long blocks = (image->file_size + image->block_size - 1) / image->block_size;
+    if (blocks > 0xffffffffULL) {
+        snprintf(image->error, sizeof(image->error), "Image is too large");
+        return 0;
+    }
+    image->total_blocks = (unsigned int)blocks;
+    AppendChunk(image, SPARSE_CHUNK_RAW, 0, image->total_blocks, 0, 0);
+    return 1;
+}
+
+// Open an image; lazy opens skip the block scan of raw files
+static int OpenImage(SparseImage* image, const char* path, Sha256Context* digest, int lazy) {
+    if (!image || !path) return 0;
+    memset(image, 0, sizeof(*image));
+
+    image->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              lazy ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (image->file == INVALID_HANDLE_VALUE) {
+        snprintf(image->error, sizeof(image->error), "Cannot open %s (error %lu)", path, GetLastError());
+        return 0;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(image->file, &file_size)) {
+        snprintf(image->error, sizeof(image->error), "Cannot read the size of %s", path);
+        SparseImageClose(image);
+        return 0;
+    }
+    image->file_size = (unsigned long long)file_size.QuadPart;
+    image->block_size = SPARSE_DEFAULT_BLOCK_SIZE;
+
+    // Empty files cannot be mapped and have no blocks
+    if (image->file_size == 0) return 1;
+
+    image->mapping = CreateFileMappingA(image->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!image->mapping) {
+        snprintf(image->error, sizeof(image->error), "Cannot map %s (error %lu)", path, GetLastError());
+        SparseImageClose(image);
+        return 0;
+    }
+
+    size_t avail = 0;
+    const unsigned char* start = MapRange(image, 0, 4, &avail);
+    image->is_sparse = start && image->file_size >= SPARSE_HEADER_SIZE && GetLE32(start) == SPARSE_HEADER_MAGIC;
+
+    int ok = start && (image->is_sparse ? MapSparseImage(image, digest)
+                                        : lazy ? MapRawRun(image) : MapRawImage(image, digest));
+    if (!ok) {
+        char error[sizeof(image->error)];
+        snprintf(error, sizeof(error), "%s", image->error);
+        SparseImageClose(image);
+        snprintf(image->error, sizeof(image->error), "%s", error);
+    }
+    return ok;
+}
+
+// Open an image and build its block map
+int SparseImageOpen(SparseImage* image, const char* path, Sha256Context* digest) {
+    return OpenImage(image, path, digest, 0);
+}
+
+// Open an image for random reads
+int SparseImageOpenLazy(SparseImage* image, const char* path) {
+    return OpenImage(image, path, NULL, 1);
+}
+
+// Release the mapping and block map
+void SparseImageClose(SparseImage* image) {
+    if (!image) return;
+    if (image->view) UnmapViewOfFile(image->view);
+    if (image->mapping) CloseHandle(image->mapping);
+    if (image->file && image->file != INVALID_HANDLE_VALUE) CloseHandle(image->file);
+    free(image->chunks);
+    image->view = NULL;
+    image->mapping = NULL;
+    image->file = INVALID_HANDLE_VALUE;
+    image->chunks = NULL;
+    image->chunk_count = 0;
+    image->chunk_capacity = 0;
+}
+
+// ============================================================================
+// Splitting
+// ============================================================================
+
+// Greedily fill each piece with whole runs, cutting RAW runs at block boundaries
+int SparseImagePlan(SparseImage* image, unsigned long long max_size, SparsePiece** pieces, int* count) {
+    if (!image || !pieces || !count) return 0;
+    *pieces = NULL;
+    *count = 0;
+
+    // A download is at most 4 GB. Every piece keeps room for the DONT_CARE run
+    // that skips the blocks after it.
+    unsigned long long limit = (max_size && max_size < 0xffffffffULL) ? max_size : 0xffffffffULL;
+    unsigned long long budget = limit - SPARSE_CHUNK_HEADER_SIZE;
+    if (limit < SPARSE_HEADER_SIZE + 3 * SPARSE_CHUNK_HEADER_SIZE) budget = 0;
+
+    int capacity = 0;
+    int index = 0;
+    unsigned int block = 0;
+    while (block < image->total_blocks) {
+        SparsePiece piece = { block, block, 0, SPARSE_HEADER_SIZE };
+        if (block > 0) {
+            piece.chunks++;
+            piece.size += SPARSE_CHUNK_HEADER_SIZE;
+        }
+
+        while (index < image->chunk_count) {
+            const SparseChunk* chunk = &image->chunks[index];
+            unsigned int left = chunk->first_block + chunk->blocks - piece.end_block;
+            unsigned long long data = 0;
+            if (chunk->type == SPARSE_CHUNK_RAW) {
+                data = (unsigned long long)left * image->block_size;
+            } else if (chunk->type == SPARSE_CHUNK_FILL) {
+                data = 4;
+            }
+
+            if (piece.size + SPARSE_CHUNK_HEADER_SIZE + data <= budget) {
+                piece.size += SPARSE_CHUNK_HEADER_SIZE + data;
+                piece.chunks++;
+                piece.end_block += left;
+                index++;
+                continue;
+            }
+            if (chunk->type == SPARSE_CHUNK_RAW &&
+                piece.size + SPARSE_CHUNK_HEADER_SIZE + image->block_size <= budget) {
+                unsigned int fit = (unsigned int)((budget - piece.size - SPARSE_CHUNK_HEADER_SIZE) / image->block_size);
+                piece.size += SPARSE_CHUNK_HEADER_SIZE + (unsigned long long)fit * image->block_size;
+                piece.chunks++;
+                piece.end_block += fit;
+            }
+            break;
+        }
+
+        if (piece.end_block == piece.first_block) {
+            snprintf(image->error, sizeof(image->error),
+                     "max-download-size (%llu bytes) cannot hold a %u-byte block", limit, image->block_size);
+            free(*pieces);
+            *pieces = NULL;
+            *count = 0;
+            return 0;
+        }
+        if (piece.end_block < image->total_blocks) {
+            piece.chunks++;
+            piece.size += SPARSE_CHUNK_HEADER_SIZE;
+        }
+
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            *pieces = (SparsePiece*)SafeRealloc(*pieces, capacity * sizeof(SparsePiece));
+        }
+        (*pieces)[(*count)++] = piece;
+        block = piece.end_block;
+    }
+    return 1;
+}
+
+// ============================================================================
+// Output
+// ============================================================================
+
+// Headers and small RAW runs coalesced into large sink calls
+typedef struct {
+    SparseSinkFn sink;
+    void* user_data;
+    unsigned char* buffer;
+    size_t fill;
+} SparseOutput;
+
+// Hand buffered bytes to the sink
+static int FlushOutput(SparseOutput* out) {
+    if (out->fill == 0) return 1;
+    int ok = out->sink(out->buffer, out->fill, out->user_data);
+    out->fill = 0;
+    return ok;
+}
+
+// Queue bytes, flushing as the buffer fills
+static int OutputBytes(SparseOutput* out, const void* data, size_t len) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    while (len > 0) {
+        if (out->fill == SPARSE_OUTPUT_BUFFER && !FlushOutput(out)) return 0;
+        size_t room = SPARSE_OUTPUT_BUFFER - out->fill;
+        size_t step = len < room ? len : room;
+        if (bytes) {
+            memcpy(out->buffer + out->fill, bytes, step);
+            bytes += step;
+        } else {
+            memset(out->buffer + out->fill, 0, step);
+        }
+        out->fill += step;
+        len -= step;
+    }
+    return 1;
+}
+
+// Queue a chunk header
+static int OutputChunkHeader(SparseOutput* out, unsigned short type, unsigned int blocks, unsigned int total_size) {
+    unsigned char header[SPARSE_CHUNK_HEADER_SIZE];
+    PutLE16(header, type);
+    PutLE16(header + 2, 0);
+    PutLE32(header + 4, blocks);
+    PutLE32(header + 8, total_size);
+    return OutputBytes(out, header, sizeof(header));
+}
+
+// Fill in a sparse file header
+static void PutSparseHeader(unsigned char* header, unsigned int block_size, unsigned int total_blocks,
+                            unsigned int chunks) {
+    PutLE32(header, SPARSE_HEADER_MAGIC);
+    PutLE16(header + 4, 1);
+    PutLE16(header + 6, 0);
+    PutLE16(header + 8, SPARSE_HEADER_SIZE);
+    PutLE16(header + 10, SPARSE_CHUNK_HEADER_SIZE);
+    PutLE32(header + 12, block_size);
+    PutLE32(header + 16, total_blocks);
+    PutLE32(header + 20, chunks);
+    PutLE32(header + 24, 0);
+}
+
+// First run reaching into or past `block`
+static int FindChunk(const SparseImage* image, unsigned int block) {
+    int low = 0, high = image->chunk_count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        const SparseChunk* chunk = &image->chunks[mid];
+        if (chunk->first_block + chunk->blocks <= block) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Send image bytes [offset, offset + len), zero-padding past the end of the file
+static int OutputImageData(SparseImage* image, SparseOutput* out, unsigned long long offset, unsigned long long len) {
+    while (len > 0 && offset < image->file_size) {
+        size_t avail = 0;
+        const unsigned char* data = MapRange(image, offset, 1, &avail);
+        if (!data) return 0;
+
+        size_t step = (size_t)(len < SPARSE_OUTPUT_BUFFER ? len : SPARSE_OUTPUT_BUFFER);
+        if (step > avail) step = avail;
+        if (step > image->file_size - offset) step = (size_t)(image->file_size - offset);
+
+        if (step >= SPARSE_DIRECT_MIN) {
+            if (!FlushOutput(out) || !out->sink(data, step, out->user_data)) return 0;
+        } else if (!OutputBytes(out, data, step)) {
+            return 0;
+        }
+        offset += step;
+        len -= step;
+    }
+    return OutputBytes(out, NULL, (size_t)len);
+}
+
+// Write one piece: header, a DONT_CARE run up to its first block, its runs, a DONT_CARE run to the end
+int SparseImageWritePiece(SparseImage* image, const SparsePiece* piece, SparseSinkFn sink, void* user_data) {
+    if (!image || !piece || !sink) return 0;
+
+    SparseOutput out = { sink, user_data, (unsigned char*)SafeMalloc(SPARSE_OUTPUT_BUFFER), 0 };
+    unsigned char header[SPARSE_HEADER_SIZE];
+    PutSparseHeader(header, image->block_size, image->total_blocks, piece->chunks);
+    int ok = OutputBytes(&out, header, sizeof(header));
+
+    if (ok && piece->first_block > 0) {
+        ok = OutputChunkHeader(&out, SPARSE_CHUNK_DONT_CARE, piece->first_block, SPARSE_CHUNK_HEADER_SIZE);
+    }
+
+    for (int i = FindChunk(image, piece->first_block); ok && i < image->chunk_count && image->chunks[i].first_block < piece->end_block; i++) {
+        const SparseChunk* chunk = &image->chunks[i];
+        unsigned int start = chunk->first_block > piece->first_block ? chunk->first_block : piece->first_block;
+        unsigned int end = chunk->first_block + chunk->blocks;
+        if (end > piece->end_block) end = piece->end_block;
+        unsigned int blocks = end - start;
+
+        if (chunk->type == SPARSE_CHUNK_RAW) {
+            unsigned long long data = (unsigned long long)blocks * image->block_size;
+            unsigned long long offset = chunk->offset + (unsigned long long)(start - chunk->first_block) * image->block_size;
+            ok = OutputChunkHeader(&out, SPARSE_CHUNK_RAW, blocks, (unsigned int)(SPARSE_CHUNK_HEADER_SIZE + data)) &&
+                 OutputImageData(image, &out, offset, data);
+        } else if (chunk->type == SPARSE_CHUNK_FILL) {
+            unsigned char fill[4];
+            PutLE32(fill, chunk->fill);
+            ok = OutputChunkHeader(&out, SPARSE_CHUNK_FILL, blocks, SPARSE_CHUNK_HEADER_SIZE + 4) &&
+                 OutputBytes(&out, fill, sizeof(fill));
+        } else {
+            ok = OutputChunkHeader(&out, SPARSE_CHUNK_DONT_CARE, blocks, SPARSE_CHUNK_HEADER_SIZE);
+        }
+    }
+
+    if (ok && piece->end_block < image->total_blocks) {
+        ok = OutputChunkHeader(&out, SPARSE_CHUNK_DONT_CARE, image->total_blocks - piece->end_block,
+                               SPARSE_CHUNK_HEADER_SIZE);
+    }
+    if (ok) ok = FlushOutput(&out);
+
+    free(out.buffer);
+    return ok;
+}
+
+// Write the file as it is
+int SparseImageWriteFile(SparseImage* image, SparseSinkFn sink, void* user_data) {
+    if (!image || !sink) return 0;
+
+    SparseOutput out = { sink, user_data, (unsigned char*)SafeMalloc(SPARSE_OUTPUT_BUFFER), 0 };
+    int ok = OutputImageData(image, &out, 0, image->file_size) && FlushOutput(&out);
+    free(out.buffer);
+    return ok;
+}
+
+// ============================================================================
+// Expanded reads
+// ============================================================================
+
+// FILL and DONT_CARE runs are sent from a buffer holding their pattern
+typedef struct {
+    SparseSinkFn sink;
+    void* user_data;
+    unsigned char* pattern;             // SPARSE_OUTPUT_BUFFER + 4 bytes of the word
+    unsigned int fill;
+} SparseExpand;
+
+// Send len bytes of a repeated word; offset gives the phase within the word
+static int ExpandFill(SparseExpand* expand, unsigned int fill, unsigned long long offset, unsigned long long len) {
+    if (!expand->pattern || expand->fill != fill) {
+        if (!expand->pattern) expand->pattern = (unsigned char*)SafeMalloc(SPARSE_OUTPUT_BUFFER + 4);
+        for (size_t i = 0; i < SPARSE_OUTPUT_BUFFER + 4; i += 4) memcpy(expand->pattern + i, &fill, 4);
+        expand->fill = fill;
+    }
+    unsigned int phase = (unsigned int)(offset % 4);
+    while (len > 0) {
+        size_t step = (size_t)(len < SPARSE_OUTPUT_BUFFER ? len : SPARSE_OUTPUT_BUFFER);
+        if (!expand->sink(expand->pattern + phase, step, expand->user_data)) return 0;
+        phase = (unsigned int)((phase + step) % 4);
+        len -= step;
+    }
+    return 1;
+}
+
+// Walk the runs covering [offset, offset + len); RAW data goes to the sink
+// straight from the mapping, a view at a time
+int SparseImageReadRange(SparseImage* image, unsigned long long offset, unsigned long long len, SparseSinkFn sink,
+                         void* user_data) {
+    if (!image || !sink) return 0;
+    unsigned long long end = offset + len;
+    if (end < offset || end > (unsigned long long)image->total_blocks * image->block_size) {
+        snprintf(image->error, sizeof(image->error), "Read past the end of the image");
+        return 0;
+    }
+
+    SparseExpand expand = { sink, user_data, NULL, 0 };
+    int ok = 1;
+    int i = FindChunk(image, (unsigned int)(offset / image->block_size));
+    while (ok && offset < end) {
+        if (i >= image->chunk_count) {
+            snprintf(image->error, sizeof(image->error), "Image has no data at offset %llu", offset);
+            ok = 0;
+            break;
+        }
+        const SparseChunk* chunk = &image->chunks[i];
+        unsigned long long chunk_start = (unsigned long long)chunk->first_block * image->block_size;
+        unsigned long long chunk_end = chunk_start + (unsigned long long)chunk->blocks * image->block_size;
+        if (offset >= chunk_end) {
+            i++;
+            continue;
+        }
+        unsigned long long step = (chunk_end < end ? chunk_end : end) - offset;
+
+        if (chunk->type == SPARSE_CHUNK_RAW) {
+            // The last block of a raw file can end short of the block size
+            unsigned long long at = chunk->offset + (offset - chunk_start);
+            unsigned long long left = step;
+            while (ok && left > 0 && at < image->file_size) {
+                size_t avail = 0;
+                const unsigned char* data = MapRange(image, at, 1, &avail);
+                if (!data) {
+                    ok = 0;
+                    break;
+                }
+                size_t piece = (size_t)(left < avail ? left : avail);
+                if (piece > image->file_size - at) piece = (size_t)(image->file_size - at);
+                ok = sink(data, piece, user_data);
+                at += piece;
+                left -= piece;
+            }
+            if (ok && left > 0) ok = ExpandFill(&expand, 0, 0, left);
+        } else {
+            ok = ExpandFill(&expand, chunk->type == SPARSE_CHUNK_FILL ? chunk->fill : 0, offset, step);
+        }
+        offset += step;
+    }
+
+    free(expand.pattern);
+    return ok;
+}
+
+// Copy sink for SparseImageRead
+static int CopyToBuffer(const void* data, size_t len, void* user_data) {
+    unsigned char** at = (unsigned char**)user_data;
+    memcpy(*at, data, len);
+    *at += len;
+    return 1;
+}
+
+// Read expanded image bytes into a buffer
+int SparseImageRead(SparseImage* image, unsigned long long offset, void* buffer, size_t len) {
+    unsigned char* at = (unsigned char*)buffer;
+    return SparseImageReadRange(image, offset, len, CopyToBuffer, &at);
+}
+
+// ============================================================================
+// Streaming packer
+// ============================================================================
+
+// What the packer expects next from its input
+enum {
+    STREAM_DETECT,                      // First bytes: sparse magic or not
+    STREAM_RAW,                         // Blocks of a raw image
+    STREAM_HEADER,                      // Sparse file header
+    STREAM_CHUNK_HEADER,
+    STREAM_CHUNK_RAW,                   // Blocks of a RAW chunk
+    STREAM_CHUNK_FILL,                  // Value of a FILL chunk
+    STREAM_DONE                         // Every chunk read; anything after is ignored
+};
+
+// Record the first failure
+static int StreamFail(SparseStream* stream, const char* message) {
+    if (!stream->failed) snprintf(stream->error, sizeof(stream->error), "%s", message);
+    stream->failed = 1;
+    return 0;
+}
+
+// Finish the growing run: its header goes in front of the data already behind it
+static void CloseStreamChunk(SparseStream* stream) {
+    if (!stream->chunk_open) return;
+
+    unsigned long long data = 0;
+    if (stream->chunk_type == SPARSE_CHUNK_RAW) {
+        data = (unsigned long long)stream->chunk_blocks * stream->block_size;
+    } else if (stream->chunk_type == SPARSE_CHUNK_FILL) {
+        data = 4;
+    }
+    unsigned char* header = stream->buffer + stream->chunk_at;
+    PutLE16(header, stream->chunk_type);
+    PutLE16(header + 2, 0);
+    PutLE32(header + 4, stream->chunk_blocks);
+    PutLE32(header + 8, (unsigned int)(SPARSE_CHUNK_HEADER_SIZE + data));
+    stream->chunk_open = 0;
+    stream->buffer_chunks++;
+    stream->total_chunks++;
+}
+
+// Begin a run at the end of the buffer; its header is written when it closes
+static void OpenStreamChunk(SparseStream* stream, unsigned short type, unsigned int fill) {
+    stream->chunk_open = 1;
+    stream->chunk_at = stream->used;
+    stream->chunk_type = type;
+    stream->chunk_blocks = 0;
+    stream->chunk_fill = fill;
+    stream->used += SPARSE_CHUNK_HEADER_SIZE;
+    if (type == SPARSE_CHUNK_FILL) {
+        PutLE32(stream->buffer + stream->used, fill);
+        stream->used += 4;
+    }
+}
+
+// Set up a fresh buffer; split pieces open with a header and a DONT_CARE run up to their data
+static void StartStreamBuffer(SparseStream* stream) {
+    stream->used = 0;
+    stream->buffer_chunks = 0;
+    stream->buffer_has_data = 0;
+    if (stream->split || stream->buffers_sent == 0) stream->used = SPARSE_HEADER_SIZE;
+    if (stream->split && stream->block > 0) {
+        OpenStreamChunk(stream, SPARSE_CHUNK_DONT_CARE, 0);
+        stream->chunk_blocks = stream->block;
+    }
+}
+
+// Hand the buffer on and continue in the next one
+static int EmitStreamBuffer(SparseStream* stream) {
+    CloseStreamChunk(stream);
+    if (stream->split) PutSparseHeader(stream->buffer, stream->block_size, stream->block, stream->buffer_chunks);
+
+    unsigned char* next = stream->ready(stream->buffer, stream->used, stream->block, stream->user_data);
+    if (!next) return StreamFail(stream, "Cancelled");
+    stream->buffer = next;
+    stream->buffers_sent++;
+    StartStreamBuffer(stream);
+    return 1;
+}
+
+// True if the open run can take more blocks of this kind
+static int StreamRunContinues(const SparseStream* stream, unsigned short type, unsigned int fill) {
+    return stream->chunk_open && stream->chunk_type == type &&
+           (type != SPARSE_CHUNK_FILL || stream->chunk_fill == fill);
+}
+
+// Make the open run one of this kind with room for data_size more bytes,
+// moving to the next buffer if this one is full
+static int BeginStreamRun(SparseStream* stream, unsigned short type, unsigned int fill, size_t data_size) {
+    if (StreamRunContinues(stream, type, fill) && stream->used + data_size <= stream->capacity) return 1;
+
+    CloseStreamChunk(stream);
+    if (stream->used + SPARSE_CHUNK_HEADER_SIZE + 4 + data_size > stream->capacity && !EmitStreamBuffer(stream)) {
+        return 0;
+    }
+    if (StreamRunContinues(stream, type, fill)) return 1;
+
+    CloseStreamChunk(stream);
+    OpenStreamChunk(stream, type, fill);
+    if (type != SPARSE_CHUNK_DONT_CARE) stream->buffer_has_data = 1;
+    return 1;
+}
+
+// Append blocks of one FILL value, or DONT_CARE blocks
+static int AddStreamRun(SparseStream* stream, unsigned short type, unsigned int blocks, unsigned int fill) {
+    if (blocks == 0) return 1;
+    if (blocks > 0xffffffffu - stream->block) return StreamFail(stream, "Image is too large");
+    if (!BeginStreamRun(stream, type, fill, 0)) return 0;
+    stream->chunk_blocks += blocks;
+    stream->block += blocks;
+    return 1;
+}
+
+// Append one block of data: a FILL run when it repeats one word, RAW otherwise
+static int AddStreamBlock(SparseStream* stream, const unsigned char* data) {
+    unsigned int fill;
+    if (stream->block_size % 64 == 0 && IsFillBlock(data, stream->block_size, &fill)) {
+        return AddStreamRun(stream, SPARSE_CHUNK_FILL, 1, fill);
+    }
+    if (stream->block == 0xffffffffu) return StreamFail(stream, "Image is too large");
+    if (!BeginStreamRun(stream, SPARSE_CHUNK_RAW, 0, stream->block_size)) return 0;
+
+    memcpy(stream->buffer + stream->used, data, stream->block_size);
+    stream->used += stream->block_size;
+    stream->chunk_blocks++;
+    stream->block++;
+    return 1;
+}
+
+// Expect the next chunk header of sparse input, if any are left
+static void NextStreamChunk(SparseStream* stream) {
+    stream->input_state = stream->input_chunks_left > 0 ? STREAM_CHUNK_HEADER : STREAM_DONE;
+    stream->pending_need = SPARSE_CHUNK_HEADER_SIZE;
+}
+
+// Sparse input: file header
+static int ParseStreamHeader(SparseStream* stream, const unsigned char* header) {
+    unsigned int major = GetLE16(header + 4);
+    unsigned int header_size = GetLE16(header + 8);
+    unsigned int chunk_header_size = GetLE16(header + 10);
+    unsigned int block_size = GetLE32(header + 12);
+    if (major != 1 || header_size < SPARSE_HEADER_SIZE || chunk_header_size < SPARSE_CHUNK_HEADER_SIZE ||
+        block_size == 0 || block_size % 4 != 0) {
+        return StreamFail(stream, "Unsupported sparse image header");
+    }
+    // A piece must hold its header, the leading DONT_CARE run and one RAW block
+    if (block_size > stream->capacity - SPARSE_HEADER_SIZE - 3 * SPARSE_CHUNK_HEADER_SIZE - 4) {
+        return StreamFail(stream, "Sparse image block size is too large");
+    }
+
+    stream->input_total_blocks = GetLE32(header + 16);
+    stream->input_chunks_left = GetLE32(header + 20);
+    stream->chunk_header_size = chunk_header_size;
+    stream->skip = header_size - SPARSE_HEADER_SIZE;
+    if (block_size > stream->block_size) {
+        stream->pending = (unsigned char*)SafeRealloc(stream->pending, block_size);
+    }
+    stream->block_size = block_size;
+    NextStreamChunk(stream);
+    return 1;
+}
+
+// Sparse input: chunk header
+static int ParseStreamChunk(SparseStream* stream, const unsigned char* chunk) {
+    unsigned short type = (unsigned short)GetLE16(chunk);
+    unsigned int blocks = GetLE32(chunk + 4);
+    unsigned long long total_size = GetLE32(chunk + 8);
+    unsigned long long data_size = total_size - stream->chunk_header_size;
+    stream->input_chunks_left--;
+    stream->skip = stream->chunk_header_size - SPARSE_CHUNK_HEADER_SIZE;
+
+    int valid = total_size >= stream->chunk_header_size && blocks <= stream->input_total_blocks - stream->block;
+    if (type == SPARSE_CHUNK_RAW) {
+        valid = valid && data_size == (unsigned long long)blocks * stream->block_size;
+    } else if (type == SPARSE_CHUNK_FILL || type == SPARSE_CHUNK_CRC32) {
+        valid = valid && data_size == 4;
+    } else if (type == SPARSE_CHUNK_DONT_CARE) {
+        valid = valid && data_size == 0;
+    } else {
+        valid = 0;
+    }
+    if (!valid) return StreamFail(stream, "Corrupt sparse image");
+
+    if (type == SPARSE_CHUNK_RAW && blocks > 0) {
+        stream->input_state = STREAM_CHUNK_RAW;
+        stream->input_blocks_left = blocks;
+        stream->pending_need = stream->block_size;
+    } else if (type == SPARSE_CHUNK_FILL) {
+        stream->input_state = STREAM_CHUNK_FILL;
+        stream->input_blocks_left = blocks;
+        stream->pending_need = 4;
+    } else {
+        // CRC32 chunks check the input file only; the output gets none
+        if (type == SPARSE_CHUNK_CRC32) stream->skip += 4;
+        if (!AddStreamRun(stream, SPARSE_CHUNK_DONT_CARE, type == SPARSE_CHUNK_DONT_CARE ? blocks : 0, 0)) return 0;
+        NextStreamChunk(stream);
+    }
+    return 1;
+}
+
+// Act on one complete unit of input: a header, a fill value or a block
+static int ProcessStreamInput(SparseStream* stream, const unsigned char* data) {
+    switch (stream->input_state) {
+        case STREAM_RAW:
+            return AddStreamBlock(stream, data);
+        case STREAM_HEADER:
+            return ParseStreamHeader(stream, data);
+        case STREAM_CHUNK_HEADER:
+            return ParseStreamChunk(stream, data);
+        case STREAM_CHUNK_RAW:
+            if (!AddStreamBlock(stream, data)) return 0;
+            if (--stream->input_blocks_left == 0) NextStreamChunk(stream);
+            return 1;
+        case STREAM_CHUNK_FILL:
+            if (!AddStreamRun(stream, SPARSE_CHUNK_FILL, stream->input_blocks_left, GetLE32(data))) return 0;
+            NextStreamChunk(stream);
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+// Start a packer
+void SparseStreamInit(SparseStream* stream, unsigned char* buffer, size_t capacity, int split,
+                      SparseBufferFn ready, void* user_data) {
+    memset(stream, 0, sizeof(*stream));
+    stream->ready = ready;
+    stream->user_data = user_data;
+    stream->split = split;
+    stream->buffer = buffer;
+    stream->capacity = capacity;
+    stream->block_size = SPARSE_DEFAULT_BLOCK_SIZE;
+    stream->input_state = STREAM_DETECT;
+    stream->pending = (unsigned char*)SafeMalloc(SPARSE_DEFAULT_BLOCK_SIZE);
+    stream->pending_need = 4;
+    StartStreamBuffer(stream);
+}
+
+// Feed input, completing headers and blocks in the pending buffer when they straddle calls
+int SparseStreamWrite(const void* data, size_t len, void* user_data) {
+    SparseStream* stream = (SparseStream*)user_data;
+    const unsigned char* bytes = (const unsigned char*)data;
+    stream->input_bytes += len;
+
+    while (len > 0 && !stream->failed && stream->input_state != STREAM_DONE) {
+        if (stream->skip > 0) {
+            size_t step = stream->skip < len ? (size_t)stream->skip : len;
+            stream->skip -= step;
+            bytes += step;
+            len -= step;
+            continue;
+        }
+
+        // Whole blocks are taken straight from the caller's data
+        int blocks = stream->input_state == STREAM_RAW || stream->input_state == STREAM_CHUNK_RAW;
+        if (blocks && stream->pending_len == 0 && len >= stream->block_size) {
+            ProcessStreamInput(stream, bytes);
+            bytes += stream->block_size;
+            len -= stream->block_size;
+            continue;
+        }
+
+        size_t step = stream->pending_need - stream->pending_len;
+        if (step > len) step = len;
+        memcpy(stream->pending + stream->pending_len, bytes, step);
+        stream->pending_len += step;
+        bytes += step;
+        len -= step;
+        if (stream->pending_len < stream->pending_need) break;
+
+        if (stream->input_state == STREAM_DETECT) {
+            // The bytes stay pending as the start of the header or first block
+            int sparse = GetLE32(stream->pending) == SPARSE_HEADER_MAGIC;
+            stream->input_state = sparse ? STREAM_HEADER : STREAM_RAW;
+            stream->pending_need = sparse ? SPARSE_HEADER_SIZE : stream->block_size;
+            continue;
+        }
+        stream->pending_len = 0;
+        ProcessStreamInput(stream, stream->pending);
+    }
+    return !stream->failed;
+}
+
+// Complete the output with whatever input is pending
+int SparseStreamFinish(SparseStream* stream) {
+    if (stream->failed) return 0;
+
+    if (stream->input_state == STREAM_DETECT || stream->input_state == STREAM_RAW) {
+        if (stream->input_bytes == 0) return StreamFail(stream, "Image is empty");
+        // A partial last block is padded with zeros
+        if (stream->pending_len > 0) {
+            memset(stream->pending + stream->pending_len, 0, stream->block_size - stream->pending_len);
+            stream->pending_len = 0;
+            if (!AddStreamBlock(stream, stream->pending)) return 0;
+        }
+    } else if (stream->input_state != STREAM_DONE || stream->skip > 0) {
+        return StreamFail(stream, "Sparse image is truncated");
+    } else if (!AddStreamRun(stream, SPARSE_CHUNK_DONT_CARE, stream->input_total_blocks - stream->block, 0)) {
+        return 0;
+    }
+
+    // A split piece with nothing but DONT_CARE runs would change nothing on the device
+    if (stream->split && !stream->buffer_has_data && stream->buffers_sent > 0) return 1;
+    return EmitStreamBuffer(stream);
+}
+
+// Header describing everything written, for continuous output
+void SparseStreamHeader(const SparseStream* stream, unsigned char header[SPARSE_HEADER_SIZE]) {
+    PutSparseHeader(header, stream->block_size, stream->block, stream->total_chunks);
+}
+
+// Release scratch memory
+void SparseStreamFree(SparseStream* stream) {
+    if (!stream) return;
+    free(stream->pending);
+    stream->pending = NULL;
+}
@@ -0,0 +1,480 @@
+#include "super_image.h"
+#include "sha256.h"
+#include "utils.h"
+
+// Geometry copies sit after the reserved bytes; metadata slots follow them,
+// primaries first, then their backups
+#define LP_GEOMETRY_OFFSET LP_PARTITION_RESERVED_BYTES
+#define LP_METADATA_OFFSET (LP_PARTITION_RESERVED_BYTES + 2 * LP_METADATA_GEOMETRY_SIZE)
+
+// On-disk sizes (liblp metadata_format.h)
+#define LP_GEOMETRY_STRUCT_SIZE 52
+#define LP_HEADER_V1_0_SIZE 128
+#define LP_HEADER_V1_2_SIZE 256
+#define LP_PARTITION_ENTRY_SIZE 52
+#define LP_EXTENT_ENTRY_SIZE 24
+#define LP_GROUP_ENTRY_SIZE 48
+#define LP_BLOCK_DEVICE_ENTRY_SIZE 64
+#define LP_NAME_SIZE 36
+
+// Zeros handed to sinks for ZERO extents
+#define SUPER_ZERO_CHUNK (256 * 1024)
+
+static const unsigned char g_zero_chunk[SUPER_ZERO_CHUNK];
+
+// Read a little-endian value
+static unsigned int GetLE16(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+// Read a little-endian value
+static unsigned int GetLE32(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Read a little-endian value
+static unsigned long long GetLE64(const unsigned char* p) {
+    return (unsigned long long)GetLE32(p) | ((unsigned long long)GetLE32(p + 4) << 32);
+}
+
+// Whether the SHA-256 of data, with its checksum field zeroed, matches that field
+static int ChecksumMatches(unsigned char* data, size_t size, size_t checksum_offset) {
+    unsigned char expected[SHA256_DIGEST_SIZE];
+    unsigned char actual[SHA256_DIGEST_SIZE];
+    memcpy(expected, data + checksum_offset, sizeof(expected));
+    memset(data + checksum_offset, 0, sizeof(expected));
+
+    Sha256Context ctx;
+    Sha256Init(&ctx);
+    Sha256Update(&ctx, data, size);
+    Sha256Final(&ctx, actual);
+    memcpy(data + checksum_offset, expected, sizeof(expected));
+    return memcmp(expected, actual, sizeof(expected)) == 0;
+}
+
+// Copy a fixed-size, possibly unterminated name
+static void CopyName(char* dest, size_t dest_size, const unsigned char* name) {
+    size_t len = 0;
+    while (len < LP_NAME_SIZE && name[len]) len++;
+    if (len >= dest_size) len = dest_size - 1;
+    memcpy(dest, name, len);
+    dest[len] = '\0';
+}
+
+// ============================================================================
+// Metadata
+// ============================================================================
+
+// Table descriptor of the metadata header
+typedef struct {
+    unsigned int offset;
+    unsigned int count;
+    unsigned int entry_size;
+} LpTable;
+
+// Read and check one table descriptor against the tables blob
+static int ReadTable(const unsigned char* header, size_t at, unsigned int min_entry_size, unsigned int tables_size,
+                     LpTable* table) {
+    table->offset = GetLE32(header + at);
+    table->count = GetLE32(header + at + 4);
+    table->entry_size = GetLE32(header + at + 8);
+    if (table->count == 0) return 1;
+    return table->entry_size >= min_entry_size && table->offset <= tables_size &&
+           (unsigned long long)table->count * table->entry_size <= tables_size - table->offset;
+}
+
+// Read the geometry from its primary copy, else the backup
+static int ReadGeometry(SuperImage* super) {
+    unsigned char geometry[LP_METADATA_GEOMETRY_SIZE];
+    for (int copy = 0; copy < 2; copy++) {
+        unsigned long long offset = LP_GEOMETRY_OFFSET + (unsigned long long)copy * LP_METADATA_GEOMETRY_SIZE;
+        if (!SparseImageRead(&super->image, offset, geometry, sizeof(geometry))) break;
+
+        unsigned int struct_size = GetLE32(geometry + 4);
+        if (GetLE32(geometry) != LP_GEOMETRY_MAGIC || struct_size < LP_GEOMETRY_STRUCT_SIZE ||
+            struct_size > sizeof(geometry) || !ChecksumMatches(geometry, struct_size, 8)) {
+            continue;
+        }
+        super->metadata_max_size = GetLE32(geometry + 40);
+        super->metadata_slots = GetLE32(geometry + 44);
+        super->logical_block_size = GetLE32(geometry + 48);
+        if (super->metadata_max_size < LP_HEADER_V1_0_SIZE || super->metadata_max_size % LP_SECTOR_SIZE != 0 ||
+            super->metadata_slots == 0 || super->logical_block_size == 0) {
+            continue;
+        }
+        return 1;
+    }
+    snprintf(super->error, sizeof(super->error), "No valid liblp geometry (not a super image?)");
+    return 0;
+}
+
+// Turn the checked tables into partitions and extents
+static int ParseTables(SuperImage* super, const unsigned char* header, const unsigned char* tables,
+                       unsigned int tables_size) {
+    LpTable partitions, extents, groups, devices;
+    if (!ReadTable(header, 80, LP_PARTITION_ENTRY_SIZE, tables_size, &partitions) ||
+        !ReadTable(header, 92, LP_EXTENT_ENTRY_SIZE, tables_size, &extents) ||
+        !ReadTable(header, 104, LP_GROUP_ENTRY_SIZE, tables_size, &groups) ||
+        !ReadTable(header, 116, LP_BLOCK_DEVICE_ENTRY_SIZE, tables_size, &devices) || devices.count == 0) {
+        snprintf(super->error, sizeof(super->error), "Corrupt liblp metadata tables");
+        return 0;
+    }
+    super->device_size = GetLE64(tables + devices.offset + 16);
+
+    if (extents.count > 0) super->extents = (SuperExtent*)SafeCalloc(extents.count, sizeof(SuperExtent));
+    for (unsigned int i = 0; i < extents.count; i++) {
+        const unsigned char* entry = tables + extents.offset + (size_t)i * extents.entry_size;
+        SuperExtent* extent = &super->extents[i];
+        extent->length = GetLE64(entry) * LP_SECTOR_SIZE;
+        extent->is_zero = GetLE32(entry + 8) == LP_TARGET_TYPE_ZERO;
+        extent->offset = GetLE64(entry + 12) * LP_SECTOR_SIZE;
+        if (!extent->is_zero && GetLE32(entry + 8) != LP_TARGET_TYPE_LINEAR) {
+            snprintf(super->error, sizeof(super->error), "Unknown liblp extent type %u", GetLE32(entry + 8));
+            return 0;
+        }
+    }
+    super->extent_count = (int)extents.count;
+
+    if (partitions.count > 0) super->partitions = (SuperPartition*)SafeCalloc(partitions.count, sizeof(SuperPartition));
+    for (unsigned int i = 0; i < partitions.count; i++) {
+        const unsigned char* entry = tables + partitions.offset + (size_t)i * partitions.entry_size;
+        SuperPartition* partition = &super->partitions[i];
+        CopyName(partition->name, sizeof(partition->name), entry);
+        partition->attributes = GetLE32(entry + 36);
+        unsigned int first = GetLE32(entry + 40);
+        unsigned int count = GetLE32(entry + 44);
+        unsigned int group = GetLE32(entry + 48);
+        if (first > extents.count || count > extents.count - first || (groups.count > 0 && group >= groups.count)) {
+            snprintf(super->error, sizeof(super->error), "Corrupt liblp entry for partition %s", partition->name);
+            return 0;
+        }
+        if (groups.count > 0) {
+            CopyName(partition->group, sizeof(partition->group), tables + groups.offset + (size_t)group * groups.entry_size);
+        }
+        partition->first_extent = (int)first;
+        partition->extent_count = (int)count;
+        for (unsigned int j = first; j < first + count; j++) {
+            const unsigned char* extent = tables + extents.offset + (size_t)j * extents.entry_size;
+            partition->size += super->extents[j].length;
+            if (!super->extents[j].is_zero && GetLE32(extent + 20) != 0) partition->foreign = 1;
+        }
+    }
+    super->count = (int)partitions.count;
+    return 1;
+}
+
+// Read slot 0's metadata from its primary copy, else the backup
+static int ReadMetadata(SuperImage* super) {
+    unsigned char header[LP_HEADER_V1_2_SIZE];
+    unsigned long long slots_size = (unsigned long long)super->metadata_slots * super->metadata_max_size;
+    char reason[128] = "not found";
+
+    for (int copy = 0; copy < 2; copy++) {
+        unsigned long long offset = LP_METADATA_OFFSET + (copy ? slots_size : 0);
+        if (!SparseImageRead(&super->image, offset, header, LP_HEADER_V1_0_SIZE)) {
+            snprintf(reason, sizeof(reason), "%s", super->image.error);
+            continue;
+        }
+
+        unsigned int header_size = GetLE32(header + 8);
+        unsigned int tables_size = GetLE32(header + 44);
+        if (GetLE32(header) != LP_METADATA_HEADER_MAGIC) continue;
+        if (GetLE16(header + 4) != LP_METADATA_MAJOR_VERSION) {
+            snprintf(reason, sizeof(reason), "unsupported version %u.%u", GetLE16(header + 4), GetLE16(header + 6));
+            continue;
+        }
+        if ((header_size != LP_HEADER_V1_0_SIZE && header_size != LP_HEADER_V1_2_SIZE) ||
+            header_size > super->metadata_max_size || tables_size > super->metadata_max_size - header_size) {
+            snprintf(reason, sizeof(reason), "bad header or table size");
+            continue;
+        }
+        if (header_size > LP_HEADER_V1_0_SIZE &&
+            !SparseImageRead(&super->image, offset + LP_HEADER_V1_0_SIZE, header + LP_HEADER_V1_0_SIZE,
+                             header_size - LP_HEADER_V1_0_SIZE)) {
+            continue;
+        }
+        if (!ChecksumMatches(header, header_size, 12)) {
+            snprintf(reason, sizeof(reason), "header checksum mismatch");
+            continue;
+        }
+
+        unsigned char* tables = (unsigned char*)SafeMalloc(tables_size ? tables_size : 1);
+        int ok = SparseImageRead(&super->image, offset + header_size, tables, tables_size);
+        if (ok) {
+            Sha256Context ctx;
+            unsigned char digest[SHA256_DIGEST_SIZE];
+            Sha256Init(&ctx);
+            Sha256Update(&ctx, tables, tables_size);
+            Sha256Final(&ctx, digest);
+            ok = memcmp(digest, header + 48, sizeof(digest)) == 0;
+            if (!ok) snprintf(reason, sizeof(reason), "table checksum mismatch");
+        }
+        if (ok) {
+            super->major = GetLE16(header + 4);
+            super->minor = GetLE16(header + 6);
+            ok = ParseTables(super, header, tables, tables_size);
+            free(tables);
+            return ok;
+        }
+        free(tables);
+    }
+    snprintf(super->error, sizeof(super->error), "No valid liblp metadata (%s)", reason);
+    return 0;
+}
+
+// ============================================================================
+// Opening
+// ============================================================================
+
+// Map the image lazily and parse its geometry and metadata
+int SuperImageOpen(SuperImage* super, const char* path) {
+    if (!super || !path) return 0;
+    memset(super, 0, sizeof(*super));
+
+    if (!SparseImageOpenLazy(&super->image, path)) {
+        snprintf(super->error, sizeof(super->error), "%s", super->image.error);
+        return 0;
+    }
+    if (!ReadGeometry(super) || !ReadMetadata(super)) {
+        char error[sizeof(super->error)];
+        snprintf(error, sizeof(error), "%s", super->error);
+        SuperImageClose(super);
+        snprintf(super->error, sizeof(super->error), "%s", error);
+        return 0;
+    }
+    return 1;
+}
+
+// Release the mapping and the parsed metadata
+void SuperImageClose(SuperImage* super) {
+    if (!super) return;
+    SparseImageClose(&super->image);
+    free(super->partitions);
+    free(super->extents);
+    super->partitions = NULL;
+    super->count = 0;
+    super->extents = NULL;
+    super->extent_count = 0;
+}
+
+// Look for the geometry magic, expanding a sparse file's first chunks as needed
+int SuperImageIsSuperFile(const char* path) {
+    SparseImage image;
+    if (!SparseImageOpenLazy(&image, path)) return 0;
+    unsigned char magic[4];
+    int found = SparseImageRead(&image, LP_GEOMETRY_OFFSET, magic, sizeof(magic)) &&
+                GetLE32(magic) == LP_GEOMETRY_MAGIC;
+    SparseImageClose(&image);
+    return found;
+}
+
+// Exact name first, then with a slot suffix added (a non-empty one first) or removed
+const SuperPartition* SuperImageFindPartition(const SuperImage* super, const char* name) {
+    if (!super || !name) return NULL;
+    for (int i = 0; i < super->count; i++) {
+        if (_stricmp(super->partitions[i].name, name) == 0) return &super->partitions[i];
+    }
+
+    size_t len = strlen(name);
+    const SuperPartition* suffixed = NULL;
+    for (int i = 0; i < super->count; i++) {
+        const char* candidate = super->partitions[i].name;
+        if (strlen(candidate) == len + 2 && _strnicmp(candidate, name, len) == 0 &&
+            (_stricmp(candidate + len, "_a") == 0 || _stricmp(candidate + len, "_b") == 0)) {
+            if (super->partitions[i].size > 0) return &super->partitions[i];
+            if (!suffixed) suffixed = &super->partitions[i];
+        }
+    }
+    if (suffixed) return suffixed;
+
+    for (int i = 0; i < super->count; i++) {
+        const char* candidate = super->partitions[i].name;
+        size_t candidate_len = strlen(candidate);
+        if (len > 2 && candidate_len == len - 2 && (_stricmp(name + len - 2, "_a") == 0 || _stricmp(name + len - 2, "_b") == 0) &&
+            _strnicmp(candidate, name, candidate_len) == 0) {
+            return &super->partitions[i];
+        }
+    }
+    return NULL;
+}
+
+// ============================================================================
+// Reading
+// ============================================================================
+
+// Extents on other block devices live outside this image
+static int CheckReadable(SuperImage* super, const SuperPartition* partition) {
+    if (!partition->foreign) return 1;
+    snprintf(super->error, sizeof(super->error), "%s has extents on another block device", partition->name);
+    return 0;
+}
+
+// Walk the extents covering [offset, offset + len)
+int SuperImageRead(SuperImage* super, const SuperPartition* partition, unsigned long long offset, void* buffer,
+                   size_t len) {
+    if (!super || !partition || !buffer || !CheckReadable(super, partition)) return 0;
+    if (offset > partition->size || len > partition->size - offset) {
+        snprintf(super->error, sizeof(super->error), "Read past the end of %s", partition->name);
+        return 0;
+    }
+
+    unsigned char* out = (unsigned char*)buffer;
+    unsigned long long start = 0;
+    for (int i = 0; i < partition->extent_count && len > 0; i++) {
+        const SuperExtent* extent = &super->extents[partition->first_extent + i];
+        unsigned long long end = start + extent->length;
+        if (offset < end) {
+            unsigned long long within = offset - start;
+            size_t step = (size_t)(extent->length - within < len ? extent->length - within : len);
+            if (extent->is_zero) {
+                memset(out, 0, step);
+            } else if (!SparseImageRead(&super->image, extent->offset + within, out, step)) {
+                snprintf(super->error, sizeof(super->error), "%s: %s", partition->name, super->image.error);
+                return 0;
+            }
+            out += step;
+            offset += step;
+            len -= step;
+        }
+        start = end;
+    }
+    return 1;
+}
+
+// Where partition bytes go, and how far they got
+typedef struct {
+    DecompressWriteFn write;
+    void* write_data;
+    unsigned long long* position;
+} SuperSink;
+
+// SparseSinkFn: pass bytes on and advance the position
+static int WriteToSink(const void* data, size_t len, void* user_data) {
+    SuperSink* sink = (SuperSink*)user_data;
+    if (!sink->write(data, len, sink->write_data)) return 0;
+    *sink->position += len;
+    return 1;
+}
+
+// LINEAR extents come straight from the mapping, ZERO extents as zeros
+int SuperImageStreamPartition(SuperImage* super, const SuperPartition* partition, DecompressWriteFn write,
+                              void* write_data, unsigned long long* position) {
+    if (!super || !partition || !write || !position || !CheckReadable(super, partition)) return 0;
+
+    SuperSink sink = { write, write_data, position };
+    for (int i = 0; i < partition->extent_count; i++) {
+        const SuperExtent* extent = &super->extents[partition->first_extent + i];
+        if (!extent->is_zero) {
+            super->image.error[0] = '\0';
+            if (!SparseImageReadRange(&super->image, extent->offset, extent->length, WriteToSink, &sink)) {
+                snprintf(super->error, sizeof(super->error), "%s: %s", partition->name,
+                         super->image.error[0] ? super->image.error : "write failed");
+                return 0;
+            }
+            continue;
+        }
+        for (unsigned long long left = extent->length; left > 0;) {
+            size_t chunk = left < SUPER_ZERO_CHUNK ? (size_t)left : SUPER_ZERO_CHUNK;
+            if (!WriteToSink(g_zero_chunk, chunk, &sink)) {
+                snprintf(super->error, sizeof(super->error), "%s: write failed", partition->name);
+                return 0;
+            }
+            left -= chunk;
+        }
+    }
+    return 1;
+}
+
+// ============================================================================
+// Extraction
+// ============================================================================
+
+// Output file of one partition and the progress across all of them
+typedef struct {
+    HANDLE file;
+    const char* name;
+    unsigned long long done;
+    unsigned long long total;
+    ProgressCallback progress;
+    void* user_data;
+} ExtractSink;
+
+// SparseSinkFn: append to the output file
+static int WriteToFile(const void* data, size_t len, void* user_data) {
+    ExtractSink* sink = (ExtractSink*)user_data;
+    const unsigned char* bytes = (const unsigned char*)data;
+    while (len > 0) {
+        DWORD step = len > 0x40000000 ? 0x40000000 : (DWORD)len;
+        DWORD written = 0;
+        if (!WriteFile(sink->file, bytes, step, &written, NULL) || written == 0) return 0;
+        bytes += written;
+        len -= written;
+        sink->done += written;
+    }
+    if (sink->progress) sink->progress(sink->name, sink->done, sink->total, sink->user_data);
+    return 1;
+}
+
+// Write one partition into a file sized up front; ZERO extents are skipped over
+static int ExtractPartition(SuperImage* super, const SuperPartition* partition, const char* path, ExtractSink* sink) {
+    sink->file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (sink->file == INVALID_HANDLE_VALUE) {
+        snprintf(super->error, sizeof(super->error), "Cannot create %s (error %lu)", path, GetLastError());
+        return 0;
+    }
+    sink->name = partition->name;
+
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)partition->size;
+    int ok = SetFilePointerEx(sink->file, end, NULL, FILE_BEGIN) && SetEndOfFile(sink->file);
+    LARGE_INTEGER start;
+    start.QuadPart = 0;
+    ok = ok && SetFilePointerEx(sink->file, start, NULL, FILE_BEGIN);
+    if (!ok) snprintf(super->error, sizeof(super->error), "Cannot size %s (error %lu)", path, GetLastError());
+
+    for (int i = 0; ok && i < partition->extent_count; i++) {
+        const SuperExtent* extent = &super->extents[partition->first_extent + i];
+        if (extent->is_zero) {
+            LARGE_INTEGER skip;
+            skip.QuadPart = (LONGLONG)extent->length;
+            ok = SetFilePointerEx(sink->file, skip, NULL, FILE_CURRENT);
+            sink->done += extent->length;
+        } else {
+            super->image.error[0] = '\0';
+            ok = SparseImageReadRange(&super->image, extent->offset, extent->length, WriteToFile, sink);
+        }
+        if (!ok) {
+            snprintf(super->error, sizeof(super->error), "%s: %s", partition->name,
+                     super->image.error[0] ? super->image.error : "cannot write the image");
+        }
+    }
+
+    CloseHandle(sink->file);
+    if (!ok) DeleteFileA(path);
+    return ok;
+}
+
+// Copy the partitions out one after another
+int SuperImageExtractPartitions(SuperImage* super, const SuperPartition** partitions, int count, const char* out_dir,
+                                ProgressCallback progress, void* user_data) {
+    if (!super || !partitions || count <= 0 || !out_dir) return 0;
+
+    ExtractSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.progress = progress;
+    sink.user_data = user_data;
+    for (int i = 0; i < count; i++) {
+        if (!CheckReadable(super, partitions[i])) return 0;
+        sink.total += partitions[i]->size;
+    }
+
+    for (int i = 0; i < count; i++) {
+        char name[64];
+        char path[MAX_PATH];
+        snprintf(name, sizeof(name), "%s.img", partitions[i]->name);
+        JoinPath(path, sizeof(path), out_dir, name);
+        if (!ExtractPartition(super, partitions[i], path, &sink)) return 0;
+    }
+    if (progress) progress(partitions[count - 1]->name, sink.total, sink.total, user_data);
+    return 1;
+}
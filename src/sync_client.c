@@ -0,0 +1,645 @@
+#include "sync_client.h"
+#include "adb_client.h"
+#include "utils.h"
+#include <stdarg.h>
+
+// DATA packets handed to the socket per send call, so several are always in flight
+#define PUSH_BATCH_PACKETS 16
+// Local file window mapped at once (a multiple of the 64 KB allocation granularity)
+#define PUSH_MAP_WINDOW (32 * 1024 * 1024)
+// Each pull write buffer; two alternate so receiving overlaps writing
+#define PULL_WRITE_CHUNK (4 * 1024 * 1024)
+// Unbuffered writes must be sector aligned; 4 KB covers 512e and 4Kn disks
+#define PULL_SECTOR_ALIGN 4096
+// Socket buffers sized to keep USB 3 busy between send/recv calls
+#define SYNC_SOCKET_BUFFER (1024 * 1024)
+
+// Regular file, rw-r--r--: what adb.exe sends for pushes from Windows
+#define PUSH_FILE_MODE (SYNC_S_IFREG | 0644)
+
+// Little-endian helpers for the 32/64-bit protocol fields
+static void PutLE32(unsigned char* p, unsigned int value) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+}
+
+static unsigned int GetLE32(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) |
+           ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned long long GetLE64(const unsigned char* p) {
+    return (unsigned long long)GetLE32(p) | ((unsigned long long)GetLE32(p + 4) << 32);
+}
+
+// Record why the last operation failed
+static void SetSyncError(SyncConnection* conn, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(conn->error, sizeof(conn->error), format, args);
+    va_end(args);
+}
+
+// Send one request: 4-byte id, 4-byte length, payload
+static int SendSyncRequest(SyncConnection* conn, const char* id, const char* data, size_t len) {
+    if (len > SYNC_PATH_MAX) {
+        SetSyncError(conn, "Remote path too long (%u bytes, limit %d)", (unsigned int)len, SYNC_PATH_MAX);
+        return 0;
+    }
+
+    unsigned char header[8];
+    memcpy(header, id, 4);
+    PutLE32(header + 4, (unsigned int)len);
+
+    if (!AdbClientSendAll(conn->sock, header, sizeof(header)) ||
+        (len > 0 && !AdbClientSendAll(conn->sock, data, len))) {
+        SetSyncError(conn, "Connection to device lost");
+        return 0;
+    }
+    return 1;
+}
+
+// Read the message of a FAIL reply into conn->error
+static void ReadFailMessage(SyncConnection* conn, unsigned int len) {
+    char message[sizeof(conn->error)];
+    size_t keep = len < sizeof(message) - 1 ? len : sizeof(message) - 1;
+
+    if (!AdbClientRecvAll(conn->sock, message, keep)) {
+        SetSyncError(conn, "Device reported an error");
+        return;
+    }
+    message[keep] = '\0';
+
+    // Drain anything that did not fit
+    char discard[256];
+    for (unsigned int left = len - (unsigned int)keep; left > 0; ) {
+        unsigned int chunk = left < sizeof(discard) ? left : (unsigned int)sizeof(discard);
+        if (!AdbClientRecvAll(conn->sock, discard, chunk)) break;
+        left -= chunk;
+    }
+
+    SetSyncError(conn, "%s", message);
+}
+
+// Read the OKAY/FAIL reply that ends a SEND
+static int ReadSyncStatus(SyncConnection* conn) {
+    unsigned char reply[8];
+    if (!AdbClientRecvAll(conn->sock, reply, sizeof(reply))) {
+        SetSyncError(conn, "Connection to device lost");
+        return 0;
+    }
+
+    if (memcmp(reply, "OKAY", 4) == 0) return 1;
+
+    if (memcmp(reply, "FAIL", 4) == 0) {
+        ReadFailMessage(conn, GetLE32(reply + 4));
+    } else {
+        SetSyncError(conn, "Unexpected sync reply");
+    }
+    return 0;
+}
+
+// Send a scatter list completely (WSASend may stop part way on a busy socket)
+static int SendBuffers(SOCKET sock, WSABUF* buffers, DWORD count) {
+    while (count > 0) {
+        DWORD sent = 0;
+        if (WSASend(sock, buffers, count, &sent, 0, NULL, NULL) != 0) {
+            return 0;
+        }
+
+        while (count > 0 && sent >= buffers->len) {
+            sent -= buffers->len;
+            buffers++;
+            count--;
+        }
+        if (count > 0) {
+            buffers->buf += sent;
+            buffers->len -= sent;
+        }
+    }
+    return 1;
+}
+
+// Drop a session whose stream position is unknown (mid-transfer local failure)
+static void AbortSync(SyncConnection* conn) {
+    if (conn->sock != INVALID_SOCKET) {
+        closesocket(conn->sock);
+        conn->sock = INVALID_SOCKET;
+    }
+}
+
+// Last path component, accepting both separators
+static const char* PathBaseName(const char* path) {
+    const char* base = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') base = p + 1;
+    }
+    return base;
+}
+
+// Open a sync session with one device
+int SyncOpen(SyncConnection* conn, const char* device_serial) {
+    if (!conn) return 0;
+
+    memset(conn, 0, sizeof(SyncConnection));
+    conn->sock = INVALID_SOCKET;
+
+    if (!AdbClientIsAvailable()) {
+        SetSyncError(conn, "adb server is not reachable");
+        return 0;
+    }
+
+    conn->sock = AdbClientOpenService(device_serial, "sync:");
+    if (conn->sock == INVALID_SOCKET) {
+        SetSyncError(conn, "Failed to open sync service");
+        return 0;
+    }
+
+    int buffer_size = SYNC_SOCKET_BUFFER;
+    setsockopt(conn->sock, SOL_SOCKET, SO_SNDBUF, (const char*)&buffer_size, sizeof(buffer_size));
+    setsockopt(conn->sock, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size, sizeof(buffer_size));
+
+    conn->has_stat_v2 = AdbClientDeviceHasFeature(device_serial, "stat_v2");
+    return 1;
+}
+
+// End the session
+void SyncClose(SyncConnection* conn) {
+    if (!conn || conn->sock == INVALID_SOCKET) return;
+
+    SendSyncRequest(conn, "QUIT", NULL, 0);
+    closesocket(conn->sock);
+    conn->sock = INVALID_SOCKET;
+}
+
+// Stat a remote path; stat_out->mode is 0 when it does not exist
+int SyncStatRemote(SyncConnection* conn, const char* remote_path, SyncStat* stat_out) {
+    if (!conn || !remote_path || !stat_out) return 0;
+    memset(stat_out, 0, sizeof(SyncStat));
+
+    if (conn->has_stat_v2) {
+        if (!SendSyncRequest(conn, "STA2", remote_path, strlen(remote_path))) return 0;
+
+        // id, error, dev, ino, mode, nlink, uid, gid, size, atime, mtime, ctime
+        unsigned char reply[72];
+        if (!AdbClientRecvAll(conn->sock, reply, sizeof(reply)) || memcmp(reply, "STA2", 4) != 0) {
+            SetSyncError(conn, "Bad STAT reply");
+            return 0;
+        }
+        if (GetLE32(reply + 4) == 0) {
+            stat_out->mode = GetLE32(reply + 24);
+            stat_out->size = GetLE64(reply + 40);
+            stat_out->mtime = (unsigned int)GetLE64(reply + 56);
+        }
+        return 1;
+    }
+
+    if (!SendSyncRequest(conn, "STAT", remote_path, strlen(remote_path))) return 0;
+
+    unsigned char reply[16];
+    if (!AdbClientRecvAll(conn->sock, reply, sizeof(reply)) || memcmp(reply, "STAT", 4) != 0) {
+        SetSyncError(conn, "Bad STAT reply");
+        return 0;
+    }
+    stat_out->mode = GetLE32(reply + 4);
+    stat_out->size = GetLE32(reply + 8);
+    stat_out->mtime = GetLE32(reply + 12);
+    return 1;
+}
+
+// List a remote directory; "." and ".." are passed through like adbd sends them
+int SyncListRemote(SyncConnection* conn, const char* remote_path, SyncListCallback callback, void* user_data) {
+    if (!conn || !remote_path) return 0;
+
+    if (!SendSyncRequest(conn, "LIST", remote_path, strlen(remote_path))) return 0;
+
+    int wanted = 1;
+    while (1) {
+        // id, mode, size, mtime, name length
+        unsigned char entry[20];
+        if (!AdbClientRecvAll(conn->sock, entry, sizeof(entry))) {
+            SetSyncError(conn, "Connection to device lost");
+            return 0;
+        }
+        if (memcmp(entry, "DONE", 4) == 0) break;
+        if (memcmp(entry, "DENT", 4) != 0) {
+            SetSyncError(conn, "Unexpected LIST reply");
+            return 0;
+        }
+
+        unsigned int name_len = GetLE32(entry + 16);
+        if (name_len > SYNC_PATH_MAX) {
+            SetSyncError(conn, "Bad LIST entry");
+            return 0;
+        }
+
+        char name[SYNC_PATH_MAX + 1];
+        if (!AdbClientRecvAll(conn->sock, name, name_len)) {
+            SetSyncError(conn, "Connection to device lost");
+            return 0;
+        }
+        name[name_len] = '\0';
+
+        // Keep reading after the callback stops us so the session stays usable
+        if (wanted && callback) {
+            SyncStat item;
+            memset(&item, 0, sizeof(item));
+            item.mode = GetLE32(entry + 4);
+            item.size = GetLE32(entry + 8);
+            item.mtime = GetLE32(entry + 12);
+            strncpy(item.name, name, sizeof(item.name) - 1);
+            wanted = callback(&item, user_data);
+        }
+    }
+
+    return 1;
+}
+
+// Stream the mapped file as batches of DATA packets. Views are mapped per call,
+// so several connections can stream from one shared mapping at the same time.
+// Returns 1 on success, 0 on a local error, -1 if the connection dropped.
+static int PushMappedFile(SyncConnection* conn, HANDLE mapping, unsigned long long size,
+                          const char* name, ProgressCallback progress, void* user_data) {
+    unsigned char headers[PUSH_BATCH_PACKETS][8];
+    WSABUF buffers[PUSH_BATCH_PACKETS * 2];
+    unsigned long long offset = 0;
+    int ok = 1;
+
+    while (ok == 1 && offset < size) {
+        unsigned long long window = size - offset;
+        if (window > PUSH_MAP_WINDOW) window = PUSH_MAP_WINDOW;
+
+        const char* view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ,
+                                                      (DWORD)(offset >> 32), (DWORD)offset, (SIZE_T)window);
+        if (!view) {
+            SetSyncError(conn, "Cannot map local file (error %lu)", GetLastError());
+            ok = 0;
+            break;
+        }
+
+        // Packet payloads point straight into the view; only the headers are built here
+        size_t position = 0;
+        while (position < window) {
+            size_t batch_start = position;
+            DWORD buffer_count = 0;
+            for (int i = 0; i < PUSH_BATCH_PACKETS && position < window; i++) {
+                size_t chunk = (size_t)window - position;
+                if (chunk > SYNC_DATA_MAX) chunk = SYNC_DATA_MAX;
+
+                memcpy(headers[i], "DATA", 4);
+                PutLE32(headers[i] + 4, (unsigned int)chunk);
+                buffers[buffer_count].buf = (char*)headers[i];
+                buffers[buffer_count].len = 8;
+                buffer_count++;
+                buffers[buffer_count].buf = (char*)(view + position);
+                buffers[buffer_count].len = (ULONG)chunk;
+                buffer_count++;
+                position += chunk;
+            }
+
+            if (!SendBuffers(conn->sock, buffers, buffer_count)) {
+                SetSyncError(conn, "Connection to device lost");
+                ok = -1;
+                break;
+            }
+            // Hashed right after sending, while the pages are still warm
+            if (conn->digest) Sha256Update(conn->digest, view + batch_start, position - batch_start);
+
+            if (progress) progress(name, offset + position, size, user_data);
+        }
+
+        UnmapViewOfFile(view);
+        offset += window;
+    }
+
+    return ok;
+}
+
+// Resolve where a push lands: onto a directory it keeps the local name, like adb push
+int SyncResolvePushTarget(SyncConnection* conn, const char* local_path, const char* remote_path,
+                          char* target, size_t target_size) {
+    if (!conn || !local_path || !remote_path || !target) return 0;
+
+    snprintf(target, target_size, "%s", remote_path);
+    size_t target_len = strlen(target);
+
+    SyncStat remote;
+    int is_directory = target_len > 0 && target[target_len - 1] == '/';
+    if (!is_directory) {
+        if (!SyncStatRemote(conn, target, &remote)) return 0;
+        is_directory = (remote.mode & SYNC_S_IFMT) == SYNC_S_IFDIR;
+    }
+    if (is_directory) {
+        snprintf(target, target_size, "%s%s%s", remote_path,
+                 (target_len > 0 && remote_path[target_len - 1] == '/') ? "" : "/", PathBaseName(local_path));
+    }
+    return 1;
+}
+
+// Push one local file
+int SyncPushFile(SyncConnection* conn, const char* local_path, const char* remote_path,
+                 ProgressCallback progress, void* user_data) {
+    char target[SYNC_PATH_MAX + 1];
+    if (!SyncResolvePushTarget(conn, local_path, remote_path, target, sizeof(target))) return 0;
+
+    return SyncSendFile(conn, local_path, target, progress, user_data);
+}
+
+// Open and map a local file for one or more pushes
+int SyncOpenSource(SyncSource* source, const char* local_path, char* error, size_t error_size) {
+    if (!source || !local_path) return 0;
+    memset(source, 0, sizeof(*source));
+
+    source->file = CreateFileA(local_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (source->file == INVALID_HANDLE_VALUE) {
+        if (error) snprintf(error, error_size, "Cannot open %s (error %lu)", local_path, GetLastError());
+        return 0;
+    }
+
+    LARGE_INTEGER file_size;
+    FILETIME write_time;
+    if (!GetFileSizeEx(source->file, &file_size) || !GetFileTime(source->file, NULL, NULL, &write_time)) {
+        if (error) snprintf(error, error_size, "Cannot read %s (error %lu)", local_path, GetLastError());
+        SyncCloseSource(source);
+        return 0;
+    }
+    source->size = (unsigned long long)file_size.QuadPart;
+    source->mtime = FileTimeToUnixSeconds(&write_time);
+    snprintf(source->name, sizeof(source->name), "%s", PathBaseName(local_path));
+
+    // Empty files cannot be mapped and have nothing to send
+    if (source->size > 0) {
+        source->mapping = CreateFileMappingA(source->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!source->mapping) {
+            if (error) snprintf(error, error_size, "Cannot map %s (error %lu)", local_path, GetLastError());
+            SyncCloseSource(source);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Release a source opened with SyncOpenSource
+void SyncCloseSource(SyncSource* source) {
+    if (!source) return;
+    if (source->mapping) CloseHandle(source->mapping);
+    if (source->file && source->file != INVALID_HANDLE_VALUE) CloseHandle(source->file);
+    source->mapping = NULL;
+    source->file = INVALID_HANDLE_VALUE;
+}
+
+// Push an opened source to exactly remote_path
+int SyncSendSource(SyncConnection* conn, const SyncSource* source, const char* remote_path,
+                   ProgressCallback progress, void* user_data) {
+    if (!conn || !source || !remote_path) return 0;
+
+    char spec[SYNC_PATH_MAX + 16];
+    int spec_len = snprintf(spec, sizeof(spec), "%s,%d", remote_path, PUSH_FILE_MODE);
+    if (!SendSyncRequest(conn, "SEND", spec, (size_t)spec_len)) return 0;
+
+    int ok = 1;
+    if (source->size > 0) {
+        ok = PushMappedFile(conn, source->mapping, source->size, source->name, progress, user_data);
+    } else if (progress) {
+        progress(source->name, 0, 0, user_data);
+    }
+
+    if (ok == 0) {
+        // The device still expects data; the session cannot be resynchronized
+        AbortSync(conn);
+        return 0;
+    }
+
+    if (ok == 1) {
+        unsigned char done[8];
+        memcpy(done, "DONE", 4);
+        PutLE32(done + 4, source->mtime);
+        if (!AdbClientSendAll(conn->sock, done, sizeof(done))) {
+            SetSyncError(conn, "Connection to device lost");
+            ok = 0;
+        }
+    }
+
+    // adbd answers a failed write (no space, read-only, ...) with FAIL; report that reason
+    if (!ReadSyncStatus(conn)) return 0;
+    return ok == 1;
+}
+
+// Push one local file to exactly remote_path
+int SyncSendFile(SyncConnection* conn, const char* local_path, const char* remote_path,
+                 ProgressCallback progress, void* user_data) {
+    if (!conn || !local_path || !remote_path) return 0;
+
+    SyncSource source;
+    if (!SyncOpenSource(&source, local_path, conn->error, sizeof(conn->error))) return 0;
+
+    int ok = SyncSendSource(conn, &source, remote_path, progress, user_data);
+    SyncCloseSource(&source);
+    return ok;
+}
+
+// Wait for an outstanding write on one pull buffer
+static int WaitPullWrite(HANDLE file, OVERLAPPED* overlapped, int* pending) {
+    if (!*pending) return 1;
+
+    DWORD written = 0;
+    *pending = 0;
+    return GetOverlappedResult(file, overlapped, &written, TRUE) ? 1 : 0;
+}
+
+// Start an overlapped write of one pull buffer at the given offset
+static int StartPullWrite(HANDLE file, const char* data, DWORD len, unsigned long long offset,
+                          OVERLAPPED* overlapped, int* pending) {
+    HANDLE event = overlapped->hEvent;
+    memset(overlapped, 0, sizeof(OVERLAPPED));
+    overlapped->hEvent = event;
+    overlapped->Offset = (DWORD)offset;
+    overlapped->OffsetHigh = (DWORD)(offset >> 32);
+
+    if (!WriteFile(file, data, len, NULL, overlapped) && GetLastError() != ERROR_IO_PENDING) {
+        return 0;
+    }
+    *pending = 1;
+    return 1;
+}
+
+// Resolve where a pull lands: into a directory it keeps the remote name, like adb pull
+int SyncResolvePullTarget(SyncConnection* conn, const char* remote_path, const char* local_path,
+                          char* target, size_t target_size, SyncStat* stat_out) {
+    if (!conn || !remote_path || !local_path || !target || !stat_out) return 0;
+
+    if (!SyncStatRemote(conn, remote_path, stat_out)) return 0;
+    if (stat_out->mode == 0) {
+        SetSyncError(conn, "Remote object '%s' does not exist", remote_path);
+        return 0;
+    }
+    if ((stat_out->mode & SYNC_S_IFMT) == SYNC_S_IFDIR) {
+        SetSyncError(conn, "'%s' is a directory", remote_path);
+        return 0;
+    }
+
+    if (DirectoryExists(local_path)) {
+        JoinPath(target, target_size, local_path, PathBaseName(remote_path));
+    } else {
+        snprintf(target, target_size, "%s", local_path);
+    }
+    return 1;
+}
+
+// Pull one remote file
+int SyncPullFile(SyncConnection* conn, const char* remote_path, const char* local_path,
+                 ProgressCallback progress, void* user_data) {
+    char target[MAX_PATH];
+    SyncStat remote;
+    if (!SyncResolvePullTarget(conn, remote_path, local_path, target, sizeof(target), &remote)) return 0;
+
+    return SyncRecvFile(conn, remote_path, target, remote.size, progress, user_data);
+}
+
+// Pull one remote file to exactly local_path; expected_size only sizes buffers and progress
+int SyncRecvFile(SyncConnection* conn, const char* remote_path, const char* local_path,
+                 unsigned long long expected_size, ProgressCallback progress, void* user_data) {
+    if (!conn || !remote_path || !local_path) return 0;
+
+    const char* name = PathBaseName(remote_path);
+    const char* target = local_path;
+
+    // Unbuffered so multi-GB images do not churn the file cache; some filesystems refuse it
+    HANDLE file = CreateFileA(target, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = CreateFileA(target, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+    }
+    if (file == INVALID_HANDLE_VALUE) {
+        SetSyncError(conn, "Cannot create %s (error %lu)", target, GetLastError());
+        return 0;
+    }
+
+    // Small files get small buffers; sizes stay whole sectors
+    size_t chunk_size = PULL_WRITE_CHUNK;
+    if (expected_size > 0 && expected_size < PULL_WRITE_CHUNK) {
+        chunk_size = ((size_t)expected_size + PULL_SECTOR_ALIGN - 1) & ~(size_t)(PULL_SECTOR_ALIGN - 1);
+    }
+
+    // Page-aligned buffers satisfy the sector alignment unbuffered writes need
+    char* buffers[2];
+    buffers[0] = (char*)VirtualAlloc(NULL, chunk_size * 2, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    buffers[1] = buffers[0] ? buffers[0] + chunk_size : NULL;
+    OVERLAPPED overlapped[2];
+    memset(overlapped, 0, sizeof(overlapped));
+    overlapped[0].hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    overlapped[1].hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    int pending[2] = {0, 0};
+
+    int ok = buffers[0] && overlapped[0].hEvent && overlapped[1].hEvent;
+    if (!ok) {
+        SetSyncError(conn, "Out of memory");
+    } else {
+        ok = SendSyncRequest(conn, "RECV", remote_path, strlen(remote_path));
+    }
+
+    int device_failed = 0;
+    int current = 0;
+    size_t fill = 0;
+    unsigned long long received = 0;
+    unsigned long long write_offset = 0;
+
+    while (ok) {
+        unsigned char header[8];
+        if (!AdbClientRecvAll(conn->sock, header, sizeof(header))) {
+            SetSyncError(conn, "Connection to device lost");
+            ok = 0;
+            break;
+        }
+        unsigned int len = GetLE32(header + 4);
+
+        if (memcmp(header, "DONE", 4) == 0) break;
+        if (memcmp(header, "FAIL", 4) == 0) {
+            ReadFailMessage(conn, len);
+            device_failed = 1;
+            ok = 0;
+            break;
+        }
+        if (memcmp(header, "DATA", 4) != 0 || len > SYNC_DATA_MAX) {
+            SetSyncError(conn, "Unexpected RECV reply");
+            ok = 0;
+            break;
+        }
+
+        while (ok && len > 0) {
+            size_t room = chunk_size - fill;
+            size_t chunk = len < room ? len : room;
+            if (!AdbClientRecvAll(conn->sock, buffers[current] + fill, chunk)) {
+                SetSyncError(conn, "Connection to device lost");
+                ok = 0;
+                break;
+            }
+            fill += chunk;
+            len -= (unsigned int)chunk;
+            received += chunk;
+
+            if (fill == chunk_size) {
+                // Hand this buffer to the disk and keep receiving into the other one
+                if (conn->digest) Sha256Update(conn->digest, buffers[current], chunk_size);
+                int next = 1 - current;
+                if (!StartPullWrite(file, buffers[current], (DWORD)chunk_size, write_offset,
+                                    &overlapped[current], &pending[current]) ||
+                    !WaitPullWrite(file, &overlapped[next], &pending[next])) {
+                    SetSyncError(conn, "Write to %s failed (error %lu)", target, GetLastError());
+                    ok = 0;
+                    break;
+                }
+                write_offset += chunk_size;
+                current = next;
+                fill = 0;
+
+                if (progress) progress(name, received, expected_size, user_data);
+            }
+        }
+    }
+
+    // Flush the tail padded to a whole sector, then trim the file to its real length
+    if (ok && fill > 0) {
+        if (conn->digest) Sha256Update(conn->digest, buffers[current], fill);
+        size_t padded = (fill + PULL_SECTOR_ALIGN - 1) & ~(size_t)(PULL_SECTOR_ALIGN - 1);
+        memset(buffers[current] + fill, 0, padded - fill);
+        if (!StartPullWrite(file, buffers[current], (DWORD)padded, write_offset,
+                            &overlapped[current], &pending[current])) {
+            SetSyncError(conn, "Write to %s failed (error %lu)", target, GetLastError());
+            ok = 0;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        if (!WaitPullWrite(file, &overlapped[i], &pending[i]) && ok) {
+            SetSyncError(conn, "Write to %s failed (error %lu)", target, GetLastError());
+            ok = 0;
+        }
+    }
+    if (ok) {
+        LARGE_INTEGER end;
+        end.QuadPart = (LONGLONG)received;
+        if (!SetFilePointerEx(file, end, NULL, FILE_BEGIN) || !SetEndOfFile(file)) {
+            SetSyncError(conn, "Cannot finalize %s (error %lu)", target, GetLastError());
+            ok = 0;
+        }
+    }
+
+    if (ok && progress) progress(name, received, expected_size ? expected_size : received, user_data);
+
+    if (overlapped[0].hEvent) CloseHandle(overlapped[0].hEvent);
+    if (overlapped[1].hEvent) CloseHandle(overlapped[1].hEvent);
+    if (buffers[0]) VirtualFree(buffers[0], 0, MEM_RELEASE);
+    CloseHandle(file);
+
+    // Do not leave a truncated file behind
+    if (!ok) {
+        DeleteFileA(target);
+        // A FAIL reply ends the RECV cleanly; anything else leaves unread data in the stream
+        if (!device_failed) AbortSync(conn);
+    }
+    return ok;
+}
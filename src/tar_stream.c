@@ -0,0 +1,531 @@
+#include "tar_stream.h"
+#include "utils.h"
+#include <stdarg.h>
+
+// Writer buffer handed to the sink in one call
+#define TAR_WRITE_BUFFER (1024 * 1024)
+// Largest GNU long name / pax record accepted
+#define TAR_META_MAX (64 * 1024)
+
+// ustar header field offsets and widths
+#define TAR_NAME      0
+#define TAR_NAME_LEN  100
+#define TAR_MODE      100
+#define TAR_UID       108
+#define TAR_GID       116
+#define TAR_SIZE      124
+#define TAR_MTIME     136
+#define TAR_CHKSUM    148
+#define TAR_TYPE      156
+#define TAR_MAGIC     257
+#define TAR_VERSION   263
+#define TAR_PREFIX    345
+#define TAR_PREFIX_LEN 155
+
+// What the extractor is consuming
+enum {
+    TAR_STATE_HEADER = 0,
+    TAR_STATE_FILE,         // Regular file data
+    TAR_STATE_SKIP,         // Data of an entry that is not extracted
+    TAR_STATE_META,         // GNU long name or pax record
+    TAR_STATE_PADDING
+};
+
+// Record the first failure
+static void SetTarError(char* error, size_t size, const char* format, ...) {
+    if (error[0]) return;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error, size, format, args);
+    va_end(args);
+}
+
+// Numeric header field: octal text, or big-endian base-256 when the top bit is set
+static unsigned long long ParseTarNumber(const unsigned char* field, size_t width) {
+    unsigned long long value = 0;
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7F;
+        for (size_t i = 1; i < width; i++) value = (value << 8) | field[i];
+        return value;
+    }
+
+    size_t i = 0;
+    while (i < width && (field[i] == ' ' || field[i] == '\0')) i++;
+    for (; i < width && field[i] >= '0' && field[i] <= '7'; i++) value = (value << 3) | (unsigned)(field[i] - '0');
+    return value;
+}
+
+// Header checksum (the checksum field itself counts as spaces)
+static unsigned int TarChecksum(const unsigned char* header) {
+    unsigned int sum = 0;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += (i >= TAR_CHKSUM && i < TAR_CHKSUM + 8) ? ' ' : header[i];
+    }
+    return sum;
+}
+
+// ---------------------------------------------------------------------------
+// Extraction
+// ---------------------------------------------------------------------------
+
+// Start an extraction into root
+void TarExtractorInit(TarExtractor* tar, const char* root) {
+    memset(tar, 0, sizeof(TarExtractor));
+    snprintf(tar->root, sizeof(tar->root), "%s", root);
+    tar->file = INVALID_HANDLE_VALUE;
+}
+
+// Map an archive path under the root; 0 for absolute escapes, ".." or overlong paths.
+// Characters Windows cannot store are replaced with '_'.
+static int MapArchivePath(const TarExtractor* tar, const char* name, char* out, size_t size) {
+    size_t used = (size_t)snprintf(out, size, "%s", tar->root);
+    if (used >= size) return 0;
+    int components = 0;
+
+    const char* p = name;
+    while (*p) {
+        while (*p == '/') p++;
+        const char* end = p;
+        while (*end && *end != '/') end++;
+        size_t len = (size_t)(end - p);
+
+        if (len == 0 || (len == 1 && p[0] == '.')) {
+            p = end;
+            continue;
+        }
+        if (len == 2 && p[0] == '.' && p[1] == '.') return 0;
+        if (used + 1 + len + 1 > size) return 0;
+
+        out[used++] = '\\';
+        for (size_t i = 0; i < len; i++) {
+            char c = p[i];
+            out[used++] = ((unsigned char)c < 32 || strchr("<>:\"\\|?*", c)) ? '_' : c;
+        }
+        out[used] = '\0';
+        components++;
+        p = end;
+    }
+    return components > 0;
+}
+
+// Create every missing folder above path (path itself too if include_self)
+static void CreateParentFolders(const TarExtractor* tar, char* path, int include_self) {
+    size_t root_len = strlen(tar->root);
+    for (char* p = path + root_len + 1; *p; p++) {
+        if (*p != '\\') continue;
+        *p = '\0';
+        CreateDirectoryA(path, NULL);
+        *p = '\\';
+    }
+    if (include_self) CreateDirectoryA(path, NULL);
+}
+
+// Finish the file being written
+static void CloseExtractedFile(TarExtractor* tar) {
+    if (tar->file == INVALID_HANDLE_VALUE) return;
+    FILETIME ft = UnixSecondsToFileTime(tar->file_mtime);
+    SetFileTime(tar->file, NULL, NULL, &ft);
+    CloseHandle(tar->file);
+    tar->file = INVALID_HANDLE_VALUE;
+}
+
+// Apply a pax extended header ("<len> key=value\n" records)
+static void ApplyPaxRecords(TarExtractor* tar) {
+    char* p = tar->meta;
+    char* end = tar->meta + tar->meta_fill;
+
+    while (p < end) {
+        char* space = memchr(p, ' ', (size_t)(end - p));
+        if (!space) break;
+        unsigned long record_len = strtoul(p, NULL, 10);
+        if (record_len == 0 || p + record_len > end) break;
+
+        char* key = space + 1;
+        char* record_end = p + record_len - 1;          // The trailing '\n'
+        char* equals = memchr(key, '=', (size_t)(record_end - key));
+        if (equals) {
+            *record_end = '\0';
+            *equals = '\0';
+            if (strcmp(key, "path") == 0) {
+                free(tar->next_path);
+                tar->next_path = _strdup(equals + 1);
+            } else if (strcmp(key, "size") == 0) {
+                tar->next_size = strtoull(equals + 1, NULL, 10);
+                tar->has_next_size = 1;
+            }
+        }
+        p += record_len;
+    }
+}
+
+// Act on the collected GNU long name or pax record
+static void FinishMetaEntry(TarExtractor* tar) {
+    tar->meta[tar->meta_fill] = '\0';
+    if (tar->meta_type == 'L') {
+        free(tar->next_path);
+        tar->next_path = _strdup(tar->meta);
+    } else {
+        ApplyPaxRecords(tar);
+    }
+    SAFE_FREE(tar->meta);
+    tar->meta_fill = 0;
+}
+
+// Entry data fully consumed
+static void FinishEntry(TarExtractor* tar) {
+    if (tar->state == TAR_STATE_FILE) CloseExtractedFile(tar);
+    if (tar->state == TAR_STATE_META) FinishMetaEntry(tar);
+    tar->state = tar->padding > 0 ? TAR_STATE_PADDING : TAR_STATE_HEADER;
+}
+
+// Interpret a complete header block
+static int ProcessHeader(TarExtractor* tar) {
+    const unsigned char* h = tar->header;
+
+    int all_zero = 1;
+    for (int i = 0; i < TAR_BLOCK_SIZE && all_zero; i++) all_zero = h[i] == 0;
+    if (all_zero) {
+        if (++tar->zero_blocks >= 2) tar->finished = 1;
+        return 1;
+    }
+    tar->zero_blocks = 0;
+
+    if ((unsigned int)ParseTarNumber(h + TAR_CHKSUM, 8) != TarChecksum(h)) {
+        SetTarError(tar->error, sizeof(tar->error), "Corrupt tar header (checksum mismatch)");
+        return 0;
+    }
+
+    // Path: long name or pax override, else ustar prefix + name
+    char name[TAR_PREFIX_LEN + 1 + TAR_NAME_LEN + 1];
+    const char* path = tar->next_path;
+    if (!path) {
+        size_t used = 0;
+        if (memcmp(h + TAR_MAGIC, "ustar", 5) == 0 && h[TAR_PREFIX]) {
+            size_t len = strnlen((const char*)h + TAR_PREFIX, TAR_PREFIX_LEN);
+            memcpy(name, h + TAR_PREFIX, len);
+            used = len;
+            name[used++] = '/';
+        }
+        size_t len = strnlen((const char*)h + TAR_NAME, TAR_NAME_LEN);
+        memcpy(name + used, h + TAR_NAME, len);
+        name[used + len] = '\0';
+        path = name;
+    }
+
+    unsigned long long size = tar->has_next_size ? tar->next_size : ParseTarNumber(h + TAR_SIZE, 12);
+    unsigned int mtime = (unsigned int)ParseTarNumber(h + TAR_MTIME, 12);
+    char type = (char)h[TAR_TYPE];
+
+    tar->remaining = size;
+    tar->padding = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    tar->state = TAR_STATE_SKIP;
+
+    if (type == 'L' || type == 'x') {
+        // Describes the next entry; keep whatever overrides are pending until then
+        if (size > TAR_META_MAX) {
+            SetTarError(tar->error, sizeof(tar->error), "Corrupt tar archive (oversized extended header)");
+            return 0;
+        }
+        tar->meta = (char*)SafeMalloc((size_t)size + 1);
+        tar->meta_fill = 0;
+        tar->meta_type = type;
+        tar->state = TAR_STATE_META;
+    } else if (type == 'g' || type == 'K') {
+        // Global pax headers and long link targets do not matter here
+    } else {
+        char local_path[MAX_PATH];
+        int mapped = MapArchivePath(tar, path, local_path, sizeof(local_path));
+
+        if (type == '5') {
+            if (mapped) {
+                CreateParentFolders(tar, local_path, 1);
+                tar->dirs++;
+            }
+        } else if ((type == '0' || type == '\0' || type == '7') && mapped) {
+            CreateParentFolders(tar, local_path, 0);
+            tar->file = CreateFileA(local_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (tar->file == INVALID_HANDLE_VALUE) {
+                SetTarError(tar->error, sizeof(tar->error), "Cannot create %s (error %lu)", local_path, GetLastError());
+                tar->failures++;
+            } else {
+                tar->file_mtime = mtime;
+                tar->state = TAR_STATE_FILE;
+                tar->files++;
+            }
+        } else {
+            // Symlinks, hard links, devices, FIFOs, or a path that would leave the root
+            tar->skipped++;
+        }
+
+        SAFE_FREE(tar->next_path);
+        tar->has_next_size = 0;
+    }
+
+    if (tar->remaining == 0) FinishEntry(tar);
+    return 1;
+}
+
+// Feed archive bytes as they arrive
+int TarExtractorFeed(TarExtractor* tar, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+
+    while (len > 0 && !tar->finished) {
+        if (tar->state == TAR_STATE_HEADER) {
+            size_t take = TAR_BLOCK_SIZE - tar->header_fill;
+            if (take > len) take = len;
+            memcpy(tar->header + tar->header_fill, p, take);
+            tar->header_fill += take;
+            p += take;
+            len -= take;
+            if (tar->header_fill == TAR_BLOCK_SIZE) {
+                tar->header_fill = 0;
+                if (!ProcessHeader(tar)) return 0;
+            }
+            continue;
+        }
+
+        if (tar->state == TAR_STATE_PADDING) {
+            size_t take = tar->padding < len ? (size_t)tar->padding : len;
+            tar->padding -= take;
+            p += take;
+            len -= take;
+            if (tar->padding == 0) tar->state = TAR_STATE_HEADER;
+            continue;
+        }
+
+        size_t take = tar->remaining < len ? (size_t)tar->remaining : len;
+        if (tar->state == TAR_STATE_FILE) {
+            DWORD written = 0;
+            if (!WriteFile(tar->file, p, (DWORD)take, &written, NULL) || written != (DWORD)take) {
+                SetTarError(tar->error, sizeof(tar->error), "Local write failed (error %lu)", GetLastError());
+                return 0;
+            }
+            tar->bytes += take;
+        } else if (tar->state == TAR_STATE_META) {
+            memcpy(tar->meta + tar->meta_fill, p, take);
+            tar->meta_fill += take;
+        }
+        tar->remaining -= take;
+        p += take;
+        len -= take;
+        if (tar->remaining == 0) FinishEntry(tar);
+    }
+    return 1;
+}
+
+// Release resources; 1 if the end-of-archive marker was seen
+int TarExtractorFinish(TarExtractor* tar) {
+    CloseExtractedFile(tar);
+    SAFE_FREE(tar->meta);
+    SAFE_FREE(tar->next_path);
+    // Some tars stop after a single zero block; accept that when nothing is pending
+    return tar->finished || (tar->zero_blocks == 1 && tar->state == TAR_STATE_HEADER && tar->header_fill == 0);
+}
+
+// ---------------------------------------------------------------------------
+// Writing
+// ---------------------------------------------------------------------------
+
+// Start an archive
+void TarWriterInit(TarWriter* tar, TarSinkFn sink, void* user_data) {
+    memset(tar, 0, sizeof(TarWriter));
+    tar->sink = sink;
+    tar->user_data = user_data;
+    tar->buffer = (char*)SafeMalloc(TAR_WRITE_BUFFER);
+}
+
+// Hand buffered bytes to the sink
+static int FlushTarWriter(TarWriter* tar) {
+    if (tar->fill == 0) return 1;
+    if (!tar->sink(tar->buffer, tar->fill, tar->user_data)) {
+        SetTarError(tar->error, sizeof(tar->error), "Connection to device lost");
+        return 0;
+    }
+    tar->fill = 0;
+    return 1;
+}
+
+// Append bytes (NULL: zeros)
+static int AppendTarBytes(TarWriter* tar, const void* data, size_t len) {
+    while (len > 0) {
+        if (tar->fill == TAR_WRITE_BUFFER && !FlushTarWriter(tar)) return 0;
+        size_t take = TAR_WRITE_BUFFER - tar->fill;
+        if (take > len) take = len;
+        if (data) {
+            memcpy(tar->buffer + tar->fill, data, take);
+            data = (const char*)data + take;
+        } else {
+            memset(tar->buffer + tar->fill, 0, take);
+        }
+        tar->fill += take;
+        len -= take;
+    }
+    return 1;
+}
+
+// Numeric field: octal when it fits, base-256 otherwise (GNU)
+static void PutTarNumber(unsigned char* field, size_t width, unsigned long long value) {
+    if (value < (1ULL << (3 * (width - 1)))) {
+        snprintf((char*)field, width, "%0*llo", (int)(width - 1), value);
+        return;
+    }
+    memset(field, 0, width);
+    for (size_t i = width - 1; i > 0; i--) {
+        field[i] = (unsigned char)(value & 0xFF);
+        value >>= 8;
+    }
+    field[0] = 0x80;
+}
+
+// Emit one header block
+static int WriteTarBlock(TarWriter* tar, const char* prefix, const char* name, char type,
+                         unsigned int mode, unsigned long long size, unsigned int mtime) {
+    unsigned char h[TAR_BLOCK_SIZE];
+    memset(h, 0, sizeof(h));
+
+    memcpy(h + TAR_NAME, name, strnlen(name, TAR_NAME_LEN));
+    if (prefix) memcpy(h + TAR_PREFIX, prefix, strnlen(prefix, TAR_PREFIX_LEN));
+    PutTarNumber(h + TAR_MODE, 8, mode);
+    PutTarNumber(h + TAR_UID, 8, 0);
+    PutTarNumber(h + TAR_GID, 8, 0);
+    PutTarNumber(h + TAR_SIZE, 12, size);
+    PutTarNumber(h + TAR_MTIME, 12, mtime);
+    h[TAR_TYPE] = (unsigned char)type;
+    memcpy(h + TAR_MAGIC, "ustar", 6);
+    memcpy(h + TAR_VERSION, "00", 2);
+    snprintf((char*)h + TAR_CHKSUM, 8, "%06o", TarChecksum(h));
+
+    return AppendTarBytes(tar, h, sizeof(h));
+}
+
+// Header for an entry, splitting into prefix/name or adding a GNU long name as needed
+static int WriteTarHeader(TarWriter* tar, const char* path, char type, unsigned int mode,
+                          unsigned long long size, unsigned int mtime) {
+    size_t len = strlen(path);
+    if (len <= TAR_NAME_LEN) return WriteTarBlock(tar, NULL, path, type, mode, size, mtime);
+
+    // ustar split at a '/' with both halves fitting
+    for (size_t i = len - 1; i > 0; i--) {
+        if (path[i] != '/') continue;
+        if (len - i - 1 > TAR_NAME_LEN) break;
+        if (i <= TAR_PREFIX_LEN && len - i - 1 > 0) {
+            char prefix[TAR_PREFIX_LEN + 1];
+            memcpy(prefix, path, i);
+            prefix[i] = '\0';
+            return WriteTarBlock(tar, prefix, path + i + 1, type, mode, size, mtime);
+        }
+    }
+
+    // GNU long name: a pseudo-entry holding the full path
+    if (!WriteTarBlock(tar, NULL, "././@LongLink", 'L', 0644, len + 1, 0) ||
+        !AppendTarBytes(tar, path, len + 1) ||
+        !AppendTarBytes(tar, NULL, (TAR_BLOCK_SIZE - (len + 1) % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE)) {
+        return 0;
+    }
+    return WriteTarBlock(tar, NULL, path, type, mode, size, mtime);
+}
+
+// Archive one regular file, streaming its content
+static int WriteTarFile(TarWriter* tar, const char* path, const char* local_path) {
+    HANDLE file = CreateFileA(local_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        SetTarError(tar->error, sizeof(tar->error), "Cannot open %s (error %lu)", local_path, GetLastError());
+        return 0;
+    }
+
+    LARGE_INTEGER file_size;
+    FILETIME write_time;
+    if (!GetFileSizeEx(file, &file_size) || !GetFileTime(file, NULL, NULL, &write_time)) {
+        SetTarError(tar->error, sizeof(tar->error), "Cannot read %s (error %lu)", local_path, GetLastError());
+        CloseHandle(file);
+        return 0;
+    }
+    unsigned long long size = (unsigned long long)file_size.QuadPart;
+
+    int ok = WriteTarHeader(tar, path, '0', 0644, size, FileTimeToUnixSeconds(&write_time));
+    unsigned long long left = size;
+    while (ok && left > 0) {
+        // Read straight into the writer buffer
+        if (tar->fill == TAR_WRITE_BUFFER && !FlushTarWriter(tar)) {
+            ok = 0;
+            break;
+        }
+        size_t room = TAR_WRITE_BUFFER - tar->fill;
+        DWORD want = (DWORD)(left < room ? left : room);
+        DWORD got = 0;
+        if (!ReadFile(file, tar->buffer + tar->fill, want, &got, NULL) || got == 0) {
+            // The file shrank or became unreadable; the header already promised `size` bytes
+            SetTarError(tar->error, sizeof(tar->error), "Cannot read %s (error %lu)", local_path, GetLastError());
+            ok = 0;
+            break;
+        }
+        tar->fill += got;
+        left -= got;
+        tar->bytes += got;
+        if (tar->progress) tar->progress(path, tar->bytes, tar->progress_total, tar->progress_data);
+    }
+    CloseHandle(file);
+
+    if (ok) ok = AppendTarBytes(tar, NULL, (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE);
+    if (ok) tar->files++;
+    return ok;
+}
+
+// Recurse below local_dir; archive names are prefix + entry name
+static int WriteTarFolder(TarWriter* tar, const char* local_dir, const char* prefix) {
+    char pattern[MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", local_dir);
+
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA(pattern, &find_data);
+    if (find == INVALID_HANDLE_VALUE) return 1;
+
+    int ok = 1;
+    do {
+        const char* name = find_data.cFileName;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        char local_path[MAX_PATH];
+        char path[MAX_PATH * 2];
+        if (snprintf(local_path, sizeof(local_path), "%s\\%s", local_dir, name) >= (int)sizeof(local_path)) {
+            SetTarError(tar->error, sizeof(tar->error), "Path too long: %s\\%s", local_dir, name);
+            ok = 0;
+            break;
+        }
+        snprintf(path, sizeof(path), "%s%s", prefix, name);
+
+        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            // Junctions and symlinked folders are not followed
+            if (find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) continue;
+
+            char dir_path[MAX_PATH * 2 + 1];
+            snprintf(dir_path, sizeof(dir_path), "%s/", path);
+            ok = WriteTarHeader(tar, dir_path, '5', 0755, 0, FileTimeToUnixSeconds(&find_data.ftLastWriteTime)) &&
+                 WriteTarFolder(tar, local_path, dir_path);
+            if (ok) tar->dirs++;
+        } else {
+            ok = WriteTarFile(tar, path, local_path);
+        }
+    } while (ok && FindNextFileA(find, &find_data));
+
+    FindClose(find);
+    return ok;
+}
+
+// Archive the contents of local_dir with names relative to it
+int TarWriteTree(TarWriter* tar, const char* local_dir) {
+    return WriteTarFolder(tar, local_dir, "");
+}
+
+// End-of-archive marker, final flush, release
+int TarWriterFinish(TarWriter* tar, int write_end) {
+    int ok = 1;
+    if (write_end) {
+        ok = AppendTarBytes(tar, NULL, TAR_BLOCK_SIZE * 2) && FlushTarWriter(tar);
+    }
+    SAFE_FREE(tar->buffer);
+    tar->fill = 0;
+    return ok;
+}
@@ -0,0 +1,89 @@
+#include "thread_pool.h"
+#include "utils.h"
+
+// Shared state of one RunParallel call
+typedef struct {
+    ParallelTask task;
+    void* context;
+    int count;
+    volatile LONG next;         // Next item to hand out
+    volatile LONG succeeded;
+} ParallelRun;
+
+// Per-thread argument
+typedef struct {
+    ParallelRun* run;
+    int worker;
+} ParallelWorker;
+
+// Pull items until none are left
+static void DrainItems(ParallelRun* run, int worker) {
+    while (1) {
+        LONG index = InterlockedIncrement(&run->next) - 1;
+        if (index >= run->count) break;
+
+        if (run->task(worker, (int)index, run->context)) {
+            InterlockedIncrement(&run->succeeded);
+        }
+    }
+}
+
+// Worker thread entry
+static DWORD WINAPI ParallelWorkerThread(LPVOID param) {
+    ParallelWorker* worker = (ParallelWorker*)param;
+    DrainItems(worker->run, worker->worker);
+    return 0;
+}
+
+// Run items 0..count-1 over up to max_workers threads
+int RunParallel(int count, int max_workers, ParallelTask task, void* context) {
+    if (count <= 0 || !task) return 0;
+
+    int workers = max_workers;
+    if (workers > count) workers = count;
+    if (workers > MAX_PARALLEL_WORKERS) workers = MAX_PARALLEL_WORKERS;
+    if (workers < 1) workers = 1;
+
+    ParallelRun run;
+    run.task = task;
+    run.context = context;
+    run.count = count;
+    run.next = 0;
+    run.succeeded = 0;
+
+    ParallelWorker params[MAX_PARALLEL_WORKERS];
+    HANDLE threads[MAX_PARALLEL_WORKERS];
+    int started = 0;
+
+    for (int i = 1; i < workers; i++) {
+        params[started].run = &run;
+        params[started].worker = i;
+        threads[started] = CreateThread(NULL, 0, ParallelWorkerThread, &params[started], 0, NULL);
+        if (!threads[started]) {
+            // Carry on with the workers we have; the calling thread always participates
+            break;
+        }
+        started++;
+    }
+
+    DrainItems(&run, 0);
+
+    if (started > 0) {
+        WaitForMultipleObjects((DWORD)started, threads, TRUE, INFINITE);
+        for (int i = 0; i < started; i++) {
+            CloseHandle(threads[i]);
+        }
+    }
+
+    return (int)run.succeeded;
+}
+
+// One worker per processor, within the RunParallel limit
+int ParallelWorkerCount(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+    if (count < 1) count = 1;
+    if (count > MAX_PARALLEL_WORKERS) count = MAX_PARALLEL_WORKERS;
+    return count;
+}
@@ -1,126 +1,15 @@
 #include "utils.h"
+#include "process_runner.h"
 #include <time.h>
 #include <sys/stat.h>
 
-// Read output from pipe into buffer (helper for RunProcess)
-static void ReadOutputToBuffer(HANDLE hRead, char** data, size_t* size) {
-    DWORD buffer_size = 4096;
-    *data = (char*)SafeMalloc(buffer_size);
-    *size = 0;
-
-    DWORD bytes_read;
-    char temp[4096];
-    while (ReadFile(hRead, temp, sizeof(temp), &bytes_read, NULL) && bytes_read > 0) {
-        if (*size + bytes_read >= buffer_size) {
-            buffer_size *= 2;
-            *data = (char*)SafeRealloc(*data, buffer_size);
-        }
-        memcpy(*data + *size, temp, bytes_read);
-        *size += bytes_read;
-    }
-
-    // Null-terminate
-    if (*size + 1 >= buffer_size) {
-        *data = (char*)SafeRealloc(*data, buffer_size + 1);
-    }
-    (*data)[*size] = '\0';
-}
-
 // Run generic process and capture output
 ProcessResult* RunProcess(const char* executable_path, const char* args[], int arg_count) {
     if (!executable_path || !args || arg_count < 0) {
         return NULL;
     }
 
-    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
-    HANDLE stdout_read, stdout_write;
-    HANDLE stderr_read, stderr_write;
-
-    // Create pipes for stdout and stderr
-    if (!CreatePipe(&stdout_read, &stdout_write, &sa, 0) ||
-        !CreatePipe(&stderr_read, &stderr_write, &sa, 0)) {
-        return NULL;
-    }
-
-    // Set read handles to not be inherited
-    SetHandleInformation(stdout_read, HANDLE_FLAG_INHERIT, 0);
-    SetHandleInformation(stderr_read, HANDLE_FLAG_INHERIT, 0);
-
-    // Build command line
-    size_t cmdline_size = strlen(executable_path) + 4; // +4 for quotes and space
-    for (int i = 0; i < arg_count; i++) {
-        cmdline_size += strlen(args[i]) + 3; // +3 for space and potential quotes
-    }
-
-    char* cmdline = (char*)SafeMalloc(cmdline_size);
-    snprintf(cmdline, cmdline_size, "\"%s\"", executable_path);
-    for (int i = 0; i < arg_count; i++) {
-        strcat(cmdline, " ");
-        // Quote arguments that contain spaces
-        if (strchr(args[i], ' ')) {
-            strcat(cmdline, "\"");
-            strcat(cmdline, args[i]);
-            strcat(cmdline, "\"");
-        } else {
-            strcat(cmdline, args[i]);
-        }
-    }
-
-    // Setup startup info
-    STARTUPINFOA si = { sizeof(STARTUPINFOA) };
-    si.dwFlags = STARTF_USESTDHANDLES;
-    si.hStdOutput = stdout_write;
-    si.hStdError = stderr_write;
-    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
-
-    PROCESS_INFORMATION pi = {0};
-
-    // Create process
-    BOOL success = CreateProcessA(
-        NULL,
-        cmdline,
-        NULL,
-        NULL,
-        TRUE,
-        CREATE_NO_WINDOW,
-        NULL,
-        NULL,
-        &si,
-        &pi
-    );
-
-    // Close write ends (we only read)
-    CloseHandle(stdout_write);
-    CloseHandle(stderr_write);
-
-    if (!success) {
-        CloseHandle(stdout_read);
-        CloseHandle(stderr_read);
-        free(cmdline);
-        return NULL;
-    }
-
-    // Allocate result structure
-    ProcessResult* result = (ProcessResult*)SafeCalloc(1, sizeof(ProcessResult));
-
-    // Read output
-    ReadOutputToBuffer(stdout_read, &result->stdout_data, &result->stdout_size);
-    ReadOutputToBuffer(stderr_read, &result->stderr_data, &result->stderr_size);
-
-    // Wait for process to finish
-    WaitForSingleObject(pi.hProcess, INFINITE);
-    DWORD exit_code;
-    GetExitCodeProcess(pi.hProcess, &exit_code);
-    result->exit_code = (int)exit_code;
-
-    // Cleanup
-    CloseHandle(stdout_read);
-    CloseHandle(stderr_read);
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-    free(cmdline);
-
-    return result;
+    return RunProcessEx(executable_path, args, arg_count, NULL);
 }
 
 // Trim whitespace from both ends of string
@@ -175,6 +64,34 @@ int StringStartsWith(const char* str, const char* prefix) {
     return strncmp(str, prefix, strlen(prefix)) == 0;
 }
 
+// FNV-1a hash of a string (serials, property and variable names)
+unsigned int HashString(const char* str) {
+    unsigned int hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Whether a partition name ends in a slot suffix (_a or _b)
+int HasSlotSuffix(const char* name) {
+    size_t len = strlen(name);
+    return len > 2 && name[len - 2] == '_' && (name[len - 1] == 'a' || name[len - 1] == 'b');
+}
+
+// Read a big-endian value
+unsigned long long GetBE64(const unsigned char* p) {
+    unsigned long long value = 0;
+    for (int i = 0; i < 8; i++) value = (value << 8) | p[i];
+    return value;
+}
+
+// Read a big-endian value
+unsigned int GetBE32(const unsigned char* p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
 // Calculate Levenshtein distance between two strings
 int LevenshteinDistance(const char* s1, const char* s2) {
     int len1 = (int)strlen(s1);
@@ -352,3 +269,18 @@ void GetCurrentTimestamp(char* buffer, size_t buffer_size) {
     struct tm* tm_info = localtime(&now);
     strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", tm_info);
 }
+
+// FILETIME to Unix seconds
+unsigned int FileTimeToUnixSeconds(const FILETIME* ft) {
+    unsigned long long ticks = ((unsigned long long)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+    return ticks > FILETIME_UNIX_EPOCH ? (unsigned int)((ticks - FILETIME_UNIX_EPOCH) / 10000000ULL) : 0;
+}
+
+// Unix seconds to FILETIME
+FILETIME UnixSecondsToFileTime(unsigned int seconds) {
+    unsigned long long ticks = (unsigned long long)seconds * 10000000ULL + FILETIME_UNIX_EPOCH;
+    FILETIME ft;
+    ft.dwLowDateTime = (DWORD)ticks;
+    ft.dwHighDateTime = (DWORD)(ticks >> 32);
+    return ft;
+}
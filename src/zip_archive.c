@@ -0,0 +1,385 @@
+#include "zip_archive.h"
+#include "utils.h"
+
+#define ZIP_LOCAL_MAGIC 0x04034b50
+#define ZIP_CENTRAL_MAGIC 0x02014b50
+#define ZIP_END_MAGIC 0x06054b50
+#define ZIP64_END_MAGIC 0x06064b50
+#define ZIP64_LOCATOR_MAGIC 0x07064b50
+
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_SIZE 22
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP64_END_SIZE 56
+// The end record sits behind a comment of at most 64 KB
+#define ZIP_END_SEARCH (ZIP_END_SIZE + 0xffff)
+
+// Entry data read per call while extracting
+#define ZIP_READ_CHUNK (256 * 1024)
+
+// Read a little-endian value
+static unsigned int GetLE16(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+// Read a little-endian value
+static unsigned int GetLE32(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Read a little-endian value
+static unsigned long long GetLE64(const unsigned char* p) {
+    return (unsigned long long)GetLE32(p) | ((unsigned long long)GetLE32(p + 4) << 32);
+}
+
+// Read exactly len bytes at an offset from the archive start
+static int ReadAt(ZipArchive* zip, unsigned long long offset, void* buffer, size_t len) {
+    if (offset > zip->length || len > zip->length - offset) {
+        snprintf(zip->error, sizeof(zip->error), "%s is truncated", zip->path);
+        return 0;
+    }
+
+    unsigned char* out = (unsigned char*)buffer;
+    offset += zip->base;
+    while (len > 0) {
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+        DWORD want = len > 0x40000000 ? 0x40000000 : (DWORD)len;
+        DWORD got = 0;
+        if (!ReadFile(zip->file, out, want, &got, &overlapped) || got == 0) {
+            snprintf(zip->error, sizeof(zip->error), "Cannot read %s (error %lu)", zip->path, GetLastError());
+            return 0;
+        }
+        out += got;
+        offset += got;
+        len -= got;
+    }
+    return 1;
+}
+
+// ============================================================================
+// Central Directory
+// ============================================================================
+
+// Locate the central directory through the end record (and its ZIP64 form)
+static int FindCentralDirectory(ZipArchive* zip, unsigned long long* offset, unsigned long long* size,
+                                unsigned long long* count) {
+    size_t tail = zip->length < ZIP_END_SEARCH ? (size_t)zip->length : ZIP_END_SEARCH;
+    if (tail < ZIP_END_SIZE) {
+        snprintf(zip->error, sizeof(zip->error), "%s is not a zip archive", zip->path);
+        return 0;
+    }
+    unsigned char* buffer = (unsigned char*)SafeMalloc(tail);
+    unsigned long long tail_start = zip->length - tail;
+    if (!ReadAt(zip, tail_start, buffer, tail)) {
+        free(buffer);
+        return 0;
+    }
+
+    size_t end = tail - ZIP_END_SIZE + 1;
+    while (end-- > 0) {
+        if (GetLE32(buffer + end) == ZIP_END_MAGIC) break;
+    }
+    if (end == (size_t)-1) {
+        snprintf(zip->error, sizeof(zip->error), "%s is not a zip archive", zip->path);
+        free(buffer);
+        return 0;
+    }
+
+    *count = GetLE16(buffer + end + 10);
+    *size = GetLE32(buffer + end + 12);
+    *offset = GetLE32(buffer + end + 16);
+    unsigned long long end_offset = tail_start + end;
+    free(buffer);
+
+    if (*count != 0xffff && *size != 0xffffffffULL && *offset != 0xffffffffULL) return 1;
+
+    // ZIP64: a locator right before the end record points at the 64-bit end record
+    unsigned char locator[ZIP64_LOCATOR_SIZE];
+    unsigned char record[ZIP64_END_SIZE];
+    if (end_offset < ZIP64_LOCATOR_SIZE || !ReadAt(zip, end_offset - ZIP64_LOCATOR_SIZE, locator, sizeof(locator)) ||
+        GetLE32(locator) != ZIP64_LOCATOR_MAGIC || !ReadAt(zip, GetLE64(locator + 8), record, sizeof(record)) ||
+        GetLE32(record) != ZIP64_END_MAGIC) {
+        snprintf(zip->error, sizeof(zip->error), "%s has a damaged ZIP64 directory", zip->path);
+        return 0;
+    }
+    *count = GetLE64(record + 32);
+    *size = GetLE64(record + 40);
+    *offset = GetLE64(record + 48);
+    return 1;
+}
+
+// Replace saturated 32-bit fields with the values of the ZIP64 extra field
+static void ApplyZip64Extra(ZipEntry* entry, const unsigned char* extra, size_t len) {
+    size_t pos = 0;
+    while (pos + 4 <= len) {
+        unsigned int id = GetLE16(extra + pos);
+        unsigned int field_len = GetLE16(extra + pos + 2);
+        const unsigned char* field = extra + pos + 4;
+        if (pos + 4 + field_len > len) return;
+
+        if (id == 0x0001) {
+            size_t used = 0;
+            if (entry->size == 0xffffffffULL && used + 8 <= field_len) {
+                entry->size = GetLE64(field + used);
+                used += 8;
+            }
+            if (entry->compressed_size == 0xffffffffULL && used + 8 <= field_len) {
+                entry->compressed_size = GetLE64(field + used);
+                used += 8;
+            }
+            if (entry->header_offset == 0xffffffffULL && used + 8 <= field_len) {
+                entry->header_offset = GetLE64(field + used);
+            }
+            return;
+        }
+        pos += 4 + field_len;
+    }
+}
+
+// Load the entry list
+static int ReadCentralDirectory(ZipArchive* zip) {
+    unsigned long long offset, size, count;
+    if (!FindCentralDirectory(zip, &offset, &size, &count)) return 0;
+    if (size > 256ULL * 1024 * 1024 || count > size / ZIP_CENTRAL_HEADER_SIZE) {
+        snprintf(zip->error, sizeof(zip->error), "%s has a damaged directory", zip->path);
+        return 0;
+    }
+
+    unsigned char* directory = (unsigned char*)SafeMalloc((size_t)size + 1);
+    if (!ReadAt(zip, offset, directory, (size_t)size)) {
+        free(directory);
+        return 0;
+    }
+
+    zip->entries = (ZipEntry*)SafeCalloc((size_t)count + 1, sizeof(ZipEntry));
+    size_t pos = 0;
+    for (unsigned long long i = 0; i < count; i++) {
+        const unsigned char* header = directory + pos;
+        if (pos + ZIP_CENTRAL_HEADER_SIZE > size || GetLE32(header) != ZIP_CENTRAL_MAGIC) break;
+        unsigned int name_len = GetLE16(header + 28);
+        unsigned int extra_len = GetLE16(header + 30);
+        unsigned int comment_len = GetLE16(header + 32);
+        if (pos + ZIP_CENTRAL_HEADER_SIZE + name_len + extra_len + comment_len > size) break;
+
+        ZipEntry* entry = &zip->entries[zip->count++];
+        size_t copy = name_len < sizeof(entry->name) - 1 ? name_len : sizeof(entry->name) - 1;
+        memcpy(entry->name, header + ZIP_CENTRAL_HEADER_SIZE, copy);
+        entry->name[copy] = '\0';
+        entry->flags = (unsigned short)GetLE16(header + 8);
+        entry->method = (unsigned short)GetLE16(header + 10);
+        entry->crc32 = GetLE32(header + 16);
+        entry->compressed_size = GetLE32(header + 20);
+        entry->size = GetLE32(header + 24);
+        entry->header_offset = GetLE32(header + 42);
+        ApplyZip64Extra(entry, header + ZIP_CENTRAL_HEADER_SIZE + name_len, extra_len);
+
+        pos += ZIP_CENTRAL_HEADER_SIZE + name_len + extra_len + comment_len;
+    }
+    free(directory);
+
+    if ((unsigned long long)zip->count != count) {
+        snprintf(zip->error, sizeof(zip->error), "%s has a damaged directory", zip->path);
+        return 0;
+    }
+    return 1;
+}
+
+// Open a byte range of a file as an archive
+static int OpenRange(ZipArchive* zip, const char* path, unsigned long long base, unsigned long long length) {
+    memset(zip, 0, sizeof(*zip));
+    snprintf(zip->path, sizeof(zip->path), "%s", path);
+    zip->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (zip->file == INVALID_HANDLE_VALUE) {
+        snprintf(zip->error, sizeof(zip->error), "Cannot open %s (error %lu)", path, GetLastError());
+        return 0;
+    }
+
+    if (length == 0) {
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(zip->file, &file_size)) {
+            snprintf(zip->error, sizeof(zip->error), "Cannot read the size of %s", path);
+            ZipClose(zip);
+            return 0;
+        }
+        length = (unsigned long long)file_size.QuadPart;
+    }
+    zip->base = base;
+    zip->length = length;
+
+    if (!ReadCentralDirectory(zip)) {
+        char error[sizeof(zip->error)];
+        snprintf(error, sizeof(error), "%s", zip->error);
+        ZipClose(zip);
+        snprintf(zip->error, sizeof(zip->error), "%s", error);
+        return 0;
+    }
+    return 1;
+}
+
+// Open a zip file
+int ZipOpen(ZipArchive* zip, const char* path) {
+    if (!zip || !path) return 0;
+    return OpenRange(zip, path, 0, 0);
+}
+
+// Where an entry's data starts, past its local header
+static int EntryDataOffset(ZipArchive* zip, const ZipEntry* entry, unsigned long long* offset) {
+    unsigned char header[ZIP_LOCAL_HEADER_SIZE];
+    if (!ReadAt(zip, entry->header_offset, header, sizeof(header))) return 0;
+    if (GetLE32(header) != ZIP_LOCAL_MAGIC) {
+        snprintf(zip->error, sizeof(zip->error), "Damaged entry %s", entry->name);
+        return 0;
+    }
+    *offset = entry->header_offset + ZIP_LOCAL_HEADER_SIZE + GetLE16(header + 26) + GetLE16(header + 28);
+    if (*offset > zip->length || entry->compressed_size > zip->length - *offset) {
+        snprintf(zip->error, sizeof(zip->error), "Damaged entry %s", entry->name);
+        return 0;
+    }
+    return 1;
+}
+
+// Where an entry's bytes (compressed or not) start in the file
+int ZipEntryDataOffset(ZipArchive* zip, const ZipEntry* entry, unsigned long long* offset) {
+    if (!zip || !entry || !offset) return 0;
+    if (!EntryDataOffset(zip, entry, offset)) return 0;
+    *offset += zip->base;
+    return 1;
+}
+
+// Where a stored entry's bytes start in the file
+int ZipStoredEntryOffset(ZipArchive* zip, const ZipEntry* entry, unsigned long long* offset) {
+    if (!zip || !entry || !offset) return 0;
+    if (entry->method != 0) {
+        snprintf(zip->error, sizeof(zip->error), "%s is compressed", entry->name);
+        return 0;
+    }
+    return ZipEntryDataOffset(zip, entry, offset);
+}
+
+// Open an archive stored inside another one without extracting it
+int ZipOpenNested(ZipArchive* zip, ZipArchive* outer, const ZipEntry* entry) {
+    if (!zip || !outer || !entry) return 0;
+
+    unsigned long long offset = 0;
+    if (entry->method != 0 || !EntryDataOffset(outer, entry, &offset)) {
+        memset(zip, 0, sizeof(*zip));
+        zip->file = INVALID_HANDLE_VALUE;
+        snprintf(zip->error, sizeof(zip->error), "%s", entry->method != 0 ? "Nested archive is compressed" : outer->error);
+        return 0;
+    }
+    return OpenRange(zip, outer->path, outer->base + offset, entry->size);
+}
+
+// Release the archive
+void ZipClose(ZipArchive* zip) {
+    if (!zip) return;
+    if (zip->file && zip->file != INVALID_HANDLE_VALUE) CloseHandle(zip->file);
+    free(zip->entries);
+    zip->file = INVALID_HANDLE_VALUE;
+    zip->entries = NULL;
+    zip->count = 0;
+}
+
+// Find an entry by path or file name
+const ZipEntry* ZipFindEntry(const ZipArchive* zip, const char* name) {
+    if (!zip || !name) return NULL;
+
+    int by_file_name = strchr(name, '/') == NULL;
+    for (int i = 0; i < zip->count; i++) {
+        const char* candidate = zip->entries[i].name;
+        if (by_file_name) {
+            const char* slash = strrchr(candidate, '/');
+            if (slash) candidate = slash + 1;
+        }
+        if (_stricmp(candidate, name) == 0) return &zip->entries[i];
+    }
+    return NULL;
+}
+
+// ============================================================================
+// Extraction
+// ============================================================================
+
+// Extraction state shared by the read and write callbacks
+typedef struct {
+    ZipArchive* zip;
+    unsigned long long offset;          // Next compressed byte
+    unsigned long long left;            // Compressed bytes not read yet
+    DecompressWriteFn write;
+    void* user_data;
+    unsigned int crc;
+    unsigned long long written;
+    unsigned int crc_table[256];
+} ZipReader;
+
+// DecompressReadFn over the entry's compressed bytes
+static int ReadEntryData(void* buffer, size_t size, void* user_data) {
+    ZipReader* reader = (ZipReader*)user_data;
+    if (reader->left == 0) return 0;
+
+    size_t want = size < ZIP_READ_CHUNK ? size : ZIP_READ_CHUNK;
+    if (want > reader->left) want = (size_t)reader->left;
+    if (!ReadAt(reader->zip, reader->offset, buffer, want)) return -1;
+    reader->offset += want;
+    reader->left -= want;
+    return (int)want;
+}
+
+// DecompressWriteFn: checksum the output and pass it on
+static int WriteEntryData(const void* data, size_t len, void* user_data) {
+    ZipReader* reader = (ZipReader*)user_data;
+    const unsigned char* bytes = (const unsigned char*)data;
+    unsigned int crc = reader->crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = reader->crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    reader->crc = crc;
+    reader->written += len;
+    return reader->write(data, len, reader->user_data);
+}
+
+// Stream one entry out
+int ZipExtractEntry(ZipArchive* zip, const ZipEntry* entry, DecompressWriteFn write, void* user_data) {
+    if (!zip || !entry || !write) return 0;
+    if (entry->flags & 0x0001) {
+        snprintf(zip->error, sizeof(zip->error), "%s is encrypted", entry->name);
+        return 0;
+    }
+    if (entry->method != 0 && entry->method != 8) {
+        snprintf(zip->error, sizeof(zip->error), "%s uses unsupported compression method %u",
+                 entry->name, entry->method);
+        return 0;
+    }
+
+    ZipReader* reader = (ZipReader*)SafeCalloc(1, sizeof(ZipReader));
+    reader->zip = zip;
+    reader->left = entry->compressed_size;
+    reader->write = write;
+    reader->user_data = user_data;
+    reader->crc = 0xffffffffu;
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned int c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        reader->crc_table[i] = c;
+    }
+
+    char error[256] = "";
+    int ok = EntryDataOffset(zip, entry, &reader->offset);
+    if (ok) {
+        ok = DecompressStream(entry->method == 8 ? COMPRESSION_DEFLATE : COMPRESSION_NONE,
+                              ReadEntryData, reader, WriteEntryData, reader, error, sizeof(error));
+        if (!ok) snprintf(zip->error, sizeof(zip->error), "%s: %s", entry->name, error[0] ? error : "extraction failed");
+    }
+    if (ok && (reader->written != entry->size || (reader->crc ^ 0xffffffffu) != entry->crc32)) {
+        snprintf(zip->error, sizeof(zip->error), "%s is corrupt (CRC or size mismatch)", entry->name);
+        ok = 0;
+    }
+
+    free(reader);
+    return ok;
+}
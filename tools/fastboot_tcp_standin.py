@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+"""Fake fastboot-over-TCP device for exercising FolkADB's native fastboot client
+without hardware.
+
+Speaks the same wire format as a real device in network fastboot: the "FB01"
+handshake, then every message framed with a big-endian 64-bit length. It keeps
+partitions in memory, expands sparse images as they are flashed, and answers
+the variables FolkADB reads (getvar all, partition-size, is-logical, slots).
+
+Usage:
+    python tools/fastboot_tcp_standin.py [--port 5554] [--max-download 0x400000]
+                                         [--userspace] [--no-sizes]
+                                         [--slow-erase SECONDS] [--hang-var NAME]
+
+Then, inside FolkADB:
+    fb connect 127.0.0.1:5554
+    fb getvar all
+    fb flash boot boot.img
+
+--no-sizes mimics bootloaders that report no partition-size variables.
+--slow-erase and --hang-var make the device go quiet, to check that the client
+keeps waiting on slow commands and gives up on a device that stops answering.
+
+Beyond the real protocol, "getvar:standin-sha256:<partition>" returns the
+SHA-256 of what the stand-in holds for a partition, so a test can check the
+bytes that arrived (sparse images are held as whole blocks, so an image sent
+sparse hashes as if zero-padded to its block size).
+"""
+
+import argparse
+import hashlib
+import socket
+import struct
+import threading
+import time
+
+SPARSE_MAGIC = 0xED26FF3A
+CHUNK_RAW = 0xCAC1
+CHUNK_FILL = 0xCAC2
+CHUNK_DONT_CARE = 0xCAC3
+CHUNK_CRC32 = 0xCAC4
+
+# Physical partitions (slotted ones get _a and _b) and the logical ones in super
+PHYSICAL = {"boot": 64 << 20, "init_boot": 8 << 20, "vendor_boot": 64 << 20, "dtbo": 16 << 20,
+            "vbmeta": 64 << 10, "super": 4 << 30, "userdata": 32 << 30, "metadata": 16 << 20,
+            "cache": 256 << 20}
+SLOTTED = {"boot", "init_boot", "vendor_boot", "dtbo", "vbmeta"}
+LOGICAL = {"system": 2 << 30, "vendor": 1 << 30, "product": 1 << 30}
+
+
+class Device:
+    def __init__(self, options):
+        self.options = options
+        self.lock = threading.Lock()
+        self.current_slot = "a"
+        self.partitions = {}            # Name -> bytearray of what was flashed
+        self.sizes = {}
+        for name, size in PHYSICAL.items():
+            for full in ([name + "_a", name + "_b"] if name in SLOTTED else [name]):
+                self.sizes[full] = size
+        if options.userspace:
+            for name, size in LOGICAL.items():
+                self.sizes[name + "_a"] = size
+                self.sizes[name + "_b"] = size
+
+    def resolve(self, name):
+        # "boot" means the current slot's copy, like a real bootloader
+        if name not in self.sizes and name + "_" + self.current_slot in self.sizes:
+            return name + "_" + self.current_slot
+        return name
+
+    def variables(self):
+        values = [("product", "standin"), ("version", "0.4"),
+                  ("max-download-size", "0x%x" % self.options.max_download),
+                  ("is-userspace", "yes" if self.options.userspace else "no"),
+                  ("current-slot", self.current_slot), ("slot-count", "2")]
+        for name in sorted(self.sizes):
+            if not self.options.no_sizes:
+                values.append(("partition-size:" + name, "0x%x" % self.sizes[name]))
+            if self.options.userspace:
+                logical = name.rsplit("_", 1)[0] in LOGICAL
+                values.append(("is-logical:" + name, "yes" if logical else "no"))
+        for name in sorted(SLOTTED):
+            values.append(("has-slot:" + name, "yes"))
+        return values
+
+    def getvar(self, name):
+        if name.startswith("standin-sha256:"):
+            data = self.partitions.get(self.resolve(name[15:]), bytearray())
+            return hashlib.sha256(data).hexdigest()
+        for key, value in self.variables():
+            if key == name:
+                return value
+        return None
+
+    def flash(self, name, data):
+        name = self.resolve(name)
+        if name not in self.sizes:
+            return "partition does not exist"
+        if len(data) >= 28 and struct.unpack("<I", data[:4])[0] == SPARSE_MAGIC:
+            return self.flash_sparse(name, data)
+        if len(data) > self.sizes[name]:
+            return "image is larger than the partition"
+        self.partitions[name] = bytearray(data)
+        print("flash %s: %d raw bytes" % (name, len(data)), flush=True)
+        return None
+
+    def flash_sparse(self, name, data):
+        # Images over max-download-size arrive as several sparse pieces of one partition
+        (_, _, _, file_header, chunk_header, block_size, total_blocks, chunk_count,
+         _) = struct.unpack("<IHHHHIIII", data[:28])
+        if total_blocks * block_size > self.sizes[name]:
+            return "image is larger than the partition"
+        out = self.partitions.setdefault(name, bytearray())
+        if len(out) < total_blocks * block_size:
+            out.extend(bytes(total_blocks * block_size - len(out)))
+
+        offset = file_header
+        block = 0
+        for _ in range(chunk_count):
+            kind, _, blocks, total = struct.unpack("<HHII", data[offset:offset + 12])
+            body = data[offset + chunk_header:offset + total]
+            start, end = block * block_size, (block + blocks) * block_size
+            if kind == CHUNK_RAW:
+                if len(body) != blocks * block_size:
+                    return "raw chunk has the wrong length"
+                out[start:end] = body
+            elif kind == CHUNK_FILL:
+                out[start:end] = body[:4] * (blocks * block_size // 4)
+            elif kind not in (CHUNK_DONT_CARE, CHUNK_CRC32):
+                return "unknown sparse chunk type 0x%x" % kind
+            if kind != CHUNK_CRC32:
+                block += blocks
+            offset += total
+        if block != total_blocks or offset != len(data):
+            return "sparse image does not add up"
+        print("flash %s: sparse piece of %d bytes, %d chunks" % (name, len(data), chunk_count), flush=True)
+        return None
+
+
+def receive(conn, size):
+    data = bytearray()
+    while len(data) < size:
+        piece = conn.recv(size - len(data))
+        if not piece:
+            raise EOFError
+        data += piece
+    return bytes(data)
+
+
+def read_message(conn):
+    return receive(conn, struct.unpack(">Q", receive(conn, 8))[0])
+
+
+def write_message(conn, message):
+    conn.sendall(struct.pack(">Q", len(message)) + message)
+
+
+def serve(conn, device):
+    options = device.options
+    pending = b""
+    try:
+        if receive(conn, 4) != b"FB01":
+            return
+        conn.sendall(b"FB01")
+        while True:
+            command = read_message(conn).decode("utf-8", "replace")
+            print("<", command, flush=True)
+
+            if options.hang_var and command == "getvar:" + options.hang_var:
+                time.sleep(3600)
+            elif command == "getvar:all":
+                with device.lock:
+                    for key, value in device.variables():
+                        write_message(conn, ("INFO%s:%s" % (key, value)).encode())
+                write_message(conn, b"OKAY")
+            elif command.startswith("getvar:"):
+                with device.lock:
+                    value = device.getvar(command[7:])
+                write_message(conn, b"FAILVariable not implemented" if value is None else b"OKAY" + value.encode())
+            elif command.startswith("download:"):
+                size = int(command[9:], 16)
+                if size > options.max_download:
+                    write_message(conn, b"FAILdata too large")
+                    continue
+                write_message(conn, b"DATA%08x" % size)
+                data = bytearray()
+                while len(data) < size:
+                    data += read_message(conn)
+                pending = bytes(data)
+                write_message(conn, b"OKAY")
+            elif command.startswith("flash:"):
+                with device.lock:
+                    error = device.flash(command[6:], pending)
+                if error:
+                    write_message(conn, b"FAIL" + error.encode())
+                else:
+                    write_message(conn, b"INFOwriting '%s'..." % command[6:].encode())
+                    write_message(conn, b"OKAY")
+            elif command.startswith("erase:"):
+                if options.slow_erase:
+                    time.sleep(options.slow_erase)
+                with device.lock:
+                    name = device.resolve(command[6:])
+                    known = name in device.sizes
+                    device.partitions.pop(name, None)
+                write_message(conn, b"OKAY" if known else b"FAILpartition does not exist")
+            elif command.startswith("set_active:"):
+                slot = command[11:].lstrip("_")
+                if slot in ("a", "b"):
+                    with device.lock:
+                        device.current_slot = slot
+                    write_message(conn, b"OKAY")
+                else:
+                    write_message(conn, b"FAILinvalid slot")
+            elif command.startswith("oem "):
+                write_message(conn, b"INFOstand-in ignores '%s'" % command[4:].encode())
+                write_message(conn, b"OKAY")
+            elif command.startswith("reboot"):
+                write_message(conn, b"OKAY")
+                break
+            else:
+                write_message(conn, b"FAILunknown command")
+    except (EOFError, ConnectionError):
+        pass
+    finally:
+        conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fake fastboot device over TCP")
+    parser.add_argument("--port", type=int, default=5554)
+    parser.add_argument("--max-download", type=lambda text: int(text, 0), default=0x400000,
+                        help="max-download-size to report (default 0x400000)")
+    parser.add_argument("--userspace", action="store_true", help="act as fastbootd (lists logical partitions)")
+    parser.add_argument("--no-sizes", action="store_true", help="report no partition-size variables")
+    parser.add_argument("--slow-erase", type=float, default=0, help="seconds each erase takes")
+    parser.add_argument("--hang-var", help="getvar name that never gets a reply")
+    options = parser.parse_args()
+
+    device = Device(options)
+    server = socket.socket()
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(("127.0.0.1", options.port))
+    server.listen(5)
+    print("fastboot stand-in listening on tcp:127.0.0.1:%d" % options.port, flush=True)
+    while True:
+        conn, _ = server.accept()
+        threading.Thread(target=serve, args=(conn, device), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()